@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include <framework/status.h>
+
+namespace bench {
+
+typedef fw::Status (*bench_fn)();
+
+// This class is used by the REGISTER_BENCH macro to register a benchmark at startup. Benchmarks are then run by name
+// from the command-line, e.g. "bench --bench=path-find".
+class BenchRegistrar {
+public:
+  BenchRegistrar(std::string_view name, bench_fn fn);
+};
+
+// Runs the benchmark with the given name, or all of them if name is "all".
+fw::Status run_bench(std::string_view name);
+
+// Prints a single result line from a benchmark, in a format that's easy to compare between runs.
+void report(std::string_view bench_name, std::string_view metric, double value, std::string_view units);
+
+#define REGISTER_BENCH(name, fn) \
+  bench::BenchRegistrar bench_registrar_##fn(name, fn)
+
+}
@@ -0,0 +1,67 @@
+#include <bench/bench_world.h>
+
+#include <framework/framework.h>
+
+#include <game/simulation/replay.h>
+#include <game/simulation/simulation_thread.h>
+#include <game/world/world_reader.h>
+
+namespace bench {
+namespace {
+
+// A WorldReader that doesn't read anything, it just makes a flat terrain.
+class FlatWorldReader : public game::WorldReader {
+public:
+  explicit FlatWorldReader(int map_size) {
+    terrain_ = std::make_shared<game::HeadlessTerrain>(map_size, map_size, nullptr);
+  }
+};
+
+fw::Status initialize_framework() {
+  static fw::ToolApplication *app = nullptr;
+  if (app != nullptr) {
+    return fw::OkStatus();
+  }
+
+  app = new fw::ToolApplication();
+  new fw::Framework(app);
+  ASSIGN_OR_RETURN(bool should_continue, fw::Framework::get_instance()->initialize("bench"));
+  if (!should_continue) {
+    return fw::ErrorStatus("framework didn't initialize");
+  }
+  return fw::OkStatus();
+}
+
+}
+
+BenchWorld::BenchWorld(int map_size) :
+    HeadlessWorld(std::make_shared<FlatWorldReader>(map_size)) {
+}
+
+BenchWorld::~BenchWorld() {
+}
+
+void BenchWorld::initialize_pathing() {
+}
+
+fw::StatusOr<std::unique_ptr<BenchWorld>> create_bench_world(int map_size, int num_players) {
+  RETURN_IF_ERROR(initialize_framework());
+
+  game::ReplayHeader header;
+  header.map_name = "bench";
+  header.seed = 1234;
+  header.local_player_no = 1;
+  for (int i = 0; i < num_players; i++) {
+    game::ReplayPlayerInfo info;
+    info.player_no = static_cast<uint8_t>(i + 1);
+    info.user_name = "player";
+    header.players.push_back(info);
+  }
+  game::SimulationThread::get_instance()->start_playback(header);
+
+  auto world = std::make_unique<BenchWorld>(map_size);
+  world->initialize();
+  return world;
+}
+
+}
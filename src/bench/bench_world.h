@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+
+#include <framework/status.h>
+
+#include <game/world/headless_world.h>
+
+namespace bench {
+
+// A flat, empty game::HeadlessWorld, so that benchmarks can run the real entities without a map on disk. There are no
+// pathing threads: nothing the benchmarks create has a PathingComponent. The World is a singleton, so only one of
+// these can exist at a time.
+class BenchWorld : public game::HeadlessWorld {
+protected:
+  void initialize_pathing() override;
+
+public:
+  explicit BenchWorld(int map_size);
+  virtual ~BenchWorld();
+};
+
+// Sets up everything the real entities need: a headless fw::Framework (the first time this is called), the given
+// number of players in the SimulationThread (as if we were playing back a replay), and a BenchWorld of the given size.
+// The entities are created from prototypes the benchmark gives the EntityManager (see
+// ent::EntityManager::set_prototype), since we don't have the Lua templates.
+fw::StatusOr<std::unique_ptr<BenchWorld>> create_bench_world(int map_size, int num_players);
+
+}
@@ -0,0 +1,345 @@
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/math.h>
+#include <framework/net.h>
+#include <framework/packet.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <game/simulation/commands.h>
+#include <game/simulation/packets.h>
+
+#include <bench/bench.h>
+#include <bench/bench_world.h>
+
+// Runs a full mesh of peers in one process, each with its own fw::net::Host on 127.0.0.1, and sends a few hundred turns
+// of CreateEntityCommands and the odd chat message between them in the game's own CommandPackets, HeartbeatPackets and
+// ChatPackets. We do it twice: once the way we used to (a CommandPacket serialized for each peer every turn, even with
+// no commands in it, and chat sent as soon as it was typed), and once the way SimulationThread does now (each turn's
+// game::TurnPackets serialized once and shared by every peer, a heartbeat for turns with no commands, and the turn's
+// chat and commands flushed together). Most turns have no commands, like a real game. We report the packets, bytes and
+// UDP datagrams per second each peer sends, assuming kTurnLengthMs turns, how long each peer spends building and
+// sending its packets each turn, and check that everything sent was received.
+namespace {
+
+constexpr int kNumPeers = 8;
+constexpr int kMapSize = 64;
+constexpr int kMinPort = 29200;
+constexpr int kMaxPort = 29299;
+constexpr uint32_t kNumTurns = 300;
+constexpr float kTurnLengthMs = 100.0f;
+
+// Each peer has commands on one turn in this many, and sends a chat message one turn in kChatInterval.
+constexpr uint32_t kCommandInterval = 5;
+constexpr uint32_t kChatInterval = 50;
+constexpr int kMaxCommandsPerTurn = 3;
+
+constexpr auto kConnectTimeout = std::chrono::seconds(5);
+constexpr auto kDrainTimeout = std::chrono::seconds(10);
+
+enum class FanoutMode {
+  // A CommandPacket serialized for each peer every turn, and chat sent straight away.
+  kPerPeer,
+
+  // One TurnPackets per turn (see SimulationThread::enqueue_posted_commands), sent after the chat and flushed once.
+  kShared,
+};
+
+class FanoutPeer {
+private:
+  uint8_t player_no_;
+  FanoutMode mode_;
+  fw::net::Host host_;
+  std::vector<std::shared_ptr<fw::net::Peer>> peers_;
+  std::mt19937 rng_;
+
+  void on_packet(std::shared_ptr<fw::net::Packet> const &pkt) {
+    if (auto command_pkt = std::dynamic_pointer_cast<game::CommandPacket>(pkt)) {
+      turns_received++;
+      commands_received += static_cast<int>(command_pkt->get_commands().size());
+    } else if (std::dynamic_pointer_cast<game::HeartbeatPacket>(pkt)) {
+      turns_received++;
+    } else if (std::dynamic_pointer_cast<game::ChatPacket>(pkt)) {
+      chats_received++;
+    }
+  }
+
+public:
+  int turns_received = 0;
+  int commands_received = 0;
+  int chats_received = 0;
+  int commands_sent = 0;
+  int chats_sent = 0;
+
+  // The time we've spent building and sending our packets.
+  std::chrono::nanoseconds send_time { 0 };
+
+  FanoutPeer(uint8_t player_no, FanoutMode mode) : player_no_(player_no), mode_(mode), rng_(player_no * 104729) {
+  }
+
+  fw::Status listen() {
+    return host_.listen(kMinPort, kMaxPort);
+  }
+
+  int get_listen_port() const {
+    return host_.get_listen_port();
+  }
+
+  fw::net::Host &get_host() {
+    return host_;
+  }
+
+  void add_peer(std::shared_ptr<fw::net::Peer> const &peer) {
+    peer->set_handler([this](std::shared_ptr<fw::net::Packet> const &pkt) { on_packet(pkt); });
+    peer->set_wire_version(fw::net::kMaxWireVersion);
+    peers_.push_back(peer);
+  }
+
+  fw::Status connect(FanoutPeer &other) {
+    ASSIGN_OR_RETURN(auto peer, host_.connect(absl::StrCat("127.0.0.1:", other.get_listen_port())));
+    add_peer(peer);
+    return fw::OkStatus();
+  }
+
+  bool accept_connection() {
+    std::vector<std::shared_ptr<fw::net::Peer>> new_connections = host_.get_new_connections();
+    if (new_connections.empty()) {
+      return false;
+    }
+    add_peer(new_connections[0]);
+    return true;
+  }
+
+  bool is_connected() const {
+    if (peers_.size() != kNumPeers - 1) {
+      return false;
+    }
+    for (auto const &peer : peers_) {
+      if (!peer->is_connected()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  uint64_t get_packets_sent() const {
+    uint64_t packets_sent = 0;
+    for (auto const &peer : peers_) {
+      packets_sent += peer->get_packets_sent();
+    }
+    return packets_sent;
+  }
+
+  uint64_t get_bytes_sent() const {
+    uint64_t bytes_sent = 0;
+    for (auto const &peer : peers_) {
+      bytes_sent += peer->get_bytes_sent();
+    }
+    return bytes_sent;
+  }
+
+  // Sends our packets for the given turn.
+  void run_turn(uint32_t turn) {
+    std::vector<std::shared_ptr<game::Command>> commands;
+    if (turn % kCommandInterval == player_no_ % kCommandInterval) {
+      std::uniform_int_distribution<int> num_dist(1, kMaxCommandsPerTurn);
+      std::uniform_real_distribution<float> pos_dist(0.0f, static_cast<float>(kMapSize));
+      const int num_commands = num_dist(rng_);
+      for (int i = 0; i < num_commands; i++) {
+        std::shared_ptr<game::CreateEntityCommand> cmd = game::create_command<game::CreateEntityCommand>(player_no_);
+        cmd->template_name = "tank";
+        cmd->initial_position = fw::Vector(pos_dist(rng_), 0.0f, pos_dist(rng_));
+        cmd->initial_goal = fw::Vector(pos_dist(rng_), 0.0f, pos_dist(rng_));
+        cmd->quantize(game::get_command_position_exponent());
+        commands.push_back(cmd);
+      }
+    }
+    commands_sent += static_cast<int>(commands.size());
+
+    std::string chat_msg;
+    const bool has_chat = (turn % kChatInterval == player_no_);
+    if (has_chat) {
+      chat_msg = absl::StrCat("hello from player ", player_no_, " on turn ", turn);
+      chats_sent++;
+    }
+
+    const uint32_t execute_turn = turn + 2;
+    const uint16_t turn_length_ms = static_cast<uint16_t>(kTurnLengthMs);
+    fw::Clock::time_point start = fw::Clock::now();
+    if (mode_ == FanoutMode::kPerPeer) {
+      // The UI thread used to send chat as soon as it was typed, so it went out in its own datagram.
+      if (has_chat) {
+        game::ChatPacket chat_pkt;
+        chat_pkt.set_msg(chat_msg);
+        for (auto &peer : peers_) {
+          peer->send(chat_pkt, game::kCommandChannel);
+        }
+        host_.update();
+      }
+      for (auto &peer : peers_) {
+        game::CommandPacket pkt;
+        pkt.set_commands(commands);
+        pkt.set_execute_turn(execute_turn);
+        pkt.set_turn_length(turn_length_ms);
+        peer->send(pkt, game::kCommandChannel);
+      }
+    } else {
+      // The same as SimulationThread::send_posted_chat_msgs followed by enqueue_posted_commands.
+      if (has_chat) {
+        for (auto &peer : peers_) {
+          game::ChatPacket chat_pkt;
+          chat_pkt.set_msg(chat_msg);
+          peer->send(chat_pkt, game::kCommandChannel);
+        }
+      }
+      game::TurnPackets packets(commands, execute_turn, turn_length_ms, 0, 0);
+      for (auto &peer : peers_) {
+        packets.send(*peer);
+      }
+      host_.flush();
+    }
+    send_time += fw::Clock::now() - start;
+  }
+};
+
+fw::Status connect_peers(std::vector<std::unique_ptr<FanoutPeer>> &peers) {
+  for (auto &peer : peers) {
+    RETURN_IF_ERROR(peer->listen());
+  }
+
+  for (int i = 0; i < kNumPeers; i++) {
+    for (int j = i + 1; j < kNumPeers; j++) {
+      RETURN_IF_ERROR(peers[i]->connect(*peers[j]));
+
+      fw::Clock::time_point start = fw::Clock::now();
+      bool accepted = false;
+      while (!accepted) {
+        if (fw::Clock::now() - start > kConnectTimeout) {
+          return fw::ErrorStatus(absl::StrCat("timed out connecting player ", i + 1, " to player ", j + 1));
+        }
+        peers[i]->get_host().update();
+        peers[j]->get_host().update();
+        accepted = peers[j]->accept_connection();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  }
+
+  fw::Clock::time_point start = fw::Clock::now();
+  while (true) {
+    bool all_connected = true;
+    for (auto &peer : peers) {
+      peer->get_host().update();
+      all_connected = all_connected && peer->is_connected();
+    }
+    if (all_connected) {
+      return fw::OkStatus();
+    }
+    if (fw::Clock::now() - start > kConnectTimeout) {
+      return fw::ErrorStatus("timed out connecting the peers");
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// Keeps the hosts going until everybody has received everything that was sent to them.
+fw::Status drain(std::vector<std::unique_ptr<FanoutPeer>> &peers) {
+  int total_commands_sent = 0;
+  int total_chats_sent = 0;
+  for (auto const &peer : peers) {
+    total_commands_sent += peer->commands_sent;
+    total_chats_sent += peer->chats_sent;
+  }
+
+  fw::Clock::time_point start = fw::Clock::now();
+  while (true) {
+    bool all_received = true;
+    for (auto &peer : peers) {
+      peer->get_host().update();
+      all_received = all_received && peer->turns_received == static_cast<int>(kNumTurns) * (kNumPeers - 1)
+          && peer->commands_received == total_commands_sent - peer->commands_sent
+          && peer->chats_received == total_chats_sent - peer->chats_sent;
+    }
+    if (all_received) {
+      return fw::OkStatus();
+    }
+    if (fw::Clock::now() - start > kDrainTimeout) {
+      return fw::ErrorStatus(absl::StrCat(
+          "player 1 only received ", peers[0]->turns_received, " turns, ", peers[0]->commands_received,
+          " commands and ", peers[0]->chats_received, " chat messages"));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+fw::Status run_mode(FanoutMode mode, std::string const &name) {
+  std::vector<std::unique_ptr<FanoutPeer>> peers;
+  for (int i = 0; i < kNumPeers; i++) {
+    peers.push_back(std::make_unique<FanoutPeer>(static_cast<uint8_t>(i + 1), mode));
+  }
+  RETURN_IF_ERROR(connect_peers(peers));
+
+  std::vector<uint64_t> datagrams_before;
+  std::vector<uint64_t> udp_bytes_before;
+  for (auto &peer : peers) {
+    datagrams_before.push_back(peer->get_host().get_datagrams_sent());
+    udp_bytes_before.push_back(peer->get_host().get_bytes_sent());
+  }
+
+  for (uint32_t turn = 1; turn <= kNumTurns; turn++) {
+    for (auto &peer : peers) {
+      peer->run_turn(turn);
+    }
+    for (auto &peer : peers) {
+      peer->get_host().update();
+    }
+  }
+  RETURN_IF_ERROR(drain(peers));
+
+  uint64_t packets_sent = 0;
+  uint64_t bytes_sent = 0;
+  uint64_t datagrams_sent = 0;
+  uint64_t udp_bytes_sent = 0;
+  std::chrono::nanoseconds send_time { 0 };
+  for (int i = 0; i < kNumPeers; i++) {
+    send_time += peers[i]->send_time;
+    packets_sent += peers[i]->get_packets_sent();
+    bytes_sent += peers[i]->get_bytes_sent();
+    datagrams_sent += peers[i]->get_host().get_datagrams_sent() - datagrams_before[i];
+    udp_bytes_sent += peers[i]->get_host().get_bytes_sent() - udp_bytes_before[i];
+  }
+
+  // Everything per peer, per second of game time.
+  const double seconds = kNumTurns * kTurnLengthMs / 1000.0;
+  const double scale = 1.0 / (kNumPeers * seconds);
+  bench::report("command-fanout", absl::StrCat(name, ".packets_per_sec"), packets_sent * scale, "packets/s");
+  bench::report("command-fanout", absl::StrCat(name, ".bytes_per_sec"), bytes_sent * scale, "bytes/s");
+  bench::report("command-fanout", absl::StrCat(name, ".datagrams_per_sec"), datagrams_sent * scale, "datagrams/s");
+  bench::report("command-fanout", absl::StrCat(name, ".udp_bytes_per_sec"), udp_bytes_sent * scale, "bytes/s");
+  bench::report("command-fanout", absl::StrCat(name, ".send_us_per_turn"),
+      std::chrono::duration<double, std::micro>(send_time).count() / (kNumPeers * kNumTurns), "us");
+  return fw::OkStatus();
+}
+
+fw::Status command_fanout_bench() {
+  RETURN_IF_ERROR(fw::net::initialize());
+
+  // The commands look up their player in the SimulationThread, so it needs to know about all of us.
+  ASSIGN_OR_RETURN(std::unique_ptr<bench::BenchWorld> world, bench::create_bench_world(kMapSize, kNumPeers));
+
+  RETURN_IF_ERROR(run_mode(FanoutMode::kPerPeer, "per_peer"));
+  RETURN_IF_ERROR(run_mode(FanoutMode::kShared, "shared"));
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("command-fanout", command_fanout_bench);
@@ -0,0 +1,193 @@
+#include <list>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/flat_id_map.h>
+#include <framework/slot_map.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+// Compares the way EntityManager used to store entities (a std::list of shared_ptrs, searched linearly by id) with
+// the slot map + id hash it uses now. We can't create real entities outside of a game, so BenchEntity stands in for
+// ent::Entity with just enough state to make the update sweep do some work.
+namespace {
+
+constexpr int kNumEntities = 50000;
+constexpr int kNumLookups = 50000;
+constexpr int kNumLegacyLookups = 1000;
+constexpr int kNumChurn = 1000;
+constexpr int kNumSweeps = 20;
+
+struct BenchEntity {
+  uint32_t id;
+  float position;
+  float velocity;
+  fw::SlotMapKey slot_key;
+
+  void update(float dt) {
+    position += velocity * dt;
+  }
+};
+
+class LegacyStorage {
+private:
+  std::list<std::shared_ptr<BenchEntity>> all_entities_;
+  std::list<std::shared_ptr<BenchEntity>> destroyed_entities_;
+
+public:
+  void create(uint32_t id) {
+    all_entities_.push_back(std::make_shared<BenchEntity>(BenchEntity { id, 0.0f, 1.0f }));
+  }
+
+  std::weak_ptr<BenchEntity> get(uint32_t id) {
+    for (auto &ent : all_entities_) {
+      if (ent->id == id) {
+        return ent;
+      }
+    }
+    return std::weak_ptr<BenchEntity>();
+  }
+
+  void destroy(uint32_t id) {
+    destroyed_entities_.push_back(get(id).lock());
+  }
+
+  void cleanup_destroyed() {
+    for (auto ent : destroyed_entities_) {
+      for (auto it = all_entities_.begin(); it != all_entities_.end();) {
+        if (*it == ent) {
+          it = all_entities_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    destroyed_entities_.clear();
+  }
+
+  void update(float dt) {
+    for (auto &ent : all_entities_) {
+      ent->update(dt);
+    }
+  }
+};
+
+class SlotMapStorage {
+private:
+  fw::SlotMap<std::shared_ptr<BenchEntity>> all_entities_;
+  fw::FlatIdMap<uint32_t, fw::SlotMapKey> entities_by_id_;
+  std::vector<std::shared_ptr<BenchEntity>> destroyed_entities_;
+
+public:
+  void create(uint32_t id) {
+    auto ent = std::make_shared<BenchEntity>(BenchEntity { id, 0.0f, 1.0f });
+    ent->slot_key = all_entities_.insert(ent);
+    entities_by_id_.insert_or_assign(id, ent->slot_key);
+  }
+
+  std::weak_ptr<BenchEntity> get(uint32_t id) {
+    fw::SlotMapKey const *key = entities_by_id_.find(id);
+    if (key == nullptr) {
+      return std::weak_ptr<BenchEntity>();
+    }
+    std::shared_ptr<BenchEntity> *ent = all_entities_.get(*key);
+    return ent == nullptr ? std::weak_ptr<BenchEntity>() : std::weak_ptr<BenchEntity>(*ent);
+  }
+
+  void destroy(uint32_t id) {
+    destroyed_entities_.push_back(get(id).lock());
+  }
+
+  void cleanup_destroyed() {
+    for (auto &ent : destroyed_entities_) {
+      if (all_entities_.remove(ent->slot_key)) {
+        entities_by_id_.erase(ent->id);
+      }
+    }
+    destroyed_entities_.clear();
+  }
+
+  void update(float dt) {
+    for (size_t i = 0; i < all_entities_.size(); i++) {
+      all_entities_[i]->update(dt);
+    }
+  }
+};
+
+struct StorageResult {
+  float lookup_ns;
+  float churn_ms;
+  float sweep_ms;
+};
+
+template<typename Storage>
+fw::StatusOr<StorageResult> run_storage(Storage &storage, int num_lookups) {
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<uint32_t> id_dist(1, kNumEntities);
+  for (uint32_t id = 1; id <= kNumEntities; id++) {
+    storage.create(id);
+  }
+
+  StorageResult result;
+  fw::Timer lookup_tmr;
+  lookup_tmr.start();
+  for (int i = 0; i < num_lookups; i++) {
+    uint32_t id = id_dist(rng);
+    if (storage.get(id).expired()) {
+      return fw::ErrorStatus(absl::StrCat("entity ", id, " not found"));
+    }
+  }
+  lookup_tmr.stop();
+  result.lookup_ns = lookup_tmr.get_total_time() * 1000000000.0f / num_lookups;
+
+  // Destroy a batch of entities and create the same number of new ones, like a big battle would.
+  fw::Timer churn_tmr;
+  churn_tmr.start();
+  uint32_t next_id = kNumEntities + 1;
+  for (int i = 0; i < kNumChurn; i++) {
+    storage.destroy(1 + (i * (kNumEntities / kNumChurn)));
+  }
+  storage.cleanup_destroyed();
+  for (int i = 0; i < kNumChurn; i++) {
+    storage.create(next_id++);
+  }
+  churn_tmr.stop();
+  result.churn_ms = churn_tmr.get_total_time() * 1000.0f;
+
+  if (!storage.get(1).expired() || storage.get(next_id - 1).expired()) {
+    return fw::ErrorStatus("churn did not destroy/create the expected entities");
+  }
+
+  fw::Timer sweep_tmr;
+  sweep_tmr.start();
+  for (int i = 0; i < kNumSweeps; i++) {
+    storage.update(0.016f);
+  }
+  sweep_tmr.stop();
+  result.sweep_ms = sweep_tmr.get_total_time() * 1000.0f / kNumSweeps;
+  return result;
+}
+
+fw::Status entity_storage_bench() {
+  LegacyStorage legacy;
+  ASSIGN_OR_RETURN(StorageResult legacy_result, run_storage(legacy, kNumLegacyLookups));
+  SlotMapStorage slot_map;
+  ASSIGN_OR_RETURN(StorageResult slot_map_result, run_storage(slot_map, kNumLookups));
+
+  bench::report("entity-storage", "list.lookup_ns", legacy_result.lookup_ns, "ns");
+  bench::report("entity-storage", "list.churn_ms", legacy_result.churn_ms, "ms");
+  bench::report("entity-storage", "list.sweep_ms", legacy_result.sweep_ms, "ms");
+  bench::report("entity-storage", "slot_map.lookup_ns", slot_map_result.lookup_ns, "ns");
+  bench::report("entity-storage", "slot_map.churn_ms", slot_map_result.churn_ms, "ms");
+  bench::report("entity-storage", "slot_map.sweep_ms", slot_map_result.sweep_ms, "ms");
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("entity-storage", entity_storage_bench);
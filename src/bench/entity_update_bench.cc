@@ -0,0 +1,162 @@
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/math.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <game/entities/damageable_component.h>
+#include <game/entities/entity.h>
+#include <game/entities/entity_attribute.h>
+#include <game/entities/entity_manager.h>
+#include <game/entities/moveable_component.h>
+#include <game/entities/ownable_component.h>
+#include <game/entities/position_component.h>
+#include <game/entities/projectile_component.h>
+#include <game/entities/weapon_component.h>
+#include <game/simulation/simulation_thread.h>
+#include <game/simulation/snapshot.h>
+#include <game/simulation/turn_handoff.h>
+
+#include <bench/bench.h>
+#include <bench/bench_world.h>
+
+// Runs the real ent::EntityManager's systems (see EntityManager::update_systems) with different numbers of threads, to
+// see how the plan/commit split scales. There are 20,000 tanks that drive towards each other and shoot missiles at
+// each other, and the missiles home in and damage the tanks. Every thread count starts from the same snapshot, and
+// after the same frames the entities must come out exactly the same (state hash included) whatever the number of
+// threads, because that's what keeps lockstep peers in sync.
+namespace {
+
+constexpr int kMapSize = 1024;
+constexpr int kNumPlayers = 4;
+constexpr int kNumTanks = 20000;
+constexpr int kNumFrames = 120;
+constexpr float kDt = static_cast<float>(game::kFrameMs) / 1000.0f;
+
+// The bench doesn't have the Lua templates, so we build the prototypes the templates would give us.
+void add_prototypes(ent::EntityManager &entities) {
+  ent::PositionComponent *tank_position = new ent::PositionComponent();
+  tank_position->set_sit_on_terrain(true);
+  ent::MoveableComponent *tank_moveable = new ent::MoveableComponent();
+  tank_moveable->set_turn_speed(1.0f / 5.15f);
+  ent::WeaponComponent *tank_weapon = new ent::WeaponComponent();
+  tank_weapon->set_fire_entity("missile", fw::Vector(0.0f, 1.0f, 0.0f));
+  entities.set_prototype("tank",
+      { tank_position, new ent::OwnableComponent(), tank_moveable, tank_weapon,
+        new ent::DamageableComponent() },
+      { ent::EntityAttribute("health", 100.0f) });
+
+  ent::MoveableComponent *missile_moveable = new ent::MoveableComponent();
+  missile_moveable->set_speed(15.0f);
+  missile_moveable->set_turn_speed(1.0f / 0.15f);
+  entities.set_prototype("missile",
+      { new ent::PositionComponent(), missile_moveable, new ent::SeekingProjectileComponent(),
+        new ent::DamageableComponent() },
+      { ent::EntityAttribute("health", 1.0f) });
+}
+
+void create_tanks(ent::EntityManager &entities) {
+  std::mt19937 rng(4321);
+  std::uniform_real_distribution<float> pos_dist(0.0f, static_cast<float>(kMapSize) - 8.0f);
+  std::uniform_real_distribution<float> unit_dist(-1.0f, 1.0f);
+  auto const &players = game::SimulationThread::get_instance()->get_players();
+
+  std::vector<std::shared_ptr<ent::Entity>> tanks;
+  fw::Vector pos;
+  for (int i = 0; i < kNumTanks; i++) {
+    uint8_t player_no = static_cast<uint8_t>(1 + i % kNumPlayers);
+    ent::entity_id id = static_cast<ent::entity_id>((static_cast<uint32_t>(player_no) << 24) | (i + 1));
+    std::shared_ptr<ent::Entity> tank = entities.create_entity("tank", id);
+
+    // The tanks come in pairs just out of weapon range of each other, so they drive a little way before shooting.
+    if (i % 2 == 0) {
+      pos = fw::Vector(pos_dist(rng), 0.0f, pos_dist(rng));
+    } else {
+      pos = pos + fw::Vector(12.0f, 0.0f, 0.0f);
+    }
+    tank->set_position(pos);
+    ent::PositionComponent *position = tank->get_component<ent::PositionComponent>();
+    position->set_direction(fw::Vector(unit_dist(rng), 0.0f, unit_dist(rng)).normalized());
+    position->get_position();
+    tank->get_component<ent::OwnableComponent>()->set_owner(players[player_no - 1]);
+    tanks.push_back(tank);
+  }
+
+  // Most tanks go after their partner, and some after somebody at random (who is usually a long way off).
+  for (int i = 0; i < kNumTanks; i++) {
+    int target = (i % 4 == 0) ? static_cast<int>(rng() % kNumTanks) : (i ^ 1);
+    tanks[i]->get_component<ent::WeaponComponent>()->set_target(tanks[target]);
+  }
+}
+
+fw::Status entity_update_bench() {
+  ASSIGN_OR_RETURN(std::unique_ptr<bench::BenchWorld> world, bench::create_bench_world(kMapSize, kNumPlayers));
+  ent::EntityManager &entities = *world->get_entity_manager();
+  add_prototypes(entities);
+  create_tanks(entities);
+
+  game::Snapshot start;
+  entities.write_snapshot(start);
+  start.finish();
+
+  std::vector<int> thread_counts = { 0, 1, 2, 4 };
+  const int hardware_threads = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+  if (hardware_threads > 4) {
+    thread_counts.push_back(hardware_threads);
+  }
+
+  std::string expected_dump;
+  for (int num_threads : thread_counts) {
+    RETURN_IF_ERROR(entities.read_snapshot(start));
+    entities.set_update_threads(num_threads);
+
+    fw::Timer tmr;
+    tmr.start();
+    for (int i = 0; i < kNumFrames; i++) {
+      entities.update(kDt);
+    }
+    tmr.stop();
+
+    // The missiles don't have an identifier, so they're not in the dump, but what they hit is.
+    fw::Timer dump_tmr;
+    dump_tmr.start();
+    std::string dump = entities.write_state_dump();
+    dump_tmr.stop();
+    if (num_threads == 0) {
+      expected_dump = dump;
+      // Peers only take a dump once they've found out they've desynced (see SimulationThread::request_state_hash).
+      bench::report("entity-update", "state_dump_ms", dump_tmr.get_total_time() * 1000.0f, "ms");
+      const size_t num_hit = entities.get_entities([](std::shared_ptr<ent::Entity> &ent) {
+        return ent->get_name() == "tank" && ent->get_attribute("health")->get_value<float>() < 100.0f;
+      }).size();
+      const size_t num_missiles = entities.get_entities([](std::shared_ptr<ent::Entity> &ent) {
+        return ent->get_name() == "missile";
+      }).size();
+      bench::report("entity-update", "tanks_hit", static_cast<double>(num_hit), "entities");
+      bench::report("entity-update", "missiles_in_flight", static_cast<double>(num_missiles), "entities");
+      if (num_hit == 0) {
+        return fw::ErrorStatus("nobody got hit, the tanks aren't doing what the bench expects");
+      }
+    } else if (dump != expected_dump) {
+      return fw::ErrorStatus(absl::StrCat(
+          "entities updated with ", num_threads, " thread(s) diverged from the single-threaded result"));
+    }
+
+    bench::report(
+        "entity-update", absl::StrCat("threads_", num_threads, ".frame_ms"),
+        tmr.get_total_time() * 1000.0f / kNumFrames, "ms");
+  }
+
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("entity-update", entity_update_bench);
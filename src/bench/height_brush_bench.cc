@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/height_brush.h>
+#include <framework/misc.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+// Dabs the raise and level brushes all over a 512x512 map (including over the edges, where it wraps) the way the
+// heightfield tool used to (a sqrt and a wrapped get and set per vertex) and with fw::HeightBrush, and checks that
+// they come out exactly the same with both of its kernels. Then we time each of fw::HeightBrush's brushes, and check
+// that the scalar and SIMD kernels of smooth and noise agree as well.
+namespace {
+
+constexpr int kMapSize = 512;
+constexpr int kNumDabs = 200;
+constexpr int kSmallRadius = 10;
+constexpr int kLargeRadius = 64;
+constexpr float kDelta = 0.08f;
+constexpr float kStrength = 1.0f;
+constexpr float kLevelTarget = 3.0f;
+
+struct Heights {
+  std::vector<float> values;
+
+  Heights() : values(kMapSize * kMapSize) {
+    for (int z = 0; z < kMapSize; z++) {
+      for (int x = 0; x < kMapSize; x++) {
+        values[z * kMapSize + x] = 10.0f * std::sin(x * 0.043f) * std::cos(z * 0.037f);
+      }
+    }
+  }
+
+  float get(int x, int z) const {
+    return values[fw::constrain(z, kMapSize) * kMapSize + fw::constrain(x, kMapSize)];
+  }
+
+  void set(int x, int z, float height) {
+    values[fw::constrain(z, kMapSize) * kMapSize + fw::constrain(x, kMapSize)] = height;
+  }
+};
+
+// This is what RaiseLowerBrush::update used to do.
+void legacy_raise(Heights &heights, int cx, int cz, int radius, float dy, float amount) {
+  int sx = cx - radius;
+  int sz = cz - radius;
+  int ex = cx + radius;
+  int ez = cz + radius;
+  for (int z = sz; z < ez; z++) {
+    for (int x = sx; x < ex; x++) {
+      float height = heights.get(x, z);
+      float distance = sqrt((float) ((x - cx) * (x - cx) + (z - cz) * (z - cz))) / radius;
+      if (distance < 1.0f)
+        heights.set(x, z, height + (dy * (1.0f - distance)) * amount);
+    }
+  }
+}
+
+// This is what LevelBrush::update used to do.
+void legacy_level(Heights &heights, int cx, int cz, int radius, float level_height, float update_time, float amount) {
+  int sx = cx - radius;
+  int sz = cz - radius;
+  int ex = cx + radius;
+  int ez = cz + radius;
+  for (int z = sz; z < ez; z++) {
+    for (int x = sx; x < ex; x++) {
+      float height = heights.get(x, z);
+      float diff = (level_height - height) * update_time;
+      float distance = sqrt((float) ((x - cx) * (x - cx) + (z - cz) * (z - cz))) / radius;
+      if (distance < 1.0f) {
+        heights.set(x, z, height + (diff * (1.0f - distance)) * amount);
+      }
+    }
+  }
+}
+
+// Does what HeightfieldBrush::apply does, with Heights standing in for the terrain.
+template<typename Fn>
+void apply(Heights &heights, fw::HeightBrush &brush, std::vector<float> &padded, int cx, int cz, Fn const &fn) {
+  const int padded_size = brush.get_padded_size();
+  const int origin_x = cx - brush.get_radius() - 1;
+  const int origin_z = cz - brush.get_radius() - 1;
+  padded.resize(padded_size * padded_size);
+  for (int z = 0; z < padded_size; z++) {
+    for (int x = 0; x < padded_size; x++) {
+      padded[z * padded_size + x] = heights.get(origin_x + x, origin_z + z);
+    }
+  }
+  fn(padded.data(), origin_x, origin_z);
+  for (int z = 0; z < padded_size; z++) {
+    for (int x = 0; x < padded_size; x++) {
+      heights.set(origin_x + x, origin_z + z, padded[z * padded_size + x]);
+    }
+  }
+}
+
+// The centre of each dab. A few of them are right by the edges, so they wrap.
+std::vector<std::pair<int, int>> make_dabs() {
+  std::vector<std::pair<int, int>> dabs;
+  for (int i = 0; i < kNumDabs; i++) {
+    dabs.emplace_back((i * 97 + 5) % kMapSize, (i * 61 + 3) % kMapSize);
+  }
+  dabs.emplace_back(0, 0);
+  dabs.emplace_back(kMapSize - 1, kMapSize / 2);
+  return dabs;
+}
+
+fw::Status compare(char const *what, Heights const &expected, Heights const &actual) {
+  for (int i = 0; i < kMapSize * kMapSize; i++) {
+    if (expected.values[i] != actual.values[i]) {
+      return fw::ErrorStatus(absl::StrCat(what, ": height ", i, " is ", actual.values[i], " but should be ",
+          expected.values[i]));
+    }
+  }
+  return fw::OkStatus();
+}
+
+fw::Status check_matches_legacy(int radius) {
+  const std::vector<std::pair<int, int>> dabs = make_dabs();
+  for (fw::HeightBrush::Kernel kernel : {fw::HeightBrush::Kernel::kScalar, fw::HeightBrush::Kernel::kSimd}) {
+    const char *kernel_name = (kernel == fw::HeightBrush::Kernel::kScalar) ? "scalar" : "simd";
+    fw::HeightBrush brush(radius);
+    std::vector<float> padded;
+
+    Heights legacy_raised;
+    Heights raised;
+    Heights legacy_levelled;
+    Heights levelled;
+    for (auto const &dab : dabs) {
+      legacy_raise(legacy_raised, dab.first, dab.second, radius, kDelta, kStrength);
+      apply(raised, brush, padded, dab.first, dab.second, [&](float *heights, int, int) {
+        brush.raise(heights, kDelta, kStrength, kernel);
+      });
+
+      legacy_level(legacy_levelled, dab.first, dab.second, radius, kLevelTarget, kDelta, kStrength);
+      apply(levelled, brush, padded, dab.first, dab.second, [&](float *heights, int, int) {
+        brush.level(heights, kLevelTarget, kDelta, kStrength, kernel);
+      });
+    }
+
+    RETURN_IF_ERROR(compare(absl::StrCat("raise (", kernel_name, ", radius ", radius, ")").c_str(),
+        legacy_raised, raised));
+    RETURN_IF_ERROR(compare(absl::StrCat("level (", kernel_name, ", radius ", radius, ")").c_str(),
+        legacy_levelled, levelled));
+  }
+  return fw::OkStatus();
+}
+
+// Times fn on a radius-kLargeRadius padded buffer, in microseconds per dab.
+template<typename Fn>
+double time_dabs(Fn const &fn) {
+  double total_us = 0.0;
+  for (int i = 0; i < kNumDabs; i++) {
+    fw::Timer tmr;
+    tmr.start();
+    fn();
+    tmr.stop();
+    total_us += tmr.get_total_time() * 1000000.0;
+  }
+  return total_us / kNumDabs;
+}
+
+fw::Status height_brush_bench() {
+  RETURN_IF_ERROR(check_matches_legacy(kSmallRadius));
+  RETURN_IF_ERROR(check_matches_legacy(kLargeRadius));
+
+  // The legacy brushes, straight on the map.
+  Heights heights;
+  const double legacy_raise_us = time_dabs([&]() {
+    legacy_raise(heights, kMapSize / 2, kMapSize / 2, kLargeRadius, kDelta, kStrength);
+  });
+  const double legacy_level_us = time_dabs([&]() {
+    legacy_level(heights, kMapSize / 2, kMapSize / 2, kLargeRadius, kLevelTarget, kDelta, kStrength);
+  });
+
+  // fw::HeightBrush on just the padded buffer (the terrain's copying in and out is the same for every brush).
+  fw::HeightBrush brush(kLargeRadius);
+  const int padded_size = brush.get_padded_size();
+  const int origin = kMapSize / 2 - kLargeRadius - 1;
+  std::vector<float> padded(padded_size * padded_size);
+  std::vector<float> scalar_padded;
+  for (int z = 0; z < padded_size; z++) {
+    for (int x = 0; x < padded_size; x++) {
+      padded[z * padded_size + x] = heights.get(origin + x, origin + z);
+    }
+  }
+  const std::vector<float> original = padded;
+
+  for (fw::HeightBrush::Kernel kernel : {fw::HeightBrush::Kernel::kScalar, fw::HeightBrush::Kernel::kSimd}) {
+    const char *kernel_name = (kernel == fw::HeightBrush::Kernel::kScalar) ? "scalar" : "simd";
+    padded = original;
+    const double raise_us = time_dabs([&]() { brush.raise(padded.data(), kDelta, kStrength, kernel); });
+    const double level_us = time_dabs([&]() {
+      brush.level(padded.data(), kLevelTarget, kDelta, kStrength, kernel);
+    });
+    const double smooth_us = time_dabs([&]() { brush.smooth(padded.data(), kDelta, kStrength, kernel); });
+    const double noise_us = time_dabs([&]() {
+      brush.noise(padded.data(), origin, origin, kMapSize, kMapSize, kDelta, kStrength, kernel);
+    });
+    bench::report("height-brush", absl::StrCat(kernel_name, "_raise_us_per_dab"), raise_us, "us");
+    bench::report("height-brush", absl::StrCat(kernel_name, "_level_us_per_dab"), level_us, "us");
+    bench::report("height-brush", absl::StrCat(kernel_name, "_smooth_us_per_dab"), smooth_us, "us");
+    bench::report("height-brush", absl::StrCat(kernel_name, "_noise_us_per_dab"), noise_us, "us");
+
+    // Every brush has been through the same dabs, so the two kernels should have ended up in exactly the same place.
+    if (kernel == fw::HeightBrush::Kernel::kScalar) {
+      scalar_padded = padded;
+    } else if (padded != scalar_padded) {
+      return fw::ErrorStatus("the scalar and SIMD kernels came out different");
+    }
+  }
+
+  bench::report("height-brush", "legacy_raise_us_per_dab", legacy_raise_us, "us");
+  bench::report("height-brush", "legacy_level_us_per_dab", legacy_level_us, "us");
+  bench::report("height-brush", absl::StrCat("simd_kernel.", fw::HeightBrush::get_simd_name()), 1.0, "");
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("height-brush", height_brush_bench);
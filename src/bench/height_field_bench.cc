@@ -0,0 +1,224 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/height_field.h>
+#include <framework/math.h>
+#include <framework/misc.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+// Samples the height of a 512x512 terrain at 100,000 points a frame (about what a big battle needs, with every unit
+// sitting on the terrain and the camera and cursor on top), the way game::Terrain::get_height used to (wrapping each of
+// the four vertices with fw::constrain) and with fw::HeightField, one at a time and in batches. We also time working
+// out the normal of every vertex, which the terrain used to do with four cross products per vertex every time it baked
+// a patch.
+//
+// The batched samplers must give exactly the same results as the one-at-a-time ones, and points on the map must come
+// out exactly the same as they used to.
+namespace {
+
+constexpr int kWidth = 512;
+constexpr int kLength = 512;
+constexpr int kNumSamples = 100000;
+constexpr int kNumFrames = 50;
+constexpr int kNumNormalIterations = 5;
+
+// Some of the points are a little way off the edge of the map, so that we exercise the wrapping as well.
+constexpr float kMargin = 16.0f;
+
+constexpr float kMaxSimdFrameMs = 5.0f;
+
+std::vector<float> make_heights() {
+  std::vector<float> heights(kWidth * kLength);
+  for (int z = 0; z < kLength; z++) {
+    for (int x = 0; x < kWidth; x++) {
+      heights[z * kWidth + x] = 20.0f * std::sin(x * 0.031f) * std::cos(z * 0.027f)
+          + 3.0f * std::sin(x * 0.17f + z * 0.11f) + 0.5f * std::cos(x * 0.91f - z * 0.77f);
+    }
+  }
+  return heights;
+}
+
+// This is how game::Terrain used to do it.
+float legacy_vertex_height(std::vector<float> const &heights, int x, int z) {
+  return heights[fw::constrain(z, kLength) * kWidth + fw::constrain(x, kWidth)];
+}
+
+float legacy_height(std::vector<float> const &heights, float x, float z) {
+  int x0 = (int) floor(x);
+  int x1 = x0 + 1;
+  int z0 = (int) floor(z);
+  int z1 = z0 + 1;
+
+  float h00 = legacy_vertex_height(heights, x0, z0);
+  float h10 = legacy_vertex_height(heights, x1, z0);
+  float h01 = legacy_vertex_height(heights, x0, z1);
+  float h11 = legacy_vertex_height(heights, x1, z1);
+
+  float dx = x - x0;
+  float dz = z - z0;
+  float dxdz = dx * dz;
+  return h00 * (1.0f - dz - dx + dxdz) + h10 * (dx - dxdz) + h11 * dxdz + h01 * (dz - dxdz);
+}
+
+fw::Vector legacy_vertex(std::vector<float> const &heights, int x, int z) {
+  return fw::Vector((float) x, legacy_vertex_height(heights, x, z), (float) z);
+}
+
+fw::Vector legacy_normal(std::vector<float> const &heights, int x, int z) {
+  fw::Vector center = legacy_vertex(heights, x, z);
+  fw::Vector a = legacy_vertex(heights, x, z + 1) - center;
+  fw::Vector b = legacy_vertex(heights, x + 1, z) - center;
+  fw::Vector c = legacy_vertex(heights, x, z - 1) - center;
+  fw::Vector d = legacy_vertex(heights, x - 1, z) - center;
+
+  fw::Vector normal(0, 0, 0);
+  normal += fw::cross(a, b);
+  normal += fw::cross(b, c);
+  normal += fw::cross(c, d);
+  normal += fw::cross(d, a);
+  return normal.normalized();
+}
+
+bool same_bits(float lhs, float rhs) {
+  return std::memcmp(&lhs, &rhs, sizeof(float)) == 0;
+}
+
+fw::Status check_results(
+    std::vector<float> const &heights, fw::HeightField const &height_field, std::vector<float> const &xs,
+    std::vector<float> const &zs) {
+  std::vector<float> scalar(kNumSamples);
+  std::vector<float> simd(kNumSamples);
+  height_field.get_heights(xs, zs, scalar, fw::HeightField::Kernel::kScalar);
+  height_field.get_heights(xs, zs, simd, fw::HeightField::Kernel::kSimd);
+  for (int i = 0; i < kNumSamples; i++) {
+    if (!same_bits(scalar[i], simd[i]) || !same_bits(scalar[i], height_field.get_height(xs[i], zs[i]))) {
+      return fw::ErrorStatus(absl::StrCat(
+          "height at (", xs[i], ", ", zs[i], ") is ", scalar[i], " one at a time and ", simd[i], " batched"));
+    }
+
+    const bool on_map = xs[i] >= 0.0f && xs[i] < kWidth && zs[i] >= 0.0f && zs[i] < kLength;
+    const float legacy = legacy_height(heights, xs[i], zs[i]);
+    if (on_map ? !same_bits(legacy, scalar[i]) : std::abs(legacy - scalar[i]) > 0.01f) {
+      return fw::ErrorStatus(absl::StrCat(
+          "height at (", xs[i], ", ", zs[i], ") is ", scalar[i], ", it used to be ", legacy));
+    }
+  }
+
+  std::vector<float> scalar_x(kNumSamples), scalar_y(kNumSamples), scalar_z(kNumSamples);
+  std::vector<float> simd_x(kNumSamples), simd_y(kNumSamples), simd_z(kNumSamples);
+  height_field.get_normals(xs, zs, scalar_x, scalar_y, scalar_z, fw::HeightField::Kernel::kScalar);
+  height_field.get_normals(xs, zs, simd_x, simd_y, simd_z, fw::HeightField::Kernel::kSimd);
+  for (int i = 0; i < kNumSamples; i++) {
+    if (!same_bits(scalar_x[i], simd_x[i]) || !same_bits(scalar_y[i], simd_y[i])
+        || !same_bits(scalar_z[i], simd_z[i])) {
+      return fw::ErrorStatus(absl::StrCat("normal at (", xs[i], ", ", zs[i], ") differs when batched"));
+    }
+  }
+
+  for (int z = 0; z < kLength; z++) {
+    for (int x = 0; x < kWidth; x++) {
+      const fw::Vector expected = legacy_normal(heights, x, z);
+      const fw::Vector actual = height_field.get_vertex_normal(x, z);
+      if ((expected - actual).length() > 0.0001f) {
+        return fw::ErrorStatus(absl::StrCat("normal of vertex (", x, ", ", z, ") is wrong"));
+      }
+    }
+  }
+  return fw::OkStatus();
+}
+
+template<typename Fn>
+float time_frames(int num_frames, Fn fn) {
+  fw::Timer tmr;
+  tmr.start();
+  for (int i = 0; i < num_frames; i++) {
+    fn();
+  }
+  tmr.stop();
+  return tmr.get_total_time() * 1000.0f / num_frames;
+}
+
+fw::Status height_field_bench() {
+  const std::vector<float> heights = make_heights();
+  fw::HeightField height_field(kWidth, kLength, heights.data());
+
+  std::mt19937 rng(2468);
+  std::uniform_real_distribution<float> x_dist(-kMargin, kWidth + kMargin);
+  std::uniform_real_distribution<float> z_dist(-kMargin, kLength + kMargin);
+  std::vector<float> xs(kNumSamples);
+  std::vector<float> zs(kNumSamples);
+  for (int i = 0; i < kNumSamples; i++) {
+    xs[i] = x_dist(rng);
+    zs[i] = z_dist(rng);
+  }
+
+  RETURN_IF_ERROR(check_results(heights, height_field, xs, zs));
+
+  std::vector<float> out(kNumSamples);
+  std::vector<float> out_y(kNumSamples);
+  std::vector<float> out_z(kNumSamples);
+  float checksum = 0.0f;
+  const float legacy_ms = time_frames(kNumFrames, [&]() {
+    for (int i = 0; i < kNumSamples; i++) {
+      out[i] = legacy_height(heights, xs[i], zs[i]);
+    }
+    checksum += out[0];
+  });
+  const float scalar_ms = time_frames(kNumFrames, [&]() {
+    for (int i = 0; i < kNumSamples; i++) {
+      out[i] = height_field.get_height(xs[i], zs[i]);
+    }
+    checksum += out[0];
+  });
+  const float batched_scalar_ms = time_frames(kNumFrames, [&]() {
+    height_field.get_heights(xs, zs, out, fw::HeightField::Kernel::kScalar);
+    checksum += out[0];
+  });
+  const float simd_ms = time_frames(kNumFrames, [&]() {
+    height_field.get_heights(xs, zs, out, fw::HeightField::Kernel::kSimd);
+    checksum += out[0];
+  });
+  const float simd_normals_ms = time_frames(kNumFrames, [&]() {
+    height_field.get_normals(xs, zs, out, out_y, out_z, fw::HeightField::Kernel::kSimd);
+    checksum += out[0];
+  });
+
+  std::vector<fw::Vector> legacy_normals(kWidth * kLength);
+  const float legacy_normals_ms = time_frames(kNumNormalIterations, [&]() {
+    for (int z = 0; z < kLength; z++) {
+      for (int x = 0; x < kWidth; x++) {
+        legacy_normals[z * kWidth + x] = legacy_normal(heights, x, z);
+      }
+    }
+  });
+  const float build_ms = time_frames(kNumNormalIterations, [&]() {
+    height_field.reset(kWidth, kLength, heights.data());
+  });
+
+  bench::report("height-field", absl::StrCat("simd_kernel.", fw::HeightField::get_simd_name()), 1.0, "");
+  bench::report("height-field", "legacy_frame_ms", legacy_ms, "ms");
+  bench::report("height-field", "scalar_frame_ms", scalar_ms, "ms");
+  bench::report("height-field", "batched_scalar_frame_ms", batched_scalar_ms, "ms");
+  bench::report("height-field", "simd_frame_ms", simd_ms, "ms");
+  bench::report("height-field", "simd_normals_frame_ms", simd_normals_ms, "ms");
+  bench::report("height-field", "simd_ns_per_sample", simd_ms * 1000000.0f / kNumSamples, "ns");
+  bench::report("height-field", "legacy_normals_ms", legacy_normals_ms, "ms");
+  bench::report("height-field", "build_ms", build_ms, "ms");
+  bench::report("height-field", "checksum", checksum, "");
+  if (simd_ms > kMaxSimdFrameMs) {
+    return fw::ErrorStatus(absl::StrCat("sampling ", kNumSamples, " heights took ", simd_ms, "ms"));
+  }
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("height-field", height_field_bench);
@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/height_field.h>
+#include <framework/height_pyramid.h>
+#include <framework/math.h>
+#include <framework/misc.h>
+#include <framework/status.h>
+#include <framework/thread_pool.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+// Drags a radius-64 raise brush across a 512x512 map, one dab per frame, the way the heightfield tool does, and times
+// the update thread (changing the heights) and the render thread (re-baking and uploading the patches) each frame.
+//
+// The "legacy" way is what ed::EditorTerrain used to do: set_vertex_height for every vertex under the brush (updating
+// the height field and pyramid each time, and scanning the list of patches to bake for a duplicate), then regenerate
+// every listed patch in full on the render thread. The "incremental" way is what it does now: one set_vertex_heights
+// for the whole dab, per-patch dirty rectangles, the changed vertices generated on a fw::ThreadPool, and just those
+// rows uploaded on the render thread. There's no GL here, so an "upload" is a memcpy into a copy of the patch's
+// vertex buffer.
+//
+// At the end we check that the incremental copy of every patch matches one generated from scratch. The legacy way only
+// queued up the patch that each vertex was in, so it misses the patches on the other side of a patch edge (which share
+// those vertices), and the normals of the vertices just outside the brush. We report how many of its vertices ended
+// up stale, too.
+namespace {
+
+constexpr int kMapSize = 512;
+constexpr int kPatchSize = 64;
+constexpr int kPatchesWidth = kMapSize / kPatchSize;
+constexpr int kVertsPerRow = kPatchSize + 1;
+constexpr int kBrushRadius = 64;
+constexpr int kBrushStep = 16;
+constexpr float kBrushAmount = 0.5f;
+
+// The same layout as fw::vertex::xyz_n.
+struct Vertex {
+  float x, y, z;
+  float nx, ny, nz;
+
+  bool operator==(Vertex const &other) const {
+    return x == other.x && y == other.y && z == other.z && nx == other.nx && ny == other.ny && nz == other.nz;
+  }
+};
+
+Vertex make_vertex(fw::HeightField const &height_field, int patch_x, int patch_z, int x, int z) {
+  const int ix = (patch_x * kPatchSize) + x;
+  const int iz = (patch_z * kPatchSize) + z;
+  const fw::Vector normal = height_field.get_vertex_normal(ix, iz);
+  return Vertex {
+      static_cast<float>(x), height_field.get_vertex_height(ix, iz), static_cast<float>(z),
+      normal[0], normal[1], normal[2]};
+}
+
+// Like game::generate_terrain_vertices.
+void generate_patch(std::vector<Vertex> &vertices, fw::HeightField const &height_field, int patch_x, int patch_z) {
+  vertices.resize(kVertsPerRow * kVertsPerRow);
+  for (int z = 0; z <= kPatchSize; z++) {
+    for (int x = 0; x <= kPatchSize; x++) {
+      vertices[z * kVertsPerRow + x] = make_vertex(height_field, patch_x, patch_z, x, z);
+    }
+  }
+}
+
+float brush_weight(int x, int z, int cx, int cz) {
+  const float distance = std::sqrt(static_cast<float>((x - cx) * (x - cx) + (z - cz) * (z - cz))) / kBrushRadius;
+  return distance < 1.0f ? (1.0f - distance) * kBrushAmount : 0.0f;
+}
+
+std::vector<float> make_heights() {
+  std::vector<float> heights(kMapSize * kMapSize);
+  for (int z = 0; z < kMapSize; z++) {
+    for (int x = 0; x < kMapSize; x++) {
+      heights[z * kMapSize + x] = 10.0f * std::sin(x * 0.043f) * std::cos(z * 0.037f);
+    }
+  }
+  return heights;
+}
+
+struct Terrain {
+  std::vector<float> heights;
+  fw::HeightField height_field;
+  fw::HeightPyramid height_pyramid;
+
+  // Our copy of each patch's vertex buffer.
+  std::vector<std::vector<Vertex>> uploaded;
+
+  Terrain() : heights(make_heights()), height_field(kMapSize, kMapSize, heights.data()),
+      height_pyramid(height_field), uploaded(kPatchesWidth * kPatchesWidth) {
+    for (int patch_z = 0; patch_z < kPatchesWidth; patch_z++) {
+      for (int patch_x = 0; patch_x < kPatchesWidth; patch_x++) {
+        generate_patch(uploaded[patch_z * kPatchesWidth + patch_x], height_field, patch_x, patch_z);
+      }
+    }
+  }
+};
+
+// The old EditorTerrain::set_vertex_height.
+void legacy_set_vertex_height(Terrain &terrain, std::vector<std::tuple<int, int>> &patches_to_bake,
+    int x, int z, float height) {
+  x = fw::constrain(x, kMapSize);
+  z = fw::constrain(z, kMapSize);
+  terrain.heights[z * kMapSize + x] = height;
+  terrain.height_field.update(terrain.heights.data(), x, z, x, z);
+  terrain.height_pyramid.update(x, z, x, z);
+
+  auto this_patch = std::make_tuple(x / kPatchSize, z / kPatchSize);
+  if (std::find(patches_to_bake.begin(), patches_to_bake.end(), this_patch) == patches_to_bake.end()) {
+    patches_to_bake.push_back(this_patch);
+  }
+}
+
+void legacy_frame(Terrain &terrain, int cx, int cz, double &update_ms, double &render_ms) {
+  std::vector<std::tuple<int, int>> patches_to_bake;
+
+  fw::Timer tmr;
+  tmr.start();
+  for (int z = cz - kBrushRadius; z < cz + kBrushRadius; z++) {
+    for (int x = cx - kBrushRadius; x < cx + kBrushRadius; x++) {
+      const float weight = brush_weight(x, z, cx, cz);
+      if (weight > 0.0f) {
+        legacy_set_vertex_height(
+            terrain, patches_to_bake, x, z, terrain.height_field.get_vertex_height(x, z) + weight);
+      }
+    }
+  }
+  tmr.stop();
+  update_ms += tmr.get_total_time() * 1000.0;
+
+  tmr = fw::Timer();
+  tmr.start();
+  std::vector<Vertex> vertices;
+  for (auto const &patch : patches_to_bake) {
+    const int patch_x = std::get<0>(patch);
+    const int patch_z = std::get<1>(patch);
+    generate_patch(vertices, terrain.height_field, patch_x, patch_z);
+    std::vector<Vertex> &uploaded = terrain.uploaded[patch_z * kPatchesWidth + patch_x];
+    memcpy(uploaded.data(), vertices.data(), vertices.size() * sizeof(Vertex));
+  }
+  tmr.stop();
+  render_ms += tmr.get_total_time() * 1000.0;
+}
+
+// The changed vertices of one patch, like ed::EditorTerrain's StagedPatch.
+struct StagedPatch {
+  int patch_x;
+  int patch_z;
+  fw::Rectangle<int> rect;
+  std::vector<Vertex> vertices;
+};
+
+template<typename Fn>
+void for_each_wrapped_run(int start, int count, int size, Fn const &fn) {
+  start = fw::constrain(start, size);
+  const int first_count = std::min(count, size - start);
+  fn(start, 0, first_count);
+  if (first_count < count) {
+    fn(0, first_count, count - first_count);
+  }
+}
+
+int floor_div(int a, int b) {
+  return (a >= 0) ? (a / b) : -((-a + b - 1) / b);
+}
+
+// Does what ed::EditorTerrain::get_vertex_heights, set_vertex_heights, mark_vertices_dirty and bake_dirty_patches do
+// for one dab of the brush.
+void incremental_frame(
+    Terrain &terrain, fw::ThreadPool &thread_pool, int cx, int cz, double &update_ms, double &render_ms) {
+  const int sx = cx - kBrushRadius;
+  const int sz = cz - kBrushRadius;
+  const int size = kBrushRadius * 2;
+
+  fw::Timer tmr;
+  tmr.start();
+  std::vector<float> dab(size * size);
+  for (int row = 0; row < size; row++) {
+    float const *src_row = terrain.heights.data() + (fw::constrain(sz + row, kMapSize) * kMapSize);
+    float *dest_row = dab.data() + (row * size);
+    for_each_wrapped_run(sx, size, kMapSize, [src_row, dest_row](int wrapped_x, int offset, int count) {
+      std::copy(src_row + wrapped_x, src_row + wrapped_x + count, dest_row + offset);
+    });
+  }
+  for (int z = 0; z < size; z++) {
+    for (int x = 0; x < size; x++) {
+      dab[z * size + x] += brush_weight(sx + x, sz + z, cx, cz);
+    }
+  }
+  for_each_wrapped_run(sz, size, kMapSize, [&](int wrapped_z, int row_offset, int num_rows) {
+    for_each_wrapped_run(sx, size, kMapSize, [&](int wrapped_x, int col_offset, int num_cols) {
+      for (int row = 0; row < num_rows; row++) {
+        float const *src = dab.data() + ((row_offset + row) * size) + col_offset;
+        std::copy(src, src + num_cols, terrain.heights.data() + ((wrapped_z + row) * kMapSize) + wrapped_x);
+      }
+      terrain.height_field.update(
+          terrain.heights.data(), wrapped_x, wrapped_z, wrapped_x + num_cols - 1, wrapped_z + num_rows - 1);
+    });
+  });
+  terrain.height_pyramid.update(sx, sz, sx + size - 1, sz + size - 1);
+
+  const int min_x = sx - 1;
+  const int min_z = sz - 1;
+  const int max_x = sx + size;
+  const int max_z = sz + size;
+  std::vector<fw::Rectangle<int>> dirty_rects(kPatchesWidth * kPatchesWidth);
+  std::vector<int> dirty_patches;
+  for (int patch_z = floor_div(min_z - 1, kPatchSize); patch_z <= floor_div(max_z, kPatchSize); patch_z++) {
+    for (int patch_x = floor_div(min_x - 1, kPatchSize); patch_x <= floor_div(max_x, kPatchSize); patch_x++) {
+      const int left = std::max(min_x - (patch_x * kPatchSize), 0);
+      const int top = std::max(min_z - (patch_z * kPatchSize), 0);
+      const int right = std::min(max_x - (patch_x * kPatchSize), kPatchSize);
+      const int bottom = std::min(max_z - (patch_z * kPatchSize), kPatchSize);
+      if (left > right || top > bottom) {
+        continue;
+      }
+      const int index =
+          fw::constrain(patch_z, kPatchesWidth) * kPatchesWidth + fw::constrain(patch_x, kPatchesWidth);
+      if (dirty_rects[index].width == 0) {
+        dirty_patches.push_back(index);
+      }
+      dirty_rects[index] = fw::Rectangle<int>::bounding(
+          dirty_rects[index], fw::Rectangle<int>(left, top, right - left + 1, bottom - top + 1));
+    }
+  }
+
+  std::vector<StagedPatch> staged_patches(dirty_patches.size());
+  for (size_t i = 0; i < dirty_patches.size(); i++) {
+    staged_patches[i].patch_x = dirty_patches[i] % kPatchesWidth;
+    staged_patches[i].patch_z = dirty_patches[i] / kPatchesWidth;
+    staged_patches[i].rect = dirty_rects[dirty_patches[i]];
+  }
+  thread_pool.parallel_for(staged_patches.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      StagedPatch &staged = staged_patches[i];
+      staged.vertices.resize(staged.rect.width * staged.rect.height);
+      for (int z = 0; z < staged.rect.height; z++) {
+        for (int x = 0; x < staged.rect.width; x++) {
+          staged.vertices[z * staged.rect.width + x] = make_vertex(
+              terrain.height_field, staged.patch_x, staged.patch_z, staged.rect.left + x, staged.rect.top + z);
+        }
+      }
+    }
+  });
+  tmr.stop();
+  update_ms += tmr.get_total_time() * 1000.0;
+
+  tmr = fw::Timer();
+  tmr.start();
+  for (StagedPatch const &staged : staged_patches) {
+    std::vector<Vertex> &uploaded = terrain.uploaded[staged.patch_z * kPatchesWidth + staged.patch_x];
+    for (int z = 0; z < staged.rect.height; z++) {
+      memcpy(&uploaded[(staged.rect.top + z) * kVertsPerRow + staged.rect.left],
+          &staged.vertices[z * staged.rect.width], staged.rect.width * sizeof(Vertex));
+    }
+  }
+  tmr.stop();
+  render_ms += tmr.get_total_time() * 1000.0;
+}
+
+// Returns the number of vertices in the uploaded patches that don't match what they should be.
+int count_stale_vertices(Terrain const &terrain) {
+  int num_stale = 0;
+  std::vector<Vertex> expected;
+  for (int patch_z = 0; patch_z < kPatchesWidth; patch_z++) {
+    for (int patch_x = 0; patch_x < kPatchesWidth; patch_x++) {
+      generate_patch(expected, terrain.height_field, patch_x, patch_z);
+      std::vector<Vertex> const &uploaded = terrain.uploaded[patch_z * kPatchesWidth + patch_x];
+      for (size_t i = 0; i < expected.size(); i++) {
+        if (!(expected[i] == uploaded[i])) {
+          num_stale++;
+        }
+      }
+    }
+  }
+  return num_stale;
+}
+
+fw::Status heightfield_brush_bench() {
+  const int num_frames = kMapSize / kBrushStep;
+  fw::ThreadPool thread_pool(std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0, 4));
+
+  Terrain legacy;
+  double legacy_update_ms = 0.0;
+  double legacy_render_ms = 0.0;
+  for (int frame = 0; frame < num_frames; frame++) {
+    legacy_frame(legacy, frame * kBrushStep, kMapSize / 2, legacy_update_ms, legacy_render_ms);
+  }
+
+  Terrain incremental;
+  double incremental_update_ms = 0.0;
+  double incremental_render_ms = 0.0;
+  for (int frame = 0; frame < num_frames; frame++) {
+    incremental_frame(
+        incremental, thread_pool, frame * kBrushStep, kMapSize / 2, incremental_update_ms, incremental_render_ms);
+  }
+
+  for (int i = 0; i < kMapSize * kMapSize; i++) {
+    if (legacy.heights[i] != incremental.heights[i]) {
+      return fw::ErrorStatus(absl::StrCat("height ", i, " is different: ", legacy.heights[i], " vs ",
+          incremental.heights[i]));
+    }
+  }
+  const int incremental_stale = count_stale_vertices(incremental);
+
+  bench::report("heightfield-brush", "legacy_update_ms_per_frame", legacy_update_ms / num_frames, "ms");
+  bench::report("heightfield-brush", "legacy_render_ms_per_frame", legacy_render_ms / num_frames, "ms");
+  bench::report("heightfield-brush", "incremental_update_ms_per_frame", incremental_update_ms / num_frames, "ms");
+  bench::report("heightfield-brush", "incremental_render_ms_per_frame", incremental_render_ms / num_frames, "ms");
+  bench::report("heightfield-brush", "legacy_stale_vertices", count_stale_vertices(legacy), "");
+  bench::report("heightfield-brush", "incremental_stale_vertices", incremental_stale, "");
+  if (incremental_stale != 0) {
+    return fw::ErrorStatus(absl::StrCat(incremental_stale, " vertices weren't re-baked"));
+  }
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("heightfield-brush", heightfield_brush_bench);
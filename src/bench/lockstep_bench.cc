@@ -0,0 +1,690 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/lockstep_scheduler.h>
+#include <framework/math.h>
+#include <framework/net.h>
+#include <framework/packet.h>
+#include <framework/packet_buffer.h>
+#include <framework/paths.h>
+#include <framework/settings.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <game/entities/entity.h>
+#include <game/entities/entity_attribute.h>
+#include <game/entities/entity_manager.h>
+#include <game/entities/moveable_component.h>
+#include <game/entities/ownable_component.h>
+#include <game/entities/position_component.h>
+#include <game/simulation/commands.h>
+#include <game/simulation/packets.h>
+#include <game/simulation/player.h>
+#include <game/simulation/replay.h>
+#include <game/simulation/simulation_thread.h>
+#include <game/simulation/turn_handoff.h>
+
+#include <bench/bench.h>
+#include <bench/bench_world.h>
+
+// Plays a few hundred turns of a four-player game in one process. Player 1 is the game's own SimulationThread, and the
+// others are BenchPeers, each with its own fw::net::Host on 127.0.0.1 and its own thread, running the same turn loop
+// as SimulationThread::thread_proc with the same LockstepScheduler and sending the same TurnPackets. Everybody posts
+// CreateEntityCommands, and our main thread is the SimulationThread's update thread: it applies the turns to a
+// BenchWorld's EntityManager and runs their frames, 40 times a second like the game does.
+//
+// We slow down the links between the BenchPeers by holding each packet back for a while after it arrives, and change
+// how long as we go. The SimulationThread's links aren't slowed down (it measures its round-trip times with ENet, which
+// doesn't know about our delay), so it's the BenchPeers that ask for longer turns, and everybody runs the longest turn
+// anybody asks for. At the end, the replay the SimulationThread recorded must have exactly the same commands and turn
+// lengths on every turn as each of the BenchPeers ran, and the EntityManager must have an entity for every command.
+//
+// It reports the turn stats of the SimulationThread and of one of the BenchPeers, as well as how far behind the update
+// thread got. They're mostly down to the delays we inject rather than to ENet itself: they say how the
+// LockstepScheduler reacts to a slow network (how long the turns get, how far ahead commands are scheduled and how long
+// it stalls waiting for its peers), not how fast the network code is.
+namespace {
+
+constexpr int kNumPlayers = 4;
+constexpr uint8_t kSimulationPlayerNo = 1;
+constexpr int kMapSize = 256;
+constexpr int kMinPort = 29100;
+constexpr int kMaxPort = 29199;
+constexpr int kMaxCommandsPerTurn = 3;
+
+// If a player doesn't get to run a turn for this long, something's wrong and we give up.
+constexpr auto kStallTimeout = std::chrono::seconds(10);
+constexpr auto kConnectTimeout = std::chrono::seconds(5);
+
+// How long we hold packets back for, and for how many turns.
+struct Phase {
+  uint32_t num_turns;
+  int delay_ms;
+};
+constexpr Phase kPhases[] = { { 60, 0 }, { 80, 250 }, { 60, 40 } };
+
+uint32_t get_num_turns() {
+  uint32_t num_turns = 0;
+  for (Phase const &phase : kPhases) {
+    num_turns += phase.num_turns;
+  }
+  return num_turns;
+}
+
+int get_delay_ms(uint32_t turn) {
+  for (Phase const &phase : kPhases) {
+    if (turn < phase.num_turns) {
+      return phase.delay_ms;
+    }
+    turn -= phase.num_turns;
+  }
+  return 0;
+}
+
+// Nobody posts commands after this turn, so that every command executes within the turns we check. A command can
+// execute up to max_command_delay turns after it's sent, and the SimulationThread doesn't send what's posted until
+// its next turn.
+uint32_t get_last_command_turn() {
+  return get_num_turns() - 2 * fw::net::LockstepConfig().max_command_delay;
+}
+
+// The bench doesn't have the Lua templates, so we build the prototype the template would give us.
+void add_prototypes(ent::EntityManager &entities) {
+  ent::PositionComponent *position = new ent::PositionComponent();
+  position->set_sit_on_terrain(true);
+  entities.set_prototype("tank",
+      { position, new ent::OwnableComponent(), new ent::MoveableComponent() },
+      { ent::EntityAttribute("health", 100.0f) });
+}
+
+std::shared_ptr<game::CreateEntityCommand> create_tank_command(uint8_t player_no, std::mt19937 &rng) {
+  std::uniform_real_distribution<float> pos_dist(0.0f, static_cast<float>(kMapSize));
+  std::shared_ptr<game::CreateEntityCommand> cmd = game::create_command<game::CreateEntityCommand>(player_no);
+  cmd->template_name = "tank";
+  cmd->initial_position = fw::Vector(pos_dist(rng), 0.0f, pos_dist(rng));
+  cmd->initial_goal = fw::Vector(pos_dist(rng), 0.0f, pos_dist(rng));
+  return cmd;
+}
+
+uint8_t get_command_player_no(game::Command const &cmd) {
+  return cmd.get_player() == nullptr ? 0 : cmd.get_player()->get_player_no();
+}
+
+// Hashes the given turn's commands, which must be in the order they're executed, so we can compare what each player
+// ran.
+uint64_t hash_commands(std::vector<std::shared_ptr<game::Command>> const &commands) {
+  fw::net::PacketBuffer buffer(0, fw::net::kWireVersionCompact);
+  buffer.set_position_exponent(game::get_command_position_exponent());
+  for (std::shared_ptr<game::Command> const &cmd : commands) {
+    buffer << cmd->get_identifier();
+    buffer << get_command_player_no(*cmd);
+    cmd->serialize(buffer);
+  }
+
+  uint64_t hash = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < buffer.get_size(); i++) {
+    hash = (hash ^ buffer.get_buffer()[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// What a BenchPeer ran on one of its turns.
+struct BenchTurn {
+  uint32_t turn_length_ms;
+  uint64_t commands_hash;
+  std::size_t num_commands;
+};
+
+// A packet that's arrived, but that we're pretending is still on its way.
+struct DelayedPacket {
+  fw::Clock::time_point due;
+  uint8_t player_no;
+  std::shared_ptr<fw::net::Packet> pkt;
+};
+
+// One of the other players in the game, with its own Host, scheduler and turn loop.
+class BenchPeer {
+private:
+  uint8_t player_no_;
+  fw::net::Host host_;
+  std::map<uint8_t, std::shared_ptr<fw::net::Peer>> peers_;
+  fw::net::LockstepScheduler scheduler_;
+  std::mt19937 rng_;
+
+  uint32_t turn_ = 0;
+  std::map<uint32_t, std::vector<std::shared_ptr<game::Command>>> commands_;
+  std::vector<std::shared_ptr<game::Command>> posted_commands_;
+
+  // Packets we've received, in the order we'll let ourselves see them. We never let a packet overtake an earlier one
+  // from the same player (ENet wouldn't), so jitter can only bunch them up.
+  std::deque<DelayedPacket> inbox_;
+  std::map<uint8_t, fw::Clock::time_point> last_due_;
+
+  void on_packet(uint8_t player_no, std::shared_ptr<fw::net::Packet> const &pkt) {
+    int delay_ms = 0;
+    if (player_no != kSimulationPlayerNo) {
+      delay_ms = get_delay_ms(turn_);
+      std::uniform_int_distribution<int> jitter_dist(0, delay_ms / 4);
+      delay_ms += jitter_dist(rng_);
+    }
+    fw::Clock::time_point due = fw::Clock::now() + std::chrono::milliseconds(delay_ms);
+    fw::Clock::time_point &last_due = last_due_[player_no];
+    due = std::max(due, last_due);
+    last_due = due;
+    inbox_.push_back(DelayedPacket { due, player_no, pkt });
+  }
+
+  // Hands the packets that have "arrived" by now to the scheduler, the same as RemotePlayer does.
+  void process_inbox(fw::Clock::time_point now) {
+    std::stable_sort(inbox_.begin(), inbox_.end(), [](DelayedPacket const &lhs, DelayedPacket const &rhs) {
+      return lhs.due < rhs.due;
+    });
+    while (!inbox_.empty() && inbox_.front().due <= now) {
+      DelayedPacket delayed = std::move(inbox_.front());
+      inbox_.pop_front();
+
+      uint32_t execute_turn = 0;
+      uint16_t turn_length_ms = 0;
+      std::vector<std::shared_ptr<game::Command>> commands;
+      if (auto command_pkt = std::dynamic_pointer_cast<game::CommandPacket>(delayed.pkt)) {
+        execute_turn = command_pkt->get_execute_turn();
+        turn_length_ms = command_pkt->get_turn_length();
+        commands = command_pkt->get_commands();
+      } else if (auto heartbeat_pkt = std::dynamic_pointer_cast<game::HeartbeatPacket>(delayed.pkt)) {
+        execute_turn = heartbeat_pkt->get_execute_turn();
+        turn_length_ms = heartbeat_pkt->get_turn_length();
+      }
+      if (execute_turn == 0) {
+        continue;
+      }
+
+      if (execute_turn <= turn_) {
+        num_late_packets++;
+      }
+      for (std::shared_ptr<game::Command> &cmd : commands) {
+        commands_[execute_turn].push_back(cmd);
+      }
+      scheduler_.on_peer_commands(
+          delayed.player_no, execute_turn, static_cast<int>(commands.size()), turn_length_ms);
+    }
+  }
+
+  // ENet only sees the real (loopback) round-trip time, so we add on the delay we're injecting, as if the network
+  // really were that slow.
+  void update_latencies() {
+    for (auto const &[player_no, peer] : peers_) {
+      const float delay_ms = (player_no == kSimulationPlayerNo) ? 0.0f : static_cast<float>(get_delay_ms(turn_));
+      scheduler_.set_peer_latency(
+          player_no, peer->get_round_trip_time() + delay_ms * 2.0f,
+          peer->get_round_trip_time_variance() + delay_ms / 4.0f);
+    }
+  }
+
+  // Posts some commands and sends them off, the same as SimulationThread::enqueue_posted_commands.
+  void post_commands() {
+    if (turn_ <= get_last_command_turn()) {
+      std::uniform_int_distribution<int> num_dist(0, kMaxCommandsPerTurn);
+      const int num_commands = num_dist(rng_);
+      for (int i = 0; i < num_commands; i++) {
+        std::shared_ptr<game::CreateEntityCommand> cmd = create_tank_command(player_no_, rng_);
+        cmd->quantize(game::get_command_position_exponent());
+        posted_commands_.push_back(cmd);
+      }
+    }
+
+    const uint32_t execute_turn = scheduler_.get_execute_turn(turn_);
+    if (execute_turn == 0) {
+      return;
+    }
+
+    for (std::shared_ptr<game::Command> &cmd : posted_commands_) {
+      commands_[execute_turn].push_back(cmd);
+    }
+
+    game::TurnPackets packets(
+        posted_commands_, execute_turn, static_cast<uint16_t>(std::lround(scheduler_.get_desired_turn_length())), 0,
+        0);
+    for (auto &[player_no, peer] : peers_) {
+      packets.send(*peer);
+    }
+    host_.flush();
+    posted_commands_.clear();
+  }
+
+  // Puts the commands due this turn in the order SimulationThread::execute_commands runs them (by player), and
+  // remembers them and the turn length.
+  void execute_commands() {
+    std::vector<std::shared_ptr<game::Command>> commands;
+    auto it = commands_.find(turn_);
+    if (it != commands_.end()) {
+      commands = std::move(it->second);
+      commands_.erase(it);
+    }
+    std::stable_sort(commands.begin(), commands.end(),
+        [](std::shared_ptr<game::Command> const &lhs, std::shared_ptr<game::Command> const &rhs) {
+          return get_command_player_no(*lhs) < get_command_player_no(*rhs);
+        });
+
+    turns.push_back(BenchTurn {
+        static_cast<uint32_t>(std::lround(scheduler_.get_turn_length())), hash_commands(commands),
+        commands.size() });
+  }
+
+public:
+  std::vector<BenchTurn> turns;
+  int num_late_packets = 0;
+  fw::Status status;
+
+  // Set once we've run all our turns (or given up), after which the above are safe to look at.
+  std::atomic<bool> done;
+
+  BenchPeer(uint8_t player_no, fw::net::LockstepConfig const &config)
+      : player_no_(player_no), scheduler_(config), rng_(player_no * 7919), done(false) {
+  }
+
+  uint8_t get_player_no() const {
+    return player_no_;
+  }
+
+  fw::Status listen() {
+    return host_.listen(kMinPort, kMaxPort);
+  }
+
+  int get_listen_port() const {
+    return host_.get_listen_port();
+  }
+
+  fw::net::Host &get_host() {
+    return host_;
+  }
+
+  void add_peer(uint8_t player_no, std::shared_ptr<fw::net::Peer> const &peer) {
+    peer->set_handler([this, player_no](std::shared_ptr<fw::net::Packet> const &pkt) { on_packet(player_no, pkt); });
+    peer->set_wire_version(fw::net::kMaxWireVersion);
+    peers_[player_no] = peer;
+  }
+
+  // Connects to the given peer, which must then accept_connection() from us.
+  fw::Status connect(BenchPeer &other) {
+    ASSIGN_OR_RETURN(auto peer, host_.connect(absl::StrCat("127.0.0.1:", other.get_listen_port())));
+    add_peer(other.player_no_, peer);
+    return fw::OkStatus();
+  }
+
+  // Picks up a connection from the given player, who's connecting to us. Returns false if it hasn't come in yet.
+  bool accept_connection(uint8_t player_no) {
+    std::vector<std::shared_ptr<fw::net::Peer>> new_connections = host_.get_new_connections();
+    if (new_connections.empty()) {
+      return false;
+    }
+    add_peer(player_no, new_connections[0]);
+    return true;
+  }
+
+  std::vector<fw::net::LockstepTurnStats> get_stats() const {
+    return scheduler_.get_stats();
+  }
+
+  bool is_connected() const {
+    if (peers_.size() != kNumPlayers - 1) {
+      return false;
+    }
+    for (auto const &[player_no, peer] : peers_) {
+      if (!peer->is_connected()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void start() {
+    scheduler_.reset();
+    for (auto const &[player_no, peer] : peers_) {
+      scheduler_.add_peer(player_no);
+    }
+  }
+
+  // The turn loop, the same as SimulationThread::thread_proc's once the game has started.
+  void run(std::atomic<bool> &stopping) {
+    const uint32_t num_turns = get_num_turns();
+    fw::Clock::time_point last_turn_start = fw::Clock::now();
+    while (turn_ < num_turns && !stopping) {
+      fw::Clock::time_point start = fw::Clock::now();
+      host_.update();
+      process_inbox(start);
+      update_latencies();
+
+      if (!scheduler_.is_turn_ready(turn_ + 1)) {
+        if (start - last_turn_start > kStallTimeout) {
+          status = fw::ErrorStatus(absl::StrCat("player ", player_no_, " stalled on turn ", turn_ + 1));
+          break;
+        }
+        scheduler_.on_stall(turn_ + 1, start);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+
+      turn_++;
+      last_turn_start = start;
+      scheduler_.begin_turn(turn_, start);
+      post_commands();
+      execute_commands();
+
+      const auto turn_length = std::chrono::microseconds(
+          static_cast<int64_t>(scheduler_.get_turn_length() * 1000.0f));
+      while (fw::Clock::now() < start + turn_length) {
+        host_.update();
+        process_inbox(fw::Clock::now());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    done = true;
+
+    // Keep servicing the host until everybody's done, so that the commands (and acks) the others need for their last
+    // few turns get through.
+    while (!stopping) {
+      host_.update();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+};
+
+fw::Status wait_for_connection(BenchPeer &peer, uint8_t player_no, BenchPeer *connecting_peer) {
+  fw::Clock::time_point start = fw::Clock::now();
+  while (true) {
+    if (fw::Clock::now() - start > kConnectTimeout) {
+      return fw::ErrorStatus(absl::StrCat(
+          "timed out connecting player ", player_no, " to player ", peer.get_player_no()));
+    }
+    if (connecting_peer != nullptr) {
+      connecting_peer->get_host().update();
+    }
+    peer.get_host().update();
+    if (peer.accept_connection(player_no)) {
+      return fw::OkStatus();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+fw::Status connect_players(game::SimulationThread &sim, std::vector<std::unique_ptr<BenchPeer>> &peers) {
+  for (auto &peer : peers) {
+    RETURN_IF_ERROR(peer->listen());
+  }
+
+  // Each peer connects to the ones after it, so every pair has exactly one connection. We make them one at a time, so
+  // we know who each incoming connection is from.
+  for (std::size_t i = 0; i < peers.size(); i++) {
+    for (std::size_t j = i + 1; j < peers.size(); j++) {
+      RETURN_IF_ERROR(peers[i]->connect(*peers[j]));
+      RETURN_IF_ERROR(wait_for_connection(*peers[j], peers[i]->get_player_no(), peers[i].get()));
+    }
+  }
+
+  // Then the SimulationThread connects to each of them. Its own thread looks after its end.
+  for (auto &peer : peers) {
+    sim.connect_confirmed_player(absl::StrCat("127.0.0.1:", peer->get_listen_port()), peer->get_player_no());
+    RETURN_IF_ERROR(wait_for_connection(*peer, kSimulationPlayerNo, nullptr));
+  }
+
+  // Wait for the connecting ends to hear that they're connected as well.
+  fw::Clock::time_point start = fw::Clock::now();
+  while (true) {
+    bool all_connected = true;
+    for (auto &peer : peers) {
+      peer->get_host().update();
+      all_connected = all_connected && peer->is_connected();
+    }
+    if (all_connected) {
+      return fw::OkStatus();
+    }
+    if (fw::Clock::now() - start > kConnectTimeout) {
+      return fw::ErrorStatus("timed out connecting the players");
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// Applies the turns the SimulationThread has handed over so far, running their frames as fast as we can.
+fw::Status finish_turns(game::SimulationThread &sim, ent::EntityManager &entities) {
+  fw::Clock::time_point start = fw::Clock::now();
+  while (sim.get_turn_handoff_stats().depth > 0) {
+    if (fw::Clock::now() - start > kStallTimeout) {
+      return fw::ErrorStatus("timed out applying the SimulationThread's turns");
+    }
+    sim.apply_turns();
+    entities.update();
+  }
+  return fw::OkStatus();
+}
+
+// Runs the game until the SimulationThread has finished all of our turns. We're its update thread, so we apply the
+// turns it hands us and run their frames, and post some commands of our own now and then.
+fw::Status run_game(
+    game::SimulationThread &sim, ent::EntityManager &entities, std::vector<std::unique_ptr<BenchPeer>> &peers) {
+  // The SimulationThread has been ticking along while we connected everybody, so catch up on the turns it's handed us
+  // so far, or we'd be that far behind for the whole game.
+  RETURN_IF_ERROR(finish_turns(sim, entities));
+
+  std::atomic<bool> stopping(false);
+  std::vector<std::thread> threads;
+  for (auto &peer : peers) {
+    peer->start();
+    threads.emplace_back([&peer, &stopping]() { peer->run(stopping); });
+  }
+
+  fw::Status status = fw::OkStatus();
+  std::mt19937 rng(kSimulationPlayerNo * 7919);
+  uint32_t last_posted_turn = 0;
+  fw::Clock::time_point last_turn_start = fw::Clock::now();
+  fw::Clock::time_point next_frame = fw::Clock::now();
+  while (true) {
+    sim.apply_turns();
+    entities.update();
+
+    // The stats are for the turns the SimulationThread has finished, so the last one is the turn before its current
+    // one. We post a few commands (or none) once a turn, like the other players.
+    std::vector<fw::net::LockstepTurnStats> stats = sim.get_turn_stats();
+    const uint32_t finished_turn = stats.empty() ? 0 : stats.back().turn;
+    if (sim.is_game_started() && finished_turn != last_posted_turn) {
+      last_posted_turn = finished_turn;
+      last_turn_start = fw::Clock::now();
+      if (finished_turn < get_last_command_turn()) {
+        std::uniform_int_distribution<int> num_dist(0, kMaxCommandsPerTurn);
+        const int num_commands = num_dist(rng);
+        for (int i = 0; i < num_commands; i++) {
+          std::shared_ptr<game::CreateEntityCommand> cmd = create_tank_command(kSimulationPlayerNo, rng);
+          sim.post_command(cmd);
+        }
+      }
+    }
+
+    // The others can be a few turns behind the SimulationThread (or ahead of it), so we wait for everybody.
+    bool all_done = finished_turn >= get_num_turns();
+    bool peer_failed = false;
+    for (auto const &peer : peers) {
+      all_done = all_done && peer->done;
+      peer_failed = peer_failed || (peer->done && !peer->status.ok());
+    }
+    if (all_done || peer_failed) {
+      break;
+    }
+    if (fw::Clock::now() - last_turn_start > kStallTimeout) {
+      status = fw::ErrorStatus(absl::StrCat("the SimulationThread stalled after turn ", finished_turn));
+      break;
+    }
+
+    next_frame = std::max(next_frame + std::chrono::milliseconds(game::kFrameMs), fw::Clock::now());
+    std::this_thread::sleep_until(next_frame);
+  }
+
+  stopping = true;
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (auto const &peer : peers) {
+    RETURN_IF_ERROR(peer->status);
+  }
+  return status;
+}
+
+// Checks that the SimulationThread ran every turn with exactly the same commands, and the same turn length, as the
+// other players. The commands in the replay look up their players in the SimulationThread, which still has them all.
+fw::Status check_lockstep(
+    std::filesystem::path const &replay_path, std::vector<std::unique_ptr<BenchPeer>> const &peers,
+    ent::EntityManager &entities, std::size_t &num_commands) {
+  for (auto const &peer : peers) {
+    if (peer->turns.size() < get_num_turns()) {
+      return fw::ErrorStatus(absl::StrCat(
+          "player ", peer->get_player_no(), " only ran ", peer->turns.size(), " of ", get_num_turns(), " turns"));
+    }
+    if (peer->num_late_packets != 0) {
+      return fw::ErrorStatus(absl::StrCat(
+          peer->num_late_packets, " packets arrived at player ", peer->get_player_no(), " after their turn"));
+    }
+  }
+
+  ASSIGN_OR_RETURN(std::unique_ptr<game::ReplayReader> reader, game::ReplayReader::open(replay_path));
+  num_commands = 0;
+  game::ReplayTurn turn;
+  game::turn_id expected_turn = 1;
+  while (expected_turn <= get_num_turns()) {
+    ASSIGN_OR_RETURN(bool has_turn, reader->next_turn(turn));
+    if (!has_turn) {
+      return fw::ErrorStatus(absl::StrCat("the SimulationThread's replay stops before turn ", expected_turn));
+    }
+    if (turn.turn == 0) {
+      // Whatever was left over from before the game started.
+      continue;
+    }
+    if (turn.turn != expected_turn) {
+      return fw::ErrorStatus(absl::StrCat(
+          "the SimulationThread's replay has turn ", turn.turn, " where we expected turn ", expected_turn));
+    }
+
+    const uint64_t commands_hash = hash_commands(turn.commands);
+    for (auto const &peer : peers) {
+      BenchTurn const &peer_turn = peer->turns[expected_turn - 1];
+      if (peer_turn.turn_length_ms != turn.turn_length_ms) {
+        return fw::ErrorStatus(absl::StrCat(
+            "turn ", expected_turn, " was ", turn.turn_length_ms, "ms for the SimulationThread, but ",
+            peer_turn.turn_length_ms, "ms for player ", peer->get_player_no()));
+      }
+      if (peer_turn.num_commands != turn.commands.size() || peer_turn.commands_hash != commands_hash) {
+        return fw::ErrorStatus(absl::StrCat(
+            "the SimulationThread and player ", peer->get_player_no(), " ran different commands on turn ",
+            expected_turn, " (", turn.commands.size(), " vs ", peer_turn.num_commands, ")"));
+      }
+    }
+    num_commands += turn.commands.size();
+    expected_turn++;
+  }
+
+  // Nobody posts anything late enough to execute after the turns we've checked, so every command we've checked should
+  // have made an entity.
+  const std::size_t num_entities = entities.get_entities([](std::shared_ptr<ent::Entity> &ent) {
+    return ent->get_name() == "tank";
+  }).size();
+  if (num_entities != num_commands) {
+    return fw::ErrorStatus(absl::StrCat(
+        "the update thread made ", num_entities, " entities, but there were ", num_commands, " commands"));
+  }
+  return fw::OkStatus();
+}
+
+void report_phases(std::string const &player, std::vector<fw::net::LockstepTurnStats> const &stats) {
+  uint32_t first_turn = 1;
+  for (Phase const &phase : kPhases) {
+    float total_turn_length_ms = 0.0f;
+    float total_stall_ms = 0.0f;
+    int total_late_arrivals = 0;
+    int max_command_delay = 0;
+    int num_turns = 0;
+    for (fw::net::LockstepTurnStats const &turn_stats : stats) {
+      if (turn_stats.turn < first_turn || turn_stats.turn >= first_turn + phase.num_turns) {
+        continue;
+      }
+      total_turn_length_ms += turn_stats.turn_length_ms;
+      total_stall_ms += turn_stats.stall_ms;
+      total_late_arrivals += turn_stats.late_arrivals;
+      max_command_delay = std::max(max_command_delay, turn_stats.command_delay);
+      num_turns++;
+    }
+    first_turn += phase.num_turns;
+
+    const std::string prefix = absl::StrCat(player, ".delay_", phase.delay_ms, "ms");
+    bench::report("lockstep", absl::StrCat(prefix, ".avg_turn_length_ms"),
+        num_turns == 0 ? 0.0f : total_turn_length_ms / num_turns, "ms");
+    bench::report("lockstep", absl::StrCat(prefix, ".max_command_delay"), max_command_delay, "turns");
+    bench::report("lockstep", absl::StrCat(prefix, ".stall_ms"), total_stall_ms, "ms");
+    bench::report("lockstep", absl::StrCat(prefix, ".late_arrivals"), total_late_arrivals, "packets");
+  }
+}
+
+fw::Status lockstep_bench() {
+  RETURN_IF_ERROR(fw::net::initialize());
+
+  const std::string replay_file = fw::Settings::get<std::string>("record-replay");
+  if (replay_file.empty()) {
+    return fw::ErrorStatus("the lockstep bench checks the SimulationThread's replay, so it needs --record-replay");
+  }
+
+  ASSIGN_OR_RETURN(std::unique_ptr<bench::BenchWorld> world, bench::create_bench_world(kMapSize, kNumPlayers));
+  ent::EntityManager &entities = *world->get_entity_manager();
+  add_prototypes(entities);
+
+  // Our players use the same config as the SimulationThread's scheduler, so they all round the turns the same way.
+  fw::net::LockstepConfig config;
+  config.stats_history = get_num_turns();
+  std::vector<std::unique_ptr<BenchPeer>> peers;
+  for (int i = 1; i < kNumPlayers; i++) {
+    peers.push_back(std::make_unique<BenchPeer>(static_cast<uint8_t>(kSimulationPlayerNo + i), config));
+  }
+
+  game::SimulationThread *sim = game::SimulationThread::get_instance();
+  sim->initialize();
+  fw::Timer tmr;
+  fw::Status status = connect_players(*sim, peers);
+  if (status.ok()) {
+    tmr.start();
+    status = run_game(*sim, entities, peers);
+    tmr.stop();
+  }
+  sim->destroy();
+  RETURN_IF_ERROR(status);
+  RETURN_IF_ERROR(finish_turns(*sim, entities));
+
+  std::size_t num_commands = 0;
+  RETURN_IF_ERROR(check_lockstep(fw::resolve(replay_file, true), peers, entities, num_commands));
+
+  bench::report("lockstep", "num_turns", get_num_turns(), "turns");
+  bench::report("lockstep", "num_commands", static_cast<double>(num_commands), "commands");
+  bench::report("lockstep", "total_time_s", tmr.get_total_time(), "s");
+  // Player 1 is the SimulationThread, which doesn't know about the delay we inject (see above), and player 2 is a
+  // BenchPeer, which does.
+  report_phases("player_1", sim->get_turn_stats());
+  report_phases("player_2", peers[0]->get_stats());
+
+  game::TurnHandoffStats handoff_stats = sim->get_turn_handoff_stats();
+  bench::report("lockstep", "handoff.mean_latency_ms", handoff_stats.mean_latency_ms, "ms");
+  bench::report("lockstep", "handoff.max_latency_ms", handoff_stats.max_latency_ms, "ms");
+  bench::report("lockstep", "handoff.max_depth", handoff_stats.max_depth, "turns");
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("lockstep", lockstep_bench);
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/settings.h>
+#include <framework/status.h>
+
+#include <bench/bench.h>
+
+namespace bench {
+namespace {
+
+std::map<std::string, bench_fn, std::less<>>& get_benches() {
+  static std::map<std::string, bench_fn, std::less<>> benches;
+  return benches;
+}
+
+}
+
+BenchRegistrar::BenchRegistrar(std::string_view name, bench_fn fn) {
+  get_benches()[std::string(name)] = fn;
+}
+
+fw::Status run_bench(std::string_view name) {
+  bool found = false;
+  for (auto const &[bench_name, fn] : get_benches()) {
+    if (name != "all" && name != bench_name) {
+      continue;
+    }
+
+    found = true;
+    std::cout << "---- " << bench_name << std::endl;
+    RETURN_IF_ERROR(fn());
+  }
+
+  if (!found) {
+    return fw::ErrorStatus(absl::StrCat("no benchmark named: ", name));
+  }
+  return fw::OkStatus();
+}
+
+void report(std::string_view bench_name, std::string_view metric, double value, std::string_view units) {
+  std::cout << bench_name << "." << metric << " = " << value << " " << units << std::endl;
+}
+
+}
+
+fw::Status settings_initialize(int argc, char** argv) {
+  fw::SettingDefinition extra_settings;
+  extra_settings.add_group("Additional options", "Benchmark specific settings")
+      .add_setting<std::string>(
+          "bench",
+          "Name of the benchmark to run, or \"all\" to run all of them.",
+          "all")
+      .add_setting<std::string>(
+          "wire-encoding-replay",
+          "A replay for the wire-encoding benchmark to measure, as well as its synthetic stream of commands.",
+          "");
+
+  // The lockstep benchmark runs the game's own SimulationThread, which reads these.
+  extra_settings.add_group("Lockstep", "Settings for the lockstep benchmark's SimulationThread")
+      .add_setting<std::string>(
+          "listen-port",
+          "The port the SimulationThread listens on. You can specify a range with the syntax aaa-bbb.",
+          "29300-29399")
+      .add_setting<int>(
+          "desync-check-interval",
+          "Every this many turns, the SimulationThread takes a hash of the game state to send to its peers. 0 turns "
+          "it off.",
+          10)
+      .add_setting<std::string>(
+          "record-replay",
+          "The SimulationThread records the game to this replay (relative to the data directory), and the benchmark "
+          "checks the turns in it against the other players'.",
+          "lockstep-bench.replay");
+
+  return fw::Settings::initialize(extra_settings, argc, argv, "bench.conf");
+}
+
+int main(int argc, char** argv) {
+  auto status = settings_initialize(argc, argv);
+  if (!status.ok()) {
+    std::cerr << status << std::endl;
+    fw::Settings::print_help();
+    return 1;
+  }
+
+  status = bench::run_bench(fw::Settings::get<std::string>("bench"));
+  if (!status.ok()) {
+    std::cerr << status << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
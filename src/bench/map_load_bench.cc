@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/bitmap.h>
+#include <framework/pack_file.h>
+#include <framework/status.h>
+#include <framework/thread_pool.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+namespace fs = std::filesystem;
+
+// Loads a 1024x1024 map (a 16x16 grid of patches, each with a 128x128 splatt) from a directory of loose files (a
+// heightfield, a PNG per splatt and a byte-per-vertex collision_data) and from a single packed map, along with the
+// eight 512x512 terrain layers. We load each one a job at a time, the way game::WorldReader and game::Terrain used to,
+// and with the jobs spread over a fw::ThreadPool, the way they do now. We report how long each takes and how big each
+// is on disk, and check they all load the same thing.
+//
+// The bench only links the framework, so it builds the packed map itself with the same layout that
+// game/world/packed_map.cc uses.
+namespace {
+
+constexpr int kWidth = 1024;
+constexpr int kLength = 1024;
+constexpr int kPatchSize = 64;
+constexpr int kPatchesWidth = kWidth / kPatchSize;
+constexpr int kPatchesLength = kLength / kPatchSize;
+constexpr int kSplattSize = 128;
+constexpr int kNumLayers = 8;
+constexpr int kLayerSize = 512;
+constexpr int kNumIterations = 5;
+
+struct MapData {
+  std::vector<float> heights;
+  std::vector<fw::Bitmap> splatts;
+  std::vector<bool> collision_data;
+  std::vector<fw::Bitmap> layers;
+};
+
+std::string splatt_name(int patch_x, int patch_z) {
+  return absl::StrCat("splatt-", patch_x, "-", patch_z);
+}
+
+std::string layer_name(int index) {
+  return absl::StrCat("layer-", index, ".png");
+}
+
+// A painted splatt is mostly big areas of one texture or another, with a soft edge between them where the brush fell
+// off. That's what we make here (random noise wouldn't compress at all, in either format).
+uint32_t splatt_channel(float value) {
+  return static_cast<uint32_t>(std::clamp(127.5f + 1000.0f * value, 0.0f, 255.0f));
+}
+
+fw::Bitmap make_splatt(int patch_x, int patch_z) {
+  std::vector<uint32_t> pixels(kSplattSize * kSplattSize);
+  for (int y = 0; y < kSplattSize; y++) {
+    for (int x = 0; x < kSplattSize; x++) {
+      const float fx = (patch_x * kSplattSize + x) * 0.02f;
+      const float fy = (patch_z * kSplattSize + y) * 0.02f;
+      const uint32_t r = splatt_channel(std::sin(fx));
+      const uint32_t g = splatt_channel(std::cos(fy));
+      const uint32_t b = splatt_channel(std::sin(fx + fy));
+      pixels[y * kSplattSize + x] = 0xff000000 | (b << 16) | (g << 8) | r;
+    }
+  }
+  return fw::Bitmap(kSplattSize, kSplattSize, pixels.data());
+}
+
+MapData make_map() {
+  MapData map;
+  map.heights.resize(kWidth * kLength);
+  map.collision_data.resize(kWidth * kLength);
+  for (int z = 0; z < kLength; z++) {
+    for (int x = 0; x < kWidth; x++) {
+      const float height = 20.0f * std::sin(x * 0.031f) * std::cos(z * 0.027f) + 3.0f * std::sin(x * 0.17f + z * 0.11f);
+      map.heights[z * kWidth + x] = height;
+      map.collision_data[z * kWidth + x] = height > 15.0f;
+    }
+  }
+  for (int patch_z = 0; patch_z < kPatchesLength; patch_z++) {
+    for (int patch_x = 0; patch_x < kPatchesWidth; patch_x++) {
+      map.splatts.push_back(make_splatt(patch_x, patch_z));
+    }
+  }
+
+  // The layers are photos of grass and rock and so on: noisy, and they don't compress well.
+  std::mt19937 rng(9876);
+  std::uniform_int_distribution<uint32_t> noise_dist(0, 63);
+  for (int i = 0; i < kNumLayers; i++) {
+    std::vector<uint32_t> pixels(kLayerSize * kLayerSize);
+    for (uint32_t &pixel : pixels) {
+      const uint32_t base = 64 + i * 16;
+      const uint32_t red = base + noise_dist(rng);
+      const uint32_t green = base + noise_dist(rng);
+      const uint32_t blue = base + noise_dist(rng);
+      pixel = 0xff000000 | (red << 16) | (green << 8) | blue;
+    }
+    map.layers.push_back(fw::Bitmap(kLayerSize, kLayerSize, pixels.data()));
+  }
+  return map;
+}
+
+fw::Status write_layers(MapData const &map, fs::path const &layers_dir) {
+  fs::create_directories(layers_dir);
+  for (int i = 0; i < kNumLayers; i++) {
+    RETURN_IF_ERROR(map.layers[i].SaveBitmap(layers_dir / layer_name(i)));
+  }
+  return fw::OkStatus();
+}
+
+template<typename T>
+void write_value(std::ofstream &outs, T value) {
+  outs.write(reinterpret_cast<char const *>(&value), sizeof(T));
+}
+
+fw::Status write_loose_map(MapData const &map, fs::path const &map_dir) {
+  fs::create_directories(map_dir);
+
+  std::ofstream heightfield(map_dir / "heightfield", std::ios::binary);
+  write_value<int32_t>(heightfield, 1);
+  write_value<int32_t>(heightfield, kWidth);
+  write_value<int32_t>(heightfield, kLength);
+  heightfield.write(reinterpret_cast<char const *>(map.heights.data()), map.heights.size() * sizeof(float));
+  heightfield.close();
+
+  for (int patch_z = 0; patch_z < kPatchesLength; patch_z++) {
+    for (int patch_x = 0; patch_x < kPatchesWidth; patch_x++) {
+      fw::Bitmap const &splatt = map.splatts[patch_z * kPatchesWidth + patch_x];
+      RETURN_IF_ERROR(splatt.SaveBitmap(map_dir / (splatt_name(patch_x, patch_z) + ".png")));
+    }
+  }
+
+  std::ofstream collision_data(map_dir / "collision_data", std::ios::binary);
+  write_value<int32_t>(collision_data, 1);
+  write_value<int32_t>(collision_data, kWidth);
+  write_value<int32_t>(collision_data, kLength);
+  for (bool b : map.collision_data) {
+    write_value<uint8_t>(collision_data, b ? 1 : 0);
+  }
+  return fw::OkStatus();
+}
+
+fw::Status write_packed_map(MapData const &map, fs::path const &path) {
+  fw::PackWriter pack;
+
+  std::vector<uint8_t> heightfield(3 * sizeof(int32_t) + map.heights.size() * sizeof(float));
+  const int32_t heightfield_header[3] = {1, kWidth, kLength};
+  std::memcpy(heightfield.data(), heightfield_header, sizeof(heightfield_header));
+  std::memcpy(
+      heightfield.data() + sizeof(heightfield_header), map.heights.data(), map.heights.size() * sizeof(float));
+  pack.add("heightfield", heightfield);
+
+  for (int patch_z = 0; patch_z < kPatchesLength; patch_z++) {
+    for (int patch_x = 0; patch_x < kPatchesWidth; patch_x++) {
+      fw::Bitmap const &splatt = map.splatts[patch_z * kPatchesWidth + patch_x];
+      std::vector<uint8_t> image(2 * sizeof(int32_t) + kSplattSize * kSplattSize * sizeof(uint32_t));
+      const int32_t image_header[2] = {kSplattSize, kSplattSize};
+      std::memcpy(image.data(), image_header, sizeof(image_header));
+      std::memcpy(
+          image.data() + sizeof(image_header), splatt.GetPixels().data(), kSplattSize * kSplattSize * sizeof(uint32_t));
+      pack.add(splatt_name(patch_x, patch_z), image, fw::PackCompression::kLz4);
+    }
+  }
+
+  const int num_words = (kWidth * kLength + 63) / 64;
+  std::vector<uint8_t> collision_data(4 * sizeof(int32_t) + num_words * sizeof(uint64_t));
+  const int32_t collision_header[4] = {2, kWidth, kLength, 0};
+  std::memcpy(collision_data.data(), collision_header, sizeof(collision_header));
+  std::vector<uint64_t> words(num_words);
+  for (size_t i = 0; i < map.collision_data.size(); i++) {
+    if (map.collision_data[i]) {
+      words[i / 64] |= uint64_t(1) << (i % 64);
+    }
+  }
+  std::memcpy(collision_data.data() + sizeof(collision_header), words.data(), num_words * sizeof(uint64_t));
+  pack.add("collision_data", collision_data);
+
+  return pack.write(path);
+}
+
+// Runs each of the jobs (on the thread pool, if we have one) and returns the first error.
+fw::Status run_jobs(fw::ThreadPool *thread_pool, std::vector<std::function<fw::Status()>> const &jobs) {
+  std::vector<fw::Status> statuses(jobs.size());
+  auto run = [&jobs, &statuses](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      statuses[i] = jobs[i]();
+    }
+  };
+  if (thread_pool != nullptr) {
+    thread_pool->parallel_for(jobs.size(), 1, run);
+  } else {
+    run(0, jobs.size());
+  }
+
+  for (fw::Status const &status : statuses) {
+    RETURN_IF_ERROR(status);
+  }
+  return fw::OkStatus();
+}
+
+// The terrain layers are loose files whichever way the map is stored.
+void add_layer_jobs(fs::path const &layers_dir, MapData &map, std::vector<std::function<fw::Status()>> &jobs) {
+  map.layers.resize(kNumLayers);
+  for (int i = 0; i < kNumLayers; i++) {
+    jobs.push_back([&layers_dir, &map, i]() {
+      ASSIGN_OR_RETURN(map.layers[i], fw::LoadBitmap(layers_dir / layer_name(i)));
+      return fw::OkStatus();
+    });
+  }
+}
+
+// This is (more or less) what game::WorldReader and game::Terrain do with a directory of loose files.
+fw::StatusOr<MapData> load_loose_map(fs::path const &map_dir, fs::path const &layers_dir, fw::ThreadPool *thread_pool) {
+  MapData map;
+
+  std::ifstream heightfield(map_dir / "heightfield", std::ios::binary);
+  int32_t header[3];
+  heightfield.read(reinterpret_cast<char *>(header), sizeof(header));
+  map.heights.resize(header[1] * header[2]);
+  heightfield.read(reinterpret_cast<char *>(map.heights.data()), map.heights.size() * sizeof(float));
+
+  std::vector<std::function<fw::Status()>> jobs;
+  add_layer_jobs(layers_dir, map, jobs);
+  map.splatts.resize(kPatchesWidth * kPatchesLength);
+  for (int patch_z = 0; patch_z < kPatchesLength; patch_z++) {
+    for (int patch_x = 0; patch_x < kPatchesWidth; patch_x++) {
+      fs::path path = map_dir / (splatt_name(patch_x, patch_z) + ".png");
+      fw::Bitmap &splatt = map.splatts[patch_z * kPatchesWidth + patch_x];
+      jobs.push_back([path, &splatt]() {
+        ASSIGN_OR_RETURN(splatt, fw::LoadBitmap(path));
+        return fw::OkStatus();
+      });
+    }
+  }
+  jobs.push_back([&map_dir, &map]() {
+    std::ifstream collision_data(map_dir / "collision_data", std::ios::binary);
+    int32_t collision_header[3];
+    collision_data.read(reinterpret_cast<char *>(collision_header), sizeof(collision_header));
+    std::vector<uint8_t> data(collision_header[1] * collision_header[2]);
+    collision_data.read(reinterpret_cast<char *>(data.data()), data.size());
+    map.collision_data.resize(data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+      map.collision_data[i] = (data[i] != 0);
+    }
+    return fw::OkStatus();
+  });
+
+  RETURN_IF_ERROR(run_jobs(thread_pool, jobs));
+  return map;
+}
+
+fw::StatusOr<MapData> load_packed_map(fs::path const &path, fs::path const &layers_dir, fw::ThreadPool *thread_pool) {
+  MapData map;
+  ASSIGN_OR_RETURN(std::unique_ptr<fw::PackReader> pack, fw::PackReader::open(path));
+
+  ASSIGN_OR_RETURN(std::span<uint8_t const> heightfield, pack->get_entry_data("heightfield"));
+  int32_t header[3];
+  std::memcpy(header, heightfield.data(), sizeof(header));
+  map.heights.resize(header[1] * header[2]);
+  std::memcpy(map.heights.data(), heightfield.data() + sizeof(header), map.heights.size() * sizeof(float));
+
+  std::vector<std::function<fw::Status()>> jobs;
+  add_layer_jobs(layers_dir, map, jobs);
+  map.splatts.resize(kPatchesWidth * kPatchesLength);
+  for (int patch_z = 0; patch_z < kPatchesLength; patch_z++) {
+    for (int patch_x = 0; patch_x < kPatchesWidth; patch_x++) {
+      std::string name = splatt_name(patch_x, patch_z);
+      fw::Bitmap &splatt = map.splatts[patch_z * kPatchesWidth + patch_x];
+      jobs.push_back([&pack, name, &splatt]() {
+        ASSIGN_OR_RETURN(std::vector<uint8_t> image, pack->read_entry(name));
+        int32_t image_header[2];
+        std::memcpy(image_header, image.data(), sizeof(image_header));
+        splatt = fw::Bitmap(
+            image_header[0], image_header[1], reinterpret_cast<uint32_t *>(image.data() + sizeof(image_header)));
+        return fw::OkStatus();
+      });
+    }
+  }
+  jobs.push_back([&pack, &map]() {
+    ASSIGN_OR_RETURN(std::span<uint8_t const> collision_data, pack->get_entry_data("collision_data"));
+    int32_t collision_header[4];
+    std::memcpy(collision_header, collision_data.data(), sizeof(collision_header));
+    uint64_t const *words = reinterpret_cast<uint64_t const *>(collision_data.data() + sizeof(collision_header));
+    map.collision_data.resize(collision_header[1] * collision_header[2]);
+    for (size_t i = 0; i < map.collision_data.size(); i++) {
+      map.collision_data[i] = ((words[i / 64] >> (i % 64)) & 1) != 0;
+    }
+    return fw::OkStatus();
+  });
+
+  RETURN_IF_ERROR(run_jobs(thread_pool, jobs));
+  return map;
+}
+
+fw::Status check_map(MapData const &expected, MapData const &actual, char const *what) {
+  if (expected.heights != actual.heights) {
+    return fw::ErrorStatus(absl::StrCat(what, " has the wrong heights"));
+  }
+  if (expected.collision_data != actual.collision_data) {
+    return fw::ErrorStatus(absl::StrCat(what, " has the wrong collision data"));
+  }
+  if (expected.splatts.size() != actual.splatts.size()) {
+    return fw::ErrorStatus(absl::StrCat(what, " has ", actual.splatts.size(), " splatts"));
+  }
+  for (size_t i = 0; i < expected.splatts.size(); i++) {
+    if (expected.splatts[i].GetPixels() != actual.splatts[i].GetPixels()) {
+      return fw::ErrorStatus(absl::StrCat(what, " has the wrong pixels in splatt ", i));
+    }
+  }
+  for (size_t i = 0; i < expected.layers.size(); i++) {
+    if (expected.layers[i].GetPixels() != actual.layers[i].GetPixels()) {
+      return fw::ErrorStatus(absl::StrCat(what, " has the wrong pixels in layer ", i));
+    }
+  }
+  return fw::OkStatus();
+}
+
+uint64_t get_size_on_disk(fs::path const &path) {
+  if (!fs::is_directory(path)) {
+    return fs::file_size(path);
+  }
+  uint64_t size = 0;
+  for (fs::directory_entry const &entry : fs::directory_iterator(path)) {
+    size += entry.file_size();
+  }
+  return size;
+}
+
+template<typename Fn>
+fw::StatusOr<float> time_loads(Fn fn, MapData const &expected, char const *what) {
+  float total_ms = 0.0f;
+  for (int i = 0; i < kNumIterations; i++) {
+    fw::Timer tmr;
+    tmr.start();
+    ASSIGN_OR_RETURN(MapData map, fn());
+    tmr.stop();
+    total_ms += tmr.get_total_time() * 1000.0f;
+    RETURN_IF_ERROR(check_map(expected, map, what));
+  }
+  return total_ms / kNumIterations;
+}
+
+fw::Status map_load_bench() {
+  const MapData map = make_map();
+  const fs::path base = fs::temp_directory_path() / "map-load-bench";
+  const fs::path map_dir = base / "loose";
+  const fs::path packed_path = base / "packed.rpmap";
+  const fs::path layers_dir = base / "layers";
+  fs::remove_all(base);
+
+  RETURN_IF_ERROR(write_loose_map(map, map_dir));
+  RETURN_IF_ERROR(write_packed_map(map, packed_path));
+  RETURN_IF_ERROR(write_layers(map, layers_dir));
+
+  // The same number of threads as game::GetNumLoaderThreads picks by default.
+  const int num_threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0, 8);
+  fw::ThreadPool thread_pool(num_threads);
+
+  // Load each one once first, so that they're both coming out of the OS's file cache.
+  ASSIGN_OR_RETURN(MapData loose, load_loose_map(map_dir, layers_dir, nullptr));
+  ASSIGN_OR_RETURN(MapData packed, load_packed_map(packed_path, layers_dir, nullptr));
+
+  // The PNGs are 8-bit RGBA, so they should come back exactly as we saved them.
+  RETURN_IF_ERROR(check_map(map, loose, "loose map"));
+  RETURN_IF_ERROR(check_map(map, packed, "packed map"));
+
+  ASSIGN_OR_RETURN(float loose_ms, time_loads(
+      [&]() { return load_loose_map(map_dir, layers_dir, nullptr); }, map, "loose map"));
+  ASSIGN_OR_RETURN(float loose_parallel_ms, time_loads(
+      [&]() { return load_loose_map(map_dir, layers_dir, &thread_pool); }, map, "loose map (in parallel)"));
+  ASSIGN_OR_RETURN(float packed_ms, time_loads(
+      [&]() { return load_packed_map(packed_path, layers_dir, nullptr); }, map, "packed map"));
+  ASSIGN_OR_RETURN(float packed_parallel_ms, time_loads(
+      [&]() { return load_packed_map(packed_path, layers_dir, &thread_pool); }, map, "packed map (in parallel)"));
+
+  const auto num_loose_files = std::distance(fs::directory_iterator(map_dir), fs::directory_iterator());
+  bench::report("map-load", "loose_files", num_loose_files, "");
+  bench::report("map-load", "loose_kb", get_size_on_disk(map_dir) / 1024.0, "KB");
+  bench::report("map-load", "packed_kb", get_size_on_disk(packed_path) / 1024.0, "KB");
+  bench::report("map-load", "loader_threads", num_threads, "");
+  bench::report("map-load", "loose_ms", loose_ms, "ms");
+  bench::report("map-load", "loose_parallel_ms", loose_parallel_ms, "ms");
+  bench::report("map-load", "packed_ms", packed_ms, "ms");
+  bench::report("map-load", "packed_parallel_ms", packed_parallel_ms, "ms");
+  fs::remove_all(base);
+
+  if (packed_ms > loose_ms) {
+    return fw::ErrorStatus(absl::StrCat("loading the packed map took ", packed_ms, "ms, vs ", loose_ms, "ms"));
+  }
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("map-load", map_load_bench);
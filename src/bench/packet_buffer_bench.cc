@@ -0,0 +1,256 @@
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/math.h>
+#include <framework/packet_buffer.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <game/simulation/commands.h>
+#include <game/simulation/orders.h>
+#include <game/simulation/packets.h>
+#include <game/simulation/replay.h>
+#include <game/simulation/simulation_thread.h>
+
+#include <bench/bench.h>
+
+// Round-trips a game::CommandPacket full of move orders through fw::net::PacketBuffer, the way Peer::send and
+// Peer::on_receive do (minus ENet itself), and compares it with a stand-in for the old std::stringstream buffer. We
+// also check that every truncated copy of the packet is rejected rather than read past the end.
+namespace {
+
+constexpr int kNumCommands = 200;
+constexpr int kNumRoundTrips = 10000;
+constexpr int kNumPlayers = 4;
+
+// Packet::serialize and deserialize are only for Peer and SharedPacket, this lets us call them as well.
+class BenchCommandPacket : public game::CommandPacket {
+public:
+  using game::CommandPacket::serialize;
+  using game::CommandPacket::deserialize;
+};
+
+// Commands look up their player as they're created, so we need some players for them to find. This is the same as
+// playing back a replay with kNumPlayers players.
+void create_players() {
+  game::ReplayHeader header;
+  header.seed = 2468;
+  header.local_player_no = 1;
+  for (int i = 0; i < kNumPlayers; i++) {
+    header.players.push_back(game::ReplayPlayerInfo { static_cast<uint8_t>(i + 1), absl::StrCat("player ", i + 1) });
+  }
+  game::SimulationThread::get_instance()->start_playback(header);
+}
+
+std::vector<std::shared_ptr<game::Command>> make_commands() {
+  std::mt19937 rng(2468);
+  std::uniform_real_distribution<float> pos_dist(0.0f, 512.0f);
+  std::vector<std::shared_ptr<game::Command>> commands;
+  for (int i = 0; i < kNumCommands; i++) {
+    auto order = game::create_order<game::MoveOrder>();
+    order->goal = fw::Vector(pos_dist(rng), 0.0f, pos_dist(rng));
+    order->group_size = static_cast<uint16_t>(1 + i % 12);
+
+    auto cmd = game::create_command<game::OrderCommand>(static_cast<uint8_t>(1 + i % kNumPlayers));
+    cmd->Entity = static_cast<ent::entity_id>(rng());
+    cmd->order = order;
+    commands.push_back(cmd);
+  }
+  return commands;
+}
+
+uint8_t get_player_no(game::Command const &cmd) {
+  return cmd.get_player() == nullptr ? 0 : cmd.get_player()->get_player_no();
+}
+
+bool same_command(game::Command const &lhs, game::Command const &rhs) {
+  if (lhs.get_identifier() != game::OrderCommand::identifier
+      || rhs.get_identifier() != game::OrderCommand::identifier
+      || get_player_no(lhs) != get_player_no(rhs)) {
+    return false;
+  }
+  auto const &lhs_order_cmd = static_cast<game::OrderCommand const &>(lhs);
+  auto const &rhs_order_cmd = static_cast<game::OrderCommand const &>(rhs);
+  auto lhs_order = std::dynamic_pointer_cast<game::MoveOrder>(lhs_order_cmd.order);
+  auto rhs_order = std::dynamic_pointer_cast<game::MoveOrder>(rhs_order_cmd.order);
+  return lhs_order_cmd.Entity == rhs_order_cmd.Entity && lhs_order && rhs_order
+      && lhs_order->goal[0] == rhs_order->goal[0] && lhs_order->goal[1] == rhs_order->goal[1]
+      && lhs_order->goal[2] == rhs_order->goal[2] && lhs_order->group_size == rhs_order->group_size;
+}
+
+// A stand-in for the old PacketBuffer: a std::stringstream that we copy into a string to send, which ENet copies
+// again, and which we copy into another string (and stream) when we receive it.
+class LegacyPacketBuffer {
+private:
+  std::stringstream buffer_;
+
+public:
+  explicit LegacyPacketBuffer(uint16_t packet_type) {
+    add_bytes(&packet_type, sizeof(packet_type));
+  }
+
+  LegacyPacketBuffer(char const *bytes, size_t n) : buffer_(std::string(bytes, n)) {
+    uint16_t packet_type;
+    get_bytes(&packet_type, sizeof(packet_type));
+  }
+
+  void add_bytes(void const *bytes, size_t n) {
+    buffer_.write(static_cast<char const *>(bytes), n);
+  }
+
+  void get_bytes(void *bytes, size_t n) {
+    buffer_.read(static_cast<char *>(bytes), n);
+  }
+
+  std::string get_value() {
+    buffer_.flush();
+    return buffer_.str();
+  }
+};
+
+template <typename T>
+void legacy_write(LegacyPacketBuffer &buffer, T const &value) {
+  buffer.add_bytes(&value, sizeof(T));
+}
+
+template <typename T>
+void legacy_read(LegacyPacketBuffer &buffer, T &value) {
+  buffer.get_bytes(&value, sizeof(T));
+}
+
+// Writes the same bytes as CommandPacket's fixed encoding, and reads them back into new commands.
+fw::Status legacy_round_trip(
+    std::vector<std::shared_ptr<game::Command>> const &commands,
+    std::vector<std::shared_ptr<game::Command>> &received) {
+  LegacyPacketBuffer out(game::CommandPacket::identifier);
+  legacy_write(out, static_cast<uint8_t>(commands.size()));
+  for (auto const &cmd : commands) {
+    auto const &order_cmd = static_cast<game::OrderCommand const &>(*cmd);
+    auto const &order = static_cast<game::MoveOrder const &>(*order_cmd.order);
+    legacy_write(out, cmd->get_identifier());
+    legacy_write(out, get_player_no(*cmd));
+    legacy_write(out, order_cmd.Entity);
+    legacy_write(out, order.get_identifier());
+    out.add_bytes(order.goal.v, sizeof(float) * 3);
+    legacy_write(out, order.group_size);
+  }
+  std::string value = out.get_value();
+  std::vector<char> sent(value.begin(), value.end());
+
+  LegacyPacketBuffer in(sent.data(), sent.size());
+  uint8_t num_commands;
+  legacy_read(in, num_commands);
+  received.clear();
+  for (uint8_t i = 0; i < num_commands; i++) {
+    uint8_t command_id;
+    uint8_t player_no;
+    uint16_t order_id;
+    legacy_read(in, command_id);
+    legacy_read(in, player_no);
+    ASSIGN_OR_RETURN(std::shared_ptr<game::Command> cmd, game::CreateCommand(command_id, player_no));
+    auto order_cmd = std::static_pointer_cast<game::OrderCommand>(cmd);
+    legacy_read(in, order_cmd->Entity);
+    legacy_read(in, order_id);
+    ASSIGN_OR_RETURN(order_cmd->order, game::CreateOrder(order_id));
+    auto &order = static_cast<game::MoveOrder &>(*order_cmd->order);
+    in.get_bytes(order.goal.v, sizeof(float) * 3);
+    legacy_read(in, order.group_size);
+    received.push_back(cmd);
+  }
+  return fw::OkStatus();
+}
+
+// The same as Peer::send followed by Peer::on_receive: the storage is handed over rather than copied, read in place,
+// and then goes back to the arena.
+fw::Status round_trip(fw::net::PacketArena &arena, BenchCommandPacket &pkt, BenchCommandPacket &received) {
+  fw::net::PacketBuffer out(game::CommandPacket::identifier, fw::net::kWireVersionFixed, arena);
+  pkt.serialize(out);
+  std::unique_ptr<fw::net::PacketStorage> sent = out.take_storage();
+
+  fw::net::PacketBuffer in(sent->bytes.data(), sent->bytes.size());
+  if (in.get_packet_type() != game::CommandPacket::identifier) {
+    return fw::ErrorStatus(absl::StrCat("unexpected packet type ", in.get_packet_type()));
+  }
+  fw::Status status = received.deserialize(in);
+  sent->arena->release(std::move(sent));
+  return status;
+}
+
+fw::Status check_commands(
+    std::vector<std::shared_ptr<game::Command>> const &expected,
+    std::vector<std::shared_ptr<game::Command>> const &actual) {
+  if (expected.size() != actual.size()) {
+    return fw::ErrorStatus(absl::StrCat("expected ", expected.size(), " commands, got ", actual.size()));
+  }
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (!same_command(*expected[i], *actual[i])) {
+      return fw::ErrorStatus(absl::StrCat("command ", i, " didn't survive the round trip"));
+    }
+  }
+  return fw::OkStatus();
+}
+
+// Every prefix of the packet is missing something, so every one of them should fail to deserialize.
+fw::Status check_truncated(BenchCommandPacket &pkt) {
+  fw::net::PacketBuffer out(game::CommandPacket::identifier);
+  pkt.serialize(out);
+  std::vector<uint8_t> bytes(out.get_buffer(), out.get_buffer() + out.get_size());
+
+  BenchCommandPacket received;
+  for (size_t n = 0; n < bytes.size(); n++) {
+    fw::net::PacketBuffer in(bytes.data(), n);
+    if (in.get_status().ok() && received.deserialize(in).ok()) {
+      return fw::ErrorStatus(absl::StrCat("packet truncated to ", n, " of ", bytes.size(), " bytes was accepted"));
+    }
+  }
+  return fw::OkStatus();
+}
+
+fw::Status packet_buffer_bench() {
+  create_players();
+  std::vector<std::shared_ptr<game::Command>> commands = make_commands();
+  std::vector<std::shared_ptr<game::Command>> received;
+  BenchCommandPacket pkt;
+  pkt.set_commands(commands);
+  BenchCommandPacket received_pkt;
+  fw::net::PacketArena arena;
+
+  RETURN_IF_ERROR(round_trip(arena, pkt, received_pkt));
+  RETURN_IF_ERROR(check_commands(commands, received_pkt.get_commands()));
+  RETURN_IF_ERROR(legacy_round_trip(commands, received));
+  RETURN_IF_ERROR(check_commands(commands, received));
+  RETURN_IF_ERROR(check_truncated(pkt));
+
+  fw::Timer tmr;
+  tmr.start();
+  for (int i = 0; i < kNumRoundTrips; i++) {
+    RETURN_IF_ERROR(round_trip(arena, pkt, received_pkt));
+  }
+  tmr.stop();
+  const float packet_buffer_us = tmr.get_total_time() * 1000000.0f / kNumRoundTrips;
+
+  fw::Timer legacy_tmr;
+  legacy_tmr.start();
+  for (int i = 0; i < kNumRoundTrips; i++) {
+    RETURN_IF_ERROR(legacy_round_trip(commands, received));
+  }
+  legacy_tmr.stop();
+  const float legacy_us = legacy_tmr.get_total_time() * 1000000.0f / kNumRoundTrips;
+
+  fw::net::PacketBuffer sized(game::CommandPacket::identifier, fw::net::kWireVersionFixed, arena);
+  pkt.serialize(sized);
+  bench::report("packet-buffer", "packet_size", static_cast<double>(sized.get_size()), "bytes");
+  bench::report("packet-buffer", "packet_buffer.round_trip_us", packet_buffer_us, "us");
+  bench::report("packet-buffer", "legacy.round_trip_us", legacy_us, "us");
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("packet-buffer", packet_buffer_bench);
@@ -0,0 +1,232 @@
+#include <cmath>
+#include <list>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/math.h>
+#include <framework/misc.h>
+#include <framework/particle_buffer.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+// Measures the particle update on a single core: the SoA ParticleBuffer with both its SIMD and scalar kernels, and
+// (for comparison) a stand-in for the old one-object-per-particle layout, where each particle was a shared_ptr in a
+// std::list with its own copy of the life states. We don't need a window or any textures for this, so it runs
+// headless alongside particle-test.
+namespace {
+
+constexpr int kNumEmitters = 20;
+constexpr int kParticlesPerEmitter = 10000;
+constexpr int kNumFrames = 60;
+constexpr float kDt = 1.0f / 60.0f;
+
+// How long we run the SIMD and scalar kernels side-by-side for. This is long enough for plenty of particles to go
+// through every state and die, while we keep emitting more.
+constexpr int kNumCompareFrames = 300;
+constexpr int kEmitPerCompareFrame = 20;
+
+// The SIMD kernel doesn't have to be bit-for-bit the same as the scalar one (the compiler is free to order the scalar
+// maths differently), but it should be very close.
+constexpr float kMaxDifference = 0.001f;
+
+// A typical "smoke" style emitter: it starts off moving upwards, slows down and drifts under gravity, then fades.
+fw::ParticleLifeCurves make_curves() {
+  fw::ParticleLifeCurves curves;
+  curves.add_state(0.0f, 0.5f, 1.0f, -1.0f, 1.0f, fw::ParticleRotation::kRandom,
+      fw::Vector(-0.2f, 1.0f, -0.2f), fw::Vector(0.2f, 1.0f, 0.2f), 4.0f, 6.0f, 0.0f, 0.0f, 1.0f, 0);
+  curves.add_state(0.3f, 1.0f, 2.0f, -0.5f, 0.5f, fw::ParticleRotation::kRandom,
+      fw::Vector(-0.5f, 0.5f, -0.5f), fw::Vector(0.5f, 0.8f, 0.5f), 2.0f, 3.0f, 0.5f, 1.0f, 0.8f, 1);
+  curves.add_state(0.7f, 2.0f, 3.0f, 0.0f, 0.0f, fw::ParticleRotation::kRandom,
+      fw::Vector(0, 0, 0), fw::Vector(0, 0, 0), 0.5f, 1.0f, 1.0f, 2.0f, 0.3f, 2);
+  curves.add_state(1.0f, 3.0f, 4.0f, 0.0f, 0.0f, fw::ParticleRotation::kRandom,
+      fw::Vector(0, 0, 0), fw::Vector(0, 0, 0), 0.0f, 0.0f, 1.0f, 2.0f, 0.0f, 3);
+  curves.finish();
+  return curves;
+}
+
+// The particles start at random ages between 0 and 0.5 and live for 4-6 seconds, so none of them die during the
+// kNumFrames we run for, and we're always updating the full count.
+void fill_buffer(fw::ParticleBuffer &buffer, std::mt19937 &rng) {
+  std::uniform_real_distribution<float> unit_dist(0.0f, 1.0f);
+  std::uniform_real_distribution<float> dir_dist(-1.0f, 1.0f);
+  for (int i = 0; i < kParticlesPerEmitter; i++) {
+    fw::Vector dir = fw::Vector(dir_dist(rng), dir_dist(rng), dir_dist(rng)).normalized();
+    buffer.emit(fw::Vector(0, 0, 0), dir, unit_dist(rng) * 0.5f, 4.0f + unit_dist(rng) * 2.0f, unit_dist(rng));
+  }
+}
+
+fw::StatusOr<float> time_buffers(fw::ParticleLifeCurves const &curves, fw::ParticleBuffer::Kernel kernel) {
+  std::mt19937 rng(1234);
+  std::vector<fw::ParticleBuffer> buffers;
+  for (int i = 0; i < kNumEmitters; i++) {
+    buffers.emplace_back(curves.num_states);
+    fill_buffer(buffers.back(), rng);
+  }
+
+  fw::Timer tmr;
+  tmr.start();
+  for (int frame = 0; frame < kNumFrames; frame++) {
+    for (auto &buffer : buffers) {
+      buffer.update(curves, kDt, kernel);
+    }
+  }
+  tmr.stop();
+
+  for (auto &buffer : buffers) {
+    if (buffer.size() != kParticlesPerEmitter) {
+      return fw::ErrorStatus(absl::StrCat("expected ", kParticlesPerEmitter, " particles, got ", buffer.size()));
+    }
+  }
+  return tmr.get_total_time() * 1000.0f / kNumFrames;
+}
+
+// Runs the same particles through both kernels and makes sure they end up in (very nearly) the same place.
+fw::Status compare_kernels(fw::ParticleLifeCurves const &curves) {
+  std::mt19937 rng(5678);
+  std::uniform_real_distribution<float> unit_dist(0.0f, 1.0f);
+  fw::ParticleBuffer simd_buffer(curves.num_states);
+  fill_buffer(simd_buffer, rng);
+  fw::ParticleBuffer scalar_buffer = simd_buffer;
+
+  for (int frame = 0; frame < kNumCompareFrames; frame++) {
+    simd_buffer.update(curves, kDt, fw::ParticleBuffer::Kernel::kSimd);
+    scalar_buffer.update(curves, kDt, fw::ParticleBuffer::Kernel::kScalar);
+    if (simd_buffer.get_last_emitted() != scalar_buffer.get_last_emitted()) {
+      return fw::ErrorStatus(absl::StrCat("last emitted particle differs on frame ", frame));
+    }
+
+    for (int i = 0; i < kEmitPerCompareFrame; i++) {
+      fw::Vector dir(unit_dist(rng), 1.0f, unit_dist(rng));
+      const float max_age = 1.0f + unit_dist(rng);
+      const float r = unit_dist(rng);
+      simd_buffer.emit(fw::Vector(0, 0, 0), dir, 0.0f, max_age, r);
+      scalar_buffer.emit(fw::Vector(0, 0, 0), dir, 0.0f, max_age, r);
+    }
+  }
+
+  if (simd_buffer.size() != scalar_buffer.size()) {
+    return fw::ErrorStatus(absl::StrCat(
+        "SIMD and scalar kernels have different particle counts: ", simd_buffer.size(), " vs ",
+        scalar_buffer.size()));
+  }
+
+  for (size_t i = 0; i < simd_buffer.size(); i++) {
+    const float difference = (simd_buffer.get_position(i) - scalar_buffer.get_position(i)).length();
+    if (difference > kMaxDifference || simd_buffer.state[i] != scalar_buffer.state[i]) {
+      return fw::ErrorStatus(absl::StrCat(
+          "SIMD and scalar kernels disagree on particle ", i, ": difference ", difference, ", state ",
+          simd_buffer.state[i], " vs ", scalar_buffer.state[i]));
+    }
+  }
+  return fw::OkStatus();
+}
+
+// A stand-in for the old fw::Particle: every particle has its own copy of the life states (with the random values
+// already chosen), and lives in a std::list of shared_ptrs.
+struct LegacyParticle {
+  struct LifeState {
+    float age;
+    float speed;
+    float gravity;
+    float rotation_speed;
+    fw::Vector direction;
+  };
+
+  std::vector<LifeState> states;
+  fw::Vector pos;
+  fw::Vector direction;
+  float age;
+  float max_age;
+  float angle;
+
+  void update(float dt) {
+    age += dt / max_age;
+    auto prev = states.begin();
+    for (; prev != states.end(); ++prev) {
+      auto next = prev + 1;
+      if (next == states.end() || next->age > age) {
+        break;
+      }
+    }
+    auto next = (prev + 1 == states.end()) ? prev : prev + 1;
+    float t = (next == prev) ? 0.0f : (age - prev->age) / (next->age - prev->age);
+
+    fw::Vector gravity = fw::Vector(0, -1, 0) * fw::lerp(prev->gravity, next->gravity, t);
+    if (prev->direction.length() < 0.001f || next->direction.length() < 0.001f) {
+      direction += gravity * dt;
+    } else {
+      direction = fw::lerp(prev->direction, next->direction, t);
+      direction += gravity * age;
+      direction.normalize();
+    }
+    angle += fw::lerp(prev->rotation_speed, next->rotation_speed, t) * dt;
+    pos += direction * fw::lerp(prev->speed, next->speed, t) * dt;
+  }
+};
+
+float time_legacy(fw::ParticleLifeCurves const &curves) {
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> unit_dist(0.0f, 1.0f);
+  std::vector<std::list<std::shared_ptr<LegacyParticle>>> emitters(kNumEmitters);
+  for (auto &particles : emitters) {
+    for (int i = 0; i < kParticlesPerEmitter; i++) {
+      auto p = std::make_shared<LegacyParticle>();
+      float r = unit_dist(rng);
+      for (int s = 0; s < curves.num_states; s++) {
+        LegacyParticle::LifeState state;
+        state.age = curves.age[s];
+        state.speed = curves.speed_base[s] + curves.speed_range[s] * r;
+        state.gravity = curves.gravity_base[s] + curves.gravity_range[s] * r;
+        state.rotation_speed = curves.rotation_speed_base[s] + curves.rotation_speed_range[s] * r;
+        state.direction = fw::Vector(
+            curves.direction_x_base[s] + curves.direction_x_range[s] * r,
+            curves.direction_y_base[s] + curves.direction_y_range[s] * r,
+            curves.direction_z_base[s] + curves.direction_z_range[s] * r);
+        p->states.push_back(state);
+      }
+      p->pos = fw::Vector(0, 0, 0);
+      p->direction = fw::Vector(0, 1, 0);
+      p->age = unit_dist(rng) * 0.5f;
+      p->max_age = 4.0f + unit_dist(rng) * 2.0f;
+      p->angle = 0.0f;
+      particles.push_back(p);
+    }
+  }
+
+  fw::Timer tmr;
+  tmr.start();
+  for (int frame = 0; frame < kNumFrames; frame++) {
+    for (auto &particles : emitters) {
+      for (auto &p : particles) {
+        p->update(kDt);
+      }
+    }
+  }
+  tmr.stop();
+  return tmr.get_total_time() * 1000.0f / kNumFrames;
+}
+
+fw::Status particle_update_bench() {
+  fw::ParticleLifeCurves curves = make_curves();
+  RETURN_IF_ERROR(compare_kernels(curves));
+
+  ASSIGN_OR_RETURN(float simd_ms, time_buffers(curves, fw::ParticleBuffer::Kernel::kSimd));
+  ASSIGN_OR_RETURN(float scalar_ms, time_buffers(curves, fw::ParticleBuffer::Kernel::kScalar));
+  float legacy_ms = time_legacy(curves);
+
+  bench::report("particle-update", "num_particles", kNumEmitters * kParticlesPerEmitter, "particles");
+  bench::report(
+      "particle-update", absl::StrCat("soa_", fw::ParticleBuffer::get_simd_name(), ".frame_ms"), simd_ms, "ms");
+  bench::report("particle-update", "soa_scalar.frame_ms", scalar_ms, "ms");
+  bench::report("particle-update", "legacy.frame_ms", legacy_ms, "ms");
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("particle-update", particle_update_bench);
@@ -0,0 +1,147 @@
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/height_field.h>
+#include <framework/hierarchical_path_find.h>
+#include <framework/misc.h>
+#include <framework/passability_grid.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+// Simulates the editor raising a little hill with the heightfield brush and then the pathing tool catching up with it.
+// The "full" way is what the editor used to do: rebuild a std::vector<bool> of the whole map from the slopes, compare
+// it with the old one cluster by cluster and rebuild the clusters that changed. The "incremental" way is what
+// ed::EditorTerrain does now: recalculate the slopes around the vertices that were edited, in the grid that the path
+// finder shares, and rebuild the clusters around just that. We check that both end up with the same passability.
+namespace {
+
+constexpr int kMapSize = 1024;
+constexpr int kClusterSize = 64;
+constexpr float kMinPassableSlope = 0.85f;
+constexpr int kBrushRadius = 8;
+constexpr int kNumStrokes = 20;
+
+std::vector<float> make_heights() {
+  std::vector<float> heights(kMapSize * kMapSize);
+  for (int z = 0; z < kMapSize; z++) {
+    for (int x = 0; x < kMapSize; x++) {
+      heights[z * kMapSize + x] = 20.0f * std::sin(x * 0.031f) * std::cos(z * 0.027f)
+          + 3.0f * std::sin(x * 0.17f + z * 0.11f);
+    }
+  }
+  return heights;
+}
+
+// Raises a steep little hill around (cx, cz) and returns the rectangle of vertices whose slope may have changed. The
+// hill mustn't go off the edge of the map, since fw::HeightField::update wants wrapped coordinates.
+fw::Rectangle<int> apply_brush(std::vector<float> &heights, fw::HeightField &height_field, int cx, int cz) {
+  for (int dz = -kBrushRadius; dz <= kBrushRadius; dz++) {
+    for (int dx = -kBrushRadius; dx <= kBrushRadius; dx++) {
+      const float distance = std::sqrt(static_cast<float>(dx * dx + dz * dz)) / kBrushRadius;
+      if (distance > 1.0f) {
+        continue;
+      }
+      const int x = cx + dx;
+      const int z = cz + dz;
+      heights[z * kMapSize + x] += 5.0f * (1.0f - distance);
+    }
+  }
+  height_field.update(
+      heights.data(), cx - kBrushRadius, cz - kBrushRadius, cx + kBrushRadius, cz + kBrushRadius);
+  return fw::Rectangle<int>(cx - kBrushRadius - 1, cz - kBrushRadius - 1, kBrushRadius * 2 + 3, kBrushRadius * 2 + 3);
+}
+
+void build_collision_data(std::vector<bool> &collision_data, fw::HeightField const &height_field) {
+  for (int z = 0; z < kMapSize; z++) {
+    for (int x = 0; x < kMapSize; x++) {
+      collision_data[x + (z * kMapSize)] = (height_field.get_vertex_slope(x, z) > kMinPassableSlope);
+    }
+  }
+}
+
+fw::Status passability_bench() {
+  std::vector<float> heights = make_heights();
+  fw::HeightField height_field(kMapSize, kMapSize, heights.data());
+
+  fw::Timer tmr;
+  tmr.start();
+  std::vector<bool> collision_data(kMapSize * kMapSize);
+  build_collision_data(collision_data, height_field);
+  fw::HierarchicalPathFind full_path_find(kMapSize, kMapSize, collision_data, kClusterSize);
+  tmr.stop();
+  const double full_build_ms = tmr.get_total_time() * 1000.0;
+
+  tmr = fw::Timer();
+  tmr.start();
+  auto passability = std::make_shared<fw::PassabilityGrid>(height_field, kMinPassableSlope);
+  fw::HierarchicalPathFind incremental_path_find(passability, kClusterSize);
+  tmr.stop();
+  const double grid_build_ms = tmr.get_total_time() * 1000.0;
+
+  std::mt19937 rng(2468);
+  std::uniform_int_distribution<int> pos_dist(kBrushRadius, kMapSize - kBrushRadius - 1);
+  double full_ms = 0.0;
+  double incremental_ms = 0.0;
+  for (int stroke = 0; stroke < kNumStrokes; stroke++) {
+    const fw::Rectangle<int> rect = apply_brush(heights, height_field, pos_dist(rng), pos_dist(rng));
+
+    tmr = fw::Timer();
+    tmr.start();
+    std::vector<bool> old_collision_data = collision_data;
+    build_collision_data(collision_data, height_field);
+    for (int cluster_z = 0; cluster_z < kMapSize; cluster_z += kClusterSize) {
+      for (int cluster_x = 0; cluster_x < kMapSize; cluster_x += kClusterSize) {
+        bool changed = false;
+        for (int z = cluster_z; !changed && z < cluster_z + kClusterSize; z++) {
+          for (int x = cluster_x; !changed && x < cluster_x + kClusterSize; x++) {
+            changed = old_collision_data[(z * kMapSize) + x] != collision_data[(z * kMapSize) + x];
+          }
+        }
+        if (changed) {
+          full_path_find.update_passability(
+              fw::Rectangle<int>(cluster_x, cluster_z, kClusterSize, kClusterSize), collision_data);
+        }
+      }
+    }
+    tmr.stop();
+    full_ms += tmr.get_total_time() * 1000.0;
+
+    tmr = fw::Timer();
+    tmr.start();
+    passability->update(
+        height_field, kMinPassableSlope, rect.left, rect.top, rect.right() - 1, rect.bottom() - 1);
+    incremental_path_find.update_passability(rect);
+    tmr.stop();
+    incremental_ms += tmr.get_total_time() * 1000.0;
+  }
+
+  for (int z = 0; z < kMapSize; z++) {
+    for (int x = 0; x < kMapSize; x++) {
+      if (passability->is_passable(x, z) != collision_data[(z * kMapSize) + x]) {
+        return fw::ErrorStatus(absl::StrCat("passability differs at ", x, ",", z));
+      }
+      const float slope_error = std::abs(passability->get_slope(x, z) - height_field.get_vertex_slope(x, z));
+      if (slope_error > 0.5f / 255.0f + 1e-6f) {
+        return fw::ErrorStatus(absl::StrCat("slope differs at ", x, ",", z, " by ", slope_error));
+      }
+    }
+  }
+
+  bench::report("passability", "full_build_ms", full_build_ms, "ms");
+  bench::report("passability", "grid_build_ms", grid_build_ms, "ms");
+  bench::report("passability", "full_rebuild_ms_per_stroke", full_ms / kNumStrokes, "ms");
+  bench::report("passability", "incremental_rebuild_ms_per_stroke", incremental_ms / kNumStrokes, "ms");
+  bench::report("passability", "grid_bytes",
+      kMapSize * passability->get_words_per_row() * sizeof(uint64_t) + kMapSize * kMapSize, "bytes");
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("passability", passability_bench);
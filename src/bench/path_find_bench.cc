@@ -0,0 +1,242 @@
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/flow_field.h>
+#include <framework/hierarchical_path_find.h>
+#include <framework/math.h>
+#include <framework/misc.h>
+#include <framework/path_find.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+namespace {
+
+constexpr int kMapSize = 1024;
+constexpr int kNumObstacles = 1500;
+constexpr int kNumRequests = 20;
+constexpr int kClusterSize = 64;
+
+// Generates a map that is mostly passable, with a bunch of round "hills" that are not.
+std::vector<bool> generate_passability(std::mt19937 &rng) {
+  std::vector<bool> passability(kMapSize * kMapSize, true);
+  std::uniform_int_distribution<int> pos_dist(0, kMapSize - 1);
+  std::uniform_int_distribution<int> radius_dist(2, 14);
+  for (int i = 0; i < kNumObstacles; i++) {
+    int cx = pos_dist(rng);
+    int cz = pos_dist(rng);
+    int radius = radius_dist(rng);
+    for (int dz = -radius; dz <= radius; dz++) {
+      for (int dx = -radius; dx <= radius; dx++) {
+        if (dx * dx + dz * dz > radius * radius) {
+          continue;
+        }
+        int x = fw::constrain(cx + dx, kMapSize);
+        int z = fw::constrain(cz + dz, kMapSize);
+        passability[z * kMapSize + x] = false;
+      }
+    }
+  }
+  return passability;
+}
+
+fw::Vector random_passable_location(std::mt19937 &rng, std::vector<bool> const &passability) {
+  std::uniform_int_distribution<int> pos_dist(0, kMapSize - 1);
+  for (;;) {
+    int x = pos_dist(rng);
+    int z = pos_dist(rng);
+    if (passability[z * kMapSize + x]) {
+      return fw::Vector(x, 0, z);
+    }
+  }
+}
+
+float path_length(std::vector<fw::Vector> const &path) {
+  float length = 0.0f;
+  for (int i = 1; i < path.size(); i++) {
+    fw::Vector dir = fw::get_direction_to(path[i - 1], path[i], kMapSize, kMapSize);
+    length += dir.length();
+  }
+  return length;
+}
+
+// Makes sure each step of the path is to an adjacent, passable cell.
+fw::Status check_path(std::vector<fw::Vector> const &path, std::vector<bool> const &passability) {
+  for (int i = 0; i < path.size(); i++) {
+    int x = static_cast<int>(path[i][0]);
+    int z = static_cast<int>(path[i][2]);
+    if (!passability[z * kMapSize + x]) {
+      return fw::ErrorStatus(absl::StrCat("path goes through impassable cell ", x, ",", z));
+    }
+    if (i > 0 && fw::get_direction_to(path[i - 1], path[i], kMapSize, kMapSize).length() > 1.5f) {
+      return fw::ErrorStatus(absl::StrCat("path jumps to non-adjacent cell ", x, ",", z));
+    }
+  }
+  return fw::OkStatus();
+}
+
+// Makes sure the path starts at start, never stays put, and (like the flat search) stops at the first cell within one
+// of end.
+fw::Status check_ends(std::vector<fw::Vector> const &path, fw::Vector const &start, fw::Vector const &end) {
+  if (path.empty() || path[0][0] != static_cast<int>(start[0]) || path[0][2] != static_cast<int>(start[2])) {
+    return fw::ErrorStatus("path doesn't begin at the start");
+  }
+  for (int i = 0; i < path.size(); i++) {
+    if (i > 0 && path[i][0] == path[i - 1][0] && path[i][2] == path[i - 1][2]) {
+      return fw::ErrorStatus(absl::StrCat("path has ", path[i][0], ",", path[i][2], " twice in a row"));
+    }
+    const bool next_to_goal = std::abs(path[i][0] - end[0]) + std::abs(path[i][2] - end[2]) <= 1.0f;
+    if (next_to_goal != (i == path.size() - 1)) {
+      return fw::ErrorStatus(absl::StrCat("path doesn't stop at the first cell next to the goal (cell ", i, " of ",
+          path.size(), ")"));
+    }
+  }
+  return fw::OkStatus();
+}
+
+struct EngineResult {
+  float total_time;
+  int64_t nodes_expanded;
+  std::vector<std::vector<fw::Vector>> paths;
+};
+
+EngineResult run_engine(fw::PathFind &pf, std::vector<std::pair<fw::Vector, fw::Vector>> const &requests) {
+  EngineResult result { 0.0f, 0 };
+  for (auto const &[start, end] : requests) {
+    std::vector<fw::Vector> path;
+
+    fw::Timer tmr;
+    tmr.start();
+    pf.find(path, start, end);
+    tmr.stop();
+
+    result.total_time += tmr.get_total_time();
+    result.nodes_expanded += pf.get_nodes_expanded();
+    result.paths.push_back(path);
+  }
+  return result;
+}
+
+fw::Status path_find_bench() {
+  std::mt19937 rng(1234);
+  std::vector<bool> passability = generate_passability(rng);
+
+  // Cross-map requests, which are the ones that stall the pathing thread.
+  std::vector<std::pair<fw::Vector, fw::Vector>> requests;
+  while (requests.size() < kNumRequests) {
+    fw::Vector start = random_passable_location(rng, passability);
+    fw::Vector end = random_passable_location(rng, passability);
+    if ((end - start).length() < kMapSize / 3) {
+      continue;
+    }
+    requests.emplace_back(start, end);
+  }
+
+  fw::PathFind multiset_pf(kMapSize, kMapSize, passability, fw::PathFind::Engine::kMultiset);
+  EngineResult multiset = run_engine(multiset_pf, requests);
+  fw::PathFind heap_pf(kMapSize, kMapSize, passability, fw::PathFind::Engine::kIndexedHeap);
+  EngineResult heap = run_engine(heap_pf, requests);
+
+  fw::Timer build_tmr;
+  build_tmr.start();
+  fw::HierarchicalPathFind hpa_pf(kMapSize, kMapSize, passability, kClusterSize);
+  build_tmr.stop();
+  EngineResult hpa = run_engine(hpa_pf, requests);
+
+  for (int i = 0; i < kNumRequests; i++) {
+    auto const &lhs = multiset.paths[i];
+    auto const &rhs = heap.paths[i];
+    bool same = lhs.size() == rhs.size();
+    for (int j = 0; same && j < lhs.size(); j++) {
+      same = (lhs[j] - rhs[j]).length() < 0.001f;
+    }
+    if (!same) {
+      return fw::ErrorStatus(absl::StrCat("path ", i, " differs between engines (", lhs.size(), " vs ",
+          rhs.size(), " nodes)"));
+    }
+  }
+
+  bench::report("path-find", "multiset.nodes_per_second", multiset.nodes_expanded / multiset.total_time, "nodes/s");
+  bench::report("path-find", "multiset.ms_per_request", multiset.total_time * 1000.0f / kNumRequests, "ms");
+  bench::report("path-find", "heap.nodes_per_second", heap.nodes_expanded / heap.total_time, "nodes/s");
+  bench::report("path-find", "heap.ms_per_request", heap.total_time * 1000.0f / kNumRequests, "ms");
+  bench::report("path-find", "nodes_expanded_per_request", heap.nodes_expanded / kNumRequests, "nodes");
+
+  // The hierarchical paths won't be identical, but they must be valid and not much longer.
+  float flat_length = 0.0f;
+  float hpa_length = 0.0f;
+  for (int i = 0; i < kNumRequests; i++) {
+    RETURN_IF_ERROR(check_path(hpa.paths[i], passability));
+    RETURN_IF_ERROR(check_ends(heap.paths[i], requests[i].first, requests[i].second));
+    RETURN_IF_ERROR(check_ends(hpa.paths[i], requests[i].first, requests[i].second));
+    flat_length += path_length(heap.paths[i]);
+    hpa_length += path_length(hpa.paths[i]);
+  }
+  bench::report("path-find", "hpa.build_ms", build_tmr.get_total_time() * 1000.0f, "ms");
+  bench::report("path-find", "hpa.abstract_nodes", hpa_pf.get_num_abstract_nodes(), "nodes");
+  bench::report("path-find", "hpa.ms_per_request", hpa.total_time * 1000.0f / kNumRequests, "ms");
+  bench::report("path-find", "hpa.nodes_expanded_per_request", hpa.nodes_expanded / kNumRequests, "nodes");
+  bench::report("path-find", "hpa.path_length_ratio", hpa_length / flat_length, "x");
+
+  // A flow field towards the first request's goal should get every start (that can reach it) there, along a path that
+  // is no longer than the one A* finds (give or take the last step, since A* stops when it's next to the goal).
+  fw::Timer flow_tmr;
+  flow_tmr.start();
+  fw::FlowField flow_field(*heap_pf.get_passability(), static_cast<int>(requests[0].second[0]),
+      static_cast<int>(requests[0].second[2]));
+  flow_tmr.stop();
+  for (auto const &[start, end] : requests) {
+    std::vector<fw::Vector> path;
+    int x = static_cast<int>(start[0]);
+    int z = static_cast<int>(start[2]);
+    path.push_back(fw::Vector(x, 0, z));
+    while (flow_field.get_next_cell(x, z, x, z)) {
+      x = fw::constrain(x, kMapSize);
+      z = fw::constrain(z, kMapSize);
+      path.push_back(fw::Vector(x, 0, z));
+      if (path.size() > kMapSize * kMapSize) {
+        return fw::ErrorStatus("flow field has a cycle");
+      }
+    }
+    RETURN_IF_ERROR(check_path(path, passability));
+    if (flow_field.is_reachable(x, z) && flow_field.get_cost(x, z) != 0.0f) {
+      return fw::ErrorStatus(absl::StrCat("flow field stopped short of the goal at ", x, ",", z));
+    }
+    std::vector<fw::Vector> flat_path;
+    if (heap_pf.find(flat_path, start, requests[0].second) && path_length(path) > path_length(flat_path) + 1.5f) {
+      return fw::ErrorStatus(absl::StrCat("flow field path is longer than A* path (", path_length(path), " vs ",
+          path_length(flat_path), ")"));
+    }
+  }
+  bench::report("path-find", "flow_field.build_ms", flow_tmr.get_total_time() * 1000.0f, "ms");
+  bench::report("path-find", "flow_field.nodes_expanded", flow_field.get_nodes_expanded(), "nodes");
+
+  // Rebuilding a single cluster should be much cheaper than building the whole graph.
+  std::vector<bool> edited = passability;
+  for (int z = 0; z < kClusterSize; z++) {
+    for (int x = 0; x < kClusterSize; x++) {
+      edited[(z + kClusterSize) * kMapSize + x + kClusterSize] = ((x / 8) % 2 == 0);
+    }
+  }
+  fw::Timer update_tmr;
+  update_tmr.start();
+  hpa_pf.update_passability(fw::Rectangle<int>(kClusterSize, kClusterSize, kClusterSize, kClusterSize), edited);
+  update_tmr.stop();
+  bench::report("path-find", "hpa.update_cluster_ms", update_tmr.get_total_time() * 1000.0f, "ms");
+
+  fw::HierarchicalPathFind rebuilt_pf(kMapSize, kMapSize, edited, kClusterSize);
+  if (rebuilt_pf.get_num_abstract_nodes() != hpa_pf.get_num_abstract_nodes()) {
+    return fw::ErrorStatus(absl::StrCat("incremental rebuild has ", hpa_pf.get_num_abstract_nodes(),
+        " abstract nodes, full rebuild has ", rebuilt_pf.get_num_abstract_nodes()));
+  }
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("path-find", path_find_bench);
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/math.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <game/entities/entity.h>
+#include <game/entities/entity_attribute.h>
+#include <game/entities/entity_manager.h>
+#include <game/entities/moveable_component.h>
+#include <game/entities/orderable_component.h>
+#include <game/entities/ownable_component.h>
+#include <game/entities/position_component.h>
+#include <game/entities/projectile_component.h>
+#include <game/entities/weapon_component.h>
+#include <game/simulation/simulation_thread.h>
+#include <game/simulation/snapshot.h>
+
+#include <bench/bench.h>
+#include <bench/bench_world.h>
+
+// Writes a snapshot of 20,000 entities with the real ent::EntityManager, and times reading it back with
+// EntityManager::read_snapshot, which is what a player joining a game in progress waits for. Most of the entities are
+// tanks that are moving and shooting at each other, with a few factories and some missiles in flight. Restoring a
+// snapshot should be a lot quicker than replaying the game, so this fails if reading it back takes longer than
+// kMaxReadMs. We also check that the restored entities are in exactly the same state as the ones we saved.
+namespace {
+
+constexpr int kMapSize = 512;
+constexpr int kNumPlayers = 4;
+constexpr int kNumEntities = 20000;
+constexpr int kNumIterations = 5;
+constexpr float kMaxReadMs = 100.0f;
+
+// The bench doesn't have the Lua templates, so we build the prototypes the templates would give us.
+void add_prototypes(ent::EntityManager &entities) {
+  ent::PositionComponent *tank_position = new ent::PositionComponent();
+  tank_position->set_sit_on_terrain(true);
+  tank_position->set_orient_to_terrain(true);
+  entities.set_prototype("tank",
+      { tank_position, new ent::OwnableComponent(), new ent::OrderableComponent(), new ent::MoveableComponent(),
+        new ent::WeaponComponent() },
+      { ent::EntityAttribute("health", 100.0f) });
+
+  ent::PositionComponent *factory_position = new ent::PositionComponent();
+  factory_position->set_sit_on_terrain(true);
+  entities.set_prototype("factory",
+      { factory_position, new ent::OwnableComponent(), new ent::OrderableComponent() },
+      { ent::EntityAttribute("health", 500.0f) });
+
+  entities.set_prototype("missile",
+      { new ent::PositionComponent(), new ent::MoveableComponent(), new ent::SeekingProjectileComponent() }, {});
+}
+
+void create_entities(ent::EntityManager &entities) {
+  std::mt19937 rng(1357);
+  std::uniform_real_distribution<float> pos_dist(0.0f, static_cast<float>(kMapSize));
+  std::uniform_real_distribution<float> unit_dist(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> health_dist(1.0f, 100.0f);
+  auto const &players = game::SimulationThread::get_instance()->get_players();
+
+  std::vector<std::shared_ptr<ent::Entity>> tanks;
+  std::vector<std::shared_ptr<ent::Entity>> missiles;
+  for (int i = 0; i < kNumEntities; i++) {
+    // Give them identifiers like the ones CreateEntityCommand would, from each player in turn.
+    uint8_t player_no = static_cast<uint8_t>(1 + i % kNumPlayers);
+    ent::entity_id id = static_cast<ent::entity_id>((static_cast<uint32_t>(player_no) << 24) | (i + 1));
+
+    std::string template_name = (i % 20 == 0) ? "factory" : (i % 10 == 5 && !tanks.empty()) ? "missile" : "tank";
+    std::shared_ptr<ent::Entity> creator;
+    if (template_name == "missile") {
+      creator = tanks[rng() % tanks.size()];
+    }
+    std::shared_ptr<ent::Entity> ent = entities.create_entity(creator, template_name, id);
+    ent->set_position(fw::Vector(pos_dist(rng), 0.0f, pos_dist(rng)));
+    ent::PositionComponent *position = ent->get_component<ent::PositionComponent>();
+    position->set_direction(fw::Vector(unit_dist(rng), 0.0f, unit_dist(rng)).normalized());
+    // The game takes snapshots between frames, after everything has worked out its final position.
+    position->get_position();
+
+    ent::OwnableComponent *ownable = ent->get_component<ent::OwnableComponent>();
+    if (ownable != nullptr) {
+      ownable->set_owner(players[player_no - 1]);
+    }
+    ent::EntityAttribute *health = ent->get_attribute("health");
+    if (health != nullptr) {
+      health->set_value(health_dist(rng));
+    }
+
+    ent::MoveableComponent *moveable = ent->get_component<ent::MoveableComponent>();
+    if (moveable != nullptr) {
+      moveable->set_goal(fw::Vector(pos_dist(rng), 0.0f, pos_dist(rng)), true);
+    }
+    if (template_name == "tank") {
+      tanks.push_back(ent);
+    } else if (template_name == "missile") {
+      missiles.push_back(ent);
+    }
+  }
+
+  // Once they're all there, a third of the tanks and all of the missiles get a target.
+  for (size_t i = 0; i < tanks.size(); i += 3) {
+    tanks[i]->get_component<ent::WeaponComponent>()->set_target(tanks[rng() % tanks.size()]);
+  }
+  for (std::shared_ptr<ent::Entity> const &missile : missiles) {
+    ent::ProjectileComponent *projectile =
+        dynamic_cast<ent::ProjectileComponent *>(missile->get_component(ent::ProjectileComponent::identifier));
+    projectile->set_target(tanks[rng() % tanks.size()]);
+  }
+}
+
+fw::Status snapshot_bench() {
+  ASSIGN_OR_RETURN(std::unique_ptr<bench::BenchWorld> world, bench::create_bench_world(kMapSize, kNumPlayers));
+  ent::EntityManager &entities = *world->get_entity_manager();
+  add_prototypes(entities);
+  create_entities(entities);
+  const std::string expected_dump = entities.write_state_dump();
+
+  fw::Timer write_tmr;
+  write_tmr.start();
+  game::Snapshot snapshot;
+  entities.write_snapshot(snapshot);
+  snapshot.finish();
+  write_tmr.stop();
+
+  // A player joining a game has no entities yet, so we clear ours out (by restoring an empty snapshot) before each
+  // time we restore the real one.
+  game::Snapshot empty_snapshot;
+  empty_snapshot.finish();
+
+  float total_read_ms = 0.0f;
+  float max_read_ms = 0.0f;
+  for (int i = 0; i < kNumIterations; i++) {
+    RETURN_IF_ERROR(entities.read_snapshot(empty_snapshot));
+
+    fw::Timer read_tmr;
+    read_tmr.start();
+    RETURN_IF_ERROR(entities.read_snapshot(snapshot));
+    read_tmr.stop();
+
+    const float read_ms = read_tmr.get_total_time() * 1000.0f;
+    total_read_ms += read_ms;
+    max_read_ms = std::max(max_read_ms, read_ms);
+    if (entities.write_state_dump() != expected_dump) {
+      return fw::ErrorStatus("restored entities don't match the ones we saved");
+    }
+  }
+
+  bench::report("snapshot", "num_entities", kNumEntities, "entities");
+  bench::report("snapshot", "size", static_cast<double>(snapshot.get_bytes().size()) / 1024.0, "KiB");
+  bench::report("snapshot", "write_ms", write_tmr.get_total_time() * 1000.0f, "ms");
+  bench::report("snapshot", "read_ms", total_read_ms / kNumIterations, "ms");
+  bench::report("snapshot", "read_max_ms", max_read_ms, "ms");
+  if (max_read_ms > kMaxReadMs) {
+    return fw::ErrorStatus(absl::StrCat(
+        "restoring ", kNumEntities, " entities took ", max_read_ms, "ms, more than ", kMaxReadMs, "ms"));
+  }
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("snapshot", snapshot_bench);
@@ -0,0 +1,176 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/lockstep_scheduler.h>
+#include <framework/math.h>
+#include <framework/state_hash.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+// Measures what it costs to keep fw::StateHash up-to-date for a big game, the way the entity components do: every
+// moving entity folds in its new position every frame, and a few of them change health or orders. The budget is 1% of
+// the shortest turn the LockstepScheduler will pick. We also check the incremental hash against hashing everything
+// from scratch, which is what we'd have to do every turn without it.
+namespace {
+
+constexpr int kNumEntities = 10000;
+constexpr int kNumTurns = 100;
+
+// The entities update every frame, and there's a few frames per turn.
+constexpr int kFramesPerTurn = 3;
+
+// The fraction of entities that take damage, and that get new orders, each frame.
+constexpr float kDamageFraction = 0.05f;
+constexpr float kOrderFraction = 0.01f;
+
+constexpr float kMaxTurnFraction = 0.01f;
+
+// The component identifiers we use as the "kind" of each value, the same as the real components.
+constexpr int kPositionIdentifier = 100;
+constexpr int kDamageableIdentifier = 450;
+constexpr int kOrderableIdentifier = 550;
+
+struct BenchEntity {
+  uint32_t id;
+  fw::Vector pos;
+  fw::Vector velocity;
+  float health;
+  uint16_t order_id;
+  int order_count;
+
+  fw::StateHash::Element position_hash;
+  fw::StateHash::Element health_hash;
+  fw::StateHash::Element orders_hash;
+
+  uint64_t get_position_value() const {
+    return fw::StateHash::combine(id, kPositionIdentifier, pos[0], pos[1], pos[2]);
+  }
+  uint64_t get_health_value() const {
+    return fw::StateHash::combine(id, kDamageableIdentifier, health);
+  }
+  uint64_t get_orders_value() const {
+    return fw::StateHash::combine(id, kOrderableIdentifier, false, order_id, order_count);
+  }
+};
+
+// The entities are contiguous, like the components in a ComponentStore.
+void init_entities(std::vector<BenchEntity> &entities, fw::StateHash &hash) {
+  std::mt19937 rng(97531);
+  std::uniform_real_distribution<float> pos_dist(0.0f, 512.0f);
+  std::uniform_real_distribution<float> velocity_dist(-1.0f, 1.0f);
+  for (size_t i = 0; i < entities.size(); i++) {
+    BenchEntity &entity = entities[i];
+    entity.id = static_cast<uint32_t>(1000 + i);
+    entity.pos = fw::Vector(pos_dist(rng), 0.0f, pos_dist(rng));
+    entity.velocity = fw::Vector(velocity_dist(rng), 0.0f, velocity_dist(rng));
+    entity.health = 100.0f;
+    entity.order_id = 0;
+    entity.order_count = 0;
+    entity.position_hash.set(hash, entity.get_position_value());
+    entity.health_hash.set(hash, entity.get_health_value());
+    entity.orders_hash.set(hash, entity.get_orders_value());
+  }
+}
+
+// What the hash would be if we started again from nothing.
+uint64_t rehash(std::vector<BenchEntity> const &entities) {
+  fw::StateHash hash;
+  std::vector<fw::StateHash::Element> elements(entities.size() * 3);
+  for (size_t i = 0; i < entities.size(); i++) {
+    elements[i * 3].set(hash, entities[i].get_position_value());
+    elements[i * 3 + 1].set(hash, entities[i].get_health_value());
+    elements[i * 3 + 2].set(hash, entities[i].get_orders_value());
+  }
+  return hash.get();
+}
+
+// Changes the entities like a frame of the game would, and returns the time we spent updating the hash.
+float simulate_frame(std::vector<BenchEntity> &entities, fw::StateHash &hash, std::mt19937 &rng) {
+  std::uniform_real_distribution<float> unit_dist(0.0f, 1.0f);
+  for (auto &entity : entities) {
+    entity.pos += entity.velocity * 0.1f;
+    if (unit_dist(rng) < kDamageFraction) {
+      entity.health -= 1.0f;
+    }
+    if (unit_dist(rng) < kOrderFraction) {
+      entity.order_id = static_cast<uint16_t>(1 + rng() % 3);
+      entity.order_count = 1;
+    }
+  }
+
+  // The real components fold their new value in as soon as it changes. We do it in a separate pass here, so we're
+  // only timing the hashing.
+  fw::Timer tmr;
+  tmr.start();
+  for (auto &entity : entities) {
+    entity.position_hash.set(hash, entity.get_position_value());
+  }
+  for (auto &entity : entities) {
+    if (entity.health != 100.0f) {
+      entity.health_hash.set(hash, entity.get_health_value());
+    }
+    if (entity.order_count != 0) {
+      entity.orders_hash.set(hash, entity.get_orders_value());
+    }
+  }
+  tmr.stop();
+  return tmr.get_total_time();
+}
+
+fw::Status state_hash_bench() {
+  fw::StateHash hash;
+  std::vector<BenchEntity> entities(kNumEntities);
+  init_entities(entities, hash);
+  if (hash.get() != rehash(entities)) {
+    return fw::ErrorStatus("initial hash doesn't match a full rehash");
+  }
+
+  std::mt19937 rng(86420);
+  float incremental_s = 0.0f;
+  for (int turn = 0; turn < kNumTurns; turn++) {
+    for (int frame = 0; frame < kFramesPerTurn; frame++) {
+      incremental_s += simulate_frame(entities, hash, rng);
+    }
+  }
+
+  fw::Timer rehash_tmr;
+  rehash_tmr.start();
+  const uint64_t expected = rehash(entities);
+  rehash_tmr.stop();
+  if (hash.get() != expected) {
+    return fw::ErrorStatus(absl::StrCat("incremental hash ", hash.get(), " doesn't match a full rehash ", expected));
+  }
+
+  // Removing everything should leave nothing behind.
+  for (auto &entity : entities) {
+    entity.position_hash.clear();
+    entity.health_hash.clear();
+    entity.orders_hash.clear();
+  }
+  if (hash.get() != 0) {
+    return fw::ErrorStatus(absl::StrCat("hash should be zero once everything is removed, got ", hash.get()));
+  }
+
+  const float turn_ms = incremental_s * 1000.0f / kNumTurns;
+  const float min_turn_length_ms = fw::net::LockstepConfig().min_turn_length_ms;
+  const float turn_fraction = turn_ms / min_turn_length_ms;
+  bench::report("state-hash", "num_entities", kNumEntities, "entities");
+  bench::report("state-hash", "incremental.turn_ms", turn_ms, "ms");
+  bench::report("state-hash", "incremental.turn_fraction", turn_fraction * 100.0f, "%");
+  bench::report("state-hash", "full_rehash.turn_ms", rehash_tmr.get_total_time() * 1000.0f, "ms");
+  if (turn_fraction > kMaxTurnFraction) {
+    return fw::ErrorStatus(absl::StrCat(
+        "hashing takes ", turn_ms, "ms per turn, more than ", kMaxTurnFraction * 100.0f, "% of a ",
+        min_turn_length_ms, "ms turn"));
+  }
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("state-hash", state_hash_bench);
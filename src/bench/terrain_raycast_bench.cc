@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/height_field.h>
+#include <framework/height_pyramid.h>
+#include <framework/math.h>
+#include <framework/misc.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+// Casts rays at a 512x512 hilly terrain the way the camera and cursor do (from 20-60 units above the ground, looking
+// down at 20-70 degrees, from 5 to 150 units along the ray) with the walk-along-the-ray search that
+// game::Terrain::get_cursor_location used to do, and with fw::HeightPyramid. We report the cost per ray of each, and
+// check that they find the same point.
+//
+// They won't always agree exactly: the old search tests each cell against the planes of its two triangles (not the
+// triangles themselves) and takes the first hit in a 3x3 block around each step, which isn't always the nearest, so
+// it can be a fraction of a cell out. The 3x3 block also means it looks a cell or so past either end of the ray, so
+// we count those hits as misses. We count how many agree to within kMatchDistance and fail if that's less than
+// kMinMatchFraction.
+namespace {
+
+constexpr int kWidth = 512;
+constexpr int kLength = 512;
+constexpr int kNumRays = 20000;
+constexpr int kNumIterations = 5;
+constexpr float kMinDistance = 5.0f;
+constexpr float kMaxDistance = 150.0f;
+constexpr float kMatchDistance = 0.5f;
+constexpr float kMinMatchFraction = 0.99f;
+
+std::vector<float> make_heights() {
+  std::vector<float> heights(kWidth * kLength);
+  for (int z = 0; z < kLength; z++) {
+    for (int x = 0; x < kWidth; x++) {
+      heights[z * kWidth + x] = 20.0f * std::sin(x * 0.031f) * std::cos(z * 0.027f)
+          + 3.0f * std::sin(x * 0.17f + z * 0.11f) + 0.5f * std::cos(x * 0.91f - z * 0.77f);
+    }
+  }
+  return heights;
+}
+
+// This is how game::Terrain::get_cursor_location used to do it.
+fw::Vector legacy_raycast(fw::HeightField const &height_field, fw::Vector const &start, fw::Vector const &direction) {
+  fw::Vector evec = start + (direction * kMaxDistance);
+  fw::Vector svec = start + (direction * kMinDistance);
+
+  int sx = static_cast<int>(floor(svec[0] + 0.5f));
+  int sz = static_cast<int>(floor(svec[2] + 0.5f));
+  int ex = static_cast<int>(floor(evec[0] + 0.5f));
+  int ez = static_cast<int>(floor(evec[2] + 0.5f));
+
+  int dx = ex - sx;
+  int dz = ez - sz;
+  int steps = std::max(std::abs(dx), std::abs(dz));
+  float xinc = dx / static_cast<float>(steps);
+  float zinc = dz / static_cast<float>(steps);
+
+  float x = static_cast<float>(sx);
+  float z = static_cast<float>(sz);
+  for (int i = 0; i <= steps; i++) {
+    int ix = static_cast<int>(floor(x + 0.5f));
+    int iz = static_cast<int>(floor(z + 0.5f));
+    for (int oz = iz - 1; oz <= iz + 1; oz++) {
+      for (int ox = ix - 1; ox <= ix + 1; ox++) {
+        float x1 = static_cast<float>(ox);
+        float x2 = static_cast<float>(ox + 1);
+        float z1 = static_cast<float>(oz);
+        float z2 = static_cast<float>(oz + 1);
+
+        fw::Vector p11(x1, height_field.get_vertex_height(ox, oz), z1);
+        fw::Vector p21(x2, height_field.get_vertex_height(ox + 1, oz), z1);
+        fw::Vector p12(x1, height_field.get_vertex_height(ox, oz + 1), z2);
+        fw::Vector p22(x2, height_field.get_vertex_height(ox + 1, oz + 1), z2);
+
+        fw::Vector n1 = fw::cross(p12 - p11, p21 - p11);
+        fw::Vector n2 = fw::cross(p21 - p22, p12 - p22);
+
+        fw::Vector i1 = fw::point_plane_intersect(p11, n1, start, direction);
+        if (i1[0] > x1 && i1[0] <= x2 && i1[2] > z1 && i1[2] <= z2) {
+          return i1;
+        }
+        fw::Vector i2 = fw::point_plane_intersect(p22, n2, start, direction);
+        if (i2[0] > x1 && i2[0] <= x2 && i2[2] > z1 && i2[2] <= z2) {
+          return i2;
+        }
+      }
+    }
+
+    x += xinc;
+    z += zinc;
+  }
+
+  return fw::Vector(0, 0, 0);
+}
+
+std::vector<fw::Ray> make_rays(fw::HeightField const &height_field) {
+  std::mt19937 rng(1357);
+  std::uniform_real_distribution<float> x_dist(0.0f, static_cast<float>(kWidth));
+  std::uniform_real_distribution<float> z_dist(0.0f, static_cast<float>(kLength));
+  std::uniform_real_distribution<float> height_dist(20.0f, 60.0f);
+  std::uniform_real_distribution<float> yaw_dist(0.0f, 2.0f * static_cast<float>(M_PI));
+  std::uniform_real_distribution<float> pitch_dist(20.0f, 70.0f);
+
+  std::vector<fw::Ray> rays(kNumRays);
+  for (fw::Ray &ray : rays) {
+    const float x = x_dist(rng);
+    const float z = z_dist(rng);
+    const float yaw = yaw_dist(rng);
+    const float pitch = pitch_dist(rng) * static_cast<float>(M_PI) / 180.0f;
+    ray.start = fw::Vector(x, height_field.get_height(x, z) + height_dist(rng), z);
+    ray.direction = fw::Vector(
+        std::cos(yaw) * std::cos(pitch), -std::sin(pitch), std::sin(yaw) * std::cos(pitch));
+    ray.min_distance = kMinDistance;
+    ray.max_distance = kMaxDistance;
+  }
+  return rays;
+}
+
+fw::Status terrain_raycast_bench() {
+  const std::vector<float> heights = make_heights();
+  fw::HeightField height_field(kWidth, kLength, heights.data());
+
+  fw::Timer tmr;
+  tmr.start();
+  fw::HeightPyramid pyramid(height_field);
+  tmr.stop();
+  const float build_ms = tmr.get_total_time() * 1000.0f;
+
+  const std::vector<fw::Ray> rays = make_rays(height_field);
+
+  std::vector<fw::Vector> legacy_hits(kNumRays);
+  tmr = fw::Timer();
+  tmr.start();
+  for (int iteration = 0; iteration < kNumIterations; iteration++) {
+    for (int i = 0; i < kNumRays; i++) {
+      legacy_hits[i] = legacy_raycast(height_field, rays[i].start, rays[i].direction);
+    }
+  }
+  tmr.stop();
+  const double legacy_us = tmr.get_total_time() * 1000000.0 / (kNumIterations * kNumRays);
+
+  std::vector<fw::RayHit> hits(kNumRays);
+  tmr = fw::Timer();
+  tmr.start();
+  for (int iteration = 0; iteration < kNumIterations; iteration++) {
+    for (int i = 0; i < kNumRays; i++) {
+      pyramid.raycast(rays[i], hits[i]);
+    }
+  }
+  tmr.stop();
+  const double pyramid_us = tmr.get_total_time() * 1000000.0 / (kNumIterations * kNumRays);
+
+  std::vector<fw::RayHit> batched_hits(kNumRays);
+  tmr = fw::Timer();
+  tmr.start();
+  for (int iteration = 0; iteration < kNumIterations; iteration++) {
+    pyramid.raycast(rays, batched_hits);
+  }
+  tmr.stop();
+  const double batched_us = tmr.get_total_time() * 1000000.0 / (kNumIterations * kNumRays);
+
+  int num_hits = 0;
+  int num_matches = 0;
+  float max_distance = 0.0f;
+  double total_distance = 0.0;
+  int num_both_hit = 0;
+  for (int i = 0; i < kNumRays; i++) {
+    if (batched_hits[i].hit != hits[i].hit || batched_hits[i].distance != hits[i].distance) {
+      return fw::ErrorStatus(absl::StrCat("ray ", i, " hit something different when batched"));
+    }
+
+    // The old search returns (0,0,0) when it misses.
+    const fw::Vector expected = legacy_hits[i];
+    const float legacy_distance = fw::dot(expected - rays[i].start, rays[i].direction);
+    const bool legacy_hit = (expected[0] != 0.0f || expected[1] != 0.0f || expected[2] != 0.0f)
+        && legacy_distance >= kMinDistance && legacy_distance <= kMaxDistance;
+    if (hits[i].hit) {
+      num_hits++;
+    }
+    if (legacy_hit != hits[i].hit) {
+      continue;
+    }
+    if (!legacy_hit) {
+      num_matches++;
+      continue;
+    }
+    const float distance = (hits[i].location - expected).length();
+    max_distance = std::max(max_distance, distance);
+    total_distance += distance;
+    num_both_hit++;
+    if (distance <= kMatchDistance) {
+      num_matches++;
+    }
+  }
+
+  const float match_fraction = num_matches / static_cast<float>(kNumRays);
+  bench::report("terrain-raycast", "pyramid_levels", pyramid.get_num_levels(), "");
+  bench::report("terrain-raycast", "build_ms", build_ms, "ms");
+  bench::report("terrain-raycast", "legacy_us_per_ray", legacy_us, "us");
+  bench::report("terrain-raycast", "pyramid_us_per_ray", pyramid_us, "us");
+  bench::report("terrain-raycast", "batched_us_per_ray", batched_us, "us");
+  bench::report("terrain-raycast", "hit_fraction", num_hits / static_cast<float>(kNumRays), "");
+  bench::report("terrain-raycast", "match_fraction", match_fraction, "");
+  bench::report("terrain-raycast", "mean_match_distance", total_distance / std::max(num_both_hit, 1), "");
+  bench::report("terrain-raycast", "max_match_distance", max_distance, "");
+  if (match_fraction < kMinMatchFraction) {
+    return fw::ErrorStatus(absl::StrCat(
+        "only ", num_matches, " of ", kNumRays, " rays hit the same place as they used to"));
+  }
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("terrain-raycast", terrain_raycast_bench);
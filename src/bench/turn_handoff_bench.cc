@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/spsc_queue.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <bench/bench.h>
+
+// Hammers the fw::SpscQueue that game::TurnHandoff uses to hand turns from the simulation thread to the update thread.
+// The game's commands aren't part of the framework, so BenchBundle stands in for a TurnBundle: a turn number, a vector
+// of "commands" and the time it was closed. The consumer checks that every bundle turns up exactly once, in order,
+// with its commands intact.
+//
+// First, both threads go flat out through a small queue, so it's constantly full, empty and wrapping around. Then we
+// run it like the game does: a turn every kTurnIntervalMs, drained once a frame, with the odd long frame (a hitch)
+// where the update thread falls behind. The producer holds off when the queue is full, the way the simulation thread
+// does, and we report how deep the queue got and how long turns waited to be applied.
+namespace {
+
+constexpr int kHammerBundles = 2000000;
+constexpr std::size_t kHammerCapacity = 8;
+
+constexpr int kGameTurns = 1000;
+constexpr std::size_t kGameCapacity = 32;
+constexpr float kTurnIntervalMs = 1.0f;
+constexpr float kFrameIntervalMs = 4.0f;
+constexpr float kHitchMs = 50.0f;
+constexpr int kHitchInterval = 100;
+
+struct BenchBundle {
+  uint32_t turn = 0;
+  std::vector<uint32_t> commands;
+  fw::Clock::time_point closed_time;
+};
+
+BenchBundle make_bundle(uint32_t turn) {
+  BenchBundle bundle;
+  bundle.turn = turn;
+  for (uint32_t i = 0; i < turn % 4; i++) {
+    bundle.commands.push_back(turn * 31 + i);
+  }
+  bundle.closed_time = fw::Clock::now();
+  return bundle;
+}
+
+bool check_bundle(BenchBundle const &bundle, uint32_t expected_turn) {
+  if (bundle.turn != expected_turn || bundle.commands.size() != expected_turn % 4) {
+    return false;
+  }
+  for (uint32_t i = 0; i < bundle.commands.size(); i++) {
+    if (bundle.commands[i] != expected_turn * 31 + i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct ConsumerResult {
+  uint32_t num_received = 0;
+  uint32_t first_bad_turn = 0;
+  bool ok = true;
+  int64_t max_latency_us = 0;
+  int64_t total_latency_us = 0;
+};
+
+// Pops everything that's in the queue and checks it, returns false if something was out of order.
+bool drain(fw::SpscQueue<BenchBundle> &queue, ConsumerResult &result) {
+  BenchBundle bundle;
+  while (queue.try_pop(bundle)) {
+    const uint32_t expected_turn = result.num_received + 1;
+    if (!check_bundle(bundle, expected_turn)) {
+      result.ok = false;
+      result.first_bad_turn = expected_turn;
+      return false;
+    }
+    const int64_t latency_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(fw::Clock::now() - bundle.closed_time).count();
+    result.max_latency_us = std::max(result.max_latency_us, latency_us);
+    result.total_latency_us += latency_us;
+    result.num_received++;
+  }
+  return true;
+}
+
+fw::Status check_result(ConsumerResult const &result, int num_sent) {
+  if (!result.ok) {
+    return fw::ErrorStatus(absl::StrCat("turn ", result.first_bad_turn, " was missing, out of order or corrupt"));
+  }
+  if (result.num_received != static_cast<uint32_t>(num_sent)) {
+    return fw::ErrorStatus(absl::StrCat("sent ", num_sent, " turns, only received ", result.num_received));
+  }
+  return fw::OkStatus();
+}
+
+fw::Status hammer() {
+  fw::SpscQueue<BenchBundle> queue(kHammerCapacity);
+  std::atomic<bool> producer_done(false);
+  ConsumerResult result;
+  int64_t num_full = 0;
+
+  fw::Timer tmr;
+  tmr.start();
+  std::thread consumer([&]() {
+    while (true) {
+      // Read producer_done before draining, so that if it's set we know we've drained everything after it finished.
+      const bool done = producer_done.load(std::memory_order_acquire);
+      if (!drain(queue, result) || done) {
+        return;
+      }
+      // Let the producer in if we're sharing a core with it.
+      std::this_thread::yield();
+    }
+  });
+
+  for (uint32_t turn = 1; turn <= kHammerBundles; turn++) {
+    BenchBundle bundle = make_bundle(turn);
+    while (!queue.try_push(std::move(bundle))) {
+      num_full++;
+      std::this_thread::yield();
+    }
+  }
+  producer_done.store(true, std::memory_order_release);
+  consumer.join();
+  tmr.stop();
+
+  RETURN_IF_ERROR(check_result(result, kHammerBundles));
+  bench::report("turn-handoff", "hammer.bundles_per_sec", kHammerBundles / tmr.get_total_time(), "bundles/s");
+  bench::report("turn-handoff", "hammer.full_retries", static_cast<double>(num_full), "retries");
+  return fw::OkStatus();
+}
+
+fw::Status game_like() {
+  fw::SpscQueue<BenchBundle> queue(kGameCapacity);
+  std::atomic<bool> producer_done(false);
+  ConsumerResult result;
+  std::size_t max_depth = 0;
+  int64_t num_stalls = 0;
+
+  std::thread consumer([&]() {
+    int frame = 0;
+    while (true) {
+      const bool done = producer_done.load(std::memory_order_acquire);
+      if (!drain(queue, result) || done) {
+        return;
+      }
+      frame++;
+      const float frame_ms = (frame % kHitchInterval == 0) ? kHitchMs : kFrameIntervalMs;
+      std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(frame_ms * 1000.0f)));
+    }
+  });
+
+  const auto turn_interval = std::chrono::microseconds(static_cast<int64_t>(kTurnIntervalMs * 1000.0f));
+  fw::Clock::time_point next_turn = fw::Clock::now();
+  for (uint32_t turn = 1; turn <= kGameTurns; turn++) {
+    // Like the simulation thread, we don't start a turn while the update thread hasn't got room for it.
+    while (queue.is_full()) {
+      num_stalls++;
+      std::this_thread::sleep_for(turn_interval);
+    }
+    queue.try_push(make_bundle(turn));
+    max_depth = std::max(max_depth, queue.size());
+
+    next_turn += turn_interval;
+    std::this_thread::sleep_until(next_turn);
+  }
+  producer_done.store(true, std::memory_order_release);
+  consumer.join();
+
+  RETURN_IF_ERROR(check_result(result, kGameTurns));
+  bench::report("turn-handoff", "game.max_depth", static_cast<double>(max_depth), "turns");
+  bench::report("turn-handoff", "game.mean_latency_ms", result.total_latency_us / (kGameTurns * 1000.0), "ms");
+  bench::report("turn-handoff", "game.max_latency_ms", result.max_latency_us / 1000.0, "ms");
+  bench::report("turn-handoff", "game.backpressure_stalls", static_cast<double>(num_stalls), "stalls");
+  return fw::OkStatus();
+}
+
+fw::Status turn_handoff_bench() {
+  RETURN_IF_ERROR(hammer());
+  RETURN_IF_ERROR(game_like());
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("turn-handoff", turn_handoff_bench);
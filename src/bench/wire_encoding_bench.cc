@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/math.h>
+#include <framework/packet_buffer.h>
+#include <framework/settings.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <game/simulation/commands.h>
+#include <game/simulation/orders.h>
+#include <game/simulation/packets.h>
+#include <game/simulation/replay.h>
+#include <game/simulation/simulation_thread.h>
+
+#include <bench/bench.h>
+
+// Compares the size of the fixed and compact wire encodings of game::CommandPacket, and how long they take to write and
+// read, over a recorded stream of commands. The stream is synthetic but shaped like a real game: eight players, one
+// packet per player per 200ms turn (mostly empty), and bursts of group move and attack orders, builds and new
+// entities. There's no world loaded, so positions are quantized for the default map size (see
+// get_command_position_exponent()), which is what kMapSize is.
+//
+// Given --wire-encoding-replay, we do the same for the commands of a replay (see game::ReplayWriter) as well: one
+// packet per player per turn, with the positions quantized however they were when it was recorded.
+namespace {
+
+constexpr int kNumPlayers = 8;
+constexpr int kNumTurns = 3000;
+constexpr int kMapSize = 128;
+
+// ENet fragments packets bigger than this, with its default MTU.
+constexpr size_t kMaxUnfragmentedSize = 1372;
+
+// Packet::serialize and deserialize are only for Peer and SharedPacket, this lets us call them as well.
+class BenchCommandPacket : public game::CommandPacket {
+public:
+  using game::CommandPacket::serialize;
+  using game::CommandPacket::deserialize;
+};
+
+typedef std::vector<std::shared_ptr<game::Command>> BenchTurn;
+
+// Commands look up their player as they're created, so we need some players for them to find. This is the same as
+// playing back a replay with kNumPlayers players.
+void create_players() {
+  game::ReplayHeader header;
+  header.seed = 1357;
+  header.local_player_no = 1;
+  for (int i = 0; i < kNumPlayers; i++) {
+    header.players.push_back(game::ReplayPlayerInfo { static_cast<uint8_t>(i + 1), absl::StrCat("player ", i + 1) });
+  }
+  game::SimulationThread::get_instance()->start_playback(header);
+}
+
+std::shared_ptr<game::OrderCommand> create_order_command(
+    int player_no, ent::entity_id entity_id, std::shared_ptr<game::Order> const &order) {
+  auto cmd = game::create_command<game::OrderCommand>(static_cast<uint8_t>(player_no));
+  cmd->Entity = entity_id;
+  cmd->order = order;
+  return cmd;
+}
+
+// Each player owns a range of entity ids (the player number in the top byte, like generate_entity_id()), and a
+// selection of units that it gives orders to. Like SimulationThread::post_command, every command is quantized before
+// it's sent.
+std::vector<BenchTurn> record_stream() {
+  std::mt19937 rng(1357);
+  std::uniform_real_distribution<float> unit_dist(0.0f, 1.0f);
+  std::uniform_real_distribution<float> pos_dist(0.0f, static_cast<float>(kMapSize));
+  std::vector<uint32_t> next_entity(kNumPlayers + 1, 1);
+  const int exponent = game::get_command_position_exponent();
+
+  std::vector<BenchTurn> stream(kNumTurns);
+  for (BenchTurn &turn : stream) {
+    for (int player_no = 1; player_no <= kNumPlayers; player_no++) {
+      const uint32_t player_base = static_cast<uint32_t>(player_no) << 24;
+      const float action = unit_dist(rng);
+      if (action < 0.25f) {
+        // A group move: a selection of (mostly nearby) ids all given the same goal.
+        auto order = game::create_order<game::MoveOrder>();
+        order->goal = fw::Vector(pos_dist(rng), 12.5f, pos_dist(rng));
+        order->group_size = static_cast<uint16_t>(1 + static_cast<int>(unit_dist(rng) * 30));
+        uint32_t entity_id = player_base + static_cast<uint32_t>(unit_dist(rng) * next_entity[player_no]);
+        for (int i = 0; i < order->group_size; i++) {
+          turn.push_back(create_order_command(player_no, entity_id, order));
+          entity_id += 1 + static_cast<uint32_t>(unit_dist(rng) * 4);
+        }
+      } else if (action < 0.30f) {
+        // A group attack on somebody else's unit. Like CursorHandler, each unit gets its own AttackOrder.
+        const ent::entity_id target = (static_cast<uint32_t>(1 + player_no % kNumPlayers) << 24) + 1
+            + static_cast<uint32_t>(unit_dist(rng) * 200);
+        const int group_size = 1 + static_cast<int>(unit_dist(rng) * 10);
+        uint32_t entity_id = player_base + static_cast<uint32_t>(unit_dist(rng) * next_entity[player_no]);
+        for (int i = 0; i < group_size; i++) {
+          auto order = game::create_order<game::AttackOrder>();
+          order->target = target;
+          turn.push_back(create_order_command(player_no, entity_id++, order));
+        }
+      } else if (action < 0.33f) {
+        // A factory starts building something.
+        auto order = game::create_order<game::BuildOrder>();
+        order->template_name = "tank";
+        turn.push_back(create_order_command(player_no, player_base + 1, order));
+      } else if (action < 0.36f) {
+        // A new unit comes out of the factory.
+        auto cmd = game::create_command<game::CreateEntityCommand>(static_cast<uint8_t>(player_no));
+        next_entity[player_no]++;
+        cmd->template_name = "tank";
+        cmd->initial_position = fw::Vector(pos_dist(rng), 8.25f, pos_dist(rng));
+        cmd->initial_goal = cmd->initial_position + fw::Vector(0.0f, 0.0f, 4.0f);
+        turn.push_back(cmd);
+      }
+    }
+  }
+
+  for (BenchTurn &turn : stream) {
+    for (auto &cmd : turn) {
+      cmd->quantize(exponent);
+    }
+  }
+  return stream;
+}
+
+// Checks that the received packet has the same commands as the one we sent, by writing it out again and comparing the
+// bytes. Every field of every command (and which commands share an order) is in there.
+fw::Status check_packet(
+    BenchCommandPacket &received, size_t num_commands, std::vector<uint8_t> const &sent, uint8_t wire_version) {
+  if (received.get_commands().size() != num_commands) {
+    return fw::ErrorStatus(
+        absl::StrCat("expected ", num_commands, " commands, got ", received.get_commands().size()));
+  }
+
+  fw::net::PacketBuffer buffer(game::CommandPacket::identifier, wire_version);
+  received.serialize(buffer);
+  if (buffer.get_size() != sent.size() || !std::equal(sent.begin(), sent.end(), buffer.get_buffer())) {
+    return fw::ErrorStatus("commands didn't survive the round trip");
+  }
+  return fw::OkStatus();
+}
+
+struct EncodingResult {
+  size_t total_bytes = 0;
+  size_t max_bytes = 0;
+  int num_fragmented = 0;
+  float encode_ms = 0.0f;
+  float decode_ms = 0.0f;
+};
+
+fw::StatusOr<EncodingResult> measure(std::vector<BenchTurn> const &stream, uint8_t wire_version) {
+  EncodingResult result;
+  std::vector<BenchCommandPacket> pkts(stream.size());
+  for (size_t i = 0; i < stream.size(); i++) {
+    BenchTurn commands = stream[i];
+    pkts[i].set_commands(commands);
+  }
+  std::vector<std::unique_ptr<fw::net::PacketStorage>> packets;
+  packets.reserve(stream.size());
+
+  fw::Timer encode_tmr;
+  encode_tmr.start();
+  for (BenchCommandPacket &pkt : pkts) {
+    fw::net::PacketBuffer buffer(game::CommandPacket::identifier, wire_version);
+    pkt.serialize(buffer);
+    packets.push_back(buffer.take_storage());
+  }
+  encode_tmr.stop();
+
+  std::vector<BenchCommandPacket> received(stream.size());
+  fw::Timer decode_tmr;
+  decode_tmr.start();
+  for (size_t i = 0; i < packets.size(); i++) {
+    fw::net::PacketBuffer buffer(packets[i]->bytes.data(), packets[i]->bytes.size());
+    RETURN_IF_ERROR(received[i].deserialize(buffer));
+    if (buffer.get_remaining() != 0) {
+      return fw::ErrorStatus(absl::StrCat("turn ", i, " has ", buffer.get_remaining(), " bytes left over"));
+    }
+  }
+  decode_tmr.stop();
+
+  for (size_t i = 0; i < stream.size(); i++) {
+    fw::Status status = check_packet(received[i], stream[i].size(), packets[i]->bytes, wire_version);
+    if (!status.ok()) {
+      return fw::ErrorStatus(absl::StrCat("turn ", i, ": ", status.message()));
+    }
+
+    const size_t size = packets[i]->bytes.size();
+    result.total_bytes += size;
+    result.max_bytes = std::max(result.max_bytes, size);
+    if (size > kMaxUnfragmentedSize) {
+      result.num_fragmented++;
+    }
+    packets[i]->arena->release(std::move(packets[i]));
+  }
+
+  result.encode_ms = encode_tmr.get_total_time() * 1000.0f;
+  result.decode_ms = decode_tmr.get_total_time() * 1000.0f;
+  return result;
+}
+
+// Turns are recorded with everybody's commands together, but each player sends its own packet, so this splits each
+// turn into one packet per player (which is empty if they didn't do anything).
+std::vector<BenchTurn> split_by_player(std::vector<BenchTurn> const &turns, std::vector<uint8_t> const &player_nos) {
+  std::vector<BenchTurn> stream;
+  for (BenchTurn const &turn : turns) {
+    for (uint8_t player_no : player_nos) {
+      BenchTurn &packet = stream.emplace_back();
+      for (auto const &cmd : turn) {
+        if (cmd->get_player() != nullptr && cmd->get_player()->get_player_no() == player_no) {
+          packet.push_back(cmd);
+        }
+      }
+    }
+  }
+  return stream;
+}
+
+// A replay has each command on its own, so every command we read back has its own order. But when CursorHandler gives a
+// group a move order, they all share the same MoveOrder (which is what lets the compact encoding write it once), so we
+// share them again: a run of the same player's commands with the same move order is a group move.
+void share_move_orders(BenchTurn &turn) {
+  for (size_t i = 1; i < turn.size(); i++) {
+    if (turn[i]->get_identifier() != game::OrderCommand::identifier
+        || turn[i - 1]->get_identifier() != game::OrderCommand::identifier
+        || turn[i]->get_player() != turn[i - 1]->get_player()) {
+      continue;
+    }
+    auto &cmd = static_cast<game::OrderCommand &>(*turn[i]);
+    auto const &prev_cmd = static_cast<game::OrderCommand const &>(*turn[i - 1]);
+    auto order = std::dynamic_pointer_cast<game::MoveOrder>(cmd.order);
+    auto prev_order = std::dynamic_pointer_cast<game::MoveOrder>(prev_cmd.order);
+    if (order && prev_order && order->goal[0] == prev_order->goal[0] && order->goal[1] == prev_order->goal[1]
+        && order->goal[2] == prev_order->goal[2] && order->group_size == prev_order->group_size) {
+      cmd.order = prev_cmd.order;
+    }
+  }
+}
+
+// Reads every turn of the replay at the given path. This replaces the players with the replay's.
+fw::StatusOr<std::vector<BenchTurn>> read_replay(std::filesystem::path const &path) {
+  ASSIGN_OR_RETURN(std::unique_ptr<game::ReplayReader> reader, game::ReplayReader::open(path));
+  game::SimulationThread::get_instance()->start_playback(reader->get_header());
+
+  std::vector<BenchTurn> turns;
+  for (;;) {
+    game::ReplayTurn turn;
+    ASSIGN_OR_RETURN(bool has_turn, reader->next_turn(turn));
+    if (!has_turn) {
+      break;
+    }
+    share_move_orders(turn.commands);
+    turns.push_back(turn.commands);
+  }
+
+  std::vector<uint8_t> player_nos;
+  for (game::ReplayPlayerInfo const &info : reader->get_header().players) {
+    player_nos.push_back(info.player_no);
+  }
+  return split_by_player(turns, player_nos);
+}
+
+// Measures both encodings of the given stream, and reports them with the given prefix on each metric.
+fw::Status compare_encodings(std::string const &prefix, std::vector<BenchTurn> const &stream) {
+  size_t num_commands = 0;
+  for (BenchTurn const &packet : stream) {
+    num_commands += packet.size();
+  }
+
+  ASSIGN_OR_RETURN(EncodingResult fixed, measure(stream, fw::net::kWireVersionFixed));
+  ASSIGN_OR_RETURN(EncodingResult compact, measure(stream, fw::net::kWireVersionCompact));
+
+  bench::report("wire-encoding", prefix + "num_packets", static_cast<double>(stream.size()), "packets");
+  bench::report("wire-encoding", prefix + "num_commands", static_cast<double>(num_commands), "commands");
+  for (auto const &[name, result] : { std::make_pair("fixed", fixed), std::make_pair("compact", compact) }) {
+    bench::report("wire-encoding", absl::StrCat(prefix, name, ".total_bytes"),
+        static_cast<double>(result.total_bytes), "bytes");
+    bench::report("wire-encoding", absl::StrCat(prefix, name, ".max_packet_bytes"),
+        static_cast<double>(result.max_bytes), "bytes");
+    bench::report("wire-encoding", absl::StrCat(prefix, name, ".fragmented_packets"), result.num_fragmented,
+        "packets");
+    bench::report("wire-encoding", absl::StrCat(prefix, name, ".bytes_per_command"),
+        static_cast<double>(result.total_bytes) / num_commands, "bytes");
+    bench::report("wire-encoding", absl::StrCat(prefix, name, ".encode_ms"), result.encode_ms, "ms");
+    bench::report("wire-encoding", absl::StrCat(prefix, name, ".decode_ms"), result.decode_ms, "ms");
+  }
+  bench::report("wire-encoding", prefix + "compact_vs_fixed.size_ratio",
+      static_cast<double>(compact.total_bytes) / fixed.total_bytes, "x");
+  return fw::OkStatus();
+}
+
+fw::Status wire_encoding_bench() {
+  create_players();
+  std::vector<uint8_t> player_nos;
+  for (int player_no = 1; player_no <= kNumPlayers; player_no++) {
+    player_nos.push_back(static_cast<uint8_t>(player_no));
+  }
+  RETURN_IF_ERROR(compare_encodings("", split_by_player(record_stream(), player_nos)));
+
+  const std::string replay_path = fw::Settings::get<std::string>("wire-encoding-replay");
+  if (!replay_path.empty()) {
+    ASSIGN_OR_RETURN(std::vector<BenchTurn> replay_stream, read_replay(replay_path));
+    RETURN_IF_ERROR(compare_encodings("replay.", replay_stream));
+  }
+  return fw::OkStatus();
+}
+
+}
+
+REGISTER_BENCH("wire-encoding", wire_encoding_bench);
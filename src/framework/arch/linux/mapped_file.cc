@@ -0,0 +1,52 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <framework/mapped_file.h>
+
+namespace fw {
+
+MappedFile::MappedFile() : data_(nullptr), size_(0) {
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+}
+
+fw::StatusOr<std::unique_ptr<MappedFile>> MappedFile::open(std::filesystem::path const &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return fw::ErrorStatus("error opening ") << path.string() << ": " << strerror(errno);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    return fw::ErrorStatus("error opening ") << path.string() << ": " << strerror(error);
+  }
+
+  std::unique_ptr<MappedFile> file(new MappedFile());
+  if (st.st_size > 0) {
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      int error = errno;
+      close(fd);
+      return fw::ErrorStatus("error mapping ") << path.string() << ": " << strerror(error);
+    }
+    file->data_ = static_cast<uint8_t const *>(data);
+    file->size_ = static_cast<size_t>(st.st_size);
+  }
+
+  // The mapping stays valid after we close the file.
+  close(fd);
+  return file;
+}
+
+}
@@ -0,0 +1,55 @@
+#include <Windows.h>
+
+#include <framework/mapped_file.h>
+
+namespace fw {
+
+MappedFile::MappedFile() : data_(nullptr), size_(0) {
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    ::UnmapViewOfFile(data_);
+  }
+}
+
+fw::StatusOr<std::unique_ptr<MappedFile>> MappedFile::open(std::filesystem::path const &path) {
+  HANDLE file = ::CreateFileW(
+      path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return fw::ErrorStatus("error opening ") << path.string() << ": " << ::GetLastError();
+  }
+
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(file, &size)) {
+    DWORD error = ::GetLastError();
+    ::CloseHandle(file);
+    return fw::ErrorStatus("error opening ") << path.string() << ": " << error;
+  }
+
+  std::unique_ptr<MappedFile> file_view(new MappedFile());
+  if (size.QuadPart > 0) {
+    HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+      DWORD error = ::GetLastError();
+      ::CloseHandle(file);
+      return fw::ErrorStatus("error mapping ") << path.string() << ": " << error;
+    }
+
+    void *data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    DWORD error = ::GetLastError();
+    // The view keeps the mapping (and the file) open until it's unmapped.
+    ::CloseHandle(mapping);
+    if (data == nullptr) {
+      ::CloseHandle(file);
+      return fw::ErrorStatus("error mapping ") << path.string() << ": " << error;
+    }
+    file_view->data_ = static_cast<uint8_t const *>(data);
+    file_view->size_ = static_cast<size_t>(size.QuadPart);
+  }
+
+  ::CloseHandle(file);
+  return file_view;
+}
+
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fw {
+
+// FlatIdMap is an open-addressing hash map from an integer identifier to a value. All of the entries live in a single
+// array (with linear probing, and backward-shift deletion so there are no tombstones), so lookups touch one or two
+// cache lines rather than chasing the node pointers of std::unordered_map or std::map.
+//
+// Key must be an unsigned integer type. Value should be cheap to copy (e.g. an index or a SlotMapKey).
+//
+// This class is not thread-safe.
+template<typename Key, typename Value>
+class FlatIdMap {
+private:
+  struct Entry {
+    Key key;
+    Value value;
+    bool occupied;
+  };
+
+  std::vector<Entry> entries_;
+  size_t size_ = 0;
+  size_t mask_ = 0;
+
+  // A cheap integer hash (the finalizer from MurmurHash3) so that sequential ids spread out over the table.
+  static inline size_t hash(Key key) {
+    uint64_t h = static_cast<uint64_t>(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<Entry> old_entries;
+    old_entries.swap(entries_);
+    entries_.resize(capacity);
+    mask_ = capacity - 1;
+    size_ = 0;
+    for (Entry const &entry : old_entries) {
+      if (entry.occupied) {
+        insert_or_assign(entry.key, entry.value);
+      }
+    }
+  }
+
+public:
+  FlatIdMap() {
+    rehash(16);
+  }
+
+  // Makes sure we can hold at least the given number of entries without growing.
+  void reserve(size_t count) {
+    size_t capacity = entries_.size();
+    while (capacity * 3 < count * 4) {
+      capacity *= 2;
+    }
+    if (capacity != entries_.size()) {
+      rehash(capacity);
+    }
+  }
+
+  void insert_or_assign(Key key, Value const &value) {
+    // Keep the load factor under 3/4.
+    if ((size_ + 1) * 4 > entries_.size() * 3) {
+      rehash(entries_.size() * 2);
+    }
+
+    for (size_t i = hash(key) & mask_;; i = (i + 1) & mask_) {
+      Entry &entry = entries_[i];
+      if (!entry.occupied) {
+        entry.key = key;
+        entry.value = value;
+        entry.occupied = true;
+        size_++;
+        return;
+      }
+      if (entry.key == key) {
+        entry.value = value;
+        return;
+      }
+    }
+  }
+
+  // Gets a pointer to the value for the given key, or nullptr if it's not in the map.
+  inline Value *find(Key key) {
+    for (size_t i = hash(key) & mask_;; i = (i + 1) & mask_) {
+      Entry &entry = entries_[i];
+      if (!entry.occupied) {
+        return nullptr;
+      }
+      if (entry.key == key) {
+        return &entry.value;
+      }
+    }
+  }
+
+  inline Value const *find(Key key) const {
+    return const_cast<FlatIdMap *>(this)->find(key);
+  }
+
+  // Removes the given key from the map, returns false if it wasn't there.
+  bool erase(Key key) {
+    size_t i = hash(key) & mask_;
+    for (;; i = (i + 1) & mask_) {
+      if (!entries_[i].occupied) {
+        return false;
+      }
+      if (entries_[i].key == key) {
+        break;
+      }
+    }
+
+    // Shift any following entries in the same probe run back into the hole, so that lookups (which stop at the first
+    // empty entry) can still find them.
+    for (size_t j = (i + 1) & mask_; entries_[j].occupied; j = (j + 1) & mask_) {
+      const size_t home = hash(entries_[j].key) & mask_;
+      // Only move entry j if its home is not in the (cyclic) range (i, j].
+      const bool home_between = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+      if (!home_between) {
+        entries_[i] = entries_[j];
+        i = j;
+      }
+    }
+    entries_[i].occupied = false;
+    size_--;
+    return true;
+  }
+
+  void clear() {
+    for (Entry &entry : entries_) {
+      entry.occupied = false;
+    }
+    size_ = 0;
+  }
+
+  inline size_t size() const {
+    return size_;
+  }
+};
+
+}
@@ -0,0 +1,129 @@
+#include <framework/flow_field.h>
+
+#include <cmath>
+#include <limits>
+
+#include <framework/indexed_heap.h>
+#include <framework/misc.h>
+#include <framework/passability_grid.h>
+
+namespace fw {
+
+namespace {
+
+struct Neighbour {
+  int dx;
+  int dz;
+  float cost;
+};
+
+// The eight neighbours of a cell, and the cost of stepping to each one (the same costs that PathFind uses).
+const Neighbour kNeighbours[] = {
+    { 0, -1, 1.0f }, { 1, 0, 1.0f }, { 0, 1, 1.0f }, { -1, 0, 1.0f },
+    { 1, -1, 1.41421356f }, { 1, 1, 1.41421356f }, { -1, 1, 1.41421356f }, { -1, -1, 1.41421356f },
+};
+
+const float kUnreachable = std::numeric_limits<float>::infinity();
+
+}
+
+FlowField::FlowField(PassabilityGrid const &passability, int goal_x, int goal_z) :
+    width_(passability.get_width()), length_(passability.get_length()),
+    goal_x_(fw::constrain(goal_x, passability.get_width())), goal_z_(fw::constrain(goal_z, passability.get_length())),
+    nodes_expanded_(0), integration_(width_ * length_, kUnreachable), directions_(width_ * length_, -1) {
+  build_integration(passability);
+  build_directions();
+}
+
+// A plain Dijkstra search outwards from the goal, over every cell that can reach it.
+void FlowField::build_integration(PassabilityGrid const &passability) {
+  std::vector<bool> closed(width_ * length_, false);
+  IndexedHeap<float> open;
+  open.reset(width_ * length_);
+
+  const int goal = (goal_z_ * width_) + goal_x_;
+  integration_[goal] = 0.0f;
+  open.push(goal, 0.0f);
+
+  while (!open.empty()) {
+    const int curr = open.pop();
+    const int curr_x = curr % width_;
+    const int curr_z = curr / width_;
+    closed[curr] = true;
+    nodes_expanded_++;
+
+    for (Neighbour const &neighbour : kNeighbours) {
+      const int x = fw::constrain(curr_x + neighbour.dx, width_);
+      const int z = fw::constrain(curr_z + neighbour.dz, length_);
+      const int n = (z * width_) + x;
+      if (closed[n] || !passability.is_passable(x, z)) {
+        continue;
+      }
+
+      const float new_cost = integration_[curr] + neighbour.cost;
+      if (integration_[n] == kUnreachable) {
+        integration_[n] = new_cost;
+        open.push(n, new_cost);
+      } else if (new_cost < integration_[n]) {
+        integration_[n] = new_cost;
+        open.decrease(n, new_cost);
+      }
+    }
+  }
+}
+
+// Each cell points at whichever of its neighbours is closest to the goal. This includes impassable cells next to the
+// reachable area, so that a unit that has been pushed into one can find its way back out.
+void FlowField::build_directions() {
+  for (int z = 0; z < length_; z++) {
+    for (int x = 0; x < width_; x++) {
+      const int index = (z * width_) + x;
+      float best_cost = integration_[index];
+      int8_t best_direction = -1;
+      for (int8_t i = 0; i < 8; i++) {
+        const int nx = fw::constrain(x + kNeighbours[i].dx, width_);
+        const int nz = fw::constrain(z + kNeighbours[i].dz, length_);
+        const float cost = integration_[(nz * width_) + nx];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_direction = i;
+        }
+      }
+      directions_[index] = best_direction;
+    }
+  }
+}
+
+bool FlowField::is_reachable(int x, int z) const {
+  return get_cost(x, z) != kUnreachable;
+}
+
+float FlowField::get_cost(int x, int z) const {
+  x = fw::constrain(x, width_);
+  z = fw::constrain(z, length_);
+  return integration_[(z * width_) + x];
+}
+
+bool FlowField::get_next_cell(int x, int z, int &next_x, int &next_z) const {
+  const int8_t direction = directions_[(fw::constrain(z, length_) * width_) + fw::constrain(x, width_)];
+  if (direction < 0) {
+    return false;
+  }
+
+  next_x = x + kNeighbours[direction].dx;
+  next_z = z + kNeighbours[direction].dz;
+  return true;
+}
+
+fw::Vector FlowField::get_direction(fw::Vector const &pos) const {
+  const int x = static_cast<int>(floor(pos[0]));
+  const int z = static_cast<int>(floor(pos[2]));
+  int next_x, next_z;
+  if (!get_next_cell(x, z, next_x, next_z)) {
+    return fw::Vector(0.0f, 0.0f, 0.0f);
+  }
+
+  return fw::Vector(static_cast<float>(next_x - x), 0.0f, static_cast<float>(next_z - z)).normalized();
+}
+
+}
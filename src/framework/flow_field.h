@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <framework/math.h>
+
+namespace fw {
+class PassabilityGrid;
+
+// A FlowField holds, for every cell of the map, the cost of the shortest path from that cell to a single goal (the
+// "integration field") and the direction to step in to follow that path (the "direction field"). It is expensive to
+// build (it's a Dijkstra search over the whole map) but once built, any number of units heading to the same goal can
+// look up which way to go in O(1), so it's much cheaper than a path search per unit when a large group is given the
+// same move order.
+//
+// Like PathFind, the field wraps around the edges of the map. Once built, a FlowField is immutable and so can be
+// shared between threads.
+class FlowField {
+private:
+  int width_;
+  int length_;
+  int goal_x_;
+  int goal_z_;
+  int nodes_expanded_;
+
+  // The cost from each cell to the goal, or infinity if the goal is not reachable from that cell.
+  std::vector<float> integration_;
+
+  // The index into the table of neighbour offsets that each cell should step to, or -1 at the goal and in cells that
+  // cannot reach the goal.
+  std::vector<int8_t> directions_;
+
+  void build_integration(PassabilityGrid const &passability);
+  void build_directions();
+
+public:
+  // Builds the field for the given goal cell. If the goal itself is impassable, we still build a field towards it, so
+  // units will get as close as they can.
+  FlowField(PassabilityGrid const &passability, int goal_x, int goal_z);
+
+  inline int get_width() const {
+    return width_;
+  }
+
+  inline int get_length() const {
+    return length_;
+  }
+
+  inline int get_goal_x() const {
+    return goal_x_;
+  }
+
+  inline int get_goal_z() const {
+    return goal_z_;
+  }
+
+  // The number of cells that the Dijkstra search expanded when building this field.
+  inline int get_nodes_expanded() const {
+    return nodes_expanded_;
+  }
+
+  // Returns true if the goal can be reached from the given cell. The coordinates are wrapped to the map.
+  bool is_reachable(int x, int z) const;
+
+  // Gets the cost of the path from the given cell to the goal (infinity if it's not reachable).
+  float get_cost(int x, int z) const;
+
+  // Gets the cell to step to from the given cell to follow the shortest path to the goal. Returns false (and leaves
+  // next_x and next_z alone) if we're already at the goal, or the goal cannot be reached. The returned coordinates are
+  // not wrapped, so they're always adjacent to x and z.
+  bool get_next_cell(int x, int z, int &next_x, int &next_z) const;
+
+  // Gets the (normalized, in the XZ plane) direction to travel in from the given world position. Returns a zero vector
+  // at the goal or if the goal cannot be reached.
+  fw::Vector get_direction(fw::Vector const &pos) const;
+};
+
+}
@@ -210,6 +210,11 @@ void Framework::run() {
 void Framework::exit() {
   LOG(INFO) << "Exiting.";
   running_ = false;
+
+  // Without graphics, the main thread is just waiting for events until we exit.
+  if (!app_->wants_graphics()) {
+    wake_events();
+  }
 }
 
 void Framework::set_camera(Camera *cam) {
@@ -227,6 +232,7 @@ void Framework::update_proc_impl() {
   auto status = app_->initialize(this);
   if (!status.ok()) {
     LOG(ERR) << "app did not iniatilize: " << status;
+    exit();
     return;
   }
 
@@ -263,7 +269,9 @@ void Framework::update(float dt) {
   if (!paused_) {
     app_->update(dt);
   }
-  particle_mgr_->update(dt);
+  if (particle_mgr_ != nullptr) {
+    particle_mgr_->update(dt);
+  }
   if (debug_view_ != nullptr) {
     debug_view_->update(dt);
   }
@@ -85,6 +85,9 @@ private:
   bool wait_events();
   bool poll_events();
 
+  // Wakes up wait_events(), so that it returns once we've been asked to exit.
+  void wake_events();
+
   bool active_;
 
   Input * input_;
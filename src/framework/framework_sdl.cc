@@ -41,4 +41,10 @@ bool Framework::wait_events() {
   return true;
 }
 
+void Framework::wake_events() {
+  SDL_Event e;
+  e.type = SDL_QUIT;
+  SDL_PushEvent(&e);
+}
+
 }  // namespace fw
\ No newline at end of file
@@ -399,6 +399,12 @@ void VertexBuffer::set_data(int num_vertices, const void *vertices, int flags /*
   glBufferData(GL_ARRAY_BUFFER, num_vertices_ * vertex_size_, vertices, flags);
 }
 
+void VertexBuffer::set_sub_data(int first_vertex, int num_vertices, const void *vertices) {
+  FW_ENSURE_RENDER_THREAD();
+  glBindBuffer(GL_ARRAY_BUFFER, id_);
+  glBufferSubData(GL_ARRAY_BUFFER, first_vertex * vertex_size_, num_vertices * vertex_size_, vertices);
+}
+
 void VertexBuffer::begin() {
   FW_ENSURE_RENDER_THREAD();
   glBindBuffer(GL_ARRAY_BUFFER, id_);
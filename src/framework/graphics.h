@@ -130,6 +130,10 @@ public:
 
   void set_data(int num_vertices, const void *vertices, int flags = -1);
 
+  // Replaces num_vertices vertices, starting at first_vertex, of the data we already have (the buffer doesn't change
+  // size). Much cheaper than set_data when you've only changed a few of them.
+  void set_sub_data(int first_vertex, int num_vertices, const void *vertices);
+
   inline int get_num_vertices() const {
     return num_vertices_;
   }
@@ -0,0 +1,294 @@
+#include <framework/height_brush.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include <framework/misc.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FW_HEIGHT_BRUSH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FW_HEIGHT_BRUSH_SSE2
+#endif
+
+namespace fw {
+namespace {
+
+// The noise is interpolated between random values on a lattice this many vertices apart.
+const int NOISE_CELL_SIZE = 8;
+
+const float ONE_NINTH = 1.0f / 9.0f;
+
+constexpr float smoothstep(float t) {
+  return t * t * (3.0f - 2.0f * t);
+}
+
+constexpr std::array<float, NOISE_CELL_SIZE> make_noise_tx() {
+  std::array<float, NOISE_CELL_SIZE> tx = {};
+  for (int i = 0; i < NOISE_CELL_SIZE; i++) {
+    tx[i] = smoothstep(static_cast<float>(i) / NOISE_CELL_SIZE);
+  }
+  return tx;
+}
+
+// How far across its noise cell each vertex is, smoothed. The same for every cell, so we only work it out once.
+constexpr std::array<float, NOISE_CELL_SIZE> NOISE_TX = make_noise_tx();
+
+#if defined(FW_HEIGHT_BRUSH_AVX2)
+namespace simd {
+typedef __m256 Float;
+const int WIDTH = 8;
+const char *NAME = "avx2";
+
+inline Float load(float const *p) { return _mm256_loadu_ps(p); }
+inline void store(float *p, Float v) { _mm256_storeu_ps(p, v); }
+inline Float set(float f) { return _mm256_set1_ps(f); }
+inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+}
+#elif defined(FW_HEIGHT_BRUSH_SSE2)
+namespace simd {
+typedef __m128 Float;
+const int WIDTH = 4;
+const char *NAME = "sse2";
+
+inline Float load(float const *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, Float v) { _mm_storeu_ps(p, v); }
+inline Float set(float f) { return _mm_set1_ps(f); }
+inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+}
+#endif
+
+// Each of the row kernels does as much of the row as it can with SIMD (if use_simd is set), and the rest one at a time,
+// with the same arithmetic in the same order.
+
+void raise_row(float *heights, float const *falloff, float delta, float strength, int count, bool use_simd) {
+  int i = 0;
+#if defined(FW_HEIGHT_BRUSH_AVX2) || defined(FW_HEIGHT_BRUSH_SSE2)
+  if (use_simd) {
+    const simd::Float delta_v = simd::set(delta);
+    const simd::Float strength_v = simd::set(strength);
+    for (; i + simd::WIDTH <= count; i += simd::WIDTH) {
+      const simd::Float change = simd::mul(simd::mul(delta_v, simd::load(falloff + i)), strength_v);
+      simd::store(heights + i, simd::add(simd::load(heights + i), change));
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    heights[i] = heights[i] + (delta * falloff[i]) * strength;
+  }
+}
+
+void level_row(
+    float *heights, float const *falloff, float target, float rate, float strength, int count, bool use_simd) {
+  int i = 0;
+#if defined(FW_HEIGHT_BRUSH_AVX2) || defined(FW_HEIGHT_BRUSH_SSE2)
+  if (use_simd) {
+    const simd::Float target_v = simd::set(target);
+    const simd::Float rate_v = simd::set(rate);
+    const simd::Float strength_v = simd::set(strength);
+    for (; i + simd::WIDTH <= count; i += simd::WIDTH) {
+      const simd::Float height = simd::load(heights + i);
+      const simd::Float diff = simd::mul(simd::sub(target_v, height), rate_v);
+      const simd::Float change = simd::mul(simd::mul(diff, simd::load(falloff + i)), strength_v);
+      simd::store(heights + i, simd::add(height, change));
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    const float diff = (target - heights[i]) * rate;
+    heights[i] = heights[i] + (diff * falloff[i]) * strength;
+  }
+}
+
+// above, row and below are the rows of the original heights around the one we're changing, and index 0 of each is the
+// first vertex we change (so index -1 is its neighbour in the border).
+void smooth_row(float *heights, float const *above, float const *row, float const *below, float const *falloff,
+    float rate, float strength, int count, bool use_simd) {
+  int i = 0;
+#if defined(FW_HEIGHT_BRUSH_AVX2) || defined(FW_HEIGHT_BRUSH_SSE2)
+  if (use_simd) {
+    const simd::Float one_ninth_v = simd::set(ONE_NINTH);
+    const simd::Float rate_v = simd::set(rate);
+    const simd::Float strength_v = simd::set(strength);
+    for (; i + simd::WIDTH <= count; i += simd::WIDTH) {
+      const simd::Float height = simd::load(row + i);
+      const simd::Float sum_above =
+          simd::add(simd::add(simd::load(above + i - 1), simd::load(above + i)), simd::load(above + i + 1));
+      const simd::Float sum_row = simd::add(simd::add(simd::load(row + i - 1), height), simd::load(row + i + 1));
+      const simd::Float sum_below =
+          simd::add(simd::add(simd::load(below + i - 1), simd::load(below + i)), simd::load(below + i + 1));
+      const simd::Float average = simd::mul(simd::add(simd::add(sum_above, sum_row), sum_below), one_ninth_v);
+      const simd::Float diff = simd::mul(simd::sub(average, height), rate_v);
+      const simd::Float change = simd::mul(simd::mul(diff, simd::load(falloff + i)), strength_v);
+      simd::store(heights + i, simd::add(height, change));
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    const float height = row[i];
+    const float sum_above = (above[i - 1] + above[i]) + above[i + 1];
+    const float sum_row = (row[i - 1] + height) + row[i + 1];
+    const float sum_below = (below[i - 1] + below[i]) + below[i + 1];
+    const float average = ((sum_above + sum_row) + sum_below) * ONE_NINTH;
+    const float diff = (average - height) * rate;
+    heights[i] = height + (diff * falloff[i]) * strength;
+  }
+}
+
+void noise_row(float *heights, float const *noise, float const *falloff, float delta, float strength, int count,
+    bool use_simd) {
+  int i = 0;
+#if defined(FW_HEIGHT_BRUSH_AVX2) || defined(FW_HEIGHT_BRUSH_SSE2)
+  if (use_simd) {
+    const simd::Float delta_v = simd::set(delta);
+    const simd::Float strength_v = simd::set(strength);
+    for (; i + simd::WIDTH <= count; i += simd::WIDTH) {
+      const simd::Float amount = simd::mul(simd::load(noise + i), delta_v);
+      const simd::Float change = simd::mul(simd::mul(amount, simd::load(falloff + i)), strength_v);
+      simd::store(heights + i, simd::add(simd::load(heights + i), change));
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    heights[i] = heights[i] + ((noise[i] * delta) * falloff[i]) * strength;
+  }
+}
+
+// Interpolates count vertices of one noise cell, which all share the same four corners: tx is NOISE_TX from the first
+// of them. This is fw::lerp(fw::lerp(near_left, near_right, tx), fw::lerp(far_left, far_right, tx), tz).
+void noise_cell(float *noise, float const *tx, float near_left, float near_right, float far_left, float far_right,
+    float tz, int count, bool use_simd) {
+  const float near_diff = near_right - near_left;
+  const float far_diff = far_right - far_left;
+  int i = 0;
+#if defined(FW_HEIGHT_BRUSH_AVX2) || defined(FW_HEIGHT_BRUSH_SSE2)
+  if (use_simd) {
+    const simd::Float near_left_v = simd::set(near_left);
+    const simd::Float near_diff_v = simd::set(near_diff);
+    const simd::Float far_left_v = simd::set(far_left);
+    const simd::Float far_diff_v = simd::set(far_diff);
+    const simd::Float tz_v = simd::set(tz);
+    for (; i + simd::WIDTH <= count; i += simd::WIDTH) {
+      const simd::Float tx_v = simd::load(tx + i);
+      const simd::Float near = simd::add(near_left_v, simd::mul(near_diff_v, tx_v));
+      const simd::Float far = simd::add(far_left_v, simd::mul(far_diff_v, tx_v));
+      simd::store(noise + i, simd::add(near, simd::mul(simd::sub(far, near), tz_v)));
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    const float near = near_left + near_diff * tx[i];
+    const float far = far_left + far_diff * tx[i];
+    noise[i] = near + (far - near) * tz;
+  }
+}
+
+// A random value between -1 and 1 for the given lattice point.
+float lattice_value(int x, int z) {
+  uint32_t h = (static_cast<uint32_t>(x) * 0x8da6b343u) ^ (static_cast<uint32_t>(z) * 0xd8163841u);
+  h ^= h >> 13;
+  h *= 0x5bd1e995u;
+  h ^= h >> 15;
+  return static_cast<float>(h & 0xffffff) * (2.0f / 0xffffff) - 1.0f;
+}
+
+}
+
+HeightBrush::HeightBrush(int radius) : radius_(0), size_(0) {
+  set_radius(radius);
+}
+
+void HeightBrush::set_radius(int radius) {
+  radius = std::max(radius, 1);
+  if (radius == radius_) {
+    return;
+  }
+
+  radius_ = radius;
+  size_ = radius * 2;
+  falloff_.resize(size_ * size_);
+  for (int z = 0; z < size_; z++) {
+    for (int x = 0; x < size_; x++) {
+      // This is exactly how the brushes have always worked it out, so the heights come out the same as they used to.
+      const int dx = x - radius_;
+      const int dz = z - radius_;
+      const float distance = std::sqrt(static_cast<float>(dx * dx + dz * dz)) / radius_;
+      falloff_[(z * size_) + x] = distance < 1.0f ? 1.0f - distance : 0.0f;
+    }
+  }
+}
+
+void HeightBrush::raise(float *heights, float delta, float strength, Kernel kernel) const {
+  const int stride = get_padded_size();
+  for (int z = 0; z < size_; z++) {
+    raise_row(heights + ((z + 1) * stride) + 1, &falloff_[z * size_], delta, strength, size_,
+        kernel == Kernel::kSimd);
+  }
+}
+
+void HeightBrush::level(float *heights, float target, float rate, float strength, Kernel kernel) const {
+  const int stride = get_padded_size();
+  for (int z = 0; z < size_; z++) {
+    level_row(heights + ((z + 1) * stride) + 1, &falloff_[z * size_], target, rate, strength, size_,
+        kernel == Kernel::kSimd);
+  }
+}
+
+void HeightBrush::smooth(float *heights, float rate, float strength, Kernel kernel) {
+  const int stride = get_padded_size();
+  scratch_.assign(heights, heights + (stride * stride));
+  for (int z = 0; z < size_; z++) {
+    float const *row = &scratch_[((z + 1) * stride) + 1];
+    smooth_row(heights + ((z + 1) * stride) + 1, row - stride, row, row + stride, &falloff_[z * size_], rate,
+        strength, size_, kernel == Kernel::kSimd);
+  }
+}
+
+void HeightBrush::noise(
+    float *heights, int origin_x, int origin_z, int width, int length, float delta, float strength, Kernel kernel) {
+  const int stride = get_padded_size();
+  const int lattice_width = width / NOISE_CELL_SIZE;
+  const int lattice_length = length / NOISE_CELL_SIZE;
+  noise_row_.resize(size_);
+  for (int z = 0; z < size_; z++) {
+    const int map_z = fw::constrain(origin_z + z + 1, length);
+    const int lattice_z = map_z / NOISE_CELL_SIZE;
+    const int next_lattice_z = (lattice_z + 1) % lattice_length;
+    const float tz = smoothstep(static_cast<float>(map_z % NOISE_CELL_SIZE) / NOISE_CELL_SIZE);
+
+    // The lattice values only change every NOISE_CELL_SIZE vertices, so we go a cell at a time and only hash them
+    // once per cell. The map is a whole number of cells wide, so it never wraps in the middle of one.
+    for (int x = 0; x < size_;) {
+      const int map_x = fw::constrain(origin_x + x + 1, width);
+      const int lattice_x = map_x / NOISE_CELL_SIZE;
+      const int next_lattice_x = (lattice_x + 1) % lattice_width;
+      const int cell_x = map_x % NOISE_CELL_SIZE;
+      const int count = std::min(NOISE_CELL_SIZE - cell_x, size_ - x);
+      noise_cell(&noise_row_[x], &NOISE_TX[cell_x], lattice_value(lattice_x, lattice_z),
+          lattice_value(next_lattice_x, lattice_z), lattice_value(lattice_x, next_lattice_z),
+          lattice_value(next_lattice_x, next_lattice_z), tz, count, kernel == Kernel::kSimd);
+      x += count;
+    }
+
+    noise_row(heights + ((z + 1) * stride) + 1, noise_row_.data(), &falloff_[z * size_], delta, strength, size_,
+        kernel == Kernel::kSimd);
+  }
+}
+
+char const *HeightBrush::get_simd_name() {
+#if defined(FW_HEIGHT_BRUSH_AVX2) || defined(FW_HEIGHT_BRUSH_SSE2)
+  return simd::NAME;
+#else
+  return "scalar";
+#endif
+}
+
+}
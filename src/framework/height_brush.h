@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+
+namespace fw {
+
+// HeightBrush does the arithmetic for the editor's heightfield brushes. A brush of radius r covers the 2r x 2r vertices
+// from (centre - r) to (centre + r - 1), and how much each one is affected falls off linearly from 1 at the centre to
+// 0 at the radius. We work out that falloff once, when the radius changes, rather than a sqrt per vertex per frame.
+//
+// The brushes work on a padded copy of the heights: get_padded_size() x get_padded_size() of them, starting at
+// (centre - r - 1), so there's a one-vertex border all the way round and smooth() can look at every vertex's neighbours
+// without going off the edge. Whoever owns the heights does the wrapping when they fill it in and copy it back.
+//
+// Each brush runs a row at a time with AVX2 or SSE2 (whichever we're compiled for). Kernel::kScalar does exactly the
+// same arithmetic, in the same order, so you get the same answer either way.
+class HeightBrush {
+public:
+  // Which implementation to use. kSimd uses AVX2 if we're compiled with it, otherwise SSE2, otherwise it's the same as
+  // kScalar.
+  enum class Kernel {
+    kScalar,
+    kSimd,
+  };
+
+private:
+  int radius_;
+  int size_;
+
+  // size_ x size_ of them: 1 - (distance / radius_) inside the radius, and 0 outside it.
+  std::vector<float> falloff_;
+
+  // A copy of the heights for smooth(), which needs the neighbours from before we changed them.
+  std::vector<float> scratch_;
+
+  // The noise for one row, for noise().
+  std::vector<float> noise_row_;
+
+public:
+  explicit HeightBrush(int radius = 1);
+
+  // Changes the radius, recalculating the falloff if it's actually different.
+  void set_radius(int radius);
+
+  inline int get_radius() const {
+    return radius_;
+  }
+
+  // The width (and length) of the vertices we change, not counting the border.
+  inline int get_size() const {
+    return size_;
+  }
+
+  inline int get_padded_size() const {
+    return size_ + 2;
+  }
+
+  // Gets the falloff of vertex (x, z) of the brush, from 0 to get_size() - 1.
+  inline float get_falloff(int x, int z) const {
+    return falloff_[(z * size_) + x];
+  }
+
+  // Each of these changes the (padded, see above) heights in place. For each vertex, with its falloff f:
+  //
+  //  - raise: adds (delta * f) * strength. Lower with a negative delta.
+  //  - level: adds (((target - height) * rate) * f) * strength, to move towards target.
+  //  - smooth: adds (((average - height) * rate) * f) * strength, where average is the mean of the vertex and its
+  //    eight neighbours, to move towards it.
+  //  - noise: adds ((noise * delta) * f) * strength, where noise is smooth value noise between -1 and 1 that's fixed
+  //    to the map (so dabbing the same place again makes the same bumps bigger). origin_x and origin_z are the map
+  //    coordinates of the first vertex of the padded heights, and width and length are the size of the map, which
+  //    the noise wraps around. They must be multiples of 8.
+  void raise(float *heights, float delta, float strength, Kernel kernel = Kernel::kSimd) const;
+  void level(float *heights, float target, float rate, float strength, Kernel kernel = Kernel::kSimd) const;
+  void smooth(float *heights, float rate, float strength, Kernel kernel = Kernel::kSimd);
+  void noise(
+      float *heights, int origin_x, int origin_z, int width, int length, float delta, float strength,
+      Kernel kernel = Kernel::kSimd);
+
+  // Gets the name of the instruction set Kernel::kSimd uses.
+  static char const *get_simd_name();
+};
+
+}
@@ -0,0 +1,463 @@
+#include <framework/height_field.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <framework/misc.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FW_HEIGHT_FIELD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FW_HEIGHT_FIELD_SSE2
+#endif
+
+namespace fw {
+namespace {
+
+// The SIMD kernels work out each vertex's index with float arithmetic (SSE2 can't multiply 32-bit integers), which is
+// only exact up to here. Anything bigger than about 4000x4000 uses the scalar kernel.
+const int MAX_SIMD_INDEX = 1 << 24;
+
+// These are the same as the SIMD min and max: if the values are equal (i.e. one's +0 and the other's -0) or one of
+// them is NaN, you get the second one. That way the scalar and SIMD kernels come out the same even then.
+inline float min_of(float a, float b) {
+  return a < b ? a : b;
+}
+
+inline float max_of(float a, float b) {
+  return a > b ? a : b;
+}
+
+// Wraps v into [0, size), the same way the SIMD kernels do.
+inline float wrap(float v, float size, float inv_size) {
+  if (v >= 0.0f && v < size) {
+    return v;
+  }
+  return v - std::floor(v * inv_size) * size;
+}
+
+inline float bilerp(float v00, float v10, float v01, float v11, float dx, float dz) {
+  const float dxdz = dx * dz;
+  return v00 * (1.0f - dz - dx + dxdz) + v10 * (dx - dxdz) + v11 * dxdz + v01 * (dz - dxdz);
+}
+
+// The vertex at the bottom-left of the cell that a point is in (as an index into the padded arrays), and how far into
+// the cell the point is.
+struct Cell {
+  int index;
+  float dx;
+  float dz;
+
+  inline float sample(std::vector<float> const &values, int stride) const {
+    return bilerp(values[index], values[index + 1], values[index + stride], values[index + stride + 1], dx, dz);
+  }
+};
+
+struct Grid {
+  float width;
+  float length;
+  float inv_width;
+  float inv_length;
+  int stride;
+
+  Grid(int width, int length, int stride) :
+      width(static_cast<float>(width)), length(static_cast<float>(length)), inv_width(1.0f / width),
+      inv_length(1.0f / length), stride(stride) {
+  }
+
+  inline Cell locate(float x, float z) const {
+    x = wrap(x, width, inv_width);
+    z = wrap(z, length, inv_length);
+    const float fx = min_of(max_of(std::floor(x), 0.0f), width - 1.0f);
+    const float fz = min_of(max_of(std::floor(z), 0.0f), length - 1.0f);
+    return Cell { (static_cast<int>(fz) + 1) * stride + static_cast<int>(fx) + 1, x - fx, z - fz };
+  }
+};
+
+// A thin wrapper around whichever SIMD instruction set we're compiled for, so that the kernels below can be written
+// once.
+#if defined(FW_HEIGHT_FIELD_AVX2)
+namespace simd {
+typedef __m256 Float;
+typedef __m256i Int;
+const int WIDTH = 8;
+const char *NAME = "avx2";
+
+inline Float load(float const *p) { return _mm256_loadu_ps(p); }
+inline void store(float *p, Float v) { _mm256_storeu_ps(p, v); }
+inline Float set(float f) { return _mm256_set1_ps(f); }
+inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+inline Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+inline Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+inline Float sqrt(Float a) { return _mm256_sqrt_ps(a); }
+inline Float floor(Float a) { return _mm256_floor_ps(a); }
+inline Float cmp_ge(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline Float cmp_lt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline Float mask_and(Float a, Float b) { return _mm256_and_ps(a, b); }
+inline Float select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+inline Int to_int(Float a) { return _mm256_cvttps_epi32(a); }
+inline Int set_int(int i) { return _mm256_set1_epi32(i); }
+inline Int add_int(Int a, Int b) { return _mm256_add_epi32(a, b); }
+inline Float gather(float const *base, Int index) { return _mm256_i32gather_ps(base, index, 4); }
+}
+#elif defined(FW_HEIGHT_FIELD_SSE2)
+namespace simd {
+typedef __m128 Float;
+typedef __m128i Int;
+const int WIDTH = 4;
+const char *NAME = "sse2";
+
+inline Float load(float const *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, Float v) { _mm_storeu_ps(p, v); }
+inline Float set(float f) { return _mm_set1_ps(f); }
+inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+inline Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+inline Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+inline Float sqrt(Float a) { return _mm_sqrt_ps(a); }
+inline Float cmp_ge(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+inline Float cmp_lt(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+inline Float mask_and(Float a, Float b) { return _mm_and_ps(a, b); }
+inline Float select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline Int to_int(Float a) { return _mm_cvttps_epi32(a); }
+inline Int set_int(int i) { return _mm_set1_epi32(i); }
+inline Int add_int(Int a, Int b) { return _mm_add_epi32(a, b); }
+
+// SSE2 doesn't have a floor, so we truncate and then take one off the negative numbers that weren't whole already.
+// This is the same as std::floor for anything that fits in an int, except that it gives +0 for -0.
+inline Float floor(Float a) {
+  const Float truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+  return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a), _mm_set1_ps(1.0f)));
+}
+
+// Nor does it have a gather, so we do it one at a time.
+inline Float gather(float const *base, Int index) {
+  alignas(16) int32_t i[4];
+  _mm_store_si128(reinterpret_cast<__m128i *>(i), index);
+  return _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+}
+}
+#endif
+
+#if defined(FW_HEIGHT_FIELD_AVX2) || defined(FW_HEIGHT_FIELD_SSE2)
+namespace simd {
+
+inline Float wrap(Float v, Float size, Float inv_size) {
+  const Float in_range = mask_and(cmp_ge(v, set(0.0f)), cmp_lt(v, size));
+  return select(in_range, v, sub(v, mul(floor(mul(v, inv_size)), size)));
+}
+
+inline Float bilerp(Float v00, Float v10, Float v01, Float v11, Float dx, Float dz) {
+  const Float dxdz = mul(dx, dz);
+  const Float w00 = add(sub(sub(set(1.0f), dz), dx), dxdz);
+  return add(add(add(mul(v00, w00), mul(v10, sub(dx, dxdz))), mul(v11, dxdz)), mul(v01, sub(dz, dxdz)));
+}
+
+// The same as the scalar Cell and Grid, a lane at a time. The index is worked out in floats, and since it's a whole
+// number below MAX_SIMD_INDEX it comes out exactly the same.
+struct Cell {
+  Int i00;
+  Int i10;
+  Int i01;
+  Int i11;
+  Float dx;
+  Float dz;
+
+  inline Float sample(std::vector<float> const &values) const {
+    float const *base = values.data();
+    return bilerp(gather(base, i00), gather(base, i10), gather(base, i01), gather(base, i11), dx, dz);
+  }
+};
+
+struct Grid {
+  Float width;
+  Float length;
+  Float inv_width;
+  Float inv_length;
+  Float max_x;
+  Float max_z;
+  Float stride;
+  Int first_index;
+  Int stride_int;
+
+  Grid(int width, int length, int stride) :
+      width(set(static_cast<float>(width))), length(set(static_cast<float>(length))), inv_width(set(1.0f / width)),
+      inv_length(set(1.0f / length)), max_x(set(width - 1.0f)), max_z(set(length - 1.0f)),
+      stride(set(static_cast<float>(stride))), first_index(set_int(stride + 1)), stride_int(set_int(stride)) {
+  }
+
+  inline Cell locate(Float x, Float z) const {
+    x = wrap(x, width, inv_width);
+    z = wrap(z, length, inv_length);
+    const Float fx = min(max(floor(x), set(0.0f)), max_x);
+    const Float fz = min(max(floor(z), set(0.0f)), max_z);
+    Cell cell;
+    cell.i00 = add_int(to_int(add(mul(fz, stride), fx)), first_index);
+    cell.i10 = add_int(cell.i00, set_int(1));
+    cell.i01 = add_int(cell.i00, stride_int);
+    cell.i11 = add_int(cell.i01, set_int(1));
+    cell.dx = sub(x, fx);
+    cell.dz = sub(z, fz);
+    return cell;
+  }
+};
+
+}
+#endif
+
+}
+
+//-------------------------------------------------------------------------
+
+HeightField::HeightField() :
+    width_(0), length_(0), stride_(0) {
+}
+
+HeightField::HeightField(int width, int length, float const *heights) : HeightField() {
+  reset(width, length, heights);
+}
+
+void HeightField::reset(int width, int length, float const *heights) {
+  width_ = width;
+  length_ = length;
+  stride_ = width + 2;
+
+  const std::size_t padded_size = static_cast<std::size_t>(stride_) * (length_ + 2);
+  heights_.assign(padded_size, 0.0f);
+  for (int z = 0; z < length_; z++) {
+    std::copy(heights + z * width_, heights + (z + 1) * width_, heights_.begin() + get_index(0, z));
+  }
+  update_border(heights_);
+
+  normals_x_.assign(padded_size, 0.0f);
+  normals_y_.assign(padded_size, 1.0f);
+  normals_z_.assign(padded_size, 0.0f);
+  for (int z = 0; z < length_; z++) {
+    calculate_normals(z, 0, width_);
+  }
+  update_border(normals_x_);
+  update_border(normals_y_);
+  update_border(normals_z_);
+}
+
+void HeightField::update(float const *heights, int min_x, int min_z, int max_x, int max_z) {
+  for (int z = min_z; z <= max_z; z++) {
+    std::copy(heights + z * width_ + min_x, heights + z * width_ + max_x + 1, heights_.begin() + get_index(min_x, z));
+  }
+  update_border(heights_);
+
+  // The vertices just outside the rectangle have normals that depend on the ones inside it, and they may be on the
+  // other side of the map.
+  for (int z = min_z - 1; z <= max_z + 1; z++) {
+    const int wrapped_z = fw::constrain(z, length_);
+    const int x_begin = min_x - 1;
+    const int x_end = max_x + 2;
+    if (x_end - x_begin >= width_) {
+      calculate_normals(wrapped_z, 0, width_);
+    } else if (x_begin < 0) {
+      calculate_normals(wrapped_z, x_begin + width_, width_);
+      calculate_normals(wrapped_z, 0, x_end);
+    } else if (x_end > width_) {
+      calculate_normals(wrapped_z, x_begin, width_);
+      calculate_normals(wrapped_z, 0, x_end - width_);
+    } else {
+      calculate_normals(wrapped_z, x_begin, x_end);
+    }
+  }
+  update_border(normals_x_);
+  update_border(normals_y_);
+  update_border(normals_z_);
+}
+
+void HeightField::update_border(std::vector<float> &values) {
+  for (int z = 0; z < length_; z++) {
+    float *row = &values[get_index(0, z)];
+    row[-1] = row[width_ - 1];
+    row[width_] = row[0];
+  }
+
+  // The rows above and below, including the corners.
+  std::copy(values.begin() + length_ * stride_, values.begin() + (length_ + 1) * stride_, values.begin());
+  std::copy(values.begin() + stride_, values.begin() + 2 * stride_, values.begin() + (length_ + 1) * stride_);
+}
+
+// The normal at a vertex is the (normalized) sum of the normals of the four triangles between it and its neighbours
+// to the north, east, south and west. When you multiply that out, the vertex's own height cancels and you're left with
+// (west - east, 2, south - north).
+void HeightField::calculate_normals(int z, int x_begin, int x_end) {
+  float const *row = &heights_[get_index(0, z)];
+  float const *north = row + stride_;
+  float const *south = row - stride_;
+  float *normal_x = &normals_x_[get_index(0, z)];
+  float *normal_y = &normals_y_[get_index(0, z)];
+  float *normal_z = &normals_z_[get_index(0, z)];
+
+  int x = x_begin;
+#if defined(FW_HEIGHT_FIELD_AVX2) || defined(FW_HEIGHT_FIELD_SSE2)
+  const simd::Float two = simd::set(2.0f);
+  const simd::Float four = simd::set(4.0f);
+  for (; x + simd::WIDTH <= x_end; x += simd::WIDTH) {
+    const simd::Float nx = simd::sub(simd::load(row + x - 1), simd::load(row + x + 1));
+    const simd::Float nz = simd::sub(simd::load(south + x), simd::load(north + x));
+    const simd::Float length =
+        simd::sqrt(simd::add(simd::add(simd::mul(nx, nx), four), simd::mul(nz, nz)));
+    simd::store(normal_x + x, simd::div(nx, length));
+    simd::store(normal_y + x, simd::div(two, length));
+    simd::store(normal_z + x, simd::div(nz, length));
+  }
+#endif
+  for (; x < x_end; x++) {
+    const float nx = row[x - 1] - row[x + 1];
+    const float nz = south[x] - north[x];
+    const float length = std::sqrt(nx * nx + 4.0f + nz * nz);
+    normal_x[x] = nx / length;
+    normal_y[x] = 2.0f / length;
+    normal_z[x] = nz / length;
+  }
+}
+
+float HeightField::get_vertex_height(int x, int z) const {
+  return heights_[get_index(fw::constrain(x, width_), fw::constrain(z, length_))];
+}
+
+fw::Vector HeightField::get_vertex_normal(int x, int z) const {
+  const int index = get_index(fw::constrain(x, width_), fw::constrain(z, length_));
+  return fw::Vector(normals_x_[index], normals_y_[index], normals_z_[index]);
+}
+
+float HeightField::get_vertex_slope(int x, int z) const {
+  return normals_y_[get_index(fw::constrain(x, width_), fw::constrain(z, length_))];
+}
+
+float HeightField::get_height(float x, float z) const {
+  float height;
+  get_heights_scalar(std::span<float const>(&x, 1), std::span<float const>(&z, 1), std::span<float>(&height, 1));
+  return height;
+}
+
+fw::Vector HeightField::get_normal(float x, float z) const {
+  float nx, ny, nz;
+  get_normals_scalar(
+      std::span<float const>(&x, 1), std::span<float const>(&z, 1), std::span<float>(&nx, 1),
+      std::span<float>(&ny, 1), std::span<float>(&nz, 1));
+  return fw::Vector(nx, ny, nz);
+}
+
+void HeightField::get_heights(
+    std::span<float const> xs, std::span<float const> zs, std::span<float> heights, Kernel kernel) const {
+  if (kernel == Kernel::kSimd) {
+    get_heights_simd(xs, zs, heights);
+  } else {
+    get_heights_scalar(xs, zs, heights);
+  }
+}
+
+void HeightField::get_normals(
+    std::span<float const> xs, std::span<float const> zs, std::span<float> normals_x, std::span<float> normals_y,
+    std::span<float> normals_z, Kernel kernel) const {
+  if (kernel == Kernel::kSimd) {
+    get_normals_simd(xs, zs, normals_x, normals_y, normals_z);
+  } else {
+    get_normals_scalar(xs, zs, normals_x, normals_y, normals_z);
+  }
+}
+
+void HeightField::get_heights_scalar(
+    std::span<float const> xs, std::span<float const> zs, std::span<float> heights) const {
+  const Grid grid(width_, length_, stride_);
+  for (std::size_t i = 0; i < xs.size(); i++) {
+    const Cell cell = grid.locate(xs[i], zs[i]);
+    heights[i] = cell.sample(heights_, stride_);
+  }
+}
+
+void HeightField::get_normals_scalar(
+    std::span<float const> xs, std::span<float const> zs, std::span<float> normals_x, std::span<float> normals_y,
+    std::span<float> normals_z) const {
+  const Grid grid(width_, length_, stride_);
+  for (std::size_t i = 0; i < xs.size(); i++) {
+    const Cell cell = grid.locate(xs[i], zs[i]);
+    const float nx = cell.sample(normals_x_, stride_);
+    const float ny = cell.sample(normals_y_, stride_);
+    const float nz = cell.sample(normals_z_, stride_);
+    const float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+    normals_x[i] = nx / length;
+    normals_y[i] = ny / length;
+    normals_z[i] = nz / length;
+  }
+}
+
+#if defined(FW_HEIGHT_FIELD_AVX2) || defined(FW_HEIGHT_FIELD_SSE2)
+void HeightField::get_heights_simd(
+    std::span<float const> xs, std::span<float const> zs, std::span<float> heights) const {
+  if (heights_.size() > MAX_SIMD_INDEX) {
+    get_heights_scalar(xs, zs, heights);
+    return;
+  }
+
+  const simd::Grid grid(width_, length_, stride_);
+  const std::size_t simd_end = xs.size() - (xs.size() % simd::WIDTH);
+  for (std::size_t i = 0; i < simd_end; i += simd::WIDTH) {
+    const simd::Cell cell = grid.locate(simd::load(&xs[i]), simd::load(&zs[i]));
+    simd::store(&heights[i], cell.sample(heights_));
+  }
+
+  get_heights_scalar(xs.subspan(simd_end), zs.subspan(simd_end), heights.subspan(simd_end));
+}
+
+void HeightField::get_normals_simd(
+    std::span<float const> xs, std::span<float const> zs, std::span<float> normals_x, std::span<float> normals_y,
+    std::span<float> normals_z) const {
+  if (heights_.size() > MAX_SIMD_INDEX) {
+    get_normals_scalar(xs, zs, normals_x, normals_y, normals_z);
+    return;
+  }
+
+  using namespace simd;
+  const simd::Grid grid(width_, length_, stride_);
+  const std::size_t simd_end = xs.size() - (xs.size() % WIDTH);
+  for (std::size_t i = 0; i < simd_end; i += WIDTH) {
+    const simd::Cell cell = grid.locate(load(&xs[i]), load(&zs[i]));
+    const Float nx = cell.sample(normals_x_);
+    const Float ny = cell.sample(normals_y_);
+    const Float nz = cell.sample(normals_z_);
+    const Float length = simd::sqrt(add(add(mul(nx, nx), mul(ny, ny)), mul(nz, nz)));
+    store(&normals_x[i], div(nx, length));
+    store(&normals_y[i], div(ny, length));
+    store(&normals_z[i], div(nz, length));
+  }
+
+  get_normals_scalar(
+      xs.subspan(simd_end), zs.subspan(simd_end), normals_x.subspan(simd_end), normals_y.subspan(simd_end),
+      normals_z.subspan(simd_end));
+}
+
+char const *HeightField::get_simd_name() {
+  return simd::NAME;
+}
+#else
+void HeightField::get_heights_simd(
+    std::span<float const> xs, std::span<float const> zs, std::span<float> heights) const {
+  get_heights_scalar(xs, zs, heights);
+}
+
+void HeightField::get_normals_simd(
+    std::span<float const> xs, std::span<float const> zs, std::span<float> normals_x, std::span<float> normals_y,
+    std::span<float> normals_z) const {
+  get_normals_scalar(xs, zs, normals_x, normals_y, normals_z);
+}
+
+char const *HeightField::get_simd_name() {
+  return "scalar";
+}
+#endif
+
+}
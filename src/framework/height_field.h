@@ -0,0 +1,105 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <framework/math.h>
+
+namespace fw {
+
+// A HeightField is a copy of a terrain's heights that's laid out for sampling them quickly. The terrain wraps around
+// at the edges, so we keep the heights with a one-vertex border all the way round, holding the heights from the
+// opposite edge: looking at a vertex's neighbours (to interpolate between them, or to work out a normal) never needs
+// to wrap the coordinates. We also keep the normal at every vertex, with the same border, which is what the terrain's
+// patches are baked with and what its collision data is built from.
+//
+// If you've got a lot of points to sample, get_heights() and get_normals() do them in batches with AVX2 or SSE2
+// (whichever we're compiled for). They do exactly the same arithmetic, in the same order, as get_height() and
+// get_normal(), so you get the same answer either way.
+class HeightField {
+public:
+  // Which implementation of the batched samplers to use. kSimd uses AVX2 if we're compiled with it, otherwise SSE2,
+  // otherwise it's the same as kScalar.
+  enum class Kernel {
+    kScalar,
+    kSimd,
+  };
+
+private:
+  int width_;
+  int length_;
+
+  // The width of a row, including the border on either side.
+  int stride_;
+
+  // (width_ + 2) * (length_ + 2) of each, with the vertex at (x, z) at get_index(x, z).
+  std::vector<float> heights_;
+  std::vector<float> normals_x_;
+  std::vector<float> normals_y_;
+  std::vector<float> normals_z_;
+
+  inline int get_index(int x, int z) const {
+    return (z + 1) * stride_ + (x + 1);
+  }
+
+  // Copies the vertices along each edge into the border on the opposite side.
+  void update_border(std::vector<float> &values);
+
+  // Calculates the normals of the vertices in row z from x_begin up to (but not including) x_end.
+  void calculate_normals(int z, int x_begin, int x_end);
+
+  void get_heights_scalar(std::span<float const> xs, std::span<float const> zs, std::span<float> heights) const;
+  void get_heights_simd(std::span<float const> xs, std::span<float const> zs, std::span<float> heights) const;
+  void get_normals_scalar(
+      std::span<float const> xs, std::span<float const> zs, std::span<float> normals_x, std::span<float> normals_y,
+      std::span<float> normals_z) const;
+  void get_normals_simd(
+      std::span<float const> xs, std::span<float const> zs, std::span<float> normals_x, std::span<float> normals_y,
+      std::span<float> normals_z) const;
+
+public:
+  HeightField();
+
+  // Creates a HeightField from the given width x length heights, one row (of width) at a time.
+  HeightField(int width, int length, float const *heights);
+
+  // Replaces everything with the given heights.
+  void reset(int width, int length, float const *heights);
+
+  // Copies the vertices from min_x,min_z to max_x,max_z (inclusive) from the given heights (which are the whole
+  // width x length of them), and recalculates the normals around them. The coordinates must already be wrapped.
+  void update(float const *heights, int min_x, int min_z, int max_x, int max_z);
+
+  int get_width() const {
+    return width_;
+  }
+  int get_length() const {
+    return length_;
+  }
+
+  // Gets the height and normal of the vertex at the given coordinates, which wrap around.
+  float get_vertex_height(int x, int z) const;
+  fw::Vector get_vertex_normal(int x, int z) const;
+
+  // Gets the cosine of the angle between the terrain at the given vertex and the horizontal: 1 on flat ground and 0
+  // on a vertical cliff. This is just the y component of the normal.
+  float get_vertex_slope(int x, int z) const;
+
+  // Gets the height and normal at the given point, interpolated between the four vertices around it. The coordinates
+  // wrap around.
+  float get_height(float x, float z) const;
+  fw::Vector get_normal(float x, float z) const;
+
+  // Gets the height (or normal) at each of the points (xs[i], zs[i]). The outputs must be at least as big as xs.
+  void get_heights(
+      std::span<float const> xs, std::span<float const> zs, std::span<float> heights,
+      Kernel kernel = Kernel::kSimd) const;
+  void get_normals(
+      std::span<float const> xs, std::span<float const> zs, std::span<float> normals_x, std::span<float> normals_y,
+      std::span<float> normals_z, Kernel kernel = Kernel::kSimd) const;
+
+  // Gets the name of the instruction set Kernel::kSimd uses.
+  static char const *get_simd_name();
+};
+
+}
@@ -0,0 +1,271 @@
+#include <framework/height_pyramid.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <framework/height_field.h>
+
+namespace fw {
+namespace {
+
+// How far (in world units) past a node's edge we look to find the next node. This is what guarantees we make
+// progress along the ray even when it's running right along an edge.
+const float STEP_EPSILON = 0.0001f;
+
+// The node bounds are exact, but the ray's heights at either end of a node aren't, so we give them a little slack
+// rather than risk skipping a node the ray only just grazes.
+const float HEIGHT_EPSILON = 0.001f;
+
+// How far outside a triangle's edges we still count as a hit, so that rays don't slip through the crack between two
+// triangles.
+const float EDGE_EPSILON = 0.00001f;
+
+inline int wrap(int value, int size) {
+  value %= size;
+  return value < 0 ? value + size : value;
+}
+
+inline int floor_div(int value, int divisor) {
+  return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+// Moller-Trumbore ray/triangle intersection. Sets distance (in multiples of the ray's direction) if we hit.
+bool intersect_triangle(
+    Ray const &ray, fw::Vector const &a, fw::Vector const &b, fw::Vector const &c, float &distance) {
+  const fw::Vector edge1 = b - a;
+  const fw::Vector edge2 = c - a;
+  const fw::Vector p = fw::cross(ray.direction, edge2);
+  const float det = fw::dot(edge1, p);
+  if (det == 0.0f) {
+    // The ray is parallel to the triangle.
+    return false;
+  }
+  const float inv_det = 1.0f / det;
+
+  const fw::Vector s = ray.start - a;
+  const float u = fw::dot(s, p) * inv_det;
+  if (u < -EDGE_EPSILON || u > 1.0f + EDGE_EPSILON) {
+    return false;
+  }
+
+  const fw::Vector q = fw::cross(s, edge1);
+  const float v = fw::dot(ray.direction, q) * inv_det;
+  if (v < -EDGE_EPSILON || u + v > 1.0f + EDGE_EPSILON) {
+    return false;
+  }
+
+  distance = fw::dot(edge2, q) * inv_det;
+  return true;
+}
+
+}
+
+HeightPyramid::HeightPyramid() : height_field_(nullptr) {
+}
+
+HeightPyramid::HeightPyramid(HeightField const &height_field) : height_field_(nullptr) {
+  reset(height_field);
+}
+
+void HeightPyramid::reset(HeightField const &height_field) {
+  height_field_ = &height_field;
+  levels_.clear();
+
+  int width = height_field.get_width();
+  int length = height_field.get_length();
+  if (width <= 0 || length <= 0) {
+    return;
+  }
+  while (true) {
+    Level level;
+    level.width = width;
+    level.length = length;
+    level.min_heights.resize(width * length);
+    level.max_heights.resize(width * length);
+    levels_.push_back(std::move(level));
+
+    if (width % 2 != 0 || length % 2 != 0) {
+      break;
+    }
+    width /= 2;
+    length /= 2;
+  }
+
+  for (int i = 0; i < get_num_levels(); i++) {
+    update_nodes(i, 0, 0, levels_[i].width - 1, levels_[i].length - 1);
+  }
+}
+
+void HeightPyramid::update(int min_x, int min_z, int max_x, int max_z) {
+  // A vertex is a corner of the four cells around it, the ones to the west and south of it are off by one.
+  min_x--;
+  min_z--;
+  for (int i = 0; i < get_num_levels(); i++) {
+    update_nodes(i, min_x, min_z, max_x, max_z);
+    min_x = floor_div(min_x, 2);
+    min_z = floor_div(min_z, 2);
+    max_x = floor_div(max_x, 2);
+    max_z = floor_div(max_z, 2);
+  }
+}
+
+void HeightPyramid::update_nodes(int level_index, int min_x, int min_z, int max_x, int max_z) {
+  Level &level = levels_[level_index];
+  if (max_x - min_x + 1 >= level.width) {
+    min_x = 0;
+    max_x = level.width - 1;
+  }
+  if (max_z - min_z + 1 >= level.length) {
+    min_z = 0;
+    max_z = level.length - 1;
+  }
+
+  for (int z = min_z; z <= max_z; z++) {
+    const int node_z = wrap(z, level.length);
+    for (int x = min_x; x <= max_x; x++) {
+      const int node_x = wrap(x, level.width);
+      float min_height;
+      float max_height;
+      if (level_index == 0) {
+        const float h00 = height_field_->get_vertex_height(node_x, node_z);
+        const float h10 = height_field_->get_vertex_height(node_x + 1, node_z);
+        const float h01 = height_field_->get_vertex_height(node_x, node_z + 1);
+        const float h11 = height_field_->get_vertex_height(node_x + 1, node_z + 1);
+        min_height = std::min(std::min(h00, h10), std::min(h01, h11));
+        max_height = std::max(std::max(h00, h10), std::max(h01, h11));
+      } else {
+        // Each level divides evenly into the one below it, so the children never need to be wrapped.
+        Level const &children = levels_[level_index - 1];
+        const int i00 = (node_z * 2) * children.width + (node_x * 2);
+        const int i01 = i00 + children.width;
+        min_height = std::min(
+            std::min(children.min_heights[i00], children.min_heights[i00 + 1]),
+            std::min(children.min_heights[i01], children.min_heights[i01 + 1]));
+        max_height = std::max(
+            std::max(children.max_heights[i00], children.max_heights[i00 + 1]),
+            std::max(children.max_heights[i01], children.max_heights[i01 + 1]));
+      }
+      level.min_heights[node_z * level.width + node_x] = min_height;
+      level.max_heights[node_z * level.width + node_x] = max_height;
+    }
+  }
+}
+
+bool HeightPyramid::intersect_cell(Ray const &ray, int cell_x, int cell_z, RayHit &hit) const {
+  // These are in the ray's (unwrapped) coordinates, only the heights come from the wrapped vertices.
+  const float x1 = static_cast<float>(cell_x);
+  const float x2 = static_cast<float>(cell_x + 1);
+  const float z1 = static_cast<float>(cell_z);
+  const float z2 = static_cast<float>(cell_z + 1);
+  const fw::Vector p11(x1, height_field_->get_vertex_height(cell_x, cell_z), z1);
+  const fw::Vector p21(x2, height_field_->get_vertex_height(cell_x + 1, cell_z), z1);
+  const fw::Vector p12(x1, height_field_->get_vertex_height(cell_x, cell_z + 1), z2);
+  const fw::Vector p22(x2, height_field_->get_vertex_height(cell_x + 1, cell_z + 1), z2);
+
+  // The cell is split along the diagonal from (x1, z2) to (x2, z1).
+  float nearest = ray.max_distance;
+  bool found = false;
+  float distance;
+  if (intersect_triangle(ray, p11, p12, p21, distance) && distance >= ray.min_distance && distance <= nearest) {
+    nearest = distance;
+    found = true;
+  }
+  if (intersect_triangle(ray, p22, p21, p12, distance) && distance >= ray.min_distance && distance <= nearest) {
+    nearest = distance;
+    found = true;
+  }
+  if (found) {
+    hit.hit = true;
+    hit.distance = nearest;
+    hit.location = ray.start + ray.direction * nearest;
+  }
+  return found;
+}
+
+bool HeightPyramid::raycast(Ray const &ray, RayHit &hit) const {
+  hit = RayHit();
+  if (levels_.empty()) {
+    return false;
+  }
+
+  const float start_x = ray.start[0];
+  const float start_y = ray.start[1];
+  const float start_z = ray.start[2];
+  const float dir_x = ray.direction[0];
+  const float dir_y = ray.direction[1];
+  const float dir_z = ray.direction[2];
+  const float inv_dir_x = dir_x != 0.0f ? 1.0f / dir_x : 0.0f;
+  const float inv_dir_z = dir_z != 0.0f ? 1.0f / dir_z : 0.0f;
+
+  // STEP_EPSILON in multiples of the direction. For a (near enough) vertical ray we'll never cross into another
+  // node, so the step doesn't matter.
+  const float step = STEP_EPSILON / std::max(std::max(std::abs(dir_x), std::abs(dir_z)), STEP_EPSILON);
+
+  const int top_level = get_num_levels() - 1;
+  int level_index = top_level;
+  float distance = ray.min_distance;
+  while (distance < ray.max_distance) {
+    Level const &level = levels_[level_index];
+    const float node_size = static_cast<float>(1 << level_index);
+
+    // Find the node we're in (or, if we're right on an edge, the node we're about to go into) and where we leave it.
+    const float probe = distance + step;
+    const int node_x = static_cast<int>(std::floor((start_x + dir_x * probe) / node_size));
+    const int node_z = static_cast<int>(std::floor((start_z + dir_z * probe) / node_size));
+    float exit = ray.max_distance;
+    if (dir_x > 0.0f) {
+      exit = std::min(exit, ((node_x + 1) * node_size - start_x) * inv_dir_x);
+    } else if (dir_x < 0.0f) {
+      exit = std::min(exit, (node_x * node_size - start_x) * inv_dir_x);
+    }
+    if (dir_z > 0.0f) {
+      exit = std::min(exit, ((node_z + 1) * node_size - start_z) * inv_dir_z);
+    } else if (dir_z < 0.0f) {
+      exit = std::min(exit, (node_z * node_size - start_z) * inv_dir_z);
+    }
+    exit = std::max(exit, probe);
+
+    // If the ray is entirely above (or below) everything in this node, skip over it and try a bigger node next.
+    const int index = wrap(node_z, level.length) * level.width + wrap(node_x, level.width);
+    const float enter_y = start_y + dir_y * distance;
+    const float exit_y = start_y + dir_y * exit;
+    if (std::max(enter_y, exit_y) < level.min_heights[index] - HEIGHT_EPSILON
+        || std::min(enter_y, exit_y) > level.max_heights[index] + HEIGHT_EPSILON) {
+      distance = exit;
+      level_index = std::min(level_index + 1, top_level);
+      continue;
+    }
+
+    if (level_index > 0) {
+      level_index--;
+      continue;
+    }
+
+    if (intersect_cell(ray, node_x, node_z, hit)) {
+      return true;
+    }
+    distance = exit;
+    level_index = std::min(level_index + 1, top_level);
+  }
+
+  return false;
+}
+
+void HeightPyramid::raycast(std::span<Ray const> rays, std::span<RayHit> hits) const {
+  for (size_t i = 0; i < rays.size(); i++) {
+    raycast(rays[i], hits[i]);
+  }
+}
+
+bool HeightPyramid::is_occluded(fw::Vector const &from, fw::Vector const &to) const {
+  Ray ray;
+  ray.start = from;
+  ray.direction = to - from;
+  ray.min_distance = 0.0f;
+  ray.max_distance = 1.0f;
+
+  RayHit hit;
+  return raycast(ray, hit);
+}
+
+}
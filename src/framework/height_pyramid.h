@@ -0,0 +1,84 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <framework/math.h>
+
+namespace fw {
+
+class HeightField;
+
+// A ray, starting at start and going in direction. Only the part of the ray between min_distance and max_distance is
+// looked at. The distances are in multiples of direction, which doesn't have to be normalized.
+struct Ray {
+  fw::Vector start;
+  fw::Vector direction;
+  float min_distance = 0.0f;
+  float max_distance = 1.0f;
+};
+
+// Where a Ray hits the terrain, if it does.
+struct RayHit {
+  bool hit = false;
+  float distance = 0.0f;
+  fw::Vector location;
+};
+
+// A HeightPyramid is a stack of ever-coarser grids over a HeightField, each node holding the lowest and highest points
+// of the terrain underneath it. When casting a ray, we can skip over any node that the ray passes entirely above (or
+// below) and only test the triangles of the cells that it might actually hit. For a ray looking down at the terrain
+// from the camera, that's a handful of triangles rather than the thousands a straight walk along the ray would test.
+//
+// The terrain wraps around, and so do the rays: a ray that goes off one edge comes back on the opposite one. Each
+// level is half the size of the one below it, for as long as the width and length divide evenly.
+//
+// The HeightPyramid keeps a pointer to the HeightField, and you must call update() whenever you update that. Once
+// it's built, it's safe to cast rays from multiple threads at once (e.g. in a ThreadPool::parallel_for).
+class HeightPyramid {
+private:
+  struct Level {
+    int width;
+    int length;
+    std::vector<float> min_heights;
+    std::vector<float> max_heights;
+  };
+
+  HeightField const *height_field_;
+
+  // levels_[0] has one node per cell of the terrain (that is, for the square between four vertices).
+  std::vector<Level> levels_;
+
+  // Recalculates the nodes from min_x,min_z to max_x,max_z (inclusive, and not necessarily wrapped) of the given level.
+  void update_nodes(int level, int min_x, int min_z, int max_x, int max_z);
+
+  // Tests the two triangles of the given cell, and fills in hit with the nearest one the ray hits (if any).
+  bool intersect_cell(Ray const &ray, int cell_x, int cell_z, RayHit &hit) const;
+
+public:
+  HeightPyramid();
+  explicit HeightPyramid(HeightField const &height_field);
+
+  // Rebuilds the whole pyramid over the given HeightField.
+  void reset(HeightField const &height_field);
+
+  // Updates the pyramid after the vertices from min_x,min_z to max_x,max_z (inclusive, and already wrapped) of the
+  // HeightField have changed.
+  void update(int min_x, int min_z, int max_x, int max_z);
+
+  int get_num_levels() const {
+    return static_cast<int>(levels_.size());
+  }
+
+  // Finds the first point where the ray hits the terrain. Returns false (and leaves hit.hit false) if it doesn't hit.
+  bool raycast(Ray const &ray, RayHit &hit) const;
+
+  // Casts each of the given rays, hits must be at least as big as rays.
+  void raycast(std::span<Ray const> rays, std::span<RayHit> hits) const;
+
+  // Returns true if the terrain is in the way between from and to. Both points need to be above the ground (e.g. at
+  // the top of a unit rather than at its feet), otherwise the terrain they're standing on counts as in the way.
+  bool is_occluded(fw::Vector const &from, fw::Vector const &to) const;
+};
+
+}
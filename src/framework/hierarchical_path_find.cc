@@ -0,0 +1,602 @@
+#include <framework/hierarchical_path_find.h>
+
+#include <algorithm>
+#include <limits>
+#include <set>
+
+#include <framework/logging.h>
+#include <framework/misc.h>
+
+namespace fw {
+namespace {
+
+constexpr float kInfiniteCost = std::numeric_limits<float>::infinity();
+constexpr float kDiagonalCost = 1.41421356f;
+
+// A run of passable border cells shorter than this gets a single entrance in the middle. Longer runs get an entrance
+// at each end, so that paths don't have to detour through the middle of a wide-open border.
+constexpr int kMaxSingleEntranceRun = 6;
+
+// PathFind::find stops at the first cell that's within one (Manhattan distance, the same as its heuristic) of the goal
+// rather than going all the way to it, so we cut our path off at the same place. Only the cells from first on are ours.
+void stop_next_to_goal(std::vector<fw::Vector> &path, size_t first, fw::Vector const &end) {
+  for (size_t i = first; i < path.size(); i++) {
+    if (std::abs(path[i][0] - end[0]) + std::abs(path[i][2] - end[2]) <= 1.0f) {
+      path.resize(i + 1);
+      return;
+    }
+  }
+}
+
+}
+
+struct HierarchicalPathFind::Transition {
+  // The cell on this side of the border.
+  int from_cell;
+
+  // The cell on the other side of the border.
+  int to_cell;
+};
+
+struct HierarchicalPathFind::Cluster {
+  // The cells of all of the entrances into this cluster.
+  std::vector<int> entrances;
+
+  // Cost of travelling from entrances[i] to entrances[j] without leaving the cluster is costs[i * n + j] (where n is
+  // entrances.size()), or kInfiniteCost if there is no path within the cluster.
+  std::vector<float> costs;
+
+  // The transitions out of this cluster, from_cell is always one of our entrances.
+  std::vector<Transition> transitions;
+};
+
+struct HierarchicalPathFind::Graph {
+  std::vector<Cluster> clusters;
+
+  // For each cluster, the list of transitions along its east and south borders. The west and north borders are the
+  // east and south borders of the neighbouring clusters.
+  std::vector<std::vector<Transition>> east_borders;
+  std::vector<std::vector<Transition>> south_borders;
+
+  // For each cell that is an entrance, the index of that entrance in its cluster's entrance list (-1 for cells that
+  // are not entrances).
+  std::vector<int> cell_entrance;
+
+  // The abstract node ID of the first entrance in each cluster, and the cell of each abstract node. Abstract node IDs
+  // are dense so that we can store the search state in flat arrays.
+  std::vector<int> cluster_first_node;
+  std::vector<int> abstract_cell;
+};
+
+HierarchicalPathFind::HierarchicalPathFind(
+    int width, int length, std::vector<bool> const &passability, int cluster_size) :
+    HierarchicalPathFind(std::make_shared<PassabilityGrid>(width, length, passability), cluster_size) {
+}
+
+HierarchicalPathFind::HierarchicalPathFind(std::shared_ptr<PassabilityGrid> passability, int cluster_size) :
+    HierarchicalPathFind(passability, std::make_shared<Graph>(), cluster_size) {
+  const int num_clusters = clusters_width_ * clusters_length_;
+  graph_->clusters.resize(num_clusters);
+  graph_->east_borders.resize(num_clusters);
+  graph_->south_borders.resize(num_clusters);
+  graph_->cell_entrance.resize(width_ * length_, -1);
+
+  for (int cluster = 0; cluster < num_clusters; cluster++) {
+    build_border(cluster, /*east=*/true);
+    build_border(cluster, /*east=*/false);
+  }
+  for (int cluster = 0; cluster < num_clusters; cluster++) {
+    build_cluster(cluster);
+  }
+  update_abstract_node_ids();
+
+  LOG(DBG) << "hierarchical path find: " << num_clusters << " clusters, " << get_num_abstract_nodes()
+           << " abstract nodes";
+}
+
+HierarchicalPathFind::HierarchicalPathFind(
+    std::shared_ptr<PassabilityGrid> passability, std::shared_ptr<Graph> graph, int cluster_size) :
+    PathFind(passability), cluster_size_(cluster_size), graph_(graph), start_cell_(-1), goal_cell_(-1),
+    abstract_run_(0), local_run_(0) {
+  clusters_width_ = (width_ + cluster_size_ - 1) / cluster_size_;
+  clusters_length_ = (length_ + cluster_size_ - 1) / cluster_size_;
+
+  const int num_local_cells = cluster_size_ * cluster_size_;
+  local_cost_.resize(num_local_cells);
+  local_previous_.resize(num_local_cells);
+  local_open_run_no_.resize(num_local_cells, 0);
+  local_closed_run_no_.resize(num_local_cells, 0);
+  local_open_.reset(num_local_cells);
+}
+
+HierarchicalPathFind::~HierarchicalPathFind() {
+}
+
+std::shared_ptr<HierarchicalPathFind> HierarchicalPathFind::create_worker() const {
+  return std::shared_ptr<HierarchicalPathFind>(
+      new HierarchicalPathFind(get_passability(), graph_, cluster_size_));
+}
+
+int HierarchicalPathFind::get_num_abstract_nodes() const {
+  return static_cast<int>(graph_->abstract_cell.size());
+}
+
+int HierarchicalPathFind::get_cluster(int cell) const {
+  int x = cell % width_;
+  int z = cell / width_;
+  return get_cluster_index(x / cluster_size_, z / cluster_size_);
+}
+
+int HierarchicalPathFind::get_cluster_index(int cluster_x, int cluster_z) const {
+  cluster_x = fw::constrain(cluster_x, clusters_width_);
+  cluster_z = fw::constrain(cluster_z, clusters_length_);
+  return (cluster_z * clusters_width_) + cluster_x;
+}
+
+fw::Rectangle<int> HierarchicalPathFind::get_cluster_bounds(int cluster) const {
+  int left = (cluster % clusters_width_) * cluster_size_;
+  int top = (cluster / clusters_width_) * cluster_size_;
+  return fw::Rectangle<int>(
+      left, top, std::min(cluster_size_, width_ - left), std::min(cluster_size_, length_ - top));
+}
+
+int HierarchicalPathFind::get_local_index(int cluster, int cell) const {
+  fw::Rectangle<int> bounds = get_cluster_bounds(cluster);
+  int x = (cell % width_) - bounds.left;
+  int z = (cell / width_) - bounds.top;
+  return (z * cluster_size_) + x;
+}
+
+// Builds the list of transitions along either the east or south border of the given cluster. A transition is a pair
+// of passable cells directly across the border from each other.
+void HierarchicalPathFind::build_border(int cluster, bool east) {
+  fw::Rectangle<int> bounds = get_cluster_bounds(cluster);
+  std::vector<Transition> &border = east ? graph_->east_borders[cluster] : graph_->south_borders[cluster];
+  border.clear();
+
+  const int border_length = east ? bounds.height : bounds.width;
+  auto get_cells = [&](int i, int *from_cell, int *to_cell) {
+    if (east) {
+      int z = bounds.top + i;
+      *from_cell = (z * width_) + bounds.right() - 1;
+      *to_cell = (z * width_) + fw::constrain(bounds.right(), width_);
+    } else {
+      int x = bounds.left + i;
+      *from_cell = ((bounds.bottom() - 1) * width_) + x;
+      *to_cell = (fw::constrain(bounds.bottom(), length_) * width_) + x;
+    }
+  };
+
+  // Along a south border, the cells on either side are in two rows, so we can find the open ones 64 at a time.
+  std::vector<uint64_t> open_bits;
+  if (!east) {
+    PassabilityGrid const &passability = *get_passability();
+    const int from_z = bounds.bottom() - 1;
+    const int to_z = fw::constrain(bounds.bottom(), length_);
+    open_bits.resize((border_length + 63) / 64);
+    for (size_t i = 0; i < open_bits.size(); i++) {
+      const int x = bounds.left + static_cast<int>(i) * 64;
+      open_bits[i] = passability.get_bits(x, from_z) & passability.get_bits(x, to_z);
+    }
+  }
+  auto is_open = [&](int i) {
+    if (!east) {
+      return ((open_bits[i / 64] >> (i % 64)) & 1) != 0;
+    }
+    int from_cell, to_cell;
+    get_cells(i, &from_cell, &to_cell);
+    return is_passable(from_cell % width_, from_cell / width_) && is_passable(to_cell % width_, to_cell / width_);
+  };
+  auto add_transition = [&](int i) {
+    Transition transition;
+    get_cells(i, &transition.from_cell, &transition.to_cell);
+    border.push_back(transition);
+  };
+
+  int i = 0;
+  while (i < border_length) {
+    if (!is_open(i)) {
+      i++;
+      continue;
+    }
+
+    int run_start = i;
+    while (i < border_length && is_open(i)) {
+      i++;
+    }
+    int run_length = i - run_start;
+    if (run_length < kMaxSingleEntranceRun) {
+      add_transition(run_start + (run_length / 2));
+    } else {
+      add_transition(run_start);
+      add_transition(i - 1);
+    }
+  }
+}
+
+// Collects the entrances of the given cluster from the four borders around it, then works out the cost of travelling
+// between each pair of them.
+void HierarchicalPathFind::build_cluster(int cluster) {
+  Cluster &c = graph_->clusters[cluster];
+  std::vector<int> &cell_entrance = graph_->cell_entrance;
+  for (int cell : c.entrances) {
+    cell_entrance[cell] = -1;
+  }
+  c.entrances.clear();
+  c.transitions.clear();
+
+  const int cluster_x = cluster % clusters_width_;
+  const int cluster_z = cluster / clusters_width_;
+  for (Transition const &transition : graph_->east_borders[cluster]) {
+    c.transitions.push_back(transition);
+  }
+  for (Transition const &transition : graph_->south_borders[cluster]) {
+    c.transitions.push_back(transition);
+  }
+  for (Transition const &transition : graph_->east_borders[get_cluster_index(cluster_x - 1, cluster_z)]) {
+    c.transitions.push_back(Transition { transition.to_cell, transition.from_cell });
+  }
+  for (Transition const &transition : graph_->south_borders[get_cluster_index(cluster_x, cluster_z - 1)]) {
+    c.transitions.push_back(Transition { transition.to_cell, transition.from_cell });
+  }
+
+  for (Transition const &transition : c.transitions) {
+    if (cell_entrance[transition.from_cell] < 0) {
+      cell_entrance[transition.from_cell] = static_cast<int>(c.entrances.size());
+      c.entrances.push_back(transition.from_cell);
+    }
+  }
+
+  const int n = static_cast<int>(c.entrances.size());
+  c.costs.assign(n * n, kInfiniteCost);
+  for (int i = 0; i < n; i++) {
+    c.costs[(i * n) + i] = 0.0f;
+    if (i == n - 1) {
+      break;
+    }
+
+    // The costs are symmetric, so we only need to search from each entrance to the ones after it.
+    search_cluster(cluster, c.entrances[i], -1);
+    for (int j = i + 1; j < n; j++) {
+      float cost = get_local_cost(cluster, c.entrances[j]);
+      c.costs[(i * n) + j] = cost;
+      c.costs[(j * n) + i] = cost;
+    }
+  }
+}
+
+void HierarchicalPathFind::update_abstract_node_ids() {
+  graph_->cluster_first_node.resize(graph_->clusters.size());
+  graph_->abstract_cell.clear();
+  for (int cluster = 0; cluster < static_cast<int>(graph_->clusters.size()); cluster++) {
+    graph_->cluster_first_node[cluster] = static_cast<int>(graph_->abstract_cell.size());
+    for (int cell : graph_->clusters[cluster].entrances) {
+      graph_->abstract_cell.push_back(cell);
+    }
+  }
+}
+
+// Makes sure our abstract search state is big enough for the graph, which may have been changed by another instance
+// since we last searched it.
+void HierarchicalPathFind::ensure_abstract_state() {
+  // Leave room for the start and goal nodes.
+  const int num_nodes = get_num_abstract_nodes() + 2;
+  if (static_cast<int>(abstract_cost_.size()) == num_nodes) {
+    return;
+  }
+
+  abstract_cost_.resize(num_nodes);
+  abstract_previous_.resize(num_nodes);
+  abstract_open_run_no_.assign(num_nodes, 0);
+  abstract_closed_run_no_.assign(num_nodes, 0);
+  abstract_open_.reset(num_nodes);
+  abstract_run_ = 0;
+}
+
+int HierarchicalPathFind::get_abstract_cell(int node) const {
+  const int num_abstract_nodes = get_num_abstract_nodes();
+  if (node < num_abstract_nodes) {
+    return graph_->abstract_cell[node];
+  }
+  return node == num_abstract_nodes ? start_cell_ : goal_cell_;
+}
+
+void HierarchicalPathFind::search_cluster(int cluster, int from_cell, int goal_cell) {
+  fw::Rectangle<int> bounds = get_cluster_bounds(cluster);
+  local_run_++;
+  local_open_.clear();
+
+  int from = get_local_index(cluster, from_cell);
+  int goal = goal_cell < 0 ? -1 : get_local_index(cluster, goal_cell);
+  local_cost_[from] = 0.0f;
+  local_previous_[from] = -1;
+  local_open_run_no_[from] = local_run_;
+  local_open_.push(from, goal_cell < 0 ? 0.0f : estimate_cost(from_cell, goal_cell));
+
+  while (!local_open_.empty()) {
+    int curr = local_open_.pop();
+    local_closed_run_no_[curr] = local_run_;
+    nodes_expanded_++;
+    if (curr == goal) {
+      return;
+    }
+
+    int curr_x = curr % cluster_size_;
+    int curr_z = curr / cluster_size_;
+    for (int dz = -1; dz <= 1; dz++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        if (dx == 0 && dz == 0)
+          continue;
+
+        int x = curr_x + dx;
+        int z = curr_z + dz;
+        if (x < 0 || z < 0 || x >= bounds.width || z >= bounds.height)
+          continue;
+        if (!is_passable(bounds.left + x, bounds.top + z))
+          continue;
+
+        int n = (z * cluster_size_) + x;
+        if (local_closed_run_no_[n] == local_run_)
+          continue;
+
+        float cost = local_cost_[curr] + (dx == 0 || dz == 0 ? 1.0f : kDiagonalCost);
+        float heuristic = 0.0f;
+        if (goal >= 0) {
+          heuristic = estimate_cost(((bounds.top + z) * width_) + bounds.left + x, goal_cell);
+        }
+
+        if (local_open_run_no_[n] != local_run_) {
+          local_open_run_no_[n] = local_run_;
+          local_cost_[n] = cost;
+          local_previous_[n] = curr;
+          local_open_.push(n, cost + heuristic);
+        } else if (cost < local_cost_[n]) {
+          local_cost_[n] = cost;
+          local_previous_[n] = curr;
+          local_open_.decrease(n, cost + heuristic);
+        }
+      }
+    }
+  }
+}
+
+float HierarchicalPathFind::get_local_cost(int cluster, int cell) const {
+  int index = get_local_index(cluster, cell);
+  if (local_closed_run_no_[index] != local_run_) {
+    return kInfiniteCost;
+  }
+  return local_cost_[index];
+}
+
+void HierarchicalPathFind::append_local_path(int cluster, int to_cell, std::vector<fw::Vector> &path) const {
+  fw::Rectangle<int> bounds = get_cluster_bounds(cluster);
+  size_t first = path.size();
+  for (int index = get_local_index(cluster, to_cell); local_previous_[index] >= 0; index = local_previous_[index]) {
+    path.push_back(fw::Vector(bounds.left + (index % cluster_size_), 0, bounds.top + (index / cluster_size_)));
+  }
+  std::reverse(path.begin() + first, path.end());
+}
+
+// The octile distance between the two cells, taking into account that the map wraps. This is an admissible heuristic
+// for both the abstract and the local searches.
+float HierarchicalPathFind::estimate_cost(int from_cell, int to_cell) const {
+  int dx = std::abs((from_cell % width_) - (to_cell % width_));
+  int dz = std::abs((from_cell / width_) - (to_cell / width_));
+  dx = std::min(dx, width_ - dx);
+  dz = std::min(dz, length_ - dz);
+  return static_cast<float>(std::max(dx, dz)) + (kDiagonalCost - 1.0f) * static_cast<float>(std::min(dx, dz));
+}
+
+bool HierarchicalPathFind::is_adjacent(int from_cell, int to_cell) const {
+  int dx = std::abs((from_cell % width_) - (to_cell % width_));
+  int dz = std::abs((from_cell / width_) - (to_cell / width_));
+  dx = std::min(dx, width_ - dx);
+  dz = std::min(dz, length_ - dz);
+  return dx <= 1 && dz <= 1;
+}
+
+void HierarchicalPathFind::relax_abstract(int from_node, int to_node, float edge_cost, int goal_cell) {
+  if (abstract_closed_run_no_[to_node] == abstract_run_) {
+    return;
+  }
+
+  float cost = abstract_cost_[from_node] + edge_cost;
+  float heuristic = estimate_cost(get_abstract_cell(to_node), goal_cell);
+  if (abstract_open_run_no_[to_node] != abstract_run_) {
+    abstract_open_run_no_[to_node] = abstract_run_;
+    abstract_cost_[to_node] = cost;
+    abstract_previous_[to_node] = from_node;
+    abstract_open_.push(to_node, cost + heuristic);
+  } else if (cost < abstract_cost_[to_node]) {
+    abstract_cost_[to_node] = cost;
+    abstract_previous_[to_node] = from_node;
+    abstract_open_.decrease(to_node, cost + heuristic);
+  }
+}
+
+bool HierarchicalPathFind::find(std::vector<fw::Vector> &path, fw::Vector const &start, fw::Vector const &end) {
+  nodes_expanded_ = 0;
+  const size_t first = path.size();
+
+  int start_x = fw::constrain(static_cast<int>(start[0]), width_);
+  int start_z = fw::constrain(static_cast<int>(start[2]), length_);
+  int goal_x = fw::constrain(static_cast<int>(end[0]), width_);
+  int goal_z = fw::constrain(static_cast<int>(end[2]), length_);
+  const int start_cell = (start_z * width_) + start_x;
+  const int goal_cell = (goal_z * width_) + goal_x;
+
+  // If the start or goal is impassable, the abstract graph can't help us. The flat search lets us get as close as
+  // possible to an impassable goal, like it always has.
+  if (!is_passable(start_x, start_z) || !is_passable(goal_x, goal_z)) {
+    return PathFind::find(path, start, end);
+  }
+
+  const int start_cluster = get_cluster(start_cell);
+  const int goal_cluster = get_cluster(goal_cell);
+  if (start_cluster == goal_cluster) {
+    // Try a path that stays within the cluster first. If there isn't one, we may still be able to get there by
+    // going out and back in again.
+    search_cluster(start_cluster, start_cell, goal_cell);
+    if (get_local_cost(start_cluster, goal_cell) < kInfiniteCost) {
+      path.push_back(fw::Vector(start_x, 0, start_z));
+      append_local_path(start_cluster, goal_cell, path);
+      stop_next_to_goal(path, first, end);
+      return true;
+    }
+  }
+
+  // Work out the cost to get from the start to each entrance of its cluster, and from each entrance of the goal's
+  // cluster to the goal.
+  Graph const &graph = *graph_;
+  Cluster const &sc = graph.clusters[start_cluster];
+  Cluster const &gc = graph.clusters[goal_cluster];
+  std::vector<float> goal_costs(gc.entrances.size());
+  search_cluster(goal_cluster, goal_cell, -1);
+  for (int i = 0; i < static_cast<int>(gc.entrances.size()); i++) {
+    goal_costs[i] = get_local_cost(goal_cluster, gc.entrances[i]);
+  }
+  std::vector<float> start_costs(sc.entrances.size());
+  search_cluster(start_cluster, start_cell, -1);
+  for (int i = 0; i < static_cast<int>(sc.entrances.size()); i++) {
+    start_costs[i] = get_local_cost(start_cluster, sc.entrances[i]);
+  }
+
+  // Now do an A* search over the abstract graph.
+  ensure_abstract_state();
+  const int start_node = get_num_abstract_nodes();
+  const int goal_node = start_node + 1;
+  start_cell_ = start_cell;
+  goal_cell_ = goal_cell;
+  abstract_run_++;
+  abstract_open_.clear();
+  abstract_cost_[start_node] = 0.0f;
+  abstract_previous_[start_node] = -1;
+  abstract_open_run_no_[start_node] = abstract_run_;
+  abstract_open_.push(start_node, estimate_cost(start_cell, goal_cell));
+
+  bool found = false;
+  while (!abstract_open_.empty()) {
+    int curr = abstract_open_.pop();
+    abstract_closed_run_no_[curr] = abstract_run_;
+    nodes_expanded_++;
+    if (curr == goal_node) {
+      found = true;
+      break;
+    }
+
+    if (curr == start_node) {
+      for (int i = 0; i < static_cast<int>(sc.entrances.size()); i++) {
+        if (start_costs[i] < kInfiniteCost) {
+          relax_abstract(curr, graph.cluster_first_node[start_cluster] + i, start_costs[i], goal_cell);
+        }
+      }
+      continue;
+    }
+
+    const int cell = graph.abstract_cell[curr];
+    const int cluster = get_cluster(cell);
+    Cluster const &c = graph.clusters[cluster];
+    const int n = static_cast<int>(c.entrances.size());
+    const int entrance = curr - graph.cluster_first_node[cluster];
+    for (int j = 0; j < n; j++) {
+      float cost = c.costs[(entrance * n) + j];
+      if (j != entrance && cost < kInfiniteCost) {
+        relax_abstract(curr, graph.cluster_first_node[cluster] + j, cost, goal_cell);
+      }
+    }
+    for (Transition const &transition : c.transitions) {
+      if (transition.from_cell == cell) {
+        int to_cluster = get_cluster(transition.to_cell);
+        int to_node = graph.cluster_first_node[to_cluster] + graph.cell_entrance[transition.to_cell];
+        relax_abstract(curr, to_node, 1.0f, goal_cell);
+      }
+    }
+    if (cluster == goal_cluster && goal_costs[entrance] < kInfiniteCost) {
+      relax_abstract(curr, goal_node, goal_costs[entrance], goal_cell);
+    }
+  }
+
+  if (!found) {
+    return false;
+  }
+
+  std::vector<int> abstract_path;
+  for (int node = goal_node; node >= 0; node = abstract_previous_[node]) {
+    abstract_path.push_back(get_abstract_cell(node));
+  }
+  std::reverse(abstract_path.begin(), abstract_path.end());
+
+  // Refine the abstract path. Each pair of nodes is either directly across a border from each other, or in the same
+  // cluster, in which case we search just that cluster for the path between them.
+  path.push_back(fw::Vector(start_x, 0, start_z));
+  for (size_t i = 1; i < abstract_path.size(); i++) {
+    int from_cell = abstract_path[i - 1];
+    int to_cell = abstract_path[i];
+    if (is_adjacent(from_cell, to_cell)) {
+      // The start or goal can be an entrance itself, and then it's in the abstract path twice in a row.
+      if (to_cell != from_cell) {
+        path.push_back(fw::Vector(to_cell % width_, 0, to_cell / width_));
+      }
+      continue;
+    }
+
+    int cluster = get_cluster(from_cell);
+    search_cluster(cluster, from_cell, to_cell);
+    append_local_path(cluster, to_cell, path);
+  }
+
+  stop_next_to_goal(path, first, end);
+  return true;
+}
+
+void HierarchicalPathFind::update_passability(fw::Rectangle<int> const &rect, std::vector<bool> const &passability) {
+  for (int z = rect.top; z < rect.bottom(); z++) {
+    for (int x = rect.left; x < rect.right(); x++) {
+      int wx = fw::constrain(x, width_);
+      int wz = fw::constrain(z, length_);
+      set_passable(wx, wz, passability[(wz * width_) + wx]);
+    }
+  }
+  update_passability(rect);
+}
+
+void HierarchicalPathFind::update_passability(fw::Rectangle<int> const &rect) {
+  // The rectangle can hang off the edge of the map, but there's no need to look at any cell twice.
+  const int right = rect.left + std::min(rect.width, width_);
+  const int bottom = rect.top + std::min(rect.height, length_);
+  std::set<int> changed_clusters;
+  for (int z = rect.top; z < bottom; z++) {
+    for (int x = rect.left; x < right; x++) {
+      int wx = fw::constrain(x, width_);
+      int wz = fw::constrain(z, length_);
+      changed_clusters.insert(get_cluster((wz * width_) + wx));
+    }
+  }
+
+  // The borders on all four sides of a changed cluster need to be rebuilt, and that changes the entrances of the
+  // neighbouring clusters as well.
+  std::set<int> rebuild_clusters;
+  for (int cluster : changed_clusters) {
+    int cluster_x = cluster % clusters_width_;
+    int cluster_z = cluster / clusters_width_;
+    int west = get_cluster_index(cluster_x - 1, cluster_z);
+    int north = get_cluster_index(cluster_x, cluster_z - 1);
+    build_border(cluster, /*east=*/true);
+    build_border(cluster, /*east=*/false);
+    build_border(west, /*east=*/true);
+    build_border(north, /*east=*/false);
+
+    rebuild_clusters.insert(cluster);
+    rebuild_clusters.insert(west);
+    rebuild_clusters.insert(north);
+    rebuild_clusters.insert(get_cluster_index(cluster_x + 1, cluster_z));
+    rebuild_clusters.insert(get_cluster_index(cluster_x, cluster_z + 1));
+  }
+
+  for (int cluster : rebuild_clusters) {
+    build_cluster(cluster);
+  }
+  update_abstract_node_ids();
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <framework/indexed_heap.h>
+#include <framework/math.h>
+#include <framework/misc.h>
+#include <framework/path_find.h>
+
+namespace fw {
+
+// HierarchicalPathFind is an implementation of HPA* ("Near Optimal Hierarchical Path-Finding", Botea et al). The grid
+// is split into square clusters, and we precompute "entrances" (pairs of passable cells on either side of a cluster
+// border) along with the cost of travelling between each pair of entrances within a cluster. A path request first
+// searches this (much smaller) abstract graph, then refines each abstract edge with a search that is bounded to a
+// single cluster. The paths are not always as short as the ones PathFind finds, but they're close, and the cost of a
+// request no longer grows with the area of the map.
+//
+// Like PathFind, this class is not thread safe. To search on multiple threads, use create_worker() to make one
+// instance per thread. Workers share the passability grid and the abstract graph, but have their own search state.
+class HierarchicalPathFind : public PathFind {
+private:
+  struct Transition;
+  struct Cluster;
+  struct Graph;
+
+  int cluster_size_;
+  int clusters_width_;
+  int clusters_length_;
+
+  // The abstract graph, which is shared between all workers.
+  std::shared_ptr<Graph> graph_;
+
+  // The start and goal of the current request are given the two abstract node IDs after the last entrance.
+  int start_cell_;
+  int goal_cell_;
+
+  // Scratch state for the abstract search.
+  std::vector<float> abstract_cost_;
+  std::vector<int> abstract_previous_;
+  std::vector<int> abstract_open_run_no_;
+  std::vector<int> abstract_closed_run_no_;
+  IndexedHeap<float> abstract_open_;
+  int abstract_run_;
+
+  // Scratch state for searches bounded to a single cluster, indexed by the cell's offset within the cluster.
+  std::vector<float> local_cost_;
+  std::vector<int> local_previous_;
+  std::vector<int> local_open_run_no_;
+  std::vector<int> local_closed_run_no_;
+  IndexedHeap<float> local_open_;
+  int local_run_;
+
+  HierarchicalPathFind(std::shared_ptr<PassabilityGrid> passability, std::shared_ptr<Graph> graph, int cluster_size);
+
+  int get_cluster(int cell) const;
+  int get_cluster_index(int cluster_x, int cluster_z) const;
+  fw::Rectangle<int> get_cluster_bounds(int cluster) const;
+  int get_local_index(int cluster, int cell) const;
+
+  void build_border(int cluster, bool east);
+  void build_cluster(int cluster);
+  void update_abstract_node_ids();
+  void ensure_abstract_state();
+  int get_abstract_cell(int node) const;
+
+  // Searches from the given cell to every other cell in the given cluster (or just to the given goal cell, if
+  // goal_cell is not -1). Afterwards, get_local_cost and append_local_path can be used to inspect the result.
+  void search_cluster(int cluster, int from_cell, int goal_cell);
+  float get_local_cost(int cluster, int cell) const;
+  void append_local_path(int cluster, int to_cell, std::vector<fw::Vector> &path) const;
+
+  void relax_abstract(int from_node, int to_node, float edge_cost, int goal_cell);
+  float estimate_cost(int from_cell, int to_cell) const;
+  bool is_adjacent(int from_cell, int to_cell) const;
+
+public:
+  // Builds the abstract graph over the given passability grid, which we share (rather than copy).
+  HierarchicalPathFind(std::shared_ptr<PassabilityGrid> passability, int cluster_size);
+  HierarchicalPathFind(int width, int length, std::vector<bool> const &passability, int cluster_size);
+  virtual ~HierarchicalPathFind();
+
+  // Like PathFind::find, the path starts at start and stops at the first cell within one of end, rather than on it.
+  bool find(std::vector<fw::Vector> &path, fw::Vector const &start, fw::Vector const &end) override;
+
+  // Creates a new HierarchicalPathFind which shares our passability grid and abstract graph, but has its own search
+  // state, so that it can be used on another thread.
+  std::shared_ptr<HierarchicalPathFind> create_worker() const;
+
+  // Updates the passability of the cells in the given rectangle (which may wrap around the edge of the map) and
+  // rebuilds the abstract graph for only the clusters that the rectangle touches, plus their immediate neighbours
+  // (whose entrances along the shared border may have changed). The passability vector covers the whole map.
+  //
+  // This modifies the state shared with our workers, so no worker may be searching while this runs. (The game never
+  // calls this: see game::Terrain::get_passability.)
+  void update_passability(fw::Rectangle<int> const &rect, std::vector<bool> const &passability);
+
+  // Like the above, but for when whoever owns the passability grid has already updated it (e.g. the terrain, when
+  // it's edited). We just rebuild the abstract graph around the given rectangle.
+  void update_passability(fw::Rectangle<int> const &rect);
+
+  inline int get_cluster_size() const {
+    return cluster_size_;
+  }
+
+  int get_num_abstract_nodes() const;
+};
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+namespace fw {
+
+// An IndexedHeap is a binary min-heap of small integer ids (e.g. indices into a grid), each with an associated key.
+// Unlike std::priority_queue, it keeps track of where each id lives in the heap, so you can lower the key of an id
+// that is already in the heap (the "decrease-key" operation A* and Dijkstra need) in O(log n) without having to
+// remove and re-insert it.
+//
+// The position table is sized once (via reset) to the maximum id, so pushing and popping never allocates once the
+// heap has grown to its working size. The heap does not track whether an id is currently in the heap or not; the
+// caller is expected to know that (e.g. with a per-node "run number" as PathFind does).
+//
+// This class is not thread-safe.
+template<typename Key, typename Compare = std::less<Key>>
+class IndexedHeap {
+public:
+  IndexedHeap() = default;
+
+  // Resizes the position table to hold ids in the range [0, max_ids) and clears the heap.
+  void reset(int max_ids) {
+    positions_.resize(max_ids);
+    entries_.clear();
+  }
+
+  // Removes all entries from the heap. Doesn't free any memory.
+  inline void clear() {
+    entries_.clear();
+  }
+
+  inline bool empty() const {
+    return entries_.empty();
+  }
+
+  inline int size() const {
+    return static_cast<int>(entries_.size());
+  }
+
+  // Returns the id with the smallest key. The heap must not be empty.
+  inline int top() const {
+    return entries_[0].id;
+  }
+
+  // Returns the key of the id with the smallest key. The heap must not be empty.
+  inline Key const &top_key() const {
+    return entries_[0].key;
+  }
+
+  // Adds the given id to the heap. The id must not already be in the heap.
+  void push(int id, Key const &key) {
+    int pos = static_cast<int>(entries_.size());
+    entries_.push_back(Entry { key, id });
+    positions_[id] = pos;
+    sift_up(pos);
+  }
+
+  // Lowers the key of an id that is already in the heap. The new key must not be larger than the current key.
+  void decrease(int id, Key const &key) {
+    int pos = positions_[id];
+    entries_[pos].key = key;
+    sift_up(pos);
+  }
+
+  // Removes and returns the id with the smallest key. The heap must not be empty.
+  int pop() {
+    int id = entries_[0].id;
+    Entry last = entries_.back();
+    entries_.pop_back();
+    if (!entries_.empty()) {
+      entries_[0] = last;
+      positions_[last.id] = 0;
+      sift_down(0);
+    }
+    return id;
+  }
+
+private:
+  struct Entry {
+    Key key;
+    int id;
+  };
+
+  std::vector<Entry> entries_;
+  std::vector<int> positions_;
+  Compare compare_;
+
+  void sift_up(int pos) {
+    Entry entry = entries_[pos];
+    while (pos > 0) {
+      int parent = (pos - 1) / 2;
+      if (!compare_(entry.key, entries_[parent].key)) {
+        break;
+      }
+      entries_[pos] = entries_[parent];
+      positions_[entries_[pos].id] = pos;
+      pos = parent;
+    }
+    entries_[pos] = entry;
+    positions_[entry.id] = pos;
+  }
+
+  void sift_down(int pos) {
+    const int count = static_cast<int>(entries_.size());
+    Entry entry = entries_[pos];
+    for (;;) {
+      int child = (pos * 2) + 1;
+      if (child >= count) {
+        break;
+      }
+      if (child + 1 < count && compare_(entries_[child + 1].key, entries_[child].key)) {
+        child++;
+      }
+      if (!compare_(entries_[child].key, entry.key)) {
+        break;
+      }
+      entries_[pos] = entries_[child];
+      positions_[entries_[pos].id] = pos;
+      pos = child;
+    }
+    entries_[pos] = entry;
+    positions_[entry.id] = pos;
+  }
+};
+
+}
@@ -0,0 +1,189 @@
+#include <framework/lockstep_scheduler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace fw::net {
+
+LockstepScheduler::LockstepScheduler() : LockstepScheduler(LockstepConfig()) {
+}
+
+LockstepScheduler::LockstepScheduler(LockstepConfig const &config) : config_(config) {
+  reset();
+}
+
+void LockstepScheduler::reset() {
+  peers_.clear();
+
+  // Nobody can have sent commands for the first max_command_delay turns, so they're always ready. That gives everybody
+  // a chance to get their first commands out, however long the turns end up being.
+  last_sent_turn_ = config_.max_command_delay;
+  turn_length_requests_.clear();
+  desired_turn_length_ms_ = config_.min_turn_length_ms;
+  turn_length_ms_ = config_.min_turn_length_ms;
+  command_delay_ = 1;
+  stalled_turn_ = 0;
+  late_arrivals_ = 0;
+  current_ = LockstepTurnStats();
+
+  std::unique_lock<std::mutex> lock(stats_mutex_);
+  stats_.clear();
+}
+
+void LockstepScheduler::add_peer(int peer_id) {
+  PeerState &peer = peers_[peer_id];
+  peer.covered_turn = config_.max_command_delay;
+  peer.turn_length_requests.clear();
+}
+
+void LockstepScheduler::set_peer_latency(int peer_id, float rtt_ms, float rtt_variance_ms) {
+  auto it = peers_.find(peer_id);
+  if (it == peers_.end()) {
+    return;
+  }
+
+  it->second.rtt_ms = rtt_ms;
+  it->second.rtt_variance_ms = rtt_variance_ms;
+}
+
+void LockstepScheduler::on_peer_commands(
+    int peer_id, uint32_t execute_turn, int num_commands, float desired_turn_length_ms) {
+  current_.commands_in += num_commands;
+
+  auto it = peers_.find(peer_id);
+  if (it == peers_.end()) {
+    return;
+  }
+
+  PeerState &peer = it->second;
+  if (stalled_turn_ != 0 && peer.covered_turn < stalled_turn_ && execute_turn >= stalled_turn_) {
+    late_arrivals_++;
+  }
+  peer.covered_turn = std::max(peer.covered_turn, execute_turn);
+  if (peer.turn_length_requests.empty() || peer.turn_length_requests.back().execute_turn < execute_turn) {
+    peer.turn_length_requests.push_back(TurnLengthRequest { execute_turn, desired_turn_length_ms });
+  }
+}
+
+bool LockstepScheduler::is_turn_ready(uint32_t turn) const {
+  for (auto const &[peer_id, peer] : peers_) {
+    if (peer.covered_turn < turn) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void LockstepScheduler::on_stall(uint32_t turn, fw::Clock::time_point now) {
+  if (stalled_turn_ != turn) {
+    stalled_turn_ = turn;
+    stall_start_ = now;
+    late_arrivals_ = 0;
+  }
+}
+
+void LockstepScheduler::begin_turn(uint32_t turn, fw::Clock::time_point now) {
+  if (current_.turn != 0) {
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    stats_.push_back(current_);
+    while (stats_.size() > config_.stats_history) {
+      stats_.pop_front();
+    }
+  }
+
+  update_timing(turn);
+
+  current_ = LockstepTurnStats();
+  current_.turn = turn;
+  current_.turn_length_ms = turn_length_ms_;
+  current_.command_delay = command_delay_;
+  if (stalled_turn_ == turn) {
+    current_.stall_ms = std::chrono::duration<float, std::milli>(now - stall_start_).count();
+    current_.late_arrivals = late_arrivals_;
+  }
+  stalled_turn_ = 0;
+  late_arrivals_ = 0;
+}
+
+void LockstepScheduler::update_timing(uint32_t turn) {
+  if (peers_.empty()) {
+    desired_turn_length_ms_ = config_.min_turn_length_ms;
+    turn_length_ms_ = round_turn_length(config_.min_turn_length_ms);
+    command_delay_ = 1;
+    return;
+  }
+
+  // Everybody has to run at the speed of the slowest, so the turn is as long as the longest anybody asked for. Nobody
+  // can have sent commands for the first max_command_delay turns (see reset()), so they're as short as they can be.
+  turn_length_ms_ = round_turn_length(config_.min_turn_length_ms);
+  if (turn > static_cast<uint32_t>(config_.max_command_delay)) {
+    turn_length_ms_ = std::max(turn_length_ms_, get_requested_turn_length(turn_length_requests_, turn));
+    for (auto &[peer_id, peer] : peers_) {
+      turn_length_ms_ = std::max(turn_length_ms_, get_requested_turn_length(peer.turn_length_requests, turn));
+    }
+  }
+
+  // The time it takes our commands to get to the slowest peer.
+  float required_ms = 0.0f;
+  for (auto const &[peer_id, peer] : peers_) {
+    required_ms = std::max(
+        required_ms, peer.rtt_ms * 0.5f + peer.rtt_variance_ms * config_.jitter_factor + config_.margin_ms);
+  }
+
+  // We'd like to spread the delivery time over as many turns as we can, so each turn is as short as it can be. We
+  // don't jump straight there, though.
+  const float target_ms = std::clamp(
+      required_ms / config_.max_command_delay, config_.min_turn_length_ms, config_.max_turn_length_ms);
+  desired_turn_length_ms_ += (target_ms - desired_turn_length_ms_) * config_.smoothing;
+
+  command_delay_ = std::clamp(
+      static_cast<int>(std::ceil(required_ms / turn_length_ms_)), 1, config_.max_command_delay);
+}
+
+float LockstepScheduler::get_requested_turn_length(std::deque<TurnLengthRequest> &requests, uint32_t turn) {
+  while (!requests.empty() && requests.front().execute_turn < turn) {
+    requests.pop_front();
+  }
+
+  // Requests arrive in order, and we don't start a turn until everybody's sent their commands for it, so the request
+  // for this turn has always turned up by now.
+  if (requests.empty()) {
+    return 0.0f;
+  }
+  return round_turn_length(requests.front().turn_length_ms);
+}
+
+float LockstepScheduler::round_turn_length(float turn_length_ms) const {
+  const float min_frames = std::ceil(config_.min_turn_length_ms / config_.frame_ms);
+  const float max_frames = std::max(std::floor(config_.max_turn_length_ms / config_.frame_ms), min_frames);
+  return std::clamp(std::round(turn_length_ms / config_.frame_ms), min_frames, max_frames) * config_.frame_ms;
+}
+
+uint32_t LockstepScheduler::get_execute_turn(uint32_t turn) {
+  const uint32_t execute_turn = turn + command_delay_;
+  if (execute_turn <= last_sent_turn_) {
+    return 0;
+  }
+
+  last_sent_turn_ = execute_turn;
+  turn_length_requests_.push_back(TurnLengthRequest { execute_turn, get_desired_turn_length() });
+  return execute_turn;
+}
+
+std::vector<LockstepTurnStats> LockstepScheduler::get_stats() const {
+  std::unique_lock<std::mutex> lock(stats_mutex_);
+  return std::vector<LockstepTurnStats>(stats_.begin(), stats_.end());
+}
+
+std::optional<LockstepTurnStats> LockstepScheduler::get_turn_stats(uint32_t turn) const {
+  std::unique_lock<std::mutex> lock(stats_mutex_);
+  for (LockstepTurnStats const &stats : stats_) {
+    if (stats.turn == turn) {
+      return stats;
+    }
+  }
+  return std::nullopt;
+}
+
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <framework/timer.h>
+
+namespace fw::net {
+
+// The knobs for a LockstepScheduler. The defaults are fine for the game, the bench plays with them.
+struct LockstepConfig {
+  // The shortest and longest we'll let a turn be.
+  float min_turn_length_ms = 50.0f;
+  float max_turn_length_ms = 400.0f;
+
+  // Turns are always a whole number of frames of this length (the Framework updates 40 times a second), so that every
+  // peer runs exactly the same frames of the simulation between one turn and the next. Peers send each other turn
+  // lengths in whole milliseconds, so this must be a whole number of milliseconds as well.
+  float frame_ms = 25.0f;
+
+  // The most turns in the future we'll schedule a command for. More turns means shorter turns (so the simulation's
+  // smoother), but each turn costs a packet to every peer.
+  int max_command_delay = 4;
+
+  // How long we reckon a packet takes to get to a peer: half the round-trip time, plus this many times the variance
+  // in the round-trip time, plus a fixed margin for the time it spends waiting for each end's turn loop.
+  float jitter_factor = 2.0f;
+  float margin_ms = 10.0f;
+
+  // The fraction of the difference between the turn length we'd like and the one our round-trip times call for that
+  // we close every turn, so the turn length changes smoothly rather than jumping around with every ping.
+  float smoothing = 0.1f;
+
+  // The number of turns we keep stats for.
+  std::size_t stats_history = 256;
+};
+
+// What happened during one turn of the simulation.
+struct LockstepTurnStats {
+  uint32_t turn = 0;
+
+  // The number of commands we got from our peers during this turn (for whatever turn they're due on).
+  int commands_in = 0;
+
+  // The number of peers whose commands for this turn only turned up after we wanted to start it.
+  int late_arrivals = 0;
+
+  // How long we waited for those late commands before we could start the turn.
+  float stall_ms = 0.0f;
+
+  float turn_length_ms = 0.0f;
+  int command_delay = 0;
+};
+
+// Decides how long each turn of a lockstep simulation should be, and how many turns in the future the commands we
+// post should execute, based on the round-trip times to our peers. Each peer tells us (with its commands) the last
+// turn it's sent us commands for, and we don't start a turn until every peer has: that's what keeps everybody in
+// lockstep, the turn length and command delay are what keep it from stalling.
+//
+// The length of a turn decides how many frames of the simulation run in it, so every peer has to agree on it. Each
+// peer sends the turn length it would like along with its commands, and a turn is as long as the longest of the
+// lengths that came with the commands for it. Every peer has all of those by the time it can start the turn, so they
+// all come to the same answer.
+//
+// Turns are numbered from 1 after reset(). Everything except get_stats() must be called from the simulation thread.
+class LockstepScheduler {
+private:
+  // The turn length that a peer (or we) sent along with the commands for execute_turn. That's the length it wants for
+  // every turn after the commands it sent before these, up to and including execute_turn.
+  struct TurnLengthRequest {
+    uint32_t execute_turn;
+    float turn_length_ms;
+  };
+
+  struct PeerState {
+    float rtt_ms = 0.0f;
+    float rtt_variance_ms = 0.0f;
+    std::deque<TurnLengthRequest> turn_length_requests;
+
+    // The last turn this peer has sent us commands for.
+    uint32_t covered_turn = 0;
+  };
+
+  LockstepConfig config_;
+  std::map<int, PeerState> peers_;
+
+  // The last turn we've told our peers about, and the turn lengths we sent them.
+  uint32_t last_sent_turn_;
+  std::deque<TurnLengthRequest> turn_length_requests_;
+
+  // The turn length we'd like, before it's rounded to a whole number of frames.
+  float desired_turn_length_ms_;
+  float turn_length_ms_;
+  int command_delay_;
+
+  // The turn we're currently waiting on our peers for (zero if we're not), and when we started waiting.
+  uint32_t stalled_turn_;
+  fw::Clock::time_point stall_start_;
+  int late_arrivals_;
+
+  LockstepTurnStats current_;
+  mutable std::mutex stats_mutex_;
+  std::deque<LockstepTurnStats> stats_;
+
+  // Works out the length of the given turn from what everybody asked for, and the command delay and the turn length
+  // we'd like from our peers' latest round-trip times.
+  void update_timing(uint32_t turn);
+
+  // Gets the turn length the given requests ask for the given turn, forgetting the ones for earlier turns.
+  float get_requested_turn_length(std::deque<TurnLengthRequest> &requests, uint32_t turn);
+
+  // Rounds the given turn length to a whole number of frames, between the shortest and longest turns we allow.
+  float round_turn_length(float turn_length_ms) const;
+
+public:
+  LockstepScheduler();
+  explicit LockstepScheduler(LockstepConfig const &config);
+
+  // Starts again from the first turn (i.e. at the start of a game), forgetting our peers and stats.
+  void reset();
+
+  // Adds a peer that we'll wait for before we start each turn.
+  void add_peer(int peer_id);
+
+  // Updates our idea of the round-trip time to the given peer. For an fw::net::Peer, this is what ENet measures.
+  void set_peer_latency(int peer_id, float rtt_ms, float rtt_variance_ms);
+
+  // Called when we get commands from a peer: they're for execute_turn, and the peer has nothing else for us before
+  // then. desired_turn_length_ms is the turn length the peer would like (its get_desired_turn_length()) for the turns
+  // up to execute_turn.
+  void on_peer_commands(int peer_id, uint32_t execute_turn, int num_commands, float desired_turn_length_ms);
+
+  // Returns true if every peer has sent us its commands for the given turn, so we can go ahead and run it.
+  bool is_turn_ready(uint32_t turn) const;
+
+  // Called when we'd like to start the given turn, but it's not ready.
+  void on_stall(uint32_t turn, fw::Clock::time_point now);
+
+  // Called when we start the given turn. This is where we adjust the turn length and command delay.
+  void begin_turn(uint32_t turn, fw::Clock::time_point now);
+
+  // Gets the turn that commands we post during the given turn should execute on. This is usually turn + the command
+  // delay, but never earlier than a turn we've already told our peers about. Returns zero if the delay has come down
+  // and we've already told them about turn + delay: hang onto the commands until next turn. Otherwise, we remember
+  // that we're asking for get_desired_turn_length() up to the turn we return, so send them that with the commands.
+  uint32_t get_execute_turn(uint32_t turn);
+
+  // The length the current turn should be. This is the same on every peer, and always a whole number of frames.
+  float get_turn_length() const {
+    return turn_length_ms_;
+  }
+
+  // The number of frames of the simulation to run in the current turn.
+  int get_turn_frames() const {
+    return static_cast<int>(std::lround(turn_length_ms_ / config_.frame_ms));
+  }
+
+  // The length we'd like turns to be, based only on our own round-trip times, in a whole number of frames. This is
+  // what we tell our peers, the turn length we actually use is the longest of ours and theirs.
+  float get_desired_turn_length() const {
+    return round_turn_length(desired_turn_length_ms_);
+  }
+
+  int get_command_delay() const {
+    return command_delay_;
+  }
+
+  // Gets the stats for the last LockstepConfig::stats_history turns, oldest first. Unlike everything else, this is
+  // safe to call from any thread.
+  std::vector<LockstepTurnStats> get_stats() const;
+
+  // Gets the stats for the given turn, if we've still got them.
+  std::optional<LockstepTurnStats> get_turn_stats(uint32_t turn) const;
+};
+
+}
@@ -0,0 +1,176 @@
+#include <framework/lz4.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace fw {
+namespace {
+
+// The smallest match the format can encode.
+const size_t MIN_MATCH = 4;
+
+// The last five bytes of a block are always literals, and the last match has to start at least 12 bytes before the
+// end of the block.
+const size_t LAST_LITERALS = 5;
+const size_t MF_LIMIT = 12;
+
+// Matches can be at most this far back.
+const size_t MAX_OFFSET = 65535;
+
+const int HASH_BITS = 14;
+
+inline uint32_t read32(uint8_t const *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint32_t hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Writes a length that didn't fit in the token's four bits: as many 255s as it takes and then the remainder.
+void write_length(std::vector<uint8_t> &out, size_t length) {
+  while (length >= 255) {
+    out.push_back(255);
+    length -= 255;
+  }
+  out.push_back(static_cast<uint8_t>(length));
+}
+
+void write_sequence(
+    std::vector<uint8_t> &out, uint8_t const *literals, size_t num_literals, size_t offset, size_t match_length) {
+  uint8_t token = static_cast<uint8_t>(std::min<size_t>(num_literals, 15) << 4);
+  if (match_length > 0) {
+    token |= static_cast<uint8_t>(std::min<size_t>(match_length - MIN_MATCH, 15));
+  }
+  out.push_back(token);
+  if (num_literals >= 15) {
+    write_length(out, num_literals - 15);
+  }
+  out.insert(out.end(), literals, literals + num_literals);
+
+  if (match_length > 0) {
+    out.push_back(static_cast<uint8_t>(offset & 0xff));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (match_length - MIN_MATCH >= 15) {
+      write_length(out, match_length - MIN_MATCH - 15);
+    }
+  }
+}
+
+// Reads a length that didn't fit in the token's four bits. Returns false if we run off the end of the block.
+bool read_length(std::span<uint8_t const> block, size_t &pos, size_t &length) {
+  while (true) {
+    if (pos >= block.size()) {
+      return false;
+    }
+    const uint8_t n = block[pos++];
+    length += n;
+    if (n != 255) {
+      return true;
+    }
+  }
+}
+
+}
+
+std::vector<uint8_t> Lz4Compress(std::span<uint8_t const> data) {
+  std::vector<uint8_t> out;
+  out.reserve(data.size() + data.size() / 255 + 16);
+
+  uint8_t const *input = data.data();
+  const size_t size = data.size();
+  size_t anchor = 0;
+  if (size >= MF_LIMIT + 1) {
+    std::vector<int32_t> table(1 << HASH_BITS, -1);
+    const size_t match_limit = size - LAST_LITERALS;
+    size_t pos = 0;
+    while (pos + MF_LIMIT <= size) {
+      const uint32_t sequence = read32(input + pos);
+      const uint32_t h = hash(sequence);
+      const int32_t candidate = table[h];
+      table[h] = static_cast<int32_t>(pos);
+      if (candidate < 0 || pos - candidate > MAX_OFFSET || read32(input + candidate) != sequence) {
+        pos++;
+        continue;
+      }
+
+      size_t match_length = MIN_MATCH;
+      while (pos + match_length < match_limit && input[candidate + match_length] == input[pos + match_length]) {
+        match_length++;
+      }
+      write_sequence(out, input + anchor, pos - anchor, pos - candidate, match_length);
+      pos += match_length;
+      anchor = pos;
+    }
+  }
+
+  // Whatever's left over is literals.
+  write_sequence(out, input + anchor, size - anchor, 0, 0);
+  return out;
+}
+
+fw::Status Lz4Decompress(std::span<uint8_t const> block, std::span<uint8_t> output) {
+  size_t in = 0;
+  size_t out = 0;
+  while (true) {
+    if (in >= block.size()) {
+      return fw::ErrorStatus("lz4 block is truncated");
+    }
+    const uint8_t token = block[in++];
+
+    size_t num_literals = token >> 4;
+    if (num_literals == 15 && !read_length(block, in, num_literals)) {
+      return fw::ErrorStatus("lz4 block is truncated");
+    }
+    if (num_literals > block.size() - in || num_literals > output.size() - out) {
+      return fw::ErrorStatus("lz4 literals run past the end of the block");
+    }
+    if (num_literals > 0) {
+      memcpy(output.data() + out, block.data() + in, num_literals);
+    }
+    in += num_literals;
+    out += num_literals;
+
+    // The last sequence is just literals.
+    if (in == block.size()) {
+      break;
+    }
+
+    if (block.size() - in < 2) {
+      return fw::ErrorStatus("lz4 block is truncated");
+    }
+    const size_t offset = block[in] | (block[in + 1] << 8);
+    in += 2;
+    if (offset == 0 || offset > out) {
+      return fw::ErrorStatus("lz4 match offset is invalid: ") << offset;
+    }
+
+    size_t match_length = token & 0x0f;
+    if (match_length == 15 && !read_length(block, in, match_length)) {
+      return fw::ErrorStatus("lz4 block is truncated");
+    }
+    match_length += MIN_MATCH;
+    if (match_length > output.size() - out) {
+      return fw::ErrorStatus("lz4 match runs past the end of the output");
+    }
+
+    // The match can overlap what we're writing (e.g. a run of zeros is a literal zero and then a match with an offset
+    // of one), so we copy it in pieces that never overlap, each one twice as big as the last.
+    const size_t from = out - offset;
+    while (match_length > 0) {
+      const size_t n = std::min(match_length, out - from);
+      memcpy(output.data() + out, output.data() + from, n);
+      out += n;
+      match_length -= n;
+    }
+  }
+
+  if (out != output.size()) {
+    return fw::ErrorStatus("lz4 block decompressed to ") << out << " bytes, expected " << output.size();
+  }
+  return fw::OkStatus();
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <framework/status.h>
+
+namespace fw {
+
+// A small implementation of the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), so
+// that we can compress things like map files without pulling in another library. Blocks we write can be read by the
+// reference implementation and vice versa. The compressor is a simple greedy one, it's not as quick (or as good) as
+// the reference implementation, but decompressing is what we care about and that's just as quick.
+
+// Compresses the given data into a single LZ4 block. The block doesn't record how big the data was, so you need to
+// keep track of that yourself.
+std::vector<uint8_t> Lz4Compress(std::span<uint8_t const> data);
+
+// Decompresses the given LZ4 block into output, which must be exactly the size of the original data. Returns an
+// error if the block is corrupt (we never read or write outside of the given spans).
+fw::Status Lz4Decompress(std::span<uint8_t const> block, std::span<uint8_t> output);
+
+}
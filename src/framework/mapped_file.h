@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+#include <framework/status.h>
+
+namespace fw {
+
+// A read-only view of a whole file, mapped into memory. The operating system pages the file in as we touch it, so
+// there's no reading into buffers: you can use the data right where it is. See arch/*/mapped_file.cc for the
+// platform-specific bits.
+class MappedFile {
+private:
+  uint8_t const *data_;
+  size_t size_;
+
+  MappedFile();
+
+public:
+  ~MappedFile();
+
+  MappedFile(MappedFile const &) = delete;
+  MappedFile &operator=(MappedFile const &) = delete;
+
+  // Maps the whole of the given file.
+  static fw::StatusOr<std::unique_ptr<MappedFile>> open(std::filesystem::path const &path);
+
+  uint8_t const *get_data() const {
+    return data_;
+  }
+  size_t get_size() const {
+    return size_;
+  }
+  std::span<uint8_t const> get_span() const {
+    return std::span<uint8_t const>(data_, size_);
+  }
+};
+
+}
@@ -1,5 +1,6 @@
 
 #include <random>
+#include <sstream>
 #include <math.h>
 
 #include <framework/math.h>
@@ -78,6 +79,27 @@ void random_initialize() {
   rng.seed(rd());
 }
 
+void random_initialize(uint32_t seed) {
+  rng.seed(seed);
+}
+
+std::string random_save_state() {
+  std::ostringstream outs;
+  outs << rng;
+  return outs.str();
+}
+
+fw::Status random_restore_state(std::string const &state) {
+  std::istringstream ins(state);
+  std::mt19937 restored;
+  ins >> restored;
+  if (!ins) {
+    return fw::ErrorStatus("invalid random number generator state");
+  }
+  rng = restored;
+  return fw::OkStatus();
+}
+
 fw::Vector get_direction_to(fw::Vector const &from, fw::Vector const &to,
     float wrap_x, float wrap_z) {
   fw::Vector dir = to - from;
@@ -5,6 +5,7 @@
 #include <absl/strings/ascii.h>
 
 #include <framework/math.h>
+#include <framework/status.h>
 
 namespace fw {
 
@@ -106,6 +107,15 @@ float random();
 // Seeds our Random number generator with a value based on current time. Call on app startup.
 void random_initialize();
 
+// Seeds our Random number generator with the given value, e.g. so that a replay sees the same numbers as the game it
+// was recorded from.
+void random_initialize(uint32_t seed);
+
+// Gets the complete state of our random number generator, and puts it back. Snapshots save this, so a game that's
+// restored from one sees the same numbers as the game it was taken from.
+std::string random_save_state();
+fw::Status random_restore_state(std::string const &state);
+
 // these are used to calculate distances and directions in a world that wraps
 fw::Vector get_direction_to(fw::Vector const &from, fw::Vector const &to,
     float wrap_x, float wrap_z);
@@ -189,6 +199,22 @@ public:
 
     return Rectangle(x5, y5, x6-x5, y6-y5);
   }
+
+  /** Returns the smallest Rectangle that contains both of the given ones. An empty Rectangle doesn't count. */
+  static inline Rectangle bounding(Rectangle const &one, Rectangle const &two) {
+    if (one.width <= 0 || one.height <= 0) {
+      return two;
+    }
+    if (two.width <= 0 || two.height <= 0) {
+      return one;
+    }
+
+    const T x1 = min(one.left, two.left);
+    const T x2 = max(one.right(), two.right());
+    const T y1 = min(one.top, two.top);
+    const T y2 = max(one.bottom(), two.bottom());
+    return Rectangle(x1, y1, x2-x1, y2-y1);
+  }
 };
 
 }
@@ -24,9 +24,39 @@ void destroy() {
   enet_deinitialize();
 }
 
+// ENet calls this when it's finished with a packet we created over a PacketStorage, so we can put the storage back
+// in its arena.
+static void free_packet_storage(ENetPacket *packet) {
+  PacketStorage *storage = static_cast<PacketStorage *>(packet->userData);
+  storage->arena->release(std::unique_ptr<PacketStorage>(storage));
+}
+
+ENetPacket *SharedPacket::create_enet_packet(Packet &pkt, uint8_t wire_version) {
+  PacketBuffer buff(pkt.get_identifier(), wire_version);
+  pkt.serialize(buff);
+
+  // ENet doesn't copy the data with ENET_PACKET_FLAG_NO_ALLOCATE, it just points at our storage. The storage belongs
+  // to the packet now, and goes back to the arena when ENet destroys it.
+  enet_uint32 flags = ENET_PACKET_FLAG_NO_ALLOCATE;
+  if (pkt.is_essential()) {
+    flags |= ENET_PACKET_FLAG_RELIABLE;
+  }
+
+  std::unique_ptr<PacketStorage> storage = buff.take_storage();
+  ENetPacket *packet = enet_packet_create(storage->bytes.data(), storage->bytes.size(), flags);
+  if (packet == nullptr) {
+    LOG(ERR) << "error creating packet of " << storage->bytes.size() << " bytes";
+    return nullptr;
+  }
+  packet->userData = storage.release();
+  packet->freeCallback = &free_packet_storage;
+  return packet;
+}
+
 //-------------------------------------------------------------------------
 Peer::Peer(Host *host, ENetPeer *peer, bool connected) :
-    host_(host), peer_(peer), connected_(connected) {
+    host_(host), peer_(peer), connected_(connected), wire_version_(kWireVersionFixed), packets_sent_(0),
+    bytes_sent_(0) {
 }
 
 Peer::~Peer() {
@@ -36,16 +66,27 @@ Peer::~Peer() {
 }
 
 void Peer::send(Packet &pkt, int channel /*= 0*/) {
-  PacketBuffer buff(pkt.get_identifier());
-  pkt.serialize(buff);
+  ENetPacket *packet = SharedPacket::create_enet_packet(pkt, wire_version_);
+  if (packet != nullptr && !send_enet_packet(packet, channel)) {
+    enet_packet_destroy(packet);
+  }
+}
 
-  enet_uint32 flags = 0;
-  if (pkt.is_essential()) {
-    flags |= ENET_PACKET_FLAG_RELIABLE;
+void Peer::send(SharedPacket &pkt, int channel /*= 0*/) {
+  // The SharedPacket holds its own reference to the packet, so it's still there if ENet doesn't take it.
+  ENetPacket *packet = pkt.get_packet(wire_version_);
+  if (packet != nullptr) {
+    send_enet_packet(packet, channel);
   }
+}
 
-  ENetPacket *Packet = enet_packet_create(buff.get_buffer(), buff.get_size(), flags);
-  enet_peer_send(peer_, static_cast<enet_uint8>(channel), Packet);
+bool Peer::send_enet_packet(ENetPacket *packet, int channel) {
+  if (enet_peer_send(peer_, static_cast<enet_uint8>(channel), packet) != 0) {
+    return false;
+  }
+  packets_sent_++;
+  bytes_sent_ += packet->dataLength;
+  return true;
 }
 
 void Peer::on_connect() {
@@ -57,10 +98,19 @@ void Peer::on_receive(ENetPacket *Packet, enet_uint8 /*channel*/) {
   LOG(INFO) << "packet received from " << peer_->address.host << ":" << peer_->address.port;
 
   if (handler_) {
-    PacketBuffer buff(reinterpret_cast<char *>(Packet->data), Packet->dataLength);
-    std::shared_ptr<net::Packet> pkt(create_packet(buff));
-    pkt->deserialize(buff);
-    handler_(pkt);
+    // The buffer reads straight out of the ENet packet, which Host::update destroys once we return.
+    PacketBuffer buff(Packet->data, Packet->dataLength);
+    auto pkt = create_packet(buff);
+    if (!pkt.ok()) {
+      LOG(WARN) << "dropping packet: " << pkt.status();
+      return;
+    }
+    fw::Status status = (*pkt)->deserialize(buff);
+    if (!status.ok()) {
+      LOG(WARN) << "dropping malformed packet " << buff.get_packet_type() << ": " << status;
+      return;
+    }
+    handler_(*pkt);
   }
 }
 
@@ -172,6 +222,20 @@ void Host::update() {
   }
 }
 
+void Host::flush() {
+  if (host_ != nullptr) {
+    enet_host_flush(host_);
+  }
+}
+
+uint64_t Host::get_datagrams_sent() const {
+  return host_ == nullptr ? 0 : host_->totalSentPackets;
+}
+
+uint64_t Host::get_bytes_sent() const {
+  return host_ == nullptr ? 0 : host_->totalSentData;
+}
+
 fw::Status Host::try_listen(int port) {
   ENetAddress addr;
   addr.host = ENET_HOST_ANY;
@@ -202,4 +266,38 @@ std::vector<std::shared_ptr<Peer>> Host::get_new_connections() {
   return new_conns;
 }
 
+//-------------------------------------------------------------------------
+
+SharedPacket::SharedPacket(Packet &pkt) : pkt_(pkt) {
+  for (ENetPacket *&packet : packets_) {
+    packet = nullptr;
+  }
+}
+
+SharedPacket::~SharedPacket() {
+  // Let go of our reference. If nobody sent it (or ENet has already finished with it), that's the last one. Otherwise,
+  // ENet destroys it once it's finished sending it.
+  for (ENetPacket *packet : packets_) {
+    if (packet != nullptr && --packet->referenceCount == 0) {
+      enet_packet_destroy(packet);
+    }
+  }
+}
+
+ENetPacket *SharedPacket::get_packet(uint8_t wire_version) {
+  if (wire_version > kMaxWireVersion) {
+    return nullptr;
+  }
+  if (packets_[wire_version] == nullptr) {
+    packets_[wire_version] = create_enet_packet(pkt_, wire_version);
+
+    // ENet destroys a packet as soon as it's not referenced by anything it's sending, which could happen before we're
+    // finished handing it out (or before we're destroyed). So we hold a reference of our own until then.
+    if (packets_[wire_version] != nullptr) {
+      packets_[wire_version]->referenceCount++;
+    }
+  }
+  return packets_[wire_version];
+}
+
 }
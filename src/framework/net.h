@@ -12,6 +12,7 @@
 namespace fw {
 namespace net {
 class Peer;
+class SharedPacket;
 
 // The Framework automatically calls fw::net::initialize() and fw::net::destroy() to ensure we're
 // all ready to go.
@@ -35,6 +36,17 @@ public:
   /** This should be called frequently (e.g. every frame) to ensure we're up to date. */
   virtual void update();
 
+  /**
+   * Sends everything we've queued for our peers now, rather than waiting for the next update(). ENet packs whatever's
+   * queued for a peer into as few datagrams as it can, so it's best to queue everything you've got (e.g. a whole
+   * turn's worth) and then flush once.
+   */
+  void flush();
+
+  /** The number of UDP datagrams (and bytes) we've sent to all of our peers. */
+  uint64_t get_datagrams_sent() const;
+  uint64_t get_bytes_sent() const;
+
   /**
    * Gets a vector of all the new connections that we've had since your last call to
    * get_new_connections()/
@@ -70,21 +82,85 @@ public:
   /** Sends the given Packet to this Peer. */
   void send(Packet &pkt, int channel = 0);
 
+  /** Sends a Packet that's shared with other peers, see SharedPacket. */
+  void send(SharedPacket &pkt, int channel = 0);
+
+  /** The number of packets (and bytes) we've sent to this Peer. */
+  uint64_t get_packets_sent() const {
+    return packets_sent_;
+  }
+  uint64_t get_bytes_sent() const {
+    return bytes_sent_;
+  }
+
   bool is_connected() const {
     return connected_;
   }
+
+  /**
+   * Gets or sets the wire version we use for the packets we send to this Peer. This starts off as kWireVersionFixed
+   * (which everybody understands), and is raised once the handshake has found a newer one we both support. Incoming
+   * packets say which version they're in, so this only affects what we send.
+   */
+  void set_wire_version(uint8_t wire_version) {
+    wire_version_ = wire_version;
+  }
+  uint8_t get_wire_version() const {
+    return wire_version_;
+  }
+
+  /** The round-trip time to this Peer (and how much it varies) in milliseconds, as ENet measures it. */
+  float get_round_trip_time() const {
+    return peer_ == nullptr ? 0.0f : static_cast<float>(peer_->roundTripTime);
+  }
+  float get_round_trip_time_variance() const {
+    return peer_ == nullptr ? 0.0f : static_cast<float>(peer_->roundTripTimeVariance);
+  }
 protected:
   friend class Host;
 
   Host *host_;
   ENetPeer *peer_;
   bool connected_;
+  uint8_t wire_version_;
+  uint64_t packets_sent_;
+  uint64_t bytes_sent_;
 
   std::function<void(std::shared_ptr<Packet> const &)> handler_;
 
+  // Queues the given packet with ENet, and returns false if it wouldn't take it.
+  bool send_enet_packet(ENetPacket *packet, int channel);
+
   virtual void on_connect();
   virtual void on_receive(ENetPacket *Packet, enet_uint8 channel);
   virtual void on_disconnect();
 };
+
+/**
+ * A Packet that's serialized once and then sent to any number of peers (e.g. the commands we send to everybody at the
+ * end of each turn). ENet reference-counts the packet, so every Peer's send shares the same bytes. We hold a reference
+ * of our own as well, so it doesn't matter when ENet finishes with it. Peers can be on different wire versions, so
+ * it's serialized (at most) once for each version that's actually sent.
+ *
+ * The Packet must outlive the SharedPacket, and mustn't change once it's been sent to anybody.
+ */
+class SharedPacket {
+public:
+  explicit SharedPacket(Packet &pkt);
+  SharedPacket(const SharedPacket&) = delete;
+  SharedPacket& operator=(const SharedPacket&) = delete;
+  ~SharedPacket();
+
+private:
+  friend class Peer;
+
+  Packet &pkt_;
+  ENetPacket *packets_[kMaxWireVersion + 1];
+
+  ENetPacket *get_packet(uint8_t wire_version);
+
+  // Serializes the given packet into a new ENetPacket. Peer::send uses this for packets that aren't shared.
+  static ENetPacket *create_enet_packet(Packet &pkt, uint8_t wire_version);
+};
 }
 }
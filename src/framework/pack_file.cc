@@ -0,0 +1,204 @@
+#include <framework/pack_file.h>
+
+#include <cstring>
+#include <fstream>
+
+#include <framework/lz4.h>
+
+namespace fs = std::filesystem;
+
+namespace fw {
+namespace {
+
+uint64_t align(uint64_t offset) {
+  return (offset + kPackAlignment - 1) & ~(kPackAlignment - 1);
+}
+
+}
+
+PackReader::PackReader() {
+}
+
+PackReader::~PackReader() {
+}
+
+bool PackReader::is_pack_file(fs::path const &path) {
+  std::ifstream ins(path, std::ios::binary);
+  uint32_t magic = 0;
+  ins.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  return ins && magic == kPackMagic;
+}
+
+fw::StatusOr<std::unique_ptr<PackReader>> PackReader::open(fs::path const &path) {
+  std::unique_ptr<PackReader> reader(new PackReader());
+  ASSIGN_OR_RETURN(reader->file_, MappedFile::open(path));
+
+  uint8_t const *data = reader->file_->get_data();
+  const uint64_t file_size = reader->file_->get_size();
+  PackHeader header;
+  if (file_size < sizeof(header)) {
+    return fw::ErrorStatus("not a pack file: ") << path.string();
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != kPackMagic) {
+    return fw::ErrorStatus("not a pack file: ") << path.string();
+  }
+  if (header.version != kPackVersion) {
+    return fw::ErrorStatus("unknown pack file version: ") << header.version;
+  }
+  if (header.num_entries > (file_size - sizeof(header)) / sizeof(PackTocEntry)) {
+    return fw::ErrorStatus("pack file is truncated: ") << path.string();
+  }
+
+  for (uint32_t i = 0; i < header.num_entries; i++) {
+    PackTocEntry toc_entry;
+    memcpy(&toc_entry, data + sizeof(header) + i * sizeof(PackTocEntry), sizeof(toc_entry));
+    if (toc_entry.name[kPackMaxNameLength] != '\0') {
+      return fw::ErrorStatus("pack file entry ") << i << " has an invalid name";
+    }
+    if (toc_entry.offset % kPackAlignment != 0 || toc_entry.offset > file_size
+        || toc_entry.stored_size > file_size - toc_entry.offset) {
+      return fw::ErrorStatus("pack file entry ") << toc_entry.name << " is outside the file";
+    }
+    if (toc_entry.compression == PackCompression::kNone) {
+      if (toc_entry.size != toc_entry.stored_size) {
+        return fw::ErrorStatus("pack file entry ") << toc_entry.name << " has the wrong size";
+      }
+    } else if (toc_entry.compression != PackCompression::kLz4) {
+      return fw::ErrorStatus("pack file entry ") << toc_entry.name << " has unknown compression "
+          << static_cast<uint32_t>(toc_entry.compression);
+    }
+
+    Entry entry;
+    entry.offset = toc_entry.offset;
+    entry.stored_size = toc_entry.stored_size;
+    entry.size = toc_entry.size;
+    entry.compression = toc_entry.compression;
+    reader->entries_[toc_entry.name] = entry;
+  }
+
+  return reader;
+}
+
+fw::StatusOr<PackReader::Entry> PackReader::get_entry(std::string_view name) const {
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    return fw::ErrorStatus("no such entry in pack file: ") << std::string(name);
+  }
+  return it->second;
+}
+
+bool PackReader::has_entry(std::string_view name) const {
+  return entries_.find(name) != entries_.end();
+}
+
+std::vector<std::string> PackReader::get_entry_names() const {
+  std::vector<std::string> names;
+  for (auto const &it : entries_) {
+    names.push_back(it.first);
+  }
+  return names;
+}
+
+fw::StatusOr<std::span<uint8_t const>> PackReader::get_entry_data(std::string_view name) const {
+  ASSIGN_OR_RETURN(Entry entry, get_entry(name));
+  if (entry.compression != PackCompression::kNone) {
+    return fw::ErrorStatus("pack file entry is compressed: ") << std::string(name);
+  }
+  return std::span<uint8_t const>(file_->get_data() + entry.offset, entry.stored_size);
+}
+
+fw::StatusOr<std::vector<uint8_t>> PackReader::read_entry(std::string_view name) const {
+  ASSIGN_OR_RETURN(Entry entry, get_entry(name));
+  std::span<uint8_t const> stored(file_->get_data() + entry.offset, entry.stored_size);
+  if (entry.compression == PackCompression::kNone) {
+    return std::vector<uint8_t>(stored.begin(), stored.end());
+  }
+
+  std::vector<uint8_t> data(entry.size);
+  auto status = Lz4Decompress(stored, data);
+  if (!status.ok()) {
+    return fw::ErrorStatus("error decompressing ") << std::string(name) << ": " << status.message();
+  }
+  return data;
+}
+
+//-----------------------------------------------------------------------------
+
+void PackWriter::add(std::string_view name, std::span<uint8_t const> data, PackCompression compression) {
+  Entry entry;
+  entry.name = std::string(name);
+  entry.size = data.size();
+  entry.compression = PackCompression::kNone;
+  if (compression == PackCompression::kLz4) {
+    entry.data = Lz4Compress(data);
+    if (entry.data.size() < data.size()) {
+      entry.compression = PackCompression::kLz4;
+    }
+  }
+  if (entry.compression == PackCompression::kNone) {
+    entry.data.assign(data.begin(), data.end());
+  }
+  entries_.push_back(std::move(entry));
+}
+
+fw::Status PackWriter::write(fs::path const &path) const {
+  PackHeader header;
+  header.magic = kPackMagic;
+  header.version = kPackVersion;
+  header.num_entries = static_cast<uint32_t>(entries_.size());
+  header.reserved = 0;
+
+  std::vector<PackTocEntry> toc(entries_.size());
+  uint64_t offset = align(sizeof(header) + toc.size() * sizeof(PackTocEntry));
+  for (size_t i = 0; i < entries_.size(); i++) {
+    Entry const &entry = entries_[i];
+    if (entry.name.empty() || entry.name.size() > kPackMaxNameLength) {
+      return fw::ErrorStatus("invalid pack file entry name: ") << entry.name;
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (entries_[j].name == entry.name) {
+        return fw::ErrorStatus("duplicate pack file entry: ") << entry.name;
+      }
+    }
+
+    memset(&toc[i], 0, sizeof(PackTocEntry));
+    memcpy(toc[i].name, entry.name.c_str(), entry.name.size());
+    toc[i].offset = offset;
+    toc[i].stored_size = entry.data.size();
+    toc[i].size = entry.size;
+    toc[i].compression = entry.compression;
+    offset = align(offset + entry.data.size());
+  }
+
+  fs::path tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream outs(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!outs) {
+      return fw::ErrorStatus("error creating ") << tmp_path.string();
+    }
+    outs.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    outs.write(reinterpret_cast<char const *>(toc.data()), toc.size() * sizeof(PackTocEntry));
+
+    static const char padding[kPackAlignment] = {};
+    uint64_t written = sizeof(header) + toc.size() * sizeof(PackTocEntry);
+    for (size_t i = 0; i < entries_.size(); i++) {
+      outs.write(padding, toc[i].offset - written);
+      outs.write(reinterpret_cast<char const *>(entries_[i].data.data()), entries_[i].data.size());
+      written = toc[i].offset + entries_[i].data.size();
+    }
+    if (!outs) {
+      return fw::ErrorStatus("error writing ") << tmp_path.string();
+    }
+  }
+
+  std::error_code ec;
+  fs::rename(tmp_path, path, ec);
+  if (ec) {
+    return fw::ErrorStatus("error renaming ") << tmp_path.string() << " to " << path.string() << ": " << ec.message();
+  }
+  return fw::OkStatus();
+}
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <framework/mapped_file.h>
+#include <framework/status.h>
+
+namespace fw {
+
+// A pack file is a bunch of named entries (think files in a directory) in one file, laid out so that it can be memory
+// mapped. It starts with a PackHeader, then a PackTocEntry for every entry, then the entries themselves. Each entry
+// starts on a kPackAlignment boundary, so anything stored uncompressed can be used right where it is in the mapping
+// (e.g. an array of floats or uint64s). Entries can also be compressed with LZ4.
+//
+// Everything is little-endian.
+constexpr uint32_t kPackMagic = 0x4b505052; // "RPPK"
+constexpr uint32_t kPackVersion = 1;
+constexpr uint64_t kPackAlignment = 64;
+constexpr size_t kPackMaxNameLength = 47;
+
+enum class PackCompression : uint32_t {
+  kNone = 0,
+  kLz4 = 1,
+};
+
+struct PackHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_entries;
+  uint32_t reserved;
+};
+
+struct PackTocEntry {
+  // Nul-terminated (and padded with nuls).
+  char name[kPackMaxNameLength + 1];
+
+  // Where the entry is (from the start of the file), and how big it is in the file.
+  uint64_t offset;
+  uint64_t stored_size;
+
+  // How big the entry is once it's been decompressed.
+  uint64_t size;
+
+  PackCompression compression;
+  uint32_t reserved;
+};
+
+// Reads a pack file. Once it's open, it's safe to read entries from multiple threads at once.
+class PackReader {
+public:
+  struct Entry {
+    uint64_t offset;
+    uint64_t stored_size;
+    uint64_t size;
+    PackCompression compression;
+  };
+
+private:
+  std::unique_ptr<MappedFile> file_;
+  std::map<std::string, Entry, std::less<>> entries_;
+
+  PackReader();
+
+  fw::StatusOr<Entry> get_entry(std::string_view name) const;
+
+public:
+  ~PackReader();
+
+  // Maps the given file and reads its table of contents.
+  static fw::StatusOr<std::unique_ptr<PackReader>> open(std::filesystem::path const &path);
+
+  // Returns true if the given file looks like a pack file (i.e. it starts with kPackMagic).
+  static bool is_pack_file(std::filesystem::path const &path);
+
+  bool has_entry(std::string_view name) const;
+  std::vector<std::string> get_entry_names() const;
+
+  // Gets the bytes of the given (uncompressed) entry, right where they are in the mapped file. The span is good for as
+  // long as the PackReader is.
+  fw::StatusOr<std::span<uint8_t const>> get_entry_data(std::string_view name) const;
+
+  // Reads the given entry into a vector, decompressing it if it was compressed.
+  fw::StatusOr<std::vector<uint8_t>> read_entry(std::string_view name) const;
+};
+
+// Writes a pack file. You add all of the entries, then write the whole thing out in one go.
+class PackWriter {
+private:
+  struct Entry {
+    std::string name;
+    uint64_t size;
+    PackCompression compression;
+    std::vector<uint8_t> data;
+  };
+  std::vector<Entry> entries_;
+
+public:
+  // Adds an entry with the given name. If you ask for it to be compressed but it doesn't get any smaller, we store it
+  // uncompressed.
+  void add(std::string_view name, std::span<uint8_t const> data, PackCompression compression = PackCompression::kNone);
+
+  // Writes the pack file to the given path. We write to a temporary file first and then rename it, so if something
+  // goes wrong you're left with the old file rather than half of a new one.
+  fw::Status write(std::filesystem::path const &path) const;
+};
+
+}
@@ -17,15 +17,15 @@ Packet::~Packet() {
 }
 
 //-------------------------------------------------------------------------
-std::shared_ptr<Packet> create_packet(PacketBuffer &buff) {
-  std::function<std::shared_ptr<Packet>()> fn = (*packet_registry)[buff.get_packet_type()];
-  if (!fn) {
-    LOG(WARN)
-        << "  received packet with unknown identifier " << buff.get_packet_type() << ", dropping.";
-    return std::shared_ptr<Packet>();
+fw::StatusOr<std::shared_ptr<Packet>> create_packet(PacketBuffer &buff) {
+  RETURN_IF_ERROR(buff.get_status());
+
+  auto it = packet_registry->find(buff.get_packet_type());
+  if (it == packet_registry->end()) {
+    return fw::ErrorStatus("unknown packet identifier ") << buff.get_packet_type();
   }
 
-  return fn();
+  return it->second();
 }
 
 //-------------------------------------------------------------------------
@@ -4,6 +4,7 @@
 #include <memory>
 
 #include <framework/packet_buffer.h>
+#include <framework/status.h>
 
 namespace fw::net {
 class net_peer;
@@ -17,10 +18,12 @@ class net_peer;
 class Packet {
 protected:
   friend class Peer;
+  friend class SharedPacket;
 
-  // serialize/deserialize ourselves to/from the given PacketBuffer
+  // serialize/deserialize ourselves to/from the given PacketBuffer. deserialize returns an error if the packet was
+  // malformed (e.g. truncated), in which case it should be dropped.
   virtual void serialize(PacketBuffer &buffer) = 0;
-  virtual void deserialize(PacketBuffer &buffer) = 0;
+  virtual fw::Status deserialize(PacketBuffer &buffer) = 0;
 
   Packet();
 public:
@@ -33,8 +36,8 @@ public:
   }
 };
 
-// Creates the Packet object from the given PacketBuffer.
-std::shared_ptr<Packet> create_packet(PacketBuffer &buff);
+// Creates the Packet object from the given PacketBuffer (but doesn't deserialize it).
+fw::StatusOr<std::shared_ptr<Packet>> create_packet(PacketBuffer &buff);
 
 // Helper class that you use indirectly via the PACKET_REGISTER macro to register a Packet with the packet_factory.
 class packet_registrar {
@@ -1,47 +1,200 @@
 #include <framework/packet_buffer.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace fw {
 namespace net {
 
-PacketBuffer::PacketBuffer(uint16_t packet_type) :
-    flushed_(false) {
-  (*this) << packet_type;
+namespace {
+
+// A varint for a 64-bit value is never longer than this.
+const int MAX_VARINT_BYTES = 10;
+
+// We clamp fixed-point values to this, so that they (and the floats we make from them) are exact.
+const int64_t MAX_FIXED_POINT = (1 << 24) - 1;
+
+}
+
+int64_t to_fixed_point(float value, int exponent) {
+  if (!std::isfinite(value)) {
+    return 0;
+  }
+
+  const float fixed = std::nearbyint(std::ldexp(value, -exponent));
+  return static_cast<int64_t>(std::clamp(
+      fixed, -static_cast<float>(MAX_FIXED_POINT), static_cast<float>(MAX_FIXED_POINT)));
+}
+
+fw::Vector quantize_position(fw::Vector const &pos, int exponent) {
+  return fw::Vector(
+      std::ldexp(static_cast<float>(to_fixed_point(pos[0], exponent)), exponent),
+      std::ldexp(static_cast<float>(to_fixed_point(pos[1], exponent)), exponent),
+      std::ldexp(static_cast<float>(to_fixed_point(pos[2], exponent)), exponent));
+}
+
+//-------------------------------------------------------------------------
+
+std::unique_ptr<PacketStorage> PacketArena::acquire() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!free_.empty()) {
+      std::unique_ptr<PacketStorage> storage = std::move(free_.back());
+      free_.pop_back();
+      return storage;
+    }
+  }
+
+  auto storage = std::make_unique<PacketStorage>();
+  storage->arena = this;
+  return storage;
+}
+
+void PacketArena::release(std::unique_ptr<PacketStorage> storage) {
+  storage->bytes.clear();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  free_.push_back(std::move(storage));
+}
+
+PacketArena &PacketArena::get_default() {
+  static PacketArena *arena = new PacketArena();
+  return *arena;
+}
+
+//-------------------------------------------------------------------------
+
+PacketBuffer::PacketBuffer(uint16_t packet_type, uint8_t wire_version, PacketArena &arena) :
+    storage_(arena.acquire()), read_data_(nullptr), read_size_(0), read_pos_(0), packet_type_(packet_type),
+    wire_version_(wire_version), position_exponent_(kDefaultPositionExponent) {
+  (*this) << static_cast<uint16_t>(packet_type | (wire_version << kWireVersionShift));
 }
 
-PacketBuffer::PacketBuffer(char const *bytes, std::size_t n) :
-    buffer_(std::string(bytes, n)), flushed_(false) {
-  (*this) >> packet_type_;
+PacketBuffer::PacketBuffer(uint8_t const *bytes, std::size_t n) :
+    read_data_(bytes), read_size_(n), read_pos_(0), packet_type_(0), wire_version_(kWireVersionFixed),
+    position_exponent_(kDefaultPositionExponent) {
+  uint16_t header;
+  (*this) >> header;
+  packet_type_ = header & kPacketTypeMask;
+  wire_version_ = static_cast<uint8_t>(header >> kWireVersionShift);
+  if (wire_version_ > kMaxWireVersion) {
+    set_error(fw::ErrorStatus("unsupported wire version ") << static_cast<int>(wire_version_));
+  }
 }
 
 PacketBuffer::~PacketBuffer() {
+  if (storage_) {
+    storage_->arena->release(std::move(storage_));
+  }
+}
+
+void PacketBuffer::add_varint(uint64_t value) {
+  uint8_t bytes[MAX_VARINT_BYTES];
+  std::size_t n = 0;
+  while (value >= 0x80) {
+    bytes[n++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  bytes[n++] = static_cast<uint8_t>(value);
+  add_bytes(bytes, n);
+}
+
+bool PacketBuffer::read_varint(uint64_t &value) {
+  value = 0;
+  for (int i = 0; i < MAX_VARINT_BYTES; i++) {
+    uint8_t byte;
+    if (!read(&byte, 1)) {
+      return false;
+    }
+    value |= static_cast<uint64_t>(byte & 0x7f) << (i * 7);
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+
+  value = 0;
+  set_error(fw::ErrorStatus("varint is too long"));
+  return false;
 }
 
-void PacketBuffer::add_bytes(char const *bytes, std::size_t offset, std::size_t n) {
-  flushed_ = false;
-  buffer_.write(bytes + offset, n);
+void PacketBuffer::add_signed_varint(int64_t value) {
+  add_varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
 }
 
-void PacketBuffer::get_bytes(char *bytes, std::size_t offset, std::size_t n) {
-  buffer_.read(bytes + offset, n);
+bool PacketBuffer::read_signed_varint(int64_t &value) {
+  uint64_t zigzag;
+  const bool ok = read_varint(zigzag);
+  value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+  return ok;
 }
 
-void PacketBuffer::flush() {
-  if (flushed_)
+void PacketBuffer::add_position(fw::Vector const &pos) {
+  if (wire_version_ < kWireVersionCompact) {
+    add_bytes(pos.v, sizeof(float) * 3);
     return;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    add_signed_varint(to_fixed_point(pos[i], position_exponent_));
+  }
+}
+
+bool PacketBuffer::read_position(fw::Vector &pos) {
+  if (wire_version_ < kWireVersionCompact) {
+    return read(pos.v, sizeof(float) * 3);
+  }
+
+  for (int i = 0; i < 3; i++) {
+    int64_t fixed;
+    if (!read_signed_varint(fixed)) {
+      pos = fw::Vector(0, 0, 0);
+      return false;
+    }
+    if (fixed > MAX_FIXED_POINT || fixed < -MAX_FIXED_POINT) {
+      set_error(fw::ErrorStatus("position out of range: ") << fixed);
+      pos = fw::Vector(0, 0, 0);
+      return false;
+    }
+    pos[i] = std::ldexp(static_cast<float>(fixed), position_exponent_);
+  }
+  return true;
+}
+
+void PacketBuffer::set_error(fw::Status const &status) {
+  if (status_.ok()) {
+    status_ = status;
+  }
+}
+
+void PacketBuffer::set_overflow(std::size_t n) {
+  // Only keep the first error, the rest are just a consequence of it.
+  if (status_.ok()) {
+    status_ = fw::ErrorStatus("read past the end of packet: wanted ") << n << " bytes at offset " << read_pos_
+        << ", but the packet is only " << read_size_ << " bytes";
+  }
+}
+
+fw::StatusOr<std::string_view> PacketBuffer::get_view(std::size_t n) {
+  if (!status_.ok() || n > read_size_ - read_pos_) {
+    set_overflow(n);
+    return status_;
+  }
+
+  std::string_view view(reinterpret_cast<char const *>(read_data_ + read_pos_), n);
+  read_pos_ += n;
+  return view;
+}
 
-  buffer_.flush();
-  value_ = buffer_.str();
-  flushed_ = true;
+uint8_t const *PacketBuffer::get_buffer() const {
+  return storage_ ? storage_->bytes.data() : read_data_;
 }
 
-char const *PacketBuffer::get_buffer() {
-  flush();
-  return value_.c_str();
+std::size_t PacketBuffer::get_size() const {
+  return storage_ ? storage_->bytes.size() : read_size_;
 }
 
-std::size_t PacketBuffer::get_size() {
-  flush();
-  return value_.length();
+std::unique_ptr<PacketStorage> PacketBuffer::take_storage() {
+  return std::move(storage_);
 }
 
 }
@@ -1,140 +1,337 @@
 #pragma once
 
-#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
 #include <framework/color.h>
 #include <framework/math.h>
+#include <framework/status.h>
 
 namespace fw::net {
 
-// This class represents a "buffer" we use for reading/writing packets that get sent between net_peers.
+// The versions of the encoding we use on the wire. Every packet says which version it was written with (in the top bits
+// of the packet type), and a Peer only writes a version newer than kWireVersionFixed once the join handshake has
+// established that the other end understands it.
+//
+// kWireVersionFixed: integers are fixed-width and positions are raw floats.
+// kWireVersionCompact: ids and counts (the values written via compact()) are LEB128 varints, and positions are
+//   zig-zag varints in units of 2^position_exponent.
+// kWireVersionLockstep: the same as kWireVersionCompact, but command packets also say which turn their commands
+//   execute on (see fw::net::LockstepScheduler).
+// kWireVersionHeartbeat: the same as kWireVersionLockstep, but a turn without any commands is sent as a heartbeat
+//   that only has the turn information in it.
+constexpr uint8_t kWireVersionFixed = 0;
+constexpr uint8_t kWireVersionCompact = 1;
+constexpr uint8_t kWireVersionLockstep = 2;
+constexpr uint8_t kWireVersionHeartbeat = 3;
+constexpr uint8_t kMaxWireVersion = kWireVersionHeartbeat;
+
+// The packet type is in the bottom 12 bits of the first two bytes of a packet, and the wire version in the top 4.
+constexpr int kWireVersionShift = 12;
+constexpr uint16_t kPacketTypeMask = (1 << kWireVersionShift) - 1;
+
+// The position exponent used by packets that don't choose their own (positions are in 1/64ths).
+constexpr int kDefaultPositionExponent = -6;
+
+// Converts a coordinate to the fixed-point value we send in the compact encoding. Values that don't fit (or aren't
+// finite) are clamped, so this is always the same on every peer.
+int64_t to_fixed_point(float value, int exponent);
+
+// Rounds the given position to what will come out the other end of the compact encoding, with the given exponent.
+// Commands do this to themselves before they're executed, so that we execute exactly what our peers receive.
+fw::Vector quantize_position(fw::Vector const &pos, int exponent);
+
+// A contiguous block of memory that a PacketBuffer writes into. These are pooled by a PacketArena, so once the game's
+// been running for a little while we're just reusing the same few blocks and sending a packet doesn't allocate.
+struct PacketStorage {
+  std::vector<uint8_t> bytes;
+
+  // The arena we'll be returned to when we're finished with.
+  class PacketArena *arena;
+};
+
+// A pool of PacketStorage blocks. This is thread-safe: a block may be released on a different thread to the one that
+// acquired it (e.g. ENet frees the packet after it's been sent).
+class PacketArena {
+private:
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<PacketStorage>> free_;
+
+public:
+  // Gets an empty block (which has probably got some capacity left over from the last time it was used).
+  std::unique_ptr<PacketStorage> acquire();
+
+  // Returns a block to the pool.
+  void release(std::unique_ptr<PacketStorage> storage);
+
+  // The arena that PacketBuffers use unless you give them another one. This is never destroyed, so it's safe to
+  // release blocks to it at any time (including while ENet is shutting down).
+  static PacketArena &get_default();
+};
+
+// This class represents a "buffer" we use for reading/writing packets that get sent between net_peers. There's two
+// kinds of buffer:
+//
+//  * A writer, which you construct with the packet type. This writes into a PacketStorage from a PacketArena, and
+//    when you're done you can take_storage() and hand the bytes off to ENet without copying them.
+//  * A reader, which you construct over the bytes you've received. This doesn't copy the bytes, so they must stay
+//    valid for as long as the reader is used.
+//
+// Reads are bounds-checked: if there aren't enough bytes left, the value is zeroed, the read fails and so does every
+// read after it. The operator >> overloads don't return the error (so that you can chain them), just check
+// get_status() once you're done reading.
 class PacketBuffer {
 private:
-  bool flushed_;
-  std::string value_;
-  std::stringstream buffer_;
+  std::unique_ptr<PacketStorage> storage_;
+  uint8_t const *read_data_;
+  std::size_t read_size_;
+  std::size_t read_pos_;
+  fw::Status status_;
   uint16_t packet_type_;
+  uint8_t wire_version_;
+  int position_exponent_;
 
-  void flush();
+  void set_overflow(std::size_t n);
 
 public:
-  PacketBuffer(uint16_t packet_type);
-  PacketBuffer(char const *bytes, std::size_t n);
+  explicit PacketBuffer(
+      uint16_t packet_type, uint8_t wire_version = kWireVersionFixed,
+      PacketArena &arena = PacketArena::get_default());
+  PacketBuffer(uint8_t const *bytes, std::size_t n);
+  PacketBuffer(const PacketBuffer&) = delete;
+  PacketBuffer& operator=(const PacketBuffer&) = delete;
   ~PacketBuffer();
 
-  void add_bytes(char const *bytes, std::size_t offset, std::size_t n);
-  void get_bytes(char *bytes, std::size_t offset, std::size_t n);
+  inline void add_bytes(void const *bytes, std::size_t n) {
+    uint8_t const *begin = static_cast<uint8_t const *>(bytes);
+    storage_->bytes.insert(storage_->bytes.end(), begin, begin + n);
+  }
+
+  // Copies the next n bytes of the packet into bytes. If there aren't that many left, bytes is zeroed, we record the
+  // error in get_status() and return false.
+  inline bool read(void *bytes, std::size_t n) {
+    if (!status_.ok() || n > read_size_ - read_pos_) {
+      std::memset(bytes, 0, n);
+      set_overflow(n);
+      return false;
+    }
+    std::memcpy(bytes, read_data_ + read_pos_, n);
+    read_pos_ += n;
+    return true;
+  }
+
+  // Same as read(), but returns the error.
+  fw::Status get_bytes(void *bytes, std::size_t n) {
+    if (!read(bytes, n)) {
+      return status_;
+    }
+    return fw::OkStatus();
+  }
+
+  // Unsigned LEB128: seven bits per byte, with the top bit set on every byte but the last.
+  void add_varint(uint64_t value);
+  bool read_varint(uint64_t &value);
+
+  // Signed values are zig-zag encoded first, so that small negative numbers are small as well.
+  void add_signed_varint(int64_t value);
+  bool read_signed_varint(int64_t &value);
+
+  void add_position(fw::Vector const &pos);
+  bool read_position(fw::Vector &pos);
+
+  // Records an error the caller found in what it read (e.g. a value that's out of range). As with running out of
+  // bytes, every read after this fails.
+  void set_error(fw::Status const &status);
+
+  // Gets a view of the next n bytes of the packet, without copying them.
+  fw::StatusOr<std::string_view> get_view(std::size_t n);
+
+  // The first error we had reading from this buffer, or OK if all the reads so far have succeeded.
+  fw::Status const &get_status() const {
+    return status_;
+  }
+
+  // The number of bytes we have left to read.
+  std::size_t get_remaining() const {
+    return read_size_ - read_pos_;
+  }
+
+  // For a writer, these are the bytes we've written so far. For a reader, it's the whole packet.
+  uint8_t const *get_buffer() const;
+  std::size_t get_size() const;
+
+  // Takes the storage from a writer, so you can pass it on to something else (e.g. ENet) without copying it. Once
+  // you've done this, the PacketBuffer is empty and can't be written to any more.
+  std::unique_ptr<PacketStorage> take_storage();
 
-  char const *get_buffer();
-  std::size_t get_size();
   uint16_t get_packet_type() const {
     return packet_type_;
   }
+
+  uint8_t get_wire_version() const {
+    return wire_version_;
+  }
+
+  // Positions are written as multiples of 2^exponent in the compact encoding. This isn't part of the packet itself, so
+  // a packet that changes it needs to write it out, so the reader can set the same value.
+  void set_position_exponent(int exponent) {
+    position_exponent_ = exponent;
+  }
+  int get_position_exponent() const {
+    return position_exponent_;
+  }
+};
+
+// Wraps an unsigned id or count, so that it's written as a varint in the compact encoding (and as the fixed-width type
+// otherwise). Use it like: buffer << fw::net::compact(entity_id);
+template <typename T>
+struct Compact {
+  static_assert(std::is_unsigned_v<std::remove_const_t<T>>, "only unsigned values can be compact");
+  T &value;
 };
 
+template <typename T>
+inline Compact<T> compact(T &value) {
+  return Compact<T> { value };
+}
+
+template <typename T>
+inline PacketBuffer &operator <<(PacketBuffer &lhs, Compact<T> rhs) {
+  if (lhs.get_wire_version() >= kWireVersionCompact) {
+    lhs.add_varint(rhs.value);
+  } else {
+    lhs << static_cast<std::remove_const_t<T>>(rhs.value);
+  }
+  return lhs;
+}
+
+template <typename T>
+inline PacketBuffer &operator >>(PacketBuffer &lhs, Compact<T> rhs) {
+  static_assert(!std::is_const_v<T>, "can't read into a const value");
+  if (lhs.get_wire_version() < kWireVersionCompact) {
+    return lhs >> rhs.value;
+  }
+
+  uint64_t value;
+  if (lhs.read_varint(value) && value > std::numeric_limits<T>::max()) {
+    lhs.set_error(fw::ErrorStatus("compact value out of range: ") << value);
+    value = 0;
+  }
+  rhs.value = static_cast<T>(value);
+  return lhs;
+}
+
 inline PacketBuffer &operator <<(PacketBuffer &lhs, int32_t rhs) {
-  lhs.add_bytes(reinterpret_cast<char const *>(&rhs), 0, 4);
+  lhs.add_bytes(&rhs, 4);
   return lhs;
 }
 
 inline PacketBuffer &operator >>(PacketBuffer &lhs, int32_t &rhs) {
-  lhs.get_bytes(reinterpret_cast<char *>(&rhs), 0, 4);
+  lhs.read(&rhs, 4);
   return lhs;
 }
 
 inline PacketBuffer &operator <<(PacketBuffer &lhs, uint32_t rhs) {
-  lhs.add_bytes(reinterpret_cast<char const *>(&rhs), 0, 4);
+  lhs.add_bytes(&rhs, 4);
   return lhs;
 }
 
 inline PacketBuffer &operator >>(PacketBuffer &lhs, uint32_t &rhs) {
-  lhs.get_bytes(reinterpret_cast<char *>(&rhs), 0, 4);
+  lhs.read(&rhs, 4);
   return lhs;
 }
 
 inline PacketBuffer &operator <<(PacketBuffer &lhs, int16_t rhs) {
-  lhs.add_bytes(reinterpret_cast<char const *>(&rhs), 0, 2);
+  lhs.add_bytes(&rhs, 2);
   return lhs;
 }
 
 inline PacketBuffer &operator >>(PacketBuffer &lhs, int16_t &rhs) {
-  lhs.get_bytes(reinterpret_cast<char *>(&rhs), 0, 2);
+  lhs.read(&rhs, 2);
   return lhs;
 }
 
 inline PacketBuffer &operator <<(PacketBuffer &lhs, uint16_t rhs) {
-  lhs.add_bytes(reinterpret_cast<char const *>(&rhs), 0, 2);
+  lhs.add_bytes(&rhs, 2);
   return lhs;
 }
 
 inline PacketBuffer &operator >>(PacketBuffer &lhs, uint16_t &rhs) {
-  lhs.get_bytes(reinterpret_cast<char *>(&rhs), 0, 2);
+  lhs.read(&rhs, 2);
   return lhs;
 }
 
 inline PacketBuffer &operator <<(PacketBuffer &lhs, int64_t rhs) {
-  lhs.add_bytes(reinterpret_cast<char const *>(&rhs), 0, 8);
+  lhs.add_bytes(&rhs, 8);
   return lhs;
 }
 
 inline PacketBuffer &operator >>(PacketBuffer &lhs, int64_t &rhs) {
-  lhs.get_bytes(reinterpret_cast<char *>(&rhs), 0, 8);
+  lhs.read(&rhs, 8);
   return lhs;
 }
 
 inline PacketBuffer &operator <<(PacketBuffer &lhs, uint64_t rhs) {
-  lhs.add_bytes(reinterpret_cast<char const *>(&rhs), 0, 8);
+  lhs.add_bytes(&rhs, 8);
   return lhs;
 }
 
 inline PacketBuffer &operator >>(PacketBuffer &lhs, uint64_t &rhs) {
-  lhs.get_bytes(reinterpret_cast<char *>(&rhs), 0, 8);
+  lhs.read(&rhs, 8);
   return lhs;
 }
 
 inline PacketBuffer &operator <<(PacketBuffer &lhs, uint8_t rhs) {
-  lhs.add_bytes(reinterpret_cast<char const *>(&rhs), 0, 1);
+  lhs.add_bytes(&rhs, 1);
   return lhs;
 }
 
 inline PacketBuffer &operator >>(PacketBuffer &lhs, uint8_t &rhs) {
-  lhs.get_bytes(reinterpret_cast<char *>(&rhs), 0, 1);
+  lhs.read(&rhs, 1);
   return lhs;
 }
 
 #ifdef __APPLE__
 // CLang for Apple makes size_t a different type, but on other platforms, it's the same as uint64_t (or uint32_t).
 
-inline packet_buffer &operator <<(packet_buffer &lhs, size_t rhs) {
-  lhs.add_bytes(reinterpret_cast<char const *>(&rhs), 0, sizeof(size_t));
+inline PacketBuffer &operator <<(PacketBuffer &lhs, size_t rhs) {
+  lhs.add_bytes(&rhs, sizeof(size_t));
   return lhs;
 }
 
-inline packet_buffer &operator >>(packet_buffer &lhs, size_t &rhs) {
-  lhs.get_bytes(reinterpret_cast<char *>(&rhs), 0, sizeof(size_t));
+inline PacketBuffer &operator >>(PacketBuffer &lhs, size_t &rhs) {
+  lhs.read(&rhs, sizeof(size_t));
   return lhs;
 }
 
 #endif
 
 inline PacketBuffer &operator <<(PacketBuffer &lhs, fw::Vector const &rhs) {
-  lhs.add_bytes(reinterpret_cast<char const *>(rhs.v), 0, sizeof(float) * 3);
+  lhs.add_position(rhs);
   return lhs;
 }
 
 inline PacketBuffer &operator >>(PacketBuffer &lhs, fw::Vector &rhs) {
-  lhs.get_bytes(reinterpret_cast<char *>(rhs.v), 0, sizeof(float) * 3);
+  lhs.read_position(rhs);
   return lhs;
 }
 
 inline PacketBuffer &operator <<(PacketBuffer &lhs, Color const &rhs) {
   uint32_t rgba = rhs.to_rgba();
-  lhs.add_bytes(reinterpret_cast<char const *>(&rgba), 0, sizeof(uint32_t));
+  lhs.add_bytes(&rgba, sizeof(uint32_t));
   return lhs;
 }
 
 inline PacketBuffer &operator >>(PacketBuffer &lhs, Color &rhs) {
   uint32_t rgba;
-  lhs.get_bytes(reinterpret_cast<char *>(&rgba), 0, sizeof(uint32_t));
+  lhs.read(&rgba, sizeof(uint32_t));
   rhs = fw::Color(rgba);
   return lhs;
 }
@@ -143,7 +340,7 @@ inline PacketBuffer &operator <<(PacketBuffer &lhs, std::string const &rhs) {
   // strings are length-prefixed
   uint16_t length = static_cast<uint16_t>(rhs.length());
   lhs << length;
-  lhs.add_bytes(rhs.c_str(), 0, length);
+  lhs.add_bytes(rhs.c_str(), length);
   return lhs;
 }
 
@@ -151,17 +348,12 @@ inline PacketBuffer &operator >>(PacketBuffer &lhs, std::string &rhs) {
   uint16_t length;
   lhs >> length;
 
-  if (length < 80) { // If it's < 80 bytes, just allocate on the stack.
-    char *value = reinterpret_cast<char *>(alloca(length));
-    lhs.get_bytes(value, 0, length);
-    rhs = std::string(value, length);
+  auto value = lhs.get_view(length);
+  if (value.ok()) {
+    rhs.assign(value->data(), value->size());
   } else {
-    char *value = new char[length];
-    lhs.get_bytes(value, 0, length);
-    rhs = std::string(value, length);
-    delete[] value;
+    rhs.clear();
   }
-
   return lhs;
 }
 
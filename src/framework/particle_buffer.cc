@@ -0,0 +1,454 @@
+#include <framework/particle_buffer.h>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FW_PARTICLE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FW_PARTICLE_SSE2
+#endif
+
+namespace fw {
+namespace {
+
+// Directions shorter than this are treated as having no direction at all.
+const float MIN_DIRECTION_LENGTH = 0.001f;
+
+// We never divide by a length shorter than this when normalizing.
+const float MIN_NORMALIZE_LENGTH = 0.000001f;
+
+// A thin wrapper around whichever SIMD instruction set we're compiled for, so that the kernel below can be written
+// once.
+#if defined(FW_PARTICLE_AVX2)
+namespace simd {
+typedef __m256 Float;
+const int WIDTH = 8;
+const char *NAME = "avx2";
+
+inline Float load(float const *p) { return _mm256_loadu_ps(p); }
+inline void store(float *p, Float v) { _mm256_storeu_ps(p, v); }
+inline Float set(float f) { return _mm256_set1_ps(f); }
+inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+inline Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+inline Float sqrt(Float a) { return _mm256_sqrt_ps(a); }
+}
+#elif defined(FW_PARTICLE_SSE2)
+namespace simd {
+typedef __m128 Float;
+const int WIDTH = 4;
+const char *NAME = "sse2";
+
+inline Float load(float const *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, Float v) { _mm_storeu_ps(p, v); }
+inline Float set(float f) { return _mm_set1_ps(f); }
+inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+inline Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+inline Float sqrt(Float a) { return _mm_sqrt_ps(a); }
+}
+#endif
+
+}
+
+//-------------------------------------------------------------------------
+
+void ParticleLifeCurves::add_state(
+    float state_age, float size_min, float size_max, float rotation_speed_min, float rotation_speed_max,
+    ParticleRotation state_rotation, fw::Vector const &direction_min, fw::Vector const &direction_max,
+    float speed_min, float speed_max, float gravity_min, float gravity_max, float state_alpha, int state_color_row) {
+  age.push_back(state_age);
+  size_base.push_back(size_min);
+  size_range.push_back(size_max - size_min);
+  rotation_speed_base.push_back(rotation_speed_min);
+  rotation_speed_range.push_back(rotation_speed_max - rotation_speed_min);
+  rotation.push_back(state_rotation);
+  direction_x_base.push_back(direction_min[0]);
+  direction_x_range.push_back(direction_max[0] - direction_min[0]);
+  direction_y_base.push_back(direction_min[1]);
+  direction_y_range.push_back(direction_max[1] - direction_min[1]);
+  direction_z_base.push_back(direction_min[2]);
+  direction_z_range.push_back(direction_max[2] - direction_min[2]);
+  speed_base.push_back(speed_min);
+  speed_range.push_back(speed_max - speed_min);
+  gravity_base.push_back(gravity_min);
+  gravity_range.push_back(gravity_max - gravity_min);
+  alpha.push_back(state_alpha);
+  color_row.push_back(state_color_row);
+  num_states++;
+}
+
+void ParticleLifeCurves::finish() {
+  if (num_states == 0) {
+    // A config with no life states at all is pretty useless, but we need at least one so we've got something to index.
+    add_state(0.0f, 1.0f, 1.0f, 0.0f, 0.0f, ParticleRotation::kRandom, fw::Vector(0, 0, 0), fw::Vector(0, 0, 0),
+        0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0);
+  }
+
+  inv_span.resize(num_states);
+  next.resize(num_states);
+  directional.resize(num_states);
+  for (int i = 0; i < num_states; i++) {
+    const int next_state = std::min(i + 1, num_states - 1);
+    next[i] = next_state;
+    const float span = age[next_state] - age[i];
+    inv_span[i] = (next_state == i || span <= 0.0f) ? 0.0f : 1.0f / span;
+
+    // We don't know exactly which direction each particle will pick, so a state "has a direction" if either end of
+    // the range is non-zero.
+    auto has_direction = [this](int state) {
+      fw::Vector min(direction_x_base[state], direction_y_base[state], direction_z_base[state]);
+      fw::Vector max = min + fw::Vector(
+          direction_x_range[state], direction_y_range[state], direction_z_range[state]);
+      return min.length() >= MIN_DIRECTION_LENGTH || max.length() >= MIN_DIRECTION_LENGTH;
+    };
+    directional[i] = (has_direction(i) && has_direction(next_state)) ? 1 : 0;
+  }
+}
+
+//-------------------------------------------------------------------------
+
+ParticleBuffer::ParticleBuffer(int num_states) : state_begin_(std::max(num_states, 1), 0), last_emitted_(-1) {
+}
+
+int ParticleBuffer::emit(
+    fw::Vector const &pos, fw::Vector const &direction, float initial_age, float max_age, float rand) {
+  // New particles are in state 0, whose group is always at the end, so we can just append.
+  x.push_back(pos[0]);
+  y.push_back(pos[1]);
+  z.push_back(pos[2]);
+  direction_x.push_back(direction[0]);
+  direction_y.push_back(direction[1]);
+  direction_z.push_back(direction[2]);
+  angle.push_back(0.0f);
+  age.push_back(initial_age);
+  age_step.push_back(1.0f / max_age);
+  random.push_back(rand);
+  state.push_back(0);
+
+  last_emitted_ = static_cast<int>(size()) - 1;
+  return last_emitted_;
+}
+
+void ParticleBuffer::clear() {
+  x.clear();
+  y.clear();
+  z.clear();
+  direction_x.clear();
+  direction_y.clear();
+  direction_z.clear();
+  angle.clear();
+  age.clear();
+  age_step.clear();
+  random.clear();
+  state.clear();
+  std::fill(state_begin_.begin(), state_begin_.end(), 0);
+  last_emitted_ = -1;
+}
+
+void ParticleBuffer::update(ParticleLifeCurves const &curves, float dt, Kernel kernel /*= Kernel::kSimd */) {
+  const size_t count = size();
+  for (size_t i = 0; i < count; i++) {
+    age[i] += age_step[i] * dt;
+  }
+
+  advance_states(curves);
+  remove_dead();
+
+  for (int s = 0; s < curves.num_states; s++) {
+    const size_t begin = state_begin_[s];
+    const size_t end = get_state_end(s);
+    if (kernel == Kernel::kSimd) {
+      update_state_simd(curves, s, dt, begin, end);
+    } else {
+      update_state_scalar(curves, s, dt, begin, end);
+    }
+  }
+}
+
+void ParticleBuffer::move_particle(size_t from, size_t to) {
+  if (from == to) {
+    return;
+  }
+
+  x[to] = x[from];
+  y[to] = y[from];
+  z[to] = z[from];
+  direction_x[to] = direction_x[from];
+  direction_y[to] = direction_y[from];
+  direction_z[to] = direction_z[from];
+  angle[to] = angle[from];
+  age[to] = age[from];
+  age_step[to] = age_step[from];
+  random[to] = random[from];
+  state[to] = state[from];
+  if (last_emitted_ == static_cast<int>(from)) {
+    last_emitted_ = static_cast<int>(to);
+  }
+}
+
+void ParticleBuffer::swap_particles(size_t a, size_t b) {
+  if (a == b) {
+    return;
+  }
+
+  std::swap(x[a], x[b]);
+  std::swap(y[a], y[b]);
+  std::swap(z[a], z[b]);
+  std::swap(direction_x[a], direction_x[b]);
+  std::swap(direction_y[a], direction_y[b]);
+  std::swap(direction_z[a], direction_z[b]);
+  std::swap(angle[a], angle[b]);
+  std::swap(age[a], age[b]);
+  std::swap(age_step[a], age_step[b]);
+  std::swap(random[a], random[b]);
+  std::swap(state[a], state[b]);
+  if (last_emitted_ == static_cast<int>(a)) {
+    last_emitted_ = static_cast<int>(b);
+  } else if (last_emitted_ == static_cast<int>(b)) {
+    last_emitted_ = static_cast<int>(a);
+  }
+}
+
+// Moves every particle that has reached the start of its next life state into that state's group. We go from state 0
+// upwards, so a particle that skips over a whole state in one frame gets moved again when we get to the next group.
+void ParticleBuffer::advance_states(ParticleLifeCurves const &curves) {
+  for (int s = 0; s + 1 < curves.num_states; s++) {
+    const float next_age = curves.age[s + 1];
+    const size_t end = get_state_end(s);
+    for (size_t i = state_begin_[s]; i < end; i++) {
+      if (age[i] >= next_age) {
+        // The first particle of our group is right after the last particle of the next state's group, so swap with it
+        // and move the boundary along.
+        const size_t first = state_begin_[s]++;
+        swap_particles(i, first);
+        state[first] = s + 1;
+      }
+    }
+  }
+}
+
+// Removes the given particle, which is in state s. We fill the hole with the last particle in the same group, which
+// leaves a hole at the end of the group. The group after it (the next younger state) then moves its last particle into
+// that hole and so on, until the hole is at the end of the arrays.
+void ParticleBuffer::remove_particle(size_t index, int s) {
+  if (last_emitted_ == static_cast<int>(index)) {
+    last_emitted_ = -1;
+  }
+
+  size_t hole = index;
+  for (int group = s; group >= 0; group--) {
+    if (group != s) {
+      // The hole is just before the start of this group, so make it the group's first particle.
+      state_begin_[group]--;
+    }
+    const size_t last = get_state_end(group) - 1;
+    move_particle(last, hole);
+    hole = last;
+  }
+
+  x.pop_back();
+  y.pop_back();
+  z.pop_back();
+  direction_x.pop_back();
+  direction_y.pop_back();
+  direction_z.pop_back();
+  angle.pop_back();
+  age.pop_back();
+  age_step.pop_back();
+  random.pop_back();
+  state.pop_back();
+}
+
+// Removes the particles whose age has gone past 1. Nearly all of them will be in the last state, which is the first
+// group, so removing them only has to move a handful of particles.
+void ParticleBuffer::remove_dead() {
+  for (int s = static_cast<int>(state_begin_.size()) - 1; s >= 0; s--) {
+    for (size_t i = state_begin_[s]; i < get_state_end(s);) {
+      if (age[i] > 1.0f) {
+        // Don't increment i: another particle from this group has just been moved into it.
+        remove_particle(i, s);
+      } else {
+        i++;
+      }
+    }
+  }
+}
+
+// The reference implementation of the update for the particles in state s. update_state_simd does exactly the same
+// thing, several particles at a time.
+void ParticleBuffer::update_state_scalar(
+    ParticleLifeCurves const &curves, int s, float dt, size_t begin, size_t end) {
+  const int n = curves.next[s];
+  const bool directional = (curves.directional[s] != 0);
+  const bool random_rotation = (curves.rotation[s] == ParticleRotation::kRandom);
+
+  for (size_t i = begin; i < end; i++) {
+    const float a = age[i];
+    const float t = curves.get_t(s, a);
+    const float r = random[i];
+    const float gravity = ParticleLifeCurves::lerp_random(curves.gravity_base, curves.gravity_range, s, n, r, t);
+
+    float dx, dy, dz;
+    if (directional) {
+      float from_x = curves.direction_x_base[s] + curves.direction_x_range[s] * r;
+      float from_y = curves.direction_y_base[s] + curves.direction_y_range[s] * r;
+      float from_z = curves.direction_z_base[s] + curves.direction_z_range[s] * r;
+      float from_length = std::max(
+          std::sqrt(from_x * from_x + from_y * from_y + from_z * from_z), MIN_NORMALIZE_LENGTH);
+      from_x /= from_length;
+      from_y /= from_length;
+      from_z /= from_length;
+
+      float to_x = curves.direction_x_base[n] + curves.direction_x_range[n] * r;
+      float to_y = curves.direction_y_base[n] + curves.direction_y_range[n] * r;
+      float to_z = curves.direction_z_base[n] + curves.direction_z_range[n] * r;
+      float to_length = std::max(std::sqrt(to_x * to_x + to_y * to_y + to_z * to_z), MIN_NORMALIZE_LENGTH);
+      to_x /= to_length;
+      to_y /= to_length;
+      to_z /= to_length;
+
+      dx = from_x + (to_x - from_x) * t;
+      dy = from_y + (to_y - from_y) * t - gravity * a;
+      dz = from_z + (to_z - from_z) * t;
+      const float length = std::max(std::sqrt(dx * dx + dy * dy + dz * dz), MIN_NORMALIZE_LENGTH);
+      dx /= length;
+      dy /= length;
+      dz /= length;
+    } else {
+      dx = direction_x[i];
+      dy = direction_y[i] - gravity * dt;
+      dz = direction_z[i];
+    }
+    direction_x[i] = dx;
+    direction_y[i] = dy;
+    direction_z[i] = dz;
+
+    if (random_rotation) {
+      angle[i] += ParticleLifeCurves::lerp_random(
+          curves.rotation_speed_base, curves.rotation_speed_range, s, n, r, t) * dt;
+    }
+
+    const float speed = ParticleLifeCurves::lerp_random(curves.speed_base, curves.speed_range, s, n, r, t);
+    x[i] += dx * speed * dt;
+    y[i] += dy * speed * dt;
+    z[i] += dz * speed * dt;
+  }
+}
+
+#if defined(FW_PARTICLE_AVX2) || defined(FW_PARTICLE_SSE2)
+void ParticleBuffer::update_state_simd(ParticleLifeCurves const &curves, int s, float dt, size_t begin, size_t end) {
+  using namespace simd;
+
+  const int n = curves.next[s];
+  const bool directional = (curves.directional[s] != 0);
+  const bool random_rotation = (curves.rotation[s] == ParticleRotation::kRandom);
+
+  // Every particle here is between the same two states, so the curve values are the same for all of them.
+  const Float dt4 = set(dt);
+  const Float min_length = set(MIN_NORMALIZE_LENGTH);
+  const Float state_age = set(curves.age[s]);
+  const Float inv_span = set(curves.inv_span[s]);
+
+  struct Range {
+    Float from_base;
+    Float from_range;
+    Float to_base;
+    Float to_range;
+
+    Range(std::vector<float> const &base, std::vector<float> const &range, int from_state, int to_state)
+        : from_base(set(base[from_state])), from_range(set(range[from_state])), to_base(set(base[to_state])),
+          to_range(set(range[to_state])) {
+    }
+
+    inline Float from(Float r) const {
+      return add(from_base, mul(from_range, r));
+    }
+
+    inline Float to(Float r) const {
+      return add(to_base, mul(to_range, r));
+    }
+
+    inline Float lerp(Float r, Float t) const {
+      const Float f = from(r);
+      return add(f, mul(sub(to(r), f), t));
+    }
+  };
+  const Range gravity_range(curves.gravity_base, curves.gravity_range, s, n);
+  const Range rotation_speed_range(curves.rotation_speed_base, curves.rotation_speed_range, s, n);
+  const Range speed_range(curves.speed_base, curves.speed_range, s, n);
+  const Range direction_x_range(curves.direction_x_base, curves.direction_x_range, s, n);
+  const Range direction_y_range(curves.direction_y_base, curves.direction_y_range, s, n);
+  const Range direction_z_range(curves.direction_z_base, curves.direction_z_range, s, n);
+
+  auto normalize = [min_length](Float &vx, Float &vy, Float &vz) {
+    const Float length = max(sqrt(add(add(mul(vx, vx), mul(vy, vy)), mul(vz, vz))), min_length);
+    vx = div(vx, length);
+    vy = div(vy, length);
+    vz = div(vz, length);
+  };
+
+  const size_t simd_end = begin + (end - begin) - ((end - begin) % WIDTH);
+  for (size_t i = begin; i < simd_end; i += WIDTH) {
+    const Float a = load(&age[i]);
+    const Float t = mul(sub(a, state_age), inv_span);
+    const Float r = load(&random[i]);
+    const Float gravity = gravity_range.lerp(r, t);
+
+    Float dx, dy, dz;
+    if (directional) {
+      Float from_x = direction_x_range.from(r);
+      Float from_y = direction_y_range.from(r);
+      Float from_z = direction_z_range.from(r);
+      normalize(from_x, from_y, from_z);
+      Float to_x = direction_x_range.to(r);
+      Float to_y = direction_y_range.to(r);
+      Float to_z = direction_z_range.to(r);
+      normalize(to_x, to_y, to_z);
+      dx = add(from_x, mul(sub(to_x, from_x), t));
+      dy = sub(add(from_y, mul(sub(to_y, from_y), t)), mul(gravity, a));
+      dz = add(from_z, mul(sub(to_z, from_z), t));
+      normalize(dx, dy, dz);
+    } else {
+      dx = load(&direction_x[i]);
+      dy = sub(load(&direction_y[i]), mul(gravity, dt4));
+      dz = load(&direction_z[i]);
+    }
+    store(&direction_x[i], dx);
+    store(&direction_y[i], dy);
+    store(&direction_z[i], dz);
+
+    if (random_rotation) {
+      store(&angle[i], add(load(&angle[i]), mul(rotation_speed_range.lerp(r, t), dt4)));
+    }
+
+    const Float speed_dt = mul(speed_range.lerp(r, t), dt4);
+    store(&x[i], add(load(&x[i]), mul(dx, speed_dt)));
+    store(&y[i], add(load(&y[i]), mul(dy, speed_dt)));
+    store(&z[i], add(load(&z[i]), mul(dz, speed_dt)));
+  }
+
+  update_state_scalar(curves, s, dt, simd_end, end);
+}
+
+char const *ParticleBuffer::get_simd_name() {
+  return simd::NAME;
+}
+#else
+void ParticleBuffer::update_state_simd(ParticleLifeCurves const &curves, int s, float dt, size_t begin, size_t end) {
+  update_state_scalar(curves, s, dt, begin, end);
+}
+
+char const *ParticleBuffer::get_simd_name() {
+  return "scalar";
+}
+#endif
+
+}
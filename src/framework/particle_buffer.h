@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <framework/math.h>
+
+namespace fw {
+
+enum ParticleRotation {
+  kRandom, kDirection
+};
+
+// The life states of a ParticleEmitterConfig, flattened into arrays (one entry per state) that the particle update
+// kernels can index directly. This is built once per config, every particle of the emitter shares it.
+//
+// The config gives most properties as a random range. Rather than choosing a value for each particle and each state
+// when the particle is emitted, we store the range here (as base + range) and each particle has a single random
+// number between 0 and 1 that picks where in each range it sits.
+struct ParticleLifeCurves {
+  int num_states = 0;
+
+  // The age (between 0 and 1) at which each state starts, and 1 / (the time until the next state starts), or 0 for the
+  // last state.
+  std::vector<float> age;
+  std::vector<float> inv_span;
+
+  // The index of the state after each state (the last state's "next" state is itself).
+  std::vector<int32_t> next;
+
+  std::vector<float> size_base;
+  std::vector<float> size_range;
+  std::vector<float> rotation_speed_base;
+  std::vector<float> rotation_speed_range;
+  std::vector<float> speed_base;
+  std::vector<float> speed_range;
+  std::vector<float> gravity_base;
+  std::vector<float> gravity_range;
+  std::vector<float> direction_x_base;
+  std::vector<float> direction_x_range;
+  std::vector<float> direction_y_base;
+  std::vector<float> direction_y_range;
+  std::vector<float> direction_z_base;
+  std::vector<float> direction_z_range;
+  std::vector<float> alpha;
+  std::vector<int32_t> color_row;
+  std::vector<int32_t> rotation;
+
+  // Non-zero if both this state and the next have a direction, in which case the particle's direction is interpolated
+  // between them. Otherwise, the particle just keeps going the way it was (plus gravity).
+  std::vector<int32_t> directional;
+
+  // Appends a state. The states must be added in order of age. Call finish() once they've all been added.
+  void add_state(
+      float state_age, float size_min, float size_max, float rotation_speed_min, float rotation_speed_max,
+      ParticleRotation state_rotation, fw::Vector const &direction_min, fw::Vector const &direction_max,
+      float speed_min, float speed_max, float gravity_min, float gravity_max, float state_alpha, int state_color_row);
+  void finish();
+
+  // Gets the interpolation factor between the given state and the next one, for a particle of the given age.
+  inline float get_t(int state, float particle_age) const {
+    return (particle_age - age[state]) * inv_span[state];
+  }
+
+  // Gets the value of a random property for a particle, interpolated between the given state and the next one.
+  static inline float lerp_random(
+      std::vector<float> const &base, std::vector<float> const &range, int state, int next_state, float random,
+      float t) {
+    const float from = base[state] + range[state] * random;
+    const float to = base[next_state] + range[next_state] * random;
+    return from + (to - from) * t;
+  }
+};
+
+// ParticleBuffer holds all of the particles of a single emitter as a structure of arrays, so that the update can
+// stream through each property and process several particles at once with SIMD instructions. There's no per-particle
+// allocation: emitting a particle appends to the arrays, and dead particles are removed by moving other particles
+// into their place (so the order of particles is not stable).
+//
+// The particles are kept grouped by their current life state, with the oldest state first: [state n-1]...[state 0].
+// That means the kernels see a run of particles that are all interpolating between the same two states, so they can
+// use the curve values directly rather than looking them up per particle. New particles are in state 0, so they go on
+// the end, and when a particle moves on to the next state we just swap it with the first particle of its group and
+// move the boundary along by one.
+class ParticleBuffer {
+public:
+  // Which implementation of the update to use. kSimd uses AVX2 if we're compiled with it, otherwise SSE2, otherwise
+  // it's the same as kScalar.
+  enum class Kernel {
+    kScalar,
+    kSimd,
+  };
+
+  // The particles' properties. The renderer reads these directly.
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> direction_x;
+  std::vector<float> direction_y;
+  std::vector<float> direction_z;
+  std::vector<float> angle;
+
+  // The particle's age, between 0 (just emitted) and 1 (about to die), and how much that increases by per second.
+  std::vector<float> age;
+  std::vector<float> age_step;
+
+  // A random number between 0 and 1 that picks the value of each of the life state's random properties.
+  std::vector<float> random;
+
+  // The index of the life state the particle is currently in (it's interpolating between this one and the next).
+  std::vector<int32_t> state;
+
+private:
+  // The index of the first particle in each life state's group. state_begin_[num_states - 1] is always 0.
+  std::vector<size_t> state_begin_;
+
+  // The index of the last particle we emitted (kept up-to-date as particles move around), or -1 if it's died.
+  int last_emitted_;
+
+  inline size_t get_state_end(int s) const {
+    return s == 0 ? size() : state_begin_[s - 1];
+  }
+
+  void move_particle(size_t from, size_t to);
+  void swap_particles(size_t a, size_t b);
+  void remove_particle(size_t index, int s);
+  void advance_states(ParticleLifeCurves const &curves);
+  void remove_dead();
+  void update_state_scalar(ParticleLifeCurves const &curves, int s, float dt, size_t begin, size_t end);
+  void update_state_simd(ParticleLifeCurves const &curves, int s, float dt, size_t begin, size_t end);
+
+public:
+  // num_states must be the same as the ParticleLifeCurves we're updated with.
+  explicit ParticleBuffer(int num_states);
+
+  inline size_t size() const {
+    return age.size();
+  }
+
+  // Adds a new particle, and returns its index.
+  int emit(fw::Vector const &pos, fw::Vector const &direction, float initial_age, float max_age, float rand);
+
+  // Updates the position, direction, etc of every particle and removes the ones that have died.
+  void update(ParticleLifeCurves const &curves, float dt, Kernel kernel = Kernel::kSimd);
+
+  // Gets the index of the last particle emitted, or -1 if it has since died.
+  int get_last_emitted() const {
+    return last_emitted_;
+  }
+
+  fw::Vector get_position(int index) const {
+    return fw::Vector(x[index], y[index], z[index]);
+  }
+
+  void clear();
+
+  // Gets the name of the instruction set Kernel::kSimd uses.
+  static char const *get_simd_name();
+};
+
+}
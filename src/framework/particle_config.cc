@@ -183,6 +183,14 @@ fw::Status ParticleEmitterConfig::LoadEmitter(XmlElement const &emitter_elem) {
       return fw::ErrorStatus("unknown child element of <emitter>: ") << child.get_value();
     }
   }
+
+  for (LifeState const &state : life) {
+    curves.add_state(
+        state.age, state.size.min, state.size.max, state.rotation_speed.min, state.rotation_speed.max,
+        state.rotation, state.direction.min, state.direction.max, state.speed.min, state.speed.max,
+        state.gravity.min, state.gravity.max, state.alpha, state.color_row);
+  }
+  curves.finish();
   return fw::OkStatus();
 }
 
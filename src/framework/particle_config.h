@@ -5,7 +5,7 @@
 
 #include <framework/color.h>
 #include <framework/math.h>
-#include <framework/particle.h>
+#include <framework/particle_buffer.h>
 #include <framework/status.h>
 #include <framework/texture.h>
 #include <framework/xml.h>
@@ -161,6 +161,9 @@ public:
   // to lerp between each LifeState to provide smooth Particle effects.
   std::vector<LifeState> life;
 
+  // The life states above, flattened into the form that ParticleBuffer::update wants. Built once the config is loaded.
+  ParticleLifeCurves curves;
+
   // This is the "policy" we use for deciding when to emit a new Particle.
   std::string emit_policy_name;
   float emit_policy_value;
@@ -1,7 +1,6 @@
 #include <stack>
 
 #include <framework/misc.h>
-#include <framework/particle.h>
 #include <framework/particle_config.h>
 #include <framework/particle_emitter.h>
 #include <framework/particle_manager.h>
@@ -9,10 +8,9 @@
 namespace fw {
 
 ParticleEmitter::ParticleEmitter(
-    ParticleManager *mgr, ObjectPool<Particle>& particle_pool, std::shared_ptr<ParticleEmitterConfig> config,
-    const fw::Vector& initial_position)
-    : mgr_(mgr), particle_pool_(particle_pool), emit_policy_(0), config_(config), dead_(false), age_(0.0f),
-      position_(initial_position) {
+    ParticleManager *mgr, std::shared_ptr<ParticleEmitterConfig> config, const fw::Vector& initial_position)
+    : mgr_(mgr), emit_policy_(0), config_(config), dead_(false), age_(0.0f), position_(initial_position),
+      particles_(config->curves.num_states) {
   if (config_->emit_policy_name == "distance") {
     emit_policy_ = new DistanceEmitPolicy(this, config_->emit_policy_value);
   } else if (config_->emit_policy_name == "timed") {
@@ -48,16 +46,8 @@ bool ParticleEmitter::update(float dt) {
     emit_policy_->check_emit(dt);
   }
 
-  // go through each Particle and update it's various properties
-  for (ParticleList::iterator it = particles_.begin(); it != particles_.end();) {
-    auto p = *it;
-    if (!p->update(dt)) {
-      // It's dead, so remove it.
-      it = particles_.erase(it);
-    } else {
-      ++it;
-    }
-  }
+  // update all of the particles' various properties, and remove the ones that have died
+  particles_.update(config_->curves, dt);
 
   return (!dead_ || particles_.size() != 0);
 }
@@ -68,16 +58,10 @@ void ParticleEmitter::destroy() {
 
 // This is called when it's time to emit a new Particle. The offset is used when emitting "extra" particles, we need
 // to offset their age and position a bit.
-std::shared_ptr<Particle> ParticleEmitter::emit(fw::Vector pos, float time_offset /*= 0.0f*/) {
-  std::shared_ptr<Particle> p(particle_pool_.get_or_new());
-  p->initialize(config_);
-  p->pos = pos;
-  p->age = time_offset;
-
-  particles_.push_back(p);
-  mgr_->add_particle(p);
-
-  return p;
+void ParticleEmitter::emit(fw::Vector pos, float time_offset /*= 0.0f*/) {
+  fw::Vector direction =
+      fw::Vector(fw::random() - 0.5f, fw::random() - 0.5f, fw::random() - 0.5f).normalized();
+  particles_.emit(pos, direction, time_offset, config_->max_age.GetValue(), fw::random());
 }
 
 //-------------------------------------------------------------------------
@@ -124,9 +108,10 @@ DistanceEmitPolicy::~DistanceEmitPolicy() {
 }
 
 void DistanceEmitPolicy::check_emit(float) {
-  std::shared_ptr<Particle> last_particle = last_particle_.lock();
-  if (!last_particle) {
-    last_particle_ = emitter_->emit(emitter_->get_position());
+  ParticleBuffer const &particles = emitter_->get_particles();
+  const int last_particle = particles.get_last_emitted();
+  if (last_particle < 0) {
+    emitter_->emit(emitter_->get_position());
     return;
   }
 
@@ -134,7 +119,7 @@ void DistanceEmitPolicy::check_emit(float) {
   float wrap_z = emitter_->get_manager()->get_wrap_z();
 
   fw::Vector next_pos = emitter_->get_position();
-  fw::Vector last_pos = last_particle->pos;
+  fw::Vector last_pos = particles.get_position(last_particle);
   fw::Vector dir = get_direction_to(last_pos, next_pos, wrap_x, wrap_z).normalized();
   fw::Vector curr_pos = last_pos + (dir * max_distance_);
 
@@ -143,7 +128,7 @@ void DistanceEmitPolicy::check_emit(float) {
   float this_distance = calculate_distance(curr_pos, next_pos, wrap_x, wrap_z);
   float last_distance = this_distance + 1.0f;
   while (last_distance >= this_distance) {
-    last_particle_ = emitter_->emit(curr_pos, time_offset);
+    emitter_->emit(curr_pos, time_offset);
     curr_pos += dir * max_distance_;
 
     last_distance = this_distance;
@@ -1,15 +1,13 @@
 #pragma once
 
-#include <list>
 #include <memory>
 
 #include <framework/math.h>
-#include <framework/object_pool.h>
+#include <framework/particle_buffer.h>
 #include <framework/xml.h>
 
 namespace fw {
 class ParticleManager;
-class Particle;
 class ParticleEmitterConfig;
 class EmitPolicy;
 
@@ -20,13 +18,10 @@ class EmitPolicy;
 class ParticleEmitter {
 private:
   std::shared_ptr<ParticleEmitterConfig> config_;
-  ObjectPool<Particle>& particle_pool_;
   ParticleManager *mgr_;
   float age_;
   int initial_count_;
-
-  typedef std::list<std::shared_ptr<Particle>> ParticleList;
-  ParticleList particles_;
+  ParticleBuffer particles_;
 
   fw::Vector position_;
   EmitPolicy *emit_policy_;
@@ -34,8 +29,7 @@ private:
 
 public:
   ParticleEmitter(
-    ParticleManager *mgr, ObjectPool<Particle>& particle_pool, std::shared_ptr<ParticleEmitterConfig> config,
-    const fw::Vector& initial_position);
+    ParticleManager *mgr, std::shared_ptr<ParticleEmitterConfig> config, const fw::Vector& initial_position);
   ~ParticleEmitter();
 
   bool update(float dt);
@@ -57,8 +51,16 @@ public:
     return mgr_;
   }
 
+  std::shared_ptr<ParticleEmitterConfig> const &get_config() const {
+    return config_;
+  }
+
+  ParticleBuffer const &get_particles() const {
+    return particles_;
+  }
+
   // This is called by the EmitPolicy when it decides to emit a new Particle.
-  std::shared_ptr<Particle> emit(fw::Vector pos, float time_offset = 0.0f);
+  void emit(fw::Vector pos, float time_offset = 0.0f);
 };
 
 // This is the base class for the "policy" which decide how and when we emit new particles. It might be an "x per
@@ -96,7 +98,6 @@ public:
 // becomes greater than some threshold.
 class DistanceEmitPolicy: public EmitPolicy {
 private:
-  std::weak_ptr<Particle> last_particle_;
   float max_distance_;
 
 public:
@@ -3,22 +3,17 @@
 #include <framework/particle_emitter.h>
 #include <framework/particle_effect.h>
 #include <framework/particle_config.h>
-#include <framework/particle.h>
 #include <framework/particle_renderer.h>
+#include <framework/camera.h>
 #include <framework/framework.h>
+#include <framework/paths.h>
 #include <framework/timer.h>
 #include <framework/scenegraph.h>
 
 namespace fw {
 
 ParticleManager::ParticleManager() :
-    renderer_(nullptr), wrap_x_(0.0f), wrap_z_(0.0f), particle_pool_(/*initial_size=*/1000) {
-  renderer_ = new ParticleRenderer(this);
-  auto* renderer = renderer_;
-  fw::Framework::get_instance()->get_scenegraph_manager()->enqueue(
-    [renderer](fw::sg::Scenegraph& scenegraph) {
-      scenegraph.add_callback(renderer);
-    });
+    renderer_(nullptr), wrap_x_(0.0f), wrap_z_(0.0f), num_active_particles_(0) {
 }
 
 ParticleManager::~ParticleManager() {
@@ -26,6 +21,20 @@ ParticleManager::~ParticleManager() {
 }
 
 fw::Status ParticleManager::Initialize() {
+  color_texture_ = std::make_shared<fw::Texture>();
+  color_texture_->create(fw::resolve("particles/colors.png"));
+
+  sg::ScenegraphManager *scenegraph_manager = fw::Framework::get_instance()->get_scenegraph_manager();
+  if (scenegraph_manager == nullptr) {
+    return fw::OkStatus();
+  }
+
+  renderer_ = new ParticleRenderer(this, color_texture_);
+  auto* renderer = renderer_;
+  scenegraph_manager->enqueue(
+    [renderer](fw::sg::Scenegraph& scenegraph) {
+      scenegraph.add_callback(renderer);
+    });
   return renderer_->Initialize();
 }
 
@@ -35,38 +44,48 @@ void ParticleManager::set_world_wrap(float x, float z) {
 }
 
 void ParticleManager::update(float dt) {
-  paused_.store(fw::Framework::get_instance()->is_paused());
+  fw::Framework *framework = fw::Framework::get_instance();
+  fw::Camera *camera = framework->get_camera();
+
+  // Even when we're paused, we still build a new snapshot so that the particles keep facing the camera.
+  simulate(
+      framework->is_paused() ? 0.0f : dt, camera != nullptr ? camera->get_position() : fw::Vector(0.0f, 0.0f, 0.0f));
 }
 
-ParticleManager::ParticleList& ParticleManager::on_render(float dt) {
-  if (!paused_.load()) {
-    std::unique_lock<std::mutex> lock(mutex_);
+void ParticleManager::simulate(float dt, fw::Vector const &camera_position) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (dt > 0.0f) {
     for (EffectList::iterator it = effects_.begin(); it != effects_.end(); ++it) {
       (*it)->update(dt);
     }
   }
 
-  if (!paused_.load()) {
-    // remove any dead particles
-    particles_.erase(std::remove_if(particles_.begin(), particles_.end(), [](const std::weak_ptr<Particle>& p) {
-      // If the underlying shared_ptr is gone, we remove it.
-      return p.expired();
-    }), particles_.end());
+  snapshot_builder_.begin(camera_position, wrap_x_, wrap_z_, color_texture_ ? color_texture_->get_height() : 1);
+  for (auto const &effect : effects_) {
+    for (auto const &emitter : effect->get_emitters()) {
+      snapshot_builder_.add_emitter(*emitter);
+    }
   }
 
-  // Return the particles so that the renderer can render them.
-  return particles_;
+  ParticleSnapshot &snapshot = snapshots_.get_write_buffer();
+  snapshot_builder_.finish(snapshot);
+  num_active_particles_ = snapshot.num_particles;
+  snapshots_.publish();
+}
+
+ParticleSnapshot const &ParticleManager::get_latest_snapshot() {
+  snapshots_.update_read_buffer();
+  return snapshots_.get_read_buffer();
 }
 
 long ParticleManager::get_num_active_particles() const {
-  // some may have died but not been removed yet, that's OK as this is just to give us an idea.
-  return particles_.size();
+  return num_active_particles_;
 }
 
 fw::StatusOr<std::shared_ptr<ParticleEffect>> ParticleManager::CreateEffect(
     std::string_view name, fw::Vector const &initial_position) {
   ASSIGN_OR_RETURN(auto config, ParticleEffectConfig::Load(name));
-  auto effect = std::make_shared<ParticleEffect>(this, particle_pool_, config, initial_position);
+  auto effect = std::make_shared<ParticleEffect>(this, config, initial_position);
 
   {
     std::unique_lock<std::mutex> lock(mutex_);
@@ -86,10 +105,4 @@ void ParticleManager::remove_effect(const std::shared_ptr<ParticleEffect>& effec
   }
 }
 
-void ParticleManager::add_particle(std::weak_ptr<Particle> p) {
-  FW_ENSURE_RENDER_THREAD();
-
-  particles_.push_back(p);
-}
-
 }
@@ -1,54 +1,65 @@
 #pragma once
 
-#include <atomic>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <vector>
 
 #include <framework/graphics.h>
-#include <framework/object_pool.h>
+#include <framework/math.h>
+#include <framework/particle_snapshot.h>
 #include <framework/status.h>
 #include <framework/texture.h>
+#include <framework/triple_buffer.h>
 
 namespace fw {
-class Particle;
-class ParticleEmitter;
 class ParticleEffect;
 class ParticleRenderer;
 
-/** The ParticleManager manages all of the Particle emitters in the game. */
+/**
+ * The ParticleManager manages all of the Particle emitters in the game. The particles are simulated on the update
+ * thread, which then publishes a ParticleSnapshot of render-ready quads. The renderer just picks up the latest
+ * snapshot and uploads it, so it never touches the emitters themselves.
+ */
 class ParticleManager {
 public:
   typedef std::list<std::shared_ptr<ParticleEffect>> EffectList;
-  typedef std::list<std::weak_ptr<Particle>> ParticleList;
 
 private:
-  // Controls access to the effect list, which can be access from both the render thread and update
-  // thread.
+  // Controls access to the effect list, in case effects are created from some thread other than the update thread.
   std::mutex mutex_;
 
-  ObjectPool<Particle> particle_pool_;
   ParticleRenderer *renderer_;
+  std::shared_ptr<Texture> color_texture_;
   EffectList effects_;
-  ParticleList particles_;
   float wrap_x_;
   float wrap_z_;
+  long num_active_particles_;
 
-  // If true, the game is paused, so we shouldn't update any particules either. Particulars are
-  // updated on the render thread, so we need this to be atomic.
-  std::atomic<bool> paused_;
+  ParticleSnapshotBuilder snapshot_builder_;
+
+  // Written by whoever calls simulate() (normally the update thread), read by the renderer.
+  TripleBuffer<ParticleSnapshot> snapshots_;
 
 public:
   ParticleManager();
   ~ParticleManager();
 
+  // Loads the color texture and, if there's a scenegraph to render to, sets up the renderer. Without one (e.g. when
+  // particle-test is running headless) we can still simulate and build snapshots, nobody will draw them.
   fw::Status Initialize();
+
+  // This is called on the update thread. It simulates the particles (unless the game is paused) and publishes a new
+  // snapshot as seen from the current camera.
   void update(float dt);
 
-  // This is called by the ParticleRenderer when we're about to render the particles. We return the
-  // particle list so that it can actually render the particles.
-  ParticleList& on_render(float dt);
+  // Simulates all of the effects by dt seconds, then builds a snapshot of them as seen from the given camera position
+  // and publishes it.
+  void simulate(float dt, fw::Vector const &camera_position);
+
+  // Gets the most recently published snapshot. Only the renderer (or when we're headless, whoever is calling
+  // simulate()) should call this.
+  ParticleSnapshot const &get_latest_snapshot();
 
   // created the named effect (we load the properties from the given .wwpart file)
   fw::StatusOr<std::shared_ptr<ParticleEffect>> CreateEffect(
@@ -70,9 +81,6 @@ public:
 
   /** Gets a count of the number of active (alive) particles, mostly for debugging. */
   long get_num_active_particles() const;
-
-  // this is called by the ParticleEmitter to add a new Particle
-  void add_particle(std::weak_ptr<Particle> p);
 };
 
 }
@@ -1,41 +1,35 @@
 #pragma once
 
-#include <list>
 #include <memory>
+#include <vector>
 
 #include <framework/texture.h>
 #include <framework/scenegraph.h>
 #include <framework/shader.h>
 #include <framework/status.h>
 
-struct RenderState;
-
 namespace fw {
-class Particle;
 class ParticleManager;
+struct ParticleSnapshot;
 
-// The ParticleRenderer is responsible for rendering particles. We create our own special Scenegraph Node that does
-// the main work.
+// The ParticleRenderer is responsible for rendering particles. The ParticleManager gives us a snapshot of quads that
+// are already built and sorted, so all we do is upload them in batches.
 class ParticleRenderer : public fw::sg::ScenegraphCallback {
-public:
-  // This is the type of a list of particles. It must match the ParticleList type defined in ParticleManager.
-  typedef std::list<std::weak_ptr<Particle>> ParticleList;
-
 private:
   std::shared_ptr<Shader> shader_;
   std::shared_ptr<ShaderParameters> shader_params_;
   std::shared_ptr<Texture> color_texture_;
   ParticleManager *mgr_;
-  int draw_frame_;
 
-  void render_particles(RenderState &rs, float offset_x, float offset_z);
-  bool add_particle(RenderState &rs, int base_index, std::shared_ptr<Particle>& p, float offset_x, float offset_z);
+  // The indices for a full batch of quads. They're the same every frame, so we just build them once.
+  std::vector<uint16_t> quad_indices_;
 
-  // sort the particles so they're optimal for rendering
-  void sort_particles(ParticleRenderer::ParticleList &particles);
+  void render_batch(
+      fw::sg::Scenegraph &scenegraph, ParticleSnapshot const &snapshot, std::shared_ptr<Texture> const &texture,
+      std::string const &program_name, int first_quad, int num_quads);
 
 public:
-  ParticleRenderer(ParticleManager *mgr);
+  ParticleRenderer(ParticleManager *mgr, std::shared_ptr<Texture> const &color_texture);
   ~ParticleRenderer();
 
   fw::Status Initialize();
@@ -0,0 +1,174 @@
+#include <framework/particle_snapshot.h>
+
+#include <algorithm>
+#include <bit>
+
+#include <framework/color.h>
+#include <framework/particle_buffer.h>
+#include <framework/particle_emitter.h>
+
+namespace fw {
+namespace {
+
+// We only draw particles that are closer than this to the camera.
+const float MAX_DRAW_DISTANCE = 50.0f;
+
+// The sort key is (texture/mode index << 32) | depth. It doesn't matter which order the texture/modes are drawn in, as
+// long as each one's particles are together. The depth is inverted so that the furthest particles sort first (the
+// bits of a positive float sort the same way as the float itself).
+inline uint64_t get_depth_key(float distance) {
+  return static_cast<uint64_t>(~std::bit_cast<uint32_t>(distance));
+}
+
+}
+
+void ParticleSnapshot::dump(std::ostream &out) const {
+  out << "particles " << num_particles << " quads " << get_num_quads() << " batches " << batches.size() << std::endl;
+  for (Batch const &batch : batches) {
+    out << "batch texture " << (batch.texture ? batch.texture->get_filename().filename().string() : "<none>")
+        << " mode " << (batch.mode == ParticleEmitterConfig::kAdditive ? "additive" : "normal")
+        << " first " << batch.first_quad << " count " << batch.num_quads << std::endl;
+    for (int quad = batch.first_quad; quad < batch.first_quad + batch.num_quads; quad++) {
+      out << "  quad";
+      for (int i = 0; i < 4; i++) {
+        vertex::xyz_c_uv const &v = vertices[quad * 4 + i];
+        out << " (" << v.x << "," << v.y << "," << v.z << " " << std::hex << v.color << std::dec << " " << v.u
+            << "," << v.v << ")";
+      }
+      out << std::endl;
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+
+ParticleSnapshotBuilder::ParticleSnapshotBuilder()
+  : wrap_x_(0.0f), wrap_z_(0.0f), color_texture_factor_(1.0f), num_particles_(0) {
+}
+
+void ParticleSnapshotBuilder::begin(
+    fw::Vector const &camera_position, float wrap_x, float wrap_z, int color_texture_height) {
+  camera_position_ = camera_position;
+  wrap_x_ = wrap_x;
+  wrap_z_ = wrap_z;
+  // The color_row is divided by this value to get the value between 0 and 1.
+  color_texture_factor_ = 1.0f / static_cast<float>(std::max(color_texture_height, 1));
+  num_particles_ = 0;
+  texture_modes_.clear();
+  vertices_.clear();
+  keys_.clear();
+}
+
+uint64_t ParticleSnapshotBuilder::get_texture_mode_key(ParticleEmitterConfig const &config) {
+  // There's only ever a handful of these, so a linear search is fine.
+  size_t index = 0;
+  for (; index < texture_modes_.size(); index++) {
+    if (texture_modes_[index].texture == config.billboard.texture
+        && texture_modes_[index].mode == config.billboard.mode) {
+      break;
+    }
+  }
+  if (index == texture_modes_.size()) {
+    texture_modes_.push_back(TextureMode { config.billboard.texture, config.billboard.mode });
+  }
+  return static_cast<uint64_t>(index) << 32;
+}
+
+void ParticleSnapshotBuilder::add_emitter(ParticleEmitter const &emitter) {
+  ParticleEmitterConfig const &config = *emitter.get_config();
+  ParticleBuffer const &particles = emitter.get_particles();
+  ParticleLifeCurves const &curves = config.curves;
+  const int count = static_cast<int>(particles.size());
+  num_particles_ += count;
+  if (count == 0) {
+    return;
+  }
+
+  const uint64_t texture_mode_key = get_texture_mode_key(config);
+  const bool wrap = (wrap_x_ > 1.0f && wrap_z_ > 1.0f);
+  for (int i = 0; i < count; i++) {
+    // If the world wraps, draw the particle at the first copy of it that's close enough to the camera.
+    fw::Vector pos;
+    fw::Vector dir_to_cam;
+    bool visible = false;
+    for (int z = (wrap ? -1 : 0); z <= (wrap ? 1 : 0) && !visible; z++) {
+      for (int x = (wrap ? -1 : 0); x <= (wrap ? 1 : 0) && !visible; x++) {
+        pos = fw::Vector(particles.x[i] + x * wrap_x_, particles.y[i], particles.z[i] + z * wrap_z_);
+        dir_to_cam = camera_position_ - pos;
+        visible = (dir_to_cam.length() <= MAX_DRAW_DISTANCE);
+      }
+    }
+    if (!visible) {
+      continue;
+    }
+
+    // Work out the properties that only the renderer cares about from the particle's life state.
+    const int s = particles.state[i];
+    const int n = curves.next[s];
+    const float t = curves.get_t(s, particles.age[i]);
+    const float r = particles.random[i];
+    const float size = ParticleLifeCurves::lerp_random(curves.size_base, curves.size_range, s, n, r, t);
+    const float alpha = fw::lerp(curves.alpha[s], curves.alpha[n], t);
+
+    Rectangle<float> rect;
+    if (config.billboard.areas.size() < 1) {
+      rect.left = rect.top = 0.0f;
+      rect.width = rect.height = 1.0f;
+    } else {
+      rect = config.billboard.areas[static_cast<int>(r * (config.billboard.areas.size() - 1))];
+    }
+
+    fw::Color color(alpha, (static_cast<float>(curves.color_row[s]) + 0.5f) * color_texture_factor_,
+        (static_cast<float>(curves.color_row[n]) + 0.5f) * color_texture_factor_, t);
+    const uint32_t abgr = color.to_abgr();
+
+    Matrix m = fw::scale(size);
+    if (curves.rotation[s] != ParticleRotation::kDirection) {
+      m *= fw::rotate_axis_angle(Vector(0, 0, 1), particles.angle[i]);
+      m *= fw::align(dir_to_cam, Vector(0, 0, 1));
+    } else {
+      m *= fw::rotate(
+          Vector(-1, 0, 0), Vector(particles.direction_x[i], particles.direction_y[i], particles.direction_z[i]));
+    }
+    m *= fw::translation(pos);
+
+    const float aspect = rect.height / rect.width;
+
+    keys_.push_back(RadixSortItem {
+        texture_mode_key | get_depth_key(dir_to_cam.length()), static_cast<uint32_t>(vertices_.size() / 4) });
+
+    fw::Vector v = m * fw::Vector(-0.5f, -0.5f * aspect, 0);
+    vertices_.push_back(fw::vertex::xyz_c_uv(v[0], v[1], v[2], abgr, rect.left, rect.top + rect.height));
+    v = m * fw::Vector(-0.5f, 0.5f * aspect, 0);
+    vertices_.push_back(fw::vertex::xyz_c_uv(v[0], v[1], v[2], abgr, rect.left, rect.top));
+    v = m * fw::Vector(0.5f, 0.5f * aspect, 0);
+    vertices_.push_back(fw::vertex::xyz_c_uv(v[0], v[1], v[2], abgr, rect.left + rect.width, rect.top));
+    v = m * fw::Vector(0.5f, -0.5f * aspect, 0);
+    vertices_.push_back(
+        fw::vertex::xyz_c_uv(v[0], v[1], v[2], abgr, rect.left + rect.width, rect.top + rect.height));
+  }
+}
+
+void ParticleSnapshotBuilder::finish(ParticleSnapshot &snapshot) {
+  radix_sort(keys_, scratch_);
+
+  snapshot.num_particles = num_particles_;
+  snapshot.batches.clear();
+  snapshot.vertices.resize(vertices_.size());
+  for (size_t i = 0; i < keys_.size(); i++) {
+    const uint64_t texture_mode_index = keys_[i].key >> 32;
+    if (i == 0 || texture_mode_index != (keys_[i - 1].key >> 32)) {
+      TextureMode const &texture_mode = texture_modes_[texture_mode_index];
+      snapshot.batches.push_back(
+          ParticleSnapshot::Batch { texture_mode.texture, texture_mode.mode, static_cast<int>(i), 0 });
+    }
+    snapshot.batches.back().num_quads++;
+
+    const size_t from = keys_[i].value * 4;
+    for (int v = 0; v < 4; v++) {
+      snapshot.vertices[i * 4 + v] = vertices_[from + v];
+    }
+  }
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <framework/graphics.h>
+#include <framework/math.h>
+#include <framework/particle_config.h>
+#include <framework/radix_sort.h>
+#include <framework/texture.h>
+
+namespace fw {
+class ParticleEmitter;
+
+// A ParticleSnapshot is everything the renderer needs to draw one frame's worth of particles: the quads are already
+// built (facing the camera), and sorted by texture, then billboard mode and then back-to-front, so all the renderer
+// has to do is upload each batch. They're built on the update thread by the ParticleManager.
+struct ParticleSnapshot {
+  // A run of quads that all use the same texture and mode.
+  struct Batch {
+    std::shared_ptr<Texture> texture;
+    ParticleEmitterConfig::BillboardMode mode;
+    int first_quad;
+    int num_quads;
+  };
+
+  // Four vertices per quad, in the order they should be drawn.
+  std::vector<vertex::xyz_c_uv> vertices;
+  std::vector<Batch> batches;
+
+  // The number of (alive) particles we looked at, including the ones too far away from the camera to be drawn.
+  int num_particles = 0;
+
+  inline int get_num_quads() const {
+    return static_cast<int>(vertices.size() / 4);
+  }
+
+  // Writes a human-readable description of the snapshot, one line per batch and one per quad. This is used by
+  // particle-test's headless mode, so that changes to the particle system can be compared without a window.
+  void dump(std::ostream &out) const;
+};
+
+// Builds ParticleSnapshots. We keep one of these around, so that its scratch space is reused from frame to frame.
+class ParticleSnapshotBuilder {
+private:
+  struct TextureMode {
+    std::shared_ptr<Texture> texture;
+    ParticleEmitterConfig::BillboardMode mode;
+  };
+
+  fw::Vector camera_position_;
+  float wrap_x_;
+  float wrap_z_;
+  float color_texture_factor_;
+  int num_particles_;
+
+  // The distinct texture/modes we've seen so far this frame: the index into this is part of the sort key.
+  std::vector<TextureMode> texture_modes_;
+
+  // The quads in the order we built them, and the sort keys whose values index into them.
+  std::vector<vertex::xyz_c_uv> vertices_;
+  std::vector<RadixSortItem> keys_;
+  std::vector<RadixSortItem> scratch_;
+
+  uint64_t get_texture_mode_key(ParticleEmitterConfig const &config);
+
+public:
+  ParticleSnapshotBuilder();
+
+  // Starts building a new snapshot. color_texture_height is the height of the texture the life states' color_row
+  // refers to.
+  void begin(fw::Vector const &camera_position, float wrap_x, float wrap_z, int color_texture_height);
+
+  // Adds quads for all of the given emitter's particles that are close enough to the camera to be seen.
+  void add_emitter(ParticleEmitter const &emitter);
+
+  // Sorts the quads we've added and writes them to the given snapshot, replacing whatever was in it before.
+  void finish(ParticleSnapshot &snapshot);
+};
+
+}
@@ -0,0 +1,65 @@
+#include <framework/passability_grid.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <framework/height_field.h>
+#include <framework/misc.h>
+
+namespace fw {
+
+PassabilityGrid::PassabilityGrid(int width, int length) :
+    width_(width), length_(length), words_per_row_((width + 63) / 64), bits_(words_per_row_ * length),
+    slopes_(width * length, 255) {
+}
+
+PassabilityGrid::PassabilityGrid(int width, int length, std::vector<bool> const &passability) :
+    PassabilityGrid(width, length) {
+  for (int z = 0; z < length_; z++) {
+    for (int x = 0; x < width_; x++) {
+      if (passability[(z * width_) + x]) {
+        set_passable(x, z, true);
+      }
+    }
+  }
+}
+
+PassabilityGrid::PassabilityGrid(HeightField const &height_field, float min_passable_slope) :
+    PassabilityGrid(height_field.get_width(), height_field.get_length()) {
+  update(height_field, min_passable_slope, 0, 0, width_ - 1, length_ - 1);
+}
+
+void PassabilityGrid::set_row(int z, uint64_t const *words) {
+  std::copy(words, words + words_per_row_, bits_.begin() + (z * words_per_row_));
+
+  // Keep the bits past the end of the row clear, so that get_bits doesn't have to mask them off.
+  if (width_ % 64 != 0) {
+    bits_[(z * words_per_row_) + words_per_row_ - 1] &= (1ULL << (width_ % 64)) - 1;
+  }
+}
+
+void PassabilityGrid::update(
+    HeightField const &height_field, float min_passable_slope, int min_x, int min_z, int max_x, int max_z) {
+  // If the rectangle covers the whole map (or more), don't do any of it twice.
+  if (max_x - min_x + 1 >= width_) {
+    min_x = 0;
+    max_x = width_ - 1;
+  }
+  if (max_z - min_z + 1 >= length_) {
+    min_z = 0;
+    max_z = length_ - 1;
+  }
+
+  for (int z = min_z; z <= max_z; z++) {
+    const int wrapped_z = fw::constrain(z, length_);
+    for (int x = min_x; x <= max_x; x++) {
+      const int wrapped_x = fw::constrain(x, width_);
+      const float slope = height_field.get_vertex_slope(wrapped_x, wrapped_z);
+      slopes_[(wrapped_z * width_) + wrapped_x] =
+          static_cast<uint8_t>(std::lround(std::clamp(slope, 0.0f, 1.0f) * 255.0f));
+      set_passable(wrapped_x, wrapped_z, slope > min_passable_slope);
+    }
+  }
+}
+
+}
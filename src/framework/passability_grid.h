@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace fw {
+
+class HeightField;
+
+// PassabilityGrid records, with one bit per cell, whether each cell of a width x length grid can be travelled over,
+// along with the slope of the terrain at each cell (quantized to a byte). Path finders hold it by std::shared_ptr so
+// that several of them (e.g. one per pathing worker thread) can search the same grid without each keeping a copy. Once
+// it's shared between threads it must be treated as read-only.
+//
+// Each row starts on a new 64-bit word, so you can test 64 cells along a row at once with get_bits (or get_row).
+class PassabilityGrid {
+private:
+  int width_;
+  int length_;
+  int words_per_row_;
+
+  // Bit (x % 64) of word (z * words_per_row_) + (x / 64) is set if cell (x, z) is passable. The bits past the end of
+  // each row are always zero.
+  std::vector<uint64_t> bits_;
+
+  // See get_slope.
+  std::vector<uint8_t> slopes_;
+
+public:
+  // Creates a grid where nothing is passable and everything is flat.
+  PassabilityGrid(int width, int length);
+
+  // Creates a grid with the given passability (one bool per cell, one row at a time) where everything is flat.
+  PassabilityGrid(int width, int length, std::vector<bool> const &passability);
+
+  // Creates a grid with the slopes of the given height field's vertices, where cells are passable if their slope is
+  // greater than min_passable_slope (a cell exactly on it is not).
+  PassabilityGrid(HeightField const &height_field, float min_passable_slope);
+
+  inline int get_width() const {
+    return width_;
+  }
+
+  inline int get_length() const {
+    return length_;
+  }
+
+  inline int get_words_per_row() const {
+    return words_per_row_;
+  }
+
+  // Returns true if the cell at the given (already wrapped) coordinates is passable.
+  inline bool is_passable(int x, int z) const {
+    return (bits_[(z * words_per_row_) + (x / 64)] & (1ULL << (x % 64))) != 0;
+  }
+
+  inline void set_passable(int x, int z, bool passable) {
+    uint64_t &word = bits_[(z * words_per_row_) + (x / 64)];
+    if (passable) {
+      word |= (1ULL << (x % 64));
+    } else {
+      word &= ~(1ULL << (x % 64));
+    }
+  }
+
+  // Gets the passability of the (up to) 64 cells from (x, z) to (x + 63, z), in bit 0 to bit 63. x must already be
+  // wrapped, and the cells don't wrap around: any that are past the end of the row come back as impassable.
+  inline uint64_t get_bits(int x, int z) const {
+    uint64_t const *row = &bits_[z * words_per_row_];
+    const int word = x / 64;
+    const int shift = x % 64;
+    uint64_t bits = row[word] >> shift;
+    if (shift != 0 && word + 1 < words_per_row_) {
+      bits |= row[word + 1] << (64 - shift);
+    }
+    return bits;
+  }
+
+  // Gets the words of the given row (see bits_).
+  inline std::span<uint64_t const> get_row(int z) const {
+    return std::span<uint64_t const>(&bits_[z * words_per_row_], words_per_row_);
+  }
+
+  // Replaces the passability of the given row with get_words_per_row() words in the same layout as get_row.
+  void set_row(int z, uint64_t const *words);
+
+  // Gets the cosine of the angle between the terrain at the given (already wrapped) cell and the horizontal, the same
+  // as HeightField::get_vertex_slope: 1 on flat ground and 0 on a vertical cliff. It's quantized to a byte, so it's
+  // only good to about 0.002.
+  inline float get_slope(int x, int z) const {
+    return slopes_[(z * width_) + x] * (1.0f / 255.0f);
+  }
+
+  // Recalculates the slope and passability of the cells from min_x,min_z to max_x,max_z (inclusive) from the given
+  // height field, which must be the same size as us. The coordinates don't need to be wrapped, and the rectangle can
+  // go off the edge of the map.
+  void update(HeightField const &height_field, float min_passable_slope, int min_x, int min_z, int max_x, int max_z);
+};
+
+}
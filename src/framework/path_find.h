@@ -1,28 +1,64 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 
 #include <framework/math.h>
+#include <framework/passability_grid.h>
 
 namespace fw {
 struct PathNode;
+struct PathGrid;
 
 // Class for finding a path between point "A" and point "B" in a grid. This class is not thread safe, you should only
-// attempt to find one path at a time on a single thread.
+// attempt to find one path at a time on a single thread. To search on multiple threads, create one PathFind per thread
+// sharing the same PassabilityGrid.
 class PathFind {
+public:
+  // The data structures used by find() to keep track of the open set. Both engines produce identical paths.
+  enum class Engine {
+    // A std::multiset of PathNodes. This is the original implementation, kept around so that we can compare against
+    // it (see the "path-find" benchmark in src/bench).
+    kMultiset,
+
+    // An indexed binary min-heap over a compact struct-of-arrays grid. This is much faster on large maps.
+    kIndexedHeap,
+  };
+
 private:
-  int width_;
-  int length_;
+  Engine engine_;
   PathNode *nodes_;
+  PathGrid *grid_;
   int run_no_;
 
+  std::shared_ptr<PassabilityGrid> passability_;
+
   PathNode *get_node(fw::Vector const &loc) const;
   bool is_passable(fw::Vector const &start, fw::Vector const &end) const;
 
+  bool find_multiset(std::vector<fw::Vector> &path, fw::Vector const &start, fw::Vector const &end);
+  bool find_indexed_heap(std::vector<fw::Vector> &path, fw::Vector const &start, fw::Vector const &end);
+
+protected:
+  int width_;
+  int length_;
+  int nodes_expanded_;
+
+  // Returns true if the cell at the given (already wrapped) coordinates is passable.
+  bool is_passable(int x, int z) const;
+
+  // Updates the passability of a single cell. Subclasses that precompute anything from the passability data will
+  // need to update that themselves.
+  void set_passable(int x, int z, bool passable);
+
 public:
-  PathFind(int width, int length, std::vector<bool> const &passability);
+  PathFind(int width, int length, std::vector<bool> const &passability, Engine engine = Engine::kIndexedHeap);
+  PathFind(std::shared_ptr<PassabilityGrid> passability, Engine engine = Engine::kIndexedHeap);
   virtual ~PathFind();
 
+  PathFind(PathFind const &) = delete;
+  PathFind &operator=(PathFind const &) = delete;
+
   // Finds a path between the given 'start' and 'end' vectors. We ignore the y component of the vectors and just look
   // at the (x,y) components. The 'path' is populated with the path we found and we'll assume the agent will travel
   // between it's current location and the first element of path, then to the second element and so on traveling in a
@@ -37,13 +73,26 @@ public:
   //
   // Note: the path in full_path is not modified, but the simplified path is built up in new_path.
   virtual void simplify_path(std::vector<fw::Vector> const &full_path, std::vector<fw::Vector> &new_path);
+
+  inline Engine get_engine() const {
+    return engine_;
+  }
+
+  inline std::shared_ptr<PassabilityGrid> const &get_passability() const {
+    return passability_;
+  }
+
+  // Gets the number of nodes that were expanded (i.e. removed from the open set) by the last call to find().
+  inline int get_nodes_expanded() const {
+    return nodes_expanded_;
+  }
 };
 
 // This specialization of PathFind adds some timing methods and it also keeps the final Node structure around
 // for visualization
 class TimedPathFind: public PathFind {
 public:
-  TimedPathFind(int width, int length, std::vector<bool> &passability);
+  TimedPathFind(int width, int length, std::vector<bool> &passability, Engine engine = Engine::kIndexedHeap);
   virtual ~TimedPathFind();
 
   // the total time the last find() call took, in seconds.
@@ -0,0 +1,61 @@
+#include <framework/radix_sort.h>
+
+#include <array>
+#include <cstddef>
+
+namespace fw {
+namespace {
+
+const int NUM_DIGITS = 8;
+const int NUM_BUCKETS = 256;
+
+inline uint32_t get_digit(uint64_t key, int digit) {
+  return static_cast<uint32_t>(key >> (digit * 8)) & 0xff;
+}
+
+}
+
+void radix_sort(std::vector<RadixSortItem> &items, std::vector<RadixSortItem> &scratch) {
+  const size_t count = items.size();
+  if (count < 2) {
+    return;
+  }
+
+  // Count every digit in one pass over the items.
+  std::array<std::array<uint32_t, NUM_BUCKETS>, NUM_DIGITS> counts = {};
+  for (RadixSortItem const &item : items) {
+    for (int digit = 0; digit < NUM_DIGITS; digit++) {
+      counts[digit][get_digit(item.key, digit)]++;
+    }
+  }
+
+  scratch.resize(count);
+  std::vector<RadixSortItem> *from = &items;
+  std::vector<RadixSortItem> *to = &scratch;
+  for (int digit = 0; digit < NUM_DIGITS; digit++) {
+    std::array<uint32_t, NUM_BUCKETS> &digit_counts = counts[digit];
+    if (digit_counts[get_digit((*from)[0].key, digit)] == count) {
+      // Every key has the same value for this digit, so this pass wouldn't change anything.
+      continue;
+    }
+
+    // Turn the counts into the offset of the first item in each bucket.
+    uint32_t offset = 0;
+    for (int bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+      const uint32_t bucket_count = digit_counts[bucket];
+      digit_counts[bucket] = offset;
+      offset += bucket_count;
+    }
+
+    for (RadixSortItem const &item : *from) {
+      (*to)[digit_counts[get_digit(item.key, digit)]++] = item;
+    }
+    std::swap(from, to);
+  }
+
+  if (from != &items) {
+    items.swap(scratch);
+  }
+}
+
+}
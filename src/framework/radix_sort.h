@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace fw {
+
+// An item to be sorted by radix_sort: the value is usually an index into some other array.
+struct RadixSortItem {
+  uint64_t key;
+  uint32_t value;
+};
+
+// Sorts the given items by key (smallest first), using a least-significant-digit radix sort on 8-bit digits. The sort
+// is stable. scratch is used as temporary storage: pass the same vector in each time to avoid reallocating it.
+//
+// We skip any digit where every key is the same, so if you only use some of the bits of the key (e.g. the top bits are
+// usually zero), you don't pay for the ones you don't use.
+void radix_sort(std::vector<RadixSortItem> &items, std::vector<RadixSortItem> &scratch);
+
+}
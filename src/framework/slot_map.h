@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace fw {
+
+// A key into a SlotMap. A default-constructed key is never valid.
+struct SlotMapKey {
+  uint32_t index = 0;
+  uint32_t generation = 0;
+
+  inline bool operator ==(SlotMapKey const &other) const {
+    return index == other.index && generation == other.generation;
+  }
+
+  inline bool operator !=(SlotMapKey const &other) const {
+    return !(*this == other);
+  }
+};
+
+// A SlotMap stores values contiguously (so iterating over them is fast and cache-friendly) while still giving each
+// value a stable key that can be used to look it up or remove it in O(1).
+//
+// Removing a value moves the last value into its place, so the order of iteration is not stable across removals.
+// Each slot has a generation which is incremented whenever the value in it is removed, so a key to a value that has
+// since been removed will not find whatever value was inserted into the slot afterwards.
+//
+// This class is not thread-safe.
+template<typename T>
+class SlotMap {
+private:
+  struct Slot {
+    uint32_t dense_index;
+    uint32_t generation;
+  };
+
+  std::vector<T> values_;
+  std::vector<uint32_t> dense_slots_;
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> free_slots_;
+
+  inline Slot const *get_slot(SlotMapKey key) const {
+    if (key.index >= slots_.size() || slots_[key.index].generation != key.generation) {
+      return nullptr;
+    }
+    return &slots_[key.index];
+  }
+
+public:
+  typedef typename std::vector<T>::iterator iterator;
+  typedef typename std::vector<T>::const_iterator const_iterator;
+
+  void reserve(size_t capacity) {
+    values_.reserve(capacity);
+    dense_slots_.reserve(capacity);
+    slots_.reserve(capacity);
+  }
+
+  SlotMapKey insert(T value) {
+    uint32_t index;
+    if (free_slots_.empty()) {
+      index = static_cast<uint32_t>(slots_.size());
+      // Generation 0 is reserved for invalid keys.
+      slots_.push_back(Slot { 0, 1 });
+    } else {
+      index = free_slots_.back();
+      free_slots_.pop_back();
+    }
+
+    Slot &slot = slots_[index];
+    slot.dense_index = static_cast<uint32_t>(values_.size());
+    values_.push_back(std::move(value));
+    dense_slots_.push_back(index);
+    return SlotMapKey { index, slot.generation };
+  }
+
+  // Removes the value with the given key. Returns false if there's no such value (e.g. it's already been removed).
+  bool remove(SlotMapKey key) {
+    if (get_slot(key) == nullptr) {
+      return false;
+    }
+
+    Slot &slot = slots_[key.index];
+    const uint32_t last = static_cast<uint32_t>(values_.size()) - 1;
+    if (slot.dense_index != last) {
+      values_[slot.dense_index] = std::move(values_[last]);
+      dense_slots_[slot.dense_index] = dense_slots_[last];
+      slots_[dense_slots_[last]].dense_index = slot.dense_index;
+    }
+    values_.pop_back();
+    dense_slots_.pop_back();
+
+    slot.generation++;
+    if (slot.generation == 0) {
+      slot.generation = 1;
+    }
+    free_slots_.push_back(key.index);
+    return true;
+  }
+
+  // Gets a pointer to the value with the given key, or nullptr if there's no such value.
+  inline T *get(SlotMapKey key) {
+    Slot const *slot = get_slot(key);
+    return slot == nullptr ? nullptr : &values_[slot->dense_index];
+  }
+
+  inline T const *get(SlotMapKey key) const {
+    Slot const *slot = get_slot(key);
+    return slot == nullptr ? nullptr : &values_[slot->dense_index];
+  }
+
+  inline bool contains(SlotMapKey key) const {
+    return get_slot(key) != nullptr;
+  }
+
+  void clear() {
+    for (uint32_t index : dense_slots_) {
+      slots_[index].generation++;
+      if (slots_[index].generation == 0) {
+        slots_[index].generation = 1;
+      }
+      free_slots_.push_back(index);
+    }
+    values_.clear();
+    dense_slots_.clear();
+  }
+
+  inline size_t size() const {
+    return values_.size();
+  }
+
+  inline bool empty() const {
+    return values_.empty();
+  }
+
+  // Access to the values by their (unstable) position in the dense array, e.g. to iterate by index while inserting.
+  inline T &operator[](size_t dense_index) {
+    return values_[dense_index];
+  }
+
+  inline T const &operator[](size_t dense_index) const {
+    return values_[dense_index];
+  }
+
+  inline iterator begin() {
+    return values_.begin();
+  }
+
+  inline iterator end() {
+    return values_.end();
+  }
+
+  inline const_iterator begin() const {
+    return values_.begin();
+  }
+
+  inline const_iterator end() const {
+    return values_.end();
+  }
+};
+
+}
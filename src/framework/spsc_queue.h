@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace fw {
+
+// An SpscQueue is a fixed-size ring that one thread (the producer) pushes T's onto and one other thread (the consumer)
+// pops them off, in the order they were pushed, without any locks. Neither side ever waits for the other: try_push()
+// returns false when the queue is full and try_pop() returns false when it's empty, and what to do about that is up to
+// the caller.
+//
+// The slots are reused, so T must be default-constructible and movable. Items are moved in and moved back out, so a
+// popped slot holds a moved-from T until it's pushed over again.
+template<typename T>
+class SpscQueue {
+private:
+  // The producer and consumer each have their index on a separate cache line, so they aren't forever taking it off
+  // each other.
+  static const std::size_t CACHE_LINE_SIZE = 64;
+
+  std::vector<T> slots_;
+  std::size_t mask_;
+
+  // The index of the next item to pop. Both indices only ever go up, an index's slot is index & mask_. Only the
+  // consumer writes head_, and cached_tail_ is the consumer's copy of tail_ so it doesn't need to read the producer's
+  // cache line every time.
+  alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> head_;
+  std::size_t cached_tail_;
+
+  // The index of the next slot to push into. Only the producer writes tail_, and cached_head_ is its copy of head_.
+  alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> tail_;
+  std::size_t cached_head_;
+
+  static std::size_t round_up_capacity(std::size_t capacity) {
+    std::size_t rounded = 1;
+    while (rounded < capacity) {
+      rounded <<= 1;
+    }
+    return rounded;
+  }
+
+public:
+  // Creates a queue that can hold (at least) the given number of items. The capacity is rounded up to a power of two.
+  explicit SpscQueue(std::size_t capacity) :
+      slots_(round_up_capacity(capacity)), mask_(slots_.size() - 1), head_(0), cached_tail_(0), tail_(0),
+      cached_head_(0) {
+  }
+
+  SpscQueue(SpscQueue const &) = delete;
+  SpscQueue &operator=(SpscQueue const &) = delete;
+
+  std::size_t get_capacity() const {
+    return slots_.size();
+  }
+
+  // Moves item onto the back of the queue, or returns false (and leaves item alone) if the queue is full. Only call
+  // this from the producer thread.
+  bool try_push(T &&item) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == slots_.size()) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == slots_.size()) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(item);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns true if there's no room for another item. Only call this from the producer thread.
+  bool is_full() {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == slots_.size()) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+    }
+    return tail - cached_head_ == slots_.size();
+  }
+
+  // Moves the item at the front of the queue into item, or returns false (and leaves item alone) if the queue is
+  // empty. Only call this from the consumer thread.
+  bool try_pop(T &item) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return false;
+      }
+    }
+    item = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Gets the number of items in the queue. This is safe to call from any thread, but by the time you look at it, the
+  // other thread may well have changed it.
+  std::size_t size() const {
+    // head_ never passes tail_, so as long as we read head_ first we can't get a tail that's behind it.
+    const std::size_t head = head_.load(std::memory_order_acquire);
+    const std::size_t tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+  }
+};
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+namespace fw {
+
+// A hash of a set of values, which doesn't depend on the order they were added in, and which can be updated
+// incrementally as the values change (rather than rehashing the whole set). Each value is mixed and then the results
+// are summed, so replacing a value is just subtracting its old mix and adding the new one.
+//
+// This is NOT thread-safe: everything that sets an Element in a given StateHash must do it from the same thread. If
+// another thread wants the hash, the owner should call get() and hand it over (see game::TurnBundle::on_executed).
+class StateHash {
+private:
+  uint64_t hash_;
+
+public:
+  // One value in a StateHash, which replaces its old value in the hash whenever it's set, and removes itself when
+  // it's destroyed. Typically, each piece of state you want to hash owns one of these.
+  class Element {
+  private:
+    StateHash *hash_;
+    uint64_t value_;
+
+  public:
+    Element() : hash_(nullptr), value_(0) {
+    }
+    Element(const Element&) = delete;
+    Element& operator=(const Element&) = delete;
+    ~Element() {
+      clear();
+    }
+
+    // Sets our value in the given hash. An Element always belongs to the same StateHash once it's been set.
+    inline void set(StateHash &hash, uint64_t value) {
+      hash_ = &hash;
+      const uint64_t mixed = mix(value);
+      hash.hash_ += mixed - value_;
+      value_ = mixed;
+    }
+
+    // Removes our value from the hash.
+    inline void clear() {
+      if (hash_ != nullptr) {
+        hash_->hash_ -= value_;
+        value_ = 0;
+      }
+    }
+  };
+
+  StateHash() : hash_(0) {
+  }
+  StateHash(const StateHash&) = delete;
+  StateHash& operator=(const StateHash&) = delete;
+
+  uint64_t get() const {
+    return hash_;
+  }
+
+  // The finalizer from SplitMix64. Every bit of the input affects every bit of the output, which is what stops
+  // changes to two different values from cancelling each other out in the sum.
+  static inline uint64_t mix(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+  }
+
+  // Combines some fields into a single value, e.g. combine(entity_id, kind, x, y, z). Order matters here. This is
+  // deliberately cheap (the multiplies don't depend on each other), because Element::set() does the full mix() on the
+  // result anyway, and positions are combined for every moving entity every frame.
+  template<typename... Fields>
+  static inline uint64_t combine(uint64_t first, Fields... fields) {
+    uint64_t value = first;
+    ((value = std::rotl(value, 21) ^ (to_bits(fields) * 0x9e3779b97f4a7c15ULL)), ...);
+    return value;
+  }
+
+  // Floats are hashed by their bits: peers in lockstep should have *exactly* the same state.
+  static inline uint64_t to_bits(float value) {
+    return std::bit_cast<uint32_t>(value);
+  }
+  template<typename T>
+  static inline uint64_t to_bits(T value) {
+    return static_cast<uint64_t>(value);
+  }
+};
+
+}
@@ -0,0 +1,140 @@
+#include <framework/thread_pool.h>
+
+#include <algorithm>
+
+namespace fw {
+
+struct ThreadPool::Batch {
+  range_fn const *fn;
+
+  // The number of chunks that haven't finished yet. Only touched with the mutex held, so that the caller can't see it
+  // hit zero (and destroy the batch) while the thread that finished the last chunk is still notifying it.
+  std::mutex mutex;
+  std::condition_variable done_cv;
+  size_t remaining;
+};
+
+ThreadPool::ThreadPool(int num_threads) : num_queued_(0), stopping_(false) {
+  num_threads = std::max(num_threads, 0);
+  for (int i = 0; i <= num_threads; i++) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (int i = 0; i < num_threads; i++) {
+    threads_.emplace_back(&ThreadPool::thread_proc, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    stopping_ = true;
+  }
+  sleep_cv_.notify_all();
+
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::push(int queue_index, Task const &task) {
+  {
+    std::unique_lock<std::mutex> lock(queues_[queue_index]->mutex);
+    queues_[queue_index]->tasks.push_back(task);
+  }
+  num_queued_++;
+}
+
+bool ThreadPool::try_pop(int queue_index, Task &task) {
+  // Our own queue first, from the back...
+  {
+    Queue &queue = *queues_[queue_index];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+      num_queued_--;
+      return true;
+    }
+  }
+
+  // ...then steal from the front of everybody else's.
+  const int num_queues = static_cast<int>(queues_.size());
+  for (int i = 1; i < num_queues; i++) {
+    Queue &queue = *queues_[(queue_index + i) % num_queues];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+      num_queued_--;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::run(Task const &task) {
+  (*task.batch->fn)(task.begin, task.end);
+
+  Batch &batch = *task.batch;
+  std::unique_lock<std::mutex> lock(batch.mutex);
+  if (--batch.remaining == 0) {
+    batch.done_cv.notify_all();
+  }
+}
+
+void ThreadPool::thread_proc(int queue_index) {
+  for (;;) {
+    Task task;
+    if (try_pop(queue_index, task)) {
+      run(task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleep_cv_.wait(lock, [this]() { return stopping_ || num_queued_ > 0; });
+    if (stopping_) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::parallel_for(size_t count, size_t grain_size, range_fn const &fn) {
+  if (count == 0) {
+    return;
+  }
+  grain_size = std::max(grain_size, static_cast<size_t>(1));
+  if (threads_.empty() || count <= grain_size) {
+    fn(0, count);
+    return;
+  }
+
+  Batch batch;
+  batch.fn = &fn;
+  batch.remaining = (count + grain_size - 1) / grain_size;
+
+  // Deal the chunks out to the queues round-robin, so that each thread starts off with its own share.
+  const int caller_queue = static_cast<int>(queues_.size()) - 1;
+  int queue_index = 0;
+  for (size_t begin = 0; begin < count; begin += grain_size) {
+    push(queue_index, Task { &batch, begin, std::min(begin + grain_size, count) });
+    queue_index = (queue_index + 1) % queues_.size();
+  }
+  {
+    // We don't need to hold the lock, but taking it makes sure that a thread which has just seen num_queued_ == 0 is
+    // actually waiting by the time we notify, so it doesn't miss the wake up.
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+  }
+  sleep_cv_.notify_all();
+
+  // Help out until there's nothing left to take, then wait for whatever the other threads are still working on.
+  Task task;
+  while (try_pop(caller_queue, task)) {
+    run(task);
+  }
+
+  std::unique_lock<std::mutex> lock(batch.mutex);
+  batch.done_cv.wait(lock, [&batch]() { return batch.remaining == 0; });
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fw {
+
+// ThreadPool is a simple work-stealing pool of threads. Each thread has its own queue of tasks: it takes work from the
+// back of its own queue and, when that runs dry, steals from the front of somebody else's. parallel_for spreads its
+// chunks over all of the queues, so in the common case each thread just chews through its own share without
+// contending with anybody else, and the stealing evens things out when some chunks take longer than others.
+//
+// The thread that calls parallel_for joins in as well, so a pool with zero threads just runs everything inline.
+//
+// Nothing about the order in which tasks run is deterministic. If you need deterministic results (e.g. for the
+// lockstep simulation), each task should only write to state that belongs to its own range.
+class ThreadPool {
+public:
+  typedef std::function<void(size_t begin, size_t end)> range_fn;
+
+private:
+  struct Batch;
+
+  struct Task {
+    Batch *batch;
+    size_t begin;
+    size_t end;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // One queue per thread, plus one at the end for whoever calls parallel_for.
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<int> num_queued_;
+  bool stopping_;
+
+  void push(int queue_index, Task const &task);
+  bool try_pop(int queue_index, Task &task);
+  void run(Task const &task);
+  void thread_proc(int queue_index);
+
+public:
+  // Creates a pool with the given number of threads (not counting the thread that calls parallel_for).
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool &operator=(ThreadPool const &) = delete;
+
+  int get_num_threads() const {
+    return static_cast<int>(threads_.size());
+  }
+
+  // Calls fn over the range [0, count) in chunks of (at most) grain_size items, and returns once every chunk has
+  // completed. fn is called concurrently from different threads, so it must be safe to do so. This must not be
+  // called from inside one of the pool's own tasks.
+  void parallel_for(size_t count, size_t grain_size, range_fn const &fn);
+};
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+
+namespace fw {
+
+// A TripleBuffer lets one thread keep producing new versions of some T while another thread consumes the latest one,
+// without either of them ever waiting for the other. The writer fills in get_write_buffer() and calls publish(). The
+// reader calls update_read_buffer() to pick up the most recently published version (if there's a new one) and then
+// reads from get_read_buffer(). Versions the reader never got around to picking up are simply skipped.
+//
+// The three T's are reused, so the writer should expect get_write_buffer() to contain an old version rather than an
+// empty T (which is handy if T holds vectors whose memory you want to keep).
+template<typename T>
+class TripleBuffer {
+private:
+  static const int INDEX_MASK = 0x3;
+
+  // Set in middle_ when the middle buffer has been published since the reader last took it.
+  static const int DIRTY_BIT = 0x4;
+
+  T buffers_[3];
+
+  // The buffer that's not currently owned by the reader or the writer. They swap their buffer with this one when
+  // they're done with it.
+  std::atomic<int> middle_;
+
+  // Only ever touched by the writer.
+  int write_;
+
+  // Only ever touched by the reader.
+  int read_;
+
+public:
+  TripleBuffer() : middle_(1), write_(0), read_(2) {
+  }
+
+  TripleBuffer(TripleBuffer const &) = delete;
+  TripleBuffer &operator=(TripleBuffer const &) = delete;
+
+  // Gets the buffer the writer should fill in. Only call this from the writer thread.
+  T &get_write_buffer() {
+    return buffers_[write_];
+  }
+
+  // Makes the write buffer available to the reader, and gives the writer a new buffer to write into. Only call this
+  // from the writer thread.
+  void publish() {
+    write_ = middle_.exchange(write_ | DIRTY_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+  }
+
+  // If something has been published since we last called this, swaps it into the read buffer and returns true.
+  // Otherwise, leaves the read buffer as it was and returns false. Only call this from the reader thread.
+  bool update_read_buffer() {
+    if ((middle_.load(std::memory_order_acquire) & DIRTY_BIT) == 0) {
+      return false;
+    }
+    read_ = middle_.exchange(read_, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+  }
+
+  // Gets the buffer the reader should read from. Only call this from the reader thread.
+  T const &get_read_buffer() const {
+    return buffers_[read_];
+  }
+};
+
+}
@@ -1,8 +1,9 @@
 #pragma once
 
 #include <condition_variable>
+#include <deque>
 #include <mutex>
-#include <queue>
+#include <vector>
 
 namespace fw {
 
@@ -13,7 +14,7 @@ namespace fw {
 template<typename T>
 class WorkQueue {
 private:
-  std::queue<T> q_;
+  std::deque<T> q_;
   std::mutex mutex_;
   std::condition_variable condition_;
 
@@ -25,6 +26,13 @@ public:
 
   /** Add an item to the queue. */
   inline void enqueue(T const &val);
+
+  /**
+   * Removes (up to max_count) items that match the given predicate from the queue, without waiting, and appends them
+   * to out. Items that don't match stay in the queue in their original order.
+   */
+  template<typename Pred>
+  inline void take_if(Pred pred, std::vector<T> &out, size_t max_count);
 };
 
 template<typename T>
@@ -35,7 +43,7 @@ T WorkQueue<T>::dequeue() {
   }
 
   T val = q_.front();
-  q_.pop();
+  q_.pop_front();
 
   return val;
 }
@@ -44,10 +52,26 @@ template<typename T>
 void WorkQueue<T>::enqueue(T const &val) {
   {
     std::unique_lock<std::mutex> lock(mutex_);
-    q_.push(val);
+    q_.push_back(val);
   }
 
   condition_.notify_one();
 }
 
+template<typename T>
+template<typename Pred>
+void WorkQueue<T>::take_if(Pred pred, std::vector<T> &out, size_t max_count) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  size_t taken = 0;
+  for (auto it = q_.begin(); it != q_.end() && taken < max_count;) {
+    if (pred(*it)) {
+      out.push_back(*it);
+      it = q_.erase(it);
+      taken++;
+    } else {
+      ++it;
+    }
+  }
+}
+
 }
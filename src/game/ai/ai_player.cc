@@ -357,7 +357,7 @@ void AIPlayer::world_loaded() {
 }
 
 // This is called each simulation frame when we get all the commands from other players
-void AIPlayer::post_commands(std::vector<std::shared_ptr<Command>> &) {
+void AIPlayer::post_commands(TurnPackets &) {
 }
 
 }
@@ -65,11 +65,19 @@ public:
 
   // This is called each simulation frame when we get all the commands from
   // other players
-  virtual void post_commands(std::vector<std::shared_ptr<Command> > &commands);
+  virtual void post_commands(TurnPackets &packets);
 
   // gets value that indicates whether we're in a valid state or not
   bool is_valid_state() { return is_valid_; }
 
+  // Saves and restores the state of our timers, see UpdateQueue::write_snapshot().
+  void write_snapshot(fw::net::PacketBuffer &buffer) const {
+    update_queue_.write_snapshot(buffer);
+  }
+  fw::Status read_snapshot(fw::net::PacketBuffer &buffer) {
+    return update_queue_.read_snapshot(buffer);
+  }
+
   LUA_DECLARE_METATABLE(AIPlayer);
 };
 
@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <functional>
 #include <thread>
 
+#include <framework/flow_field.h>
+#include <framework/hierarchical_path_find.h>
 #include <framework/logging.h>
-#include <framework/path_find.h>
+#include <framework/misc.h>
+#include <framework/settings.h>
 
 #include <game/ai/pathing_thread.h>
 #include <game/world/world.h>
@@ -16,29 +20,57 @@ int FLAG_NONE = 0;
 // if set, this means out stop() method has been called and the worker thread is to stop
 int FLAG_STOP = 1;
 
-PathingThread::PathingThread() : terrain_(nullptr) {
+// if set, this is a request to build the flow field towards the request's goal, rather than to find a path
+int FLAG_FLOW_FIELD = 2;
+
+// Requests for the same goal cell whose start is within this many cells of another request's start are coalesced.
+static const float COALESCE_RADIUS = 8.0f;
+
+// The maximum number of extra requests a worker will coalesce with the one it's working on.
+static const size_t MAX_COALESCED = 64;
+
+static float seconds_since(fw::Clock::time_point time_point) {
+  auto microseconds =
+      std::chrono::duration_cast<std::chrono::microseconds>(fw::Clock::now() - time_point).count();
+  return static_cast<float>(microseconds) / 1000000.0f;
+}
+
+PathingThread::PathingThread() : terrain_(nullptr), flow_field_cache_size_(0) {
 }
 
 void PathingThread::start() {
   // initialize the pather with the current world's map
   terrain_ = game::World::get_instance()->get_terrain();
-  std::shared_ptr<fw::PathFind> pf(
-      new fw::PathFind(
-          terrain_->get_width(),
-          terrain_->get_length(),
-          terrain_->get_collision_data()));
-  pather_ = pf;
-
-  // start the thread that will simply wait for jobs to arrive and
-  // then process them in order.
-  thread_ = std::thread(std::bind(&PathingThread::thread_proc, this));
+  pather_ = std::make_shared<fw::HierarchicalPathFind>(terrain_->get_passability(), Terrain::PATCH_SIZE);
+  flow_field_cache_size_ = std::max(fw::Settings::get<int>("flow-field-cache-size"), 1);
+
+  int num_threads = fw::Settings::get<int>("pathing-threads");
+  if (num_threads <= 0) {
+    // Leave a core for the update and render threads.
+    num_threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, 4);
+  }
+  LOG(INFO) << "starting " << num_threads << " pathing thread(s)";
+
+  // start the threads that will simply wait for jobs to arrive and then process them. The first thread uses pather_
+  // directly, the rest get a worker that shares its passability grid and abstract graph.
+  for (int i = 0; i < num_threads; i++) {
+    auto pather = (i == 0) ? pather_ : pather_->create_worker();
+    threads_.emplace_back(std::bind(&PathingThread::thread_proc, this, pather));
+  }
 }
 
 void PathingThread::stop() {
-  // add an item to the queue to shutdown...
-  PathRequestData request;
-  request.flags = FLAG_STOP;
-  work_queue_.enqueue(request);
+  // add an item to the queue for each thread to shutdown...
+  for (size_t i = 0; i < threads_.size(); i++) {
+    PathRequestData request;
+    request.flags = FLAG_STOP;
+    work_queue_.enqueue(request);
+  }
+
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
 }
 
 void PathingThread::request_path(fw::Vector const &start, fw::Vector const &goal, callback_fn on_path_found) {
@@ -47,25 +79,220 @@ void PathingThread::request_path(fw::Vector const &start, fw::Vector const &goal
   request.start = start;
   request.goal = goal;
   request.callback = on_path_found;
+  request.enqueue_time = fw::Clock::now();
   work_queue_.enqueue(request);
 }
 
-void PathingThread::thread_proc() {
+void PathingThread::request_flow_field(fw::Vector const &goal, flow_field_callback_fn on_flow_field_found) {
+  const int goal_cell = get_goal_cell(goal);
+  std::shared_ptr<fw::FlowField const> field;
+  {
+    std::unique_lock<std::mutex> lock(flow_field_mutex_);
+    auto it = flow_fields_.find(goal_cell);
+    if (it == flow_fields_.end()) {
+      // Nobody has asked for this one yet, get one of the workers to build it.
+      flow_fields_[goal_cell].callbacks.push_back(on_flow_field_found);
+
+      PathRequestData request;
+      request.flags = FLAG_FLOW_FIELD;
+      request.goal = goal;
+      request.enqueue_time = fw::Clock::now();
+      work_queue_.enqueue(request);
+      return;
+    }
+
+    if (!it->second.field) {
+      // It's still being built, we'll be called back along with whoever asked for it first.
+      it->second.callbacks.push_back(on_flow_field_found);
+      return;
+    }
+
+    // It's already built, move it to the front of the LRU list.
+    field = it->second.field;
+    flow_field_lru_.remove(goal_cell);
+    flow_field_lru_.push_front(goal_cell);
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    stats_.num_flow_field_hits++;
+  }
+  on_flow_field_found(field);
+}
+
+int PathingThread::get_goal_cell(fw::Vector const &goal) const {
+  const int x = fw::constrain(static_cast<int>(goal[0]), terrain_->get_width());
+  const int z = fw::constrain(static_cast<int>(goal[2]), terrain_->get_length());
+  return (z * terrain_->get_width()) + x;
+}
+
+PathingThread::Stats PathingThread::get_stats() const {
+  std::unique_lock<std::mutex> lock(stats_mutex_);
+  return stats_;
+}
+
+bool PathingThread::can_coalesce(PathRequestData const &first, PathRequestData const &other) const {
+  if (other.flags != FLAG_NONE) {
+    return false;
+  }
+
+  if (static_cast<int>(first.goal[0]) != static_cast<int>(other.goal[0])
+      || static_cast<int>(first.goal[2]) != static_cast<int>(other.goal[2])) {
+    return false;
+  }
+
+  fw::Vector first_start(first.start[0], 0.0f, first.start[2]);
+  fw::Vector other_start(other.start[0], 0.0f, other.start[2]);
+  float distance = fw::calculate_distance(
+      first_start, other_start, static_cast<float>(terrain_->get_width()), static_cast<float>(terrain_->get_length()));
+  return distance <= COALESCE_RADIUS;
+}
+
+// Finds a path for the given request that joins up with shared_path (which was found for a request with the same goal
+// and a nearby start). We join at whichever node near the start of the shared path is closest to our start, so that
+// we don't double back.
+void PathingThread::find_tail_path(fw::HierarchicalPathFind &pather, std::vector<fw::Vector> const &shared_path,
+    PathRequestData const &request, std::vector<fw::Vector> &path) {
+  const float wrap_x = static_cast<float>(terrain_->get_width());
+  const float wrap_z = static_cast<float>(terrain_->get_length());
+  fw::Vector start(request.start[0], 0.0f, request.start[2]);
+
+  int join_index = -1;
+  float join_distance = 0.0f;
+  const int max_join_index = std::min(static_cast<int>(shared_path.size()), static_cast<int>(COALESCE_RADIUS * 2));
+  for (int i = 0; i < max_join_index; i++) {
+    float distance = fw::calculate_distance(start, shared_path[i], wrap_x, wrap_z);
+    if (join_index < 0 || distance < join_distance) {
+      join_index = i;
+      join_distance = distance;
+    }
+  }
+
+  if (join_index >= 0 && pather.find(path, request.start, shared_path[join_index])) {
+    // find() stops next to the join node rather than on it, so the join node is the first one of the shared path we
+    // need (unless we were already on it).
+    auto join = shared_path.begin() + join_index;
+    if (path.back()[0] == (*join)[0] && path.back()[2] == (*join)[2]) {
+      ++join;
+    }
+    path.insert(path.end(), join, shared_path.end());
+    return;
+  }
+
+  // We couldn't join up with the shared path (maybe we're on the other side of a cliff), so just do a full search.
+  path.clear();
+  pather.find(path, request.start, request.goal);
+}
+
+void PathingThread::complete_request(PathRequestData const &request, std::vector<fw::Vector> const &path,
+    RequestStats const &request_stats) {
+  {
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    stats_.num_requests++;
+    if (request_stats.coalesced) {
+      stats_.num_coalesced++;
+    }
+    stats_.total_queue_time += request_stats.queue_time;
+    stats_.total_search_time += request_stats.search_time;
+    stats_.total_nodes_expanded += request_stats.nodes_expanded;
+    stats_.last_request = request_stats;
+  }
+
+  if (request.callback) {
+    request.callback(path);
+  }
+}
+
+void PathingThread::build_flow_field(PathRequestData const &request) {
+  fw::Timer tmr;
+  tmr.start();
+  auto field = std::make_shared<fw::FlowField const>(
+      *pather_->get_passability(), static_cast<int>(request.goal[0]), static_cast<int>(request.goal[2]));
+  tmr.stop();
+
+  std::vector<flow_field_callback_fn> callbacks;
+  {
+    std::unique_lock<std::mutex> lock(flow_field_mutex_);
+    const int goal_cell = get_goal_cell(request.goal);
+    FlowFieldEntry &entry = flow_fields_[goal_cell];
+    entry.field = field;
+    callbacks.swap(entry.callbacks);
+    flow_field_lru_.push_front(goal_cell);
+
+    // Evict the least-recently used fields. Anybody still following one keeps their own reference to it.
+    while (flow_field_lru_.size() > flow_field_cache_size_) {
+      flow_fields_.erase(flow_field_lru_.back());
+      flow_field_lru_.pop_back();
+    }
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    stats_.num_flow_fields++;
+    stats_.total_flow_field_time += tmr.get_total_time();
+  }
+
+  for (auto const &callback : callbacks) {
+    callback(field);
+  }
+}
+
+void PathingThread::thread_proc(std::shared_ptr<fw::HierarchicalPathFind> pather) {
   for (;;) {
     PathRequestData request = work_queue_.dequeue();
     if (request.flags == FLAG_STOP) {
       LOG(INFO) << "pathing_thread::stop() has been called, thread_proc stopping.";
       return;
     }
+    if (request.flags == FLAG_FLOW_FIELD) {
+      build_flow_field(request);
+      continue;
+    }
+
+    // Grab any other requests that we can satisfy with the same search.
+    std::vector<PathRequestData> coalesced;
+    work_queue_.take_if(
+        [this, &request](PathRequestData const &other) { return can_coalesce(request, other); },
+        coalesced, MAX_COALESCED);
+
+    RequestStats request_stats;
+    request_stats.queue_time = seconds_since(request.enqueue_time);
+    request_stats.coalesced = !coalesced.empty();
 
+    fw::Timer tmr;
+    tmr.start();
     std::vector<fw::Vector> path;
-    pather_->find(path, request.start, request.goal);
+    pather->find(path, request.start, request.goal);
+    request_stats.nodes_expanded = pather->get_nodes_expanded();
 
     std::vector<fw::Vector> simplified;
-    pather_->simplify_path(path, simplified);
+    pather->simplify_path(path, simplified);
+    tmr.stop();
+    request_stats.search_time = tmr.get_total_time();
+
+    complete_request(request, simplified, request_stats);
+
+    for (auto const &other : coalesced) {
+      RequestStats other_stats;
+      other_stats.queue_time = seconds_since(other.enqueue_time);
+      other_stats.coalesced = true;
+
+      fw::Timer other_tmr;
+      other_tmr.start();
+      std::vector<fw::Vector> other_path;
+      if (path.empty()) {
+        pather->find(other_path, other.start, other.goal);
+      } else {
+        find_tail_path(*pather, path, other, other_path);
+      }
+      other_stats.nodes_expanded = pather->get_nodes_expanded();
+
+      std::vector<fw::Vector> other_simplified;
+      pather->simplify_path(other_path, other_simplified);
+      other_tmr.stop();
+      other_stats.search_time = other_tmr.get_total_time();
 
-    if (request.callback) {
-      request.callback(simplified);
+      complete_request(other, other_simplified, other_stats);
     }
   }
 }
@@ -1,24 +1,73 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include <framework/math.h>
+#include <framework/timer.h>
 #include <framework/work_queue.h>
 
 namespace fw {
-class PathFind;
+class FlowField;
+class HierarchicalPathFind;
 }
 
 namespace game {
 class Terrain;
 
-// Encapsulates a thread that all players will queue requests for path-finding to. We then execute one request
-// at a time and call the player back when the path is found.
+// Encapsulates a pool of threads that all players will queue requests for path-finding to. Each worker thread has its
+// own path finder (sharing the passability grid and abstract graph with the others), and we call the player back when
+// the path is found.
+//
+// Requests for the same goal from nearby starting points (e.g. a group of units all ordered to the same place) are
+// coalesced: one worker does the full search once, and each of the other units just searches for a short "tail" path
+// that joins up with it.
+//
+// For large groups, we can instead build a flow field towards the goal, which every unit in the group then follows.
+// Flow fields are cached per goal cell (the least-recently used one is evicted when the cache is full), so repeated
+// orders to the same place (e.g. a rally point) don't need to build a new one.
 class PathingThread {
 public:
   typedef std::function<void(std::vector<fw::Vector> const &)> callback_fn;
+  typedef std::function<void(std::shared_ptr<fw::FlowField const> const &)> flow_field_callback_fn;
+
+  // Latency statistics for a single request. Like TimedPathFind::total_time, times are in seconds.
+  struct RequestStats {
+    // The time the request spent in the queue before a worker picked it up.
+    float queue_time = 0.0f;
+
+    // The time spent searching for (and simplifying) the path.
+    float search_time = 0.0f;
+
+    // The number of nodes expanded by the search(es) for this request.
+    int nodes_expanded = 0;
+
+    // True if this request shared its search with another request.
+    bool coalesced = false;
+  };
+
+  // Totals over all requests since start() was called.
+  struct Stats {
+    int num_requests = 0;
+    int num_coalesced = 0;
+    float total_queue_time = 0.0f;
+    float total_search_time = 0.0f;
+    int64_t total_nodes_expanded = 0;
+
+    // The number of flow fields built, and the number of requests for one that were found in the cache.
+    int num_flow_fields = 0;
+    int num_flow_field_hits = 0;
+    float total_flow_field_time = 0.0f;
+
+    // The stats of the most recently completed request.
+    RequestStats last_request;
+  };
 
 private:
   struct PathRequestData {
@@ -26,14 +75,39 @@ private:
     fw::Vector start;
     fw::Vector goal;
     callback_fn callback;
+    fw::Clock::time_point enqueue_time;
+  };
+
+  // A flow field in the cache. Until it's been built, field is null and we just collect the callbacks of everybody
+  // who asked for it.
+  struct FlowFieldEntry {
+    std::shared_ptr<fw::FlowField const> field;
+    std::vector<flow_field_callback_fn> callbacks;
   };
 
-  std::shared_ptr<fw::PathFind> pather_;
+  // Flow fields, keyed by goal cell. flow_field_lru_ holds the keys of the built fields with the most recently used at
+  // the front.
+  std::mutex flow_field_mutex_;
+  std::map<int, FlowFieldEntry> flow_fields_;
+  std::list<int> flow_field_lru_;
+  size_t flow_field_cache_size_;
+
+  std::shared_ptr<fw::HierarchicalPathFind> pather_;
   std::shared_ptr<Terrain> terrain_;
-  std::thread thread_;
+  std::vector<std::thread> threads_;
   fw::WorkQueue<PathRequestData> work_queue_;
 
-  void thread_proc();
+  mutable std::mutex stats_mutex_;
+  Stats stats_;
+
+  void thread_proc(std::shared_ptr<fw::HierarchicalPathFind> pather);
+  bool can_coalesce(PathRequestData const &first, PathRequestData const &other) const;
+  void find_tail_path(fw::HierarchicalPathFind &pather, std::vector<fw::Vector> const &shared_path,
+      PathRequestData const &request, std::vector<fw::Vector> &path);
+  void complete_request(PathRequestData const &request, std::vector<fw::Vector> const &path,
+      RequestStats const &request_stats);
+  void build_flow_field(PathRequestData const &request);
+  int get_goal_cell(fw::Vector const &goal) const;
 
 public:
   PathingThread();
@@ -44,6 +118,13 @@ public:
   void stop();
 
   void request_path(fw::Vector const &start, fw::Vector const &goal, callback_fn on_path_found);
+
+  // Requests the flow field towards the given goal. If it's already cached, the callback is called immediately (on the
+  // calling thread), otherwise it's called on one of the pathing threads once the field has been built.
+  void request_flow_field(fw::Vector const &goal, flow_field_callback_fn on_flow_field_found);
+
+  // Gets a snapshot of the latency statistics so far.
+  Stats get_stats() const;
 };
 
 }
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <functional>
+#include <vector>
 
 //#include <luabind/error.hpp>
 //#include <luabind/object.hpp>
@@ -7,6 +9,7 @@
 #include <framework/lua.h>
 #include <framework/timer.h>
 #include <framework/logging.h>
+#include <framework/packet_buffer.h>
 
 #include <game/ai/update_queue.h>
 
@@ -14,8 +17,8 @@ namespace game {
 
 //-------------------------------------------------------------------------
 
-QueueEntry::QueueEntry(float dequeue_time, std::function<void()> fn) :
-    dequeue_time(dequeue_time), fn(fn) {
+QueueEntry::QueueEntry(float dequeue_time, uint64_t sequence, std::function<void()> fn) :
+    dequeue_time(dequeue_time), sequence(sequence), fn(fn) {
 }
 
 //-------------------------------------------------------------------------
@@ -23,17 +26,70 @@ QueueEntry::QueueEntry(float dequeue_time, std::function<void()> fn) :
 bool QueueEntryCmp::operator()(QueueEntry const &lhs, QueueEntry const &rhs) {
   // we want the one with the LOWEST dequeue_time to go first, so our comparison
   // is actually > (the default priority_queue would be <)
-  return (lhs.dequeue_time > rhs.dequeue_time);
+  if (lhs.dequeue_time != rhs.dequeue_time) {
+    return (lhs.dequeue_time > rhs.dequeue_time);
+  }
+  return (lhs.sequence > rhs.sequence);
 }
 
 //-------------------------------------------------------------------------
 
 UpdateQueue::UpdateQueue() :
-    now_(0) {
+    now_(0), next_sequence_(0) {
 }
 
 void UpdateQueue::push(float timeout, std::function<void()> fn) {
-  queue_.push(QueueEntry(now_ + timeout, fn));
+  queue_.push(QueueEntry(now_ + timeout, next_sequence_++, fn));
+}
+
+void UpdateQueue::write_snapshot(fw::net::PacketBuffer &buffer) const {
+  // There's no way to look through a priority_queue without popping things off it, so we pop them off a copy.
+  auto queue = queue_;
+  std::vector<QueueEntry> entries;
+  while (!queue.empty()) {
+    entries.push_back(queue.top());
+    queue.pop();
+  }
+  std::sort(entries.begin(), entries.end(), [](QueueEntry const &lhs, QueueEntry const &rhs) {
+    return lhs.sequence < rhs.sequence;
+  });
+
+  uint32_t num_entries = static_cast<uint32_t>(entries.size());
+  buffer << fw::net::compact(num_entries);
+  for (QueueEntry const &entry : entries) {
+    float time_remaining = entry.dequeue_time - now_;
+    buffer.add_bytes(&time_remaining, sizeof(float));
+  }
+}
+
+fw::Status UpdateQueue::read_snapshot(fw::net::PacketBuffer &buffer) {
+  uint32_t num_entries;
+  buffer >> fw::net::compact(num_entries);
+  RETURN_IF_ERROR(buffer.get_status());
+
+  std::vector<QueueEntry> entries;
+  while (!queue_.empty()) {
+    entries.push_back(queue_.top());
+    queue_.pop();
+  }
+  std::sort(entries.begin(), entries.end(), [](QueueEntry const &lhs, QueueEntry const &rhs) {
+    return lhs.sequence < rhs.sequence;
+  });
+  if (entries.size() != num_entries) {
+    LOG(WARN) << "snapshot has " << num_entries << " AI timer(s), but we have " << entries.size();
+  }
+
+  for (uint32_t i = 0; i < num_entries; i++) {
+    float time_remaining;
+    buffer.read(&time_remaining, sizeof(float));
+    if (i < entries.size()) {
+      entries[i].dequeue_time = now_ + time_remaining;
+    }
+  }
+  for (QueueEntry &entry : entries) {
+    queue_.push(entry);
+  }
+  return buffer.get_status();
 }
 
 void UpdateQueue::update() {
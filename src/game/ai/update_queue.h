@@ -1,16 +1,26 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <deque>
 #include <queue>
 
+#include <framework/status.h>
+
+namespace fw::net {
+class PacketBuffer;
+}
+
 namespace game {
 
 struct QueueEntry {
   float dequeue_time;
+
+  // Entries are numbered in the order they're pushed, which breaks ties between entries due at the same time.
+  uint64_t sequence;
   std::function<void()> fn;
 
-  QueueEntry(float dequeue_time, std::function<void()> fn);
+  QueueEntry(float dequeue_time, uint64_t sequence, std::function<void()> fn);
 };
 
 // A functor for comparing queue entries to ensure we always choose the one which is due out first.
@@ -24,6 +34,7 @@ class UpdateQueue {
 private:
   std::priority_queue<QueueEntry, std::deque<QueueEntry>, QueueEntryCmp> queue_;
   float now_;
+  uint64_t next_sequence_;
 
 public:
   UpdateQueue();
@@ -33,6 +44,13 @@ public:
 
   // call each frame; we'll call each of the callbacks whose time has expired
   void update();
+
+  // Writes the time left on each of our callbacks to a snapshot, in the order they were pushed. The callbacks
+  // themselves are Lua functions, which we can't save. Instead, read_snapshot() matches the saved times up with the
+  // callbacks we've got (the script that pushed them has been started fresh, so it's pushed the same ones, in the
+  // same order) and just restores their times.
+  void write_snapshot(fw::net::PacketBuffer &buffer) const;
+  fw::Status read_snapshot(fw::net::PacketBuffer &buffer);
 };
 
 }
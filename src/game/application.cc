@@ -56,6 +56,9 @@ void Application::destroy() {
 }
 
 void Application::update(float dt) {
+  // The simulation thread's turns are applied first, so everything else this update sees their commands.
+  SimulationThread::get_instance()->apply_turns();
+
   Screen *active = screen_stack_->get_active_screen();
   if (active != nullptr) {
     active->update();
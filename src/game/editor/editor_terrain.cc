@@ -1,10 +1,16 @@
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <thread>
 
 #include <framework/framework.h>
 #include <framework/graphics.h>
 #include <framework/bitmap.h>
 #include <framework/texture.h>
+#include <framework/thread_pool.h>
 
 #include <game/world/terrain_helper.h>
+#include <game/world/world.h>
 #include <game/editor/editor_terrain.h>
 
 namespace ed {
@@ -14,8 +20,41 @@ static const int splatt_height = 128;
 
 static fw::Bitmap tmp_bmp_;
 
+namespace {
+
+// The changed vertices of a patch, generated on the thread pool and waiting to be uploaded by the render thread.
+struct StagedPatch {
+  int patch_x;
+  int patch_z;
+  fw::Rectangle<int> rect;
+  std::vector<fw::vertex::xyz_n> vertices;
+};
+
+// Splits the count values starting at start (which doesn't need to be wrapped) into at most two runs that don't go over
+// the edge of a map that's size values wide, and calls fn(wrapped_start, offset, run_count) for each of them, where
+// offset is how far into the original values the run starts. count must be no more than size.
+template<typename Fn>
+void for_each_wrapped_run(int start, int count, int size, Fn const &fn) {
+  start = fw::constrain(start, size);
+  const int first_count = std::min(count, size - start);
+  fn(start, 0, first_count);
+  if (first_count < count) {
+    fn(0, first_count, count - first_count);
+  }
+}
+
+// Rounds towards negative infinity, unlike the / operator.
+int floor_div(int a, int b) {
+  return (a >= 0) ? (a / b) : -((-a + b - 1) / b);
+}
+
+}
+
 EditorTerrain::EditorTerrain(int width, int height, float* height_data/*= nullptr*/)
-  : Terrain(width, height, height_data) {
+  : Terrain(width, height, height_data),
+    patch_dirty_rects_(get_patches_width() * get_patches_length()),
+    thread_pool_(std::make_unique<fw::ThreadPool>(
+        std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0, 4))) {
 }
 
 EditorTerrain::~EditorTerrain() {
@@ -23,47 +62,112 @@ EditorTerrain::~EditorTerrain() {
 
 // set the height of the given vertex to the given value.
 void EditorTerrain::set_vertex_height(int x, int z, float height) {
-  while (x < 0) {
-    x += width_;
+  set_vertex_heights(x, z, 1, 1, &height);
+}
+
+void EditorTerrain::get_vertex_heights(int x, int z, int width, int length, float *heights) const {
+  for (int row = 0; row < length; row++) {
+    float const *src_row = heights_ + (fw::constrain(z + row, length_) * width_);
+    float *dest_row = heights + (row * width);
+    for_each_wrapped_run(x, width, width_, [src_row, dest_row](int wrapped_x, int offset, int count) {
+      std::copy(src_row + wrapped_x, src_row + wrapped_x + count, dest_row + offset);
+    });
   }
-  while (x >= width_) {
-    x -= width_;
+}
+
+void EditorTerrain::set_vertex_heights(int x, int z, int width, int length, float const *heights) {
+  if (width <= 0 || length <= 0) {
+    return;
   }
-  while (z < 0) {
-    z += length_;
+
+  // The height field wants rectangles that don't wrap, so we split ours into (at most) four that don't.
+  for_each_wrapped_run(z, length, length_, [&](int wrapped_z, int row_offset, int num_rows) {
+    for_each_wrapped_run(x, width, width_, [&](int wrapped_x, int col_offset, int num_cols) {
+      for (int row = 0; row < num_rows; row++) {
+        float const *src = heights + ((row_offset + row) * width) + col_offset;
+        std::copy(src, src + num_cols, heights_ + ((wrapped_z + row) * width_) + wrapped_x);
+      }
+      height_field_.update(heights_, wrapped_x, wrapped_z, wrapped_x + num_cols - 1, wrapped_z + num_rows - 1);
+    });
+  });
+  height_pyramid_.update(x, z, x + width - 1, z + length - 1);
+
+  // The slope (and normal) of the vertices around the edge depends on the heights we've changed as well.
+  passability_dirty_rect_ =
+      fw::Rectangle<int>::bounding(passability_dirty_rect_, fw::Rectangle<int>(x - 1, z - 1, width + 2, length + 2));
+  mark_vertices_dirty(x - 1, z - 1, x + width, z + length);
+}
+
+void EditorTerrain::mark_vertices_dirty(int min_x, int min_z, int max_x, int max_z) {
+  if (max_x - min_x + 1 > width_) {
+    min_x = 0;
+    max_x = width_;
   }
-  while (z >= length_) {
-    z -= length_;
+  if (max_z - min_z + 1 > length_) {
+    min_z = 0;
+    max_z = length_;
   }
 
-  heights_[z * width_ + x] = height;
+  // The vertices along the edge of a patch are in the patches on both sides of it, so a patch covers vertices
+  // patch_x * PATCH_SIZE to (patch_x + 1) * PATCH_SIZE inclusive.
+  for (int patch_z = floor_div(min_z - 1, PATCH_SIZE); patch_z <= floor_div(max_z, PATCH_SIZE); patch_z++) {
+    for (int patch_x = floor_div(min_x - 1, PATCH_SIZE); patch_x <= floor_div(max_x, PATCH_SIZE); patch_x++) {
+      const int left = std::max(min_x - (patch_x * PATCH_SIZE), 0);
+      const int top = std::max(min_z - (patch_z * PATCH_SIZE), 0);
+      const int right = std::min(max_x - (patch_x * PATCH_SIZE), PATCH_SIZE);
+      const int bottom = std::min(max_z - (patch_z * PATCH_SIZE), PATCH_SIZE);
+      if (left > right || top > bottom) {
+        continue;
+      }
 
-  auto this_patch = std::make_tuple(x / PATCH_SIZE, z / PATCH_SIZE);
-  bool found = false;
-
-  std::unique_lock<std::mutex> lock(patches_to_bake_mutex_);
-  for(auto patch : patches_to_bake_) {
-    if (patch == this_patch) {
-      found = true;
-      break;
+      const int index = get_patch_index(patch_x, patch_z);
+      fw::Rectangle<int> &dirty_rect = patch_dirty_rects_[index];
+      if (dirty_rect.width == 0) {
+        dirty_patches_.push_back(index);
+      }
+      dirty_rect = fw::Rectangle<int>::bounding(
+          dirty_rect, fw::Rectangle<int>(left, top, right - left + 1, bottom - top + 1));
     }
   }
+}
 
-  if (!found) {
-    patches_to_bake_.push_back(this_patch);
+void EditorTerrain::bake_dirty_patches() {
+  if (dirty_patches_.empty()) {
+    return;
   }
-  
-  if (!bake_queued_.exchange(true)) {
-    fw::Framework::get_instance()->get_scenegraph_manager()->enqueue(
-      [this](fw::sg::Scenegraph&) {
-        std::unique_lock<std::mutex> lock(patches_to_bake_mutex_);
-        for (auto patch : patches_to_bake_) {
-          bake_patch(std::get<0>(patch), std::get<1>(patch));
-        }
-        patches_to_bake_.clear();
-        bake_queued_.store(false);
-      });
+
+  auto staged_patches = std::make_shared<std::vector<StagedPatch>>(dirty_patches_.size());
+  for (size_t i = 0; i < dirty_patches_.size(); i++) {
+    const int index = dirty_patches_[i];
+    StagedPatch &staged = (*staged_patches)[i];
+    staged.patch_x = index % get_patches_width();
+    staged.patch_z = index / get_patches_width();
+    staged.rect = patch_dirty_rects_[index];
+    patch_dirty_rects_[index] = fw::Rectangle<int>();
   }
+  dirty_patches_.clear();
+
+  // Nothing changes the heights while we're in here (the brushes run on this thread), so it's safe to read them from
+  // the pool's threads.
+  thread_pool_->parallel_for(staged_patches->size(), 1, [this, &staged_patches](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      StagedPatch &staged = (*staged_patches)[i];
+      game::generate_terrain_vertices(
+          staged.vertices, height_field_, PATCH_SIZE, staged.patch_x, staged.patch_z, staged.rect);
+    }
+  });
+
+  fw::Framework::get_instance()->get_scenegraph_manager()->enqueue(
+    [this, staged_patches](fw::sg::Scenegraph&) {
+      for (StagedPatch const &staged : *staged_patches) {
+        upload_patch_rect(staged.patch_x, staged.patch_z, staged.rect, staged.vertices.data());
+      }
+    });
+}
+
+void EditorTerrain::update() {
+  bake_dirty_patches();
+  Terrain::update();
 }
 
 void EditorTerrain::initialize_splatt() {
@@ -139,12 +243,18 @@ void EditorTerrain::set_layer(int number, fw::Bitmap const &bitmap) {
   textures_->add(bitmap);
 }
 
-fw::Status EditorTerrain::BuildCollisionData(std::vector<bool> &vertices) {
-  if (static_cast<int>(vertices.size()) < (width_ * length_)) {
-    return fw::ErrorStatus("vertices vector is too small!");
+fw::Rectangle<int> EditorTerrain::update_passability() {
+  fw::Rectangle<int> rect = passability_dirty_rect_;
+  if (rect.width == 0) {
+    return rect;
   }
 
-  return game::BuildCollisionData(vertices, heights_, width_, length_);
+  // The pathing threads search our passability without a lock (see Terrain::get_passability).
+  assert(game::World::get_instance() == nullptr || game::World::get_instance()->get_pathing() == nullptr);
+  passability_->update(
+      height_field_, MIN_PASSABLE_SLOPE, rect.left, rect.top, rect.right() - 1, rect.bottom() - 1);
+  passability_dirty_rect_ = fw::Rectangle<int>();
+  return rect;
 }
 
 }
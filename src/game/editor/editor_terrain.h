@@ -1,14 +1,16 @@
 #pragma once
 
-#include <atomic>
-#include <mutex>
-#include <tuple>
+#include <memory>
+#include <vector>
+
+#include <framework/misc.h>
 
 #include <game/world/terrain.h>
 
 namespace fw {
 class Bitmap;
 class texture;
+class ThreadPool;
 }
 
 namespace ed {
@@ -16,9 +18,15 @@ namespace ed {
 // this subclass of game::Terrain allows us to edit the actual heightfield data, textures, and so on.
 class EditorTerrain: public game::Terrain {
 private:
-  std::mutex patches_to_bake_mutex_;
-  std::vector<std::tuple<int, int>> patches_to_bake_;
-  std::atomic<bool> bake_queued_;
+  // The vertices of each patch (indexed by get_patch_index, and in the patch's own coordinates, which go from 0 to
+  // PATCH_SIZE inclusive) whose position or normal has changed since we last baked it. Empty if it hasn't changed.
+  std::vector<fw::Rectangle<int>> patch_dirty_rects_;
+
+  // The indices of the patches whose rectangle in patch_dirty_rects_ isn't empty.
+  std::vector<int> dirty_patches_;
+
+  // We generate the changed vertices on this, so all the render thread has to do is upload them.
+  std::unique_ptr<fw::ThreadPool> thread_pool_;
 
   // we keep a separate vector of the splatt bitmaps for easy editing
   std::vector<fw::Bitmap> splatt_bitmaps_;
@@ -26,6 +34,16 @@ private:
   // We also keep a separate vector of the layer bitmaps
   std::vector<fw::Bitmap> layer_bitmaps_;
 
+  // The vertices whose passability may have changed since the last update_passability. Empty if nothing has. The
+  // coordinates aren't wrapped, so it can hang off the edge of the map.
+  fw::Rectangle<int> passability_dirty_rect_;
+
+  // Marks the vertices from min_x,min_z to max_x,max_z (inclusive, and not necessarily wrapped) as needing re-baking.
+  void mark_vertices_dirty(int min_x, int min_z, int max_x, int max_z);
+
+  // Regenerates the vertices that have changed since last time, and queues them up for uploading.
+  void bake_dirty_patches();
+
 public:
   EditorTerrain(int width, int height, float* height_data = nullptr);
   virtual ~EditorTerrain();
@@ -33,6 +51,19 @@ public:
   // set a new height for the given vertex
   void set_vertex_height(int x, int y, float height);
 
+  // Gets the heights of the width x length vertices starting at (x, z), one row after another. The coordinates don't
+  // need to be wrapped.
+  void get_vertex_heights(int x, int z, int width, int length, float *heights) const;
+
+  // Sets the heights of the width x length vertices starting at (x, z) to the given values (one row after another).
+  // This is what the brushes use: updating the height field, pyramid and so on once for the whole rectangle is much
+  // cheaper than calling set_vertex_height for each vertex. The coordinates don't need to be wrapped, but the
+  // rectangle can't be bigger than the map.
+  void set_vertex_heights(int x, int z, int width, int length, float const *heights);
+
+  // Bakes the patches we've changed since the last frame.
+  void update() override;
+
   // gets and sets the texture of the given layer.
   int get_num_layers() const;
   fw::Bitmap const &get_layer(int number);
@@ -49,10 +80,10 @@ public:
     return heights_;
   }
 
-  // builds the collision data for the whole map. we assume the vertices buffer
-  // is big enough to hold one data point per vertex in the map. each data point
-  // holds a single boolean flag - true means "passable", false means "impassable"
-  fw::Status BuildCollisionData(std::vector<bool> &vertices);
+  // Recalculates the passability of the vertices whose height has changed (and their neighbours, since their slope
+  // changes too) since the last time this was called. Returns the rectangle we updated, which is empty if nothing had
+  // changed. Pass that on to the path finders that share our passability (see get_passability).
+  fw::Rectangle<int> update_passability();
 };
 
 }
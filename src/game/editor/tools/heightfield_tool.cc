@@ -1,8 +1,11 @@
 
+#include <vector>
+
 #include <framework/framework.h>
 #include <framework/graphics.h>
 #include <framework/bitmap.h>
 #include <framework/color.h>
+#include <framework/height_brush.h>
 #include <framework/input.h>
 #include <framework/timer.h>
 #include <framework/logging.h>
@@ -32,6 +35,17 @@ protected:
   std::shared_ptr<ed::EditorTerrain> terrain_;
   ed::HeightfieldTool *tool_;
 
+  // Does the actual arithmetic, see fw::HeightBrush.
+  fw::HeightBrush kernel_;
+
+  // The (padded) heights under the brush, see apply().
+  std::vector<float> heights_;
+
+  // Copies the heights under the brush at cursor_loc into heights_ (with the border that fw::HeightBrush wants), calls
+  // fn(heights, origin_x, origin_z) to change them, then copies them back to the terrain, all in one go.
+  template<typename Fn>
+  void apply(fw::Vector const &cursor_loc, Fn const &fn);
+
 public:
   HeightfieldBrush();
   virtual ~HeightfieldBrush();
@@ -56,6 +70,20 @@ void HeightfieldBrush::Initialize(
   terrain_ = terrain;
 }
 
+template<typename Fn>
+void HeightfieldBrush::apply(fw::Vector const &cursor_loc, Fn const &fn) {
+  kernel_.set_radius(tool_->get_radius());
+
+  // The terrain does the wrapping (splitting the rectangle up where it goes off the edge of the map).
+  int padded_size = kernel_.get_padded_size();
+  int origin_x = (int) cursor_loc[0] - kernel_.get_radius() - 1;
+  int origin_z = (int) cursor_loc[2] - kernel_.get_radius() - 1;
+  heights_.resize(padded_size * padded_size);
+  terrain_->get_vertex_heights(origin_x, origin_z, padded_size, padded_size, heights_.data());
+  fn(heights_.data(), origin_x, origin_z);
+  terrain_->set_vertex_heights(origin_x, origin_z, padded_size, padded_size, heights_.data());
+}
+
 //-----------------------------------------------------------------------------
 class RaiseLowerBrush: public HeightfieldBrush {
 public:
@@ -109,24 +137,10 @@ void RaiseLowerBrush::update(fw::Vector const &cursor_loc) {
   }
 
   if (dy != 0.0f) {
-    int cx = (int) cursor_loc[0];
-    int cz = (int) cursor_loc[2];
-    int sx = cx - tool_->get_radius();
-    int sz = cz - tool_->get_radius();
-    int ex = cx + tool_->get_radius();
-    int ez = cz + tool_->get_radius();
-
     float amount = 4.0f * tool_->get_speed();
-
-    for (int z = sz; z < ez; z++) {
-      for (int x = sx; x < ex; x++) {
-        float height = terrain_->get_vertex_height(x, z);
-        float distance =
-            sqrt((float) ((x - cx) * (x - cx) + (z - cz) * (z - cz))) / tool_->get_radius();
-        if (distance < 1.0f)
-          terrain_->set_vertex_height(x, z, height + (dy * (1.0f - distance)) * amount);
-      }
-    }
+    apply(cursor_loc, [this, dy, amount](float *heights, int, int) {
+      kernel_.raise(heights, dy, amount);
+    });
   }
 }
 
@@ -178,32 +192,120 @@ void LevelBrush::update(fw::Vector const &cursor_loc) {
   }
 
   if (levelling_) {
-    int cx = (int) cursor_loc[0];
-    int cz = (int) cursor_loc[2];
-    int sx = cx - tool_->get_radius();
-    int sz = cz - tool_->get_radius();
-    int ex = cx + tool_->get_radius();
-    int ez = cz + tool_->get_radius();
+    float amount = 4.0f * tool_->get_speed();
+    float update_time = fw::Framework::get_instance()->get_timer()->get_update_time();
+    apply(cursor_loc, [this, amount, update_time](float *heights, int, int) {
+      kernel_.level(heights, level_height_, update_time, amount);
+    });
+  }
+}
+
+//-----------------------------------------------------------------------------
+// SmoothBrush evens out the bumps under it while you hold the mouse button down.
+class SmoothBrush: public HeightfieldBrush {
+private:
+  bool smoothing_ = false;
+  int key_bind_;
+
+public:
+  SmoothBrush();
+  virtual ~SmoothBrush();
 
+  void OnSmoothKey(std::string keyname, bool is_down);
+  virtual void update(fw::Vector const &cursor_loc) override;
+};
+
+SmoothBrush::SmoothBrush() {
+  fw::Input *inp = fw::Framework::get_instance()->get_input();
+  key_bind_ = inp->bind_key(
+      "Left-Mouse",
+      fw::InputBinding(std::bind(&SmoothBrush::OnSmoothKey, this, _1, _2)));
+}
+
+SmoothBrush::~SmoothBrush() {
+  fw::Input *inp = fw::Framework::get_instance()->get_input();
+  inp->unbind_key(key_bind_);
+}
+
+void SmoothBrush::OnSmoothKey(std::string keyname, bool is_down) {
+  smoothing_ = is_down;
+}
+
+void SmoothBrush::update(fw::Vector const &cursor_loc) {
+  if (smoothing_) {
     float amount = 4.0f * tool_->get_speed();
+    float update_time = fw::Framework::get_instance()->get_timer()->get_update_time();
+    apply(cursor_loc, [this, amount, update_time](float *heights, int, int) {
+      kernel_.smooth(heights, update_time, amount);
+    });
+  }
+}
 
-    for (int z = sz; z < ez; z++) {
-      for (int x = sx; x < ex; x++) {
-        float height = terrain_->get_vertex_height(x, z);
-        float diff = (level_height_ - height) * fw::Framework::get_instance()->get_timer()->get_update_time();
-        float distance = sqrt((float) ((x - cx) * (x - cx) + (z - cz) * (z - cz))) / tool_->get_radius();
-        if (distance < 1.0f) {
-          terrain_->set_vertex_height(x, z, height + (diff * (1.0f - distance)) * amount);
-        }
-      }
-    }
+//-----------------------------------------------------------------------------
+// NoiseBrush roughens up the terrain under it: the left button makes the bumps bigger and the right button smaller.
+class NoiseBrush: public HeightfieldBrush {
+private:
+  bool is_adding_ = false;
+  bool is_removing_ = false;
+  int add_key_bind_;
+  int remove_key_bind_;
+
+public:
+  NoiseBrush();
+  virtual ~NoiseBrush();
+
+  void OnAddKey(std::string keyname, bool is_down);
+  void OnRemoveKey(std::string keyname, bool is_down);
+  virtual void update(fw::Vector const &cursor_loc) override;
+};
+
+NoiseBrush::NoiseBrush() {
+  fw::Input *inp = fw::Framework::get_instance()->get_input();
+  add_key_bind_ = inp->bind_key(
+      "Left-Mouse",
+      fw::InputBinding(std::bind(&NoiseBrush::OnAddKey, this, _1, _2)));
+  remove_key_bind_ = inp->bind_key(
+      "Right-Mouse",
+      fw::InputBinding(std::bind(&NoiseBrush::OnRemoveKey, this, _1, _2)));
+}
+
+NoiseBrush::~NoiseBrush() {
+  fw::Input *inp = fw::Framework::get_instance()->get_input();
+  inp->unbind_key(add_key_bind_);
+  inp->unbind_key(remove_key_bind_);
+}
+
+void NoiseBrush::OnAddKey(std::string keyname, bool is_down) {
+  is_adding_ = is_down;
+}
+
+void NoiseBrush::OnRemoveKey(std::string keyname, bool is_down) {
+  is_removing_ = is_down;
+}
+
+void NoiseBrush::update(fw::Vector const &cursor_loc) {
+  float dy = 0.0f;
+  if (is_adding_) {
+    dy += 2.0f * fw::Framework::get_instance()->get_timer()->get_update_time();
+  }
+  if (is_removing_) {
+    dy -= 2.0f * fw::Framework::get_instance()->get_timer()->get_update_time();
+  }
+
+  if (dy != 0.0f) {
+    float amount = 4.0f * tool_->get_speed();
+    apply(cursor_loc, [this, dy, amount](float *heights, int origin_x, int origin_z) {
+      kernel_.noise(heights, origin_x, origin_z, terrain_->get_width(), terrain_->get_length(), dy, amount);
+    });
   }
 }
 
 //-----------------------------------------------------------------------------
 enum IDS {
   RAISE_LOWER_BRUSH_ID = 329723,
-  LEVEL_BRUSH_ID
+  LEVEL_BRUSH_ID,
+  SMOOTH_BRUSH_ID,
+  NOISE_BRUSH_ID,
 };
 
 class HeightfieldToolWindow {
@@ -255,6 +357,25 @@ HeightfieldToolWindow::HeightfieldToolWindow(ed::HeightfieldTool *tool) :
                   << Button::icon("editor_hightfield_level")
                   << Button::click(std::bind(&HeightfieldToolWindow::on_tool_clicked, this, _1)))
               )
+          << (Builder<LinearLayout>()
+              << Widget::width(Widget::MatchParent())
+              << Widget::height(Widget::WrapContent())
+              << LinearLayout::orientation(LinearLayout::Orientation::kHorizontal)
+              << (Builder<Button>()
+                  << Widget::height(Widget::Fixed(30.f))
+                  << LinearLayout::weight(1.0f)
+                  << Widget::margin(0.f, 5.f, 10.0f, 10.0f)
+                  << Widget::id(SMOOTH_BRUSH_ID)
+                  << Button::text("Smooth")
+                  << Button::click(std::bind(&HeightfieldToolWindow::on_tool_clicked, this, _1)))
+              << (Builder<Button>()
+                  << Widget::height(Widget::Fixed(30.f))
+                  << LinearLayout::weight(1.0f)
+                  << Widget::margin(0.f, 10.f, 10.0f, 5.0f)
+                  << Widget::id(NOISE_BRUSH_ID)
+                  << Button::text("Noise")
+                  << Button::click(std::bind(&HeightfieldToolWindow::on_tool_clicked, this, _1)))
+              )
         << (Builder<Label>()
             << Widget::width(Widget::MatchParent())
             << Widget::height(Widget::WrapContent())
@@ -328,15 +449,23 @@ void HeightfieldToolWindow::on_import_file_selected(ed::OpenFileWindow &ofw) {
 bool HeightfieldToolWindow::on_tool_clicked(fw::gui::Widget &w) {
   auto raise_lower = wnd_->Find<Button>(RAISE_LOWER_BRUSH_ID);
   auto level = wnd_->Find<Button>(LEVEL_BRUSH_ID);
+  auto smooth = wnd_->Find<Button>(SMOOTH_BRUSH_ID);
+  auto noise = wnd_->Find<Button>(NOISE_BRUSH_ID);
 
   raise_lower->set_pressed(false);
   level->set_pressed(false);
+  smooth->set_pressed(false);
+  noise->set_pressed(false);
   dynamic_cast<Button &>(w).set_pressed(true);
 
   if (w.get_id() == RAISE_LOWER_BRUSH_ID) {
     tool_->set_brush(std::make_unique<RaiseLowerBrush>());
   } else if (w.get_id() == LEVEL_BRUSH_ID) {
     tool_->set_brush(std::make_unique<LevelBrush>());
+  } else if (w.get_id() == SMOOTH_BRUSH_ID) {
+    tool_->set_brush(std::make_unique<SmoothBrush>());
+  } else if (w.get_id() == NOISE_BRUSH_ID) {
+    tool_->set_brush(std::make_unique<NoiseBrush>());
   }
 
   return true;
@@ -414,15 +543,17 @@ void HeightfieldTool::import_heightfield(fw::Bitmap &bm) {
   // get the pixel data from the bitmap
   std::vector<uint32_t> const &pixels = bm.GetPixels();
 
-  // now, for each pixel, we set the terrain height!
+  // now, for each pixel, we work out the terrain height, and then set them all at once
+  std::vector<float> heights(terrain_width * terrain_length);
   for (int x = 0; x < terrain_width; x++) {
     for (int z = 0; z < terrain_length; z++) {
       fw::Color col = fw::Color::from_argb(pixels[x + (z * terrain_width)]);
       float val = col.grayscale();
 
-      terrain_->set_vertex_height(x, z, val * 30.0f);
+      heights[x + (z * terrain_width)] = val * 30.0f;
     }
   }
+  terrain_->set_vertex_heights(0, 0, terrain_width, terrain_length, heights.data());
 }
 /*
 void HeightfieldTool::render(fw::sg::Scenegraph &scenegraph) {
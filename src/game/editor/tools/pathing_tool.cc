@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <functional>
 
 #include <absl/strings/str_cat.h>
@@ -19,7 +20,7 @@
 #include <framework/scenegraph.h>
 #include <framework/shader.h>
 #include <framework/paths.h>
-#include <framework/path_find.h>
+#include <framework/timer.h>
 
 #include <game/editor/tools/pathing_tool.h>
 #include <game/editor/windows/main_menu.h>
@@ -147,11 +148,11 @@ private:
 
 public:
   void bake(
-      std::vector<bool> &data, float *heights, int width, int length, int patch_x, int patch_z);
+      fw::PassabilityGrid const &passability, float *heights, int width, int length, int patch_x, int patch_z);
 };
 
 void CollisionPatchNode::bake(
-    std::vector<bool> &data, float *heights, int width, int length, int patch_x, int patch_z) {
+    fw::PassabilityGrid const &passability, float *heights, int width, int length, int patch_x, int patch_z) {
 
   std::vector<uint16_t> indices;
   game::generate_terrain_indices_wireframe(indices, PATCH_SIZE);
@@ -166,7 +167,7 @@ void CollisionPatchNode::bake(
       int ix = fw::constrain((patch_x * PATCH_SIZE) + x, width);
       int iz = fw::constrain((patch_z * PATCH_SIZE) + z, length);
 
-      bool passable = data[(iz * width) + ix];
+      bool passable = passability.is_passable(ix, iz);
       fw::Color color(passable ? fw::Color(0.1f, 1.0f, 0.1f) : fw::Color(1.0f, 0.1f, 0.1f));
 
       int index = z * (PATCH_SIZE + 1) + x;
@@ -214,19 +215,10 @@ void PathingTool::activate() {
 
   int width = get_terrain()->get_width();
   int length = get_terrain()->get_length();
-  collision_data_.resize(width * length);
-  auto status = get_terrain()->BuildCollisionData(collision_data_);
-  if (!status.ok()) {
-    LOG(ERR) << "error building collision data: " << status;
-  }
+  update_path_find();
 
   patches_.resize((width / PATCH_SIZE) * (length / PATCH_SIZE));
 
-  std::shared_ptr<fw::TimedPathFind> pf(
-      new fw::TimedPathFind(
-          get_terrain()->get_width(), get_terrain()->get_length(), collision_data_));
-  path_find_ = pf;
-
   fw::Input *inp = fw::Framework::get_instance()->get_input();
   keybind_tokens_.push_back(
       inp->bind_key(
@@ -252,7 +244,7 @@ void PathingTool::activate() {
 
   fw::Framework::get_instance()->get_scenegraph_manager()->enqueue(
     [this, patch_width, patch_length](fw::sg::Scenegraph& sg) {
-      auto data = terrain_->get_collision_data();
+      auto passability = terrain_->get_passability();
       auto heights = terrain_->get_height_data();
       int width = terrain_->get_width();
       int length = terrain_->get_length();
@@ -265,7 +257,7 @@ void PathingTool::activate() {
                   patch_x, patch_z, patch_width, patch_length, &new_patch_x, &new_patch_z);
           auto patch = patches_[patch_index];
           if (patch) {
-            patch->bake(data, heights, width, length, patch_x, patch_z);
+            patch->bake(*passability, heights, width, length, patch_x, patch_z);
             sg.add_node(patch);
           }
         }
@@ -278,6 +270,18 @@ void PathingTool::activate() {
     });
 }
 
+// Brings the terrain's passability up to date and makes sure path_find_ is up to date with it. The heightfield may
+// have been edited since we were last active, so we only rebuild the part around the vertices that were edited.
+void PathingTool::update_path_find() {
+  fw::Rectangle<int> changed = get_terrain()->update_passability();
+  if (!path_find_) {
+    path_find_ = std::make_shared<fw::HierarchicalPathFind>(
+        get_terrain()->get_passability(), game::Terrain::PATCH_SIZE);
+  } else if (changed.width > 0) {
+    path_find_->update_passability(changed);
+  }
+}
+
 void PathingTool::deactivate() {
   Tool::deactivate();
 
@@ -343,16 +347,22 @@ void PathingTool::find_path() {
     return;
 
   std::vector<fw::Vector> full_path;
-  if (!path_find_->find(full_path, start_pos_, end_pos_)) {
+  fw::Timer tmr;
+  tmr.start();
+  bool found = path_find_->find(full_path, start_pos_, end_pos_);
+  tmr.stop();
+  float total_time = tmr.get_total_time();
+
+  if (!found) {
     statusbar->set_message(
-      absl::StrCat("No path found after ", path_find_->total_time * 1000.0f, "ms"));
+      absl::StrCat("No path found after ", total_time * 1000.0f, "ms"));
   } else {
     std::vector<fw::Vector> path;
     path_find_->simplify_path(full_path, path);
     statusbar->set_message(
       absl::StrCat(
-        "Path found in ", path_find_->total_time * 1000.0f, "ms, ", full_path.size(), " nodes, ",
-        path.size(), " nodes (simplified)"));
+        "Path found in ", total_time * 1000.0f, "ms, ", full_path.size(), " nodes, ",
+        path.size(), " nodes (simplified), ", path_find_->get_nodes_expanded(), " expanded"));
 
     std::vector<fw::vertex::xyz_c> buffer;
 
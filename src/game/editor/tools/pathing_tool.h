@@ -2,8 +2,8 @@
 
 #include <memory>
 
+#include <framework/hierarchical_path_find.h>
 #include <framework/model.h>
-#include <framework/path_find.h>
 #include <framework/scenegraph.h>
 
 #include <game/editor/tools/tools.h>
@@ -22,7 +22,6 @@ private:
 
   TestMode test_mode_;
   std::unique_ptr<PathingToolWindow> wnd_;
-  std::vector<bool> collision_data_;
   std::shared_ptr<fw::Model> marker_;
   fw::Vector start_pos_;
   bool start_set_;
@@ -30,12 +29,13 @@ private:
   bool end_set_;
   bool simplify_;
   std::vector<std::shared_ptr<CollisionPatchNode>> patches_;
-  std::shared_ptr<fw::TimedPathFind> path_find_;
+  std::shared_ptr<fw::HierarchicalPathFind> path_find_;
 
   std::shared_ptr<fw::sg::Node> current_path_node_;
   std::shared_ptr<fw::ModelNode> start_marker_;
   std::shared_ptr<fw::ModelNode> end_marker_;
 
+  void update_path_find();
   void on_key(std::string keyname, bool is_down);
   void find_path();
 public:
@@ -1,3 +1,4 @@
+#include <filesystem>
 #include <memory>
 
 #include <absl/strings/str_cat.h>
@@ -8,10 +9,12 @@
 #include <framework/color.h>
 #include <framework/graphics.h>
 #include <framework/misc.h>
+#include <framework/pack_file.h>
+#include <framework/paths.h>
 #include <framework/status.h>
 #include <framework/texture.h>
 
-#include <game/world/world_vfs.h>
+#include <game/world/packed_map.h>
 #include <game/world/terrain.h>
 #include <game/editor/world_writer.h>
 #include <game/editor/editor_world.h>
@@ -29,70 +32,55 @@ WorldWriter::~WorldWriter() {
 fw::Status WorldWriter::write(std::string name) {
   name_ = name;
 
-  ASSIGN_OR_RETURN(game::WorldFile wf, game::OpenWorldFile(name, /* for_writing= */ true));
-
-  RETURN_IF_ERROR(write_terrain(wf));
-  write_mapdesc(wf);
-  RETURN_IF_ERROR(WriteMinimapBackground(wf));
-  RETURN_IF_ERROR(WriteCollisionData(wf));
+  fw::PackWriter pack;
+  RETURN_IF_ERROR(write_terrain(pack));
+  write_mapdesc(pack);
+  RETURN_IF_ERROR(WriteMinimapBackground(pack));
+  RETURN_IF_ERROR(WriteCollisionData(pack));
 
   // write the screenshot as well, which is pretty simple...
   if (world_->get_screenshot().get_width() > 0) {
-    game::WorldFileEntry wfe = wf.get_entry("screenshot.png", true /* for_write */);
-    auto status = world_->get_screenshot().SaveBitmap(wfe.get_full_path());
-    if (!status.ok()) {
-      return status;
-    }
+    game::PackImage(pack, game::kPackedScreenshotEntry, world_->get_screenshot());
   }
 
-  return fw::OkStatus();
+  std::filesystem::path maps_path = fw::user_base_path() / "maps";
+  std::filesystem::create_directories(maps_path);
+  return pack.write(maps_path / (name + game::kPackedMapExtension));
 }
 
-fw::Status WorldWriter::write_terrain(game::WorldFile &wf) {
+fw::Status WorldWriter::write_terrain(fw::PackWriter &pack) {
   auto trn = dynamic_pointer_cast<EditorTerrain>(world_->get_terrain());
-  int version = 1;
-  int trn_width = trn->get_width();
-  int trn_length = trn->get_length();
-
-  game::WorldFileEntry wfe = wf.get_entry("heightfield", true /* for_write */);
-  wfe.write(&version, sizeof(int));
-  wfe.write(&trn_width, sizeof(int));
-  wfe.write(&trn_length, sizeof(int));
-  wfe.write(trn->heights_, trn_width * trn_length * sizeof(float));
+  game::PackHeightfield(pack, trn->get_width(), trn->get_length(), trn->heights_);
 
   for (int patch_z = 0; patch_z < trn->get_patches_length(); patch_z++) {
     for (int patch_x = 0; patch_x < trn->get_patches_width(); patch_x++) {
       fw::Bitmap &splatt = trn->get_splatt(patch_x, patch_z);
-
-      std::string name = absl::StrCat("splatt-", patch_x, "-", patch_z, ".png");
-      wfe = wf.get_entry(name, true /* for_write */);
-      RETURN_IF_ERROR(splatt.SaveBitmap(wfe.get_full_path()));
+      game::PackImage(pack, game::GetPackedSplattEntry(patch_x, patch_z), splatt);
     }
   }
   return fw::OkStatus();
 }
 
-void WorldWriter::write_mapdesc(game::WorldFile &wf) {
-  game::WorldFileEntry wfe = wf.get_entry(name_ + ".mapdesc", true /* for_write */);
-  wfe.write("<mapdesc version=\"1\">");
-  wfe.write(absl::StrCat("  <description>", world_->get_description(), "</description>"));
-  wfe.write(absl::StrCat("  <author>", world_->get_author(), "</author>"));
-  wfe.write("  <size width=\"3\" height=\"3\" />");
-  wfe.write("  <players>");
+void WorldWriter::write_mapdesc(fw::PackWriter &pack) {
+  std::string mapdesc = "<mapdesc version=\"1\">\r\n";
+  absl::StrAppend(&mapdesc, "  <description>", world_->get_description(), "</description>\r\n");
+  absl::StrAppend(&mapdesc, "  <author>", world_->get_author(), "</author>\r\n");
+  absl::StrAppend(&mapdesc, "  <size width=\"3\" height=\"3\" />\r\n");
+  absl::StrAppend(&mapdesc, "  <players>\r\n");
   for (std::map<int, fw::Vector>::iterator it = world_->get_player_starts().begin();
       it != world_->get_player_starts().end(); ++it) {
-    wfe.write(
-      absl::StrCat(
-        "    <player no=\"", it->first, "\" start=\"", it->second[0], " ", it->second[2], "\" />"));
+    absl::StrAppend(
+        &mapdesc, "    <player no=\"", it->first, "\" start=\"", it->second[0], " ", it->second[2], "\" />\r\n");
   }
-  wfe.write("  </players>");
-  wfe.write("</mapdesc>");
+  absl::StrAppend(&mapdesc, "  </players>\r\n");
+  absl::StrAppend(&mapdesc, "</mapdesc>\r\n");
+  game::PackText(pack, game::kPackedMapdescEntry, mapdesc);
 }
 
 // The minimap background consist of basically one pixel per vertex. We calculate the color
 // of the pixel as a combination of the height of the terrain at that point and the texture that
 // is displayed on the terrain at that point (so "high" and "grass" would be a Light green, etc)
-fw::Status WorldWriter::WriteMinimapBackground(game::WorldFile &wf) {
+fw::Status WorldWriter::WriteMinimapBackground(fw::PackWriter &pack) {
   auto trn = world_->get_terrain();
   int width = trn->get_width();
   int height = trn->get_length();
@@ -144,8 +132,8 @@ fw::Status WorldWriter::WriteMinimapBackground(game::WorldFile &wf) {
   fw::Bitmap img(width, height);
   img.SetPixels(pixels);
 
-  game::WorldFileEntry wfe = wf.get_entry("minimap.png", true /* for_write */);
-  return img.SaveBitmap(wfe.get_full_path());
+  game::PackImage(pack, game::kPackedMinimapEntry, img);
+  return fw::OkStatus();
 }
 
 // gets the basic color of the terrain at the given (x,z) location
@@ -188,26 +176,12 @@ void WorldWriter::calculate_base_minimap_colors() {
   }
 }
 
-fw::Status WorldWriter::WriteCollisionData(game::WorldFile &wf) {
+fw::Status WorldWriter::WriteCollisionData(fw::PackWriter &pack) {
   auto trn = std::dynamic_pointer_cast<EditorTerrain>(world_->get_terrain());
-  int width = trn->get_width();
-  int length = trn->get_length();
-
-  std::vector<bool> collision_data(width * length);
-  RETURN_IF_ERROR(trn->BuildCollisionData(collision_data));
-
-  int version = 1;
-
-  game::WorldFileEntry wfe = wf.get_entry("collision_data", true /* for_write */);
-  wfe.write(&version, sizeof(int));
-  wfe.write(&width, sizeof(int));
-  wfe.write(&length, sizeof(int));
-
-  for(bool b : collision_data) {
-    uint8_t n = static_cast<uint8_t>(b);
-    wfe.write(&n, 1);
-  }
 
+  // Only the vertices around the ones that have been edited since the last time need recalculating.
+  trn->update_passability();
+  game::PackCollisionData(pack, *trn->get_passability());
   return fw::OkStatus();
 }
 
@@ -3,15 +3,15 @@
 #include <framework/color.h>
 #include <framework/status.h>
 
-namespace game {
-class WorldFile;
+namespace fw {
+class PackWriter;
 }
 
 namespace ed {
 class EditorWorld;
 
-// This class writes all the information for a given world (map) into the given directory or .map file (which is
-// just a zipped version of the directory)
+// This class writes all the information for a given world (map) into a packed map (see game/world/packed_map.h) in
+// the user's maps directory.
 class WorldWriter {
 private:
   EditorWorld *world_;
@@ -21,10 +21,10 @@ private:
   fw::Color get_terrain_color(int x, int z);
   void calculate_base_minimap_colors();
 
-  fw::Status write_terrain(game::WorldFile &wf);
-  void write_mapdesc(game::WorldFile &wf);
-  fw::Status WriteMinimapBackground(game::WorldFile &wf);
-  fw::Status WriteCollisionData(game::WorldFile &wf);
+  fw::Status write_terrain(fw::PackWriter &pack);
+  void write_mapdesc(fw::PackWriter &pack);
+  fw::Status WriteMinimapBackground(fw::PackWriter &pack);
+  fw::Status WriteCollisionData(fw::PackWriter &pack);
 
 public:
   WorldWriter(EditorWorld *wrld);
@@ -40,6 +40,12 @@ void AudioComponent::apply_template(fw::lua::Value tmpl) {
 
 }
 
+EntityComponent *AudioComponent::clone() const {
+	AudioComponent *comp = new AudioComponent();
+	comp->cues_ = cues_;
+	return comp;
+}
+
 void AudioComponent::initialize() {
 	if (cues_.size() == 0) {
 		// Don't bother initializing if there aren't any cues.
@@ -13,7 +13,7 @@ namespace ent {
  * This class provide audio cues and so on that other components can reference to play audio from
  * this Entity.
  */
-class AudioComponent: public EntityComponent {
+class AudioComponent final: public EntityComponent {
 public:
   struct Cue {
     std::string name;
@@ -34,6 +34,7 @@ public:
   virtual ~AudioComponent();
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
   void initialize() override;
 
   /** Plays the Cue with the given name (if the Cue doesn't exist, nothing happens). */
@@ -15,4 +15,10 @@ void BuildableComponent::apply_template(fw::lua::Value tmpl) {
   build_group_ = tmpl["BuildGroup"];
 }
 
+EntityComponent *BuildableComponent::clone() const {
+  BuildableComponent *comp = new BuildableComponent();
+  comp->build_group_ = build_group_;
+  return comp;
+}
+
 }
@@ -7,7 +7,7 @@ namespace ent {
 /**
  * This component is attached to entities that can be directly built by a BuilderComponent Entity.
  */
-class BuildableComponent: public EntityComponent {
+class BuildableComponent final: public EntityComponent {
 private:
   std::string build_group_;
 
@@ -21,6 +21,7 @@ public:
   ~BuildableComponent();
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
 };
 
 }
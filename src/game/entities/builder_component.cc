@@ -38,6 +38,12 @@ void BuilderComponent::apply_template(fw::lua::Value tmpl) {
   build_group_ = tmpl["BuildGroup"];
 }
 
+EntityComponent *BuilderComponent::clone() const {
+  BuilderComponent *comp = new BuilderComponent();
+  comp->build_group_ = build_group_;
+  return comp;
+}
+
 // this is called when our Entity is selected/deselected, we need to show/hide the build window as
 // appropriate.
 void BuilderComponent::on_selected(bool selected) {
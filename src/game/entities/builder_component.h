@@ -12,7 +12,7 @@ class ParticleEffectComponent;
 /**
  * This component is attached to entities who have the ability to build things (units, buildings, etc).
  */
-class BuilderComponent : public EntityComponent {
+class BuilderComponent final : public EntityComponent {
 private:
   struct QueueEntry {
     fw::lua::Value tmpl;
@@ -44,6 +44,7 @@ public:
   void set_target(const fw::Vector& target);
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
   virtual void initialize();
   virtual void update(float dt);
 };
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ent {
+
+// ComponentStore keeps all of the components of a single type together in memory, in fixed-size blocks, rather than
+// scattered around the heap wherever new happened to put them. Components opt in with the ENT_COMPONENT_STORE macro,
+// which gives them a class-specific operator new and delete. Nothing else about how the component is created,
+// looked up or destroyed changes, so the rest of the code can keep treating it like any other component.
+//
+// The point is that the EntityManager's "systems" can then update every component of that type in one pass over
+// contiguous memory (see for_each), rather than hopping from entity to entity.
+//
+// Blocks are never freed or moved, so pointers to components stay valid, and components may be created while we're
+// in the middle of for_each (e.g. a weapon creating a missile). Allocation is locked, since entities can be created
+// from the simulation thread.
+template<typename T>
+class ComponentStore {
+private:
+  static const int BLOCK_SIZE = 256;
+
+  // The component is the first member, so we can get from a T* back to its Slot (and the live flag).
+  struct Slot {
+    alignas(T) unsigned char storage[sizeof(T)];
+    bool live = false;
+
+    inline T *get() {
+      return reinterpret_cast<T *>(storage);
+    }
+  };
+
+  struct Block {
+    Slot slots[BLOCK_SIZE];
+  };
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Block>> blocks_;
+  std::vector<T *> free_list_;
+  size_t size_ = 0;
+
+  ComponentStore() = default;
+
+public:
+  static ComponentStore<T> &get_instance() {
+    // This is never destroyed, as components can outlive static destructors at shutdown.
+    static ComponentStore<T> *instance = new ComponentStore<T>();
+    return *instance;
+  }
+
+  void *allocate() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (free_list_.empty()) {
+      // Push the new block's slots in reverse so that we hand them out in memory order.
+      blocks_.push_back(std::make_unique<Block>());
+      for (int i = BLOCK_SIZE - 1; i >= 0; i--) {
+        free_list_.push_back(blocks_.back()->slots[i].get());
+      }
+    }
+
+    T *ptr = free_list_.back();
+    free_list_.pop_back();
+    reinterpret_cast<Slot *>(ptr)->live = true;
+    size_++;
+    return ptr;
+  }
+
+  void deallocate(void *ptr) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    reinterpret_cast<Slot *>(ptr)->live = false;
+    free_list_.push_back(static_cast<T *>(ptr));
+    size_--;
+  }
+
+  // Calls fn with each component in the store, in memory order. fn may create new components (which may or may not be
+  // visited, depending on where they end up) but must not destroy any. Memory order depends on the order slots were
+  // freed in, so it's not the same on every peer: don't use it for anything where the order affects the result.
+  template<typename Fn>
+  void for_each(Fn fn) {
+    for (size_t block_index = 0;; block_index++) {
+      Block *block;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (block_index >= blocks_.size()) {
+          break;
+        }
+        block = blocks_[block_index].get();
+      }
+
+      for (int i = 0; i < BLOCK_SIZE; i++) {
+        if (block->slots[i].live) {
+          fn(*block->slots[i].get());
+        }
+      }
+    }
+  }
+
+  size_t size() const {
+    return size_;
+  }
+};
+
+// Add this to the body of a component class to allocate it from its ComponentStore. Subclasses (which are a different
+// size) just go through the normal operator new and delete.
+#define ENT_COMPONENT_STORE(type) \
+  static void *operator new(size_t size) { \
+    if (size != sizeof(type)) return ::operator new(size); \
+    return ent::ComponentStore<type>::get_instance().allocate(); \
+  } \
+  static void operator delete(void *ptr, size_t size) { \
+    if (size != sizeof(type)) { ::operator delete(ptr); return; } \
+    ent::ComponentStore<type>::get_instance().deallocate(ptr); \
+  }
+
+}
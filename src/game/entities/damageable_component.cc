@@ -20,8 +20,10 @@ DamageableComponent::DamageableComponent() {
 }
 
 DamageableComponent::~DamageableComponent() {
-  std::shared_ptr<Entity> entity(entity_);
-  EntityAttribute *health = entity->get_attribute("health");
+  // If our entity is being destroyed, its attributes (and their signals) are going with it, so there's nothing to
+  // disconnect. A prototype's components (see EntityManager::prototypes_) don't have an entity at all.
+  std::shared_ptr<Entity> entity = entity_.lock();
+  EntityAttribute *health = entity ? entity->get_attribute("health") : nullptr;
   if (health != nullptr) {
     health->sig_value_changed.Disconnect(health_value_changed_signal_);
   }
@@ -31,12 +33,19 @@ void DamageableComponent::apply_template(fw::lua::Value tmpl) {
   expl_name_ = tmpl["Explosion"];
 }
 
+EntityComponent *DamageableComponent::clone() const {
+  DamageableComponent *comp = new DamageableComponent();
+  comp->expl_name_ = expl_name_;
+  return comp;
+}
+
 void DamageableComponent::initialize() {
   std::shared_ptr<Entity> entity(entity_);
   EntityAttribute *health = entity->get_attribute("health");
   if (health != nullptr) {
     health_value_changed_signal_ =
-        health->sig_value_changed.Connect(std::bind(&DamageableComponent::check_explode, this, _2));
+        health->sig_value_changed.Connect(std::bind(&DamageableComponent::on_health_changed, this, _2));
+    update_state_hash(health->get_value<float>());
   }
 }
 
@@ -51,8 +60,22 @@ void DamageableComponent::apply_damage(float amt) {
   }
 }
 
-// this is called whenever our health attribute changes value. we check whether it's
-// hit 0, and explode if it has
+// this is called whenever our health attribute changes value. We fold the new value into the state hash, then check
+// whether we need to explode.
+void DamageableComponent::on_health_changed(std::any health_value) {
+  update_state_hash(std::any_cast<float>(health_value));
+  check_explode(health_value);
+}
+
+void DamageableComponent::update_state_hash(float health) {
+  std::shared_ptr<Entity> entity(entity_);
+  if (entity->get_id() != 0) {
+    state_hash_.set(
+        entity->get_manager()->get_state_hash(), fw::StateHash::combine(entity->get_id(), identifier, health));
+  }
+}
+
+// we check whether our health has hit 0, and explode if it has
 void DamageableComponent::check_explode(std::any health_value) {
   if (std::any_cast<float>(health_value) <= 0) {
     explode();
@@ -3,6 +3,7 @@
 #include <any>
 
 #include <framework/signals.h>
+#include <framework/state_hash.h>
 
 #include <game/entities/entity.h>
 
@@ -10,7 +11,7 @@ namespace ent {
 
 // This component is applied to any Entity which can take damage. Entities that "dish out" damage
 // will query for this component and apply the damage.
-class DamageableComponent: public EntityComponent {
+class DamageableComponent final: public EntityComponent {
 
 public:
   static const int identifier = 450;
@@ -22,16 +23,24 @@ public:
   ~DamageableComponent();
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
   virtual void initialize();
 
   void apply_damage(float amt);
   void explode();
 
+  void remove_from_state_hash() override {
+    state_hash_.clear();
+  }
+
 private:
+  void on_health_changed(std::any health_value);
+  void update_state_hash(float health);
   void check_explode(std::any health_value);
   
   fw::SignalConnection health_value_changed_signal_;
   std::string expl_name_;
+  fw::StateHash::Element state_hash_;
 };
 
 }
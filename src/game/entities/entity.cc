@@ -9,6 +9,7 @@
 #include <game/entities/entity.h>
 #include <game/entities/entity_debug.h>
 #include <game/entities/entity_factory.h>
+#include <game/entities/entity_manager.h>
 #include <game/entities/position_component.h>
 #include <game/entities/moveable_component.h>
 
@@ -36,9 +37,19 @@ void Entity::add_component(EntityComponent *comp) {
   }
 
   components_[comp->get_identifier()] = comp;
+
+  const int fast_index = get_fast_component_index(comp->get_identifier());
+  if (fast_index >= 0) {
+    fast_components_[fast_index] = comp;
+  }
 }
 
 EntityComponent *Entity::get_component(int identifier) {
+  const int fast_index = get_fast_component_index(identifier);
+  if (fast_index >= 0) {
+    return fast_components_[fast_index];
+  }
+
   auto it = components_.find(identifier);
   if (it == components_.end()) {
     return nullptr;
@@ -48,6 +59,11 @@ EntityComponent *Entity::get_component(int identifier) {
 }
 
 bool Entity::contains_component(int identifier) const {
+  const int fast_index = get_fast_component_index(identifier);
+  if (fast_index >= 0) {
+    return fast_components_[fast_index] != nullptr;
+  }
+
   return (components_.find(identifier) != components_.end());
 }
 
@@ -78,7 +94,12 @@ void Entity::initialize() {
 }
 
 void Entity::update(float dt) {
+  // If the EntityManager is using systems, it has already updated the components that have one.
+  const bool use_systems = mgr_->is_using_systems();
   for (auto& pair : components_) {
+    if (use_systems && pair.second->has_system()) {
+      continue;
+    }
     pair.second->update(dt);
   }
 
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <memory>
+#include <type_traits>
 
 #include <framework/lua.h>
+#include <framework/slot_map.h>
 
 #include <game/entities/entity_attribute.h>
 #include <game/entities/entity_debug.h>
@@ -10,6 +12,9 @@
 namespace fw {
 class Graphics;
 class XmlElement;
+namespace net {
+class PacketBuffer;
+}
 namespace sg {
 class Scenegraph;
 }
@@ -27,6 +32,24 @@ class EntityManager;
  */
 typedef uint32_t entity_id;
 
+// Component identifiers are all multiples of 50 (see the "identifier" member of each component), which lets an Entity
+// keep its components in a small fixed table indexed by identifier / 50, so that get_component<T>() doesn't need a map
+// lookup or a dynamic_cast. Any component whose identifier doesn't fit is still found through the map.
+const int MAX_FAST_COMPONENTS = 20;
+
+constexpr int get_fast_component_index(int identifier) {
+  return (identifier % 50 == 0 && identifier / 50 < MAX_FAST_COMPONENTS) ? identifier / 50 : -1;
+}
+
+// get_component<T>() can skip the dynamic_cast when every component with T's identifier is a T. That's only true when T
+// is final (so nothing else is a T) and declares its own get_identifier() (so it isn't using an identifier it
+// inherited: SeekingProjectileComponent and BallisticProjectileComponent both have ProjectileComponent's, for
+// example).
+template<class T>
+constexpr bool has_unique_identifier() {
+  return std::is_final_v<T> && std::is_same_v<decltype(&T::get_identifier), int (T::*)()>;
+}
+
 // This is the base class for components of entities. It's just got a couple of methods
 // and stuff that let us figure out how the component fits in and so on.
 class EntityComponent {
@@ -46,16 +69,37 @@ public:
   virtual void update(float) {
   }
 
+  // Return true from here if the EntityManager can update all components of your type in a batch "system" (see
+  // ComponentStore), in which case Entity::update will skip you when systems are enabled.
+  virtual bool has_system() const {
+    return false;
+  }
+
   // Loads this component with data from the given component template (Lua object).
   virtual void apply_template(fw::lua::Value tmpl) {
   }
 
+  // Creates a new component of the same type, configured the way apply_template configured this one but with none of
+  // its state. The EntityManager creates entities by cloning the components of a prototype (see
+  // EntityManager::prototypes_), so each template only has to be read from Lua once.
+  virtual EntityComponent *clone() const = 0;
+
+  // Components that add to the EntityManager's state hash (see EntityManager::get_state_hash()) override this to
+  // remove their contribution. This is called when the Entity is destroyed.
+  virtual void remove_from_state_hash() {
+  }
+
   // This is called by the entity_factory when we're added to an Entity. Do not override this and
   // instead wait for initialize() to be called.
   void set_entity(std::weak_ptr<Entity> ent) {
     entity_ = ent;
   }
 
+  // Gets the Entity we've been added to.
+  std::weak_ptr<Entity> const &get_entity() const {
+    return entity_;
+  }
+
   // Gets the unique identifier for this component (e.g. MesgComponent::identifier for the MeshComponent)
   virtual int get_identifier() = 0;
 
@@ -76,6 +120,7 @@ private:
   Entity(EntityManager *mgr, entity_id id);
 
   std::map<int, EntityComponent *> components_;
+  EntityComponent *fast_components_[MAX_FAST_COMPONENTS] = {};
   std::map<std::string, EntityAttribute> attributes_;
   std::weak_ptr<Entity> creator_;
   std::vector<std::function<void()>> cleanup_functions_;
@@ -86,6 +131,9 @@ private:
   EntityDebugFlags debug_flags_;
   std::unique_ptr<EntityDebugView> debug_view_;
   EntityManager *mgr_;
+
+  // Our key in the EntityManager's slot map of entities.
+  fw::SlotMapKey slot_key_;
 public:
   ~Entity();
 
@@ -123,16 +171,36 @@ public:
   // have a static member called "identifier" which contains the identifier
   template<class T>
   inline T *get_component() {
-    return dynamic_cast<T *>(get_component(T::identifier));
+    constexpr int fast_index = get_fast_component_index(T::identifier);
+    if constexpr (fast_index >= 0 && has_unique_identifier<T>()) {
+      // The only component that can have T's identifier is a T, so there's no need for a dynamic_cast.
+      return static_cast<T *>(fast_components_[fast_index]);
+    } else if constexpr (fast_index >= 0) {
+      return dynamic_cast<T *>(fast_components_[fast_index]);
+    } else {
+      return dynamic_cast<T *>(get_component(T::identifier));
+    }
   }
   template<class T>
   inline T const *get_component() const {
-    return dynamic_cast<T const *>(get_component(T::identifier));
+    constexpr int fast_index = get_fast_component_index(T::identifier);
+    if constexpr (fast_index >= 0 && has_unique_identifier<T>()) {
+      return static_cast<T const *>(fast_components_[fast_index]);
+    } else if constexpr (fast_index >= 0) {
+      return dynamic_cast<T const *>(fast_components_[fast_index]);
+    } else {
+      return dynamic_cast<T const *>(get_component(T::identifier));
+    }
   }
 
   template<class T>
   inline bool contains_component() const {
-    return contains_component(T::identifier);
+    constexpr int fast_index = get_fast_component_index(T::identifier);
+    if constexpr (fast_index >= 0) {
+      return fast_components_[fast_index] != nullptr;
+    } else {
+      return contains_component(T::identifier);
+    }
   }
 
   // these are called each frame to update the Entity
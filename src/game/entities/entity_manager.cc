@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <cassert>
 #include <functional>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 #include <framework/framework.h>
 #include <framework/camera.h>
@@ -7,28 +12,156 @@
 #include <framework/timer.h>
 #include <framework/misc.h>
 #include <framework/logging.h>
+#include <framework/packet_buffer.h>
+#include <framework/settings.h>
+#include <framework/thread_pool.h>
 
 #include <game/world/terrain.h>
 #include <game/world/world.h>
+#include <game/entities/component_store.h>
 #include <game/entities/entity.h>
 #include <game/entities/entity_factory.h>
 #include <game/entities/entity_manager.h>
 #include <game/entities/entity_debug.h>
 #include <game/entities/position_component.h>
+#include <game/entities/moveable_component.h>
+#include <game/entities/orderable_component.h>
 #include <game/entities/ownable_component.h>
+#include <game/entities/pathing_component.h>
+#include <game/entities/projectile_component.h>
 #include <game/entities/selectable_component.h>
+#include <game/entities/spatial_index.h>
+#include <game/entities/weapon_component.h>
+#include <game/simulation/commands.h>
+#include <game/simulation/orders.h>
+#include <game/simulation/simulation_thread.h>
+#include <game/simulation/snapshot.h>
 
 using namespace std::placeholders;
 
 namespace ent {
 
+// The size of the cells in the SpatialIndex. Most queries (collision avoidance, explosions, etc) have a radius of a
+// few units, so this keeps the number of cells we visit per query small without having too many entities per cell.
+static const float SPATIAL_INDEX_CELL_SIZE = 8.0f;
+
+// The number of components each task in update_systems' parallel phases plans. Planning one component is cheap, so
+// this needs to be big enough that we're not just measuring the overhead of handing out tasks.
+static const size_t SYSTEM_GRAIN_SIZE = 64;
+
+// The first four bytes of a state dump ("RPSD" in little-endian), and the version of the format.
+static const uint32_t STATE_DUMP_MAGIC = 0x44535052;
+static const uint32_t STATE_DUMP_VERSION = 1;
+
+template<typename T>
+static void write_value(std::ostream &outs, T const &value) {
+  outs.write(reinterpret_cast<char const *>(&value), sizeof(T));
+}
+
+namespace {
+
+// The kinds of component section in a snapshot. They're written (and so restored) in this order: orders come before
+// movement and weapons, because restarting an order changes those.
+enum class SnapshotComponentKind : uint8_t {
+  kPosition = 1,
+  kOwnable = 2,
+  kOrderable = 3,
+  kMoveable = 4,
+  kPathing = 5,
+  kWeapon = 6,
+  kSeekingProjectile = 7,
+  kBallisticProjectile = 8,
+};
+
+// Maps each entity in a snapshot to its index in the snapshot's entity section.
+typedef std::unordered_map<Entity const *, uint32_t> SnapshotEntityIndices;
+
+// Writes a section with the state of every component of type T. for_each calls its argument with each component (in
+// memory order, for the types in a ComponentStore). Each record is the index of the component's entity plus one,
+// followed by whatever T::write_snapshot writes, and a zero marks the end.
+template<typename T, typename ForEach>
+void write_component_section(
+    game::Snapshot &snapshot, SnapshotComponentKind kind, SnapshotEntityIndices const &indices, ForEach for_each) {
+  fw::net::PacketBuffer section(game::kSnapshotSectionComponents, fw::net::kWireVersionCompact);
+  section << static_cast<uint8_t>(kind);
+  for_each([&section, &indices](T const &component) {
+    // Components of entities that have been destroyed (but not freed yet) aren't in the snapshot.
+    std::shared_ptr<Entity> entity = component.get_entity().lock();
+    auto it = entity ? indices.find(entity.get()) : indices.end();
+    if (it == indices.end()) {
+      return;
+    }
+
+    uint32_t record = it->second + 1;
+    section << fw::net::compact(record);
+    component.write_snapshot(section);
+  });
+  uint32_t end = 0;
+  section << fw::net::compact(end);
+  snapshot.add_section(section);
+}
+
+template<typename T>
+void write_store_section(game::Snapshot &snapshot, SnapshotComponentKind kind, SnapshotEntityIndices const &indices) {
+  write_component_section<T>(snapshot, kind, indices, [](auto fn) {
+    ComponentStore<T>::get_instance().for_each(fn);
+  });
+}
+
+template<typename T>
+void write_entity_section(
+    game::Snapshot &snapshot, SnapshotComponentKind kind, SnapshotEntityIndices const &indices,
+    std::vector<Entity *> const &entities) {
+  write_component_section<T>(snapshot, kind, indices, [&entities](auto fn) {
+    for (Entity *entity : entities) {
+      T const *component = entity->get_component<T>();
+      if (component != nullptr) {
+        fn(*component);
+      }
+    }
+  });
+}
+
+// Reads back a section written by write_component_section. The projectiles share an identifier, so we can't use the
+// fast get_component<T>() for them, but that's one dynamic_cast per component (not per field).
+template<typename T>
+void read_component_section(fw::net::PacketBuffer &section, std::vector<std::shared_ptr<Entity>> const &entities) {
+  for (;;) {
+    uint32_t record;
+    section >> fw::net::compact(record);
+    if (record == 0 || !section.get_status().ok()) {
+      return;
+    }
+    if (record > entities.size()) {
+      section.set_error(fw::ErrorStatus("invalid entity index in snapshot: ") << record);
+      return;
+    }
+
+    Entity &entity = *entities[record - 1];
+    T *component = dynamic_cast<T *>(entity.get_component(T::identifier));
+    if (component == nullptr) {
+      // We've no way of knowing how much of the section to skip, so this is the end of it. (The identifier is copied
+      // because operator<< takes a reference, and the identifiers are declared but not defined.)
+      section.set_error(fw::ErrorStatus("entity in snapshot doesn't have component ")
+          << static_cast<int>(T::identifier) << ": " << entity.get_name());
+      return;
+    }
+    component->read_snapshot(section);
+  }
+}
+
+}
+
 EntityManager::EntityManager() :
-    patch_mgr_(0), debug_(0) {
+    patch_mgr_(0), debug_(0), spatial_index_(0), use_systems_(false),
+    thread_pool_(nullptr), in_parallel_phase_(false) {
 }
 
 EntityManager::~EntityManager() {
+  delete thread_pool_;
   delete patch_mgr_;
   delete debug_;
+  delete spatial_index_;
 }
 
 void EntityManager::initialize() {
@@ -39,6 +172,21 @@ void EntityManager::initialize() {
   patch_mgr_ = new PatchManager(
       static_cast<float>(terrain->get_width()),
       static_cast<float>(terrain->get_length()));
+  spatial_index_ = new SpatialIndex(
+      static_cast<float>(terrain->get_width()),
+      static_cast<float>(terrain->get_length()),
+      SPATIAL_INDEX_CELL_SIZE);
+  use_systems_ = fw::Settings::get<bool>("entity-systems");
+
+  if (use_systems_) {
+    int num_threads = fw::Settings::get<int>("entity-update-threads");
+    if (num_threads < 0) {
+      // The update thread helps out as well, so this leaves a core for the render thread.
+      num_threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 2, 0, 4);
+    }
+    LOG(INFO) << "updating entity systems with " << num_threads << " extra thread(s)";
+    thread_pool_ = new fw::ThreadPool(num_threads);
+  }
 }
 
 std::shared_ptr<Entity> EntityManager::create_entity(std::string const &template_name, entity_id id) {
@@ -47,12 +195,68 @@ std::shared_ptr<Entity> EntityManager::create_entity(std::string const &template
 
 std::shared_ptr<Entity> EntityManager::create_entity(
     std::shared_ptr<Entity> created_by, std::string const &template_name, entity_id id) {
+  std::shared_ptr<Entity> ent = create_entity(get_prototype(template_name), created_by, id);
+
+  // This is here rather than in the create_entity that does the work so that restoring a snapshot doesn't format a
+  // log line (which happens even if it's not written) for every one of its entities.
+  LOG(DBG) << "created entity: " << template_name << "(identifier: " << id << ")";
+  return ent;
+}
+
+Entity const &EntityManager::get_prototype(std::string const &template_name) {
+  std::unique_ptr<Entity> &prototype = prototypes_[template_name];
+  if (!prototype) {
+    // populate() needs a shared_ptr to give the components, but the prototype's components mustn't be attached to it
+    // (otherwise e.g. ComponentStore<PositionComponent>::for_each would put it into the world), so we detach them.
+    std::shared_ptr<Entity> ent(new Entity(this, 0));
+    ent::EntityFactory factory;
+    factory.populate(ent, template_name);
+
+    prototype.reset(new Entity(this, 0));
+    prototype->name_ = template_name;
+    prototype->attributes_ = ent->attributes_;
+    std::swap(prototype->components_, ent->components_);
+    std::swap(prototype->fast_components_, ent->fast_components_);
+    for (auto &pair : prototype->components_) {
+      pair.second->set_entity(std::weak_ptr<Entity>());
+    }
+  }
+  return *prototype;
+}
+
+void EntityManager::set_prototype(std::string const &template_name, std::vector<EntityComponent *> const &components,
+    std::vector<EntityAttribute> const &attributes) {
+  std::unique_ptr<Entity> prototype(new Entity(this, 0));
+  prototype->name_ = template_name;
+  for (EntityAttribute const &attr : attributes) {
+    prototype->add_attribute(attr);
+  }
+  for (EntityComponent *comp : components) {
+    prototype->add_component(comp);
+  }
+  prototypes_[template_name] = std::move(prototype);
+}
+
+void EntityManager::set_update_threads(int num_threads) {
+  use_systems_ = true;
+  delete thread_pool_;
+  thread_pool_ = new fw::ThreadPool(num_threads);
+}
+
+std::shared_ptr<Entity> EntityManager::create_entity(
+    Entity const &prototype, std::shared_ptr<Entity> created_by, entity_id id) {
+  // Entities can only be created in the serial parts of update_systems, see the comment there.
+  assert(!in_parallel_phase_);
+
   std::shared_ptr<Entity> ent(new Entity(this, id));
-  ent->name_ = template_name;
+  ent->name_ = prototype.name_;
   ent->creator_ = created_by;
-
-  ent::EntityFactory factory;
-  factory.populate(ent, template_name);
+  ent->attributes_ = prototype.attributes_;
+  for (auto const &pair : prototype.components_) {
+    EntityComponent *comp = pair.second->clone();
+    ent->add_component(comp);
+    comp->set_entity(ent);
+  }
 
   ent->initialize();
   if (created_by) {
@@ -75,10 +279,6 @@ std::shared_ptr<Entity> EntityManager::create_entity(
     }
   }
 
-  ent->add_attribute(ent::EntityAttribute("patch_offset_", fw::Vector(0, 0, 0)));
-
-  LOG(DBG) << "created entity: " << template_name << "(identifier: " << id << ")";
-
   for (auto& pair : ent->components_) {
     EntityComponent *comp = pair.second;
     if (comp->allow_get_by_component()) {
@@ -87,11 +287,19 @@ std::shared_ptr<Entity> EntityManager::create_entity(
     }
   }
 
-  all_entities_.push_back(ent);
+  ent->slot_key_ = all_entities_.insert(ent);
+  if (id != 0) {
+    if (entities_by_id_.find(id) != nullptr) {
+      LOG(WARN) << "entity identifier already in use: " << id;
+    }
+    entities_by_id_.insert_or_assign(id, ent->slot_key_);
+  }
   return ent;
 }
 
 void EntityManager::destroy(std::weak_ptr<Entity> entity) {
+  assert(!in_parallel_phase_);
+
   std::shared_ptr<ent::Entity> sp = entity.lock();
   if (sp) {
     float age = sp->get_age();
@@ -167,8 +375,7 @@ std::weak_ptr<Entity> EntityManager::get_entity(fw::Vector const &start, fw::Vec
           0,
           (float) (patch_z * PatchManager::PATCH_SIZE) - p->get_origin()[2]);
 
-      std::list<std::weak_ptr<Entity> > patch_entities = p->get_entities();
-      for (auto it = patch_entities.begin(); it != patch_entities.end(); ++it) {
+      for (auto it = p->get_entities().begin(); it != p->get_entities().end(); ++it) {
         std::shared_ptr<Entity> Entity = (*it).lock();
         if (!Entity)
           continue;
@@ -193,13 +400,16 @@ std::weak_ptr<Entity> EntityManager::get_entity(fw::Vector const &start, fw::Vec
 }
 
 std::weak_ptr<Entity> EntityManager::get_entity(entity_id id) {
-  // obviously, this is dumb... we should index entities by the identifier for fast access
-  for (std::shared_ptr<Entity>& ent : all_entities_) {
-    if (ent->get_id() == id)
-      return std::weak_ptr<Entity>(ent);
+  fw::SlotMapKey const *key = entities_by_id_.find(id);
+  if (key == nullptr) {
+    return std::weak_ptr<Entity>();
   }
 
-  return std::weak_ptr<Entity>();
+  std::shared_ptr<Entity> *ent = all_entities_.get(*key);
+  if (ent == nullptr) {
+    return std::weak_ptr<Entity>();
+  }
+  return std::weak_ptr<Entity>(*ent);
 }
 
 // gets a reference to a list of all the entities with the component with the given identifier.
@@ -250,14 +460,30 @@ void EntityManager::clear_selection() {
 }
 
 void EntityManager::cleanup_destroyed() {
-  // go through the destroyed list and destroy all entities that have been marked as such
-  for(auto ent : destroyed_entities_) {
-    for (auto it = all_entities_.begin(); it != all_entities_.end();) {
-      if (*it == ent) {
-        it = all_entities_.erase(it);
-      } else {
-        ++it;
-      }
+  if (destroyed_entities_.empty()) {
+    return;
+  }
+
+  // go through the destroyed list and destroy all entities that have been marked as such. An Entity can be destroyed
+  // more than once in the same frame (e.g. hit by two missiles), in which case remove() fails the second time.
+  for(auto &ent : destroyed_entities_) {
+    if (!all_entities_.remove(ent->slot_key_)) {
+      continue;
+    }
+
+    PositionComponent *position = ent->get_component<PositionComponent>();
+    if (position != nullptr) {
+      position->remove_from_world();
+    }
+
+    // Take the entity out of the state hash now, rather than whenever the last reference to it happens to go away.
+    for (auto &[identifier, component] : ent->components_) {
+      component->remove_from_state_hash();
+    }
+
+    fw::SlotMapKey const *key = entities_by_id_.find(ent->get_id());
+    if (key != nullptr && *key == ent->slot_key_) {
+      entities_by_id_.erase(ent->get_id());
     }
   }
   destroyed_entities_.clear();
@@ -265,18 +491,432 @@ void EntityManager::cleanup_destroyed() {
   // clear the other Entity list(s) of entities that have been destroyed
   selected_entities_.remove_if(std::bind(&std::weak_ptr<Entity> ::expired, _1));
 
-  for(auto it : entities_by_component_) {
+  for(auto &it : entities_by_component_) {
     it.second.remove_if(std::bind(&std::weak_ptr<Entity>::expired, _1));
   }
 }
 
+// Positions are updated straight out of their ComponentStore, in memory order. The other systems gather their
+// components in all_entities_ order (the order update() gives Entity::update), because the order of a ComponentStore
+// depends on which slots its free list happened to hand out, which isn't the same on every peer (or even in every
+// run). all_entities_ only changes as entities are created and destroyed, which every peer does in the same order,
+// and a snapshot keeps it. The work is split into phases:
+//
+//  1. Positions are brought up-to-date, serially (this can move entities between patches).
+//  2. Movement and weapon targeting are planned in parallel. Planning only reads other entities' state, and only
+//     writes to the component's own state, so it doesn't matter which thread plans which component, or when.
+//  3. The planned moves and weapon actions are committed serially, in all_entities_ order. Firing a weapon creates a
+//     projectile, which is why this can't happen in phase 2.
+//  4. Positions are brought up-to-date again, so that nothing in phase 5 needs to modify a PositionComponent.
+//  5. Projectile homing and hit detection are planned in parallel.
+//  6. Seeking projectiles steer towards their targets and projectiles which hit something explode, serially, in
+//     all_entities_ order. This damages (and may destroy) entities.
+//
+// Every commit happens in the same order however the plan phases were scheduled, so the simulation comes out exactly
+// the same whatever the number of threads in thread_pool_, which is what keeps lockstep peers in sync.
+void EntityManager::update_systems(float dt) {
+  auto update_positions = [dt]() {
+    ComponentStore<PositionComponent>::get_instance().for_each([dt](PositionComponent &position) {
+      // The prototypes' components are in the store as well, but they're not in the world.
+      if (position.get_entity().expired()) {
+        return;
+      }
+      position.PositionComponent::update(dt);
+    });
+  };
+  update_positions();
+
+  system_moveables_.clear();
+  system_weapons_.clear();
+  for (size_t i = 0; i < all_entities_.size(); i++) {
+    Entity *ent = all_entities_[i].get();
+    MoveableComponent *moveable = ent->get_component<MoveableComponent>();
+    if (moveable != nullptr) {
+      system_moveables_.push_back(moveable);
+    }
+    WeaponComponent *weapon = ent->get_component<WeaponComponent>();
+    if (weapon != nullptr) {
+      system_weapons_.push_back(weapon);
+    }
+  }
+
+  in_parallel_phase_ = true;
+  thread_pool_->parallel_for(system_moveables_.size(), SYSTEM_GRAIN_SIZE, [this, dt](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      system_moveables_[i]->plan_update(dt);
+    }
+  });
+  thread_pool_->parallel_for(system_weapons_.size(), SYSTEM_GRAIN_SIZE, [this, dt](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      system_weapons_[i]->plan_update(dt);
+    }
+  });
+  in_parallel_phase_ = false;
+
+  for (MoveableComponent *moveable : system_moveables_) {
+    moveable->commit_update();
+  }
+  for (WeaponComponent *weapon : system_weapons_) {
+    weapon->commit_update();
+  }
+  update_positions();
+
+  // This includes the projectiles that were fired in phase 3.
+  system_projectiles_.clear();
+  for (size_t i = 0; i < all_entities_.size(); i++) {
+    ProjectileComponent *projectile = all_entities_[i]->get_component<ProjectileComponent>();
+    if (projectile != nullptr && projectile->has_system()) {
+      system_projectiles_.push_back(projectile);
+    }
+  }
+
+  in_parallel_phase_ = true;
+  thread_pool_->parallel_for(system_projectiles_.size(), SYSTEM_GRAIN_SIZE, [this, dt](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      system_projectiles_[i]->plan_update(dt);
+    }
+  });
+  in_parallel_phase_ = false;
+
+  for (ProjectileComponent *projectile : system_projectiles_) {
+    projectile->commit_update();
+  }
+}
+
+// The dump is the state hash followed by every entity with a non-zero identifier, in identifier order, so that two
+// dumps can be compared byte-by-byte. Each entity is its identifier, template name, position, direction, health and
+// orders (zeros where the entity doesn't have them).
+std::string EntityManager::write_state_dump() {
+  std::vector<std::shared_ptr<Entity>> entities;
+  for (std::shared_ptr<Entity> &ent : all_entities_) {
+    if (ent->get_id() != 0) {
+      entities.push_back(ent);
+    }
+  }
+  std::sort(entities.begin(), entities.end(),
+      [](std::shared_ptr<Entity> const &lhs, std::shared_ptr<Entity> const &rhs) {
+        return lhs->get_id() < rhs->get_id();
+      });
+
+  std::ostringstream outs(std::ios::binary);
+  write_value(outs, STATE_DUMP_MAGIC);
+  write_value(outs, STATE_DUMP_VERSION);
+  write_value(outs, state_hash_.get());
+  write_value(outs, static_cast<uint32_t>(entities.size()));
+
+  for (std::shared_ptr<Entity> &ent : entities) {
+    write_value(outs, ent->get_id());
+    write_value(outs, static_cast<uint16_t>(ent->get_name().size()));
+    outs.write(ent->get_name().data(), ent->get_name().size());
+
+    fw::Vector pos(0, 0, 0);
+    fw::Vector dir(0, 0, 0);
+    PositionComponent *position = ent->get_component<PositionComponent>();
+    if (position != nullptr) {
+      pos = position->get_position(false);
+      dir = position->get_direction();
+    }
+    outs.write(reinterpret_cast<char const *>(pos.v), sizeof(float) * 3);
+    outs.write(reinterpret_cast<char const *>(dir.v), sizeof(float) * 3);
+
+    float health = 0.0f;
+    EntityAttribute *health_attr = ent->get_attribute("health");
+    if (health_attr != nullptr) {
+      health = health_attr->get_value<float>();
+    }
+    write_value(outs, health);
+
+    uint32_t order_count = 0;
+    uint16_t current_order = 0;
+    OrderableComponent *orderable = ent->get_component<OrderableComponent>();
+    if (orderable != nullptr) {
+      order_count = static_cast<uint32_t>(orderable->get_order_count());
+      if (orderable->get_current_order()) {
+        current_order = orderable->get_current_order()->get_identifier();
+      }
+    }
+    write_value(outs, order_count);
+    write_value(outs, current_order);
+  }
+  return outs.str();
+}
+
+void EntityManager::request_snapshot(
+    std::shared_ptr<game::Snapshot> snapshot, std::function<void(std::shared_ptr<game::Snapshot>)> fn) {
+  std::unique_lock<std::mutex> lock(snapshot_mutex_);
+  snapshot_requests_.push_back(SnapshotRequest { snapshot, fn });
+}
+
+void EntityManager::request_load_snapshot(std::shared_ptr<game::Snapshot const> snapshot) {
+  std::unique_lock<std::mutex> lock(snapshot_mutex_);
+  snapshot_to_load_ = snapshot;
+}
+
+void EntityManager::write_snapshot(game::Snapshot &snapshot) {
+  std::vector<Entity *> entities;
+  SnapshotEntityIndices indices;
+  indices.reserve(all_entities_.size());
+  for (std::shared_ptr<Entity> &ent : all_entities_) {
+    indices[ent.get()] = static_cast<uint32_t>(entities.size());
+    entities.push_back(ent.get());
+  }
+
+  // Template and attribute names are written once, and referred to by their index.
+  std::vector<std::string const *> strings;
+  std::unordered_map<std::string, uint32_t> string_indices;
+  auto get_string_index = [&strings, &string_indices](std::string const &str) {
+    auto [it, inserted] = string_indices.emplace(str, static_cast<uint32_t>(strings.size()));
+    if (inserted) {
+      strings.push_back(&it->first);
+    }
+    return it->second;
+  };
+
+  // The attributes that come from the template as strings, tables and so on don't change, the ones we need are the
+  // numbers (e.g. health).
+  fw::net::PacketBuffer entity_records(game::kSnapshotSectionEntities, fw::net::kWireVersionCompact);
+  for (Entity *ent : entities) {
+    uint32_t name_index = get_string_index(ent->get_name());
+    std::shared_ptr<Entity> creator = ent->creator_.lock();
+    auto creator_it = creator ? indices.find(creator.get()) : indices.end();
+    uint32_t creator_record = creator_it == indices.end() ? 0 : creator_it->second + 1;
+    uint32_t num_attributes = 0;
+    for (auto const &[attr_name, attr] : ent->attributes_) {
+      if (std::any_cast<float>(&attr.get_value()) != nullptr) {
+        num_attributes++;
+      }
+    }
+
+    entity_records << fw::net::compact(ent->id_);
+    entity_records << fw::net::compact(name_index);
+    entity_records << fw::net::compact(creator_record);
+    entity_records << fw::net::compact(num_attributes);
+    for (auto const &[attr_name, attr] : ent->attributes_) {
+      float const *value = std::any_cast<float>(&attr.get_value());
+      if (value != nullptr) {
+        uint32_t attr_name_index = get_string_index(attr_name);
+        entity_records << fw::net::compact(attr_name_index);
+        game::write_raw(entity_records, *value);
+      }
+    }
+  }
+
+  fw::net::PacketBuffer section(game::kSnapshotSectionEntities, fw::net::kWireVersionCompact);
+  uint32_t num_strings = static_cast<uint32_t>(strings.size());
+  section << fw::net::compact(num_strings);
+  for (std::string const *str : strings) {
+    section << *str;
+  }
+  uint32_t num_entities = static_cast<uint32_t>(entities.size());
+  section << fw::net::compact(num_entities);
+  // Skip the packet type at the start of entity_records, the section already has one.
+  const std::size_t header_size = sizeof(uint16_t);
+  section.add_bytes(entity_records.get_buffer() + header_size, entity_records.get_size() - header_size);
+  snapshot.add_section(section);
+
+  write_store_section<PositionComponent>(snapshot, SnapshotComponentKind::kPosition, indices);
+  write_entity_section<OwnableComponent>(snapshot, SnapshotComponentKind::kOwnable, indices, entities);
+  write_entity_section<OrderableComponent>(snapshot, SnapshotComponentKind::kOrderable, indices, entities);
+  write_store_section<MoveableComponent>(snapshot, SnapshotComponentKind::kMoveable, indices);
+  write_entity_section<PathingComponent>(snapshot, SnapshotComponentKind::kPathing, indices, entities);
+  write_store_section<WeaponComponent>(snapshot, SnapshotComponentKind::kWeapon, indices);
+  write_store_section<SeekingProjectileComponent>(snapshot, SnapshotComponentKind::kSeekingProjectile, indices);
+  write_store_section<BallisticProjectileComponent>(snapshot, SnapshotComponentKind::kBallisticProjectile, indices);
+}
+
+fw::Status EntityManager::read_snapshot(game::Snapshot const &snapshot) {
+  RETURN_IF_ERROR(snapshot.validate());
+
+  // Everything we've got now is replaced by what's in the snapshot.
+  clear_selection();
+  for (std::shared_ptr<Entity> &ent : all_entities_) {
+    destroyed_entities_.push_back(ent);
+  }
+  cleanup_destroyed();
+
+  std::vector<std::shared_ptr<Entity>> entities;
+  RETURN_IF_ERROR(snapshot.for_each_section(game::kSnapshotSectionEntities,
+      [this, &entities](fw::net::PacketBuffer &section) {
+        uint32_t num_strings;
+        section >> fw::net::compact(num_strings);
+        std::vector<std::string> strings;
+        for (uint32_t i = 0; i < num_strings && section.get_status().ok(); i++) {
+          strings.emplace_back();
+          section >> strings.back();
+        }
+
+        uint32_t num_entities;
+        section >> fw::net::compact(num_entities);
+        RETURN_IF_ERROR(section.get_status());
+        entities.reserve(num_entities);
+        all_entities_.reserve(num_entities);
+        entities_by_id_.reserve(num_entities);
+
+        // Snapshots usually have lots of entities with the same template, so we look each one's prototype up once.
+        std::vector<Entity const *> prototypes(strings.size(), nullptr);
+
+        std::vector<uint32_t> creator_records;
+        creator_records.reserve(num_entities);
+        for (uint32_t i = 0; i < num_entities; i++) {
+          entity_id id;
+          uint32_t name_index;
+          uint32_t creator_record;
+          uint32_t num_attributes;
+          section >> fw::net::compact(id);
+          section >> fw::net::compact(name_index);
+          section >> fw::net::compact(creator_record);
+          section >> fw::net::compact(num_attributes);
+          RETURN_IF_ERROR(section.get_status());
+          if (name_index >= strings.size()) {
+            return fw::ErrorStatus("invalid template name in snapshot: ") << name_index;
+          }
+
+          if (prototypes[name_index] == nullptr) {
+            prototypes[name_index] = &get_prototype(strings[name_index]);
+          }
+          std::shared_ptr<Entity> ent = create_entity(*prototypes[name_index], std::shared_ptr<Entity>(), id);
+          for (uint32_t j = 0; j < num_attributes; j++) {
+            uint32_t attr_name_index;
+            float value;
+            section >> fw::net::compact(attr_name_index);
+            game::read_raw(section, value);
+            RETURN_IF_ERROR(section.get_status());
+            if (attr_name_index >= strings.size()) {
+              return fw::ErrorStatus("invalid attribute name in snapshot: ") << attr_name_index;
+            }
+
+            EntityAttribute *attr = ent->get_attribute(strings[attr_name_index]);
+            if (attr != nullptr) {
+              attr->set_value(value);
+            }
+          }
+
+          // Make sure the commands we create from now on don't reuse any of the identifiers we've just restored.
+          if (id != 0) {
+            game::reserve_entity_id(id);
+          }
+          entities.push_back(ent);
+          creator_records.push_back(creator_record);
+        }
+
+        // An entity's creator can come after it, so we only link them up once they've all been created.
+        for (uint32_t i = 0; i < num_entities; i++) {
+          if (creator_records[i] != 0 && creator_records[i] <= entities.size()) {
+            entities[i]->creator_ = entities[creator_records[i] - 1];
+          }
+        }
+        return fw::OkStatus();
+      }));
+
+  return snapshot.for_each_section(game::kSnapshotSectionComponents,
+      [&entities](fw::net::PacketBuffer &section) {
+        uint8_t kind;
+        section >> kind;
+        switch (static_cast<SnapshotComponentKind>(kind)) {
+        case SnapshotComponentKind::kPosition:
+          read_component_section<PositionComponent>(section, entities);
+          break;
+        case SnapshotComponentKind::kOwnable:
+          read_component_section<OwnableComponent>(section, entities);
+          break;
+        case SnapshotComponentKind::kOrderable:
+          read_component_section<OrderableComponent>(section, entities);
+          break;
+        case SnapshotComponentKind::kMoveable:
+          read_component_section<MoveableComponent>(section, entities);
+          break;
+        case SnapshotComponentKind::kPathing:
+          read_component_section<PathingComponent>(section, entities);
+          break;
+        case SnapshotComponentKind::kWeapon:
+          read_component_section<WeaponComponent>(section, entities);
+          break;
+        case SnapshotComponentKind::kSeekingProjectile:
+          read_component_section<SeekingProjectileComponent>(section, entities);
+          break;
+        case SnapshotComponentKind::kBallisticProjectile:
+          read_component_section<BallisticProjectileComponent>(section, entities);
+          break;
+        default:
+          LOG(WARN) << "skipping unknown component section in snapshot: " << static_cast<int>(kind);
+          break;
+        }
+        return section.get_status();
+      });
+}
+
+void EntityManager::process_snapshots() {
+  std::shared_ptr<game::Snapshot const> snapshot_to_load;
+  std::vector<SnapshotRequest> snapshot_requests;
+  {
+    std::unique_lock<std::mutex> lock(snapshot_mutex_);
+    std::swap(snapshot_to_load, snapshot_to_load_);
+    std::swap(snapshot_requests, snapshot_requests_);
+  }
+
+  if (snapshot_to_load) {
+    fw::Timer tmr;
+    tmr.start();
+    fw::Status status = read_snapshot(*snapshot_to_load);
+    tmr.stop();
+    if (status.ok()) {
+      LOG(INFO) << "restored " << all_entities_.size() << " entities from snapshot in "
+                << (tmr.get_total_time() * 1000.0f) << "ms";
+    } else {
+      LOG(ERR) << "error restoring snapshot: " << status;
+    }
+  }
+
+  for (SnapshotRequest &request : snapshot_requests) {
+    write_snapshot(*request.snapshot);
+    request.snapshot->finish();
+    request.fn(request.snapshot);
+  }
+}
+
 void EntityManager::update() {
+  // The simulation only moves on by the frames the turns we've been handed ask for, and always by the same time step,
+  // so that every peer runs exactly the same frames between turns (see game::TurnHandoff).
+  if (game::SimulationThread::get_instance()->take_frame()) {
+    update(static_cast<float>(game::kFrameMs) / 1000.0f);
+    return;
+  }
+
+  // We're waiting for the next turn, but there may still be snapshots to take (they come after a turn's frames), and
+  // the camera may have moved.
   cleanup_destroyed();
+  process_snapshots();
+  fw::Camera *camera = fw::Framework::get_instance()->get_camera();
+  if (camera != nullptr) {
+    update_view(camera);
+  }
+}
+
+void EntityManager::update(float dt) {
+  cleanup_destroyed();
+  process_snapshots();
+
+  // update all of the entities. Entities can create other entities while they're updating (which may move
+  // all_entities_ in memory), so we go by index rather than with an iterator. The new entities are appended to the
+  // end, so they get their first update this frame as well.
+  if (use_systems_) {
+    update_systems(dt);
+  }
+  for (size_t i = 0; i < all_entities_.size(); i++) {
+    all_entities_[i]->update(dt);
+  }
+
+  // Without a camera (i.e. when we're playing back a replay without graphics), there's nobody to draw anything for.
+  fw::Camera *camera = fw::Framework::get_instance()->get_camera();
+  if (camera != nullptr) {
+    update_view(camera);
+  }
+}
 
+void EntityManager::update_view(fw::Camera *camera) {
   // work out the current "view center" which is used for things like drawing
   // the entities centred around the camera and so on.
   game::World *wrld = game::World::get_instance();
-  fw::Camera *camera = fw::Framework::get_instance()->get_camera();
   fw::Vector cam_loc = camera->get_position();
   fw::Vector cam_dir = camera->get_direction();
 
@@ -286,12 +926,6 @@ void EntityManager::update() {
       location[1],
       fw::constrain(location[2], this->get_patch_manager()->get_world_length(), 0.0f));
 
-  // update all of the entities
-  float dt = fw::Framework::get_instance()->get_timer()->get_update_time();
-  for(auto &ent : all_entities_) {
-    ent->update(dt);
-  }
-
   int center_patch_x = (int)(location[0] / PatchManager::PATCH_SIZE);
   int center_patch_z = (int)(location[2] / PatchManager::PATCH_SIZE);
   for (int patch_z = center_patch_z - 1; patch_z <= center_patch_z + 1; patch_z++) {
@@ -303,16 +937,13 @@ void EntityManager::update() {
         0,
         (float)(patch_z * PatchManager::PATCH_SIZE) - p->get_origin()[2]);
 
-      std::list<std::weak_ptr<Entity> > patch_entities = p->get_entities();
-      for (auto it = patch_entities.begin(); it != patch_entities.end(); ++it) {
-        auto entity = (*it).lock();
+      for (auto const &patch_entity : p->get_entities()) {
+        auto entity = patch_entity.lock();
         if (!entity)
           continue;
 
-        auto attr = entity->get_attribute("patch_offset_");
-        if (attr != nullptr) {
-          attr->set_value(patch_offset);
-        }
+        // Everything in a patch has a position, that's how it got into the patch.
+        entity->get_component<PositionComponent>()->set_patch_offset(patch_offset);
       }
     }
   }
@@ -1,38 +1,111 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include <framework/flat_id_map.h>
 #include <framework/scenegraph.h>
 #include <framework/math.h>
+#include <framework/slot_map.h>
+#include <framework/state_hash.h>
+#include <framework/status.h>
 
 #include <game/entities/entity.h>
 
 namespace fw {
+class Camera;
 class Graphics;
+class ThreadPool;
+}
+
+namespace game {
+class Snapshot;
 }
 
 namespace ent {
 class Entity;
 class EntityDebug;
+class MoveableComponent;
 class PatchManager;
+class ProjectileComponent;
+class SpatialIndex;
+class WeaponComponent;
 
 // Manages all the entities in the game, and contains various "indexes" of entities so that we
 // can access them efficiently.
 class EntityManager {
 private:
-  std::list<std::shared_ptr<Entity>> all_entities_;
-  std::list<std::shared_ptr<Entity>> destroyed_entities_;
+  // A hash of the state of every entity that's shared between peers (i.e. that has a non-zero identifier). The
+  // components fold their state in as it changes, so this must be destroyed after all the entities are. Only the
+  // update thread touches state_hash_.
+  fw::StateHash state_hash_;
+
+  // The simulation thread asks us to add our entities to a snapshot it's taking (after which we call fn
+  // with it), or to replace our entities with the ones in a snapshot. These are also done at the start of the next
+  // update, locked by snapshot_mutex_.
+  struct SnapshotRequest {
+    std::shared_ptr<game::Snapshot> snapshot;
+    std::function<void(std::shared_ptr<game::Snapshot>)> fn;
+  };
+  std::mutex snapshot_mutex_;
+  std::vector<SnapshotRequest> snapshot_requests_;
+  std::shared_ptr<game::Snapshot const> snapshot_to_load_;
+
+  // All of the entities, stored contiguously so that update() can sweep through them quickly. entities_by_id_ maps
+  // an entity's identifier to its key in all_entities_. Entities with an identifier of 0 (e.g. explosions, which are
+  // created locally on each peer) are not in entities_by_id_.
+  fw::SlotMap<std::shared_ptr<Entity>> all_entities_;
+  fw::FlatIdMap<entity_id, fw::SlotMapKey> entities_by_id_;
+  std::vector<std::shared_ptr<Entity>> destroyed_entities_;
   std::list<std::weak_ptr<Entity>> selected_entities_;
 
   std::map<int, std::list<std::weak_ptr<Entity>>> entities_by_component_;
 
+  // The first time we create an entity with a given template, we build a prototype of it with the EntityFactory
+  // (which reads the template from Lua). Every entity with that template is then created by cloning the prototype's
+  // attributes and components. The prototypes aren't part of the world: they're never initialized, and their
+  // components aren't attached to an entity.
+  std::map<std::string, std::unique_ptr<Entity>> prototypes_;
+
   EntityDebug *debug_;
   PatchManager *patch_mgr_;
+  SpatialIndex *spatial_index_;
+  bool use_systems_;
   fw::Vector view_center_;
 
+  // The systems run their "plan" phases on this pool. While a plan phase is running, in_parallel_phase_ is true and
+  // entities must not be created or destroyed (that happens in the commit phase that follows, on the update thread).
+  fw::ThreadPool *thread_pool_;
+  bool in_parallel_phase_;
+
+  // Scratch lists of the components that update_systems plans in parallel, kept around so we don't reallocate them
+  // every frame.
+  std::vector<MoveableComponent *> system_moveables_;
+  std::vector<WeaponComponent *> system_weapons_;
+  std::vector<ProjectileComponent *> system_projectiles_;
+
   // removes the destroyed entities from the various lists
   void cleanup_destroyed();
 
+  // runs the batch "systems" which update all the components of one type at a time
+  void update_systems(float dt);
+
+  // Updates the view center and the entities' patch offsets (which are only for drawing) from the camera.
+  void update_view(fw::Camera *camera);
+
+  // Does whatever snapshot_requests_ and snapshot_to_load_ ask for.
+  void process_snapshots();
+
+  // Gets the prototype of the given template from prototypes_, building it if this is the first time we've seen it.
+  Entity const &get_prototype(std::string const &template_name);
+
+  // Creates a new entity by cloning the given prototype.
+  std::shared_ptr<Entity> create_entity(Entity const &prototype, std::shared_ptr<Entity> created_by, entity_id id);
+
 public:
   EntityManager();
   ~EntityManager();
@@ -45,6 +118,16 @@ public:
   std::shared_ptr<Entity> create_entity(std::string const &template_name, entity_id id);
   std::shared_ptr<Entity> create_entity(std::shared_ptr<Entity> created_by, std::string const &template_name, entity_id id);
 
+  // Sets the prototype that entities with the given template are cloned from, rather than building it from the
+  // template's Lua file. This is for tools and benchmarks that run without the Lua templates. We take ownership of the
+  // components.
+  void set_prototype(std::string const &template_name, std::vector<EntityComponent *> const &components,
+      std::vector<EntityAttribute> const &attributes);
+
+  // Turns the systems on and runs their plan phases with the given number of extra threads, whatever the settings say.
+  // This is for benchmarks that compare different numbers of threads in the one process.
+  void set_update_threads(int num_threads);
+
   // destroy the given Entity (we actually remove it on the next update cycle)
   void destroy(std::weak_ptr<Entity> Entity);
 
@@ -91,12 +174,56 @@ public:
     return debug_;
   }
 
+  // Updates all the entities. The first one runs a frame if the SimulationThread's turns say there's one to run (and
+  // otherwise just looks after snapshots and the view), the second is for when we're stepping the simulation ourselves
+  // (i.e. playing back a replay).
   void update();
+  void update(float dt);
 
   // gets the patch_manager which manages the patches of entities.
   PatchManager *get_patch_manager() const {
     return patch_mgr_;
   }
+
+  // returns true if we update the components which have a "system" in batches, rather than entity by entity. This is
+  // controlled by the "entity-systems" setting.
+  bool is_using_systems() const {
+    return use_systems_;
+  }
+
+  // gets the SpatialIndex which we use to find the entities near a given point.
+  SpatialIndex *get_spatial_index() const {
+    return spatial_index_;
+  }
+
+  // Gets the hash of the state of every entity that's shared with our peers: their positions, health and orders.
+  // Peers in lockstep compare these every few turns to detect a desync. Components update this as their state changes,
+  // so it must only be used on the update thread.
+  fw::StateHash &get_state_hash() {
+    return state_hash_;
+  }
+
+  // Gets the state of every shared entity, for diffing against the same dump from another peer when they've desynced.
+  // Like get_state_hash(), this must only be called on the update thread.
+  std::string write_state_dump();
+
+  // Asks us to add our entities to the given snapshot at the start of the next update, finish it, and then call fn
+  // with it (on the update thread).
+  void request_snapshot(
+      std::shared_ptr<game::Snapshot> snapshot, std::function<void(std::shared_ptr<game::Snapshot>)> fn);
+
+  // Asks us to replace all of our entities with the ones in the given snapshot at the start of the next update.
+  void request_load_snapshot(std::shared_ptr<game::Snapshot const> snapshot);
+
+  // Adds a section with every entity (its template, identifier, creator and the attributes that can change) to the
+  // snapshot, followed by a section for each type of component that has state the template doesn't give it. The
+  // components are written straight out of their ComponentStore where they've got one, and each type writes its own
+  // state with a non-virtual write_snapshot(), so reading them back is a tight loop per type with no virtual calls.
+  void write_snapshot(game::Snapshot &snapshot);
+
+  // Destroys all of our entities and creates the ones in the given snapshot. They're cloned from their templates'
+  // prototypes (see prototypes_), so apart from the first time we see a template, this doesn't touch Lua.
+  fw::Status read_snapshot(game::Snapshot const &snapshot);
 };
 
 }
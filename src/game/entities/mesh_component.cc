@@ -46,6 +46,12 @@ void MeshComponent::apply_template(fw::lua::Value tmpl) {
   model_name_ = tmpl["FileName"];
 }
 
+EntityComponent *MeshComponent::clone() const {
+  MeshComponent *comp = new MeshComponent();
+  comp->model_name_ = model_name_;
+  return comp;
+}
+
 void MeshComponent::initialize() {
   std::shared_ptr<Entity> entity(entity_);
   fw::Color color = fw::Color::WHITE();
@@ -57,7 +63,13 @@ void MeshComponent::initialize() {
     }
   }
 
-  auto model = fw::Framework::get_instance()->get_model_manager()->get_model(model_name_);
+  // Without graphics (e.g. playing back a replay), there's no models and nothing to draw them.
+  fw::ModelManager *model_manager = fw::Framework::get_instance()->get_model_manager();
+  if (model_manager == nullptr) {
+    return;
+  }
+
+  auto model = model_manager->get_model(model_name_);
   if (!model.ok()) {
     LOG(ERR) << "error loading model: " << model.status();
   } else {
@@ -72,16 +84,12 @@ void MeshComponent::initialize() {
 
 void MeshComponent::update(float dt) {
   std::shared_ptr<Entity> entity(entity_);
-  if (!entity) return;
+  if (!entity || !sg_node_) return;
 
   auto pos = entity->get_component<PositionComponent>();
   if (pos != nullptr) {
     fw::Matrix transform = pos->get_transform();
-
-    auto offset = entity->get_attribute("patch_offset_");
-    if (offset != nullptr) {
-      transform *= fw::translation(offset->get_value<fw::Vector>());
-    }
+    transform *= fw::translation(pos->get_patch_offset());
 
     fw::Framework::get_instance()->get_scenegraph_manager()->enqueue(
       [transform, sg_node=sg_node_](fw::sg::Scenegraph& sg) {
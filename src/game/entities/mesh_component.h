@@ -12,7 +12,7 @@ class OwnableComponent;
 
 // the mesh component is a member of all entities that have mesh data, basically
 // all the visible entities
-class MeshComponent: public EntityComponent {
+class MeshComponent final: public EntityComponent {
 private:
   std::string model_name_;
   std::shared_ptr<fw::Model> model_;
@@ -28,6 +28,7 @@ public:
   virtual ~MeshComponent();
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
 
   void initialize() override;
   void update(float dt) override;
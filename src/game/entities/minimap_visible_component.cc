@@ -11,4 +11,8 @@ MinimapVisibleComponent::MinimapVisibleComponent() {
 MinimapVisibleComponent::~MinimapVisibleComponent() {
 }
 
+EntityComponent *MinimapVisibleComponent::clone() const {
+  return new MinimapVisibleComponent();
+}
+
 }
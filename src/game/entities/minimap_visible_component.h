@@ -10,7 +10,7 @@ namespace ent {
 
 // This component is used to make an Entity visible on the minimap. The Entity must also have a position_component and
 // optionally an ownable_component (to get a color - if no ownable color, it gets drawn white.)
-class MinimapVisibleComponent: public EntityComponent {
+class MinimapVisibleComponent final: public EntityComponent {
 public:
   static const int identifier = 150;
   virtual int get_identifier() {
@@ -23,6 +23,8 @@ public:
 
   MinimapVisibleComponent();
   ~MinimapVisibleComponent();
+
+  virtual EntityComponent *clone() const;
 };
 
 }
@@ -11,15 +11,21 @@
 #include <game/entities/pathing_component.h>
 #include <game/entities/position_component.h>
 #include <game/entities/selectable_component.h>
+#include <game/entities/spatial_index.h>
+#include <game/simulation/snapshot.h>
 
 namespace ent {
 
 // register the moveable component with the entity_factory
 ENT_COMPONENT_REGISTER("Moveable", MoveableComponent);
 
+// We only look for obstacles to avoid within this radius. It needs to be at least twice the selection radius of the
+// biggest thing we might want to avoid.
+static const float AVOID_COLLISIONS_RADIUS = 10.0f;
+
 MoveableComponent::MoveableComponent() :
     position_component_(nullptr), pathing_component_(nullptr), speed_(3.0f), turn_speed_(1.0f),
-    avoid_collisions_(true), is_moving_(false) {
+    avoid_collisions_(true), is_moving_(false), has_planned_move_(false) {
 }
 
 MoveableComponent::~MoveableComponent() {
@@ -37,6 +43,14 @@ void MoveableComponent::apply_template(fw::lua::Value tmpl) {
   }
 }
 
+EntityComponent *MoveableComponent::clone() const {
+  MoveableComponent *comp = new MoveableComponent();
+  comp->speed_ = speed_;
+  comp->turn_speed_ = turn_speed_;
+  comp->avoid_collisions_ = avoid_collisions_;
+  return comp;
+}
+
 void MoveableComponent::initialize() {
   std::shared_ptr<Entity> entity(entity_);
   pathing_component_ = entity->get_component<PathingComponent>();
@@ -46,7 +60,7 @@ void MoveableComponent::initialize() {
 }
 
 // TODO: skip_pathing is such a hack
-void MoveableComponent::set_goal(fw::Vector goal, bool skip_pathing /*= false*/) {
+void MoveableComponent::set_goal(fw::Vector goal, bool skip_pathing /*= false*/, bool use_flow_field /*= false*/) {
   std::shared_ptr<Entity> entity(entity_);
   float world_width = entity->get_manager()->get_patch_manager()->get_world_width();
   float world_length = entity->get_manager()->get_patch_manager()->get_world_length();
@@ -63,7 +77,7 @@ void MoveableComponent::set_goal(fw::Vector goal, bool skip_pathing /*= false*/)
     intermediate_goal_ = position_component_->get_position();
     is_moving_ = false;
 
-    pathing_component_->set_goal(goal_);
+    pathing_component_->set_goal(goal_, use_flow_field);
   }
 }
 
@@ -87,12 +101,42 @@ void MoveableComponent::stop() {
   }
 }
 
+void MoveableComponent::write_snapshot(fw::net::PacketBuffer &buffer) const {
+  game::write_raw(buffer, goal_);
+  game::write_raw(buffer, intermediate_goal_);
+  game::write_raw(buffer, speed_);
+  game::write_raw(buffer, turn_speed_);
+  buffer << static_cast<uint8_t>((avoid_collisions_ ? 1 : 0) | (is_moving_ ? 2 : 0));
+}
+
+void MoveableComponent::read_snapshot(fw::net::PacketBuffer &buffer) {
+  game::read_raw(buffer, goal_);
+  game::read_raw(buffer, intermediate_goal_);
+  game::read_raw(buffer, speed_);
+  game::read_raw(buffer, turn_speed_);
+  uint8_t flags;
+  buffer >> flags;
+  avoid_collisions_ = (flags & 1) != 0;
+  is_moving_ = (flags & 2) != 0;
+  has_planned_move_ = false;
+}
+
 void MoveableComponent::update(float dt) {
+  plan_update(dt);
+  commit_update();
+}
+
+void MoveableComponent::plan_update(float dt) {
+  has_planned_move_ = false;
+  planned_debug_lines_.clear();
+  planned_debug_circles_.clear();
   if (!is_moving_) {
     return;
   }
 
-  fw::Vector pos = position_component_->get_position();
+  // Our position has already been brought up-to-date (by our own PositionComponent, or by the EntityManager), and we
+  // mustn't modify the PositionComponent while planning, hence get_position(false).
+  fw::Vector pos = position_component_->get_position(false);
   pos[1] = 0.0f; // ignore terrain height.
   fw::Vector goal = intermediate_goal_;
   fw::Vector dir = position_component_->get_direction_to(goal, /*ignore_height=*/true);
@@ -108,10 +152,14 @@ void MoveableComponent::update(float dt) {
 
   // if we're avoiding obstacles, we'll need to figure out what is the closest Entity to us
   if (avoid_collisions_) {
-    std::shared_ptr<ent::Entity> obstacle = position_component_->get_nearest_entity().lock();
-    if (obstacle) {
-      fw::Vector obstacle_dir = position_component_->get_direction_to(obstacle);
-      float obstacle_distance = obstacle_dir.length();
+    Entity const *us = entity.get();
+    std::array<SpatialIndex::Neighbour, 1> nearest;
+    int num_nearest = entity->get_manager()->get_spatial_index()->find_nearest(pos, AVOID_COLLISIONS_RADIUS,
+        [us](SpatialIndex::Neighbour const &neighbour) { return neighbour.entity != us; }, nearest);
+    if (num_nearest > 0) {
+      Entity *obstacle = nearest[0].entity;
+      fw::Vector obstacle_dir = nearest[0].offset;
+      float obstacle_distance = nearest[0].distance;
 
       // only worry about the obstacle when it's in front of us
       float d = fw::dot(position_component_->get_direction().normalized(), obstacle_dir.normalized());
@@ -131,7 +179,7 @@ void MoveableComponent::update(float dt) {
           fw::Vector obstacle_pos = pos + obstacle_dir;
           if (show_steering) {
             // draw a circle around whatever we're trying to avoid
-            entity->get_debug_view().add_circle(obstacle_pos, obstacle_radius * 2.0f, fw::Color(1, 0, 0));
+            planned_debug_circles_.push_back(DebugCircle { obstacle_pos, obstacle_radius * 2.0f, fw::Color(1, 0, 0) });
           }
 
           // temporarily adjust the "goal" so as to avoid the obstacle
@@ -144,8 +192,8 @@ void MoveableComponent::update(float dt) {
 
           if (show_steering) {
             // draw a blue line from the obstacle in the direction we're going to travel to avoid it.
-            entity->get_debug_view().add_line(
-                obstacle_pos, obstacle_pos + (avoid_dir * (obstacle_radius * 2.0f)), fw::Color(0, 0, 1));
+            planned_debug_lines_.push_back(DebugLine {
+                obstacle_pos, obstacle_pos + (avoid_dir * (obstacle_radius * 2.0f)), fw::Color(0, 0, 1), false });
           }
 
           // our new goal is just in front of where we are now, but offset by what we're trying to avoid.
@@ -167,7 +215,7 @@ void MoveableComponent::update(float dt) {
 
   if (show_steering) {
     // a line from us to the goal
-    entity->get_debug_view().add_line(pos, goal, fw::Color(0, 1, 0), /*offset_terrain_height=*/true);
+    planned_debug_lines_.push_back(DebugLine { pos, goal, fw::Color(0, 1, 0), /*offset_terrain_height=*/true });
   }
 
   if (scale_factor < 1.0f) {
@@ -176,20 +224,45 @@ void MoveableComponent::update(float dt) {
   }
 
   // turn towards the goal
-  dir = steer(position_component_->get_position(),
+  dir = steer(position_component_->get_position(false),
       position_component_->get_direction(), dir, turn_speed * dt, show_steering);
 
   // move in the direction we're facing
   pos += (dir * dt * speed);
 
-  position_component_->set_direction(dir);
-  position_component_->set_position(pos);
+  planned_direction_ = dir;
+  planned_position_ = pos;
+  has_planned_move_ = true;
+}
+
+void MoveableComponent::commit_update() {
+  if (!planned_debug_lines_.empty() || !planned_debug_circles_.empty()) {
+    std::shared_ptr<Entity> entity = entity_.lock();
+    if (entity && entity->has_debug_view()) {
+      for (DebugCircle const &circle : planned_debug_circles_) {
+        entity->get_debug_view().add_circle(circle.center, circle.radius, circle.color);
+      }
+      for (DebugLine const &line : planned_debug_lines_) {
+        entity->get_debug_view().add_line(line.from, line.to, line.color, line.offset_terrain_height);
+      }
+    }
+    planned_debug_lines_.clear();
+    planned_debug_circles_.clear();
+  }
+
+  if (!has_planned_move_) {
+    return;
+  }
+
+  position_component_->set_direction(planned_direction_);
+  position_component_->set_position(planned_position_);
+  has_planned_move_ = false;
 }
 
 // applies a steering factor to the "curr_direction" so that we slowly turn towards the goal_direction.
 //
-// if show_steering is true, we use the Entity's debug_view (which we assume is non-NULL
-//   to display the relevent steering vectors.
+// if show_steering is true, we add the relevent steering vectors to the lines commit_update will draw on the Entity's
+//   debug_view.
 fw::Vector MoveableComponent::steer(fw::Vector pos, fw::Vector curr_direction, fw::Vector goal_direction,
     float turn_amount, bool show_steering) {
   curr_direction.normalize();
@@ -210,15 +283,12 @@ fw::Vector MoveableComponent::steer(fw::Vector pos, fw::Vector curr_direction, f
   steer = fw::dot(steer, goal_direction) < 0.0f ? steer * -1.0f : steer;
 
   if (show_steering) {
-    auto entity = entity_.lock();
-    if (entity) {
-      // draw the current "up" and "forward" vectors
-      entity->get_debug_view().add_line(pos, pos + up, fw::Color(1, 1, 1));
-      entity->get_debug_view().add_line(pos, pos + curr_direction, fw::Color(1, 1, 1));
-
-      // draw the "steering" vector which is the direction we're going to steer in
-      entity->get_debug_view().add_line(pos, pos + steer, fw::Color(0, 1, 1));
-    }
+    // draw the current "up" and "forward" vectors
+    planned_debug_lines_.push_back(DebugLine { pos, pos + up, fw::Color(1, 1, 1), false });
+    planned_debug_lines_.push_back(DebugLine { pos, pos + curr_direction, fw::Color(1, 1, 1), false });
+
+    // draw the "steering" vector which is the direction we're going to steer in
+    planned_debug_lines_.push_back(DebugLine { pos, pos + steer, fw::Color(0, 1, 1), false });
   }
 
   // adjust the amount of steering by the turn_amount. The higher the turn amount, the more we try to steer (we assume
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <vector>
+
+#include <framework/color.h>
 #include <framework/math.h>
 
+#include <game/entities/component_store.h>
 #include <game/entities/entity.h>
 
 namespace ent {
@@ -9,7 +13,7 @@ class PathingComponent;
 class PositionComponent;
 
 // this component is added to entities which can move (e.g. units, etc)
-class MoveableComponent: public EntityComponent {
+class MoveableComponent final: public EntityComponent {
 private:
   PositionComponent *position_component_;
   PathingComponent *pathing_component_;
@@ -20,10 +24,33 @@ private:
   bool avoid_collisions_;
   bool is_moving_;
 
+  // The result of plan_update, which commit_update applies.
+  bool has_planned_move_;
+  fw::Vector planned_position_;
+  fw::Vector planned_direction_;
+
+  // If our entity is showing its steering, the lines and circles plan_update wants drawn. The debug view isn't ours
+  // to change while we're planning, so commit_update draws them.
+  struct DebugLine {
+    fw::Vector from;
+    fw::Vector to;
+    fw::Color color;
+    bool offset_terrain_height;
+  };
+  struct DebugCircle {
+    fw::Vector center;
+    float radius;
+    fw::Color color;
+  };
+  std::vector<DebugLine> planned_debug_lines_;
+  std::vector<DebugCircle> planned_debug_circles_;
+
   fw::Vector steer(fw::Vector pos, fw::Vector curr_direction,
       fw::Vector goal_direction, float turn_amount, bool show_steering);
 
 public:
+  ENT_COMPONENT_STORE(MoveableComponent);
+
   static const int identifier = 400;
   virtual int get_identifier() {
     return identifier;
@@ -33,10 +60,22 @@ public:
   ~MoveableComponent();
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
 
   virtual void initialize();
   virtual void update(float dt);
 
+  // update() is split into two halves, so that the EntityManager can plan everybody's move in parallel and then
+  // apply them all in a fixed order. plan_update only reads other entities' state (and only writes our own), so it
+  // is safe to call concurrently for different entities. commit_update applies the planned move, and must be called
+  // on the update thread.
+  void plan_update(float dt);
+  void commit_update();
+
+  bool has_system() const override {
+    return true;
+  }
+
   void set_speed(float speed) {
     speed_ = speed;
   }
@@ -47,7 +86,10 @@ public:
     avoid_collisions_ = value;
   }
 
-  void set_goal(fw::Vector goal, bool skip_pathing = false);
+  // Sets the goal we're moving towards. If use_flow_field is true, our pathing_component will follow the flow field
+  // towards the goal (shared with everybody else moving there) rather than searching for its own path, which is
+  // what we want when a large group is ordered to the same place.
+  void set_goal(fw::Vector goal, bool skip_pathing = false, bool use_flow_field = false);
   fw::Vector get_goal() const {
     return goal_;
   }
@@ -63,6 +105,10 @@ public:
 
   // Stop moving.
   void stop();
+
+  // Saves and restores our state in a snapshot, see EntityManager::write_snapshot().
+  void write_snapshot(fw::net::PacketBuffer &buffer) const;
+  void read_snapshot(fw::net::PacketBuffer &buffer);
 };
 
 }
@@ -1,4 +1,7 @@
+#include <framework/packet_buffer.h>
+
 #include <game/entities/entity_factory.h>
+#include <game/entities/entity_manager.h>
 #include <game/entities/orderable_component.h>
 #include <game/simulation/commands.h>
 #include <game/simulation/orders.h>
@@ -16,10 +19,21 @@ OrderableComponent::OrderableComponent() :
 OrderableComponent::~OrderableComponent() {
 }
 
+EntityComponent *OrderableComponent::clone() const {
+  return new OrderableComponent();
+}
+
+void OrderableComponent::initialize() {
+  // We're in the state hash from the start (with no orders), not just once we get one. Otherwise an entity that's
+  // never had an order wouldn't be in it, but the same entity restored from a snapshot would.
+  update_state_hash();
+}
+
 void OrderableComponent::execute_order(std::shared_ptr<game::Order> const &order) {
   curr_order_ = order;
   order_pending_ = false;
   curr_order_->begin(entity_);
+  update_state_hash();
 }
 
 void OrderableComponent::update(float dt) {
@@ -28,6 +42,7 @@ void OrderableComponent::update(float dt) {
     curr_order_->update(dt);
     if (curr_order_->is_complete()) {
       curr_order_.reset();
+      update_state_hash();
     }
   }
 
@@ -36,7 +51,7 @@ void OrderableComponent::update(float dt) {
     // update and execute a command to start it off
     if (orders_.size() > 0) {
       std::shared_ptr<game::Order> next_order = orders_.front();
-      orders_.pop();
+      orders_.pop_front();
 
       std::shared_ptr<game::OrderCommand> cmd(game::create_command<game::OrderCommand>());
       cmd->order = next_order;
@@ -46,6 +61,7 @@ void OrderableComponent::update(float dt) {
       // mark that we've got an order pending, it'll take a few frames
       // for it to actually come back to us
       order_pending_ = true;
+      update_state_hash();
     }
   }
 }
@@ -53,7 +69,92 @@ void OrderableComponent::update(float dt) {
 void OrderableComponent::issue_order(std::shared_ptr<game::Order> const &order) {
   // TODO: we need a way to queue up orders.
   curr_order_.reset();
-  orders_.push(order);
+  orders_.push_back(order);
+  update_state_hash();
+}
+
+void OrderableComponent::update_state_hash() {
+  std::shared_ptr<Entity> entity(entity_);
+  if (entity->get_id() == 0) {
+    return;
+  }
+
+  uint64_t value = fw::StateHash::combine(
+      entity->get_id(), identifier, order_pending_, curr_order_ ? curr_order_->get_identifier() : 0, orders_.size());
+  for (auto const &order : orders_) {
+    value = fw::StateHash::combine(value, order->get_identifier());
+  }
+  state_hash_.set(entity->get_manager()->get_state_hash(), value);
+}
+
+namespace {
+
+void write_order(fw::net::PacketBuffer &buffer, std::shared_ptr<game::Order> const &order) {
+  buffer << order->get_identifier();
+  order->serialize(buffer);
+}
+
+std::shared_ptr<game::Order> read_order(fw::net::PacketBuffer &buffer) {
+  uint16_t id;
+  buffer >> id;
+  if (!buffer.get_status().ok()) {
+    return nullptr;
+  }
+
+  auto order = game::CreateOrder(id);
+  if (!order.ok()) {
+    buffer.set_error(order.status());
+    return nullptr;
+  }
+  auto status = (*order)->deserialize(buffer);
+  if (!status.ok()) {
+    buffer.set_error(status);
+    return nullptr;
+  }
+  return *order;
+}
+
+}
+
+void OrderableComponent::write_snapshot(fw::net::PacketBuffer &buffer) const {
+  buffer << static_cast<uint8_t>((order_pending_ ? 1 : 0) | (curr_order_ ? 2 : 0));
+  if (curr_order_) {
+    write_order(buffer, curr_order_);
+  }
+
+  uint32_t num_orders = static_cast<uint32_t>(orders_.size());
+  buffer << fw::net::compact(num_orders);
+  for (auto const &order : orders_) {
+    write_order(buffer, order);
+  }
+}
+
+void OrderableComponent::read_snapshot(fw::net::PacketBuffer &buffer) {
+  uint8_t flags;
+  buffer >> flags;
+  std::shared_ptr<game::Order> curr_order;
+  if ((flags & 2) != 0) {
+    curr_order = read_order(buffer);
+  }
+
+  uint32_t num_orders;
+  buffer >> fw::net::compact(num_orders);
+  orders_.clear();
+  for (uint32_t i = 0; i < num_orders && buffer.get_status().ok(); i++) {
+    orders_.push_back(read_order(buffer));
+  }
+  if (!buffer.get_status().ok()) {
+    orders_.clear();
+    return;
+  }
+
+  if (curr_order) {
+    execute_order(curr_order);
+  } else {
+    curr_order_.reset();
+  }
+  order_pending_ = (flags & 1) != 0;
+  update_state_hash();
 }
 
 int OrderableComponent::get_order_count() const {
@@ -3,9 +3,11 @@
 //
 #pragma once
 
+#include <deque>
 #include <map>
 #include <memory>
-#include <queue>
+
+#include <framework/state_hash.h>
 
 #include <game/entities/entity.h>
 
@@ -17,11 +19,15 @@ namespace ent {
 
 // The orderable component is attached to each Entity that can execute orders
 // from a local (or AI) player.
-class OrderableComponent: public EntityComponent {
+class OrderableComponent final: public EntityComponent {
 private:
   std::shared_ptr<game::Order> curr_order_;
   bool order_pending_;
-  std::queue<std::shared_ptr<game::Order>> orders_;
+  std::deque<std::shared_ptr<game::Order>> orders_;
+  fw::StateHash::Element state_hash_;
+
+  // Folds our current order and queue into the state hash, this is called whenever they change.
+  void update_state_hash();
 
 public:
   static const int identifier = 550;
@@ -32,6 +38,8 @@ public:
   OrderableComponent();
   ~OrderableComponent();
 
+  virtual EntityComponent *clone() const;
+  virtual void initialize();
   virtual void update(float dt);
 
   // begins actually executing an order. This should only be called by the order_command
@@ -46,6 +54,15 @@ public:
   // gets the total number of currently executing + waiting orders.
   int get_order_count() const;
   std::shared_ptr<game::Order> get_current_order() const;
+
+  void remove_from_state_hash() override {
+    state_hash_.clear();
+  }
+
+  // Saves and restores our orders in a snapshot, see EntityManager::write_snapshot(). The current order is started
+  // again when it's restored.
+  void write_snapshot(fw::net::PacketBuffer &buffer) const;
+  void read_snapshot(fw::net::PacketBuffer &buffer);
 };
 
 }
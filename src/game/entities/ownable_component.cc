@@ -1,3 +1,5 @@
+#include <framework/packet_buffer.h>
+
 #include <game/entities/entity_factory.h>
 #include <game/entities/ownable_component.h>
 
@@ -16,11 +18,31 @@ OwnableComponent::OwnableComponent() :
 OwnableComponent::~OwnableComponent() {
 }
 
+EntityComponent *OwnableComponent::clone() const {
+  return new OwnableComponent();
+}
+
 void OwnableComponent::set_owner(std::shared_ptr<game::Player> const &owner) {
   owner_ = owner;
   owner_changed_event.Emit(this);
 }
 
+void OwnableComponent::write_snapshot(fw::net::PacketBuffer &buffer) const {
+  buffer << static_cast<uint8_t>(owner_ == nullptr ? 0 : owner_->get_player_no());
+}
+
+void OwnableComponent::read_snapshot(fw::net::PacketBuffer &buffer) {
+  uint8_t player_no;
+  buffer >> player_no;
+  std::shared_ptr<game::Player> owner;
+  if (player_no != 0) {
+    owner = game::SimulationThread::get_instance()->get_player(player_no);
+  }
+  if (owner != owner_) {
+    set_owner(owner);
+  }
+}
+
 bool OwnableComponent::is_local_player() const {
   if (owner_ == nullptr)
     return false;
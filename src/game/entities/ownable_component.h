@@ -10,7 +10,7 @@ class Player;
 
 namespace ent {
 
-class OwnableComponent: public EntityComponent {
+class OwnableComponent final: public EntityComponent {
 private:
   std::shared_ptr<game::Player> owner_;
 
@@ -23,6 +23,8 @@ public:
   OwnableComponent();
   ~OwnableComponent();
 
+  virtual EntityComponent *clone() const;
+
   std::shared_ptr<game::Player> get_owner() const {
     return owner_;
   }
@@ -35,6 +37,10 @@ public:
   // that's under our control
   bool is_local_or_ai_player() const;
 
+  // Saves and restores our owner in a snapshot, see EntityManager::write_snapshot().
+  void write_snapshot(fw::net::PacketBuffer &buffer) const;
+  void read_snapshot(fw::net::PacketBuffer &buffer);
+
   // this signal is fired when the owner changes.
   fw::Signal<OwnableComponent *> owner_changed_event;
 };
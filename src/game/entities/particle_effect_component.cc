@@ -45,6 +45,16 @@ void ParticleEffectComponent::apply_template(fw::lua::Value tmpl) {
   }
 }
 
+EntityComponent *ParticleEffectComponent::clone() const {
+  ParticleEffectComponent *comp = new ParticleEffectComponent();
+  for (auto const &kvp : effects_) {
+    EffectInfo effect = kvp.second;
+    effect.effect.reset();
+    comp->effects_[kvp.first] = effect;
+  }
+  return comp;
+}
+
 void ParticleEffectComponent::initialize() {
   our_position_ = std::shared_ptr<Entity>(entity_)->get_component<PositionComponent>();
 }
@@ -88,6 +98,13 @@ void ParticleEffectComponent::update(float) {
     if (effect_info.started && !effect_info.effect) {
       // It should be started, but it's not started yet, then start it.
       fw::ParticleManager* mgr = fw::Framework::get_instance()->get_particle_mgr();
+      if (mgr == nullptr) {
+        // No graphics, so there's no particles either. If we were only here to show the effect, we're done.
+        if (effect_info.destroy_entity_on_complete) {
+          entity_.lock()->get_manager()->destroy(entity_);
+        }
+        return;
+      }
 
       // TODO: return the error?
       auto effect = mgr->CreateEffect(effect_info.name, our_position + effect_info.offset);
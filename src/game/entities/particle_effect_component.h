@@ -15,7 +15,7 @@ class PositionComponent;
 
 // This component holds a bunch of ParticleEmitters, and allows an Entity to act as a particle emitter as well
 // (basically, the ParticleEmitter follows the Entity around).
-class ParticleEffectComponent: public EntityComponent {
+class ParticleEffectComponent final: public EntityComponent {
 private:
   struct EffectInfo {
     std::string name;
@@ -38,6 +38,7 @@ public:
   virtual ~ParticleEffectComponent();
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
 
   void initialize() override;
   void update(float dt) override;
@@ -1,5 +1,7 @@
+#include <cmath>
 #include <functional>
 
+#include <framework/flow_field.h>
 #include <framework/framework.h>
 #include <framework/logging.h>
 #include <framework/timer.h>
@@ -11,6 +13,7 @@
 #include <game/entities/moveable_component.h>
 #include <game/world/world.h>
 #include <game/ai/pathing_thread.h>
+#include <game/simulation/snapshot.h>
 
 namespace ent {
 
@@ -19,6 +22,10 @@ using namespace std::placeholders;
 // register the pathing component with the entity_factory
 ENT_COMPONENT_REGISTER("Pathing", PathingComponent);
 
+// When following a flow field, we head for the cell this many steps ahead of us, rather than the very next cell, so
+// that we move smoothly instead of zig-zagging between cell centres.
+static const int FLOW_FIELD_LOOKAHEAD = 3;
+
 PathingComponent::PathingComponent() :
     position_(nullptr), moveable_(nullptr), curr_goal_node_(0), last_request_time_(0.0f) {
 }
@@ -26,6 +33,10 @@ PathingComponent::PathingComponent() :
 PathingComponent::~PathingComponent() {
 }
 
+EntityComponent *PathingComponent::clone() const {
+  return new PathingComponent();
+}
+
 void PathingComponent::initialize() {
   std::shared_ptr<Entity> ent = entity_.lock();
   if (ent) {
@@ -45,11 +56,24 @@ void PathingComponent::update(float dt) {
       //TODO vector operator << for osteam
       //LOG(INFO) << "found path to [" << last_request_goal_ << "]: " << path_.size() << " node(s)" << std::endl;
     }
+    if (new_flow_field_) {
+      // Make sure this is the field for the goal we're currently heading to, and not one we asked for previously.
+      if (new_flow_field_->get_goal_x() == static_cast<int>(flow_field_goal_[0])
+          && new_flow_field_->get_goal_z() == static_cast<int>(flow_field_goal_[2])) {
+        flow_field_ = new_flow_field_;
+      }
+      new_flow_field_.reset();
+    }
   }
 
   auto entity = entity_.lock();
   if (!entity) return;
 
+  if (flow_field_) {
+    follow_flow_field(entity);
+    return;
+  }
+
   // follow the path... todo: this can be done SOOOOOO much better!
   while (is_following_path()) {
     fw::Vector goal = path_[curr_goal_node_];
@@ -75,11 +99,56 @@ void PathingComponent::update(float dt) {
   }
 }
 
+// Unlike a path, the flow field tells us which way to go from wherever we are, so there's no "current node" to keep
+// track of. We just look up our cell each frame and head for the cell a few steps further along the field.
+void PathingComponent::follow_flow_field(std::shared_ptr<Entity> const &entity) {
+  fw::Vector dir = position_->get_direction_to(flow_field_goal_, /*ignore_height=*/true);
+  dir[1] = 0.0f;
+  if (dir.length() <= 1.0f) {
+    // We're basically at the goal, head straight for it.
+    moveable_->set_intermediate_goal(flow_field_goal_);
+    flow_field_.reset();
+    return;
+  }
+
+  fw::Vector pos = position_->get_position();
+  int x = static_cast<int>(floor(pos[0]));
+  int z = static_cast<int>(floor(pos[2]));
+  const bool show_pathing =
+      entity->has_debug_view() && (entity->get_debug_flags() & EntityDebugFlags::kDebugShowPathing) != 0;
+
+  int steps = 0;
+  for (; steps < FLOW_FIELD_LOOKAHEAD; steps++) {
+    int next_x, next_z;
+    if (!flow_field_->get_next_cell(x, z, next_x, next_z)) {
+      break;
+    }
+    if (show_pathing) {
+      entity->get_debug_view().add_line(fw::Vector(x + 0.5f, 0.0f, z + 0.5f),
+          fw::Vector(next_x + 0.5f, 0.0f, next_z + 0.5f), fw::Color(0, 1, 1), /*offset_terrain_height=*/ true);
+    }
+    x = next_x;
+    z = next_z;
+  }
+
+  if (steps > 0) {
+    moveable_->set_intermediate_goal(fw::Vector(x + 0.5f, 0.0f, z + 0.5f));
+  } else if (flow_field_->get_cost(x, z) == 0.0f) {
+    // We're in the goal cell, so just head straight to the goal itself.
+    moveable_->set_intermediate_goal(flow_field_goal_);
+    flow_field_.reset();
+  } else {
+    // The goal can't be reached from here.
+    moveable_->set_intermediate_goal(pos);
+    flow_field_.reset();
+  }
+}
+
 bool PathingComponent::is_following_path() const {
-  return (path_.size() > curr_goal_node_);
+  return (path_.size() > curr_goal_node_) || flow_field_ != nullptr;
 }
 
-void PathingComponent::set_goal(fw::Vector const &goal) {
+void PathingComponent::set_goal(fw::Vector const &goal, bool use_flow_field /*= false*/) {
   // request a path from the Entity's current position to the given goal and get the pathing_thread to call our
   // set_path method when it's done
   float now = fw::Framework::get_instance()->get_timer()->get_total_time();
@@ -94,13 +163,76 @@ void PathingComponent::set_goal(fw::Vector const &goal) {
   last_request_goal_ = goal;
 
   auto pathing_thread = game::World::get_instance()->get_pathing();
-  pathing_thread->request_path(position_->get_position(), goal,
-      std::bind(&PathingComponent::on_path_found, this, _1));
+  if (use_flow_field) {
+    // Stop following our old path. We'll start following the flow field once we've got it.
+    path_.clear();
+    curr_goal_node_ = 0;
+    flow_field_.reset();
+    flow_field_goal_ = goal;
+    pathing_thread->request_flow_field(goal, std::bind(&PathingComponent::on_flow_field_found, this, _1));
+  } else {
+    flow_field_.reset();
+    pathing_thread->request_path(position_->get_position(), goal,
+        std::bind(&PathingComponent::on_path_found, this, _1));
+  }
 }
 
 void PathingComponent::stop() {
   path_.clear();
   curr_goal_node_ = 0;
+  flow_field_.reset();
+}
+
+void PathingComponent::write_snapshot(fw::net::PacketBuffer &buffer) const {
+  // If a path has just been found, we'd have started following it on our next update, so that's what we save.
+  std::unique_lock lock(mutex_);
+  std::vector<fw::Vector> const &path = new_path_.empty() ? path_ : new_path_;
+  uint32_t curr_goal_node = new_path_.empty() ? static_cast<uint32_t>(curr_goal_node_) : 0;
+  uint32_t num_nodes = static_cast<uint32_t>(path.size());
+
+  game::write_raw(buffer, last_request_goal_);
+  buffer << fw::net::compact(curr_goal_node);
+  buffer << fw::net::compact(num_nodes);
+  for (fw::Vector const &node : path) {
+    game::write_raw(buffer, node);
+  }
+
+  const bool following_flow_field = flow_field_ != nullptr || new_flow_field_ != nullptr;
+  buffer << static_cast<uint8_t>(following_flow_field ? 1 : 0);
+  if (following_flow_field) {
+    game::write_raw(buffer, flow_field_goal_);
+  }
+}
+
+void PathingComponent::read_snapshot(fw::net::PacketBuffer &buffer) {
+  std::unique_lock lock(mutex_);
+  uint32_t curr_goal_node;
+  uint32_t num_nodes;
+  game::read_raw(buffer, last_request_goal_);
+  buffer >> fw::net::compact(curr_goal_node);
+  buffer >> fw::net::compact(num_nodes);
+  if (num_nodes > buffer.get_remaining() / (sizeof(float) * 3)) {
+    buffer.set_error(fw::ErrorStatus("too many path nodes: ") << num_nodes);
+    return;
+  }
+  path_.resize(num_nodes);
+  for (fw::Vector &node : path_) {
+    game::read_raw(buffer, node);
+  }
+  curr_goal_node_ = curr_goal_node;
+  new_path_.clear();
+  new_flow_field_.reset();
+  flow_field_.reset();
+  last_request_time_ = fw::Framework::get_instance()->get_timer()->get_total_time();
+
+  uint8_t following_flow_field;
+  buffer >> following_flow_field;
+  if (following_flow_field != 0) {
+    game::read_raw(buffer, flow_field_goal_);
+    lock.unlock();
+    game::World::get_instance()->get_pathing()->request_flow_field(
+        flow_field_goal_, std::bind(&PathingComponent::on_flow_field_found, this, _1));
+  }
 }
 
 void PathingComponent::on_path_found(std::vector<fw::Vector> const &path) {
@@ -108,4 +240,9 @@ void PathingComponent::on_path_found(std::vector<fw::Vector> const &path) {
   new_path_ = path;
 }
 
+void PathingComponent::on_flow_field_found(std::shared_ptr<fw::FlowField const> const &flow_field) {
+  std::unique_lock lock(mutex_);
+  new_flow_field_ = flow_field;
+}
+
 }
@@ -1,20 +1,25 @@
 #pragma once
 
+#include <memory>
 #include <mutex>
 
 #include <framework/math.h>
 
 #include <game/entities/entity.h>
 
+namespace fw {
+class FlowField;
+}
+
 namespace ent {
 class MoveableComponent;
 class PositionComponent;
 
 // The pathing component is attached to each Entity that will follow a path
 // over the terrain (for example, tanks have this; helicopters do not)
-class PathingComponent: public EntityComponent {
+class PathingComponent final: public EntityComponent {
 private:
-  std::mutex mutex_;
+  mutable std::mutex mutex_;
 
   fw::Vector last_request_goal_;
   float last_request_time_;
@@ -28,6 +33,14 @@ private:
   void on_path_found(std::vector<fw::Vector> const &path);
   std::vector<fw::Vector> new_path_;
 
+  // When we're moving as part of a large group, we follow a flow field (shared with the rest of the group) instead of
+  // a path. Like new_path_, new_flow_field_ is set on the pathing thread and locked by mutex_.
+  void on_flow_field_found(std::shared_ptr<fw::FlowField const> const &flow_field);
+  void follow_flow_field(std::shared_ptr<Entity> const &entity);
+  std::shared_ptr<fw::FlowField const> new_flow_field_;
+  std::shared_ptr<fw::FlowField const> flow_field_;
+  fw::Vector flow_field_goal_;
+
 public:
   static const int identifier = 650;
   virtual int get_identifier() {
@@ -37,18 +50,25 @@ public:
   PathingComponent();
   ~PathingComponent();
 
+  virtual EntityComponent *clone() const;
   virtual void initialize();
   virtual void update(float dt);
 
   // sets the goal for this Entity. we request the path from the pathing_thread and when it comes back, we'll start
-  // moving along it.
-  void set_goal(fw::Vector const &goal);
+  // moving along it. If use_flow_field is true, we request the flow field towards the goal instead (which is shared
+  // with every other Entity moving to the same goal) and follow that.
+  void set_goal(fw::Vector const &goal, bool use_flow_field = false);
 
   // If we're following a path (or waiting for a path), stop now.
   void stop();
 
   // get a flag that simply indicates whether we're currently following a path or not
   bool is_following_path() const;
+
+  // Saves and restores our state in a snapshot, see EntityManager::write_snapshot(). We save the path we're following,
+  // but not a flow field: we just ask for the flow field again when we're restored.
+  void write_snapshot(fw::net::PacketBuffer &buffer) const;
+  void read_snapshot(fw::net::PacketBuffer &buffer);
 };
 
 }
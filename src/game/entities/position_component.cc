@@ -9,6 +9,7 @@
 #include <game/entities/entity_factory.h>
 #include <game/entities/position_component.h>
 #include <game/entities/mesh_component.h>
+#include <game/simulation/snapshot.h>
 #include <game/world/world.h>
 #include <game/world/terrain.h>
 
@@ -21,12 +22,34 @@ ENT_COMPONENT_REGISTER("Position", PositionComponent);
 
 PositionComponent::PositionComponent() :
     pos_(0, 0, 0), dir_(0, 0, 1), up_(0, 1, 0), pos_updated_(true), sit_on_terrain_(false),
-    orient_to_terrain_(false), patch_(0) {
+    orient_to_terrain_(false), patch_(0), patch_offset_(0, 0, 0), spatial_index_(nullptr),
+    spatial_handle_(SpatialIndex::INVALID_HANDLE) {
 }
 
 PositionComponent::~PositionComponent() {
 }
 
+void PositionComponent::initialize() {
+  std::shared_ptr<ent::Entity> entity(entity_);
+  spatial_index_ = entity->get_manager()->get_spatial_index();
+  if (spatial_index_ != nullptr) {
+    spatial_handle_ = spatial_index_->add(entity_, pos_);
+  }
+}
+
+void PositionComponent::remove_from_world() {
+  if (spatial_handle_ != SpatialIndex::INVALID_HANDLE) {
+    spatial_index_->remove(spatial_handle_);
+    spatial_handle_ = SpatialIndex::INVALID_HANDLE;
+  }
+
+  // Otherwise the patch would keep our (expired) entry forever.
+  if (patch_ != nullptr) {
+    patch_->remove_entity(patch_entry_);
+    patch_ = nullptr;
+  }
+}
+
 void PositionComponent::apply_template(fw::lua::Value tmpl) {
   set_sit_on_terrain(tmpl["SitOnTerrain"]);
   // We don't want to set this false unless it's explicitly set to false. If it's unset, then it will depend on the
@@ -36,6 +59,13 @@ void PositionComponent::apply_template(fw::lua::Value tmpl) {
   }
 }
 
+EntityComponent *PositionComponent::clone() const {
+  PositionComponent *comp = new PositionComponent();
+  comp->sit_on_terrain_ = sit_on_terrain_;
+  comp->orient_to_terrain_ = orient_to_terrain_;
+  return comp;
+}
+
 void PositionComponent::set_sit_on_terrain(bool sit_on_terrain) {
   sit_on_terrain_ = sit_on_terrain;
   if (sit_on_terrain_)
@@ -76,21 +106,29 @@ void PositionComponent::set_final_position() {
     float z = fw::constrain(pos_[2], static_cast<float>(terrain->get_length()), 0.0f);
     pos_ = fw::Vector(x, pos_[1], z);
 
-    // make sure we "exist" in the correct patch as well...
-    std::shared_ptr<ent::Entity> entity(entity_);
-    EntityManager *emgr = entity->get_manager();
-    PatchManager *pmgr = emgr->get_patch_manager();
-    Patch *new_patch = pmgr->get_patch(x, z);
-    if (new_patch != patch_) {
-      if (patch_ != nullptr) {
-        patch_->remove_entity(entity);
-      }
+    update_patch_and_hash();
+    pos_updated_ = false;
+  }
+}
 
-      new_patch->add_entity(entity);
-      patch_ = new_patch;
+void PositionComponent::update_patch_and_hash() {
+  // make sure we "exist" in the correct patch as well...
+  std::shared_ptr<ent::Entity> entity(entity_);
+  EntityManager *emgr = entity->get_manager();
+  PatchManager *pmgr = emgr->get_patch_manager();
+  Patch *new_patch = pmgr->get_patch(pos_[0], pos_[2]);
+  if (new_patch != patch_) {
+    if (patch_ != nullptr) {
+      patch_->remove_entity(patch_entry_);
     }
 
-    pos_updated_ = false;
+    patch_entry_ = new_patch->add_entity(entity);
+    patch_ = new_patch;
+  }
+
+  if (entity->get_id() != 0) {
+    state_hash_.set(
+        emgr->get_state_hash(), fw::StateHash::combine(entity->get_id(), identifier, pos_[0], pos_[1], pos_[2]));
   }
 }
 
@@ -100,10 +138,37 @@ void PositionComponent::set_position(fw::Vector const &pos) {
   float world_length = entity->get_manager()->get_patch_manager()->get_world_length();
 
   pos_ = fw::Vector(fw::constrain(pos[0], world_width, 0.0f), pos[1], fw::constrain(pos[2], world_length, 0.0f));
+  if (spatial_handle_ != SpatialIndex::INVALID_HANDLE) {
+    spatial_index_->move(spatial_handle_, pos_);
+  }
 
   pos_updated_ = true;
 }
 
+void PositionComponent::write_snapshot(fw::net::PacketBuffer &buffer) const {
+  game::write_raw(buffer, pos_);
+  game::write_raw(buffer, dir_);
+  game::write_raw(buffer, up_);
+  buffer << static_cast<uint8_t>(pos_updated_ ? 1 : 0);
+}
+
+void PositionComponent::read_snapshot(fw::net::PacketBuffer &buffer) {
+  game::read_raw(buffer, pos_);
+  game::read_raw(buffer, dir_);
+  game::read_raw(buffer, up_);
+  uint8_t pos_updated;
+  buffer >> pos_updated;
+  pos_updated_ = (pos_updated != 0);
+  if (spatial_handle_ != SpatialIndex::INVALID_HANDLE) {
+    spatial_index_->move(spatial_handle_, pos_);
+  }
+
+  // We don't call set_final_position here: sitting on the terrain and renormalizing dir_ again could move us by a
+  // rounding error, and then we'd no longer match the peers we got the snapshot from. If they hadn't worked out their
+  // final position yet either, we'll do it at the same time they do.
+  update_patch_and_hash();
+}
+
 fw::Vector PositionComponent::get_position(bool allow_update) {
   if (allow_update) {
     set_final_position();
@@ -164,46 +229,29 @@ fw::Vector PositionComponent::get_direction_to(std::shared_ptr<Entity> entity, b
 }
 
 // searches for the nearest Entity to us which matches the given predicate
-std::weak_ptr<Entity> PositionComponent::get_nearest_entity(
-    std::function<bool(std::shared_ptr<Entity> const &)> pred) const {
-  std::shared_ptr<Entity> closest;
-  float closest_distance = 0.0f;
-
-  std::shared_ptr<Entity> us(entity_);
-  std::list<std::weak_ptr<Entity>> patch_entities = patch_->get_entities();
-  for (auto it = patch_entities.begin(); it != patch_entities.end(); ++it) {
-    std::shared_ptr<Entity> ent = (*it).lock();
-    if (!ent) {
-      continue;
-    }
-
-    if (ent == us) {
-      continue;
-    }
-
-    PositionComponent *their_pos = ent->get_component<PositionComponent>();
-    if (their_pos == nullptr) {
-      continue;
-    }
-
-    float dist = get_direction_to(their_pos->get_position()).length();
-    if (!closest || (closest_distance > dist && pred(ent))) {
-      closest = ent;
-      closest_distance = dist;
-    }
+std::weak_ptr<Entity> PositionComponent::get_nearest_entity(std::function<bool(Entity const &)> pred) const {
+  Entity const *us = entity_.lock().get();
+
+  std::array<SpatialIndex::Neighbour, 1> nearest;
+  int count = spatial_index_->find_nearest(pos_, static_cast<float>(PatchManager::PATCH_SIZE),
+      [us, &pred](SpatialIndex::Neighbour const &neighbour) {
+        return neighbour.entity != us && pred(*neighbour.entity);
+      }, nearest);
+  if (count == 0) {
+    return std::weak_ptr<Entity>();
   }
 
-  return std::weak_ptr<Entity>(closest);
+  return spatial_index_->get_entity(nearest[0].handle);
 }
 
 // searches for the nearest Entity to us
 std::weak_ptr<Entity> PositionComponent::get_nearest_entity() const {
-  return get_nearest_entity([](std::shared_ptr<Entity> const &) { return true; });
+  return get_nearest_entity([](Entity const &) { return true; });
 }
 
 std::weak_ptr<Entity> PositionComponent::get_nearest_entity_with_component(int component_type) const {
-  return get_nearest_entity([component_type](std::shared_ptr<Entity> const &ent) {
-    return ent->contains_component(component_type);
+  return get_nearest_entity([component_type](Entity const &ent) {
+    return ent.contains_component(component_type);
   });
 }
 
@@ -216,24 +264,14 @@ Patch::Patch(fw::Vector const &origin) :
 Patch::~Patch() {
 }
 
-void Patch::add_entity(std::weak_ptr<Entity> Entity) {
-  entities_.push_back(Entity);
+std::list<std::weak_ptr<Entity>>::iterator Patch::add_entity(std::weak_ptr<Entity> Entity) {
+  return entities_.insert(entities_.end(), Entity);
 }
 
-void Patch::remove_entity(std::weak_ptr<Entity> Entity) {
-  std::shared_ptr<ent::Entity> ent = Entity.lock();
-  if (!ent) {
-    return;
-  }
-
-  for (auto it = entities_.begin(); it != entities_.end();) {
-    std::shared_ptr<ent::Entity> other_ent = (*it).lock();
-    if (other_ent && other_ent == ent) {
-      it = entities_.erase(it);
-    } else {
-      ++it;
-    }
-  }
+void Patch::remove_entity(std::list<std::weak_ptr<Entity>>::iterator entry) {
+  // Entities move between patches all the time (and a snapshot restore moves every one of them), so this has to be
+  // quicker than searching the whole patch for them.
+  entities_.erase(entry);
 }
 
 //-------------------------------------------------------------------------
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <array>
+#include <functional>
 #include <list>
 #include <memory>
 
 #include <framework/math.h>
+#include <framework/state_hash.h>
 
+#include <game/entities/component_store.h>
 #include <game/entities/entity.h>
+#include <game/entities/spatial_index.h>
 
 namespace ent {
 
@@ -21,14 +26,13 @@ public:
   Patch(fw::Vector const &origin);
   ~Patch();
 
-  // adds the given Entity to this patch
-  void add_entity(std::weak_ptr<Entity> entity);
+  // adds the given Entity to this patch, and returns its entry, which is what you pass to remove_entity
+  std::list<std::weak_ptr<Entity>>::iterator add_entity(std::weak_ptr<Entity> entity);
 
-  // removes the given Entity from this patch
-  void remove_entity(std::weak_ptr<Entity> entity);
+  // removes the given entry (returned by add_entity) from this patch
+  void remove_entity(std::list<std::weak_ptr<Entity>>::iterator entry);
 
-  // gets a COPY of the Entity list (this could be expensive...)
-  std::list<std::weak_ptr<Entity>> get_entities() {
+  std::list<std::weak_ptr<Entity>> const &get_entities() const {
     return entities_;
   }
 
@@ -76,7 +80,7 @@ public:
 
 // the position component is a member of all entities that have position data (which, actually, is probably most of
 // them!)
-class PositionComponent: public EntityComponent {
+class PositionComponent final: public EntityComponent {
 private:
   fw::Vector pos_;
   fw::Vector dir_;
@@ -85,21 +89,49 @@ private:
   bool sit_on_terrain_;
   bool orient_to_terrain_;
   Patch *patch_;
+  std::list<std::weak_ptr<Entity>>::iterator patch_entry_;
+  fw::Vector patch_offset_;
+  SpatialIndex *spatial_index_;
+  SpatialIndex::Handle spatial_handle_;
+  fw::StateHash::Element state_hash_;
 
   // if _pos_updated is true, this will calculation "real" position of the
   // Entity, taking _sit_on_terrain and _orient_to_terrain into account
   void set_final_position();
 
+  // Puts us in the patch for pos_ and updates the state hash, without changing pos_, dir_ or up_.
+  void update_patch_and_hash();
+
 public:
+  ENT_COMPONENT_STORE(PositionComponent);
+
   static const int identifier = 100;
 
   PositionComponent();
   virtual ~PositionComponent();
 
   virtual void apply_template(fw::lua::Value tmpl);
+  virtual EntityComponent *clone() const;
 
+  virtual void initialize();
   virtual void update(float dt);
 
+  bool has_system() const override {
+    return true;
+  }
+
+  // Removes us from the EntityManager's SpatialIndex and from our patch. This is called by the EntityManager when we're
+  // destroyed.
+  void remove_from_world();
+
+  void remove_from_state_hash() override {
+    state_hash_.clear();
+  }
+
+  // Saves and restores our state in a snapshot, see EntityManager::write_snapshot().
+  void write_snapshot(fw::net::PacketBuffer &buffer) const;
+  void read_snapshot(fw::net::PacketBuffer &buffer);
+
   // gets the view transform for the Entity based on it's current world-space position
   fw::Matrix get_transform() const;
 
@@ -132,14 +164,23 @@ public:
     return patch_;
   }
 
+  // gets or sets the offset we're drawn at, so that entities near the camera are drawn on the correct "side" of the
+  // map when the view wraps around the edge of the world. This is set by the EntityManager each frame.
+  void set_patch_offset(fw::Vector const &offset) {
+    patch_offset_ = offset;
+  }
+  fw::Vector const &get_patch_offset() const {
+    return patch_offset_;
+  }
+
   // gets the direction to the given point/Entity, taking into account the fact that it might be quicker to wrap around
   // the edges of the map. If ignore_height is true, we ignore the terrain height (basically set y to 0).
   fw::Vector get_direction_to(fw::Vector const &point, bool ignore_height = false) const;
   fw::Vector get_direction_to(std::shared_ptr<Entity> entity, bool ignore_height = false) const;
 
-  // searches for the nearest Entity to us which matches the given predicate
-  std::weak_ptr<Entity> get_nearest_entity(
-      std::function<bool(std::shared_ptr<Entity> const &)> pred) const;
+  // searches for the nearest Entity to us (no further away than the size of a patch) which matches the given
+  // predicate
+  std::weak_ptr<Entity> get_nearest_entity(std::function<bool(Entity const &)> pred) const;
 
   // searches for the nearest Entity to us
   std::weak_ptr<Entity> get_nearest_entity() const;
@@ -153,29 +194,17 @@ public:
     return get_nearest_entity_with_component(T::identifier);
   }
 
-  // searches for all the entities within the given radius
+  // searches for all the entities within the given radius (up to a maximum of MAX_RADIUS_RESULTS of them)
+  static const int MAX_RADIUS_RESULTS = 64;
   template<typename inserter_t>
   inline void get_entities_within_radius(float radius, inserter_t ins) const {
-    std::shared_ptr<Entity> us(entity_);
-
-    std::list<std::weak_ptr<Entity>> patch_entities = patch_->get_entities();
-    for (auto it = patch_entities.begin(); it != patch_entities.end(); ++it) {
-      std::shared_ptr<Entity> ent = (*it).lock();
-      if (!ent)
-        continue;
-
-      // ignore ourselves
-      if (ent == us)
-        continue;
-
-      PositionComponent *their_pos = ent->get_component<PositionComponent>();
-      if (their_pos == 0)
-        continue;
-
-      float dist = get_direction_to(their_pos->get_position()).length();
-      if (dist < radius) {
-        (*ins) = std::weak_ptr<Entity>(ent);
-      }
+    Entity const *us = entity_.lock().get();
+
+    std::array<SpatialIndex::Neighbour, MAX_RADIUS_RESULTS> neighbours;
+    int count = spatial_index_->find_within_radius(pos_, radius,
+        [us](SpatialIndex::Neighbour const &neighbour) { return neighbour.entity != us; }, neighbours);
+    for (int i = 0; i < count; i++) {
+      (*ins) = spatial_index_->get_entity(neighbours[i].handle);
     }
   }
 
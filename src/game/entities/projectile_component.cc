@@ -10,6 +10,7 @@
 #include <game/entities/moveable_component.h>
 #include <game/entities/damageable_component.h>
 #include <game/entities/selectable_component.h>
+#include <game/simulation/snapshot.h>
 #include <game/world/world.h>
 #include <game/world/terrain.h>
 
@@ -21,7 +22,7 @@ ENT_COMPONENT_REGISTER("BallisticProjectile", BallisticProjectileComponent);
 
 //-------------------------------------------------------------------------
 ProjectileComponent::ProjectileComponent() :
-    our_moveable_(0), our_position_(nullptr), target_position_(nullptr) {
+    our_moveable_(0), our_position_(nullptr), target_position_(nullptr), planned_explode_(false) {
 }
 
 ProjectileComponent::~ProjectileComponent() {
@@ -44,8 +45,14 @@ void ProjectileComponent::set_target(std::weak_ptr<Entity> target) {
     target_position_ = sp->get_component<PositionComponent>();
 }
 
-void ProjectileComponent::update(float) {
-  bool exploded = false;
+void ProjectileComponent::update(float dt) {
+  plan_update(dt);
+  commit_update();
+}
+
+void ProjectileComponent::plan_update(float) {
+  planned_explode_ = false;
+  planned_hit_.reset();
   std::shared_ptr<ent::Entity> Entity(entity_);
 
   // find the nearest damagable Entity - if it's closer than the "hit" distance, then we've hit them!
@@ -63,24 +70,32 @@ void ProjectileComponent::update(float) {
     }
 
     if (nearest_distance < hit_distance) {
-      explode(nearest);
-      exploded = true;
+      planned_explode_ = true;
+      planned_hit_ = nearest;
     }
   }
 
-  if (!exploded) {
+  if (!planned_explode_) {
     // check whether we've hit the ground
     auto terrain = game::World::get_instance()->get_terrain();
 
-    fw::Vector pos = our_position_->get_position();
+    fw::Vector pos = our_position_->get_position(false);
     float height = terrain->get_height(pos[0], pos[2]);
     if (height > pos[1]) {
-      explode (std::shared_ptr<ent::Entity>());
-      exploded = true;
+      planned_explode_ = true;
     }
   }
 }
 
+void ProjectileComponent::commit_update() {
+  if (planned_explode_) {
+    std::shared_ptr<Entity> hit = planned_hit_;
+    planned_explode_ = false;
+    planned_hit_.reset();
+    explode(hit);
+  }
+}
+
 void ProjectileComponent::explode(std::shared_ptr<Entity> hit) {
   // if we hit someone, apply damage to them
   if (hit) {
@@ -96,9 +111,29 @@ void ProjectileComponent::explode(std::shared_ptr<Entity> hit) {
   attr->set_value(0.0f);
 }
 
+void ProjectileComponent::write_snapshot(fw::net::PacketBuffer &buffer) const {
+  std::shared_ptr<Entity> target = target_.lock();
+  entity_id target_id = target ? target->get_id() : 0;
+  buffer << fw::net::compact(target_id);
+}
+
+void ProjectileComponent::read_snapshot(fw::net::PacketBuffer &buffer) {
+  entity_id target_id;
+  buffer >> fw::net::compact(target_id);
+
+  // Our trajectory (if we're ballistic) has already been restored, so we don't want set_target() to work it out again.
+  std::weak_ptr<Entity> target;
+  if (target_id != 0) {
+    target = std::shared_ptr<Entity>(entity_)->get_manager()->get_entity(target_id);
+  }
+  ProjectileComponent::set_target(target);
+  planned_explode_ = false;
+  planned_hit_.reset();
+}
+
 //-------------------------------------------------------------------------
 SeekingProjectileComponent::SeekingProjectileComponent() :
-    time_to_lock_(0) {
+    time_to_lock_(0), has_planned_goal_(false) {
 }
 
 SeekingProjectileComponent::~SeekingProjectileComponent() {
@@ -108,13 +143,21 @@ void SeekingProjectileComponent::apply_template(fw::lua::Value tmpl) {
   time_to_lock_ = tmpl["TimeToLock"];
 }
 
-void SeekingProjectileComponent::update(float dt) {
+EntityComponent *SeekingProjectileComponent::clone() const {
+  SeekingProjectileComponent *comp = new SeekingProjectileComponent();
+  comp->time_to_lock_ = time_to_lock_;
+  return comp;
+}
+
+void SeekingProjectileComponent::plan_update(float dt) {
+  has_planned_goal_ = false;
   if (time_to_lock_ > 0.0f) {
     time_to_lock_ -= dt;
 
     // our time to lock hasn't expired yet, keep waiting...
     if (time_to_lock_ > 0.0f) {
-      our_moveable_->set_intermediate_goal(our_position_->get_position() + our_position_->get_direction());
+      planned_goal_ = our_position_->get_position(false) + our_position_->get_direction();
+      has_planned_goal_ = true;
     } else {
       // we've locked, make it exactly 0 (it might be less)
       time_to_lock_ = 0.0f;
@@ -126,11 +169,31 @@ void SeekingProjectileComponent::update(float dt) {
   std::shared_ptr<Entity> target = target_.lock();
   if (target && time_to_lock_ == 0) {
     // "seek" the target, just move towards it...
-    our_moveable_->set_intermediate_goal(target_position_->get_position());
+    planned_goal_ = target_position_->get_position(false);
+    has_planned_goal_ = true;
   }
 
   // the base class will check when it's time to explode
-  ProjectileComponent::update(dt);
+  ProjectileComponent::plan_update(dt);
+}
+
+void SeekingProjectileComponent::commit_update() {
+  if (has_planned_goal_) {
+    our_moveable_->set_intermediate_goal(planned_goal_);
+    has_planned_goal_ = false;
+  }
+  ProjectileComponent::commit_update();
+}
+
+void SeekingProjectileComponent::write_snapshot(fw::net::PacketBuffer &buffer) const {
+  ProjectileComponent::write_snapshot(buffer);
+  game::write_raw(buffer, time_to_lock_);
+}
+
+void SeekingProjectileComponent::read_snapshot(fw::net::PacketBuffer &buffer) {
+  ProjectileComponent::read_snapshot(buffer);
+  game::read_raw(buffer, time_to_lock_);
+  has_planned_goal_ = false;
 }
 
 //-------------------------------------------------------------------------
@@ -145,6 +208,12 @@ void BallisticProjectileComponent::apply_template(fw::lua::Value tmpl) {
   max_height_ = tmpl["MaxHeight"];
 }
 
+EntityComponent *BallisticProjectileComponent::clone() const {
+  BallisticProjectileComponent *comp = new BallisticProjectileComponent();
+  comp->max_height_ = max_height_;
+  return comp;
+}
+
 void BallisticProjectileComponent::set_target(std::weak_ptr<Entity> target) {
   ProjectileComponent::set_target(target);
   std::shared_ptr<Entity> sptarget = target.lock();
@@ -2,6 +2,9 @@
 
 #include <memory>
 
+#include <framework/math.h>
+
+#include <game/entities/component_store.h>
 #include <game/entities/entity.h>
 
 namespace ent {
@@ -17,6 +20,10 @@ protected:
   MoveableComponent *our_moveable_;
   PositionComponent *our_position_;
 
+  // The result of plan_update, which commit_update applies.
+  bool planned_explode_;
+  std::shared_ptr<Entity> planned_hit_;
+
 public:
   static const int identifier = 600;
 
@@ -31,11 +38,21 @@ public:
   virtual void initialize();
   virtual void update(float dt);
 
+  // update() is split in two so the EntityManager can do the homing and hit detection for every projectile in
+  // parallel. plan_update works out whether we've hit something, and commit_update does the exploding (which damages
+  // and destroys entities, so must happen on the update thread).
+  virtual void plan_update(float dt);
+  virtual void commit_update();
+
   // this is called when we detect we've hit our target (or something else got in the way) not all projectiles
   // will actually "explode" but that's a good enough analogy. If hit is valid, we'll assume that's the Entity we
   // actually hit and give them some extra damage
   virtual void explode(std::shared_ptr<Entity> hit);
 
+  // Saves and restores our state in a snapshot, see EntityManager::write_snapshot().
+  void write_snapshot(fw::net::PacketBuffer &buffer) const;
+  void read_snapshot(fw::net::PacketBuffer &buffer);
+
   virtual int get_identifier() {
     return identifier;
   }
@@ -48,13 +65,30 @@ private:
   // Basically, we simply don't start "seeking" until this time runs out.
   float time_to_lock_;
 
+  // Where plan_update wants our MoveableComponent to head next, which commit_update tells it. Its goal isn't ours to
+  // change while we're planning.
+  bool has_planned_goal_;
+  fw::Vector planned_goal_;
+
 public:
+  ENT_COMPONENT_STORE(SeekingProjectileComponent);
+
   SeekingProjectileComponent();
   virtual ~SeekingProjectileComponent();
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
 
-  virtual void update(float dt);
+  void plan_update(float dt) override;
+  void commit_update() override;
+
+  bool has_system() const override {
+    return true;
+  }
+
+  // As well as the ProjectileComponent's state, we save how long we've got left until we lock on.
+  void write_snapshot(fw::net::PacketBuffer &buffer) const;
+  void read_snapshot(fw::net::PacketBuffer &buffer);
 };
 
 // This is a "ballistic" projectile component, which travels in a arc to it's target
@@ -64,10 +98,17 @@ private:
   float max_height_;
 
 public:
+  ENT_COMPONENT_STORE(BallisticProjectileComponent);
+
   BallisticProjectileComponent();
   virtual ~BallisticProjectileComponent();
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
+
+  bool has_system() const override {
+    return true;
+  }
 
   virtual void set_target(std::weak_ptr<Entity> target);
 };
@@ -82,6 +82,12 @@ void SelectableComponent::apply_template(fw::lua::Value tmpl) {
   }
 }
 
+EntityComponent *SelectableComponent::clone() const {
+  SelectableComponent *comp = new SelectableComponent();
+  comp->selection_radius_ = selection_radius_;
+  return comp;
+}
+
 void SelectableComponent::set_selection_radius(float value) {
   selection_radius_ = value;
 }
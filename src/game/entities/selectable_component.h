@@ -14,7 +14,7 @@ class PositionComponent;
 
 // The selectable_component is added to entities which can be selected by the user (e.g.
 // buildings, units and so on)
-class SelectableComponent: public EntityComponent {
+class SelectableComponent final: public EntityComponent {
 private:
   bool is_selected_;
   float selection_radius_;
@@ -39,6 +39,7 @@ public:
   void update(float dt) override;
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
 
   // gets or sets a flag which indicates whether we're selected or not
   void set_is_selected(bool selected);
@@ -0,0 +1,99 @@
+#include <game/entities/spatial_index.h>
+
+#include <cmath>
+
+namespace ent {
+
+SpatialIndex::SpatialIndex(float world_width, float world_length, float cell_size) :
+    world_width_(world_width), world_length_(world_length), cell_size_(cell_size) {
+  cells_width_ = std::max(1, static_cast<int>(ceil(world_width / cell_size)));
+  cells_length_ = std::max(1, static_cast<int>(ceil(world_length / cell_size)));
+  cells_.resize(cells_width_ * cells_length_);
+}
+
+int SpatialIndex::get_cell(float x, float z) const {
+  const int cell_x = fw::constrain(static_cast<int>(floor(x / cell_size_)), cells_width_);
+  const int cell_z = fw::constrain(static_cast<int>(floor(z / cell_size_)), cells_length_);
+  return (cell_z * cells_width_) + cell_x;
+}
+
+void SpatialIndex::add_to_cell(int slot, int cell) {
+  slot_cells_[slot] = cell;
+  slot_cell_positions_[slot] = static_cast<int>(cells_[cell].size());
+  cells_[cell].push_back(slot);
+}
+
+void SpatialIndex::remove_from_cell(int slot) {
+  std::vector<int> &cell = cells_[slot_cells_[slot]];
+  const int position = slot_cell_positions_[slot];
+  const int last_slot = cell.back();
+  cell[position] = last_slot;
+  slot_cell_positions_[last_slot] = position;
+  cell.pop_back();
+}
+
+SpatialIndex::Handle SpatialIndex::add(std::weak_ptr<Entity> const &entity, fw::Vector const &pos) {
+  Handle handle;
+  if (free_handles_.empty()) {
+    handle = static_cast<Handle>(handle_slots_.size());
+    handle_slots_.push_back(0);
+  } else {
+    handle = free_handles_.back();
+    free_handles_.pop_back();
+  }
+
+  const int slot = static_cast<int>(entities_.size());
+  handle_slots_[handle] = slot;
+  xs_.push_back(fw::constrain(pos[0], world_width_, 0.0f));
+  zs_.push_back(fw::constrain(pos[2], world_length_, 0.0f));
+  entities_.push_back(entity.lock().get());
+  weak_entities_.push_back(entity);
+  slot_cells_.push_back(0);
+  slot_cell_positions_.push_back(0);
+  slot_handles_.push_back(handle);
+  add_to_cell(slot, get_cell(xs_[slot], zs_[slot]));
+  return handle;
+}
+
+void SpatialIndex::move(Handle handle, fw::Vector const &pos) {
+  const int slot = handle_slots_[handle];
+  xs_[slot] = fw::constrain(pos[0], world_width_, 0.0f);
+  zs_[slot] = fw::constrain(pos[2], world_length_, 0.0f);
+
+  const int cell = get_cell(xs_[slot], zs_[slot]);
+  if (cell != slot_cells_[slot]) {
+    remove_from_cell(slot);
+    add_to_cell(slot, cell);
+  }
+}
+
+void SpatialIndex::remove(Handle handle) {
+  const int slot = handle_slots_[handle];
+  remove_from_cell(slot);
+
+  // Move the last slot into the one we just vacated, so the slots stay packed.
+  const int last_slot = static_cast<int>(entities_.size()) - 1;
+  if (slot != last_slot) {
+    xs_[slot] = xs_[last_slot];
+    zs_[slot] = zs_[last_slot];
+    entities_[slot] = entities_[last_slot];
+    weak_entities_[slot] = weak_entities_[last_slot];
+    slot_cells_[slot] = slot_cells_[last_slot];
+    slot_cell_positions_[slot] = slot_cell_positions_[last_slot];
+    slot_handles_[slot] = slot_handles_[last_slot];
+
+    cells_[slot_cells_[slot]][slot_cell_positions_[slot]] = slot;
+    handle_slots_[slot_handles_[slot]] = slot;
+  }
+
+  xs_.pop_back();
+  zs_.pop_back();
+  entities_.pop_back();
+  weak_entities_.pop_back();
+  slot_cells_.pop_back();
+  slot_cell_positions_.pop_back();
+  slot_handles_.pop_back();
+  free_handles_.push_back(handle);
+}
+
+}
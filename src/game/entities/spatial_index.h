@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <framework/math.h>
+#include <framework/misc.h>
+
+#include <game/entities/entity.h>
+
+namespace ent {
+
+// SpatialIndex is a uniform grid over the (wrapping) world which lets us find the entities near a point without
+// walking every entity in a patch. Each entity with a position is added once (by its PositionComponent) and gets a
+// handle, which it uses to tell us whenever it moves. Positions are stored contiguously, and an entity moving within
+// its cell (which is what almost all moves are) just updates its position in place.
+//
+// The queries take a predicate (called with each candidate Neighbour) and a caller-supplied output span, so they
+// never allocate. The results are not in any particular order, except for find_nearest, which sorts them by
+// distance.
+//
+// This class is not thread-safe; it's updated and queried on the update thread.
+class SpatialIndex {
+public:
+  typedef int Handle;
+  static const Handle INVALID_HANDLE = -1;
+
+  // The result of a query. offset is the (wrap-aware) vector from the query's centre to the entity, in the XZ plane.
+  struct Neighbour {
+    Handle handle;
+    Entity *entity;
+    fw::Vector offset;
+    float distance;
+  };
+
+private:
+  float world_width_;
+  float world_length_;
+  float cell_size_;
+  int cells_width_;
+  int cells_length_;
+
+  // The entities are packed into "slots" [0, size). When an entity is removed, the last slot is moved into its place,
+  // so handles are an indirection to the slot (and slot_handles_ maps back again).
+  std::vector<float> xs_;
+  std::vector<float> zs_;
+  std::vector<Entity *> entities_;
+  std::vector<std::weak_ptr<Entity>> weak_entities_;
+  std::vector<int> slot_cells_;
+  std::vector<int> slot_cell_positions_;
+  std::vector<Handle> slot_handles_;
+
+  std::vector<int> handle_slots_;
+  std::vector<Handle> free_handles_;
+
+  // The slots in each cell.
+  std::vector<std::vector<int>> cells_;
+
+  int get_cell(float x, float z) const;
+  void add_to_cell(int slot, int cell);
+  void remove_from_cell(int slot);
+
+  inline Neighbour make_neighbour(int slot, float centre_x, float centre_z) const {
+    float dx = xs_[slot] - centre_x;
+    float dz = zs_[slot] - centre_z;
+    if (dx > world_width_ * 0.5f) dx -= world_width_;
+    else if (dx < -world_width_ * 0.5f) dx += world_width_;
+    if (dz > world_length_ * 0.5f) dz -= world_length_;
+    else if (dz < -world_length_ * 0.5f) dz += world_length_;
+
+    const float distance = sqrt((dx * dx) + (dz * dz));
+    return Neighbour { slot_handles_[slot], entities_[slot], fw::Vector(dx, 0.0f, dz), distance };
+  }
+
+  // Calls fn with each cell that overlaps the rectangle half_width x half_length either side of the given centre,
+  // visiting each cell at most once even if the rectangle is bigger than the world. Stops early if fn returns false.
+  template<typename Fn>
+  void visit_cells(float centre_x, float centre_z, float half_width, float half_length, Fn fn) const {
+    int min_x = static_cast<int>(floor((centre_x - half_width) / cell_size_));
+    int max_x = static_cast<int>(floor((centre_x + half_width) / cell_size_));
+    int min_z = static_cast<int>(floor((centre_z - half_length) / cell_size_));
+    int max_z = static_cast<int>(floor((centre_z + half_length) / cell_size_));
+    if (max_x - min_x >= cells_width_) {
+      min_x = 0;
+      max_x = cells_width_ - 1;
+    }
+    if (max_z - min_z >= cells_length_) {
+      min_z = 0;
+      max_z = cells_length_ - 1;
+    }
+
+    for (int z = min_z; z <= max_z; z++) {
+      const int row = fw::constrain(z, cells_length_) * cells_width_;
+      for (int x = min_x; x <= max_x; x++) {
+        if (!fn(row + fw::constrain(x, cells_width_))) {
+          return;
+        }
+      }
+    }
+  }
+
+  // Inserts the given neighbour into the (sorted, count long) results, dropping the furthest one if it's full.
+  static void insert_sorted(Neighbour const &neighbour, std::span<Neighbour> out, int &count) {
+    if (count == static_cast<int>(out.size())) {
+      if (out.empty() || neighbour.distance >= out[count - 1].distance) {
+        return;
+      }
+      count--;
+    }
+
+    int i = count;
+    while (i > 0 && out[i - 1].distance > neighbour.distance) {
+      out[i] = out[i - 1];
+      i--;
+    }
+    out[i] = neighbour;
+    count++;
+  }
+
+public:
+  SpatialIndex(float world_width, float world_length, float cell_size);
+
+  // Adds an entity at the given position and returns the handle to use to move or remove it.
+  Handle add(std::weak_ptr<Entity> const &entity, fw::Vector const &pos);
+
+  // Updates the position of the entity with the given handle.
+  void move(Handle handle, fw::Vector const &pos);
+
+  // Removes the entity with the given handle. The handle may be reused by a later call to add().
+  void remove(Handle handle);
+
+  inline int get_size() const {
+    return static_cast<int>(entities_.size());
+  }
+
+  inline float get_cell_size() const {
+    return cell_size_;
+  }
+
+  std::weak_ptr<Entity> const &get_entity(Handle handle) const {
+    return weak_entities_[handle_slots_[handle]];
+  }
+
+  // Finds the entities within radius of centre for which pred returns true. Returns the number of entities written to
+  // out, which is at most out.size().
+  template<typename Pred>
+  int find_within_radius(fw::Vector const &centre, float radius, Pred pred, std::span<Neighbour> out) const {
+    int count = 0;
+    visit_cells(centre[0], centre[2], radius, radius, [&](int cell) {
+      for (int slot : cells_[cell]) {
+        Neighbour neighbour = make_neighbour(slot, centre[0], centre[2]);
+        if (neighbour.distance > radius || !pred(neighbour)) {
+          continue;
+        }
+        if (count == static_cast<int>(out.size())) {
+          return false;
+        }
+        out[count++] = neighbour;
+      }
+      return true;
+    });
+    return count;
+  }
+
+  // Finds the entities inside the given rectangle (left/top are X/Z, and it may wrap around the edge of the world) for
+  // which pred returns true. Returns the number of entities written to out.
+  template<typename Pred>
+  int find_in_rect(fw::Rectangle<float> const &rect, Pred pred, std::span<Neighbour> out) const {
+    const float half_width = rect.width * 0.5f;
+    const float half_length = rect.height * 0.5f;
+    const float centre_x = rect.left + half_width;
+    const float centre_z = rect.top + half_length;
+
+    int count = 0;
+    visit_cells(centre_x, centre_z, half_width, half_length, [&](int cell) {
+      for (int slot : cells_[cell]) {
+        Neighbour neighbour = make_neighbour(slot, centre_x, centre_z);
+        if (fabs(neighbour.offset[0]) > half_width || fabs(neighbour.offset[2]) > half_length || !pred(neighbour)) {
+          continue;
+        }
+        if (count == static_cast<int>(out.size())) {
+          return false;
+        }
+        out[count++] = neighbour;
+      }
+      return true;
+    });
+    return count;
+  }
+
+  // Finds the (up to) out.size() entities nearest to centre, no further than max_radius away, for which pred returns
+  // true. The results are sorted nearest first. We search outwards a ring of cells at a time, and stop as soon as no
+  // closer entity could be found.
+  template<typename Pred>
+  int find_nearest(fw::Vector const &centre, float max_radius, Pred pred, std::span<Neighbour> out) const {
+    if (out.empty()) {
+      return 0;
+    }
+
+    const int centre_x = static_cast<int>(floor(centre[0] / cell_size_));
+    const int centre_z = static_cast<int>(floor(centre[2] / cell_size_));
+    const int max_ring = std::min(
+        static_cast<int>(ceil(max_radius / cell_size_)), (std::min(cells_width_, cells_length_) - 1) / 2);
+
+    int count = 0;
+    for (int ring = 0; ring <= max_ring; ring++) {
+      for (int z = centre_z - ring; z <= centre_z + ring; z++) {
+        const int row = fw::constrain(z, cells_length_) * cells_width_;
+        const bool edge_row = (z == centre_z - ring || z == centre_z + ring);
+        for (int x = centre_x - ring; x <= centre_x + ring; x += (edge_row || ring == 0 ? 1 : ring * 2)) {
+          for (int slot : cells_[row + fw::constrain(x, cells_width_)]) {
+            Neighbour neighbour = make_neighbour(slot, centre[0], centre[2]);
+            if (neighbour.distance <= max_radius && pred(neighbour)) {
+              insert_sorted(neighbour, out, count);
+            }
+          }
+        }
+      }
+
+      // Everything in the next ring is at least this far away.
+      if (count == static_cast<int>(out.size()) && out[count - 1].distance <= ring * cell_size_) {
+        break;
+      }
+    }
+    return count;
+  }
+};
+
+}
@@ -13,6 +13,7 @@
 #include <game/entities/moveable_component.h>
 #include <game/entities/projectile_component.h>
 #include <game/entities/audio_component.h>
+#include <game/simulation/snapshot.h>
 #include <game/world/world.h>
 #include <game/world/terrain.h>
 
@@ -22,7 +23,7 @@ namespace ent {
 ENT_COMPONENT_REGISTER("Weapon", WeaponComponent);
 
 WeaponComponent::WeaponComponent() :
-    time_to_fire_(0.0f) {
+    time_to_fire_(0.0f), range_(10.0f), planned_move_(PlannedMove::kNone), planned_fire_(false) {
 }
 
 WeaponComponent::~WeaponComponent() {
@@ -48,7 +49,23 @@ void WeaponComponent::apply_template(fw::lua::Value tmpl) {
   }
 }
 
+EntityComponent *WeaponComponent::clone() const {
+  WeaponComponent *comp = new WeaponComponent();
+  comp->fire_entity_name_ = fire_entity_name_;
+  comp->fire_direction_ = fire_direction_;
+  comp->range_ = range_;
+  return comp;
+}
+
 void WeaponComponent::update(float dt) {
+  plan_update(dt);
+  commit_update();
+}
+
+void WeaponComponent::plan_update(float dt) {
+  planned_move_ = PlannedMove::kNone;
+  planned_fire_ = false;
+
   time_to_fire_ -= dt;
   if (time_to_fire_ < 0)
     time_to_fire_ = 0.0f;
@@ -63,26 +80,68 @@ void WeaponComponent::update(float dt) {
     if (our_pos == nullptr || their_pos == nullptr)
       return;
 
+    // We only read positions here (hence get_position(false)), see MoveableComponent::plan_update.
     bool need_fire = true;
     if (our_moveable != nullptr) {
       float wrap_x = game::World::get_instance()->get_terrain()->get_width();
       float wrap_z = game::World::get_instance()->get_terrain()->get_length();
-      fw::Vector goal = fw::get_direction_to(our_pos->get_position(), their_pos->get_position(), wrap_x, wrap_z);
+      fw::Vector goal = fw::get_direction_to(
+          our_pos->get_position(false), their_pos->get_position(false), wrap_x, wrap_z);
       if (goal.length() > range_) {
-        our_moveable->set_goal(their_pos->get_position());
+        planned_move_ = PlannedMove::kMoveToTarget;
+        planned_goal_ = their_pos->get_position(false);
         need_fire = false;
       } else {
-        our_moveable->stop();
+        planned_move_ = PlannedMove::kStop;
       }
     }
 
     if (need_fire && time_to_fire_ <= 0.0f) {
-      fire();
+      planned_fire_ = true;
       time_to_fire_ = 5.0f;
     }
   }
 }
 
+void WeaponComponent::commit_update() {
+  if (planned_move_ != PlannedMove::kNone) {
+    std::shared_ptr<ent::Entity> entity(entity_);
+    MoveableComponent *our_moveable = entity->get_component<MoveableComponent>();
+    if (planned_move_ == PlannedMove::kMoveToTarget) {
+      our_moveable->set_goal(planned_goal_);
+    } else {
+      our_moveable->stop();
+    }
+    planned_move_ = PlannedMove::kNone;
+  }
+
+  if (planned_fire_) {
+    fire();
+    planned_fire_ = false;
+  }
+}
+
+void WeaponComponent::write_snapshot(fw::net::PacketBuffer &buffer) const {
+  // Only entities that are shared with our peers (i.e. have an identifier) can be targeted, so that's what we save.
+  std::shared_ptr<Entity> target = target_.lock();
+  entity_id target_id = target ? target->get_id() : 0;
+  buffer << fw::net::compact(target_id);
+  game::write_raw(buffer, time_to_fire_);
+}
+
+void WeaponComponent::read_snapshot(fw::net::PacketBuffer &buffer) {
+  entity_id target_id;
+  buffer >> fw::net::compact(target_id);
+  game::read_raw(buffer, time_to_fire_);
+
+  target_.reset();
+  if (target_id != 0) {
+    target_ = std::shared_ptr<Entity>(entity_)->get_manager()->get_entity(target_id);
+  }
+  planned_move_ = PlannedMove::kNone;
+  planned_fire_ = false;
+}
+
 void WeaponComponent::fire() {
   std::shared_ptr<ent::Entity> entity(entity_);
   // TODO: entity_id
@@ -2,31 +2,57 @@
 
 #include <framework/math.h>
 
+#include <game/entities/component_store.h>
 #include <game/entities/entity.h>
 
 namespace ent {
 
 // This component is attached to entities that have weapons and can shoot other entities.
-class WeaponComponent: public EntityComponent {
+class WeaponComponent final: public EntityComponent {
 private:
+  // What plan_update decided we should do with our MoveableComponent.
+  enum class PlannedMove {
+    kNone,
+    kMoveToTarget,
+    kStop,
+  };
+
   std::weak_ptr<Entity> target_;
   std::string fire_entity_name_;
   fw::Vector fire_direction_;
   float time_to_fire_;
   float range_;
 
+  // The result of plan_update, which commit_update applies.
+  PlannedMove planned_move_;
+  fw::Vector planned_goal_;
+  bool planned_fire_;
+
   void fire();
 
 public:
+  ENT_COMPONENT_STORE(WeaponComponent);
+
   static const int identifier = 500;
 
   WeaponComponent();
   virtual ~WeaponComponent();
 
   void apply_template(fw::lua::Value tmpl) override;
+  EntityComponent *clone() const override;
 
   virtual void update(float dt);
 
+  // Like MoveableComponent, update() is split in two so the EntityManager can run the targeting for every weapon in
+  // parallel. plan_update works out whether we need to move closer to our target or fire at it, and commit_update
+  // actually does it (which may create a new projectile Entity, so must happen on the update thread).
+  void plan_update(float dt);
+  void commit_update();
+
+  bool has_system() const override {
+    return true;
+  }
+
   void set_target(std::weak_ptr<Entity> target) {
     target_ = target;
   }
@@ -37,6 +63,17 @@ public:
     return target_;
   }
 
+  // Sets what we fire, and which way it's facing when we fire it. These normally come from our template's
+  // "FireEntity" and "FireDirection".
+  void set_fire_entity(std::string const &template_name, fw::Vector const &direction) {
+    fire_entity_name_ = template_name;
+    fire_direction_ = direction;
+  }
+
+  // Saves and restores our state in a snapshot, see EntityManager::write_snapshot().
+  void write_snapshot(fw::net::PacketBuffer &buffer) const;
+  void read_snapshot(fw::net::PacketBuffer &buffer);
+
   virtual int get_identifier() {
     return identifier;
   }
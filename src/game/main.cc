@@ -6,9 +6,12 @@
 #include <framework/settings.h>
 #include <framework/logging.h>
 #include <framework/misc.h>
+#include <framework/paths.h>
 
 #include <game/application.h>
+#include <game/replay_application.h>
 #include <game/settings.h>
+#include <game/world/packed_map.h>
 
 void display_exception(std::string const &msg);
 
@@ -24,8 +27,37 @@ int main(int argc, char** argv) {
       return 1;
     }
 
-    game::Application app;
-    new fw::Framework(&app);
+    // With --convert-maps, we just convert the maps and exit.
+    if (fw::Settings::get<bool>("convert-maps")) {
+      auto convert_status = game::ConvertAllMaps();
+      if (!convert_status.ok()) {
+        LOG(ERR) << convert_status;
+        return 1;
+      }
+      return 0;
+    }
+
+    // With --replay and --check-replay-threads, we check that the replay comes out the same with each number of
+    // threads, and exit.
+    std::string replay_file = fw::Settings::get<std::string>("replay");
+    std::string check_replay_threads = fw::Settings::get<std::string>("check-replay-threads");
+    if (!replay_file.empty() && !check_replay_threads.empty()) {
+      auto check_status = game::CheckReplayThreads(fw::resolve(replay_file), check_replay_threads);
+      if (!check_status.ok()) {
+        LOG(ERR) << check_status;
+        return 1;
+      }
+      return 0;
+    }
+
+    // With --replay, we play the replay back without graphics instead of running the game.
+    std::unique_ptr<fw::BaseApp> app;
+    if (replay_file.empty()) {
+      app = std::make_unique<game::Application>();
+    } else {
+      app = std::make_unique<game::ReplayApplication>(fw::resolve(replay_file));
+    }
+    new fw::Framework(app.get());
     auto continue_or_status = fw::Framework::get_instance()->initialize("Ravaged Planet");
     if (!continue_or_status.ok()) {
       LOG(ERR) << continue_or_status.status();
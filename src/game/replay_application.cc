@@ -0,0 +1,261 @@
+#include <game/replay_application.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+
+#include <framework/framework.h>
+#include <framework/logging.h>
+#include <framework/settings.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <game/entities/entity_manager.h>
+#include <game/simulation/commands.h>
+#include <game/simulation/simulation_thread.h>
+#include <game/simulation/snapshot.h>
+#include <game/world/headless_world.h>
+
+namespace game {
+
+namespace {
+
+// The entities are updated in the same frames as in the game (see TurnHandoff), so a turn is however many of these fit
+// in it.
+const float FRAME_MS = static_cast<float>(kFrameMs);
+
+// We play turns for this long each update, before we give the Framework a chance to do its thing (and notice if
+// we've been asked to exit).
+const std::chrono::milliseconds PLAYBACK_SLICE(100);
+
+struct TurnStateHash {
+  turn_id turn;
+  uint64_t hash;
+};
+
+// Plays back the replay in a new process with the given number of entity-update-threads, and reads back the state
+// hashes it wrote.
+fw::StatusOr<std::vector<TurnStateHash>> PlayWithThreads(std::filesystem::path const &path, int num_threads) {
+  std::filesystem::path hashes_path =
+      std::filesystem::temp_directory_path() / absl::StrCat("replay-state-hashes-", num_threads, ".txt");
+  std::filesystem::remove(hashes_path);
+
+  std::string command = absl::StrCat(
+      "\"", fw::Settings::get_executable_path().string(), "\" --replay \"", path.string(),
+      "\" --entity-systems --entity-update-threads ", num_threads, " --replay-state-hashes \"",
+      hashes_path.string(), "\"");
+#if defined(_WIN32)
+  // cmd.exe strips the outer quotes off the whole command, so it needs another pair.
+  command = absl::StrCat("\"", command, "\"");
+#endif
+  LOG(INFO) << "playing back with " << num_threads << " entity update thread(s)";
+  const int exit_code = std::system(command.c_str());
+  if (exit_code != 0) {
+    return fw::ErrorStatus("playing back with ") << num_threads << " thread(s) failed: " << exit_code;
+  }
+
+  std::ifstream ins(hashes_path);
+  if (!ins) {
+    return fw::ErrorStatus("playing back with ") << num_threads << " thread(s) didn't write any state hashes";
+  }
+  std::vector<TurnStateHash> hashes;
+  TurnStateHash hash;
+  while (ins >> hash.turn >> hash.hash) {
+    hashes.push_back(hash);
+  }
+  ins.close();
+  std::filesystem::remove(hashes_path);
+  return hashes;
+}
+
+}
+
+ReplayApplication::ReplayApplication(std::filesystem::path const &path) :
+    framework_(nullptr), path_(path), finished_(false), pending_ms_(0.0f), snapshot_interval_(0), num_snapshots_(0),
+    max_snapshot_bytes_(0), snapshot_write_ms_(0.0f), snapshot_read_ms_(0.0f), num_turns_(0), num_commands_(0),
+    num_frames_(0) {
+}
+
+ReplayApplication::~ReplayApplication() {
+}
+
+fw::Status ReplayApplication::initialize(fw::Framework *framework) {
+  framework_ = framework;
+
+  ASSIGN_OR_RETURN(reader_, ReplayReader::open(path_));
+  ReplayHeader const &header = reader_->get_header();
+  LOG(INFO) << "playing back " << path_.string() << ": " << header.map_name << " with " << header.players.size()
+            << " player(s)";
+  SimulationThread::get_instance()->start_playback(header);
+
+  auto world_reader = std::make_shared<HeadlessWorldReader>();
+  RETURN_IF_ERROR(world_reader->Read(header.map_name));
+  world_ = std::make_unique<HeadlessWorld>(world_reader);
+  world_->initialize();
+
+  std::string state_hashes_file = fw::Settings::get<std::string>("replay-state-hashes");
+  if (!state_hashes_file.empty()) {
+    state_hashes_.open(state_hashes_file);
+    if (!state_hashes_) {
+      return fw::ErrorStatus("couldn't open ") << state_hashes_file;
+    }
+  }
+  snapshot_interval_ = fw::Settings::get<int>("replay-snapshot-interval");
+
+  start_time_ = fw::Clock::now();
+  return fw::OkStatus();
+}
+
+void ReplayApplication::destroy() {
+  if (world_) {
+    world_->destroy();
+  }
+}
+
+void ReplayApplication::update(float) {
+  if (finished_) {
+    return;
+  }
+
+  const fw::Clock::time_point slice_end = fw::Clock::now() + PLAYBACK_SLICE;
+  while (fw::Clock::now() < slice_end) {
+    auto has_turn = play_turn();
+    if (!has_turn.ok()) {
+      LOG(ERR) << "error playing back replay: " << has_turn.status();
+      finish();
+      return;
+    }
+    if (!*has_turn) {
+      finish();
+      return;
+    }
+  }
+}
+
+fw::StatusOr<bool> ReplayApplication::play_turn() {
+  ASSIGN_OR_RETURN(bool has_turn, reader_->next_turn(turn_));
+  if (!has_turn) {
+    return false;
+  }
+
+  // The commands were recorded in the order they were executed, so we can just run them.
+  for (std::shared_ptr<Command> &cmd : turn_.commands) {
+    cmd->execute();
+  }
+  num_turns_++;
+  num_commands_ += static_cast<int>(turn_.commands.size());
+
+  ent::EntityManager *entities = world_->get_entity_manager();
+  pending_ms_ += static_cast<float>(turn_.turn_length_ms);
+  while (pending_ms_ >= FRAME_MS) {
+    entities->update(FRAME_MS / 1000.0f);
+    pending_ms_ -= FRAME_MS;
+    num_frames_++;
+  }
+  if (state_hashes_.is_open()) {
+    state_hashes_ << turn_.turn << " " << entities->get_state_hash().get() << "\n";
+  }
+  if (snapshot_interval_ > 0 && num_turns_ % snapshot_interval_ == 0) {
+    RETURN_IF_ERROR(check_snapshot());
+  }
+  return true;
+}
+
+fw::Status ReplayApplication::check_snapshot() {
+  ent::EntityManager *entities = world_->get_entity_manager();
+  const std::string expected = entities->write_state_dump();
+
+  fw::Timer write_tmr;
+  write_tmr.start();
+  Snapshot snapshot;
+  entities->write_snapshot(snapshot);
+  snapshot.finish();
+  write_tmr.stop();
+
+  fw::Timer read_tmr;
+  read_tmr.start();
+  RETURN_IF_ERROR(entities->read_snapshot(snapshot));
+  read_tmr.stop();
+
+  // The dump has the state hash in it as well, so this checks everything that our peers would check.
+  if (entities->write_state_dump() != expected) {
+    return fw::ErrorStatus("restoring a snapshot after turn ") << turn_.turn << " changed the entities (state hash "
+                                                               << entities->get_state_hash().get() << ")";
+  }
+
+  num_snapshots_++;
+  max_snapshot_bytes_ = std::max(max_snapshot_bytes_, snapshot.get_bytes().size());
+  snapshot_write_ms_ += write_tmr.get_total_time() * 1000.0f;
+  snapshot_read_ms_ += read_tmr.get_total_time() * 1000.0f;
+  return fw::OkStatus();
+}
+
+void ReplayApplication::finish() {
+  finished_ = true;
+
+  const float wall_seconds = std::chrono::duration<float>(fw::Clock::now() - start_time_).count();
+  const float game_seconds = num_frames_ * FRAME_MS / 1000.0f;
+  LOG(INFO) << "replay finished: " << num_turns_ << " turns, " << num_commands_ << " commands, " << game_seconds
+            << "s of game time in " << wall_seconds << "s (" << (game_seconds / std::max(wall_seconds, 0.001f))
+            << "x)";
+
+  if (num_snapshots_ > 0) {
+    LOG(INFO) << "restored " << num_snapshots_ << " snapshot(s), up to " << max_snapshot_bytes_ << " bytes, in "
+              << (snapshot_write_ms_ / num_snapshots_) << "ms to write and " << (snapshot_read_ms_ / num_snapshots_)
+              << "ms to read on average";
+  }
+
+  // Playing the same replay twice should always end up in the same place (with or without snapshots).
+  LOG(INFO) << "final state hash: " << world_->get_entity_manager()->get_state_hash().get();
+  if (state_hashes_.is_open()) {
+    state_hashes_.close();
+  }
+
+  framework_->exit();
+}
+
+fw::Status CheckReplayThreads(std::filesystem::path const &path, std::string const &thread_counts) {
+  std::vector<int> counts;
+  std::vector<std::string> parts = absl::StrSplit(thread_counts, ",");
+  for (std::string const &str : parts) {
+    int count;
+    if (!absl::SimpleAtoi(str, &count) || count < 0) {
+      return fw::ErrorStatus("invalid number of threads: ") << str;
+    }
+    counts.push_back(count);
+  }
+  if (counts.size() < 2) {
+    return fw::ErrorStatus("need at least two numbers of threads to compare, got: ") << thread_counts;
+  }
+
+  ASSIGN_OR_RETURN(std::vector<TurnStateHash> expected, PlayWithThreads(path, counts[0]));
+  if (expected.empty()) {
+    return fw::ErrorStatus("replay has no turns: ") << path.string();
+  }
+  for (size_t i = 1; i < counts.size(); i++) {
+    ASSIGN_OR_RETURN(std::vector<TurnStateHash> actual, PlayWithThreads(path, counts[i]));
+    if (actual.size() != expected.size()) {
+      return fw::ErrorStatus("played ") << actual.size() << " turns with " << counts[i] << " thread(s), but "
+                                        << expected.size() << " with " << counts[0];
+    }
+    for (size_t j = 0; j < expected.size(); j++) {
+      if (actual[j].turn != expected[j].turn || actual[j].hash != expected[j].hash) {
+        return fw::ErrorStatus("state hash after turn ") << expected[j].turn << " is " << actual[j].hash
+                                                         << " with " << counts[i] << " thread(s), but "
+                                                         << expected[j].hash << " with " << counts[0];
+      }
+    }
+  }
+
+  LOG(INFO) << "replay came out the same with " << thread_counts << " thread(s): " << expected.size()
+            << " turns, final state hash " << expected.back().hash;
+  return fw::OkStatus();
+}
+
+}
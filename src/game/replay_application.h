@@ -0,0 +1,76 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <framework/framework.h>
+#include <framework/status.h>
+#include <framework/timer.h>
+
+#include <game/simulation/replay.h>
+
+namespace game {
+class HeadlessWorld;
+
+// Plays back a replay without graphics, as fast as we can, and then exits. This is what we run instead of the
+// Application when you pass --replay, e.g. to see how long a long game takes to simulate, or to reproduce a bug.
+class ReplayApplication: public fw::BaseApp {
+public:
+  ReplayApplication(std::filesystem::path const &path);
+  ~ReplayApplication();
+
+  bool wants_graphics() override {
+    return false;
+  }
+
+  fw::Status initialize(fw::Framework *framework) override;
+  void destroy() override;
+  void update(float dt) override;
+
+private:
+  fw::Framework *framework_;
+  std::filesystem::path path_;
+  std::unique_ptr<ReplayReader> reader_;
+  std::unique_ptr<HeadlessWorld> world_;
+  bool finished_;
+
+  // The turn we're playing, and the game time we've got left to simulate (less than one frame's worth).
+  ReplayTurn turn_;
+  float pending_ms_;
+
+  // If --replay-state-hashes is set, we write the entities' state hash here after every turn.
+  std::ofstream state_hashes_;
+
+  // If --replay-snapshot-interval is set, we snapshot and restore the entities every this many turns. These are how
+  // many times we've done it, the biggest snapshot and the total time it took.
+  int snapshot_interval_;
+  int num_snapshots_;
+  std::size_t max_snapshot_bytes_;
+  float snapshot_write_ms_;
+  float snapshot_read_ms_;
+
+  fw::Clock::time_point start_time_;
+  int num_turns_;
+  int num_commands_;
+  int num_frames_;
+
+  // Plays the next turn of the replay. Returns false once there are no turns left.
+  fw::StatusOr<bool> play_turn();
+
+  // Writes a snapshot of the entities and reads it straight back (the same as a player joining the game now would),
+  // and returns an error if that changed anything.
+  fw::Status check_snapshot();
+
+  // Reports how we went, and exits.
+  void finish();
+};
+
+// Plays the given replay back once for each of the given (comma-separated) numbers of entity-update-threads, with
+// entity-systems on, and returns an error if the entities' state hash differs between them after any turn. Each one
+// is played back by a new process of our own, so each starts from scratch (the same as a peer would) and the only
+// difference between them is the number of threads. This is what --check-replay-threads does.
+fw::Status CheckReplayThreads(std::filesystem::path const &path, std::string const &thread_counts);
+
+}
@@ -1,13 +1,18 @@
 
 #include <framework/camera.h>
 #include <framework/framework.h>
+#include <framework/logging.h>
+#include <framework/paths.h>
 #include <framework/scenegraph.h>
+#include <framework/settings.h>
+#include <framework/timer.h>
 
 #include <game/world/terrain.h>
 #include <game/world/world.h>
 #include <game/world/world_reader.h>
 #include <game/simulation/simulation_thread.h>
 #include <game/simulation/player.h>
+#include <game/simulation/snapshot.h>
 #include <game/screens/hud/build_window.h>
 #include <game/screens/hud/minimap_window.h>
 #include <game/screens/hud/pause_window.h>
@@ -42,7 +47,13 @@ void GameScreen::show() {
     return;
   }
 
+  fw::Timer load_timer;
+  load_timer.start();
+
   std::shared_ptr<WorldReader> reader(new WorldReader());
+  reader->sig_progress.Connect([](float progress) {
+    LOG(DBG) << "loading world: " << static_cast<int>(progress * 100.0f) << "%";
+  });
   auto status = reader->Read(options_->map_name);
   if (!status.ok()) {
     // TODO: make this return the error the caller instead
@@ -52,12 +63,32 @@ void GameScreen::show() {
 
   // initialize the world
   world_->initialize();
+  load_timer.update();
+  LOG(INFO) << "loaded world in " << load_timer.get_total_time() * 1000.0f << "ms";
+
+  // Everything the terrain needs to draw itself has been enqueued by now, so this runs just before the first frame that
+  // has the whole world in it.
+  fw::Framework::get_instance()->get_scenegraph_manager()->enqueue([load_timer](fw::sg::Scenegraph&) mutable {
+    load_timer.stop();
+    LOG(INFO) << "time to first frame: " << load_timer.get_total_time() * 1000.0f << "ms";
+  });
 
   // notify all of the players that the world is loaded
   for(auto plyr : SimulationThread::get_instance()->get_players()) {
     plyr->world_loaded();
   }
 
+  // If we've been asked to start from a snapshot, now that the world's loaded we can restore it.
+  std::string snapshot_file = fw::Settings::get<std::string>("load-snapshot");
+  if (!snapshot_file.empty()) {
+    auto snapshot = Snapshot::load(fw::resolve(snapshot_file));
+    if (snapshot.ok()) {
+      SimulationThread::get_instance()->request_load_snapshot(*snapshot);
+    } else {
+      LOG(ERR) << "error loading snapshot: " << snapshot.status();
+    }
+  }
+
   // show the initial set of windows
 //  hud_chat->show();
   hud_minimap->show();
@@ -20,7 +20,66 @@ fw::Status settings_initialize(int argc, char** argv) {
       .add_setting<std::string>(
           "auto-login",
           "A string used to automatically log on to the server. The value is obfuscated.",
-          "");
+          "")
+      .add_setting<int>(
+          "pathing-threads",
+          "The number of threads to use for path-finding. 0 means pick based on the number of cores.",
+          0)
+      .add_setting<int>(
+          "flow-field-cache-size",
+          "The number of flow fields (used for moving large groups of units) to keep cached.",
+          8)
+      .add_setting<bool>(
+          "entity-systems",
+          "If true, positions, movement and weapons are updated in batches by type rather than entity by entity.",
+          false)
+      .add_setting<int>(
+          "loader-threads",
+          "The number of extra threads used to decode images and bake the terrain while a map loads. -1 means pick "
+          "based on the number of cores.",
+          -1)
+      .add_setting<int>(
+          "entity-update-threads",
+          "The number of extra threads used to update entities when entity-systems is on. -1 means pick based on the "
+          "number of cores.",
+          -1)
+      .add_setting<int>(
+          "desync-check-interval",
+          "Every this many turns, peers compare a hash of the game state to check they're still in sync. 0 turns "
+          "the check off.",
+          10)
+      .add_setting<std::string>(
+          "record-replay",
+          "If set, games are recorded to this file (relative to the data directory), so they can be played back with "
+          "--replay.",
+          "")
+      .add_setting<std::string>(
+          "replay",
+          "Plays back the given replay file without graphics, as fast as possible, then exits.",
+          "")
+      .add_setting<std::string>(
+          "replay-state-hashes",
+          "With --replay, writes the entities' state hash after every turn to this file.",
+          "")
+      .add_setting<std::string>(
+          "check-replay-threads",
+          "With --replay, plays the replay back once for each of these (comma-separated) numbers of "
+          "entity-update-threads, with entity-systems on, and checks that the entities come out exactly the same "
+          "after every turn. E.g. 0,1,2,4.",
+          "")
+      .add_setting<int>(
+          "replay-snapshot-interval",
+          "With --replay, every this many turns we snapshot the entities, restore them from the snapshot and check "
+          "that they come out exactly the same. 0 means never.",
+          0)
+      .add_setting<std::string>(
+          "load-snapshot",
+          "If set, the game starts from this snapshot (relative to the data directory) once the map has loaded.",
+          "")
+      .add_setting<bool>(
+          "convert-maps",
+          "Packs every map that's still a directory of loose files into a single .rpmap file, then exits.",
+          false);
 
   extra_settings.add_group("Keybindings", "Keybinding settings")
       .add_setting<std::string>(
@@ -32,7 +91,9 @@ fw::Status settings_initialize(int argc, char** argv) {
       .add_setting<std::string>(
           "bind.deselect", "Deselect all objects", "Right-Mouse")
       .add_setting<std::string>(
-          "bind.screenshot", "Take a screenshot", "Ctrl+S");
+          "bind.screenshot", "Take a screenshot", "Ctrl+S")
+      .add_setting<std::string>(
+          "bind.snapshot", "Save a snapshot of the game", "F5");
 
   return fw::Settings::initialize(extra_settings, argc, argv, "default.conf");
 }
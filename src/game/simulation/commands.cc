@@ -84,6 +84,9 @@ Command::Command(uint8_t player_no) {
 Command::~Command() {
 }
 
+void Command::quantize(int) {
+}
+
 //-------------------------------------------------------------------------
 
 ConnectPlayerCommand::ConnectPlayerCommand(uint8_t player_no) :
@@ -96,7 +99,8 @@ ConnectPlayerCommand::~ConnectPlayerCommand() {
 void ConnectPlayerCommand::serialize(fw::net::PacketBuffer &) {
 }
 
-void ConnectPlayerCommand::deserialize(fw::net::PacketBuffer &) {
+fw::Status ConnectPlayerCommand::deserialize(fw::net::PacketBuffer &) {
+  return fw::OkStatus();
 }
 
 void ConnectPlayerCommand::execute() {
@@ -119,6 +123,18 @@ ent::entity_id generate_entity_id() {
   return static_cast<ent::entity_id>((static_cast<uint32_t>(player_id) << 24) | entity_id);
 }
 
+void reserve_entity_id(ent::entity_id id) {
+  uint8_t player_id = SimulationThread::get_instance()->get_local_player()->get_player_no();
+  if ((static_cast<uint32_t>(id) >> 24) != player_id) {
+    return;
+  }
+
+  ent::entity_id entity_number = static_cast<ent::entity_id>(static_cast<uint32_t>(id) & 0x00ffffff);
+  ent::entity_id curr = g_next_entity_number.load();
+  while (curr < entity_number && !g_next_entity_number.compare_exchange_weak(curr, entity_number)) {
+  }
+}
+
 CreateEntityCommand::CreateEntityCommand(uint8_t player_no) :
     Command(player_no) {
   entity_id_ = generate_entity_id();
@@ -128,17 +144,23 @@ CreateEntityCommand::~CreateEntityCommand() {
 }
 
 void CreateEntityCommand::serialize(fw::net::PacketBuffer &buffer) {
-  buffer << entity_id_;
+  buffer << fw::net::compact(entity_id_);
   buffer << template_name;
   buffer << initial_position;
   buffer << initial_goal;
 }
 
-void CreateEntityCommand::deserialize(fw::net::PacketBuffer &buffer) {
-  buffer >> entity_id_;
+fw::Status CreateEntityCommand::deserialize(fw::net::PacketBuffer &buffer) {
+  buffer >> fw::net::compact(entity_id_);
   buffer >> template_name;
   buffer >> initial_position;
   buffer >> initial_goal;
+  return buffer.get_status();
+}
+
+void CreateEntityCommand::quantize(int position_exponent) {
+  initial_position = fw::net::quantize_position(initial_position, position_exponent);
+  initial_goal = fw::net::quantize_position(initial_goal, position_exponent);
 }
 
 void CreateEntityCommand::execute() {
@@ -172,23 +194,25 @@ OrderCommand::~OrderCommand() {
 }
 
 void OrderCommand::serialize(fw::net::PacketBuffer &buffer) {
-  buffer << Entity;
-  buffer << order->get_identifier();
+  buffer << fw::net::compact(Entity);
+  uint16_t order_id = order->get_identifier();
+  buffer << fw::net::compact(order_id);
   order->serialize(buffer);
 }
 
-void OrderCommand::deserialize(fw::net::PacketBuffer &buffer) {
-  buffer >> Entity;
+fw::Status OrderCommand::deserialize(fw::net::PacketBuffer &buffer) {
+  buffer >> fw::net::compact(Entity);
 
   uint16_t order_id;
-  buffer >> order_id;
+  buffer >> fw::net::compact(order_id);
+  RETURN_IF_ERROR(buffer.get_status());
 
-  // TODO: return error
-  auto order_or_status = CreateOrder(order_id);
-  if (order_or_status.ok()) {
-    order = *order_or_status;
-    order->deserialize(buffer);
-  }
+  ASSIGN_OR_RETURN(order, CreateOrder(order_id));
+  return order->deserialize(buffer);
+}
+
+void OrderCommand::quantize(int position_exponent) {
+  order->quantize(position_exponent);
 }
 
 void OrderCommand::execute() {
@@ -31,7 +31,14 @@ public:
   virtual ~Command();
 
   virtual void serialize(fw::net::PacketBuffer &buffer) = 0;
-  virtual void deserialize(fw::net::PacketBuffer &buffer) = 0;
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer) = 0;
+
+  /**
+   * Rounds any positions in this command to multiples of 2^position_exponent, which is what the compact wire encoding
+   * sends. We do this to every command before it's executed (whichever encoding our peers are using), so that we
+   * execute exactly the same command as they do.
+   */
+  virtual void quantize(int position_exponent);
 
   /** Gets an instance of the player who executed this command. */
   std::shared_ptr<Player> const &get_player() const {
@@ -58,7 +65,7 @@ public:
   virtual ~ConnectPlayerCommand();
 
   virtual void serialize(fw::net::PacketBuffer &buffer);
-  virtual void deserialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
 
   virtual void execute();
 
@@ -83,7 +90,8 @@ public:
   virtual ~CreateEntityCommand();
 
   virtual void serialize(fw::net::PacketBuffer &buffer);
-  virtual void deserialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
+  virtual void quantize(int position_exponent);
 
   virtual void execute();
 
@@ -104,7 +112,8 @@ public:
   virtual ~OrderCommand();
 
   virtual void serialize(fw::net::PacketBuffer &buffer);
-  virtual void deserialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
+  virtual void quantize(int position_exponent);
 
   virtual void execute();
 
@@ -118,6 +127,10 @@ public:
 fw::StatusOr<std::shared_ptr<Command>> CreateCommand(uint8_t id);
 fw::StatusOr<std::shared_ptr<Command>> CreateCommand(uint8_t id, uint8_t player_no);
 
+// Makes sure the entities we create from now on don't reuse the given identifier (e.g. it's one of ours that's just
+// been restored from a snapshot).
+void reserve_entity_id(ent::entity_id id);
+
 template<typename T>
 std::shared_ptr<T> create_command() {
   auto cmd = CreateCommand(T::identifier);
@@ -73,7 +73,11 @@ void Order::begin(std::weak_ptr<ent::Entity> const &ent) {
 void Order::serialize(fw::net::PacketBuffer &) {
 }
 
-void Order::deserialize(fw::net::PacketBuffer &) {
+fw::Status Order::deserialize(fw::net::PacketBuffer &) {
+  return fw::OkStatus();
+}
+
+void Order::quantize(int) {
 }
 
 //-------------------------------------------------------------------------
@@ -106,14 +110,18 @@ void BuildOrder::serialize(fw::net::PacketBuffer &buffer) {
   buffer << template_name;
 }
 
-void BuildOrder::deserialize(fw::net::PacketBuffer &buffer) {
+fw::Status BuildOrder::deserialize(fw::net::PacketBuffer &buffer) {
   buffer >> template_name;
+  return buffer.get_status();
 }
 
 //-------------------------------------------------------------------------
 
+// Groups of at least this many entities moving to the same goal will use a flow field instead of a path each.
+static const uint16_t FLOW_FIELD_MIN_GROUP_SIZE = 8;
+
 MoveOrder::MoveOrder() :
-    Order("moving") {
+    Order("moving"), group_size(1) {
 }
 
 MoveOrder::~MoveOrder() {
@@ -126,7 +134,7 @@ void MoveOrder::begin(std::weak_ptr<ent::Entity> const &ent) {
   // move towards the component, if we don't have a moveable component, nothing will happen.
   auto moveable = entity->get_component<ent::MoveableComponent>();
   if (moveable != nullptr) {
-    moveable->set_goal(goal);
+    moveable->set_goal(goal, false /* skip_pathing */, group_size >= FLOW_FIELD_MIN_GROUP_SIZE);
   }
 
   // if it has a builder component, then "move" commands actually just update the builder's target.
@@ -159,10 +167,17 @@ bool MoveOrder::is_complete() {
 
 void MoveOrder::serialize(fw::net::PacketBuffer &buffer) {
   buffer << goal;
+  buffer << fw::net::compact(group_size);
 }
 
-void MoveOrder::deserialize(fw::net::PacketBuffer &buffer) {
+fw::Status MoveOrder::deserialize(fw::net::PacketBuffer &buffer) {
   buffer >> goal;
+  buffer >> fw::net::compact(group_size);
+  return buffer.get_status();
+}
+
+void MoveOrder::quantize(int position_exponent) {
+  goal = fw::net::quantize_position(goal, position_exponent);
 }
 
 //-----------------------------------------------------------------------------
@@ -209,11 +224,12 @@ bool AttackOrder::is_complete() {
 }
 
 void AttackOrder::serialize(fw::net::PacketBuffer &buffer) {
-  buffer << target;
+  buffer << fw::net::compact(target);
 }
 
-void AttackOrder::deserialize(fw::net::PacketBuffer &buffer) {
-  buffer >> target;
+fw::Status AttackOrder::deserialize(fw::net::PacketBuffer &buffer) {
+  buffer >> fw::net::compact(target);
+  return buffer.get_status();
 }
 
 
@@ -36,7 +36,10 @@ public:
   virtual ~Order();
 
   virtual void serialize(fw::net::PacketBuffer &buffer);
-  virtual void deserialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
+
+  /** Rounds any positions to what the compact wire encoding can send (see Command::quantize). */
+  virtual void quantize(int position_exponent);
 
   /**
    * This is called by the orderable_component when this order hits the front of the queue for Entity. You can
@@ -78,7 +81,7 @@ public:
   bool is_complete() override;
 
   void serialize(fw::net::PacketBuffer &buffer) override;
-  void deserialize(fw::net::PacketBuffer &buffer) override;
+  fw::Status deserialize(fw::net::PacketBuffer &buffer) override;
 
   std::string template_name;
 
@@ -98,10 +101,15 @@ public:
   bool is_complete() override;
 
   void serialize(fw::net::PacketBuffer &buffer) override;
-  void deserialize(fw::net::PacketBuffer &buffer) override;
+  fw::Status deserialize(fw::net::PacketBuffer &buffer) override;
+  void quantize(int position_exponent) override;
 
   fw::Vector goal;
 
+  // The number of entities this order was issued to at once. Large groups follow a shared flow field to the goal
+  // rather than each searching for their own path.
+  uint16_t group_size;
+
   static const int identifier = 2;
   uint16_t get_identifier() const override {
     return identifier;
@@ -120,7 +128,7 @@ public:
   bool is_complete() override;
 
   void serialize(fw::net::PacketBuffer &buffer) override;
-  void deserialize(fw::net::PacketBuffer &buffer) override;
+  fw::Status deserialize(fw::net::PacketBuffer &buffer) override;
 
   // ID of the Entity we want to attack.
   ent::entity_id target;
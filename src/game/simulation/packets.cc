@@ -1,9 +1,17 @@
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <framework/net.h>
 #include <framework/packet_buffer.h>
 
 #include <game/simulation/packets.h>
 #include <game/simulation/commands.h>
+#include <game/simulation/orders.h>
 #include <game/simulation/player.h>
+#include <game/world/terrain.h>
+#include <game/world/world.h>
 
 namespace game {
 
@@ -12,10 +20,65 @@ PACKET_REGISTER(JoinResponsePacket);
 PACKET_REGISTER(ChatPacket);
 PACKET_REGISTER(StartGamePacket);
 PACKET_REGISTER(CommandPacket);
+PACKET_REGISTER(SnapshotPacket);
+PACKET_REGISTER(HeartbeatPacket);
+
+namespace {
+
+// The number of bits of a position on the map, see get_command_position_exponent().
+const int POSITION_BITS = 13;
+
+// The range of get_command_position_exponent(): frexp gives an exponent of 1 for the smallest maps, and 32 for the
+// biggest int (which rounds up to 2^31 as a float).
+const int MIN_POSITION_EXPONENT = 1 - POSITION_BITS;
+const int MAX_POSITION_EXPONENT = 32 - POSITION_BITS;
+
+uint8_t get_player_no(Command const &cmd) {
+  if (cmd.get_player() != nullptr) {
+    return cmd.get_player()->get_player_no();
+  }
+  return 0;
+}
+
+// Returns true if the given command is an OrderCommand from the given player, with the given order.
+bool is_same_order(std::shared_ptr<Command> const &cmd, OrderCommand const &first) {
+  if (cmd->get_identifier() != OrderCommand::identifier || cmd->get_player() != first.get_player()) {
+    return false;
+  }
+  return static_cast<OrderCommand const &>(*cmd).order == first.order;
+}
+
+}
+
+int get_command_position_exponent() {
+  World *world = World::get_instance();
+  if (world == nullptr || !world->get_terrain()) {
+    return fw::net::kDefaultPositionExponent;
+  }
+
+  // The smallest power of two that's at least the size of the map.
+  const int size = std::max(world->get_terrain()->get_width(), world->get_terrain()->get_length());
+  int exponent;
+  std::frexp(static_cast<float>(std::max(size - 1, 1)), &exponent);
+  return exponent - POSITION_BITS;
+}
+
+fw::Status read_command_position_exponent(fw::net::PacketBuffer &buffer) {
+  uint8_t value;
+  buffer >> value;
+  RETURN_IF_ERROR(buffer.get_status());
+
+  const int position_exponent = static_cast<int8_t>(value);
+  if (position_exponent < MIN_POSITION_EXPONENT || position_exponent > MAX_POSITION_EXPONENT) {
+    return fw::ErrorStatus("invalid position exponent ") << position_exponent;
+  }
+  buffer.set_position_exponent(position_exponent);
+  return fw::OkStatus();
+}
 
 //-------------------------------------------------------------------------
 
-JoinRequestPacket::JoinRequestPacket() : user_id_(-1) {
+JoinRequestPacket::JoinRequestPacket() : user_id_(-1), max_wire_version_(fw::net::kMaxWireVersion) {
 }
 
 JoinRequestPacket::~JoinRequestPacket() {
@@ -24,16 +87,23 @@ JoinRequestPacket::~JoinRequestPacket() {
 void JoinRequestPacket::serialize(fw::net::PacketBuffer &buffer) {
   buffer << user_id_;
   buffer << color_;
+  buffer << max_wire_version_;
 }
 
-void JoinRequestPacket::deserialize(fw::net::PacketBuffer &buffer) {
+fw::Status JoinRequestPacket::deserialize(fw::net::PacketBuffer &buffer) {
   buffer >> user_id_;
   buffer >> color_;
+  if (buffer.get_remaining() > 0) {
+    buffer >> max_wire_version_;
+  } else {
+    max_wire_version_ = fw::net::kWireVersionFixed;
+  }
+  return buffer.get_status();
 }
 
 //-------------------------------------------------------------------------
 
-JoinResponsePacket::JoinResponsePacket() {
+JoinResponsePacket::JoinResponsePacket() : wire_version_(fw::net::kWireVersionFixed) {
 }
 
 JoinResponsePacket::~JoinResponsePacket() {
@@ -41,28 +111,36 @@ JoinResponsePacket::~JoinResponsePacket() {
 
 void JoinResponsePacket::serialize(fw::net::PacketBuffer &buffer) {
   buffer << map_name_;
-  buffer << other_users_.size();
+  uint64_t num_other_users = other_users_.size();
+  buffer << fw::net::compact(num_other_users);
   for (uint32_t sess_id : other_users_) {
-    buffer << sess_id;
+    buffer << fw::net::compact(sess_id);
   }
   buffer << my_color_;
   buffer << your_color_;
+  buffer << wire_version_;
 }
 
-void JoinResponsePacket::deserialize(fw::net::PacketBuffer &buffer) {
-  typedef std::vector<std::string>::size_type size_type;
-
+fw::Status JoinResponsePacket::deserialize(fw::net::PacketBuffer &buffer) {
   buffer >> map_name_;
-  size_type num_other_users;
-  buffer >> num_other_users;
-  for (size_type i = 0; i < num_other_users; i++) {
+  uint64_t num_other_users;
+  buffer >> fw::net::compact(num_other_users);
+  for (uint64_t i = 0; i < num_other_users; i++) {
     uint32_t other_user;
-    buffer >> other_user;
+    buffer >> fw::net::compact(other_user);
+    // Don't trust num_other_users, it could be anything if the packet is corrupt.
+    RETURN_IF_ERROR(buffer.get_status());
 
     other_users_.push_back(other_user);
   }
   buffer >> my_color_;
   buffer >> your_color_;
+  if (buffer.get_remaining() > 0) {
+    buffer >> wire_version_;
+  } else {
+    wire_version_ = fw::net::kWireVersionFixed;
+  }
+  return buffer.get_status();
 }
 
 //-------------------------------------------------------------------------
@@ -77,8 +155,9 @@ void ChatPacket::serialize(fw::net::PacketBuffer &buffer) {
   buffer << msg_;
 }
 
-void ChatPacket::deserialize(fw::net::PacketBuffer &buffer) {
+fw::Status ChatPacket::deserialize(fw::net::PacketBuffer &buffer) {
   buffer >> msg_;
+  return buffer.get_status();
 }
 
 //-------------------------------------------------------------------------
@@ -92,35 +171,160 @@ StartGamePacket::~StartGamePacket() {
 void StartGamePacket::serialize(fw::net::PacketBuffer &) {
 }
 
-void StartGamePacket::deserialize(fw::net::PacketBuffer &) {
+fw::Status StartGamePacket::deserialize(fw::net::PacketBuffer &) {
+  return fw::OkStatus();
+}
+
+//----------------------------------------------------------------------------
+
+HeartbeatPacket::HeartbeatPacket() : execute_turn_(0), turn_length_ms_(0), state_hash_turn_(0), state_hash_(0) {
+}
+
+HeartbeatPacket::~HeartbeatPacket() {
+}
+
+void HeartbeatPacket::serialize(fw::net::PacketBuffer &buffer) {
+  buffer << fw::net::compact(execute_turn_);
+  buffer << fw::net::compact(turn_length_ms_);
+  buffer << fw::net::compact(state_hash_turn_);
+  if (state_hash_turn_ != 0) {
+    buffer << state_hash_;
+  }
+}
+
+fw::Status HeartbeatPacket::deserialize(fw::net::PacketBuffer &buffer) {
+  state_hash_ = 0;
+  buffer >> fw::net::compact(execute_turn_);
+  buffer >> fw::net::compact(turn_length_ms_);
+  buffer >> fw::net::compact(state_hash_turn_);
+  if (state_hash_turn_ != 0) {
+    buffer >> state_hash_;
+  }
+  return buffer.get_status();
+}
+
+//----------------------------------------------------------------------------
+
+TurnPackets::TurnPackets(
+    std::vector<std::shared_ptr<Command>> &commands, uint32_t execute_turn, uint16_t turn_length_ms,
+    uint32_t state_hash_turn, uint64_t state_hash) {
+  command_pkt_.set_commands(commands);
+  command_pkt_.set_execute_turn(execute_turn);
+  command_pkt_.set_turn_length(turn_length_ms);
+  command_pkt_.set_state_hash(state_hash_turn, state_hash);
+  heartbeat_pkt_.set_execute_turn(execute_turn);
+  heartbeat_pkt_.set_turn_length(turn_length_ms);
+  heartbeat_pkt_.set_state_hash(state_hash_turn, state_hash);
+
+  shared_command_pkt_ = std::make_unique<fw::net::SharedPacket>(command_pkt_);
+  shared_heartbeat_pkt_ = std::make_unique<fw::net::SharedPacket>(heartbeat_pkt_);
+}
+
+TurnPackets::~TurnPackets() {
+}
+
+void TurnPackets::send(fw::net::Peer &peer) {
+  if (command_pkt_.get_commands().empty()) {
+    if (command_pkt_.get_execute_turn() == 0) {
+      return;
+    }
+    if (peer.get_wire_version() >= fw::net::kWireVersionHeartbeat) {
+      peer.send(*shared_heartbeat_pkt_, kCommandChannel);
+      return;
+    }
+  }
+  peer.send(*shared_command_pkt_, kCommandChannel);
+}
+
+//----------------------------------------------------------------------------
+
+SnapshotPacket::SnapshotPacket() : total_size_(0), offset_(0) {
+}
+
+SnapshotPacket::~SnapshotPacket() {
+}
+
+void SnapshotPacket::serialize(fw::net::PacketBuffer &buffer) {
+  uint32_t size = static_cast<uint32_t>(bytes_.size());
+  buffer << total_size_;
+  buffer << offset_;
+  buffer << size;
+  buffer.add_bytes(bytes_.data(), bytes_.size());
+}
+
+fw::Status SnapshotPacket::deserialize(fw::net::PacketBuffer &buffer) {
+  uint32_t size;
+  buffer >> total_size_;
+  buffer >> offset_;
+  buffer >> size;
+  RETURN_IF_ERROR(buffer.get_status());
+  if (size > buffer.get_remaining() || offset_ > total_size_ || size > total_size_ - offset_) {
+    return fw::ErrorStatus("invalid snapshot chunk: ") << offset_ << " + " << size << " of " << total_size_;
+  }
+
+  bytes_.resize(size);
+  return buffer.get_bytes(bytes_.data(), size);
 }
 
 //----------------------------------------------------------------------------
 
-CommandPacket::CommandPacket() {
+CommandPacket::CommandPacket() : execute_turn_(0), turn_length_ms_(0), state_hash_turn_(0), state_hash_(0) {
 }
 
 CommandPacket::~CommandPacket() {
 }
 
 void CommandPacket::serialize(fw::net::PacketBuffer &buffer) {
+  if (buffer.get_wire_version() >= fw::net::kWireVersionLockstep) {
+    buffer << fw::net::compact(execute_turn_);
+    buffer << fw::net::compact(turn_length_ms_);
+    buffer << fw::net::compact(state_hash_turn_);
+    if (state_hash_turn_ != 0) {
+      buffer << state_hash_;
+    }
+  }
+
+  if (buffer.get_wire_version() >= fw::net::kWireVersionCompact) {
+    serialize_compact(buffer);
+  } else {
+    serialize_fixed(buffer);
+  }
+}
+
+fw::Status CommandPacket::deserialize(fw::net::PacketBuffer &buffer) {
+  execute_turn_ = 0;
+  turn_length_ms_ = 0;
+  state_hash_turn_ = 0;
+  state_hash_ = 0;
+  if (buffer.get_wire_version() >= fw::net::kWireVersionLockstep) {
+    buffer >> fw::net::compact(execute_turn_);
+    buffer >> fw::net::compact(turn_length_ms_);
+    buffer >> fw::net::compact(state_hash_turn_);
+    if (state_hash_turn_ != 0) {
+      buffer >> state_hash_;
+    }
+    RETURN_IF_ERROR(buffer.get_status());
+  }
+
+  if (buffer.get_wire_version() >= fw::net::kWireVersionCompact) {
+    return deserialize_compact(buffer);
+  } else {
+    return deserialize_fixed(buffer);
+  }
+}
+
+void CommandPacket::serialize_fixed(fw::net::PacketBuffer &buffer) {
   uint8_t num_commands = static_cast<uint8_t>(commands_.size());
   buffer << num_commands;
 
   for (std::shared_ptr<Command> &cmd : commands_) {
     buffer << cmd->get_identifier();
-
-    if (cmd->get_player() != nullptr) {
-      buffer << cmd->get_player()->get_player_no();
-    } else {
-      buffer << 0;
-    }
-
+    buffer << get_player_no(*cmd);
     cmd->serialize(buffer);
   }
 }
 
-void CommandPacket::deserialize(fw::net::PacketBuffer &buffer) {
+fw::Status CommandPacket::deserialize_fixed(fw::net::PacketBuffer &buffer) {
   uint8_t num_commands;
   buffer >> num_commands;
 
@@ -130,16 +334,114 @@ void CommandPacket::deserialize(fw::net::PacketBuffer &buffer) {
     uint8_t player_no;
     buffer >> id;
     buffer >> player_no;
+    RETURN_IF_ERROR(buffer.get_status());
+
+    // We can't skip over a command we don't understand (we don't know how long it is), so the whole packet is bad.
+    ASSIGN_OR_RETURN(std::shared_ptr<Command> cmd, CreateCommand(id, player_no));
+    RETURN_IF_ERROR(cmd->deserialize(buffer));
+    commands_.push_back(cmd);
+  }
+  return buffer.get_status();
+}
+
+void CommandPacket::serialize_compact(fw::net::PacketBuffer &buffer) {
+  const int position_exponent = get_command_position_exponent();
+  buffer.set_position_exponent(position_exponent);
+  buffer << static_cast<uint8_t>(static_cast<int8_t>(position_exponent));
+
+  uint32_t num_commands = static_cast<uint32_t>(commands_.size());
+  buffer << fw::net::compact(num_commands);
+
+  size_t i = 0;
+  while (i < commands_.size()) {
+    Command &cmd = *commands_[i];
+    buffer << cmd.get_identifier();
+    buffer << get_player_no(cmd);
+
+    if (cmd.get_identifier() != OrderCommand::identifier) {
+      cmd.serialize(buffer);
+      i++;
+      continue;
+    }
+
+    // Find the run of commands that share this order, and write all their entity ids followed by the order itself.
+    OrderCommand const &first = static_cast<OrderCommand const &>(cmd);
+    size_t end = i + 1;
+    while (end < commands_.size() && is_same_order(commands_[end], first)) {
+      end++;
+    }
+
+    uint32_t run_length = static_cast<uint32_t>(end - i);
+    buffer << fw::net::compact(run_length);
+    int64_t prev_entity_id = 0;
+    for (; i < end; i++) {
+      const int64_t entity_id = static_cast<OrderCommand const &>(*commands_[i]).Entity;
+      buffer.add_signed_varint(entity_id - prev_entity_id);
+      prev_entity_id = entity_id;
+    }
+
+    uint16_t order_id = first.order->get_identifier();
+    buffer << fw::net::compact(order_id);
+    first.order->serialize(buffer);
+  }
+}
+
+fw::Status CommandPacket::deserialize_compact(fw::net::PacketBuffer &buffer) {
+  RETURN_IF_ERROR(read_command_position_exponent(buffer));
+
+  uint32_t num_commands;
+  buffer >> fw::net::compact(num_commands);
+  RETURN_IF_ERROR(buffer.get_status());
+
+  commands_.clear();
+  while (commands_.size() < num_commands) {
+    uint8_t id;
+    uint8_t player_no;
+    buffer >> id;
+    buffer >> player_no;
+    RETURN_IF_ERROR(buffer.get_status());
+
+    if (id != OrderCommand::identifier) {
+      ASSIGN_OR_RETURN(std::shared_ptr<Command> cmd, CreateCommand(id, player_no));
+      RETURN_IF_ERROR(cmd->deserialize(buffer));
+      commands_.push_back(cmd);
+      continue;
+    }
+
+    uint32_t run_length;
+    buffer >> fw::net::compact(run_length);
+    RETURN_IF_ERROR(buffer.get_status());
+    if (run_length == 0 || run_length > num_commands - commands_.size()) {
+      return fw::ErrorStatus("invalid order run length ") << run_length << " (" << commands_.size() << " of "
+          << num_commands << " commands read)";
+    }
+
+    const size_t first = commands_.size();
+    int64_t entity_id = 0;
+    for (uint32_t i = 0; i < run_length; i++) {
+      int64_t delta;
+      buffer.read_signed_varint(delta);
+      RETURN_IF_ERROR(buffer.get_status());
+      entity_id += delta;
+      if (entity_id < 0 || entity_id > std::numeric_limits<ent::entity_id>::max()) {
+        return fw::ErrorStatus("entity id out of range: ") << entity_id;
+      }
+
+      ASSIGN_OR_RETURN(std::shared_ptr<Command> cmd, CreateCommand(id, player_no));
+      std::static_pointer_cast<OrderCommand>(cmd)->Entity = static_cast<ent::entity_id>(entity_id);
+      commands_.push_back(cmd);
+    }
 
-    auto cmd = CreateCommand(id, player_no);
-    if (!cmd.ok()) {
-      // TODO: return error
-      LOG(ERR) << "error deserializing command packet: " << cmd.status();
-    } else {
-      (*cmd)->deserialize(buffer);
-      commands_.push_back(*cmd);
+    uint16_t order_id;
+    buffer >> fw::net::compact(order_id);
+    RETURN_IF_ERROR(buffer.get_status());
+    ASSIGN_OR_RETURN(std::shared_ptr<Order> order, CreateOrder(order_id));
+    RETURN_IF_ERROR(order->deserialize(buffer));
+    for (size_t i = first; i < commands_.size(); i++) {
+      std::static_pointer_cast<OrderCommand>(commands_[i])->order = order;
     }
   }
+  return buffer.get_status();
 }
 
 }
@@ -3,18 +3,29 @@
 //
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include <framework/packet.h>
 #include <framework/color.h>
 
 namespace fw {
 namespace net {
 class PacketBuffer;
+class Peer;
+class SharedPacket;
 }
 }
 
 namespace game {
 class Command;
 
+// The ENet channels we send on. Commands, heartbeats and chat all go on the same channel, so that they arrive in order
+// and everything we send in a turn can go out together. Snapshots are big, so they have a channel of their own and
+// don't hold up the commands.
+constexpr int kCommandChannel = 0;
+constexpr int kSnapshotChannel = 1;
+
 /**
  * This is the first Packet you send to a Host when you want to join the game. we'll response with a join_response
  * detailing the players that already exist in the game, the initial state and so on.
@@ -23,10 +34,11 @@ class JoinRequestPacket: public fw::net::Packet {
 private:
   uint32_t user_id_;
   fw::Color color_;
+  uint8_t max_wire_version_;
 
 protected:
   virtual void serialize(fw::net::PacketBuffer &buffer);
-  virtual void deserialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
 
 public:
   JoinRequestPacket();
@@ -48,6 +60,12 @@ public:
     return color_;
   }
 
+  // The newest wire version the connecting player understands. This goes on the end of the packet, so players that
+  // don't know about it (and don't send it) get kWireVersionFixed.
+  uint8_t get_max_wire_version() const {
+    return max_wire_version_;
+  }
+
   static const int identifier = 1;
   virtual uint16_t get_identifier() const {
     return identifier;
@@ -61,10 +79,11 @@ private:
   std::vector<uint32_t> other_users_;
   fw::Color my_color_;
   fw::Color your_color_;
+  uint8_t wire_version_;
 
 protected:
   virtual void serialize(fw::net::PacketBuffer &buffer);
-  virtual void deserialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
 
 public:
   JoinResponsePacket();
@@ -98,6 +117,15 @@ public:
     your_color_ = col;
   }
 
+  // gets or sets the wire version we've chosen for the rest of the conversation (the newest one both of us support).
+  // Like JoinRequestPacket's max_wire_version, this is on the end so older players just ignore it.
+  uint8_t get_wire_version() const {
+    return wire_version_;
+  }
+  void set_wire_version(uint8_t value) {
+    wire_version_ = value;
+  }
+
   static const int identifier = 2;
   virtual uint16_t get_identifier() const {
     return identifier;
@@ -111,7 +139,7 @@ private:
 
 protected:
   virtual void serialize(fw::net::PacketBuffer &buffer);
-  virtual void deserialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
 
 public:
   ChatPacket();
@@ -134,7 +162,7 @@ public:
 class StartGamePacket: public fw::net::Packet {
 protected:
   virtual void serialize(fw::net::PacketBuffer &buffer);
-  virtual void deserialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
 
 public:
   StartGamePacket();
@@ -147,14 +175,30 @@ public:
 };
 
 // this Packet is sent at the end of each turn and notifies our Peer
-// of our commands that are queued for the next turn
+// of our commands that are queued for the next turn. In the compact encoding, a run of OrderCommands that share
+// the same order (i.e. a group of units that were all given the same order at once) is written as a single record,
+// with the order once and the list of entity ids delta-encoded.
+//
+// From kWireVersionLockstep, the packet also says which turn the commands execute on (the sender has nothing else for
+// us before then) and the turn length the sender would like, see fw::net::LockstepScheduler. An execute turn of zero
+// means the sender hasn't started the game yet, and the commands execute on our next turn. Every few turns, it also
+// carries the sender's state hash (see ent::EntityManager::get_state_hash()) for an earlier turn.
 class CommandPacket: public fw::net::Packet {
 private:
   std::vector<std::shared_ptr<Command>> commands_;
+  uint32_t execute_turn_;
+  uint16_t turn_length_ms_;
+  uint32_t state_hash_turn_;
+  uint64_t state_hash_;
+
+  void serialize_fixed(fw::net::PacketBuffer &buffer);
+  fw::Status deserialize_fixed(fw::net::PacketBuffer &buffer);
+  void serialize_compact(fw::net::PacketBuffer &buffer);
+  fw::Status deserialize_compact(fw::net::PacketBuffer &buffer);
 
 protected:
   virtual void serialize(fw::net::PacketBuffer &buffer);
-  virtual void deserialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
 
 public:
   CommandPacket();
@@ -167,10 +211,159 @@ public:
     return commands_;
   }
 
+  void set_execute_turn(uint32_t turn) {
+    execute_turn_ = turn;
+  }
+  uint32_t get_execute_turn() const {
+    return execute_turn_;
+  }
+
+  void set_turn_length(uint16_t ms) {
+    turn_length_ms_ = ms;
+  }
+  uint16_t get_turn_length() const {
+    return turn_length_ms_;
+  }
+
+  // The state hash at the end of the given turn, or a turn of zero if this packet doesn't have one.
+  void set_state_hash(uint32_t turn, uint64_t hash) {
+    state_hash_turn_ = turn;
+    state_hash_ = hash;
+  }
+  uint32_t get_state_hash_turn() const {
+    return state_hash_turn_;
+  }
+  uint64_t get_state_hash() const {
+    return state_hash_;
+  }
+
   static const int identifier = 5;
   virtual uint16_t get_identifier() const {
     return identifier;
   }
 };
 
+// Sent at the end of a turn instead of a CommandPacket when we haven't got any commands, which is most turns. It has
+// just the turn information from a CommandPacket: the turn we've got nothing for them before, the turn length we'd
+// like and (every few turns) our state hash. Only peers on kWireVersionHeartbeat or later get these.
+class HeartbeatPacket: public fw::net::Packet {
+private:
+  uint32_t execute_turn_;
+  uint16_t turn_length_ms_;
+  uint32_t state_hash_turn_;
+  uint64_t state_hash_;
+
+protected:
+  virtual void serialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
+
+public:
+  HeartbeatPacket();
+  virtual ~HeartbeatPacket();
+
+  void set_execute_turn(uint32_t turn) {
+    execute_turn_ = turn;
+  }
+  uint32_t get_execute_turn() const {
+    return execute_turn_;
+  }
+
+  void set_turn_length(uint16_t ms) {
+    turn_length_ms_ = ms;
+  }
+  uint16_t get_turn_length() const {
+    return turn_length_ms_;
+  }
+
+  void set_state_hash(uint32_t turn, uint64_t hash) {
+    state_hash_turn_ = turn;
+    state_hash_ = hash;
+  }
+  uint32_t get_state_hash_turn() const {
+    return state_hash_turn_;
+  }
+  uint64_t get_state_hash() const {
+    return state_hash_;
+  }
+
+  static const int identifier = 7;
+  virtual uint16_t get_identifier() const {
+    return identifier;
+  }
+};
+
+// What we send to every peer at the end of a turn: a CommandPacket with the commands we've posted, or a HeartbeatPacket
+// if we haven't posted any. Every peer gets exactly the same thing, so each packet is serialized once (per wire
+// version) however many peers there are, see fw::net::SharedPacket.
+class TurnPackets {
+private:
+  CommandPacket command_pkt_;
+  HeartbeatPacket heartbeat_pkt_;
+  std::unique_ptr<fw::net::SharedPacket> shared_command_pkt_;
+  std::unique_ptr<fw::net::SharedPacket> shared_heartbeat_pkt_;
+
+public:
+  // The commands execute on execute_turn, or on the next turn if it's zero (which it is until the game has started).
+  TurnPackets(
+      std::vector<std::shared_ptr<Command>> &commands, uint32_t execute_turn, uint16_t turn_length_ms,
+      uint32_t state_hash_turn, uint64_t state_hash);
+  TurnPackets(const TurnPackets&) = delete;
+  TurnPackets& operator=(const TurnPackets&) = delete;
+  ~TurnPackets();
+
+  // Sends whichever packet the given peer needs, if any: before the game has started, there's nothing to say if we
+  // haven't got any commands.
+  void send(fw::net::Peer &peer);
+};
+
+// A chunk of a snapshot (see game::Snapshot) that the host is sending to a player who's joined a game that's already
+// started. The chunks arrive in order on their own channel, one per turn, and once the player has all of them they
+// restore it.
+class SnapshotPacket: public fw::net::Packet {
+private:
+  uint32_t total_size_;
+  uint32_t offset_;
+  std::vector<uint8_t> bytes_;
+
+protected:
+  virtual void serialize(fw::net::PacketBuffer &buffer);
+  virtual fw::Status deserialize(fw::net::PacketBuffer &buffer);
+
+public:
+  SnapshotPacket();
+  virtual ~SnapshotPacket();
+
+  // The size of the whole snapshot, and where in it this chunk goes.
+  void set_total_size(uint32_t value) {
+    total_size_ = value;
+  }
+  uint32_t get_total_size() const {
+    return total_size_;
+  }
+  void set_offset(uint32_t value) {
+    offset_ = value;
+  }
+  uint32_t get_offset() const {
+    return offset_;
+  }
+
+  std::vector<uint8_t> &get_bytes() {
+    return bytes_;
+  }
+
+  static const int identifier = 6;
+  virtual uint16_t get_identifier() const {
+    return identifier;
+  }
+};
+
+// Gets the exponent that commands quantize their positions to. We split the map into 2^13 steps along its longest
+// side, so that any position on the map fits in a two-byte varint.
+int get_command_position_exponent();
+
+// Reads a position exponent (written as an int8) and sets it as buffer's position exponent. It comes from the wire (or
+// a file), so we fail if it's not one that get_command_position_exponent() could have returned: anything else would
+// turn perfectly good fixed-point positions into huge (or infinite) ones.
+fw::Status read_command_position_exponent(fw::net::PacketBuffer &buffer);
+
 }
@@ -28,7 +28,7 @@ void Player::update() {
 void Player::send_chat_msg(std::string const &) {
 }
 
-void Player::post_commands(std::vector<std::shared_ptr<Command>> &) {
+void Player::post_commands(TurnPackets &) {
 }
 
 void Player::world_loaded() {
@@ -6,6 +6,7 @@
 
 namespace game {
 class Command;
+class TurnPackets;
 
 extern std::vector<fw::Color> player_colors;
 
@@ -47,8 +48,11 @@ public:
   /** This is called just after the world has loaded, we can create our initial entities and stuff. */
   virtual void world_loaded();
 
-  /** Posts the given commands to this player for the next turn. */
-  virtual void post_commands(std::vector<std::shared_ptr<Command>> &commands);
+  /**
+   * Posts the commands we've got this turn to this player. The packets are shared by every player, so they're only
+   * serialized once.
+   */
+  virtual void post_commands(TurnPackets &packets);
 
   std::string get_user_name() const;
   uint32_t get_user_id() const {
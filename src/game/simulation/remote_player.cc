@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <string>
 
 #include <framework/net.h>
 #include <framework/logging.h>
@@ -13,6 +15,7 @@
 #include <game/simulation/packets.h>
 #include <game/simulation/simulation_thread.h>
 #include <game/simulation/commands.h>
+#include <game/simulation/snapshot.h>
 
 using namespace std::placeholders;
 
@@ -22,7 +25,8 @@ RemotePlayer::RemotePlayer(
     std::shared_ptr<fw::net::Host> const &host,
     std::shared_ptr<fw::net::Peer> const &peer,
     bool connected)
-    : host_(host), peer_(peer), connected_(connected) {
+    : host_(host), peer_(peer), connected_(connected), wire_version_(fw::net::kWireVersionFixed),
+      snapshot_received_(0) {
   peer->set_handler(std::bind(&RemotePlayer::packet_handler, this, _1));
 
   // give them a temporary username until the connection process has completed.
@@ -39,10 +43,23 @@ fw::StatusOr<std::shared_ptr<RemotePlayer>> RemotePlayer::connect(
   return std::make_shared<RemotePlayer>(host, peer, false);
 }
 
+fw::StatusOr<std::shared_ptr<RemotePlayer>> RemotePlayer::connect_confirmed(
+    std::shared_ptr<fw::net::Host> const &host, std::string address, uint8_t player_no) {
+  ASSIGN_OR_RETURN(auto peer, host->connect(address));
+
+  // We're "connected" already as far as the handshake goes, so update() won't send them a JoinRequestPacket.
+  auto player = std::make_shared<RemotePlayer>(host, peer, true);
+  player->player_no_ = player_no;
+  player->user_name_ = "Player " + std::to_string(player_no);
+  player->wire_version_ = fw::net::kMaxWireVersion;
+  peer->set_wire_version(player->wire_version_);
+  return player;
+}
+
 void RemotePlayer::send_chat_msg(std::string const &msg) {
   ChatPacket pkt;
   pkt.set_msg(msg);
-  peer_->send(pkt);
+  peer_->send(pkt, kCommandChannel);
 }
 
 // we need to send a Packet to our Peer and let them know we're ready to go
@@ -51,10 +68,12 @@ void RemotePlayer::local_player_is_ready() {
   peer_->send(pkt);
 }
 
-void RemotePlayer::post_commands(std::vector<std::shared_ptr<Command>> &commands) {
-  CommandPacket pkt;
-  pkt.set_commands(commands);
-  peer_->send(pkt);
+void RemotePlayer::post_commands(TurnPackets &packets) {
+  packets.send(*peer_);
+}
+
+bool RemotePlayer::is_lockstep() const {
+  return wire_version_ >= fw::net::kWireVersionLockstep;
 }
 
 // this is called whenever we receive a Packet from our Peer, we need to work out
@@ -76,6 +95,12 @@ void RemotePlayer::packet_handler(std::shared_ptr<fw::net::Packet> const &pkt) {
   case CommandPacket::identifier:
     pkt_command(pkt);
     break;
+  case HeartbeatPacket::identifier:
+    pkt_heartbeat(pkt);
+    break;
+  case SnapshotPacket::identifier:
+    pkt_snapshot(pkt);
+    break;
 
   default:
     LOG(WARN) << "  unknown packet type: " << pkt->get_identifier();
@@ -89,6 +114,7 @@ void RemotePlayer::pkt_join_req(std::shared_ptr<fw::net::Packet> pkt) {
   std::shared_ptr<JoinRequestPacket> req(std::dynamic_pointer_cast<JoinRequestPacket>(pkt));
   user_id_ = req->get_user_id();
   color_ = req->get_color();
+  wire_version_ = std::min(req->get_max_wire_version(), fw::net::kMaxWireVersion);
 
   // call the session and confirm the fact that this player is valid and that.
   std::shared_ptr<game::SessionRequest> sess_req = Session::get_instance()->confirm_player(
@@ -102,6 +128,12 @@ void RemotePlayer::pkt_join_resp(std::shared_ptr<fw::net::Packet> pkt) {
   std::shared_ptr<JoinResponsePacket> resp(std::dynamic_pointer_cast<JoinResponsePacket>(pkt));
 
   LOG(INFO) << "connected to host, map is: " << resp->get_map_name();
+
+  // Everything we send after this can use the wire version they've chosen (the response is always in
+  // kWireVersionFixed, since they don't switch until after they've sent it).
+  wire_version_ = std::min(resp->get_wire_version(), fw::net::kMaxWireVersion);
+  peer_->set_wire_version(wire_version_);
+  LOG(INFO) << "using wire version " << static_cast<int>(wire_version_);
   for (uint32_t other_user_id : resp->get_other_users()) {
     // the color that we sent will be echo'd back to us, usually
     color_ = resp->get_my_color();
@@ -159,15 +191,76 @@ void RemotePlayer::pkt_start_game(std::shared_ptr<fw::net::Packet> pkt) {
 }
 
 // this is sent to us at the beginning of the turn, we need to enqueue the commands
-// for the next turn.
+// for the turn they're due on.
 void RemotePlayer::pkt_command(std::shared_ptr<fw::net::Packet> pkt) {
   std::shared_ptr<CommandPacket> command_pkt(std::dynamic_pointer_cast<CommandPacket>(pkt));
+  if (command_pkt->get_state_hash_turn() != 0) {
+    SimulationThread::get_instance()->check_peer_state_hash(
+        player_no_, command_pkt->get_state_hash_turn(), command_pkt->get_state_hash());
+  }
+
+  if (command_pkt->get_execute_turn() != 0) {
+    SimulationThread::get_instance()->enqueue_peer_commands(
+        player_no_, command_pkt->get_execute_turn(), command_pkt->get_commands(), command_pkt->get_turn_length());
+    return;
+  }
+
   for (std::shared_ptr<Command> &cmd : command_pkt->get_commands()) {
     LOG(DBG) << "got command, id: " << static_cast<int>(cmd->get_identifier());
     SimulationThread::get_instance()->enqueue_command(cmd);
   }
 }
 
+// this is sent to us instead of a CommandPacket when our peer hasn't got any commands for a turn. It's just the same as
+// a CommandPacket with no commands in it.
+void RemotePlayer::pkt_heartbeat(std::shared_ptr<fw::net::Packet> pkt) {
+  std::shared_ptr<HeartbeatPacket> heartbeat_pkt(std::dynamic_pointer_cast<HeartbeatPacket>(pkt));
+  if (heartbeat_pkt->get_state_hash_turn() != 0) {
+    SimulationThread::get_instance()->check_peer_state_hash(
+        player_no_, heartbeat_pkt->get_state_hash_turn(), heartbeat_pkt->get_state_hash());
+  }
+
+  std::vector<std::shared_ptr<Command>> no_commands;
+  SimulationThread::get_instance()->enqueue_peer_commands(
+      player_no_, heartbeat_pkt->get_execute_turn(), no_commands, heartbeat_pkt->get_turn_length());
+}
+
+// this is sent to us by the host, a chunk at a time, when we join a game that's already started. Once we've got the
+// whole thing, we restore it.
+void RemotePlayer::pkt_snapshot(std::shared_ptr<fw::net::Packet> pkt) {
+  std::shared_ptr<SnapshotPacket> snapshot_pkt(std::dynamic_pointer_cast<SnapshotPacket>(pkt));
+  if (snapshot_pkt->get_offset() == 0) {
+    if (snapshot_pkt->get_total_size() > kMaxSnapshotSize) {
+      LOG(ERR) << "snapshot is too big: " << snapshot_pkt->get_total_size() << " bytes";
+      return;
+    }
+    snapshot_bytes_.resize(snapshot_pkt->get_total_size());
+    snapshot_received_ = 0;
+  }
+  if (snapshot_pkt->get_total_size() != snapshot_bytes_.size() || snapshot_pkt->get_offset() != snapshot_received_) {
+    LOG(ERR) << "unexpected snapshot chunk at " << snapshot_pkt->get_offset() << ", expected " << snapshot_received_;
+    return;
+  }
+
+  std::vector<uint8_t> &bytes = snapshot_pkt->get_bytes();
+  std::copy(bytes.begin(), bytes.end(), snapshot_bytes_.begin() + snapshot_received_);
+  snapshot_received_ += bytes.size();
+  if (snapshot_received_ < snapshot_bytes_.size()) {
+    return;
+  }
+
+  auto snapshot = std::make_shared<Snapshot>(std::move(snapshot_bytes_));
+  snapshot_bytes_.clear();
+  snapshot_received_ = 0;
+  auto status = snapshot->validate();
+  if (!status.ok()) {
+    LOG(ERR) << "invalid snapshot from player " << static_cast<int>(player_no_) << ": " << status;
+    return;
+  }
+  LOG(INFO) << "got snapshot from player " << static_cast<int>(player_no_) << ", restoring";
+  SimulationThread::get_instance()->request_load_snapshot(snapshot);
+}
+
 // checks whether the given color is already taken (ignoring the given player)
 bool color_already_taken(Player *except_for, fw::Color &col) {
   for (auto &plyr : SimulationThread::get_instance()->get_players()) {
@@ -212,6 +305,7 @@ void RemotePlayer::join_complete(SessionRequest &req) {
   resp.set_map_name(SimulationThread::get_instance()->get_map_name());
   resp.set_your_color(color_);
   resp.set_my_color(SimulationThread::get_instance()->get_local_player()->get_color());
+  resp.set_wire_version(wire_version_);
   for (auto plyr : SimulationThread::get_instance()->get_players()) {
     if (plyr.get() == this) {
       continue;
@@ -220,6 +314,12 @@ void RemotePlayer::join_complete(SessionRequest &req) {
     resp.get_other_users().push_back(plyr->get_user_id());
   }
   peer_->send(resp);
+  peer_->set_wire_version(wire_version_);
+
+  // If they've joined a game that's already going, they need to catch up with where we are.
+  if (SimulationThread::get_instance()->is_game_started()) {
+    SimulationThread::get_instance()->send_snapshot(player_no_);
+  }
 
   SimulationThread::get_instance()->sig_players_changed.Emit();
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <framework/status.h>
 
@@ -30,12 +31,25 @@ public:
   static fw::StatusOr<std::shared_ptr<RemotePlayer>> connect(
       std::shared_ptr<fw::net::Host> const &host, std::string address);
 
+  // Connects to a player who's joined the game without going through the session server (e.g. the players in the
+  // lockstep bench, which has no server to ask), as the given player_no. There's no join handshake: we talk to them in
+  // the newest wire version straight away.
+  static fw::StatusOr<std::shared_ptr<RemotePlayer>> connect_confirmed(
+      std::shared_ptr<fw::net::Host> const &host, std::string address, uint8_t player_no);
+
   // this is called when our local player is ready to start the game, we should notify
   // our Peer that we're ready.
   virtual void local_player_is_ready();
 
-  // posts the given commands to this player for the next turn
-  virtual void post_commands(std::vector<std::shared_ptr<Command>> &commands);
+  // sends this turn's commands (or heartbeat) to this player
+  virtual void post_commands(TurnPackets &packets);
+
+  // Returns true if this player sends us the turn their commands execute on, so we can keep in lockstep with them.
+  bool is_lockstep() const;
+
+  std::shared_ptr<fw::net::Peer> const &get_peer() const {
+    return peer_;
+  }
 
   virtual void update();
   virtual void send_chat_msg(std::string const &msg);
@@ -45,6 +59,13 @@ public:
   std::shared_ptr<fw::net::Peer> peer_;
   bool connected_;
 
+  // The wire version we agreed on in the join handshake, which we switch to once we've sent our JoinResponsePacket.
+  uint8_t wire_version_;
+
+  // The snapshot the host is sending us (if we've joined a game that's already started), and how much of it we've got.
+  std::vector<uint8_t> snapshot_bytes_;
+  std::size_t snapshot_received_;
+
   /** This is called whenever we receive a Packet from our Peer. */
   void packet_handler(std::shared_ptr<fw::net::Packet> const &pkt);
 
@@ -55,6 +76,8 @@ public:
   void pkt_chat(std::shared_ptr<fw::net::Packet> pkt);
   void pkt_start_game(std::shared_ptr<fw::net::Packet> pkt);
   void pkt_command(std::shared_ptr<fw::net::Packet> pkt);
+  void pkt_heartbeat(std::shared_ptr<fw::net::Packet> pkt);
+  void pkt_snapshot(std::shared_ptr<fw::net::Packet> pkt);
 
   // when we get a pkt_join, we ask the server to confirm the user. when the server
   // gets back to us, it'll call this method and we can respond to the original
@@ -0,0 +1,288 @@
+#include <game/simulation/replay.h>
+
+#include <framework/logging.h>
+#include <framework/packet_buffer.h>
+#include <framework/status.h>
+
+#include <game/simulation/commands.h>
+#include <game/simulation/packets.h>
+
+namespace game {
+
+namespace {
+
+// The first four bytes of a replay file ("RPRP" in little-endian), and the version of the format.
+const uint32_t REPLAY_MAGIC = 0x50525052;
+const uint32_t REPLAY_VERSION = 1;
+
+// We write out a chunk once it has this many turns in it, or once it's this big, whichever comes first.
+const int MAX_CHUNK_TURNS = 64;
+const std::size_t MAX_CHUNK_BYTES = 16 * 1024;
+
+// Anything bigger than this isn't a chunk we wrote.
+const uint32_t MAX_CHUNK_SIZE = 16 * 1024 * 1024;
+
+}
+
+ReplayPlayer::ReplayPlayer(ReplayPlayerInfo const &info) {
+  player_no_ = info.player_no;
+  user_name_ = info.user_name;
+  color_ = info.color;
+  is_ready_to_start_ = true;
+}
+
+ReplayPlayer::~ReplayPlayer() {
+}
+
+void ReplayPlayer::local_player_is_ready() {
+}
+
+//-------------------------------------------------------------------------
+
+ReplayWriter::ReplayWriter() : chunk_turns_(0), position_exponent_(0), next_turn_(0) {
+}
+
+ReplayWriter::~ReplayWriter() {
+  auto status = close();
+  if (!status.ok()) {
+    LOG(ERR) << "error closing replay: " << status;
+  }
+}
+
+fw::StatusOr<std::unique_ptr<ReplayWriter>> ReplayWriter::create(
+    std::filesystem::path const &path, ReplayHeader const &header) {
+  std::unique_ptr<ReplayWriter> writer(new ReplayWriter());
+  writer->outs_.open(path, std::ios::binary | std::ios::trunc);
+  if (!writer->outs_) {
+    return fw::ErrorStatus("error creating replay: ") << path.string();
+  }
+  writer->outs_.write(reinterpret_cast<char const *>(&REPLAY_MAGIC), sizeof(REPLAY_MAGIC));
+  writer->outs_.write(reinterpret_cast<char const *>(&REPLAY_VERSION), sizeof(REPLAY_VERSION));
+
+  fw::net::PacketBuffer chunk(kReplayChunkHeader, fw::net::kWireVersionCompact);
+  chunk << header.map_name;
+  chunk << header.seed;
+  chunk << header.local_player_no;
+  uint32_t num_players = static_cast<uint32_t>(header.players.size());
+  chunk << fw::net::compact(num_players);
+  for (ReplayPlayerInfo const &player : header.players) {
+    chunk << player.player_no;
+    chunk << player.user_name;
+    chunk << player.color;
+  }
+  RETURN_IF_ERROR(writer->write_chunk(chunk));
+
+  return writer;
+}
+
+fw::Status ReplayWriter::write_chunk(fw::net::PacketBuffer &chunk) {
+  const uint32_t size = static_cast<uint32_t>(chunk.get_size());
+  outs_.write(reinterpret_cast<char const *>(&size), sizeof(size));
+  outs_.write(reinterpret_cast<char const *>(chunk.get_buffer()), size);
+  outs_.flush();
+  if (!outs_) {
+    return fw::ErrorStatus("error writing replay");
+  }
+  return fw::OkStatus();
+}
+
+fw::Status ReplayWriter::flush_turns() {
+  if (!chunk_) {
+    return fw::OkStatus();
+  }
+
+  // A zero marks the end of the chunk (every turn is written as one more than its distance from the last).
+  uint32_t end = 0;
+  *chunk_ << fw::net::compact(end);
+  auto status = write_chunk(*chunk_);
+  chunk_.reset();
+  chunk_turns_ = 0;
+  return status;
+}
+
+fw::Status ReplayWriter::write_turn(
+    turn_id turn, uint32_t turn_length_ms, std::vector<std::shared_ptr<Command>> const &commands,
+    int position_exponent) {
+  if (!outs_.is_open()) {
+    return fw::ErrorStatus("replay is closed");
+  }
+  if (turn < next_turn_) {
+    return fw::ErrorStatus("replay turns must be in order, got turn ") << turn << " after " << (next_turn_ - 1);
+  }
+
+  // Positions in a chunk all have the same exponent, so if it changes (i.e. the map's just been loaded), we start a
+  // new chunk.
+  if (chunk_ && position_exponent != position_exponent_) {
+    RETURN_IF_ERROR(flush_turns());
+  }
+  if (!chunk_) {
+    chunk_ = std::make_unique<fw::net::PacketBuffer>(kReplayChunkTurns, fw::net::kWireVersionCompact);
+    chunk_->set_position_exponent(position_exponent);
+    *chunk_ << static_cast<uint8_t>(static_cast<int8_t>(position_exponent));
+    position_exponent_ = position_exponent;
+  }
+
+  uint32_t turn_delta = turn - next_turn_ + 1;
+  uint32_t num_commands = static_cast<uint32_t>(commands.size());
+  *chunk_ << fw::net::compact(turn_delta);
+  *chunk_ << fw::net::compact(turn_length_ms);
+  *chunk_ << fw::net::compact(num_commands);
+  for (std::shared_ptr<Command> const &cmd : commands) {
+    *chunk_ << cmd->get_identifier();
+    *chunk_ << static_cast<uint8_t>(cmd->get_player() == nullptr ? 0 : cmd->get_player()->get_player_no());
+    cmd->serialize(*chunk_);
+  }
+  next_turn_ = turn + 1;
+
+  chunk_turns_++;
+  if (chunk_turns_ >= MAX_CHUNK_TURNS || chunk_->get_size() >= MAX_CHUNK_BYTES) {
+    RETURN_IF_ERROR(flush_turns());
+  }
+  return fw::OkStatus();
+}
+
+fw::Status ReplayWriter::close() {
+  if (!outs_.is_open()) {
+    return fw::OkStatus();
+  }
+
+  RETURN_IF_ERROR(flush_turns());
+  fw::net::PacketBuffer chunk(kReplayChunkEnd, fw::net::kWireVersionCompact);
+  auto status = write_chunk(chunk);
+  outs_.close();
+  return status;
+}
+
+//-------------------------------------------------------------------------
+
+ReplayReader::ReplayReader() : finished_(false), next_turn_(0) {
+}
+
+ReplayReader::~ReplayReader() {
+}
+
+fw::StatusOr<std::unique_ptr<ReplayReader>> ReplayReader::open(std::filesystem::path const &path) {
+  std::unique_ptr<ReplayReader> reader(new ReplayReader());
+  reader->ins_.open(path, std::ios::binary);
+  if (!reader->ins_) {
+    return fw::ErrorStatus("error opening replay: ") << path.string();
+  }
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  reader->ins_.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  reader->ins_.read(reinterpret_cast<char *>(&version), sizeof(version));
+  if (!reader->ins_ || magic != REPLAY_MAGIC) {
+    return fw::ErrorStatus("not a replay file: ") << path.string();
+  }
+  if (version != REPLAY_VERSION) {
+    return fw::ErrorStatus("unsupported replay version ") << version << ": " << path.string();
+  }
+
+  ASSIGN_OR_RETURN(bool has_header, reader->read_chunk());
+  if (!has_header || reader->chunk_->get_packet_type() != kReplayChunkHeader) {
+    return fw::ErrorStatus("replay has no header: ") << path.string();
+  }
+
+  fw::net::PacketBuffer &chunk = *reader->chunk_;
+  ReplayHeader &header = reader->header_;
+  chunk >> header.map_name;
+  chunk >> header.seed;
+  chunk >> header.local_player_no;
+  uint32_t num_players;
+  chunk >> fw::net::compact(num_players);
+  RETURN_IF_ERROR(chunk.get_status());
+  for (uint32_t i = 0; i < num_players; i++) {
+    ReplayPlayerInfo player;
+    chunk >> player.player_no;
+    chunk >> player.user_name;
+    chunk >> player.color;
+    RETURN_IF_ERROR(chunk.get_status());
+    header.players.push_back(player);
+  }
+  reader->chunk_.reset();
+
+  return reader;
+}
+
+fw::StatusOr<bool> ReplayReader::read_chunk() {
+  chunk_.reset();
+
+  uint32_t size;
+  ins_.read(reinterpret_cast<char *>(&size), sizeof(size));
+  if (ins_.gcount() == 0 && ins_.eof()) {
+    return false;
+  }
+  if (!ins_ || size > MAX_CHUNK_SIZE) {
+    return fw::ErrorStatus("invalid replay chunk");
+  }
+
+  chunk_bytes_.resize(size);
+  ins_.read(reinterpret_cast<char *>(chunk_bytes_.data()), size);
+  if (!ins_) {
+    return fw::ErrorStatus("replay chunk is truncated");
+  }
+
+  chunk_ = std::make_unique<fw::net::PacketBuffer>(chunk_bytes_.data(), chunk_bytes_.size());
+  RETURN_IF_ERROR(chunk_->get_status());
+  return true;
+}
+
+fw::StatusOr<bool> ReplayReader::next_turn(ReplayTurn &turn) {
+  while (!finished_) {
+    if (!chunk_) {
+      ASSIGN_OR_RETURN(bool has_chunk, read_chunk());
+      if (!has_chunk) {
+        // The game didn't get to close the replay (e.g. it crashed), but everything up to here is still good.
+        LOG(WARN) << "replay has no end chunk, it may be truncated";
+        finished_ = true;
+        break;
+      }
+
+      if (chunk_->get_packet_type() == kReplayChunkEnd) {
+        finished_ = true;
+        break;
+      } else if (chunk_->get_packet_type() != kReplayChunkTurns) {
+        // Something from a newer version that we don't need to understand.
+        chunk_.reset();
+        continue;
+      }
+
+      RETURN_IF_ERROR(read_command_position_exponent(*chunk_));
+    }
+
+    fw::net::PacketBuffer &chunk = *chunk_;
+    uint32_t turn_delta;
+    chunk >> fw::net::compact(turn_delta);
+    RETURN_IF_ERROR(chunk.get_status());
+    if (turn_delta == 0) {
+      chunk_.reset();
+      continue;
+    }
+
+    turn.turn = next_turn_ + turn_delta - 1;
+    chunk >> fw::net::compact(turn.turn_length_ms);
+    uint32_t num_commands;
+    chunk >> fw::net::compact(num_commands);
+    RETURN_IF_ERROR(chunk.get_status());
+
+    turn.commands.clear();
+    for (uint32_t i = 0; i < num_commands; i++) {
+      uint8_t id;
+      uint8_t player_no;
+      chunk >> id;
+      chunk >> player_no;
+      RETURN_IF_ERROR(chunk.get_status());
+
+      ASSIGN_OR_RETURN(std::shared_ptr<Command> cmd, CreateCommand(id, player_no));
+      RETURN_IF_ERROR(cmd->deserialize(chunk));
+      turn.commands.push_back(cmd);
+    }
+    next_turn_ = turn.turn + 1;
+    return true;
+  }
+
+  return false;
+}
+
+}
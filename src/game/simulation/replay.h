@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <framework/color.h>
+#include <framework/packet_buffer.h>
+#include <framework/status.h>
+
+#include <game/simulation/player.h>
+#include <game/simulation/simulation_thread.h>
+
+namespace game {
+class Command;
+
+// A replay is everything we need to play a game back: the map, the random seed, the players and the commands that
+// were executed on each turn. Given the same map and the same commands on the same turns, the simulation does the
+// same thing, so that's all we need to record.
+//
+// The file starts with a magic number and a version, followed by a series of chunks. Each chunk is a uint32 length
+// and then the bytes of a fw::net::PacketBuffer, whose packet type is the kind of chunk. The first chunk is the
+// header (see ReplayHeader), followed by any number of chunks of turns, and finally an end chunk. Commands are
+// written with Command::serialize, in the compact wire encoding. We write out a chunk every few dozen turns, so if
+// the game crashes we only lose the last few seconds.
+constexpr uint16_t kReplayChunkHeader = 1;
+constexpr uint16_t kReplayChunkTurns = 2;
+constexpr uint16_t kReplayChunkEnd = 3;
+
+struct ReplayPlayerInfo {
+  uint8_t player_no;
+  std::string user_name;
+  fw::Color color;
+};
+
+struct ReplayHeader {
+  std::string map_name;
+
+  // We seed the random number generator with this when the game starts.
+  uint32_t seed;
+
+  // The player who recorded the replay, and everybody who was playing.
+  uint8_t local_player_no;
+  std::vector<ReplayPlayerInfo> players;
+};
+
+// One turn of a replay: the commands that were executed at the start of the turn, and how long the turn was (i.e.
+// the game time between these commands and the next turn's).
+struct ReplayTurn {
+  turn_id turn;
+  uint32_t turn_length_ms;
+  std::vector<std::shared_ptr<Command>> commands;
+};
+
+// A Player in a replay. They don't do anything: their commands are all in the replay already.
+class ReplayPlayer : public Player {
+public:
+  ReplayPlayer(ReplayPlayerInfo const &info);
+  virtual ~ReplayPlayer();
+
+  void local_player_is_ready() override;
+};
+
+// Writes a replay file as the game is played, see SimulationThread::execute_commands().
+class ReplayWriter {
+private:
+  std::ofstream outs_;
+
+  // The turns we've written since the last chunk, and the position exponent they're written with.
+  std::unique_ptr<fw::net::PacketBuffer> chunk_;
+  int chunk_turns_;
+  int position_exponent_;
+
+  // The turn after the last one we wrote. Turns are written relative to this, so they're usually just one byte.
+  turn_id next_turn_;
+
+  ReplayWriter();
+
+  fw::Status write_chunk(fw::net::PacketBuffer &chunk);
+  fw::Status flush_turns();
+
+public:
+  ~ReplayWriter();
+
+  // Creates a new replay file at the given path (replacing whatever's there) and writes the header.
+  static fw::StatusOr<std::unique_ptr<ReplayWriter>> create(
+      std::filesystem::path const &path, ReplayHeader const &header);
+
+  // Writes the commands for the given turn, which must be after the last turn we wrote. position_exponent is what
+  // the commands have been quantized to, see get_command_position_exponent().
+  fw::Status write_turn(
+      turn_id turn, uint32_t turn_length_ms, std::vector<std::shared_ptr<Command>> const &commands,
+      int position_exponent);
+
+  // Writes out any turns we haven't written yet and finishes the file. This is called by the destructor if you don't
+  // call it yourself.
+  fw::Status close();
+};
+
+// Reads a replay file back. Commands look up their player in the SimulationThread as they're created, so you need to
+// call SimulationThread::start_playback() with our header before you read any turns.
+class ReplayReader {
+private:
+  std::ifstream ins_;
+  ReplayHeader header_;
+
+  // The chunk we're currently reading turns from (if any). chunk_ points into chunk_bytes_.
+  std::vector<uint8_t> chunk_bytes_;
+  std::unique_ptr<fw::net::PacketBuffer> chunk_;
+  bool finished_;
+  turn_id next_turn_;
+
+  ReplayReader();
+
+  // Reads the next chunk into chunk_bytes_ and chunk_. Returns false if we've got to the end of the file.
+  fw::StatusOr<bool> read_chunk();
+
+public:
+  ~ReplayReader();
+
+  // Opens the replay at the given path and reads its header.
+  static fw::StatusOr<std::unique_ptr<ReplayReader>> open(std::filesystem::path const &path);
+
+  ReplayHeader const &get_header() const {
+    return header_;
+  }
+
+  // Reads the next turn into turn. Returns false once there are no turns left.
+  fw::StatusOr<bool> next_turn(ReplayTurn &turn);
+};
+
+}
@@ -1,11 +1,17 @@
 #include <game/simulation/simulation_thread.h>
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <memory>
+#include <random>
 #include <thread>
 
 #include <framework/logging.h>
 #include <framework/lua.h>
+#include <framework/misc.h>
 #include <framework/net.h>
+#include <framework/paths.h>
 #include <framework/settings.h>
 #include <framework/status.h>
 #include <framework/timer.h>
@@ -14,17 +20,56 @@
 #include <game/simulation/remote_player.h>
 #include <game/simulation/local_player.h>
 #include <game/simulation/commands.h>
+#include <game/simulation/packets.h>
+#include <game/simulation/replay.h>
+#include <game/simulation/snapshot.h>
 #include <game/ai/ai_player.h>
+#include <game/entities/entity_manager.h>
+#include <game/world/world.h>
 
 namespace game {
 
 SimulationThread *SimulationThread::instance = new SimulationThread();
 
+namespace {
+
+// How often we check for commands from our peers while we're waiting for them.
+const int STALL_POLL_MS = 2;
+
+// Until the game starts, there's nobody to keep in step with, so we just tick along with turns this long.
+const int PRE_LOCKSTEP_TURN_MS = 200;
+
+// The most turns we'll get ahead of the update thread. It's normally still running the frames of the turn before the
+// one we've just closed, so this is only reached if it's stuck (e.g. loading something), and then we wait for it to
+// catch up.
+const std::size_t TURN_HANDOFF_CAPACITY = 32;
+
+// The number of our own state hashes we keep around for checking our peers' against. Peers can only be a few turns
+// apart, so this is plenty.
+const size_t STATE_HASH_HISTORY = 16;
+
+// We send a snapshot to a joining player this much at a time, one chunk per turn, so that sending it doesn't hold up
+// the turn loop. It goes on its own channel, so it doesn't hold up our commands either.
+const std::size_t SNAPSHOT_CHUNK_SIZE = 64 * 1024;
+
+}
+
 SimulationThread::SimulationThread() :
-    turn_(0), game_id_(0), stopped_(false) {
+    turn_(0), game_id_(0), turn_handoff_(TURN_HANDOFF_CAPACITY), stopped_(false), lockstep_started_(false),
+    state_hash_interval_(0), state_hash_epoch_(0), last_state_hash_turn_(0), unsent_state_hash_turn_(0),
+    unsent_state_hash_(0), desynced_(false), dump_turn_(0), playing_back_(false) {
+}
+
+SimulationThread::~SimulationThread() {
 }
 
 void SimulationThread::initialize() {
+  state_hash_interval_ = std::max(fw::Settings::get<int>("desync-check-interval"), 0);
+
+  // We're running the game from now on, even if we were playing something back before (e.g. in the bench).
+  playing_back_ = false;
+  players_.clear();
+
   // create the local_player that represents us.
   local_player_ = std::make_shared<LocalPlayer>();
   players_.push_back(local_player_);
@@ -37,6 +82,9 @@ void SimulationThread::destroy() {
   stopped_ = true;
   stopped_cond_.notify_all();
   thread_.join();
+
+  // Finish off the replay, if we were recording one.
+  replay_writer_.reset();
 }
 
 fw::Status SimulationThread::connect(uint64_t game_id, std::string address, uint8_t player_no) {
@@ -59,6 +107,29 @@ fw::Status SimulationThread::connect_player(std::string address) {
   return fw::OkStatus();
 }
 
+void SimulationThread::connect_confirmed_player(std::string address, uint8_t player_no) {
+  std::unique_lock<std::mutex> lock(confirmed_players_mutex_);
+  confirmed_players_.emplace_back(address, player_no);
+}
+
+void SimulationThread::connect_confirmed_players() {
+  std::vector<std::pair<std::string, uint8_t>> confirmed_players;
+  {
+    std::unique_lock<std::mutex> lock(confirmed_players_mutex_);
+    std::swap(confirmed_players, confirmed_players_);
+  }
+
+  for (auto const &[address, player_no] : confirmed_players) {
+    auto player = RemotePlayer::connect_confirmed(host_, address, player_no);
+    if (!player.ok()) {
+      LOG(ERR) << "error connecting to player " << static_cast<int>(player_no) << ": " << player.status();
+      continue;
+    }
+    players_.push_back(*player);
+    sig_players_changed.Emit();
+  }
+}
+
 void SimulationThread::new_game(uint64_t game_id) {
   // remember the identifier of the game.
   game_id_ = game_id;
@@ -77,8 +148,21 @@ void SimulationThread::set_map_name(std::string const &value) {
 }
 
 void SimulationThread::send_chat_msg(std::string const &msg) {
-  for(auto &player : players_) {
-    player->send_chat_msg(msg);
+  std::unique_lock<std::mutex> lock(chat_mutex_);
+  posted_chat_msgs_.push_back(msg);
+}
+
+void SimulationThread::send_posted_chat_msgs() {
+  std::vector<std::string> chat_msgs;
+  {
+    std::unique_lock<std::mutex> lock(chat_mutex_);
+    std::swap(chat_msgs, posted_chat_msgs_);
+  }
+
+  for (std::string const &msg : chat_msgs) {
+    for (auto &player : players_) {
+      player->send_chat_msg(msg);
+    }
   }
 }
 
@@ -93,24 +177,54 @@ std::shared_ptr<Player> SimulationThread::get_player(uint8_t player_no) const {
 }
 
 void SimulationThread::post_command(std::shared_ptr<Command> &cmd) {
+  if (playing_back_) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(posted_commands_mutex_);
   posted_commands_.push_back(cmd);
 }
 
 void SimulationThread::enqueue_posted_commands() {
-  for (std::shared_ptr<Command> &cmd : posted_commands_) {
-    enqueue_command(cmd);
+  turn_id execute_turn = turn_ + 1;
+  if (lockstep_started_) {
+    execute_turn = scheduler_.get_execute_turn(turn_);
+    if (execute_turn == 0) {
+      // The command delay has come down, and we've already told everybody we've got nothing for them up to (and
+      // including) turn_ + delay. Hang on to the commands until next turn.
+      return;
+    }
   }
 
+  std::vector<std::shared_ptr<Command>> posted_commands;
+  {
+    std::unique_lock<std::mutex> lock(posted_commands_mutex_);
+    std::swap(posted_commands, posted_commands_);
+  }
+
+  // Round off the commands to what the compact wire encoding can represent before we execute them ourselves, so that
+  // we're executing exactly what our peers will receive.
+  const int position_exponent = get_command_position_exponent();
+  for (std::shared_ptr<Command> &cmd : posted_commands) {
+    cmd->quantize(position_exponent);
+    enqueue_command(cmd, execute_turn);
+  }
+
+  TurnPackets packets(
+      posted_commands, lockstep_started_ ? execute_turn : 0,
+      static_cast<uint16_t>(std::lround(scheduler_.get_desired_turn_length())), unsent_state_hash_turn_,
+      unsent_state_hash_);
   for (auto &player : players_) {
-    player->post_commands(posted_commands_);
+    player->post_commands(packets);
   }
 
-  posted_commands_.clear();
+  unsent_state_hash_turn_ = 0;
 }
 
 void SimulationThread::enqueue_command(std::shared_ptr<Command> &cmd) {
-  turn_id turn = turn_ + 1;
+  enqueue_command(cmd, turn_ + 1);
+}
 
+void SimulationThread::enqueue_command(std::shared_ptr<Command> &cmd, turn_id turn) {
   auto it = commands_.find(turn);
   if (it == commands_.end()) {
     commands_[turn] = std::vector<std::shared_ptr<Command>>();
@@ -121,6 +235,494 @@ void SimulationThread::enqueue_command(std::shared_ptr<Command> &cmd) {
   command_list.push_back(cmd);
 }
 
+void SimulationThread::enqueue_peer_commands(
+    uint8_t player_no, turn_id execute_turn, std::vector<std::shared_ptr<Command>> &commands,
+    float desired_turn_length_ms) {
+  // If this player has started the game, everybody's ready even if we haven't heard about it yet.
+  if (!lockstep_started_) {
+    start_lockstep();
+  }
+
+  if (execute_turn <= turn_) {
+    // We only get here if they're not one of the peers we wait for (e.g. they joined after the game started), and
+    // there's no way to go back and run these commands on the right turn now.
+    LOG(ERR) << "commands from player " << static_cast<int>(player_no) << " for turn " << execute_turn
+             << " arrived on turn " << turn_ << ", running them next turn";
+    execute_turn = turn_ + 1;
+  }
+
+  for (std::shared_ptr<Command> &cmd : commands) {
+    LOG(DBG) << "got command, id: " << static_cast<int>(cmd->get_identifier()) << " turn: " << execute_turn;
+    enqueue_command(cmd, execute_turn);
+  }
+  scheduler_.on_peer_commands(player_no, execute_turn, static_cast<int>(commands.size()), desired_turn_length_ms);
+}
+
+void SimulationThread::execute_commands(turn_id turn, int num_frames) {
+  TurnBundle bundle;
+  bundle.turn = turn;
+  bundle.num_frames = num_frames;
+  request_state_hash(bundle);
+
+  auto it = commands_.find(turn);
+  if (it == commands_.end()) {
+    // Nothing to do, but the replay still needs to know the turn happened (and how long it was), and we still hand
+    // the turn over so the handoff's latency covers every turn.
+    record_turn(turn, bundle.commands);
+    turn_handoff_.push(std::move(bundle));
+    return;
+  }
+
+  // Commands from different players arrive in whatever order the network delivers them, so sort them by player to
+  // make sure every peer runs them in the same order. Each player's own commands stay in the order they posted them.
+  auto &command_list = it->second;
+  std::stable_sort(command_list.begin(), command_list.end(),
+      [](std::shared_ptr<Command> const &lhs, std::shared_ptr<Command> const &rhs) {
+        const uint8_t lhs_player_no = lhs->get_player() == nullptr ? 0 : lhs->get_player()->get_player_no();
+        const uint8_t rhs_player_no = rhs->get_player() == nullptr ? 0 : rhs->get_player()->get_player_no();
+        return lhs_player_no < rhs_player_no;
+      });
+  record_turn(turn, command_list);
+
+  // we'll not need this turn again...
+  bundle.commands = std::move(command_list);
+  commands_.erase(it);
+  turn_handoff_.push(std::move(bundle));
+}
+
+bool SimulationThread::all_players_ready() const {
+  for (auto const &player : players_) {
+    if (!player->is_ready()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SimulationThread::start_lockstep() {
+  start_recording();
+
+  // Anything left over from before the game started would've run next turn, so run it now before we renumber the
+  // turns. If we're recording, these are recorded as turn 0, which has no frames (when it's played back, either).
+  execute_commands(turn_ + 1, 0);
+  commands_.clear();
+  turn_ = 0;
+  reset_state_hashes();
+
+  scheduler_.reset();
+  int num_peers = 0;
+  for (auto &player : players_) {
+    auto remote_player = std::dynamic_pointer_cast<RemotePlayer>(player);
+    if (remote_player && remote_player->is_lockstep()) {
+      scheduler_.add_peer(remote_player->get_player_no());
+      num_peers++;
+    }
+  }
+  update_peer_latencies();
+
+  lockstep_started_ = true;
+  LOG(INFO) << "game started, running in lockstep with " << num_peers << " peer(s)";
+}
+
+void SimulationThread::start_recording() {
+  std::string file_name = fw::Settings::get<std::string>("record-replay");
+  if (file_name.empty()) {
+    return;
+  }
+
+  // Nothing in the simulation uses the random number generator before the game starts, so we pick a new seed here
+  // and record it, and playback starts from the same place.
+  ReplayHeader header;
+  header.map_name = map_name_;
+  header.seed = std::random_device()();
+  fw::random_initialize(header.seed);
+  header.local_player_no = local_player_->get_player_no();
+  for (auto &player : players_) {
+    header.players.push_back(
+        ReplayPlayerInfo { player->get_player_no(), player->get_user_name(), player->get_color() });
+  }
+
+  std::filesystem::path path = fw::resolve(file_name, true);
+  auto writer = ReplayWriter::create(path, header);
+  if (!writer.ok()) {
+    LOG(ERR) << "error recording replay: " << writer.status();
+    return;
+  }
+  replay_writer_ = std::move(*writer);
+  LOG(INFO) << "recording replay to " << path.string();
+}
+
+void SimulationThread::record_turn(turn_id turn, std::vector<std::shared_ptr<Command>> const &commands) {
+  if (!replay_writer_) {
+    return;
+  }
+
+  // Before the game starts (i.e. the commands that were left over when it did), there's no turn length.
+  uint32_t turn_length_ms = 0;
+  if (lockstep_started_) {
+    turn_length_ms = static_cast<uint32_t>(std::lround(scheduler_.get_turn_length()));
+  } else {
+    turn = 0;
+  }
+
+  auto status = replay_writer_->write_turn(turn, turn_length_ms, commands, get_command_position_exponent());
+  if (!status.ok()) {
+    LOG(ERR) << "error recording replay, recording stopped: " << status;
+    replay_writer_.reset();
+  }
+}
+
+void SimulationThread::start_playback(ReplayHeader const &header) {
+  playing_back_ = true;
+  map_name_ = header.map_name;
+
+  players_.clear();
+  for (ReplayPlayerInfo const &info : header.players) {
+    if (info.player_no == header.local_player_no) {
+      local_player_ = std::make_shared<LocalPlayer>();
+      local_player_->set_player_no(info.player_no);
+      local_player_->set_color(info.color);
+      players_.push_back(local_player_);
+    } else {
+      players_.push_back(std::make_shared<ReplayPlayer>(info));
+    }
+  }
+  if (!local_player_) {
+    // We need a local player for commands to be created (see generate_entity_id()), even if it doesn't play.
+    local_player_ = std::make_shared<LocalPlayer>();
+    local_player_->set_player_no(header.local_player_no);
+  }
+
+  // Creating the players uses up some random numbers, so we seed it afterwards.
+  fw::random_initialize(header.seed);
+}
+
+void SimulationThread::update_peer_latencies() {
+  for (auto &player : players_) {
+    auto remote_player = std::dynamic_pointer_cast<RemotePlayer>(player);
+    if (remote_player) {
+      auto const &peer = remote_player->get_peer();
+      scheduler_.set_peer_latency(
+          remote_player->get_player_no(), peer->get_round_trip_time(), peer->get_round_trip_time_variance());
+    }
+  }
+}
+
+void SimulationThread::request_state_hash(TurnBundle &bundle) {
+  const bool take_dump = (dump_turn_ != 0 && bundle.turn == dump_turn_);
+  if (!lockstep_started_ || state_hash_interval_ == 0 || (bundle.turn % state_hash_interval_ != 0 && !take_dump)) {
+    return;
+  }
+
+  // We can't compare anything until the world's loaded (and neither can our peers: they'll just not find a hash of
+  // ours to compare with until we start sending them).
+  game::World *world = game::World::get_instance();
+  if (world == nullptr || world->get_entity_manager() == nullptr) {
+    return;
+  }
+
+  // The update thread is usually still running the frames of an earlier turn, so the hash has to be taken by the
+  // update thread at exactly this point in the turn. It only gets here once it's run every frame of the turns before
+  // this one (see TurnHandoff), which are the same frames every peer runs, so every peer's hash is of the same state.
+  ent::EntityManager *ent_mgr = world->get_entity_manager();
+  const turn_id turn = bundle.turn;
+  const uint32_t epoch = state_hash_epoch_;
+  bundle.on_executed = [this, ent_mgr, turn, epoch, take_dump]() {
+    TurnStateHash state_hash { turn, epoch, ent_mgr->get_state_hash().get() };
+    if (take_dump) {
+      state_hash.dump = ent_mgr->write_state_dump();
+    }
+    std::unique_lock<std::mutex> lock(state_hash_mutex_);
+    executed_state_hashes_.push_back(std::move(state_hash));
+  };
+}
+
+void SimulationThread::record_state_hashes() {
+  std::vector<TurnStateHash> executed_state_hashes;
+  {
+    std::unique_lock<std::mutex> lock(state_hash_mutex_);
+    std::swap(executed_state_hashes, executed_state_hashes_);
+  }
+
+  for (TurnStateHash &state_hash : executed_state_hashes) {
+    if (state_hash.epoch != state_hash_epoch_) {
+      continue;
+    }
+    const turn_id turn = state_hash.turn;
+    last_state_hash_turn_ = turn;
+    unsent_state_hash_turn_ = turn;
+    unsent_state_hash_ = state_hash.hash;
+    TurnStateHash &ours = state_hashes_[turn] = std::move(state_hash);
+    if (!ours.dump.empty()) {
+      write_desync_dump(ours);
+      ours.dump.clear();
+    }
+
+    // Check any hashes our peers sent before we got here, and forget the ones we'll never have a hash of ours for.
+    auto end = peer_state_hashes_.upper_bound(turn);
+    for (auto it = peer_state_hashes_.begin(); it != end; ++it) {
+      if (it->first == turn && it->second.second != ours.hash) {
+        on_desync(it->second.first, ours, it->second.second);
+      }
+    }
+    peer_state_hashes_.erase(peer_state_hashes_.begin(), end);
+  }
+
+  while (state_hashes_.size() > STATE_HASH_HISTORY) {
+    state_hashes_.erase(state_hashes_.begin());
+  }
+}
+
+void SimulationThread::reset_state_hashes() {
+  state_hash_epoch_++;
+  state_hashes_.clear();
+  peer_state_hashes_.clear();
+  last_state_hash_turn_ = 0;
+  unsent_state_hash_turn_ = 0;
+  dump_turn_ = 0;
+}
+
+void SimulationThread::check_peer_state_hash(uint8_t player_no, turn_id turn, uint64_t hash) {
+  if (turn > last_state_hash_turn_ || !lockstep_started_) {
+    peer_state_hashes_.emplace(turn, std::make_pair(player_no, hash));
+    return;
+  }
+
+  auto it = state_hashes_.find(turn);
+  if (it != state_hashes_.end() && it->second.hash != hash) {
+    on_desync(player_no, it->second, hash);
+  }
+}
+
+void SimulationThread::on_desync(uint8_t player_no, TurnStateHash const &ours, uint64_t their_hash) {
+  LOG(ERR) << "desync with player " << static_cast<int>(player_no) << " on turn " << ours.turn
+           << ": our state hash is " << ours.hash << ", theirs is " << their_hash;
+  if (desynced_) {
+    return;
+  }
+  desynced_ = true;
+
+  // Dump our entities on the next turn we check, so it can be diffed against the same dump from the other player. We
+  // only do this once: once we've diverged, every turn after this will be different as well.
+  dump_turn_ = std::max(ours.turn + state_hash_interval_, turn_ + 1);
+  LOG(INFO) << "dumping entity state on turn " << dump_turn_;
+}
+
+void SimulationThread::write_desync_dump(TurnStateHash const &state_hash) {
+  std::string file_name = "desync-turn" + std::to_string(state_hash.turn) + "-player"
+      + std::to_string(local_player_->get_player_no()) + ".bin";
+  std::filesystem::path path = fw::resolve(file_name, true);
+  std::ofstream outs(path, std::ios::binary);
+  outs.write(state_hash.dump.data(), state_hash.dump.size());
+  if (!outs) {
+    LOG(ERR) << "error writing entity state dump to " << path.string();
+    return;
+  }
+  LOG(INFO) << "wrote entity state dump to " << path.string();
+}
+
+void SimulationThread::request_snapshot(std::function<void(std::shared_ptr<Snapshot>)> fn) {
+  std::unique_lock<std::mutex> lock(snapshot_mutex_);
+  snapshot_requests_.push_back(fn);
+}
+
+void SimulationThread::request_load_snapshot(std::shared_ptr<Snapshot const> snapshot) {
+  std::unique_lock<std::mutex> lock(snapshot_mutex_);
+  snapshot_to_load_ = snapshot;
+}
+
+void SimulationThread::send_snapshot(uint8_t player_no) {
+  LOG(INFO) << "taking snapshot for player " << static_cast<int>(player_no);
+  request_snapshot([this, player_no](std::shared_ptr<Snapshot> snapshot) {
+    std::unique_lock<std::mutex> lock(snapshot_mutex_);
+    outgoing_snapshots_.push_back(OutgoingSnapshot { player_no, snapshot, 0 });
+  });
+}
+
+void SimulationThread::write_snapshot(Snapshot &snapshot) {
+  // The queued commands have already been quantized to this exponent, see enqueue_posted_commands().
+  const int position_exponent = get_command_position_exponent();
+  fw::net::PacketBuffer section(kSnapshotSectionSimulation, fw::net::kWireVersionCompact);
+  section.set_position_exponent(position_exponent);
+  section << static_cast<uint8_t>(static_cast<int8_t>(position_exponent));
+  section << turn_;
+  section << static_cast<uint8_t>(lockstep_started_ ? 1 : 0);
+  section << fw::random_save_state();
+
+  uint32_t num_turns = static_cast<uint32_t>(commands_.size());
+  section << fw::net::compact(num_turns);
+  for (auto const &[turn, command_list] : commands_) {
+    uint32_t num_commands = static_cast<uint32_t>(command_list.size());
+    section << turn;
+    section << fw::net::compact(num_commands);
+    for (std::shared_ptr<Command> const &cmd : command_list) {
+      section << cmd->get_identifier();
+      section << static_cast<uint8_t>(cmd->get_player() == nullptr ? 0 : cmd->get_player()->get_player_no());
+      cmd->serialize(section);
+    }
+  }
+  snapshot.add_section(section);
+
+  // Each AI player gets its own section, so if we don't have the player when it's restored, we can just skip it.
+  for (auto &player : players_) {
+    auto ai_player = std::dynamic_pointer_cast<AIPlayer>(player);
+    if (ai_player) {
+      fw::net::PacketBuffer player_section(kSnapshotSectionPlayers, fw::net::kWireVersionCompact);
+      player_section << ai_player->get_player_no();
+      ai_player->write_snapshot(player_section);
+      snapshot.add_section(player_section);
+    }
+  }
+}
+
+fw::Status SimulationThread::read_snapshot(Snapshot const &snapshot) {
+  RETURN_IF_ERROR(snapshot.validate());
+
+  turn_id turn = 0;
+  bool lockstep_started = false;
+  std::string random_state;
+  std::map<turn_id, std::vector<std::shared_ptr<Command>>> commands;
+  RETURN_IF_ERROR(snapshot.for_each_section(kSnapshotSectionSimulation,
+      [&](fw::net::PacketBuffer &section) {
+        uint8_t flags;
+        RETURN_IF_ERROR(read_command_position_exponent(section));
+        section >> turn;
+        section >> flags;
+        lockstep_started = (flags != 0);
+        section >> random_state;
+
+        uint32_t num_turns;
+        section >> fw::net::compact(num_turns);
+        RETURN_IF_ERROR(section.get_status());
+        for (uint32_t i = 0; i < num_turns; i++) {
+          turn_id command_turn;
+          uint32_t num_commands;
+          section >> command_turn;
+          section >> fw::net::compact(num_commands);
+          RETURN_IF_ERROR(section.get_status());
+
+          auto &command_list = commands[command_turn];
+          for (uint32_t j = 0; j < num_commands; j++) {
+            uint8_t id;
+            uint8_t player_no;
+            section >> id;
+            section >> player_no;
+            RETURN_IF_ERROR(section.get_status());
+
+            ASSIGN_OR_RETURN(std::shared_ptr<Command> cmd, CreateCommand(id, player_no));
+            RETURN_IF_ERROR(cmd->deserialize(section));
+            command_list.push_back(cmd);
+          }
+        }
+        return fw::OkStatus();
+      }));
+  RETURN_IF_ERROR(fw::random_restore_state(random_state));
+
+  // If the game's already going (e.g. we're joining it), then we're in it now as well.
+  if (lockstep_started && !lockstep_started_) {
+    start_lockstep();
+  }
+  turn_ = turn;
+  commands_ = std::move(commands);
+  {
+    std::unique_lock<std::mutex> lock(posted_commands_mutex_);
+    posted_commands_.clear();
+  }
+  reset_state_hashes();
+
+  return snapshot.for_each_section(kSnapshotSectionPlayers, [this](fw::net::PacketBuffer &section) {
+    uint8_t player_no;
+    section >> player_no;
+    auto ai_player = std::dynamic_pointer_cast<AIPlayer>(get_player(player_no));
+    if (!ai_player) {
+      LOG(WARN) << "AI player " << static_cast<int>(player_no) << " in snapshot isn't in this game, skipping";
+      return fw::OkStatus();
+    }
+    return ai_player->read_snapshot(section);
+  });
+}
+
+void SimulationThread::process_snapshots() {
+  std::shared_ptr<Snapshot const> snapshot_to_load;
+  std::vector<std::function<void(std::shared_ptr<Snapshot>)>> snapshot_requests;
+  {
+    std::unique_lock<std::mutex> lock(snapshot_mutex_);
+    std::swap(snapshot_to_load, snapshot_to_load_);
+    std::swap(snapshot_requests, snapshot_requests_);
+  }
+
+  ent::EntityManager *ent_mgr = nullptr;
+  game::World *world = game::World::get_instance();
+  if (world != nullptr) {
+    ent_mgr = world->get_entity_manager();
+  }
+
+  // The update thread may not have applied this turn's commands yet, so the EntityManager's part of the snapshot is
+  // handed over with the turn, after its commands.
+  TurnBundle bundle;
+  bundle.turn = turn_;
+
+  if (snapshot_to_load) {
+    auto status = read_snapshot(*snapshot_to_load);
+    if (!status.ok()) {
+      LOG(ERR) << "error restoring snapshot: " << status;
+    } else {
+      LOG(INFO) << "restored snapshot, now on turn " << turn_;
+      if (ent_mgr != nullptr) {
+        bundle.after_commands.push_back([ent_mgr, snapshot_to_load]() {
+          ent_mgr->request_load_snapshot(snapshot_to_load);
+        });
+      }
+    }
+  }
+
+  for (auto &fn : snapshot_requests) {
+    auto snapshot = std::make_shared<Snapshot>();
+    write_snapshot(*snapshot);
+    if (ent_mgr != nullptr) {
+      bundle.after_commands.push_back([ent_mgr, snapshot, fn]() {
+        ent_mgr->request_snapshot(snapshot, fn);
+      });
+    } else {
+      // No world yet, so there aren't any entities to add.
+      snapshot->finish();
+      fn(snapshot);
+    }
+  }
+
+  if (!bundle.after_commands.empty()) {
+    turn_handoff_.push(std::move(bundle));
+  }
+}
+
+void SimulationThread::send_snapshot_chunks() {
+  std::unique_lock<std::mutex> lock(snapshot_mutex_);
+  for (auto it = outgoing_snapshots_.begin(); it != outgoing_snapshots_.end();) {
+    auto remote_player = std::dynamic_pointer_cast<RemotePlayer>(get_player(it->player_no));
+    std::vector<uint8_t> const &bytes = it->snapshot->get_bytes();
+    if (!remote_player) {
+      LOG(WARN) << "player " << static_cast<int>(it->player_no) << " left before we could send their snapshot";
+      it = outgoing_snapshots_.erase(it);
+      continue;
+    }
+
+    const std::size_t n = std::min(SNAPSHOT_CHUNK_SIZE, bytes.size() - it->offset);
+    SnapshotPacket pkt;
+    pkt.set_total_size(static_cast<uint32_t>(bytes.size()));
+    pkt.set_offset(static_cast<uint32_t>(it->offset));
+    pkt.get_bytes().assign(bytes.begin() + it->offset, bytes.begin() + it->offset + n);
+    remote_player->get_peer()->send(pkt, kSnapshotChannel);
+
+    it->offset += n;
+    if (it->offset >= bytes.size()) {
+      LOG(INFO) << "sent " << bytes.size() << " byte snapshot to player " << static_cast<int>(it->player_no);
+      it = outgoing_snapshots_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 void SimulationThread::add_ai_player(std::shared_ptr<AIPlayer> const &player) {
   players_.push_back(player);
   sig_players_changed.Emit();
@@ -140,38 +742,76 @@ void SimulationThread::thread_proc() {
   while (!stopped_) {
     fw::Clock::time_point start(fw::Clock::now());
     host_->update();
-    turn_++;
 
-    // at the start of each turn, we post the commands for the *next* turn
-    enqueue_posted_commands();
-
-    // next, check for any new connections that the Host has detected for us, this shouldn't happen
+    // check for any new connections that the Host has detected for us, this shouldn't happen
     // once the game is underway, but you never know (in that case, we need to reject them!)
     std::vector<std::shared_ptr<fw::net::Peer>> new_connections = host_->get_new_connections();
     for (auto &new_peer : new_connections) {
       players_.push_back(std::make_shared<RemotePlayer>(host_, new_peer, true));
       sig_players_changed.Emit();
     }
+    connect_confirmed_players();
 
-    // execute all of the commands that are due this turn
-    auto it = commands_.find(turn_);
-    if (it != commands_.end()) {
-      auto &command_list = it->second;
-      for (std::shared_ptr<Command> &cmd : command_list) {
-        cmd->execute();
+    if (!lockstep_started_ && all_players_ready()) {
+      start_lockstep();
+    }
+
+    if (lockstep_started_) {
+      update_peer_latencies();
+      if (!scheduler_.is_turn_ready(turn_ + 1)) {
+        // One of our peers hasn't sent us their commands for the next turn yet, so we can't run it.
+        scheduler_.on_stall(turn_ + 1, start);
+        std::unique_lock<std::mutex> lock(mutex);
+        stopped_cond_.wait_for(lock, std::chrono::milliseconds(STALL_POLL_MS));
+        continue;
       }
+    }
 
-      // we'll not need this turn again...
-      commands_.erase(it);
+    if (!turn_handoff_.try_flush()) {
+      // The update thread is too far behind applying the turns we've already run, don't get any further ahead of it.
+      turn_handoff_.on_backpressure_stall();
+      std::unique_lock<std::mutex> lock(mutex);
+      stopped_cond_.wait_for(lock, std::chrono::milliseconds(STALL_POLL_MS));
+      continue;
     }
 
+    turn_++;
+    scheduler_.begin_turn(turn_, start);
+
+    // pick up the state hashes the update thread has taken since last turn, so the latest goes out with our commands.
+    record_state_hashes();
+
+    // at the start of each turn, we post the commands for a later turn (and any chat), and send it all off together
+    // now rather than leaving it until the next turn.
+    send_posted_chat_msgs();
+    enqueue_posted_commands();
+    host_->flush();
+
+    // hand all of the commands that are due this turn over to the update thread, along with the frames to run after
+    // them. Every peer runs the same number of frames in a turn, since they all agree on how long it is.
+    int num_frames = PRE_LOCKSTEP_TURN_MS / kFrameMs;
+    if (lockstep_started_) {
+      num_frames = scheduler_.get_turn_frames();
+    }
+    execute_commands(turn_, num_frames);
+
+    // Snapshots are of the state at the end of the turn, and restoring one puts us at the end of its turn.
+    process_snapshots();
+
     // finally, update each player.
     for (auto &player : players_) {
       player->update();
     }
+    send_snapshot_chunks();
 
+    // Until the game starts, there's nobody to keep in step with so we just tick along. After that, the scheduler
+    // decides how long a turn should be.
+    std::chrono::microseconds turn_length(PRE_LOCKSTEP_TURN_MS * 1000);
+    if (lockstep_started_) {
+      turn_length = std::chrono::microseconds(static_cast<int64_t>(scheduler_.get_turn_length() * 1000.0f));
+    }
     std::unique_lock<std::mutex> lock(mutex);
-    stopped_cond_.wait_until(lock, start + std::chrono::milliseconds(200));
+    stopped_cond_.wait_until(lock, start + turn_length);
   }
 }
 
@@ -3,12 +3,16 @@
 #include <condition_variable>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string_view>
 #include <thread>
 
+#include <framework/lockstep_scheduler.h>
 #include <framework/status.h>
 #include <framework/signals.h>
 
+#include <game/simulation/turn_handoff.h>
+
 namespace fw {
 namespace net {
 class Host;
@@ -20,8 +24,9 @@ class Player;
 class AIPlayer;
 class LocalPlayer;
 class Command;
-
-typedef uint32_t turn_id;
+class ReplayWriter;
+struct ReplayHeader;
+class Snapshot;
 
 // The main simulation for the game runs in a separate thread, and at a separate rate to the rendering, etc. This
 // class encapsulates the functions of the simulation thread.
@@ -31,7 +36,7 @@ public:
   typedef std::function<void()> callback_fn;
 
   SimulationThread();
-  ~SimulationThread() = default;
+  ~SimulationThread();
 
   void initialize();
   void destroy();
@@ -43,6 +48,11 @@ public:
   // an existing game)
   fw::Status connect_player(std::string address);
 
+  // Connect to a player who's joined the game without going through the session server, as the given player_no (see
+  // RemotePlayer::connect_confirmed). Unlike connect_player, this is safe to call while we're running: we make the
+  // connection on our own thread, at the start of our next turn.
+  void connect_confirmed_player(std::string address, uint8_t player_no);
+
   // When a new multiplayer game is started, this is called to set up the game_id and that, once everything is ready
   // to go, call start_game()
   void new_game(uint64_t game_id);
@@ -63,7 +73,7 @@ public:
 
   // This is the called by the Input subsystem/game world when the user initiates a command (e.g. the click on terrain
   // to order a unit to move, etc). we must post the command to our command queue and notify remote players of the
-  // pending command.
+  // pending command. This can be called from any thread.
   void post_command(std::shared_ptr<Command> &cmd);
 
   // This is just a convenience. normally, you'll have a shared_ptr to something that derives from command and this'll
@@ -74,9 +84,60 @@ public:
     post_command(real_cmd);
   }
 
-  // Enqueues a command for the next turn. this is called when we receive a command from other players.
+  // Enqueues a command for the next turn. this is called when we receive a command from other players who aren't
+  // in lockstep with us.
   void enqueue_command(std::shared_ptr<Command> &cmd);
 
+  // Enqueues a command for the given turn.
+  void enqueue_command(std::shared_ptr<Command> &cmd, turn_id turn);
+
+  // Enqueues commands from the given player that execute on the given turn. The player has nothing else for us
+  // before then, so this lets the turns up to execute_turn go ahead. desired_turn_length_ms is the turn length the
+  // player would like the turns up to execute_turn to be.
+  void enqueue_peer_commands(
+      uint8_t player_no, turn_id execute_turn, std::vector<std::shared_ptr<Command>> &commands,
+      float desired_turn_length_ms);
+
+  // The turn length we'd like, based on the round-trip times to our peers. We send this with our commands.
+  float get_desired_turn_length() const {
+    return scheduler_.get_desired_turn_length();
+  }
+
+  // The turn of the most recent state hash we've recorded but not yet sent to our peers (zero if there isn't one),
+  // and its value. Our RemotePlayers send this with our commands.
+  turn_id get_unsent_state_hash_turn() const {
+    return unsent_state_hash_turn_;
+  }
+  uint64_t get_unsent_state_hash() const {
+    return unsent_state_hash_;
+  }
+
+  // Checks the state hash a peer sent us against ours for the same turn (now, or once we've got to that turn).
+  void check_peer_state_hash(uint8_t player_no, turn_id turn, uint64_t hash);
+
+  // Gets the stats (commands in, late arrivals, time spent stalled and so on) for the most recent turns, oldest
+  // first. This is safe to call from any thread.
+  std::vector<fw::net::LockstepTurnStats> get_turn_stats() const {
+    return scheduler_.get_stats();
+  }
+
+  // Executes the commands for the turns we've run since last time. This must be called from the update thread, at the
+  // start of each update, before anything looks at the entities. See TurnHandoff.
+  void apply_turns() {
+    turn_handoff_.apply_pending();
+  }
+
+  // Returns true if the update thread should run a frame of the simulation now, i.e. the turns it's applied have
+  // frames left to run. Otherwise, the simulation waits for the next turn. See TurnHandoff.
+  bool take_frame() {
+    return turn_handoff_.take_frame();
+  }
+
+  // Gets the stats for the handoff of turns from us to the update thread. This is safe to call from any thread.
+  TurnHandoffStats get_turn_handoff_stats() const {
+    return turn_handoff_.get_stats();
+  }
+
   // Adds a new AI player to the list of players.
   void add_ai_player(std::shared_ptr<AIPlayer> const &player);
 
@@ -106,6 +167,30 @@ public:
     return instance;
   }
 
+  // Sets up the players from the given replay so that its commands can be created and executed. This is instead of
+  // initialize(): we don't start the thread, the ReplayApplication executes the commands itself. Commands that are
+  // posted during playback are ignored, the replay has all the commands that were executed already.
+  void start_playback(ReplayHeader const &header);
+  bool is_playing_back() const {
+    return playing_back_;
+  }
+
+  // Asks for a snapshot of the whole simulation at the end of the current turn. The entities are added on the
+  // EntityManager's next update, and fn is called from there (i.e. not on our thread) once the snapshot is finished.
+  void request_snapshot(std::function<void(std::shared_ptr<Snapshot>)> fn);
+
+  // Restores the given snapshot at the start of our next turn. The entities are restored on the EntityManager's next
+  // update after that.
+  void request_load_snapshot(std::shared_ptr<Snapshot const> snapshot);
+
+  // Takes a snapshot and sends it to the given player (who has just joined the game), a chunk at a time.
+  void send_snapshot(uint8_t player_no);
+
+  // True once every player is ready and we've started running in lockstep.
+  bool is_game_started() const {
+    return lockstep_started_;
+  }
+
 private:
   static SimulationThread *instance;
 
@@ -122,14 +207,129 @@ private:
 
   std::map<turn_id, std::vector<std::shared_ptr<Command>>> commands_;
 
+  // We don't execute commands ourselves, we hand each turn's commands over to the update thread, which executes them
+  // at the start of its next update.
+  TurnHandoff turn_handoff_;
+
+  // Once all the players are ready, we start numbering turns again from 1 and run in lockstep with our peers: we
+  // don't start a turn until every peer has sent us their commands for it.
+  bool lockstep_started_;
+  fw::net::LockstepScheduler scheduler_;
+
+  // Every state_hash_interval_ turns, the update thread takes the entities' state hash as soon as it's executed that
+  // turn's commands, and hands it back to us through executed_state_hashes_. We keep the most recent ones in
+  // state_hashes_ and send them to our peers, who compare them with theirs. peer_state_hashes_ are the ones we've been
+  // sent for turns we haven't got a hash for yet.
+  //
+  // A dump of the entities' state is much too slow to take every time, so once we find out we've desynced, we ask for
+  // one on dump_turn_: the next turn we check after the one we desynced on (if we're not past it already). The peer
+  // we desynced with will find out about the same time, and dump the same turn, so the dumps can be diffed.
+  //
+  // state_hash_epoch_ changes whenever the turns are renumbered (e.g. when a snapshot is restored), so we can ignore
+  // the hashes of turns the update thread was still executing from before then.
+  struct TurnStateHash {
+    turn_id turn;
+    uint32_t epoch;
+    uint64_t hash;
+    std::string dump;
+  };
+  turn_id state_hash_interval_;
+  uint32_t state_hash_epoch_;
+  std::mutex state_hash_mutex_;
+  std::vector<TurnStateHash> executed_state_hashes_;
+  std::map<turn_id, TurnStateHash> state_hashes_;
+  turn_id last_state_hash_turn_;
+  std::multimap<turn_id, std::pair<uint8_t, uint64_t>> peer_state_hashes_;
+  turn_id unsent_state_hash_turn_;
+  uint64_t unsent_state_hash_;
+  bool desynced_;
+  turn_id dump_turn_;
+
+  // If we're recording a replay of the game, this is where it's going. It's created when the game starts (if the
+  // record-replay setting is set) and every turn from then on is written to it.
+  std::unique_ptr<ReplayWriter> replay_writer_;
+  bool playing_back_;
+
   // This is the list of commands that the player posted to us in this turn. At the end of the current turn, we'll
-  // enqueue it to the command queue and also notify other players of it.
+  // enqueue it to the command queue and also notify other players of it. Commands are posted from other threads (e.g.
+  // the update thread, when an entity gives itself an order), so they're protected by posted_commands_mutex_.
+  std::mutex posted_commands_mutex_;
   std::vector<std::shared_ptr<Command>> posted_commands_;
 
+  // The players we've been asked to connect to with connect_confirmed_player() since last turn, and their player_no.
+  // These come from other threads, so they're protected by confirmed_players_mutex_.
+  std::mutex confirmed_players_mutex_;
+  std::vector<std::pair<std::string, uint8_t>> confirmed_players_;
+
+  // Chat messages the player has sent since the last turn. These come from the UI thread, and we send them along with
+  // our commands, so they're protected by chat_mutex_.
+  std::mutex chat_mutex_;
+  std::vector<std::string> posted_chat_msgs_;
+
+  // Snapshots we've been asked to take or restore, and the ones we're in the middle of sending to players who've
+  // joined. These come from other threads, so they're protected by snapshot_mutex_.
+  struct OutgoingSnapshot {
+    uint8_t player_no;
+    std::shared_ptr<Snapshot> snapshot;
+    std::size_t offset;
+  };
+  std::mutex snapshot_mutex_;
+  std::vector<std::function<void(std::shared_ptr<Snapshot>)>> snapshot_requests_;
+  std::shared_ptr<Snapshot const> snapshot_to_load_;
+  std::vector<OutgoingSnapshot> outgoing_snapshots_;
+
   // At the end of each turn, this is called to enqueue all the commands that were posted and notify other players
   // of them as well.
   void enqueue_posted_commands();
 
+  // Sends the chat messages that were posted since last turn to the other players.
+  void send_posted_chat_msgs();
+
+  // Connects to the players we've been asked to with connect_confirmed_player() since last turn.
+  void connect_confirmed_players();
+
+  // Hands the commands that are due on the given turn over to the update thread to execute, followed by the given
+  // number of frames of the simulation.
+  void execute_commands(turn_id turn, int num_frames);
+
+  // Starts recording a replay, if the record-replay setting says we should.
+  void start_recording();
+
+  // Records the commands for a turn to our replay, if we're recording one.
+  void record_turn(turn_id turn, std::vector<std::shared_ptr<Command>> const &commands);
+
+  bool all_players_ready() const;
+  void start_lockstep();
+  void update_peer_latencies();
+
+  // If the given turn is one we check, has the update thread take the state hash once it's executed the turn's
+  // commands (and the dump as well, if it's dump_turn_).
+  void request_state_hash(TurnBundle &bundle);
+
+  // Records the state hashes the update thread has taken since last time, and checks them against our peers'.
+  void record_state_hashes();
+
+  // Called when our state hash for a turn doesn't match a peer's.
+  void on_desync(uint8_t player_no, TurnStateHash const &ours, uint64_t their_hash);
+
+  // Writes out the dump the update thread took on dump_turn_.
+  void write_desync_dump(TurnStateHash const &state_hash);
+
+  // Forgets all of our state hashes, and ignores any the update thread is still taking. This is for when the turns are
+  // renumbered.
+  void reset_state_hashes();
+
+  // Writes our part of a snapshot (the turn, the queued commands, the random number generator and the AI players),
+  // and reads it back.
+  void write_snapshot(Snapshot &snapshot);
+  fw::Status read_snapshot(Snapshot const &snapshot);
+
+  // Takes and restores the snapshots that have been requested since last turn.
+  void process_snapshots();
+
+  // Sends the next chunk of each snapshot we're sending to a joining player.
+  void send_snapshot_chunks();
+
   void thread_proc();
 };
 
@@ -0,0 +1,142 @@
+#include <game/simulation/snapshot.h>
+
+#include <cstring>
+#include <fstream>
+
+#include <framework/packet_buffer.h>
+#include <framework/status.h>
+
+namespace game {
+
+namespace {
+
+// The first four bytes of a snapshot ("RPSS" in little-endian), and the version of the format.
+const uint32_t SNAPSHOT_MAGIC = 0x53535052;
+const uint32_t SNAPSHOT_VERSION = 1;
+
+const std::size_t SNAPSHOT_HEADER_SIZE = sizeof(uint32_t) * 2;
+
+void append_uint32(std::vector<uint8_t> &bytes, uint32_t value) {
+  uint8_t const *begin = reinterpret_cast<uint8_t const *>(&value);
+  bytes.insert(bytes.end(), begin, begin + sizeof(uint32_t));
+}
+
+uint32_t read_uint32(std::vector<uint8_t> const &bytes, std::size_t offset) {
+  uint32_t value;
+  std::memcpy(&value, bytes.data() + offset, sizeof(uint32_t));
+  return value;
+}
+
+}
+
+Snapshot::Snapshot() : finished_(false) {
+  append_uint32(bytes_, SNAPSHOT_MAGIC);
+  append_uint32(bytes_, SNAPSHOT_VERSION);
+}
+
+Snapshot::Snapshot(std::vector<uint8_t> bytes) : bytes_(std::move(bytes)), finished_(true) {
+}
+
+void Snapshot::add_section(fw::net::PacketBuffer &section) {
+  append_uint32(bytes_, static_cast<uint32_t>(section.get_size()));
+  bytes_.insert(bytes_.end(), section.get_buffer(), section.get_buffer() + section.get_size());
+}
+
+void Snapshot::finish() {
+  fw::net::PacketBuffer end(kSnapshotSectionEnd, fw::net::kWireVersionCompact);
+  add_section(end);
+  finished_ = true;
+}
+
+fw::Status Snapshot::validate() const {
+  if (bytes_.size() < SNAPSHOT_HEADER_SIZE || read_uint32(bytes_, 0) != SNAPSHOT_MAGIC) {
+    return fw::ErrorStatus("not a snapshot");
+  }
+  const uint32_t version = read_uint32(bytes_, sizeof(uint32_t));
+  if (version != SNAPSHOT_VERSION) {
+    return fw::ErrorStatus("unsupported snapshot version ") << version;
+  }
+
+  std::size_t offset = SNAPSHOT_HEADER_SIZE;
+  while (offset < bytes_.size()) {
+    if (bytes_.size() - offset < sizeof(uint32_t)) {
+      return fw::ErrorStatus("snapshot is truncated");
+    }
+    const uint32_t size = read_uint32(bytes_, offset);
+    offset += sizeof(uint32_t);
+    if (size > bytes_.size() - offset) {
+      return fw::ErrorStatus("snapshot section is truncated");
+    }
+
+    fw::net::PacketBuffer section(bytes_.data() + offset, size);
+    RETURN_IF_ERROR(section.get_status());
+    if (section.get_packet_type() == kSnapshotSectionEnd) {
+      return fw::OkStatus();
+    }
+    offset += size;
+  }
+
+  return fw::ErrorStatus("snapshot has no end section");
+}
+
+fw::Status Snapshot::for_each_section(
+    uint16_t kind, std::function<fw::Status(fw::net::PacketBuffer &)> const &fn) const {
+  // validate() has already checked all the sizes, so we don't need to check them again here.
+  std::size_t offset = SNAPSHOT_HEADER_SIZE;
+  while (offset + sizeof(uint32_t) <= bytes_.size()) {
+    const uint32_t size = read_uint32(bytes_, offset);
+    offset += sizeof(uint32_t);
+
+    fw::net::PacketBuffer section(bytes_.data() + offset, size);
+    if (section.get_packet_type() == kSnapshotSectionEnd) {
+      break;
+    }
+    if (section.get_packet_type() == kind) {
+      RETURN_IF_ERROR(fn(section));
+      RETURN_IF_ERROR(section.get_status());
+    }
+    offset += size;
+  }
+  return fw::OkStatus();
+}
+
+fw::Status Snapshot::save(std::filesystem::path const &path) const {
+  if (!finished_) {
+    return fw::ErrorStatus("snapshot isn't finished");
+  }
+
+  std::ofstream outs(path, std::ios::binary | std::ios::trunc);
+  if (!outs) {
+    return fw::ErrorStatus("error creating snapshot: ") << path.string();
+  }
+  outs.write(reinterpret_cast<char const *>(bytes_.data()), bytes_.size());
+  if (!outs) {
+    return fw::ErrorStatus("error writing snapshot: ") << path.string();
+  }
+  return fw::OkStatus();
+}
+
+fw::StatusOr<std::shared_ptr<Snapshot>> Snapshot::load(std::filesystem::path const &path) {
+  std::ifstream ins(path, std::ios::binary | std::ios::ate);
+  if (!ins) {
+    return fw::ErrorStatus("error opening snapshot: ") << path.string();
+  }
+  const std::streamoff size = ins.tellg();
+  if (size < 0 || static_cast<std::size_t>(size) > kMaxSnapshotSize) {
+    return fw::ErrorStatus("invalid snapshot: ") << path.string();
+  }
+
+  // We read the whole thing with one call, rather than a section at a time.
+  std::vector<uint8_t> bytes(static_cast<std::size_t>(size));
+  ins.seekg(0);
+  ins.read(reinterpret_cast<char *>(bytes.data()), size);
+  if (!ins) {
+    return fw::ErrorStatus("error reading snapshot: ") << path.string();
+  }
+
+  auto snapshot = std::make_shared<Snapshot>(std::move(bytes));
+  RETURN_IF_ERROR(snapshot->validate());
+  return snapshot;
+}
+
+}
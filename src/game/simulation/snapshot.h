@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <framework/math.h>
+#include <framework/packet_buffer.h>
+#include <framework/status.h>
+
+namespace game {
+
+// A snapshot is the complete state of the simulation: every entity with its attributes and components, the turn we're
+// on and the commands queued up for later turns, the AI players' timers and the random number generator. Restoring
+// one puts the game back where it was, which is a lot quicker than replaying every command from the start (e.g. for a
+// player who joins a game that's already running).
+//
+// Like a replay, a snapshot is a magic number and a version followed by a series of sections. Each section is a uint32
+// length and then the bytes of a fw::net::PacketBuffer, whose packet type is the kind of section. The simulation
+// thread writes its sections first (see SimulationThread::request_snapshot()), then the EntityManager adds the entities
+// and one section for each type of component (see ent::EntityManager::write_snapshot()), and finally there's an end
+// section. Sections we don't know about are skipped.
+constexpr uint16_t kSnapshotSectionSimulation = 1;
+constexpr uint16_t kSnapshotSectionPlayers = 2;
+constexpr uint16_t kSnapshotSectionEntities = 3;
+constexpr uint16_t kSnapshotSectionComponents = 4;
+constexpr uint16_t kSnapshotSectionEnd = 5;
+
+// Anything bigger than this isn't a snapshot we wrote.
+constexpr std::size_t kMaxSnapshotSize = 256 * 1024 * 1024;
+
+class Snapshot {
+private:
+  std::vector<uint8_t> bytes_;
+  bool finished_;
+
+public:
+  // Creates an empty snapshot, ready to have sections added.
+  Snapshot();
+
+  // Creates a snapshot from the given bytes (e.g. that we've been sent by the host). Call validate() before you read
+  // anything from it.
+  explicit Snapshot(std::vector<uint8_t> bytes);
+
+  // Appends the given section. The section is written with its packet type as the kind of section.
+  void add_section(fw::net::PacketBuffer &section);
+
+  // Appends the end section. Nothing more can be added after this.
+  void finish();
+  bool is_finished() const {
+    return finished_;
+  }
+
+  // Checks that this is a snapshot we understand, and that none of its sections are truncated.
+  fw::Status validate() const;
+
+  // Calls fn with a reader over each section of the given kind, in the order they were written.
+  fw::Status for_each_section(uint16_t kind, std::function<fw::Status(fw::net::PacketBuffer &)> const &fn) const;
+
+  std::vector<uint8_t> const &get_bytes() const {
+    return bytes_;
+  }
+
+  // Writes a finished snapshot to the given file, and reads one back.
+  fw::Status save(std::filesystem::path const &path) const;
+  static fw::StatusOr<std::shared_ptr<Snapshot>> load(std::filesystem::path const &path);
+};
+
+// A snapshot has to put things back exactly as they were, so floats and vectors are written as their raw bits, never
+// in the compact (quantized) position encoding.
+inline void write_raw(fw::net::PacketBuffer &buffer, float value) {
+  buffer.add_bytes(&value, sizeof(float));
+}
+
+inline void write_raw(fw::net::PacketBuffer &buffer, fw::Vector const &value) {
+  buffer.add_bytes(value.v, sizeof(float) * 3);
+}
+
+inline void read_raw(fw::net::PacketBuffer &buffer, float &value) {
+  buffer.read(&value, sizeof(float));
+}
+
+inline void read_raw(fw::net::PacketBuffer &buffer, fw::Vector &value) {
+  float v[3];
+  buffer.read(v, sizeof(float) * 3);
+  value = fw::Vector(v[0], v[1], v[2]);
+}
+
+}
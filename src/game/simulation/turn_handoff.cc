@@ -0,0 +1,101 @@
+#include <game/simulation/turn_handoff.h>
+
+#include <chrono>
+
+#include <game/simulation/commands.h>
+
+namespace game {
+
+TurnHandoff::TurnHandoff(std::size_t capacity) :
+    queue_(capacity), max_depth_(0), max_latency_us_(0), total_latency_us_(0), num_applied_(0),
+    num_backpressure_stalls_(0), frames_owed_(0) {
+}
+
+void TurnHandoff::push(TurnBundle &&bundle) {
+  bundle.closed_time = fw::Clock::now();
+  if (!overflow_.empty() || !queue_.try_push(std::move(bundle))) {
+    overflow_.push_back(std::move(bundle));
+  }
+  update_max_depth();
+}
+
+bool TurnHandoff::try_flush() {
+  while (!overflow_.empty()) {
+    if (!queue_.try_push(std::move(overflow_.front()))) {
+      return false;
+    }
+    overflow_.pop_front();
+  }
+  return true;
+}
+
+void TurnHandoff::on_backpressure_stall() {
+  num_backpressure_stalls_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TurnHandoff::update_max_depth() {
+  // Only the simulation thread writes max_depth_, so we don't need a compare-and-swap.
+  const int depth = static_cast<int>(queue_.size() + overflow_.size());
+  if (depth > max_depth_.load(std::memory_order_relaxed)) {
+    max_depth_.store(depth, std::memory_order_relaxed);
+  }
+}
+
+int TurnHandoff::apply_pending() {
+  int num_applied = 0;
+  TurnBundle bundle;
+  while (frames_owed_ == 0 && queue_.try_pop(bundle)) {
+    for (std::shared_ptr<Command> &cmd : bundle.commands) {
+      cmd->execute();
+    }
+    if (bundle.on_executed) {
+      bundle.on_executed();
+    }
+    for (auto &fn : bundle.after_commands) {
+      fn();
+    }
+
+    const int64_t latency_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(fw::Clock::now() - bundle.closed_time).count();
+    total_latency_us_.fetch_add(latency_us, std::memory_order_relaxed);
+    if (latency_us > max_latency_us_.load(std::memory_order_relaxed)) {
+      max_latency_us_.store(latency_us, std::memory_order_relaxed);
+    }
+    num_applied_.fetch_add(1, std::memory_order_relaxed);
+    num_applied++;
+
+    // Let go of the commands now, rather than whenever this slot is next reused.
+    const bool has_after_commands = !bundle.after_commands.empty();
+    frames_owed_ = bundle.num_frames;
+    bundle = TurnBundle();
+    if (has_after_commands) {
+      break;
+    }
+  }
+  return num_applied;
+}
+
+bool TurnHandoff::take_frame() {
+  if (frames_owed_ == 0) {
+    return false;
+  }
+  frames_owed_--;
+  return true;
+}
+
+TurnHandoffStats TurnHandoff::get_stats() const {
+  TurnHandoffStats stats;
+  // This doesn't include the overflow (which only the simulation thread can look at), but if there's anything in the
+  // overflow then the queue is full anyway.
+  stats.depth = static_cast<int>(queue_.size());
+  stats.max_depth = max_depth_.load(std::memory_order_relaxed);
+  stats.num_applied = num_applied_.load(std::memory_order_relaxed);
+  stats.max_latency_ms = max_latency_us_.load(std::memory_order_relaxed) / 1000.0f;
+  if (stats.num_applied > 0) {
+    stats.mean_latency_ms = total_latency_us_.load(std::memory_order_relaxed) / (stats.num_applied * 1000.0f);
+  }
+  stats.num_backpressure_stalls = num_backpressure_stalls_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}
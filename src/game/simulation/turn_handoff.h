@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <framework/spsc_queue.h>
+#include <framework/timer.h>
+
+namespace game {
+class Command;
+
+typedef uint32_t turn_id;
+
+// The update thread runs the simulation in frames of this many milliseconds (the Framework updates 40 times a second),
+// and every turn is a whole number of them.
+constexpr int kFrameMs = 1000 / 40;
+
+// Everything the update thread has to do for one turn of the simulation: the commands to execute, in order, then
+// anything else that has to happen after them (e.g. handing a snapshot request to the EntityManager), and then the
+// frames of the simulation to run before the next turn.
+struct TurnBundle {
+  turn_id turn = 0;
+  std::vector<std::shared_ptr<Command>> commands;
+  std::vector<std::function<void()>> after_commands;
+  int num_frames = 0;
+
+  // If set, this is called as soon as the commands have been executed, before the after_commands and before anything
+  // else touches the entities. This is how the simulation thread gets the state hash as of the end of this turn.
+  std::function<void()> on_executed;
+
+  // When the simulation thread closed the turn and handed it off.
+  fw::Clock::time_point closed_time;
+};
+
+// How the update thread is keeping up with the turns the simulation thread hands it.
+struct TurnHandoffStats {
+  // The number of turns waiting to be applied right now, and the most there have ever been.
+  int depth = 0;
+  int max_depth = 0;
+
+  // The time between the simulation thread closing a turn and the update thread applying it.
+  float mean_latency_ms = 0.0f;
+  float max_latency_ms = 0.0f;
+
+  uint64_t num_applied = 0;
+
+  // The number of times the simulation thread held off starting a turn because the update thread was too far behind.
+  uint64_t num_backpressure_stalls = 0;
+};
+
+// The simulation thread decides which commands run on which turn, but the commands themselves change the entities,
+// which belong to the update thread. So rather than executing commands itself, the simulation thread hands each turn
+// over to the update thread through a lock-free single-producer/single-consumer queue, and the update thread applies
+// them (in order) at the start of its next update.
+//
+// The update thread then runs each turn's frames (see take_frame()) before it applies the next turn, so that every
+// peer runs exactly the same frames between one turn's commands and the next, however far behind its update thread
+// happens to be.
+//
+// push() and try_flush() must only be called from the simulation thread, and apply_pending() and take_frame() only
+// from the update thread. get_stats() is safe to call from anywhere.
+class TurnHandoff {
+private:
+  fw::SpscQueue<TurnBundle> queue_;
+
+  // Turns that didn't fit in the queue, oldest first. Only the simulation thread touches this: it pushes these before
+  // anything newer, and doesn't start another turn until they've all gone (see try_flush()).
+  std::deque<TurnBundle> overflow_;
+
+  std::atomic<int> max_depth_;
+  std::atomic<int64_t> max_latency_us_;
+  std::atomic<int64_t> total_latency_us_;
+  std::atomic<uint64_t> num_applied_;
+  std::atomic<uint64_t> num_backpressure_stalls_;
+
+  // The frames of the last turn we applied that the update thread hasn't run yet. Only the update thread touches this.
+  int frames_owed_;
+
+  void update_max_depth();
+
+public:
+  explicit TurnHandoff(std::size_t capacity);
+
+  // Hands the given turn over to the update thread. This never fails: if the queue is full, the turn waits on our side
+  // until there's room.
+  void push(TurnBundle &&bundle);
+
+  // Moves whatever's waiting on our side into the queue, and returns true if it all fit. The simulation thread
+  // shouldn't start another turn until this returns true, that's what stops it getting too far ahead of the update
+  // thread.
+  bool try_flush();
+
+  // Records that the simulation thread waited because try_flush() returned false.
+  void on_backpressure_stall();
+
+  // Executes the commands in each turn that's been handed to us, oldest first, and returns the number of turns
+  // applied. We stop after a turn with frames (the next turn has to wait until they've run), and after a turn with
+  // after_commands, so that they see the state as of the end of that turn (and not some later turn) when the update
+  // that follows gets to them.
+  int apply_pending();
+
+  // Returns true if the turns we've applied have a frame of the simulation for the update thread to run now (and
+  // counts it as run). If this returns false, the simulation has to wait for the next turn.
+  bool take_frame();
+
+  TurnHandoffStats get_stats() const;
+};
+
+}
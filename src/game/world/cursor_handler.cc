@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <functional>
+#include <limits>
 
 #include <framework/cursor.h>
 #include <framework/input.h>
@@ -126,6 +128,8 @@ void CursorHandler::on_key_select(std::string, bool is_down) {
     } else {
       std::shared_ptr<MoveOrder> order(create_order<MoveOrder>());
       order->goal = terrain_->get_cursor_location();
+      order->group_size = static_cast<uint16_t>(
+          std::min(entities_->get_selection().size(), static_cast<size_t>(std::numeric_limits<uint16_t>::max())));
 //      LOG(DBG) << "cursor_location: " << order->goal;
       for (auto it = entities_->get_selection().begin(); it != entities_->get_selection().end(); ++it) {
         std::shared_ptr<ent::Entity> ent = it->lock();
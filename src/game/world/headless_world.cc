@@ -0,0 +1,50 @@
+#include <game/world/headless_world.h>
+
+namespace game {
+
+HeadlessTerrain::HeadlessTerrain(int width, int length, float *height_data) :
+    Terrain(width, length, height_data) {
+}
+
+HeadlessTerrain::~HeadlessTerrain() {
+}
+
+fw::Status HeadlessTerrain::initialize() {
+  return fw::OkStatus();
+}
+
+void HeadlessTerrain::update() {
+}
+
+void HeadlessTerrain::set_layer(int, fw::Bitmap const &) {
+}
+
+void HeadlessTerrain::set_splatt(int, int, fw::Bitmap const &) {
+}
+
+//-------------------------------------------------------------------------
+
+HeadlessWorldReader::HeadlessWorldReader() {
+}
+
+fw::StatusOr<std::shared_ptr<Terrain>> HeadlessWorldReader::create_terrain(
+    int width, int length, float* height_data) {
+  auto terrain = std::make_shared<HeadlessTerrain>(width, length, height_data);
+  RETURN_IF_ERROR(terrain->initialize());
+  return std::static_pointer_cast<Terrain>(terrain);
+}
+
+//-------------------------------------------------------------------------
+
+HeadlessWorld::HeadlessWorld(std::shared_ptr<WorldReader> reader) :
+    World(reader) {
+}
+
+HeadlessWorld::~HeadlessWorld() {
+}
+
+void HeadlessWorld::initialize_presentation() {
+  // Nobody's watching.
+}
+
+}
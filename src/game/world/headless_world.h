@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+
+#include <framework/status.h>
+
+#include <game/world/terrain.h>
+#include <game/world/world.h>
+#include <game/world/world_reader.h>
+
+namespace game {
+
+// A Terrain that only has the heightfield (and collision data), with no textures or vertex buffers. This is what we
+// use when there's no graphics, e.g. when playing back a replay.
+class HeadlessTerrain: public Terrain {
+public:
+  HeadlessTerrain(int width, int length, float *height_data);
+  virtual ~HeadlessTerrain();
+
+  fw::Status initialize() override;
+  void update() override;
+  void set_layer(int number, fw::Bitmap const &bitmap) override;
+  void set_splatt(int patch_x, int patch_z, fw::Bitmap const &bmp) override;
+};
+
+// A WorldReader that creates a HeadlessTerrain.
+class HeadlessWorldReader: public WorldReader {
+protected:
+  fw::StatusOr<std::shared_ptr<Terrain>> create_terrain(int width, int length, float* height_data) override;
+
+public:
+  HeadlessWorldReader();
+};
+
+// The world without graphics: the same terrain, entities and pathing, but nothing to look at or interact with (no
+// particles, cursor or key bindings). Nothing calls update() on this, the owner updates the entities directly.
+class HeadlessWorld: public World {
+protected:
+  void initialize_presentation() override;
+
+public:
+  HeadlessWorld(std::shared_ptr<WorldReader> reader);
+  virtual ~HeadlessWorld();
+};
+
+}
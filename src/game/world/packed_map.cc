@@ -0,0 +1,346 @@
+#include <game/world/packed_map.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <absl/strings/str_cat.h>
+
+#include <framework/bitmap.h>
+#include <framework/logging.h>
+#include <framework/pack_file.h>
+#include <framework/paths.h>
+#include <framework/status.h>
+#include <framework/xml.h>
+
+#include <game/world/terrain.h>
+
+namespace fs = std::filesystem;
+
+namespace game {
+namespace {
+
+const int32_t HEIGHTFIELD_VERSION = 1;
+const int32_t COLLISION_DATA_VERSION = 2;
+
+// The version of the loose collision_data file, which has a byte per vertex.
+const int32_t LOOSE_COLLISION_DATA_VERSION = 1;
+
+struct HeightfieldHeader {
+  int32_t version;
+  int32_t width;
+  int32_t length;
+};
+
+struct CollisionDataHeader {
+  int32_t version;
+  int32_t width;
+  int32_t length;
+
+  // So that the words after the header are 8-byte aligned.
+  int32_t padding;
+};
+
+struct ImageHeader {
+  int32_t width;
+  int32_t height;
+};
+
+// Maps are nowhere near this big, anything bigger is a corrupt file. This also keeps width * length (and a few times
+// that) well inside an int, which is what everything downstream counts vertices with.
+const int32_t MAX_SIZE = 1 << 14;
+
+bool is_valid_size(int32_t width, int32_t length) {
+  return width > 0 && length > 0 && width <= MAX_SIZE && length <= MAX_SIZE;
+}
+
+// The number of values in a width x length grid. The header values come straight from the file, so we do the
+// arithmetic in size_t before checking anything against them.
+size_t get_count(int32_t width, int32_t length) {
+  return static_cast<size_t>(width) * static_cast<size_t>(length);
+}
+
+template<typename T>
+void append(std::vector<uint8_t> &data, T const *values, size_t count) {
+  uint8_t const *bytes = reinterpret_cast<uint8_t const *>(values);
+  data.insert(data.end(), bytes, bytes + count * sizeof(T));
+}
+
+fw::StatusOr<std::vector<uint8_t>> read_file(fs::path const &path) {
+  std::ifstream ins(path, std::ios::binary);
+  if (!ins) {
+    return fw::ErrorStatus("error opening ") << path.string();
+  }
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(ins), std::istreambuf_iterator<char>());
+}
+
+// Reads the (version 1) heightfield file from a loose map and checks that it looks right.
+fw::StatusOr<std::vector<uint8_t>> read_loose_heightfield(fs::path const &path, HeightfieldHeader &header) {
+  ASSIGN_OR_RETURN(std::vector<uint8_t> data, read_file(path));
+  if (data.size() < sizeof(header)) {
+    return fw::ErrorStatus("heightfield is truncated: ") << path.string();
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.version != HEIGHTFIELD_VERSION) {
+    return fw::ErrorStatus("unknown terrain version: ") << header.version;
+  }
+  if (!is_valid_size(header.width, header.length)
+      || data.size() != sizeof(header) + get_count(header.width, header.length) * sizeof(float)) {
+    return fw::ErrorStatus("heightfield is the wrong size: ") << path.string();
+  }
+  return data;
+}
+
+// Reads the (version 1) collision_data file from a loose map.
+fw::Status read_loose_collision_data(
+    fs::path const &path, int &width, int &length, std::vector<bool> &collision_data) {
+  ASSIGN_OR_RETURN(std::vector<uint8_t> data, read_file(path));
+  int32_t header[3];
+  if (data.size() < sizeof(header)) {
+    return fw::ErrorStatus("collision_data is truncated: ") << path.string();
+  }
+  memcpy(header, data.data(), sizeof(header));
+  if (header[0] != LOOSE_COLLISION_DATA_VERSION) {
+    return fw::ErrorStatus("unknown collision_data version: ") << header[0];
+  }
+  width = header[1];
+  length = header[2];
+  if (!is_valid_size(width, length) || data.size() != sizeof(header) + get_count(width, length)) {
+    return fw::ErrorStatus("collision_data is the wrong size: ") << path.string();
+  }
+
+  collision_data.resize(get_count(width, length));
+  for (size_t i = 0; i < collision_data.size(); i++) {
+    collision_data[i] = data[sizeof(header) + i] != 0;
+  }
+  return fw::OkStatus();
+}
+
+}
+
+std::string GetPackedSplattEntry(int patch_x, int patch_z) {
+  return absl::StrCat("splatt-", patch_x, "-", patch_z);
+}
+
+void PackHeightfield(fw::PackWriter &pack, int width, int length, float const *heights) {
+  HeightfieldHeader header;
+  header.version = HEIGHTFIELD_VERSION;
+  header.width = width;
+  header.length = length;
+
+  std::vector<uint8_t> data;
+  data.reserve(sizeof(header) + width * length * sizeof(float));
+  append(data, &header, 1);
+  append(data, heights, width * length);
+  pack.add(kPackedHeightfieldEntry, data);
+}
+
+void PackCollisionData(fw::PackWriter &pack, fw::PassabilityGrid const &passability) {
+  const int width = passability.get_width();
+  const int length = passability.get_length();
+
+  CollisionDataHeader header;
+  header.version = COLLISION_DATA_VERSION;
+  header.width = width;
+  header.length = length;
+  header.padding = 0;
+
+  std::vector<uint64_t> words((width * length + 63) / 64);
+  if (width % 64 == 0) {
+    for (int z = 0; z < length; z++) {
+      std::span<uint64_t const> row = passability.get_row(z);
+      std::copy(row.begin(), row.end(), words.begin() + (z * passability.get_words_per_row()));
+    }
+  } else {
+    for (int z = 0; z < length; z++) {
+      for (int x = 0; x < width; x++) {
+        const int i = (z * width) + x;
+        if (passability.is_passable(x, z)) {
+          words[i / 64] |= uint64_t(1) << (i % 64);
+        }
+      }
+    }
+  }
+
+  std::vector<uint8_t> data;
+  append(data, &header, 1);
+  append(data, words.data(), words.size());
+  pack.add(kPackedCollisionDataEntry, data);
+}
+
+void PackImage(fw::PackWriter &pack, std::string const &name, fw::Bitmap const &bitmap) {
+  ImageHeader header;
+  header.width = bitmap.get_width();
+  header.height = bitmap.get_height();
+
+  std::vector<uint8_t> data;
+  append(data, &header, 1);
+  if (header.width > 0 && header.height > 0) {
+    append(data, bitmap.GetPixels().data(), header.width * header.height);
+  }
+  pack.add(name, data, fw::PackCompression::kLz4);
+}
+
+void PackText(fw::PackWriter &pack, std::string const &name, std::string const &text) {
+  pack.add(name, std::span<uint8_t const>(reinterpret_cast<uint8_t const *>(text.data()), text.size()));
+}
+
+fw::StatusOr<PackedHeightfield> ReadPackedHeightfield(fw::PackReader const &pack) {
+  ASSIGN_OR_RETURN(std::span<uint8_t const> data, pack.get_entry_data(kPackedHeightfieldEntry));
+  HeightfieldHeader header;
+  if (data.size() < sizeof(header)) {
+    return fw::ErrorStatus("heightfield is truncated");
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.version != HEIGHTFIELD_VERSION) {
+    return fw::ErrorStatus("unknown terrain version: ") << header.version;
+  }
+  if (!is_valid_size(header.width, header.length)
+      || data.size() != sizeof(header) + get_count(header.width, header.length) * sizeof(float)) {
+    return fw::ErrorStatus("heightfield is the wrong size");
+  }
+
+  // The entry is aligned (see fw::PackWriter) and the header is a multiple of four bytes, so the heights are aligned.
+  PackedHeightfield heightfield;
+  heightfield.width = header.width;
+  heightfield.length = header.length;
+  heightfield.heights = std::span<float const>(
+      reinterpret_cast<float const *>(data.data() + sizeof(header)), get_count(header.width, header.length));
+  return heightfield;
+}
+
+fw::Status ReadPackedCollisionData(fw::PackReader const &pack, fw::PassabilityGrid &passability) {
+  ASSIGN_OR_RETURN(std::span<uint8_t const> data, pack.get_entry_data(kPackedCollisionDataEntry));
+  CollisionDataHeader header;
+  if (data.size() < sizeof(header)) {
+    return fw::ErrorStatus("collision_data is truncated");
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.version != COLLISION_DATA_VERSION) {
+    return fw::ErrorStatus("unknown collision_data version: ") << header.version;
+  }
+  if (!is_valid_size(header.width, header.length)
+      || data.size() != sizeof(header) + ((get_count(header.width, header.length) + 63) / 64) * sizeof(uint64_t)) {
+    return fw::ErrorStatus("collision_data is the wrong size");
+  }
+  if (header.width != passability.get_width() || header.length != passability.get_length()) {
+    return fw::ErrorStatus("collision_data is ") << header.width << "x" << header.length << ", but the map is "
+        << passability.get_width() << "x" << passability.get_length();
+  }
+
+  uint64_t const *words = reinterpret_cast<uint64_t const *>(data.data() + sizeof(header));
+  if (header.width % 64 == 0) {
+    for (int z = 0; z < header.length; z++) {
+      passability.set_row(z, words + (z * passability.get_words_per_row()));
+    }
+  } else {
+    const int num_vertices = header.width * header.length;
+    for (int i = 0; i < num_vertices; i++) {
+      passability.set_passable(i % header.width, i / header.width, (words[i / 64] >> (i % 64)) & 1);
+    }
+  }
+  return fw::OkStatus();
+}
+
+fw::StatusOr<fw::Bitmap> ReadPackedImage(fw::PackReader const &pack, std::string const &name) {
+  ASSIGN_OR_RETURN(std::vector<uint8_t> data, pack.read_entry(name));
+  ImageHeader header;
+  if (data.size() < sizeof(header)) {
+    return fw::ErrorStatus("image is truncated: ") << name;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.width == 0 && header.height == 0 && data.size() == sizeof(header)) {
+    return fw::Bitmap();
+  }
+  if (!is_valid_size(header.width, header.height)
+      || data.size() != sizeof(header) + get_count(header.width, header.height) * sizeof(uint32_t)) {
+    return fw::ErrorStatus("image is the wrong size: ") << name;
+  }
+
+  // The Bitmap copies the pixels.
+  return fw::Bitmap(header.width, header.height, reinterpret_cast<uint32_t *>(data.data() + sizeof(header)));
+}
+
+fw::StatusOr<fw::XmlElement> ReadPackedMapdesc(fw::PackReader const &pack) {
+  ASSIGN_OR_RETURN(std::vector<uint8_t> data, pack.read_entry(kPackedMapdescEntry));
+  fw::XmlElement root(std::string_view(reinterpret_cast<char const *>(data.data()), data.size()));
+  if (!root.is_valid() || root.get_value() != "mapdesc") {
+    return fw::ErrorStatus("invalid mapdesc");
+  }
+  auto version = root.GetAttribute("version");
+  if (version.ok() && *version != "1") {
+    return fw::ErrorStatus("invalid mapdesc version: ") << *version;
+  }
+  return root;
+}
+
+fw::Status ConvertToPackedMap(fs::path const &map_dir, fs::path const &packed_path) {
+  const std::string name = map_dir.filename().string();
+  fw::PackWriter pack;
+
+  // The loose heightfield is exactly the same as the packed one.
+  HeightfieldHeader header;
+  ASSIGN_OR_RETURN(std::vector<uint8_t> heightfield, read_loose_heightfield(map_dir / "heightfield", header));
+  pack.add(kPackedHeightfieldEntry, heightfield);
+
+  for (int patch_z = 0; patch_z < header.length / Terrain::PATCH_SIZE; patch_z++) {
+    for (int patch_x = 0; patch_x < header.width / Terrain::PATCH_SIZE; patch_x++) {
+      ASSIGN_OR_RETURN(
+          fw::Bitmap splatt, fw::LoadBitmap(map_dir / absl::StrCat("splatt-", patch_x, "-", patch_z, ".png")));
+      PackImage(pack, GetPackedSplattEntry(patch_x, patch_z), splatt);
+    }
+  }
+
+  if (fs::exists(map_dir / "minimap.png")) {
+    ASSIGN_OR_RETURN(fw::Bitmap minimap, fw::LoadBitmap(map_dir / "minimap.png"));
+    PackImage(pack, kPackedMinimapEntry, minimap);
+  }
+  if (fs::exists(map_dir / "screenshot.png")) {
+    ASSIGN_OR_RETURN(fw::Bitmap screenshot, fw::LoadBitmap(map_dir / "screenshot.png"));
+    PackImage(pack, kPackedScreenshotEntry, screenshot);
+  }
+
+  fs::path mapdesc_path = map_dir / (name + ".mapdesc");
+  if (fs::exists(mapdesc_path)) {
+    ASSIGN_OR_RETURN(std::vector<uint8_t> mapdesc, read_file(mapdesc_path));
+    pack.add(kPackedMapdescEntry, mapdesc);
+  }
+
+  if (fs::exists(map_dir / "collision_data")) {
+    int width, length;
+    std::vector<bool> collision_data;
+    RETURN_IF_ERROR(read_loose_collision_data(map_dir / "collision_data", width, length, collision_data));
+    PackCollisionData(pack, fw::PassabilityGrid(width, length, collision_data));
+  }
+
+  return pack.write(packed_path);
+}
+
+fw::Status ConvertAllMaps() {
+  int num_converted = 0;
+  for (fs::path const &base : {fw::install_base_path() / "maps", fw::user_base_path() / "maps"}) {
+    if (!fs::is_directory(base)) {
+      continue;
+    }
+    for (fs::directory_iterator it(base); it != fs::directory_iterator(); ++it) {
+      fs::path map_dir(*it);
+      if (!fs::is_directory(map_dir)) {
+        continue;
+      }
+
+      fs::path packed_path = base / (map_dir.filename().string() + kPackedMapExtension);
+      LOG(INFO) << "converting " << map_dir.string() << " to " << packed_path.string();
+      auto status = ConvertToPackedMap(map_dir, packed_path);
+      if (!status.ok()) {
+        return fw::ErrorStatus("error converting ") << map_dir.string() << ": " << status.message();
+      }
+      num_converted++;
+    }
+  }
+
+  LOG(INFO) << "converted " << num_converted << " map(s)";
+  return fw::OkStatus();
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <framework/bitmap.h>
+#include <framework/pack_file.h>
+#include <framework/passability_grid.h>
+#include <framework/status.h>
+#include <framework/xml.h>
+
+namespace game {
+
+// A packed map is a whole map in a single fw::PackReader file called <name>.rpmap, sitting alongside the map
+// directories. Loading one is a handful of reads from a memory-mapped file, rather than opening (and decoding) a few
+// hundred little files. The entries are:
+//
+//  - "heightfield": the same as the loose heightfield file (int32 version, width and length, then the heights as
+//    floats). Stored uncompressed, so the heights can be used straight out of the mapping.
+//  - "collision_data": int32 version (2), width and length, four bytes of padding, then one bit per vertex in uint64
+//    words (vertex i is bit i % 64 of word i / 64). Also uncompressed. When the width is a multiple of 64 (as it is for
+//    every map the editor makes) that's exactly the layout of fw::PassabilityGrid, so it's copied in a row at a time.
+//    The slopes aren't stored: the terrain works them out from the heights.
+//  - "splatt-X-Z": the splatt for patch (X, Z) as an image (see below), LZ4-compressed.
+//  - "minimap" and "screenshot": images, LZ4-compressed.
+//  - "mapdesc": the text of the <mapdesc> XML file.
+//
+// Images are int32 width and height and then the RGBA pixels, so there's no decoding them.
+constexpr char const *kPackedMapExtension = ".rpmap";
+constexpr char const *kPackedHeightfieldEntry = "heightfield";
+constexpr char const *kPackedCollisionDataEntry = "collision_data";
+constexpr char const *kPackedMinimapEntry = "minimap";
+constexpr char const *kPackedScreenshotEntry = "screenshot";
+constexpr char const *kPackedMapdescEntry = "mapdesc";
+
+std::string GetPackedSplattEntry(int patch_x, int patch_z);
+
+// The heights of a packed map, pointing right into the mapped file.
+struct PackedHeightfield {
+  int width;
+  int length;
+  std::span<float const> heights;
+};
+
+void PackHeightfield(fw::PackWriter &pack, int width, int length, float const *heights);
+void PackCollisionData(fw::PackWriter &pack, fw::PassabilityGrid const &passability);
+void PackImage(fw::PackWriter &pack, std::string const &name, fw::Bitmap const &bitmap);
+void PackText(fw::PackWriter &pack, std::string const &name, std::string const &text);
+
+fw::StatusOr<PackedHeightfield> ReadPackedHeightfield(fw::PackReader const &pack);
+// Reads the passability into the given grid, which must already be the size of the map. The slopes are left alone.
+fw::Status ReadPackedCollisionData(fw::PackReader const &pack, fw::PassabilityGrid &passability);
+fw::StatusOr<fw::Bitmap> ReadPackedImage(fw::PackReader const &pack, std::string const &name);
+fw::StatusOr<fw::XmlElement> ReadPackedMapdesc(fw::PackReader const &pack);
+
+// Packs the loose map in the given directory into the given packed map file.
+fw::Status ConvertToPackedMap(std::filesystem::path const &map_dir, std::filesystem::path const &packed_path);
+
+// Packs every map directory in the install and user maps directories into a packed map next to it. This is what
+// --convert-maps does.
+fw::Status ConvertAllMaps();
+
+}
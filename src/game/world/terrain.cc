@@ -1,5 +1,8 @@
 #include <game/world/terrain.h>
 
+#include <filesystem>
+#include <vector>
+
 #include <framework/graphics.h>
 #include <framework/misc.h>
 #include <framework/paths.h>
@@ -12,8 +15,10 @@
 #include <framework/scenegraph.h>
 #include <framework/shader.h>
 #include <framework/status.h>
+#include <framework/thread_pool.h>
 
 #include <game/world/terrain_helper.h>
+#include <game/world/world_reader.h>
 
 namespace game {
 
@@ -26,6 +31,9 @@ Terrain::Terrain(int width, int height, float* height_data /*= nullptr*/) :
     for (int i = 0; i < width_ * length_; i++)
       heights_[i] = 0.0f;
   }
+  height_field_.reset(width_, length_, heights_);
+  height_pyramid_.reset(height_field_);
+  passability_ = std::make_shared<fw::PassabilityGrid>(height_field_, MIN_PASSABLE_SLOPE);
 }
 
 Terrain::~Terrain() {
@@ -33,13 +41,18 @@ Terrain::~Terrain() {
 }
 
 fw::Status Terrain::initialize() {
+  // make sure the patches are all there before we start touching them from other threads
+  ensure_patches();
+
   // generate indices
   std::vector<uint16_t> index_data;
   generate_terrain_indices(index_data, PATCH_SIZE);
 
+  fw::ThreadPool thread_pool(GetNumLoaderThreads());
+
   // TODO: this should come from the world_reader
   textures_ = std::make_shared<fw::TextureArray>(512, 512);
-  const auto bitmap_names = {
+  const std::vector<std::filesystem::path> bitmap_names = {
     fw::resolve("terrain/grass-01.jpg"),
     fw::resolve("terrain/rock-01.jpg"),
     fw::resolve("terrain/rock-01.jpg"),
@@ -49,22 +62,28 @@ fw::Status Terrain::initialize() {
     fw::resolve("terrain/grass-02.jpg"),
     fw::resolve("terrain/road-01.png"),
   };
-  int index = 0;
-  for (const auto& bitmap_name : bitmap_names) {
-     ASSIGN_OR_RETURN(auto bitmap, fw::LoadBitmap(bitmap_name));
-     set_layer(index++, bitmap);
+
+  // Decode the layers in parallel, but add them to the texture array in order.
+  std::vector<fw::Bitmap> bitmaps(bitmap_names.size());
+  std::vector<fw::Status> statuses(bitmap_names.size());
+  thread_pool.parallel_for(bitmap_names.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      auto bitmap = fw::LoadBitmap(bitmap_names[i]);
+      if (bitmap.ok()) {
+        bitmaps[i] = *bitmap;
+      } else {
+        statuses[i] = bitmap.status();
+      }
+    }
+  });
+  for (size_t i = 0; i < bitmaps.size(); i++) {
+    RETURN_IF_ERROR(statuses[i]);
+    set_layer(static_cast<int>(i), bitmaps[i]);
   }
 
   std::shared_ptr<fw::sg::Node> root_node = root_node_;
   fw::Framework::get_instance()->get_scenegraph_manager()->enqueue(
     [root_node, this, index_data](fw::sg::Scenegraph& scenegraph) {
-      // bake the patches into the vertex buffers that'll be used for rendering
-      for (int patch_z = 0; patch_z < get_patches_length(); patch_z++) {
-        for (int patch_x = 0; patch_x < get_patches_width(); patch_x++) {
-          bake_patch(patch_x, patch_z);
-        }
-      }
-
       ib_ = std::make_shared<fw::IndexBuffer>();
       ib_->set_data(index_data.size(), &index_data[0], 0);
 
@@ -73,6 +92,23 @@ fw::Status Terrain::initialize() {
 
       scenegraph.add_node(root_node);
     });
+
+  // Generate the vertices for the patches on the thread pool, and hand each one over to the render thread as soon as
+  // it's done. The render thread uploads whatever's ready before each frame, rather than baking every patch in one go.
+  thread_pool.parallel_for(get_patches_width() * get_patches_length(), 1, [this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const int patch_x = static_cast<int>(i) % get_patches_width();
+      const int patch_z = static_cast<int>(i) / get_patches_width();
+
+      fw::vertex::xyz_n *vert_data;
+      const int num_verts = generate_terrain_vertices(&vert_data, height_field_, PATCH_SIZE, patch_x, patch_z);
+      std::shared_ptr<fw::vertex::xyz_n[]> vertices(vert_data);
+      fw::Framework::get_instance()->get_scenegraph_manager()->enqueue(
+        [this, patch_x, patch_z, vertices, num_verts](fw::sg::Scenegraph&) {
+          upload_patch(patch_x, patch_z, vertices.get(), num_verts);
+        });
+    }
+  });
   return fw::OkStatus();
 }
 
@@ -112,7 +148,16 @@ std::shared_ptr<fw::Texture> Terrain::create_splatt(fw::Bitmap const& bmp) {
 }
 
 void Terrain::bake_patch(int patch_x, int patch_z) {
-  unsigned int index = get_patch_index(patch_x, patch_z, &patch_x, &patch_z);
+  get_patch_index(patch_x, patch_z, &patch_x, &patch_z);
+
+  fw::vertex::xyz_n *vert_data;
+  int num_verts = generate_terrain_vertices(&vert_data, height_field_, PATCH_SIZE, patch_x, patch_z);
+  upload_patch(patch_x, patch_z, vert_data, num_verts);
+  delete[] vert_data;
+}
+
+void Terrain::upload_patch(int patch_x, int patch_z, fw::vertex::xyz_n const *vert_data, int num_verts) {
+  unsigned int index = get_patch_index(patch_x, patch_z);
   ensure_patches();
 
   // if we haven't created the vertex buffer for this patch yet, do it now
@@ -120,17 +165,32 @@ void Terrain::bake_patch(int patch_x, int patch_z) {
     patches_[index]->vb = fw::VertexBuffer::create<fw::vertex::xyz_n>();
   }
 
-  fw::vertex::xyz_n *vert_data;
-  int num_verts = generate_terrain_vertices(&vert_data, heights_, width_, length_, PATCH_SIZE, patch_x, patch_z);
-
   std::shared_ptr<TerrainPatch> patch(patches_[index]);
   patch->vb->set_data(num_verts, vert_data, 0);
-  delete[] vert_data;
 
   patch->shader_params = shader_->CreateParameters();
   patch->shader_params->set_texture("textures", textures_);
 }
 
+void Terrain::upload_patch_rect(
+    int patch_x, int patch_z, fw::Rectangle<int> const &rect, fw::vertex::xyz_n const *vert_data) {
+  unsigned int index = get_patch_index(patch_x, patch_z);
+  ensure_patches();
+
+  std::shared_ptr<TerrainPatch> patch(patches_[index]);
+  if (patch->vb == std::shared_ptr<fw::VertexBuffer>()) {
+    // We've never uploaded this patch at all, so it all needs to go.
+    bake_patch(patch_x, patch_z);
+    return;
+  }
+
+  // Each row of the rectangle is a contiguous run of vertices in the buffer.
+  for (int z = 0; z < rect.height; z++) {
+    patch->vb->set_sub_data(
+        ((rect.top + z) * (PATCH_SIZE + 1)) + rect.left, rect.width, vert_data + (z * rect.width));
+  }
+}
+
 void Terrain::ensure_patches() {
   unsigned int index = get_patch_index(get_patches_width() - 1,
       get_patches_length() - 1);
@@ -216,28 +276,13 @@ int Terrain::get_patch_index(int patch_x, int patch_z, int *new_patch_x, int *ne
 }
 
 float Terrain::get_vertex_height(int x, int z) {
-  return heights_[fw::constrain(z, length_) * width_ + fw::constrain(x, width_)];
+  return height_field_.get_vertex_height(x, z);
 }
 
-// this method is pretty simple. we basically get the height at (x, z) then interpolate that value between (x+1, z+1).
+// we get the height at (x, z) then interpolate that value between (x+1, z+1). The height field does the work (and
+// does the wrapping without having to constrain all four vertices).
 float Terrain::get_height(float x, float z) {
-  int x0 = (int) floor(x);
-  int x1 = x0 + 1;
-
-  int z0 = (int) floor(z);
-  int z1 = z0 + 1;
-
-  float h00 = get_vertex_height(x0, z0);
-  float h10 = get_vertex_height(x1, z0);
-
-  float h01 = get_vertex_height(x0, z1);
-  float h11 = get_vertex_height(x1, z1);
-
-  float dx = x - x0;
-  float dz = z - z0;
-  float dxdz = dx * dz;
-
-  return h00 * (1.0f - dz - dx + dxdz) + h10 * (dx - dxdz) + h11 * dxdz + h01 * (dz - dxdz);
+  return height_field_.get_height(x, z);
 }
 
 // gets the point on the terrain that the camera is currently looking at
@@ -252,9 +297,7 @@ fw::Vector Terrain::get_camera_lookat() {
   return get_cursor_location(start, direction);
 }
 
-// This method is fairly simple, we just trace a line from the camera through the cursor point to the end of the
-// terrain, projected in the (x,y) plane (so it's a nice, easy 2D line). Then, for each 2D point on that line, we check
-// how close the ray is to that point in 3D-space. If it's close enough, we return that one.
+// We cast a ray from the camera through the cursor point and return the first point where it hits the terrain.
 fw::Vector Terrain::get_cursor_location() {
   fw::Framework *frmwrk = fw::Framework::get_instance();
   fw::Input *Input = frmwrk->get_input();
@@ -274,68 +317,23 @@ fw::Vector Terrain::get_cursor_location() {
   return get_cursor_location(start, direction);
 }
 
+// The height pyramid lets us skip over everything the ray passes above, so we only test the triangles of the few cells
+// where it gets down near the ground.
 fw::Vector Terrain::get_cursor_location(fw::Vector const &start, fw::Vector const &direction) {
-  fw::Vector evec = start + (direction * 150.0f);
-  fw::Vector svec = start + (direction * 5.0f);
-
-  // TODO: we use the same algorithm here and in PathFfind::is_passable(fw::Vector const &start, fw::Vector const &end)
-  // can we factor it out?
-  int sx = static_cast<int>(floor(svec[0] + 0.5f));
-  int sz = static_cast<int>(floor(svec[2] + 0.5f));
-  int ex = static_cast<int>(floor(evec[0] + 0.5f));
-  int ez = static_cast<int>(floor(evec[2] + 0.5f));
-
-  int dx = ex - sx;
-  int dz = ez - sz;
-  int abs_dx = abs(dx);
-  int abs_dz = abs(dz);
-
-  int steps = (abs_dx > abs_dz) ? abs_dx : abs_dz;
-
-  float xinc = dx / static_cast<float>(steps);
-  float zinc = dz / static_cast<float>(steps);
-
-  float x = static_cast<float>(sx);
-  float z = static_cast<float>(sz);
-  for (int i = 0; i <= steps; i++) {
-    // We actually check in a 9x9 matrix around this point, to make sure we check all possible candidates. Because we
-    // return as soon as match is found, this shouldn't be too bad...
-    int ix = static_cast<int>(floor(x + 0.5f));
-    int iz = static_cast<int>(floor(z + 0.5f));
-    for (int oz = iz - 1; oz <= iz + 1; oz++) {
-      for (int ox = ix - 1; ox <= ix + 1; ox++) {
-        float x1 = static_cast<float>(ox);
-        float x2 = static_cast<float>(ox + 1);
-        float z1 = static_cast<float>(oz);
-        float z2 = static_cast<float>(oz + 1);
-
-        fw::Vector p11(x1, get_vertex_height(static_cast<int>(x1), static_cast<int>(z1)), z1);
-        fw::Vector p21(x2, get_vertex_height(static_cast<int>(x2), static_cast<int>(z1)), z1);
-        fw::Vector p12(x1, get_vertex_height(static_cast<int>(x1), static_cast<int>(z2)), z2);
-        fw::Vector p22(x2, get_vertex_height(static_cast<int>(x2), static_cast<int>(z2)), z2);
-
-        fw::Vector n1 = fw::cross(p12 - p11, p21 - p11);
-        fw::Vector n2 = fw::cross(p21 - p22, p12 - p22);
-
-        // The line intersects the plane defined by the first triangle at i1. If that's within this triangle's "x,z"
-        // coordinates, this is the intersection point!
-        fw::Vector i1 = fw::point_plane_intersect(p11, n1, start, direction);
-        if (i1[0] > x1 && i1[0] <= x2 && i1[2] > z1 && i1[2] <= z2) {
-          return i1;
-        }
-
-        // Same calculation for the second triangle
-        fw::Vector i2 = fw::point_plane_intersect(p22, n2, start, direction);
-        if (i2[0] > x1 && i2[0] <= x2 && i2[2] > z1 && i2[2] <= z2) {
-          return i2;
-        }
-      }
-    }
-
-    x += xinc;
-    z += zinc;
+  fw::Ray ray;
+  ray.start = start;
+  ray.direction = direction;
+  ray.min_distance = 5.0f;
+  ray.max_distance = 150.0f;
+
+  fw::RayHit hit;
+  if (height_pyramid_.raycast(ray, hit)) {
+    return hit.location;
   }
-
   return fw::Vector(0, 0, 0);
 }
+
+bool Terrain::has_line_of_sight(fw::Vector const &from, fw::Vector const &to) const {
+  return !height_pyramid_.is_occluded(from, to);
+}
 }
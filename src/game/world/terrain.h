@@ -5,7 +5,11 @@
 #include <stdint.h>
 
 #include <framework/bitmap.h>
+#include <framework/height_field.h>
+#include <framework/height_pyramid.h>
 #include <framework/math.h>
+#include <framework/misc.h>
+#include <framework/passability_grid.h>
 #include <framework/scenegraph.h>
 #include <framework/status.h>
 #include <framework/texture.h>
@@ -15,6 +19,9 @@ class VertexBuffer;
 class IndexBuffer;
 class Shader;
 class ShaderParameters;
+namespace vertex {
+struct xyz_n;
+}
 }
 
 namespace ed {
@@ -38,6 +45,9 @@ class Terrain {
 public:
   static const int PATCH_SIZE = 64;
 
+  // Vertices whose slope (see fw::HeightField::get_vertex_slope) is more than this are passable.
+  static constexpr float MIN_PASSABLE_SLOPE = 0.85f;
+
 private:
   std::vector<std::shared_ptr<TerrainPatch>> patches_;
   std::shared_ptr<fw::IndexBuffer> ib_;
@@ -51,12 +61,22 @@ protected:
   friend class WorldReader;
 
   std::shared_ptr<fw::TextureArray> textures_;
-  std::vector<bool> collision_data_;
 
   const int width_;
   const int length_;
   float *heights_;
 
+  // A copy of heights_ (plus the normals) that's laid out for sampling. If you change heights_, you need to update
+  // this as well.
+  fw::HeightField height_field_;
+
+  // The min/max pyramid over height_field_ that we cast rays against. Update this whenever you update height_field_.
+  fw::HeightPyramid height_pyramid_;
+
+  // Which vertices units can walk over, and the slope at each one. The path finders share this, so if you change it,
+  // tell them (see fw::HierarchicalPathFind::update_passability).
+  std::shared_ptr<fw::PassabilityGrid> passability_;
+
   // get the width/height of the terrain in patches
   int get_patches_width() const {
     return (width_ / PATCH_SIZE);
@@ -72,6 +92,15 @@ protected:
   // passed to our vertex Shader. cool!
   void bake_patch(int patch_x, int patch_z);
 
+  // Uploads the vertices we generated for the given patch (see generate_terrain_vertices). Must be called on the render
+  // thread, but the vertices can be generated on any thread.
+  void upload_patch(int patch_x, int patch_z, fw::vertex::xyz_n const *vert_data, int num_verts);
+
+  // Uploads just the vertices of the patch that are in rect (in the patch's own coordinates), which vert_data has one
+  // row of the rectangle after another. Must be called on the render thread.
+  void upload_patch_rect(
+      int patch_x, int patch_z, fw::Rectangle<int> const &rect, fw::vertex::xyz_n const *vert_data);
+
   // gets or sets the splatt texture for the given patch
   std::shared_ptr<fw::Texture> get_patch_splatt(int patch_x, int patch_z);
   std::shared_ptr<fw::Texture> create_splatt(fw::Bitmap const& bmp);
@@ -94,6 +123,11 @@ public:
   // gets the height above the terrain at the given (x,z) coordinates.
   float get_height(float x, float z);
 
+  // gets the height field, for when you want the normals as well, or have a lot of points to sample at once.
+  fw::HeightField const &get_height_field() const {
+    return height_field_;
+  }
+
   inline int get_width() const {
     return width_;
   }
@@ -103,9 +137,12 @@ public:
 
   virtual void set_splatt(int patch_x, int patch_z, fw::Bitmap const &bmp);
 
-  // gets the collision data for the map
-  std::vector<bool> const &get_collision_data() const {
-    return collision_data_;
+  // Gets the passability (and slope) of each vertex of the map. The PathingThread's workers search this (and the
+  // abstract graph built over it) without a lock, so it must never change while a PathingThread is running. In the
+  // game it never changes at all: only EditorTerrain::update_passability changes it, and EditorWorld doesn't start a
+  // PathingThread.
+  std::shared_ptr<fw::PassabilityGrid> const &get_passability() const {
+    return passability_;
   }
 
   // Gets the (x,y,z) location of the point on the terrain where the cursor is pointing
@@ -115,6 +152,14 @@ public:
 
   // Gets the (x,y,z) of the point on the terrain that the camera is looking at
   fw::Vector get_camera_lookat();
+
+  // Returns true if nothing on the terrain is in the way between from and to. Both points must be above the ground.
+  bool has_line_of_sight(fw::Vector const &from, fw::Vector const &to) const;
+
+  // Gets the pyramid we cast rays against, for when you've got a lot of rays to cast at once.
+  fw::HeightPyramid const &get_height_pyramid() const {
+    return height_pyramid_;
+  }
 };
 
 }
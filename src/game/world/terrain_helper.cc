@@ -1,6 +1,7 @@
 
 #include <framework/misc.h>
 #include <framework/graphics.h>
+#include <framework/height_field.h>
 
 #include <game/world/terrain_helper.h>
 
@@ -57,38 +58,10 @@ void generate_terrain_indices_wireframe(std::vector<uint16_t> &indices, int patc
   }
 }
 
-// gets the height of a vertex at the given (x,z) location, using fw::constrain() to
-// constrain the coordinates to the width/length.
-fw::Vector get_vertex(int x, int z, float *height, int width, int length) {
-  int ix = fw::constrain(x, width);
-  int iz = fw::constrain(z, length);
-
-  return fw::Vector((float) x, height[iz * width + ix], (float) z);
-}
-
-// calculates the normal at the given location in the map
-fw::Vector calculate_normal(float *heights, int width, int length, int x, int z) {
-  fw::Vector center = get_vertex(x, z, heights, width, length);
-  fw::Vector north = get_vertex(x, z + 1, heights, width, length);
-  fw::Vector south = get_vertex(x, z - 1, heights, width, length);
-  fw::Vector east = get_vertex(x + 1, z, heights, width, length);
-  fw::Vector west = get_vertex(x - 1, z, heights, width, length);
-
-  fw::Vector a = north - center;
-  fw::Vector b = east - center;
-  fw::Vector c = south - center;
-  fw::Vector d = west - center;
-
-  fw::Vector normal(0, 0, 0);
-  normal += fw::cross(a, b);
-  normal += fw::cross(b, c);
-  normal += fw::cross(c, d);
-  normal += fw::cross(d, a);
-  return normal.normalized();
-}
-
-int generate_terrain_vertices(fw::vertex::xyz_n **buffer, float *height, int width, int length,
+int generate_terrain_vertices(fw::vertex::xyz_n **buffer, fw::HeightField const &height_field,
     int patch_size /* = 0 */, int patch_x /* = 0 */, int patch_z /* = 0 */) {
+  const int width = height_field.get_width();
+  const int length = height_field.get_length();
   if (patch_size == 0) {
     if (width != length) {
       LOG(ERR) << "if you don't specify a patch_size, width and height must be the same";
@@ -103,11 +76,11 @@ int generate_terrain_vertices(fw::vertex::xyz_n **buffer, float *height, int wid
     for (int x = 0; x <= patch_size; x++) {
       int ix = (patch_x * patch_size) + x;
       int iz = (patch_z * patch_size) + z;
-      fw::Vector center = get_vertex(ix, iz, height, width, length);
-      fw::Vector normal = calculate_normal(height, width, length, ix, iz);
+      float height = height_field.get_vertex_height(ix, iz);
+      fw::Vector normal = height_field.get_vertex_normal(ix, iz);
 
       int verts_index = z * (patch_size + 1) + x;
-      (*buffer)[verts_index] = fw::vertex::xyz_n(x, center[1], z, normal[0],
+      (*buffer)[verts_index] = fw::vertex::xyz_n(x, height, z, normal[0],
           normal[1], normal[2]);
     }
   }
@@ -115,20 +88,20 @@ int generate_terrain_vertices(fw::vertex::xyz_n **buffer, float *height, int wid
   return (patch_size + 1) * (patch_size + 1);
 }
 
-fw::Status BuildCollisionData(std::vector<bool> &vertices, float *heights,  int width, int length) {
-  fw::Vector up(0, 1, 0);
-
-  for (int z = 0; z < length; z++) {
-    for (int x = 0; x < width; x++) {
-      fw::Vector normal = calculate_normal(heights, width, length, x, z);
-      float dot = fw::dot(up, normal);
-
-      // todo: we should store the actual dot product, since it could be useful in other places.
-      vertices[x + (z * width)] = (dot > 0.85f);
+void generate_terrain_vertices(std::vector<fw::vertex::xyz_n> &vertices, fw::HeightField const &height_field,
+    int patch_size, int patch_x, int patch_z, fw::Rectangle<int> const &rect) {
+  vertices.resize(rect.width * rect.height);
+  for (int z = 0; z < rect.height; z++) {
+    for (int x = 0; x < rect.width; x++) {
+      int ix = (patch_x * patch_size) + rect.left + x;
+      int iz = (patch_z * patch_size) + rect.top + z;
+      float height = height_field.get_vertex_height(ix, iz);
+      fw::Vector normal = height_field.get_vertex_normal(ix, iz);
+
+      vertices[z * rect.width + x] = fw::vertex::xyz_n(rect.left + x, height, rect.top + z, normal[0],
+          normal[1], normal[2]);
     }
   }
-
-  return fw::OkStatus();
 }
 
 }
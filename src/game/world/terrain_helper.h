@@ -1,8 +1,12 @@
 #pragma once
 
+#include <vector>
+
+#include <framework/misc.h>
 #include <framework/status.h>
 
 namespace fw {
+class HeightField;
 namespace vertex {
 struct xyz_n;
 }
@@ -21,13 +25,13 @@ void generate_terrain_indices_wireframe(std::vector<uint16_t> &indices, int patc
 //
 // patch_x, patch_y is the patch offset into the given height data that we want to
 // generate data for
-// height is a pointer to the actual height data we're going to generate the terrain for
-// width, height is the width/height of the total terrain data
-int generate_terrain_vertices(fw::vertex::xyz_n **buffer, float *height,
-    int width, int length, int patch_size = 0, int patch_x = 0,
-    int patch_z = 0);
-
-// see editor_terrain::BuildCollisionData, which we're based off of
-fw::Status BuildCollisionData(std::vector<bool> &vertices, float *heights, int width, int length);
+// height_field holds the heights (and normals) of the whole terrain we're going to generate the patch for
+int generate_terrain_vertices(fw::vertex::xyz_n **buffer, fw::HeightField const &height_field,
+    int patch_size = 0, int patch_x = 0, int patch_z = 0);
+
+// Like the above, but only generates the vertices of the patch that are in rect (in the patch's own coordinates, which
+// go from 0 to patch_size inclusive), one row of the rectangle after another.
+void generate_terrain_vertices(std::vector<fw::vertex::xyz_n> &vertices, fw::HeightField const &height_field,
+    int patch_size, int patch_x, int patch_z, fw::Rectangle<int> const &rect);
 
 }
@@ -23,6 +23,7 @@
 #include <game/screens/hud/pause_window.h>
 #include <game/simulation/simulation_thread.h>
 #include <game/simulation/local_player.h>
+#include <game/simulation/snapshot.h>
 
 namespace fs = std::filesystem;
 using namespace std::placeholders;
@@ -56,26 +57,30 @@ void World::initialize() {
     player_starts_[it.first] = it.second;
   }
 
+  World::set_instance(this);
+
+  initialize_entities();
+  initialize_presentation();
+  initialize_pathing();
+
+  initialized_ = true;
+}
+
+void World::initialize_presentation() {
   // tell the Particle manager to wrap particles at the world boundary
   fw::Framework::get_instance()->get_particle_mgr()->set_world_wrap(
       terrain_->get_width(), terrain_->get_length());
 
   fw::Input *input = fw::Framework::get_instance()->get_input();
-
-  World::set_instance(this);
-
-  initialize_entities();
   if (entities_ != nullptr) {
     cursor_->initialize();
     keybind_tokens_.push_back(
         input->bind_function("pause", std::bind(&World::on_key_pause, this, _1, _2)));
+    keybind_tokens_.push_back(
+        input->bind_function("snapshot", std::bind(&World::on_key_snapshot, this, _1, _2)));
   }
   keybind_tokens_.push_back(
       input->bind_function("screenshot", std::bind(&World::on_key_screenshot, this, _1, _2)));
-
-  initialize_pathing();
-
-  initialized_ = true;
 }
 
 void World::destroy() {
@@ -120,6 +125,21 @@ void World::on_key_screenshot(std::string, bool is_down) {
   }
 }
 
+void World::on_key_snapshot(std::string, bool is_down) {
+  if (!is_down) {
+    LOG(INFO) << "requesting snapshot";
+    SimulationThread::get_instance()->request_snapshot([](std::shared_ptr<Snapshot> snapshot) {
+      fs::path path = fw::resolve("snapshot.rps", true);
+      auto status = snapshot->save(path);
+      if (!status.ok()) {
+        LOG(ERR) << "error saving snapshot: " << status;
+        return;
+      }
+      LOG(INFO) << "saved " << snapshot->get_bytes().size() << " byte snapshot to " << path.string();
+    });
+  }
+}
+
 void World::screenshot_callback(fw::Bitmap const &screenshot) {
   // screenshots go under the data directory\screens folder
   fs::path base_path = fw::resolve("screens", true);
@@ -47,6 +47,7 @@ private:
 
   void on_key_pause(std::string key, bool is_down);
   void on_key_screenshot(std::string key, bool is_down);
+  void on_key_snapshot(std::string key, bool is_down);
 
   // This is called after a screenshot is taken, we'll save it to disk.
   void screenshot_callback(fw::Bitmap const &screenshot);
@@ -57,6 +58,10 @@ protected:
   virtual void initialize_pathing();
   virtual void initialize_entities();
 
+  // Initializes the things that are only there for the player looking at the world: particles, the cursor and key
+  // bindings.
+  virtual void initialize_presentation();
+
 public:
   // constructs a new world using the information from the given world_reader.
   World(std::shared_ptr<WorldReader> reader);
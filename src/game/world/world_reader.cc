@@ -1,6 +1,8 @@
 #include <game/world/world_reader.h>
 
+#include <algorithm>
 #include <memory>
+#include <thread>
 
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
@@ -11,23 +13,92 @@
 #include <framework/graphics.h>
 #include <framework/logging.h>
 #include <framework/misc.h>
+#include <framework/pack_file.h>
+#include <framework/settings.h>
 #include <framework/status.h>
+#include <framework/thread_pool.h>
 #include <framework/xml.h>
 
+#include <game/world/packed_map.h>
 #include <game/world/world.h>
 #include <game/world/world_vfs.h>
 #include <game/world/terrain.h>
 
 namespace game {
 
+int GetNumLoaderThreads() {
+  int num_threads = fw::Settings::get<int>("loader-threads");
+  if (num_threads < 0) {
+    // The thread that's loading the map helps out as well. The render thread is mostly idle while we load.
+    num_threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0, 8);
+  }
+  return num_threads;
+}
+
 WorldReader::WorldReader() :
-    terrain_(nullptr) {
+    num_jobs_(1), num_jobs_done_(0), terrain_(nullptr) {
 }
 
 WorldReader::~WorldReader() {
 }
 
+float WorldReader::get_progress() {
+  std::unique_lock<std::mutex> lock(progress_mutex_);
+  return static_cast<float>(num_jobs_done_) / num_jobs_;
+}
+
+void WorldReader::finish_job() {
+  float progress;
+  {
+    std::unique_lock<std::mutex> lock(progress_mutex_);
+    num_jobs_done_++;
+    progress = static_cast<float>(num_jobs_done_) / num_jobs_;
+  }
+
+  // Emit without holding the lock, so a handler can call get_progress().
+  sig_progress.Emit(progress);
+}
+
+fw::Status WorldReader::RunJobs(fw::ThreadPool &thread_pool, std::vector<std::function<fw::Status()>> const &jobs) {
+  {
+    std::unique_lock<std::mutex> lock(progress_mutex_);
+    num_jobs_ = static_cast<int>(jobs.size()) + 1;
+    num_jobs_done_ = 0;
+  }
+  finish_job();
+
+  std::vector<fw::Status> statuses(jobs.size());
+  thread_pool.parallel_for(jobs.size(), 1, [&jobs, &statuses, this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      statuses[i] = jobs[i]();
+      finish_job();
+    }
+  });
+
+  for (fw::Status const &status : statuses) {
+    RETURN_IF_ERROR(status);
+  }
+  return fw::OkStatus();
+}
+
+void WorldReader::set_splatts(std::vector<fw::Bitmap> const &splatts) {
+  for (int patch_z = 0; patch_z < terrain_->get_patches_length(); patch_z++) {
+    for (int patch_x = 0; patch_x < terrain_->get_patches_width(); patch_x++) {
+      terrain_->set_splatt(patch_x, patch_z, splatts[patch_z * terrain_->get_patches_width() + patch_x]);
+    }
+  }
+}
+
 fw::Status WorldReader::Read(std::string name) {
+  fw::ThreadPool thread_pool(GetNumLoaderThreads());
+
+  auto packed_path = FindPackedMap(name);
+  if (packed_path.ok()) {
+    name_ = name;
+    ASSIGN_OR_RETURN(auto pack, fw::PackReader::open(*packed_path));
+    return ReadPacked(*pack, thread_pool);
+  }
+
   ASSIGN_OR_RETURN(WorldFile wf, OpenWorldFile(name, false));
 
   int version;
@@ -49,13 +120,16 @@ fw::Status WorldReader::Read(std::string name) {
   name_ = name;
   ASSIGN_OR_RETURN(terrain_, create_terrain(trn_width, trn_length, height_data));
 
+  std::vector<std::function<fw::Status()>> jobs;
+  std::vector<fw::Bitmap> splatts(terrain_->get_patches_width() * terrain_->get_patches_length());
   for (int patch_z = 0; patch_z < terrain_->get_patches_length(); patch_z++) {
     for (int patch_x = 0; patch_x < terrain_->get_patches_width(); patch_x++) {
-      std::string name = absl::StrCat("splatt-", patch_x, "-", patch_z, ".png");
-      wfe = wf.get_entry(name, false /* for_write */);
-
-      ASSIGN_OR_RETURN(auto splatt, fw::LoadBitmap(wfe.get_full_path().c_str()));
-      terrain_->set_splatt(patch_x, patch_z, splatt);
+      std::string path = wf.get_entry(absl::StrCat("splatt-", patch_x, "-", patch_z, ".png"), false).get_full_path();
+      fw::Bitmap &splatt = splatts[patch_z * terrain_->get_patches_width() + patch_x];
+      jobs.push_back([path, &splatt]() {
+        ASSIGN_OR_RETURN(splatt, fw::LoadBitmap(path));
+        return fw::OkStatus();
+      });
     }
   }
 
@@ -63,29 +137,46 @@ fw::Status WorldReader::Read(std::string name) {
   if (wfe.exists()) {
     wfe.close();
 
-    ASSIGN_OR_RETURN(minimap_background_, fw::LoadBitmap(wfe.get_full_path()));
+    std::string path = wfe.get_full_path();
+    jobs.push_back([path, this]() {
+      ASSIGN_OR_RETURN(minimap_background_, fw::LoadBitmap(path));
+      return fw::OkStatus();
+    });
   }
 
   wfe = wf.get_entry("screenshot.png", false /* for_write */);
   if (wfe.exists()) {
     wfe.close();
 
-    ASSIGN_OR_RETURN(screenshot_, fw::LoadBitmap(wfe.get_full_path()));
+    std::string path = wfe.get_full_path();
+    jobs.push_back([path, this]() {
+      ASSIGN_OR_RETURN(screenshot_, fw::LoadBitmap(path));
+      return fw::OkStatus();
+    });
   }
 
   wfe = wf.get_entry(name + ".mapdesc", false /* for_write */);
   if (wfe.exists()) {
     wfe.close();
 
-    ASSIGN_OR_RETURN(fw::XmlElement root, fw::LoadXml(wfe.get_full_path(), "mapdesc", 1));
-    RETURN_IF_ERROR(ReadMapdesc(root));
+    std::string path = wfe.get_full_path();
+    jobs.push_back([path, this]() {
+      ASSIGN_OR_RETURN(fw::XmlElement root, fw::LoadXml(path, "mapdesc", 1));
+      return ReadMapdesc(root);
+    });
   }
 
   wfe = wf.get_entry("collision_data", false /* for_write */);
   if (wfe.exists()) {
-    RETURN_IF_ERROR(ReadCollisionData(wfe));
+    wfe.close();
+
+    jobs.push_back([wfe, this]() mutable {
+      return ReadCollisionData(wfe);
+    });
   }
 
+  RETURN_IF_ERROR(RunJobs(thread_pool, jobs));
+  set_splatts(splatts);
   return fw::OkStatus();
 }
 
@@ -100,12 +191,72 @@ fw::Status WorldReader::ReadCollisionData(WorldFileEntry &wfe) {
   wfe.read(&width, sizeof(int));
   wfe.read(&length, sizeof(int));
 
-  for (int i = 0; i < (width * length); i++) {
-    uint8_t n;
-    wfe.read(&n, sizeof(uint8_t));
-    terrain_->collision_data_.push_back(n != 0);
+  if (width != terrain_->get_width() || length != terrain_->get_length()) {
+    return fw::ErrorStatus("collision_data is ") << width << "x" << length << ", but the map is "
+        << terrain_->get_width() << "x" << terrain_->get_length();
+  }
+
+  std::vector<uint8_t> data(width * length);
+  wfe.read(data.data(), data.size());
+  fw::PassabilityGrid &passability = *terrain_->passability_;
+  for (int z = 0; z < length; z++) {
+    for (int x = 0; x < width; x++) {
+      passability.set_passable(x, z, data[(z * width) + x] != 0);
+    }
+  }
+
+  return fw::OkStatus();
+}
+
+fw::Status WorldReader::ReadPacked(fw::PackReader const &pack, fw::ThreadPool &thread_pool) {
+  ASSIGN_OR_RETURN(PackedHeightfield heightfield, ReadPackedHeightfield(pack));
+
+  // The heights are right there in the mapped file, but the terrain owns its heights (and the editor changes them), so
+  // it gets a copy.
+  float *height_data = new float[heightfield.heights.size()];
+  std::copy(heightfield.heights.begin(), heightfield.heights.end(), height_data);
+  ASSIGN_OR_RETURN(terrain_, create_terrain(heightfield.width, heightfield.length, height_data));
+
+  // The PackReader is safe to read from multiple threads at once.
+  std::vector<std::function<fw::Status()>> jobs;
+  std::vector<fw::Bitmap> splatts(terrain_->get_patches_width() * terrain_->get_patches_length());
+  for (int patch_z = 0; patch_z < terrain_->get_patches_length(); patch_z++) {
+    for (int patch_x = 0; patch_x < terrain_->get_patches_width(); patch_x++) {
+      std::string entry_name = GetPackedSplattEntry(patch_x, patch_z);
+      fw::Bitmap &splatt = splatts[patch_z * terrain_->get_patches_width() + patch_x];
+      jobs.push_back([&pack, entry_name, &splatt]() {
+        ASSIGN_OR_RETURN(splatt, ReadPackedImage(pack, entry_name));
+        return fw::OkStatus();
+      });
+    }
+  }
+
+  if (pack.has_entry(kPackedMinimapEntry)) {
+    jobs.push_back([&pack, this]() {
+      ASSIGN_OR_RETURN(minimap_background_, ReadPackedImage(pack, kPackedMinimapEntry));
+      return fw::OkStatus();
+    });
+  }
+  if (pack.has_entry(kPackedScreenshotEntry)) {
+    jobs.push_back([&pack, this]() {
+      ASSIGN_OR_RETURN(screenshot_, ReadPackedImage(pack, kPackedScreenshotEntry));
+      return fw::OkStatus();
+    });
+  }
+  if (pack.has_entry(kPackedMapdescEntry)) {
+    jobs.push_back([&pack, this]() {
+      ASSIGN_OR_RETURN(fw::XmlElement root, ReadPackedMapdesc(pack));
+      return ReadMapdesc(root);
+    });
+  }
+  if (pack.has_entry(kPackedCollisionDataEntry)) {
+    jobs.push_back([&pack, this]() {
+      return ReadPackedCollisionData(pack, *terrain_->passability_);
+    });
   }
 
+  RETURN_IF_ERROR(RunJobs(thread_pool, jobs));
+  set_splatts(splatts);
   return fw::OkStatus();
 }
 
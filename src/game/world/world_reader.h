@@ -1,15 +1,21 @@
 #pragma once
 
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <framework/bitmap.h>
 #include <framework/math.h>
+#include <framework/signals.h>
 #include <framework/status.h>
 #include <framework/xml.h>
 
 namespace fw {
 class Bitmap;
+class PackReader;
+class ThreadPool;
 class XmlElement;
 }
 
@@ -19,8 +25,25 @@ class Terrain;
 class World;
 class WorldFileEntry;
 
+// Gets the number of extra threads to decode images and bake the terrain with while a map loads (the thread that's
+// loading the map joins in as well).
+int GetNumLoaderThreads();
+
 // this class reads the map from the filesystem and lets the world populate itself.
+//
+// Once we've read the heightfield and created the terrain, everything else (decoding the splatts, minimap and
+// screenshot, parsing the mapdesc and so on) is independent, so we run it all as separate jobs on a fw::ThreadPool.
 class WorldReader {
+private:
+  std::mutex progress_mutex_;
+  int num_jobs_;
+  int num_jobs_done_;
+
+  // Runs each of the given jobs on the thread pool, and returns the first error (if any). Creating the terrain counts
+  // as the first job, so we're already part of the way through when this starts.
+  fw::Status RunJobs(fw::ThreadPool &thread_pool, std::vector<std::function<fw::Status()>> const &jobs);
+  void finish_job();
+
 protected:
   fw::Bitmap minimap_background_;
   fw::Bitmap screenshot_;
@@ -37,11 +60,26 @@ protected:
   fw::Status ReadMapdescPlayers(fw::XmlElement players_node);
   fw::Status ReadCollisionData(WorldFileEntry &wfe);
 
+  // reads a packed map (see packed_map.h), rather than a directory of loose files.
+  fw::Status ReadPacked(fw::PackReader const &pack, fw::ThreadPool &thread_pool);
+
+  // sets all of the splatts we decoded on the terrain.
+  void set_splatts(std::vector<fw::Bitmap> const &splatts);
+
 public:
   WorldReader();
   virtual ~WorldReader();
 
-  // reads the map with the given name and populates our members
+  // Fired as the map loads, with how far through we are (from 0 to 1). The jobs run on a pool of threads, so this can
+  // be fired from any of them, even two at once, and the values can arrive slightly out of order. Bind it to the
+  // loading screen's progress bar.
+  fw::Signal<float /*progress*/> sig_progress;
+
+  // Gets how far through loading the map we are (from 0 to 1). Safe to call from any thread.
+  float get_progress();
+
+  // reads the map with the given name and populates our members. If there's a packed version of the map, we read
+  // that, otherwise we read the loose files.
   fw::Status Read(std::string name);
 
   std::shared_ptr<Terrain> get_terrain() const {
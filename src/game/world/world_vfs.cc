@@ -10,6 +10,7 @@
 #include <framework/status.h>
 #include <framework/xml.h>
 
+#include <game/world/packed_map.h>
 #include <game/world/world_vfs.h>
 
 namespace fs = std::filesystem;
@@ -26,11 +27,28 @@ void PopulateMaps(std::vector<game::WorldSummary> &list, fs::path path) {
   for (fs::directory_iterator it(path); it != fs::directory_iterator(); ++it) {
     fs::path p(*it);
     LOG(DBG) << "  - " << p.string();
+
+    // A map is either a directory of loose files, or a packed map. It can be both (if it's been converted), and it
+    // can be in more than one of the places we look, but we only list it once.
+    std::string name;
     if (fs::is_directory(p)) {
-      game::WorldSummary ws;
-      ws.initialize(p.filename().string());
+      name = p.filename().string();
+    } else if (p.extension() == kPackedMapExtension) {
+      name = p.stem().string();
+    } else {
+      continue;
+    }
 
-      // todo: see if it already exists before adding it
+    bool found = false;
+    for (game::WorldSummary const &existing : list) {
+      if (existing.get_name() == name) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      game::WorldSummary ws;
+      ws.initialize(name);
       list.push_back(ws);
     }
   }
@@ -66,6 +84,16 @@ void WorldSummary::ensure_extra_loaded() const {
   if (extra_loaded_)
     return;
 
+  auto packed_path = FindPackedMap(name_);
+  if (packed_path.ok()) {
+    auto status = LoadPackedSummary(*packed_path);
+    if (!status.ok()) {
+      LOG(ERR) << "error loading packed map summary: " << status;
+    }
+    extra_loaded_ = true;
+    return;
+  }
+
   auto full_path = FindMap(name_);
   if (!full_path.ok()) {
     LOG(ERR) << "map does not exist: " << name_ << ": " << full_path.status();
@@ -90,9 +118,21 @@ void WorldSummary::ensure_extra_loaded() const {
   extra_loaded_ = true;
 }
 
+fw::Status WorldSummary::LoadPackedSummary(fs::path const &path) const {
+  ASSIGN_OR_RETURN(auto pack, fw::PackReader::open(path));
+  if (pack->has_entry(kPackedScreenshotEntry)) {
+    ASSIGN_OR_RETURN(screenshot_, ReadPackedImage(*pack, kPackedScreenshotEntry));
+  }
+  ASSIGN_OR_RETURN(fw::XmlElement xml, ReadPackedMapdesc(*pack));
+  return ParseMapdesc(xml);
+}
+
 fw::Status WorldSummary::ParseMapdescFile(fs::path const &filename) const {
   ASSIGN_OR_RETURN(fw::XmlElement xml, fw::LoadXml(filename, "mapdesc", 1));
+  return ParseMapdesc(xml);
+}
 
+fw::Status WorldSummary::ParseMapdesc(fw::XmlElement const &xml) const {
   for (fw::XmlElement child : xml.children()) {
     if (child.get_value() == "description") {
       description_ = child.get_text();
@@ -155,6 +195,18 @@ fw::StatusOr<WorldFile> OpenWorldFile(std::string name, bool for_writing /*= fal
   return fw::ErrorStatus(absl::StrCat("map '", name, "' doesn't exist"));
 }
 
+fw::StatusOr<fs::path> FindPackedMap(std::string name) {
+  fs::path p = fw::user_base_path() / "maps" / (name + kPackedMapExtension);
+  if (fs::is_regular_file(p))
+    return p;
+
+  p = fw::install_base_path() / "maps" / (name + kPackedMapExtension);
+  if (fs::is_regular_file(p))
+    return p;
+
+  return fw::ErrorStatus("could not find packed map: ") << name;
+}
+
 //-------------------------------------------------------------------------
 
 WorldFileEntry::WorldFileEntry(std::string full_path, bool for_write) :
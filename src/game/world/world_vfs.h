@@ -5,6 +5,7 @@
 #include <memory>
 
 #include <framework/bitmap.h>
+#include <framework/xml.h>
 
 namespace game {
 
@@ -27,6 +28,10 @@ private:
 
   // parse the <mapdesc> file and populate our extra stuff.
   fw::Status ParseMapdescFile(std::filesystem::path const &filename) const;
+  fw::Status ParseMapdesc(fw::XmlElement const &xml) const;
+
+  // load the screenshot and <mapdesc> from a packed map.
+  fw::Status LoadPackedSummary(std::filesystem::path const &path) const;
 
 public:
   WorldSummary();
@@ -121,4 +126,8 @@ std::vector<WorldSummary> ListMaps();
 // opens a new world_file with the complete details of the given map
 fw::StatusOr<WorldFile> OpenWorldFile(std::string name, bool for_writing = false);
 
+// finds the packed version of the given map (see packed_map.h), if there is one. We look in the user's maps first,
+// since that's where the editor saves them.
+fw::StatusOr<std::filesystem::path> FindPackedMap(std::string name);
+
 }
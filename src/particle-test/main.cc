@@ -1,3 +1,5 @@
+#include <atomic>
+#include <fstream>
 #include <iostream>
 
 #include <framework/bitmap.h>
@@ -23,10 +25,17 @@
 fw::Status settings_initialize(int argc, char** argv);
 void display_exception(std::string const &msg);
 
+// The particles are simulated on the update thread, so that's the only thread that touches g_effect. The GUI runs on
+// the render thread, so the buttons just set these flags for Application::update to pick up.
 static std::shared_ptr<fw::ParticleEffect> g_effect;
-static bool is_moving = false;
+static std::atomic<bool> restart_requested(false);
+static std::atomic<bool> is_moving(false);
 static float angle;
 
+// In headless mode, we simulate this many frames and then dump the snapshot the renderer would have drawn.
+static const float DUMP_DT = 1.0f / 40.0f;
+static const fw::Vector DUMP_CAMERA_POSITION(0.0f, 20.0f, -20.0f);
+
 class Application: public fw::BaseApp {
 public:
   fw::Status initialize(fw::Framework *frmwrk);
@@ -43,31 +52,27 @@ void update_effect_position() {
     pos = fw::Vector(0.0f, 0.0f, 0.0f);
   }
 
-  fw::Framework::get_instance()->get_scenegraph_manager()->enqueue(
-    [pos](fw::sg::Scenegraph& scenegraph) {
-      g_effect->set_position(pos);
-    });
+  if (g_effect) {
+    g_effect->set_position(pos);
+  }
 }
 
 void restart_effect() {
-  fw::Framework::get_instance()->get_scenegraph_manager()->enqueue(
-    [](fw::sg::Scenegraph& scenegraph) {
-      if (g_effect) {
-        g_effect->destroy();
-      }
-      auto effect = fw::Framework::get_instance()->get_particle_mgr()->CreateEffect(
-          fw::Settings::get<std::string>("particle-file"), fw::Vector(0, 0, 0));
-      if (!effect.ok()) {
-        LOG(ERR) << "error creating effect: " << effect.status();
-      } else {
-        g_effect = *effect;
-      }
-    });
+  if (g_effect) {
+    g_effect->destroy();
+  }
+  auto effect = fw::Framework::get_instance()->get_particle_mgr()->CreateEffect(
+      fw::Settings::get<std::string>("particle-file"), fw::Vector(0, 0, 0));
+  if (!effect.ok()) {
+    LOG(ERR) << "error creating effect: " << effect.status();
+  } else {
+    g_effect = *effect;
+  }
   update_effect_position();
 }
 
 bool restart_handler(fw::gui::Widget &wdgt) {
-  restart_effect();
+  restart_requested = true;
   return true;
 }
 
@@ -90,7 +95,6 @@ bool movement_handler(fw::gui::Widget &wdgt) {
   if (is_moving) {
     is_moving = false;
     btn.set_text("Stationary");
-    update_effect_position();
   } else {
     is_moving = true;
     btn.set_text("Moving");
@@ -143,10 +147,37 @@ fw::Status Application::initialize(fw::Framework *frmwrk) {
 }
 
 void Application::update(float dt) {
+  if (restart_requested.exchange(false)) {
+    restart_effect();
+  }
+
   if (is_moving) {
     angle += 3.1415f * dt;
-    update_effect_position();
   }
+  update_effect_position();
+}
+
+// Runs the effect without a window: we simulate it for a while on this thread, then write out the snapshot that the
+// renderer would have drawn. We don't seed the random number generator, so the output is the same every time.
+fw::Status dump_snapshot(std::string const &filename) {
+  RETURN_IF_ERROR(fw::LogInitialize());
+
+  fw::ParticleManager particle_mgr;
+  RETURN_IF_ERROR(particle_mgr.Initialize());
+  ASSIGN_OR_RETURN(
+      auto effect, particle_mgr.CreateEffect(fw::Settings::get<std::string>("particle-file"), fw::Vector(0, 0, 0)));
+
+  const int num_frames = fw::Settings::get<int>("dump-frames");
+  for (int i = 0; i < num_frames; i++) {
+    particle_mgr.simulate(DUMP_DT, DUMP_CAMERA_POSITION);
+  }
+
+  std::ofstream out(filename);
+  if (!out) {
+    return fw::ErrorStatus("could not open ") << filename;
+  }
+  particle_mgr.get_latest_snapshot().dump(out);
+  return fw::OkStatus();
 }
 
 //-----------------------------------------------------------------------------
@@ -162,6 +193,17 @@ int main(int argc, char** argv) {
 
     Application app;
     new fw::Framework(&app);
+
+    std::string dump_filename = fw::Settings::get<std::string>("dump-snapshot");
+    if (!dump_filename.empty()) {
+      status = dump_snapshot(dump_filename);
+      if (!status.ok()) {
+        std::cerr << status << std::endl;
+        return 1;
+      }
+      return 0;
+    }
+
     auto continue_or_status = fw::Framework::get_instance()->initialize("Particle Test");
     if (!continue_or_status.ok()) {
       LOG(ERR) << continue_or_status.status();
@@ -201,7 +243,16 @@ fw::Status settings_initialize(int argc, char** argv) {
       .add_setting<std::string>(
           "particle-file",
           "Name of the particle file to load, we assume it can be fw::resolve'd.",
-          "explosion-01");
+          "explosion-01")
+      .add_setting<std::string>(
+          "dump-snapshot",
+          "If set, run headless: simulate the effect for --dump-frames frames and write the particle snapshot the "
+          "renderer would draw to this file.",
+          "")
+      .add_setting<int>(
+          "dump-frames",
+          "Number of frames to simulate before writing --dump-snapshot.",
+          60);
 
   return fw::Settings::initialize(extra_settings, argc, argv, "font-test.conf");
 }